@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+struct iio_attr_batch * iio_context_create_attr_batch(struct iio_context *ctx)
+{
+	struct iio_attr_batch *batch;
+
+	batch = zalloc(sizeof(*batch));
+	if (!batch) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	batch->ctx = ctx;
+	return batch;
+}
+
+void iio_attr_batch_destroy(struct iio_attr_batch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->nb_entries; i++) {
+		free(batch->entries[i].attr);
+		free(batch->entries[i].src);
+	}
+
+	free(batch->entries);
+	free(batch);
+}
+
+static int iio_attr_batch_add(struct iio_attr_batch *batch,
+		const struct iio_device *dev, const struct iio_channel *chn,
+		const char *attr, const char *src, char *dst, size_t len)
+{
+	struct iio_attr_batch_entry *entry, *entries;
+
+	if (!dev || dev->ctx != batch->ctx || (chn && chn->dev != dev))
+		return -EINVAL;
+
+	if (chn ? !iio_channel_find_attr(chn, attr)
+			: !iio_device_find_attr(dev, attr))
+		return -ENOENT;
+
+	entries = realloc(batch->entries,
+			(batch->nb_entries + 1) * sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	batch->entries = entries;
+	entry = &entries[batch->nb_entries];
+	memset(entry, 0, sizeof(*entry));
+
+	entry->attr = iio_strdup(attr);
+	if (!entry->attr)
+		return -ENOMEM;
+
+	if (src) {
+		entry->src = iio_strdup(src);
+		if (!entry->src) {
+			free(entry->attr);
+			return -ENOMEM;
+		}
+	}
+
+	entry->dev = dev;
+	entry->chn = chn;
+	entry->dst = dst;
+	entry->len = len;
+	entry->ret = -EAGAIN;
+
+	return (int) batch->nb_entries++;
+}
+
+int iio_attr_batch_add_read(struct iio_attr_batch *batch,
+		const struct iio_device *dev, const struct iio_channel *chn,
+		const char *attr, char *dst, size_t len)
+{
+	if (!dst || !len)
+		return -EINVAL;
+
+	return iio_attr_batch_add(batch, dev, chn, attr, NULL, dst, len);
+}
+
+int iio_attr_batch_add_write(struct iio_attr_batch *batch,
+		const struct iio_device *dev, const struct iio_channel *chn,
+		const char *attr, const char *src)
+{
+	if (!src)
+		return -EINVAL;
+
+	return iio_attr_batch_add(batch, dev, chn, attr, src, NULL, 0);
+}
+
+static ssize_t iio_attr_batch_run_entry(const struct iio_attr_batch_entry *e)
+{
+	if (e->chn && e->src)
+		return iio_channel_attr_write(e->chn, e->attr, e->src);
+	else if (e->chn)
+		return iio_channel_attr_read(e->chn, e->attr, e->dst, e->len);
+	else if (e->src)
+		return iio_device_attr_write(e->dev, e->attr, e->src);
+	else
+		return iio_device_attr_read(e->dev, e->attr, e->dst, e->len);
+}
+
+int iio_attr_batch_commit(struct iio_attr_batch *batch, bool stop_on_error)
+{
+	const struct iio_backend_ops *ops = batch->ctx->ops;
+	bool stopped = false;
+	unsigned int i;
+	int ret;
+
+	if (ops->commit_attr_batch) {
+		ret = ops->commit_attr_batch(batch, stop_on_error);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	for (i = 0; i < batch->nb_entries; i++) {
+		struct iio_attr_batch_entry *entry = &batch->entries[i];
+
+		if (stopped) {
+			entry->ret = -ECANCELED;
+			continue;
+		}
+
+		entry->ret = iio_attr_batch_run_entry(entry);
+		stopped = stop_on_error && entry->ret < 0;
+	}
+
+	return 0;
+}
+
+ssize_t iio_attr_batch_get_result(const struct iio_attr_batch *batch,
+		unsigned int index)
+{
+	if (index >= batch->nb_entries)
+		return -EINVAL;
+
+	return batch->entries[index].ret;
+}
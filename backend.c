@@ -20,6 +20,8 @@ unsigned int iio_get_backends_count(void)
 	count += WITH_NETWORK_BACKEND;
 	count += WITH_USB_BACKEND;
 	count += WITH_SERIAL_BACKEND;
+	count += WITH_FILE_BACKEND;
+	count += WITH_SYNTHETIC_BACKEND;
 
 	return count;
 }
@@ -56,6 +58,18 @@ const char * iio_get_backend(unsigned int index)
 		index --;
 	}
 
+	if (WITH_FILE_BACKEND) {
+		if (index == 0)
+			return "file";
+		index--;
+	}
+
+	if (WITH_SYNTHETIC_BACKEND) {
+		if (index == 0)
+			return "synthetic";
+		index--;
+	}
+
 	return NULL;
 }
 
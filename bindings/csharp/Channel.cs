@@ -372,6 +372,123 @@ namespace iio
 
         }
 
+        /// <summary>Extract the samples corresponding to this channel from the
+        /// given <see cref="iio.IOBuffer"/> object into caller-provided memory.</summary>
+        /// <param name="buffer">A valid instance of the <see cref="iio.IOBuffer"/> class.</param>
+        /// <param name="array">A <c>byte</c> array where the extracted samples will be stored.</param>
+        /// <param name="raw">If set to <c>true</c>, the samples are not converted from their
+        /// hardware format to their host format.</param>
+        /// <returns>The number of bytes extracted.</returns>
+        /// <exception cref="System.Exception">The samples could not be read.</exception>
+        public uint read(IOBuffer buffer, byte[] array, bool raw = false)
+        {
+            if (!is_enabled())
+            {
+                throw new Exception("Channel must be enabled before the IOBuffer is instantiated");
+            }
+            if (this.output)
+            {
+                throw new Exception("Unable to read from output channel");
+            }
+
+            GCHandle handle = GCHandle.Alloc(array, GCHandleType.Pinned);
+            IntPtr addr = handle.AddrOfPinnedObject();
+            uint count;
+
+            if (raw)
+            {
+                count = iio_channel_read_raw(this.chn, buffer.buf, addr, (uint) array.Length);
+            }
+            else
+            {
+                count = iio_channel_read(this.chn, buffer.buf, addr, (uint) array.Length);
+            }
+            handle.Free();
+
+            return count;
+        }
+
+#if NETCOREAPP2_1_OR_GREATER || NETSTANDARD2_1_OR_GREATER || IIO_HAS_SPAN
+        /// <summary>Extract the samples corresponding to this channel from the
+        /// given <see cref="iio.IOBuffer"/> object into caller-provided memory.</summary>
+        /// <param name="buffer">A valid instance of the <see cref="iio.IOBuffer"/> class.</param>
+        /// <param name="dst">The memory where the extracted samples will be stored.</param>
+        /// <param name="raw">If set to <c>true</c>, the samples are not converted from their
+        /// hardware format to their host format.</param>
+        /// <returns>The number of samples extracted.</returns>
+        /// <exception cref="System.Exception">The samples could not be read.</exception>
+        public unsafe int read<T>(IOBuffer buffer, Span<T> dst, bool raw = false) where T : unmanaged
+        {
+            if (!is_enabled())
+            {
+                throw new Exception("Channel must be enabled before the IOBuffer is instantiated");
+            }
+            if (this.output)
+            {
+                throw new Exception("Unable to read from output channel");
+            }
+
+            uint len = (uint) (dst.Length * sizeof(T));
+            uint count;
+
+            fixed (T *ptr = dst)
+            {
+                if (raw)
+                {
+                    count = iio_channel_read_raw(this.chn, buffer.buf, (IntPtr) ptr, len);
+                }
+                else
+                {
+                    count = iio_channel_read(this.chn, buffer.buf, (IntPtr) ptr, len);
+                }
+            }
+
+            uint size = sample_size * Math.Max(format.repeat, 1u);
+
+            return size != 0 ? (int) (count / size) : 0;
+        }
+
+        /// <summary>
+        /// Write the specified samples corresponding to this channel into the
+        /// given <see cref="iio.IOBuffer"/> object.</summary>
+        /// <param name="buffer">A valid instance of the <see cref="iio.IOBuffer"/> class.</param>
+        /// <param name="src">The samples to write.</param>
+        /// <param name="raw">If set to <c>true</c>, the samples are not converted from their
+        /// host format to their native format.</param>
+        /// <returns>The number of samples written.</returns>
+        /// <exception cref="System.Exception">The samples could not be written.</exception>
+        public unsafe int write<T>(IOBuffer buffer, ReadOnlySpan<T> src, bool raw = false) where T : unmanaged
+        {
+            if (!is_enabled())
+            {
+                throw new Exception("Channel must be enabled before the IOBuffer is instantiated");
+            }
+            if (!this.output)
+            {
+                throw new Exception("Unable to write to an input channel");
+            }
+
+            uint len = (uint) (src.Length * sizeof(T));
+            uint count;
+
+            fixed (T *ptr = src)
+            {
+                if (raw)
+                {
+                    count = iio_channel_write_raw(this.chn, buffer.buf, (IntPtr) ptr, len);
+                }
+                else
+                {
+                    count = iio_channel_write(this.chn, buffer.buf, (IntPtr) ptr, len);
+                }
+            }
+
+            uint size = sample_size * Math.Max(format.repeat, 1u);
+
+            return size != 0 ? (int) (count / size) : 0;
+        }
+#endif
+
         /// <summary>
         /// Write the specified array of samples corresponding to this channel into the
         /// given <see cref="iio.IOBuffer"/> object.</summary>
@@ -7,6 +7,9 @@
  */
 
 using System;
+#if NETCOREAPP2_1_OR_GREATER || NETSTANDARD2_1_OR_GREATER || IIO_HAS_SPAN
+using System.Buffers;
+#endif
 using System.Collections.Generic;
 using System.Linq;
 using System.Runtime.InteropServices;
@@ -180,6 +183,103 @@ namespace iio
             Marshal.Copy(iio_buffer_start(buf), array, 0, (int)length);
         }
 
+#if NETCOREAPP2_1_OR_GREATER || NETSTANDARD2_1_OR_GREATER || IIO_HAS_SPAN
+        private sealed unsafe class NativeMemoryManager : MemoryManager<byte>
+        {
+            private readonly IntPtr ptr;
+            private readonly int length;
+
+            public NativeMemoryManager(IntPtr ptr, int length)
+            {
+                this.ptr = ptr;
+                this.length = length;
+            }
+
+            public override Span<byte> GetSpan()
+            {
+                return new Span<byte>((void *) ptr, length);
+            }
+
+            /* The memory belongs to libiio, it never moves */
+            public override MemoryHandle Pin(int elementIndex = 0)
+            {
+                return new MemoryHandle((byte *) ptr + elementIndex);
+            }
+
+            public override void Unpin()
+            {
+            }
+
+            protected override void Dispose(bool disposing)
+            {
+            }
+        }
+
+        /// <summary>Gives access to the samples of the <see cref="iio.IOBuffer"/> object, without copying them.</summary>
+        /// <returns>A span over the memory of the buffer.</returns>
+        /// <remarks>The span is only valid until the next call to <see cref="refill"/> or
+        /// <see cref="push()"/>, which can move the samples.</remarks>
+        public unsafe Span<byte> get_span()
+        {
+            IntPtr start = iio_buffer_start(buf);
+            long length = (long) iio_buffer_end(buf) - (long) start;
+
+            return new Span<byte>((void *) start, (int) length);
+        }
+
+        /// <summary>Gives access to the samples of the <see cref="iio.IOBuffer"/> object as
+        /// values of type <typeparamref name="T"/>, without copying them.</summary>
+        /// <returns>A span over the memory of the buffer.</returns>
+        /// <remarks>See <see cref="get_span()"/>.</remarks>
+        public Span<T> get_span<T>() where T : unmanaged
+        {
+            return MemoryMarshal.Cast<byte, T>(get_span());
+        }
+
+        /// <summary>Gives access to the samples of the <see cref="iio.IOBuffer"/> object, without copying them,
+        /// from asynchronous code.</summary>
+        /// <returns>A <c>Memory</c> over the memory of the buffer.</returns>
+        /// <remarks>See <see cref="get_span()"/>.</remarks>
+        public Memory<byte> get_memory()
+        {
+            IntPtr start = iio_buffer_start(buf);
+            long length = (long) iio_buffer_end(buf) - (long) start;
+
+            return new NativeMemoryManager(start, (int) length).Memory;
+        }
+
+        /// <summary>Copy the given samples inside the <see cref="iio.IOBuffer"/> object.</summary>
+        /// <param name="src">The samples that should be written.</param>
+        /// <returns>The number of bytes written.</returns>
+        /// <remarks>The number of samples written will not exceed the size of the buffer.</remarks>
+        public int fill(ReadOnlySpan<byte> src)
+        {
+            Span<byte> dst = get_span();
+
+            if (src.Length < dst.Length)
+            {
+                dst = dst.Slice(0, src.Length);
+            }
+            src.Slice(0, dst.Length).CopyTo(dst);
+            return dst.Length;
+        }
+
+        /// <summary>Extract the samples from the <see cref="iio.IOBuffer"/> object into caller-provided memory.</summary>
+        /// <param name="dst">The memory where the samples should be stored.</param>
+        /// <returns>The number of bytes extracted.</returns>
+        public int read(Span<byte> dst)
+        {
+            Span<byte> src = get_span();
+
+            if (dst.Length < src.Length)
+            {
+                src = src.Slice(0, dst.Length);
+            }
+            src.CopyTo(dst);
+            return src.Length;
+        }
+#endif
+
         /// <summary>Returns poll file descriptor for the current buffer.</summary>
         public int get_poll_fd()
         {
@@ -115,6 +115,7 @@ class DataFormat(Structure):
         ("with_scale", c_bool),
         ("scale", c_double),
         ("repeat", c_uint),
+        ("offset", c_double),
     ]
 
 
@@ -555,6 +556,36 @@ _c_read_raw.argtypes = (
     c_size_t,
 )
 
+_c_read_block = _lib.iio_channel_read_block
+_c_read_block.restype = c_size_t
+_c_read_block.argtypes = (
+    _ChannelPtr,
+    _BufferPtr,
+    c_void_p,
+    c_size_t,
+    c_size_t,
+)
+
+_c_read_float = _lib.iio_channel_read_float
+_c_read_float.restype = c_size_t
+_c_read_float.argtypes = (
+    _ChannelPtr,
+    _BufferPtr,
+    c_void_p,
+    c_size_t,
+    c_size_t,
+)
+
+_c_read_double = _lib.iio_channel_read_double
+_c_read_double.restype = c_size_t
+_c_read_double.argtypes = (
+    _ChannelPtr,
+    _BufferPtr,
+    c_void_p,
+    c_size_t,
+    c_size_t,
+)
+
 _c_write = _lib.iio_channel_write
 _c_write.restype = c_ssize_t
 _c_write.argtypes = (
@@ -634,6 +665,10 @@ _buffer_end = _lib.iio_buffer_end
 _buffer_end.restype = c_void_p
 _buffer_end.argtypes = (_BufferPtr,)
 
+_buffer_first = _lib.iio_buffer_first
+_buffer_first.restype = c_void_p
+_buffer_first.argtypes = (_BufferPtr, _ChannelPtr)
+
 _buffer_cancel = _lib.iio_buffer_cancel
 _buffer_cancel.restype = c_void_p
 _buffer_cancel.argtypes = (_BufferPtr,)
@@ -874,6 +909,74 @@ class Channel(object):
             length = _c_read(self._channel, buf._buffer, c_array, len(array))
         return array[:length]
 
+    def read_into(self, buf, array, offset=0):
+        """
+        Extract and convert the samples of this channel into a preallocated array, without any intermediate copy.
+
+        :param buf: type=iio.Buffer
+            A valid instance of the iio.Buffer class
+        :param array: type=numpy.ndarray, bytearray or any writable contiguous buffer
+            The destination of the samples. If its items are float32 or
+            float64 values, the samples are converted to processed values,
+            (raw + offset) * scale; otherwise they are stored in host format
+        :param offset: type=int
+            The index of the first sample of the buffer to extract
+
+        returns: type=int
+            The number of samples extracted
+        """
+        view = memoryview(array)
+        fmt = self.data_format
+        repeat = fmt.repeat or 1
+        if view.format in ("f", "d"):
+            size = view.itemsize * repeat
+            read_func = _c_read_float if view.format == "f" else _c_read_double
+        else:
+            size = fmt.length // 8 * repeat
+            read_func = _c_read_block
+        mytype = c_char * view.nbytes
+        c_array = mytype.from_buffer(array)
+        return read_func(
+            self._channel, buf._buffer, c_array, offset, view.nbytes // size
+        )
+
+    def view(self, buf):
+        """
+        Get a NumPy view of the samples of this channel, in place in the given iio.Buffer object.
+
+        The samples are in hardware format: no shift or mask is applied. The
+        view is only valid until the next refill or push of the buffer.
+        Requires NumPy.
+
+        :param buf: type=iio.Buffer
+            A valid instance of the iio.Buffer class
+
+        returns: type=numpy.ndarray
+            A strided array over the samples of this channel; two-dimensional
+            if the channel has several values per sample
+        """
+        import numpy  # pylint: disable=import-outside-toplevel
+
+        fmt = self.data_format
+        repeat = fmt.repeat or 1
+        width = fmt.length // 8
+        dtype = numpy.dtype(
+            "%s%s%u" % (">" if fmt.is_be else "<", "i" if fmt.is_signed else "u", width)
+        )
+        start = _buffer_start(buf._buffer)
+        end = _buffer_end(buf._buffer)
+        first = _buffer_first(buf._buffer, self._channel)
+        step = buf.step
+        count = 0
+        if step and first + width * repeat <= end:
+            count = (end - first - width * repeat) // step + 1
+        shape, strides = (count,), (step,)
+        if repeat > 1:
+            shape, strides = (count, repeat), (step, width)
+        return numpy.ndarray(
+            shape, dtype, buffer=buf.view(), offset=first - start, strides=strides
+        )
+
     def write(self, buf, array, raw=False):
         """
         Write the specified array of samples corresponding to this channel into the given iio.Buffer object.
@@ -1060,6 +1163,25 @@ class Buffer(object):
         _memmove(c_array, start, len(array))
         return array
 
+    def view(self):
+        """
+        Access the samples contained inside the Buffer object, without copying them.
+
+        The view is only valid until the next refill or push of the buffer,
+        which can move the samples. numpy.frombuffer() can be used on it.
+
+        returns: type=memoryview
+            A writable view of the samples
+        """
+        start = _buffer_start(self._buffer)
+        end = _buffer_end(self._buffer)
+        mytype = c_char * (end - start)
+        return memoryview(mytype.from_address(start)).cast("B")
+
+    def __buffer__(self, flags):
+        """Support the buffer protocol (Python 3.12+), see view()."""
+        return self.view()
+
     def write(self, array):
         """
         Copy the given array of samples inside the Buffer object.
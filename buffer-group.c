@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "iio-lock.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+struct iio_buffer_group_member {
+	struct iio_buffer_group *group;
+	struct iio_buffer *buf;
+	struct iio_thrd *thrd;
+
+	ssize_t ret;
+	uint64_t timestamp;
+};
+
+struct iio_buffer_group {
+	struct iio_buffer_group_member *members;
+	unsigned int nb_members;
+
+	/*
+	 * In parallel mode, the first member is refilled by the caller, and
+	 * each other one by a thread of its own. Every refill bumps the
+	 * generation, which wakes up the threads; the last one to finish
+	 * wakes up the caller.
+	 */
+	struct iio_mutex *lock;
+	struct iio_cond *start_cond, *done_cond;
+	unsigned int generation, nb_pending;
+	bool stop;
+};
+
+static void group_member_refill(struct iio_buffer_group_member *member)
+{
+	member->timestamp = 0;
+	member->ret = iio_buffer_refill(member->buf);
+
+	if (member->ret >= 0 &&
+	    iio_buffer_get_timestamp(member->buf, &member->timestamp) < 0)
+		member->timestamp = 0;
+}
+
+static int group_thread(void *d)
+{
+	struct iio_buffer_group_member *member = d;
+	struct iio_buffer_group *group = member->group;
+	unsigned int generation = 0;
+
+	iio_mutex_lock(group->lock);
+
+	while (true) {
+		while (!group->stop && group->generation == generation)
+			iio_cond_wait(group->start_cond, group->lock, 0);
+
+		if (group->stop)
+			break;
+
+		generation = group->generation;
+		iio_mutex_unlock(group->lock);
+
+		group_member_refill(member);
+
+		iio_mutex_lock(group->lock);
+		if (!--group->nb_pending)
+			iio_cond_signal(group->done_cond);
+	}
+
+	iio_mutex_unlock(group->lock);
+
+	return 0;
+}
+
+static void group_stop_threads(struct iio_buffer_group *group)
+{
+	unsigned int i;
+
+	iio_mutex_lock(group->lock);
+	group->stop = true;
+	iio_cond_broadcast(group->start_cond);
+	iio_mutex_unlock(group->lock);
+
+	for (i = 1; i < group->nb_members; i++) {
+		if (group->members[i].thrd)
+			iio_thrd_join_and_destroy(group->members[i].thrd);
+	}
+}
+
+static int group_start_threads(struct iio_buffer_group *group)
+{
+	unsigned int i;
+
+	group->lock = iio_mutex_create();
+	if (!group->lock)
+		return -ENOMEM;
+
+	group->start_cond = iio_cond_create();
+	group->done_cond = iio_cond_create();
+	if (!group->start_cond || !group->done_cond)
+		return -ENOMEM;
+
+	for (i = 1; i < group->nb_members; i++) {
+		group->members[i].thrd = iio_thrd_create(group_thread,
+							 &group->members[i]);
+		if (!group->members[i].thrd)
+			return -errno;
+	}
+
+	return 0;
+}
+
+static void group_free(struct iio_buffer_group *group)
+{
+	unsigned int i;
+
+	if (group->done_cond)
+		iio_cond_destroy(group->done_cond);
+	if (group->start_cond)
+		iio_cond_destroy(group->start_cond);
+	if (group->lock)
+		iio_mutex_destroy(group->lock);
+
+	for (i = 0; i < group->nb_members; i++) {
+		if (group->members[i].buf)
+			iio_buffer_destroy(group->members[i].buf);
+	}
+
+	free(group->members);
+	free(group);
+}
+
+struct iio_buffer_group * iio_create_buffer_group(
+		const struct iio_device * const *devs, unsigned int nb_devs,
+		const struct iio_device *trigger, size_t samples_count,
+		bool parallel)
+{
+	struct iio_buffer_group *group;
+	unsigned int i;
+	int err;
+
+	if (!nb_devs) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for (i = 0; i < nb_devs; i++) {
+		if (iio_device_is_tx(devs[i])) {
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	group = zalloc(sizeof(*group));
+	if (!group) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	group->members = calloc(nb_devs, sizeof(*group->members));
+	if (!group->members) {
+		err = -ENOMEM;
+		goto err_free_group;
+	}
+
+	group->nb_members = nb_devs;
+
+	/* All the devices follow the trigger before any of them starts */
+	if (trigger) {
+		for (i = 0; i < nb_devs; i++) {
+			err = iio_device_set_trigger(devs[i], trigger);
+			if (err < 0)
+				goto err_free_group;
+		}
+	}
+
+	for (i = 0; i < nb_devs; i++) {
+		group->members[i].group = group;
+		group->members[i].buf = iio_device_create_buffer(devs[i],
+				samples_count, false);
+		if (!group->members[i].buf) {
+			err = -errno;
+			goto err_free_group;
+		}
+	}
+
+	if (parallel && nb_devs > 1) {
+		err = group_start_threads(group);
+		if (err < 0)
+			goto err_stop_threads;
+	}
+
+	return group;
+
+err_stop_threads:
+	if (group->lock && group->start_cond)
+		group_stop_threads(group);
+err_free_group:
+	group_free(group);
+	errno = -err;
+	return NULL;
+}
+
+void iio_buffer_group_destroy(struct iio_buffer_group *group)
+{
+	if (group->lock)
+		group_stop_threads(group);
+
+	group_free(group);
+}
+
+struct iio_buffer * iio_buffer_group_get_buffer(
+		const struct iio_buffer_group *group, unsigned int index)
+{
+	if (index >= group->nb_members)
+		return NULL;
+
+	return group->members[index].buf;
+}
+
+int iio_buffer_group_refill(struct iio_buffer_group *group)
+{
+	unsigned int i;
+
+	if (group->lock) {
+		iio_mutex_lock(group->lock);
+		group->nb_pending = group->nb_members - 1;
+		group->generation++;
+		iio_cond_broadcast(group->start_cond);
+		iio_mutex_unlock(group->lock);
+
+		group_member_refill(&group->members[0]);
+
+		iio_mutex_lock(group->lock);
+		while (group->nb_pending)
+			iio_cond_wait(group->done_cond, group->lock, 0);
+		iio_mutex_unlock(group->lock);
+	} else {
+		for (i = 0; i < group->nb_members; i++)
+			group_member_refill(&group->members[i]);
+	}
+
+	for (i = 0; i < group->nb_members; i++) {
+		if (group->members[i].ret < 0)
+			return (int) group->members[i].ret;
+	}
+
+	return 0;
+}
+
+int iio_buffer_group_get_status(const struct iio_buffer_group *group,
+		unsigned int index, struct iio_buffer_group_status *status)
+{
+	const struct iio_buffer_group_member *member, *first;
+
+	if (index >= group->nb_members)
+		return -EINVAL;
+
+	member = &group->members[index];
+	first = &group->members[0];
+
+	status->ret = member->ret;
+	status->timestamp = member->timestamp;
+
+	if (member->timestamp && first->timestamp)
+		status->skew = (int64_t) (member->timestamp - first->timestamp);
+	else
+		status->skew = 0;
+
+	return 0;
+}
+
+void iio_buffer_group_cancel(struct iio_buffer_group *group)
+{
+	unsigned int i;
+
+	for (i = 0; i < group->nb_members; i++)
+		iio_buffer_cancel(group->members[i].buf);
+}
@@ -23,9 +23,144 @@ static bool device_is_high_speed(const struct iio_device *dev)
 		(ops->get_buffer(dev, NULL, 0, NULL, 0) != -ENOSYS);
 }
 
-struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
-		size_t samples_count, bool cyclic)
+/* Demultiplex by chunks of this size, so that the data stays in cache */
+#define DEMUX_CHUNK_SIZE 16384
+
+/*
+ * Compute the offset of every channel present in the buffer within a sample
+ * frame. This follows the rules of iio_buffer_first(), and must be called
+ * every time the buffer's mask changes.
+ */
+static void iio_buffer_update_layout(struct iio_buffer *buf)
+{
+	const struct iio_device *dev = buf->dev;
+	size_t ptr = 0, base = 0, len;
+	unsigned int i, nb = 0;
+	bool same_index;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		const struct iio_channel *chn = dev->channels[i];
+
+		if (chn->index < 0)
+			break;
+
+		/* Two channels with the same index use the same samples */
+		same_index = i > 0 && chn->index == dev->channels[i - 1]->index;
+		if (!same_index)
+			base = ptr;
+
+		if (!TEST_BIT(buf->mask, chn->number))
+			continue;
+
+		len = chn->format.length / 8;
+		buf->layout[nb].chn = chn;
+		buf->layout[nb].offset = base;
+		if (len && base % len)
+			buf->layout[nb].offset += len - (base % len);
+		nb++;
+
+		if (same_index)
+			continue;
+
+		len *= chn->format.repeat;
+		if (len && ptr % len)
+			ptr += len - (ptr % len);
+		ptr += len;
+	}
+
+	buf->nb_layout = nb;
+}
+
+/*
+ * Compute the channels visited by iio_buffer_foreach_sample() and their
+ * offset within a sample frame, following the rules of the per-sample loop.
+ * The table can only be used when every sample frame has the same layout,
+ * that is when the frame length is a multiple of the length of all the
+ * channels present in the buffer; otherwise foreach_layout_valid is cleared.
+ */
+static void iio_buffer_update_foreach_layout(struct iio_buffer *buf)
+{
+	const struct iio_device *dev = buf->dev;
+	size_t ptr = 0, length;
+	unsigned int i, nb = 0;
+	bool valid = true;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		const struct iio_channel *chn = dev->channels[i];
+
+		length = chn->format.length / 8;
+
+		if (chn->index < 0)
+			break;
+
+		if (!TEST_BIT(buf->mask, chn->number))
+			continue;
+
+		if (!length) {
+			valid = false;
+			break;
+		}
+
+		if (ptr % length)
+			ptr += length - (ptr % length);
+
+		if (TEST_BIT(dev->mask, chn->number)) {
+			buf->foreach_layout[nb].chn = chn;
+			buf->foreach_layout[nb].offset = ptr;
+			nb++;
+		}
+
+		if (i == dev->nb_channels - 1 || dev->channels[
+				i + 1]->index != chn->index)
+			ptr += length * chn->format.repeat;
+	}
+
+	valid = valid && ptr;
+
+	for (i = 0; valid && i < dev->nb_channels; i++) {
+		const struct iio_channel *chn = dev->channels[i];
+
+		if (chn->index < 0)
+			break;
+
+		if (TEST_BIT(buf->mask, chn->number))
+			valid = !(ptr % (chn->format.length / 8));
+	}
+
+	buf->nb_foreach_layout = nb;
+	buf->foreach_frame_len = ptr;
+	buf->foreach_layout_valid = valid;
+	memcpy(buf->foreach_dev_mask, dev->mask,
+			dev->words * sizeof(*buf->foreach_dev_mask));
+}
+
+/* The set of enabled channels may change at any time; refresh the table of
+ * iio_buffer_foreach_sample() if it did. */
+static void iio_buffer_check_foreach_layout(struct iio_buffer *buf)
 {
+	const struct iio_device *dev = buf->dev;
+
+	if (memcmp(buf->foreach_dev_mask, dev->mask,
+				dev->words * sizeof(*dev->mask)))
+		iio_buffer_update_foreach_layout(buf);
+}
+
+static void buffer_free_memory(struct iio_buffer *buf)
+{
+	if (!buf->owns_memory)
+		return;
+
+	if (buf->buffer_free)
+		buf->buffer_free(buf->buffer, buf->mem_length,
+				 buf->buffer_alloc_data);
+	else
+		free(buf->buffer);
+}
+
+static struct iio_buffer * create_buffer(const struct iio_device *dev,
+		size_t samples_count, bool cyclic, void *mem, size_t mem_size)
+{
+	const struct iio_context *ctx = dev->ctx;
 	ssize_t ret = -EINVAL;
 	struct iio_buffer *buf;
 	ssize_t sample_size = iio_device_get_sample_size(dev);
@@ -46,7 +181,17 @@ struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
 
 	buf->dev_sample_size = (unsigned int) sample_size;
 	buf->length = sample_size * samples_count;
+	buf->mem_length = mem ? mem_size : buf->length;
 	buf->dev = dev;
+	buf->blocks = NULL;
+	buf->nb_blocks = 0;
+	buf->async_cb = NULL;
+	buf->owns_memory = false;
+
+	if (mem && mem_size < buf->length) {
+		ret = -EINVAL;
+		goto err_free_buf;
+	}
 	buf->mask = calloc(dev->words, sizeof(*buf->mask));
 	if (!buf->mask) {
 		ret = -ENOMEM;
@@ -59,39 +204,88 @@ struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
 	 * iio_buffer_foreach_sample to be used. */
 	memcpy(buf->mask, dev->mask, dev->words * sizeof(*buf->mask));
 
+	buf->layout = calloc(dev->nb_channels, sizeof(*buf->layout));
+	if (!buf->layout) {
+		ret = -ENOMEM;
+		goto err_free_mask;
+	}
+
+	buf->foreach_layout = calloc(dev->nb_channels,
+			sizeof(*buf->foreach_layout));
+	if (!buf->foreach_layout) {
+		ret = -ENOMEM;
+		goto err_free_layout;
+	}
+
+	buf->foreach_dev_mask = calloc(dev->words,
+			sizeof(*buf->foreach_dev_mask));
+	if (!buf->foreach_dev_mask) {
+		ret = -ENOMEM;
+		goto err_free_foreach_layout;
+	}
+
 	ret = iio_device_open(dev, samples_count, cyclic);
 	if (ret < 0)
-		goto err_free_mask;
+		goto err_free_foreach_mask;
 
 	buf->dev_is_high_speed = device_is_high_speed(dev);
 	if (buf->dev_is_high_speed) {
 		/* Dequeue the first buffer, so that buf->buffer is correctly
 		 * initialized */
 		buf->buffer = NULL;
+
+		/* The samples live in the DMA blocks of the backend */
+		if (mem) {
+			ret = -ENOTSUP;
+			goto err_close_device;
+		}
+
 		if (iio_device_is_tx(dev)) {
 			ret = dev->ctx->ops->get_buffer(dev, &buf->buffer,
 					buf->length, buf->mask, dev->words);
 			if (ret < 0)
 				goto err_close_device;
 		}
+	} else if (mem) {
+		buf->buffer = mem;
 	} else {
-		buf->buffer = malloc(buf->length);
+		if (ctx->buffer_alloc) {
+			buf->buffer = ctx->buffer_alloc(buf->length,
+					ctx->buffer_alloc_data);
+			buf->buffer_free = ctx->buffer_free;
+			buf->buffer_alloc_data = ctx->buffer_alloc_data;
+		} else {
+			buf->buffer = malloc(buf->length);
+			buf->buffer_free = NULL;
+		}
 		if (!buf->buffer) {
 			ret = -ENOMEM;
 			goto err_close_device;
 		}
+
+		buf->owns_memory = true;
 	}
 
 	ret = iio_device_get_sample_size_mask(dev, buf->mask, dev->words);
 	if (ret < 0)
-		goto err_close_device;
+		goto err_free_memory;
 
 	buf->sample_size = (unsigned int) ret;
 	buf->data_length = buf->length;
+	iio_buffer_update_layout(buf);
+	iio_buffer_update_foreach_layout(buf);
 	return buf;
 
+err_free_memory:
+	buffer_free_memory(buf);
 err_close_device:
 	iio_device_close(dev);
+err_free_foreach_mask:
+	free(buf->foreach_dev_mask);
+err_free_foreach_layout:
+	free(buf->foreach_layout);
+err_free_layout:
+	free(buf->layout);
 err_free_mask:
 	free(buf->mask);
 err_free_buf:
@@ -101,15 +295,95 @@ err_set_errno:
 	return NULL;
 }
 
+struct iio_buffer * iio_device_create_buffer(const struct iio_device *dev,
+		size_t samples_count, bool cyclic)
+{
+	return create_buffer(dev, samples_count, cyclic, NULL, 0);
+}
+
+struct iio_buffer * iio_device_create_buffer_with_memory(
+		const struct iio_device *dev, size_t samples_count,
+		bool cyclic, void *mem, size_t mem_size)
+{
+	if (!mem) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return create_buffer(dev, samples_count, cyclic, mem, mem_size);
+}
+
 void iio_buffer_destroy(struct iio_buffer *buffer)
 {
+	unsigned int i;
+
 	iio_device_close(buffer->dev);
-	if (!buffer->dev_is_high_speed)
-		free(buffer->buffer);
+	buffer_free_memory(buffer);
+	for (i = 0; i < buffer->nb_blocks; i++)
+		free(buffer->blocks[i]);
+	free(buffer->blocks);
+	free(buffer->foreach_dev_mask);
+	free(buffer->foreach_layout);
+	free(buffer->layout);
 	free(buffer->mask);
 	free(buffer);
 }
 
+int iio_buffer_reconfigure(struct iio_buffer *buffer, size_t samples_count)
+{
+	const struct iio_device *dev = buffer->dev;
+	ssize_t sample_size = iio_device_get_sample_size(dev);
+	size_t length;
+	int ret;
+
+	if (!sample_size || !samples_count)
+		return -EINVAL;
+	if (sample_size < 0)
+		return (int) sample_size;
+
+	if (buffer->nb_blocks || buffer->async_cb)
+		return -EBUSY;
+
+	if (!dev->ctx->ops->reconfigure)
+		return -ENOSYS;
+
+	/* In high-speed mode, the samples live in the blocks of the backend,
+	 * which checks that they still fit */
+	length = (size_t) sample_size * samples_count;
+	if (!buffer->dev_is_high_speed && length > buffer->mem_length)
+		return -ENOSPC;
+
+	ret = dev->ctx->ops->reconfigure(dev, samples_count);
+	if (ret < 0)
+		return ret;
+
+	buffer->dev_sample_size = (unsigned int) sample_size;
+	buffer->length = length;
+	buffer->data_length = length;
+	memcpy(buffer->mask, dev->mask, dev->words * sizeof(*buffer->mask));
+
+	ret = (int) iio_device_get_sample_size_mask(dev,
+			buffer->mask, dev->words);
+	if (ret < 0)
+		return ret;
+
+	buffer->sample_size = (unsigned int) ret;
+	iio_buffer_update_layout(buffer);
+	iio_buffer_update_foreach_layout(buffer);
+	return 0;
+}
+
+int iio_buffer_get_timestamp(const struct iio_buffer *buffer,
+		uint64_t *timestamp)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+
+	if (!ops->get_timestamp)
+		return -ENOSYS;
+
+	return ops->get_timestamp(buffer->dev, timestamp);
+}
+
 int iio_buffer_get_poll_fd(struct iio_buffer *buffer)
 {
 	return iio_device_get_poll_fd(buffer->dev);
@@ -120,19 +394,104 @@ int iio_buffer_set_blocking_mode(struct iio_buffer *buffer, bool blocking)
 	return iio_device_set_blocking_mode(buffer->dev, blocking);
 }
 
-ssize_t iio_buffer_refill(struct iio_buffer *buffer)
+int iio_buffer_set_busy_poll(struct iio_buffer *buffer,
+		unsigned int busy_poll_us, int cpu)
 {
-	ssize_t read;
 	const struct iio_device *dev = buffer->dev;
-	ssize_t ret;
 
-	if (buffer->dev_is_high_speed) {
-		read = dev->ctx->ops->get_buffer(dev, &buffer->buffer,
-				buffer->length, buffer->mask, dev->words);
-	} else {
-		read = iio_device_read_raw(dev, buffer->buffer, buffer->length,
-				buffer->mask, dev->words);
-	}
+	if (dev->ctx->ops->set_busy_poll)
+		return dev->ctx->ops->set_busy_poll(dev, busy_poll_us, cpu);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_set_read_ahead(struct iio_buffer *buffer,
+		unsigned int nb_requests)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (dev->ctx->ops->set_read_ahead)
+		return dev->ctx->ops->set_read_ahead(dev, nb_requests);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_set_compression(struct iio_buffer *buffer, bool enable)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (dev->ctx->ops->set_compression)
+		return dev->ctx->ops->set_compression(dev, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_publish(struct iio_buffer *buffer, const char *addr,
+		unsigned int ttl)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (dev->ctx->ops->publish)
+		return dev->ctx->ops->publish(dev, addr, ttl);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_subscribe(struct iio_buffer *buffer, const char *addr)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (dev->ctx->ops->subscribe)
+		return dev->ctx->ops->subscribe(dev, addr);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_set_decimation(struct iio_buffer *buffer, unsigned int factor)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (!factor)
+		return -EINVAL;
+
+	if (dev->ctx->ops->set_decimation)
+		return dev->ctx->ops->set_decimation(dev, factor);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_set_capture_window(struct iio_buffer *buffer,
+		const struct iio_channel *chn, enum iio_window_edge edge,
+		long long level, unsigned int pre, unsigned int post)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (edge != IIO_WINDOW_OFF && (!chn || chn->dev != dev ||
+				       !iio_channel_is_enabled(chn) || !post))
+		return -EINVAL;
+
+	if (dev->ctx->ops->set_capture_window)
+		return dev->ctx->ops->set_capture_window(dev, chn, edge,
+				level, pre, post);
+	else
+		return -ENOSYS;
+}
+
+int iio_buffer_get_multicast_losses(const struct iio_buffer *buffer,
+		uint64_t *nb_lost)
+{
+	const struct iio_device *dev = buffer->dev;
+
+	if (dev->ctx->ops->get_multicast_losses)
+		return dev->ctx->ops->get_multicast_losses(dev, nb_lost);
+	else
+		return -ENOSYS;
+}
+
+static ssize_t buffer_refilled(struct iio_buffer *buffer, ssize_t read)
+{
+	const struct iio_device *dev = buffer->dev;
+	ssize_t ret;
 
 	if (read >= 0) {
 		buffer->data_length = read;
@@ -140,19 +499,69 @@ ssize_t iio_buffer_refill(struct iio_buffer *buffer)
 		if (ret < 0)
 			return ret;
 		buffer->sample_size = (unsigned int)ret;
+		iio_buffer_update_layout(buffer);
+		iio_buffer_update_foreach_layout(buffer);
+	}
+	return read;
+}
+
+static ssize_t buffer_exchange_block(struct iio_buffer *buffer,
+		void **addr, size_t len)
+{
+	const struct iio_device *dev = buffer->dev;
+	uint64_t start;
+	ssize_t ret;
+
+	start = iio_stats_start();
+	ret = dev->ctx->ops->get_buffer(dev, addr, len,
+			buffer->mask, dev->words);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_GET_BUFFER, start, ret);
+
+	return ret;
+}
+
+ssize_t iio_buffer_refill(struct iio_buffer *buffer)
+{
+	ssize_t read;
+	const struct iio_device *dev = buffer->dev;
+	uint64_t start;
+
+	if (buffer->async_cb)
+		return -EBUSY;
+
+	IIO_TRACE(refill_start, buffer, buffer->length);
+	start = iio_stats_start();
+
+	if (buffer->dev_is_high_speed) {
+		read = buffer_exchange_block(buffer, &buffer->buffer,
+				buffer->length);
+	} else {
+		read = iio_device_read_raw(dev, buffer->buffer, buffer->length,
+				buffer->mask, dev->words);
 	}
+
+	read = buffer_refilled(buffer, read);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_REFILL, start, read);
+	IIO_TRACE(refill_done, buffer, read);
+
 	return read;
 }
 
 ssize_t iio_buffer_push(struct iio_buffer *buffer)
 {
 	const struct iio_device *dev = buffer->dev;
+	uint64_t start;
 	ssize_t ret;
 
+	if (buffer->async_cb)
+		return -EBUSY;
+
+	IIO_TRACE(push_start, buffer, buffer->data_length);
+	start = iio_stats_start();
+
 	if (buffer->dev_is_high_speed) {
 		void *buf;
-		ret = dev->ctx->ops->get_buffer(dev, &buf,
-				buffer->data_length, buffer->mask, dev->words);
+		ret = buffer_exchange_block(buffer, &buf, buffer->data_length);
 		if (ret >= 0) {
 			buffer->buffer = buf;
 			ret = (ssize_t) buffer->data_length;
@@ -177,6 +586,8 @@ ssize_t iio_buffer_push(struct iio_buffer *buffer)
 
 out_reset_data_length:
 	buffer->data_length = buffer->length;
+	iio_stats_record(dev->ctx->stats, IIO_STATS_PUSH, start, ret);
+	IIO_TRACE(push_done, buffer, ret);
 	return ret;
 }
 
@@ -191,7 +602,142 @@ ssize_t iio_buffer_push_partial(struct iio_buffer *buffer, size_t samples_count)
 	return iio_buffer_push(buffer);
 }
 
-ssize_t iio_buffer_foreach_sample(struct iio_buffer *buffer,
+static int buffer_submit_async(struct iio_buffer *buffer, bool tx,
+		void (*callback)(struct iio_buffer *, ssize_t, void *), void *d)
+{
+	const struct iio_backend_ops *ops = buffer->dev->ctx->ops;
+	int ret;
+
+	if (!callback || tx != iio_device_is_tx(buffer->dev))
+		return -EINVAL;
+	if (buffer->async_cb)
+		return -EBUSY;
+
+	if (buffer->dev_is_high_speed) {
+		if (!ops->try_get_buffer)
+			return -ENOSYS;
+	} else if (tx ? !ops->try_write : !ops->try_read) {
+		return -ENOSYS;
+	}
+
+	if (!tx && !buffer->dev_is_high_speed && ops->request_read) {
+		ret = ops->request_read(buffer->dev, buffer->length);
+		if (ret < 0)
+			return ret;
+	}
+
+	buffer->async_cb = callback;
+	buffer->async_data = d;
+	buffer->async_done = 0;
+	buffer->async_tx = tx;
+	return 0;
+}
+
+int iio_buffer_refill_async(struct iio_buffer *buffer,
+		void (*callback)(struct iio_buffer *, ssize_t, void *), void *d)
+{
+	return buffer_submit_async(buffer, false, callback, d);
+}
+
+int iio_buffer_push_async(struct iio_buffer *buffer,
+		void (*callback)(struct iio_buffer *, ssize_t, void *), void *d)
+{
+	return buffer_submit_async(buffer, true, callback, d);
+}
+
+/* Make as much progress as possible on the pending operation without
+ * blocking. Returns -EAGAIN if it has not completed yet. */
+static ssize_t buffer_try_refill(struct iio_buffer *buffer)
+{
+	const struct iio_device *dev = buffer->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	ssize_t ret;
+
+	if (buffer->dev_is_high_speed) {
+		ret = ops->try_get_buffer(dev, &buffer->buffer,
+				buffer->length, buffer->mask, dev->words);
+		if (ret == -EAGAIN)
+			return ret;
+
+		return buffer_refilled(buffer, ret);
+	}
+
+	ret = ops->try_read(dev,
+			(void *) ((uintptr_t) buffer->buffer + buffer->async_done),
+			buffer->length - buffer->async_done,
+			buffer->mask, dev->words);
+	if (ret < 0)
+		return ret;
+
+	buffer->async_done += ret;
+	if (buffer->async_done < buffer->length)
+		return -EAGAIN;
+
+	return buffer_refilled(buffer, (ssize_t) buffer->length);
+}
+
+static ssize_t buffer_try_push(struct iio_buffer *buffer)
+{
+	const struct iio_device *dev = buffer->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	ssize_t ret;
+
+	if (buffer->dev_is_high_speed) {
+		void *buf;
+
+		ret = ops->try_get_buffer(dev, &buf, buffer->data_length,
+				buffer->mask, dev->words);
+		if (ret == -EAGAIN)
+			return ret;
+		if (ret >= 0) {
+			buffer->buffer = buf;
+			ret = (ssize_t) buffer->data_length;
+		}
+	} else {
+		ret = ops->try_write(dev,
+			(const void *) ((uintptr_t) buffer->buffer + buffer->async_done),
+			buffer->data_length - buffer->async_done);
+		if (ret == -EAGAIN)
+			return ret;
+		if (ret >= 0) {
+			buffer->async_done += ret;
+			if (buffer->async_done < buffer->data_length)
+				return -EAGAIN;
+
+			ret = (ssize_t) buffer->data_length;
+		}
+	}
+
+	buffer->data_length = buffer->length;
+	return ret;
+}
+
+int iio_buffer_process_async(struct iio_buffer *buffer)
+{
+	void (*callback)(struct iio_buffer *, ssize_t, void *);
+	ssize_t ret;
+
+	callback = buffer->async_cb;
+	if (!callback)
+		return 0;
+
+	if (buffer->async_tx)
+		ret = buffer_try_push(buffer);
+	else
+		ret = buffer_try_refill(buffer);
+	if (ret == -EAGAIN)
+		return -EAGAIN;
+
+	/* Clear the pending state first, so that the callback can submit the
+	 * next operation right away */
+	buffer->async_cb = NULL;
+	callback(buffer, ret, buffer->async_data);
+	return 0;
+}
+
+/* Per-sample loop, used when the sample frames don't all have the same
+ * layout */
+static ssize_t foreach_sample_slow(struct iio_buffer *buffer,
 		ssize_t (*callback)(const struct iio_channel *,
 			void *, size_t, void *), void *d)
 {
@@ -242,6 +788,467 @@ ssize_t iio_buffer_foreach_sample(struct iio_buffer *buffer,
 	return processed;
 }
 
+ssize_t iio_buffer_foreach_sample(struct iio_buffer *buffer,
+		ssize_t (*callback)(const struct iio_channel *,
+			void *, size_t, void *), void *d)
+{
+	uintptr_t ptr = (uintptr_t) buffer->buffer,
+		  end = ptr + buffer->data_length;
+	ssize_t processed = 0;
+	unsigned int i;
+
+	if (buffer->sample_size == 0)
+		return -EINVAL;
+
+	if (buffer->data_length < buffer->dev_sample_size)
+		return 0;
+
+	iio_buffer_check_foreach_layout(buffer);
+
+	if (!buffer->foreach_layout_valid)
+		return foreach_sample_slow(buffer, callback, d);
+
+	for (; end - ptr >= (size_t) buffer->sample_size;
+			ptr += buffer->foreach_frame_len) {
+		for (i = 0; i < buffer->nb_foreach_layout; i++) {
+			const struct iio_channel_layout *layout =
+				&buffer->foreach_layout[i];
+			ssize_t ret = callback(layout->chn,
+					(void *) (ptr + layout->offset),
+					layout->chn->format.length / 8, d);
+			if (ret < 0)
+				return ret;
+
+			processed += ret;
+		}
+	}
+
+	return processed;
+}
+
+struct foreach_batch_data {
+	ssize_t (*callback)(const struct iio_channel *, void *,
+			size_t, ptrdiff_t, size_t, void *);
+	void *d;
+};
+
+static ssize_t foreach_batch_one(const struct iio_channel *chn,
+		void *src, size_t length, void *d)
+{
+	struct foreach_batch_data *data = d;
+
+	return data->callback(chn, src, length, 0, 1, data->d);
+}
+
+ssize_t iio_buffer_foreach_sample_batch(struct iio_buffer *buffer,
+		ssize_t (*callback)(const struct iio_channel *, void *,
+			size_t, ptrdiff_t, size_t, void *), void *d)
+{
+	uintptr_t ptr = (uintptr_t) buffer->buffer;
+	size_t nb_samples, frame_len;
+	ssize_t processed = 0;
+	unsigned int i;
+
+	if (buffer->sample_size == 0)
+		return -EINVAL;
+
+	if (buffer->data_length < buffer->dev_sample_size)
+		return 0;
+
+	iio_buffer_check_foreach_layout(buffer);
+
+	if (!buffer->foreach_layout_valid) {
+		struct foreach_batch_data data = {
+			.callback = callback,
+			.d = d,
+		};
+
+		return foreach_sample_slow(buffer, foreach_batch_one, &data);
+	}
+
+	/* Number of iterations of the per-sample loop */
+	if (buffer->data_length < buffer->sample_size)
+		return 0;
+
+	frame_len = buffer->foreach_frame_len;
+	nb_samples = (buffer->data_length - buffer->sample_size) /
+		frame_len + 1;
+
+	for (i = 0; i < buffer->nb_foreach_layout; i++) {
+		const struct iio_channel_layout *layout =
+			&buffer->foreach_layout[i];
+		ssize_t ret = callback(layout->chn,
+				(void *) (ptr + layout->offset),
+				layout->chn->format.length / 8,
+				(ptrdiff_t) frame_len, nb_samples, d);
+		if (ret < 0)
+			return ret;
+
+		processed += ret;
+	}
+
+	return processed;
+}
+
+enum demux_mode {
+	DEMUX_RAW,
+	DEMUX_CONVERT,
+	DEMUX_FLOAT,
+};
+
+static size_t demux_sample_size(const struct iio_channel *chn,
+		enum demux_mode mode)
+{
+	if (mode == DEMUX_FLOAT)
+		return sizeof(float) * chn->format.repeat;
+
+	return chn->format.length / 8 * chn->format.repeat;
+}
+
+static void demux_channel(const struct iio_channel *chn, enum demux_mode mode,
+		void *dst, const void *src, size_t step, size_t nb)
+{
+	size_t j, length = chn->format.length / 8 * chn->format.repeat;
+	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
+
+	switch (mode) {
+	case DEMUX_CONVERT:
+		iio_channel_convert_strided(chn, dst, src, (ptrdiff_t) step, nb);
+		break;
+	case DEMUX_FLOAT:
+		iio_channel_convert_float_strided(chn, dst, src,
+				(ptrdiff_t) step, nb);
+		break;
+	default:
+		for (j = 0; j < nb; j++, src_ptr += step, dst_ptr += length)
+			memcpy((void *) dst_ptr, (const void *) src_ptr, length);
+		break;
+	}
+}
+
+static ssize_t buffer_demux(const struct iio_buffer *buffer,
+		void * const *dst, size_t offset, size_t nb_samples,
+		enum demux_mode mode)
+{
+	const struct iio_device *dev = buffer->dev;
+	size_t step = buffer->sample_size, total, chunk, done, nb, length;
+	uintptr_t src, end;
+	unsigned int i;
+
+	if (!step || !dst)
+		return -EINVAL;
+
+	total = buffer->data_length / step;
+	if (offset >= total)
+		return 0;
+
+	if (nb_samples > total - offset)
+		nb_samples = total - offset;
+
+	chunk = DEMUX_CHUNK_SIZE / step;
+	if (!chunk)
+		chunk = 1;
+
+	end = (uintptr_t) buffer->buffer + buffer->data_length;
+
+	/* Process the buffer chunk by chunk: each chunk is read from memory
+	 * once, the following channels then get their samples from cache. */
+	for (done = 0; done < nb_samples; done += nb) {
+		nb = nb_samples - done;
+		if (nb > chunk)
+			nb = chunk;
+
+		src = (uintptr_t) buffer->buffer + (offset + done) * step;
+
+		for (i = 0; i < buffer->nb_layout; i++) {
+			const struct iio_channel_layout *layout =
+				&buffer->layout[i];
+			const struct iio_channel *chn = layout->chn;
+			uintptr_t ptr = (uintptr_t) dst[chn->number],
+				  first = src + layout->offset;
+			size_t nb_chn = nb;
+
+			if (!ptr || !TEST_BIT(dev->mask, chn->number))
+				continue;
+
+			/* Never read past the end of the buffer's data */
+			length = chn->format.length / 8 * chn->format.repeat;
+			if (first + length > end)
+				continue;
+			if (nb_chn > (end - first - length) / step + 1)
+				nb_chn = (end - first - length) / step + 1;
+
+			ptr += done * demux_sample_size(chn, mode);
+			demux_channel(chn, mode, (void *) ptr,
+					(const void *) first, step, nb_chn);
+		}
+	}
+
+	return (ssize_t) nb_samples;
+}
+
+ssize_t iio_buffer_demux(const struct iio_buffer *buffer, void * const *dst,
+		size_t offset, size_t nb_samples, bool raw)
+{
+	return buffer_demux(buffer, dst, offset, nb_samples,
+			raw ? DEMUX_RAW : DEMUX_CONVERT);
+}
+
+ssize_t iio_buffer_demux_float(const struct iio_buffer *buffer,
+		float * const *dst, size_t offset, size_t nb_samples)
+{
+	return buffer_demux(buffer, (void * const *) dst, offset, nb_samples,
+			DEMUX_FLOAT);
+}
+
+/* Process I/Q pairs by chunks of this number of samples */
+#define COMPLEX_CHUNK_SAMPLES 256
+
+static const struct iio_channel_layout * buffer_find_layout(
+		const struct iio_buffer *buffer, const struct iio_channel *chn)
+{
+	unsigned int i;
+
+	for (i = 0; i < buffer->nb_layout; i++)
+		if (buffer->layout[i].chn == chn)
+			return &buffer->layout[i];
+
+	return NULL;
+}
+
+/*
+ * Resolve the I and Q channels of the pair the given channel belongs to, and
+ * compute how many samples of the pair can be accessed from 'offset'.
+ * Returns the number of samples, or a negative error code.
+ */
+static ssize_t buffer_get_iq_pair(const struct iio_buffer *buffer,
+		const struct iio_channel *chn, size_t offset, size_t nb_samples,
+		const struct iio_channel_layout **layout_i,
+		const struct iio_channel_layout **layout_q)
+{
+	const struct iio_channel *chn_i, *chn_q;
+	size_t step = buffer->sample_size, total;
+
+	if (!chn->iq_pair || !step)
+		return -EINVAL;
+
+	if (chn->modifier == IIO_MOD_I) {
+		chn_i = chn;
+		chn_q = chn->iq_pair;
+	} else {
+		chn_i = chn->iq_pair;
+		chn_q = chn;
+	}
+
+	if (!iio_channel_is_enabled(chn_i) || !iio_channel_is_enabled(chn_q))
+		return 0;
+
+	*layout_i = buffer_find_layout(buffer, chn_i);
+	*layout_q = buffer_find_layout(buffer, chn_q);
+	if (!*layout_i || !*layout_q)
+		return 0;
+
+	total = buffer->data_length / step;
+	if (offset >= total)
+		return 0;
+
+	if (nb_samples > total - offset)
+		nb_samples = total - offset;
+
+	return (ssize_t) nb_samples;
+}
+
+static bool is_complex_int16(const struct iio_channel *chn)
+{
+	return chn->format.length == 16 && chn->format.repeat == 1 &&
+		chn->iq_pair && chn->iq_pair->format.length == 16 &&
+		chn->iq_pair->format.repeat == 1;
+}
+
+ssize_t iio_buffer_read_complex_int16(const struct iio_buffer *buffer,
+		const struct iio_channel *chn, int16_t *dst,
+		size_t offset, size_t nb_samples)
+{
+	const struct iio_channel_layout *li, *lq;
+	int16_t tmp_i[COMPLEX_CHUNK_SAMPLES], tmp_q[COMPLEX_CHUNK_SAMPLES];
+	size_t step = buffer->sample_size, done, nb, j;
+	uintptr_t src;
+	ssize_t ret;
+
+	if (!is_complex_int16(chn))
+		return -EINVAL;
+
+	ret = buffer_get_iq_pair(buffer, chn, offset, nb_samples, &li, &lq);
+	if (ret <= 0)
+		return ret;
+
+	nb_samples = (size_t) ret;
+
+	for (done = 0; done < nb_samples; done += nb) {
+		nb = nb_samples - done;
+		if (nb > COMPLEX_CHUNK_SAMPLES)
+			nb = COMPLEX_CHUNK_SAMPLES;
+
+		src = (uintptr_t) buffer->buffer + (offset + done) * step;
+
+		iio_channel_convert_strided(li->chn, tmp_i,
+				(const void *) (src + li->offset),
+				(ptrdiff_t) step, nb);
+		iio_channel_convert_strided(lq->chn, tmp_q,
+				(const void *) (src + lq->offset),
+				(ptrdiff_t) step, nb);
+
+		for (j = 0; j < nb; j++) {
+			dst[2 * (done + j)] = tmp_i[j];
+			dst[2 * (done + j) + 1] = tmp_q[j];
+		}
+	}
+
+	return (ssize_t) nb_samples;
+}
+
+ssize_t iio_buffer_read_complex_cf32(const struct iio_buffer *buffer,
+		const struct iio_channel *chn, float *dst,
+		size_t offset, size_t nb_samples)
+{
+	const struct iio_channel_layout *li, *lq;
+	float tmp_i[COMPLEX_CHUNK_SAMPLES], tmp_q[COMPLEX_CHUNK_SAMPLES];
+	size_t step = buffer->sample_size, done, nb, j;
+	uintptr_t src;
+	ssize_t ret;
+
+	if (chn->format.repeat != 1 || !chn->iq_pair ||
+			chn->iq_pair->format.repeat != 1)
+		return -EINVAL;
+
+	ret = buffer_get_iq_pair(buffer, chn, offset, nb_samples, &li, &lq);
+	if (ret <= 0)
+		return ret;
+
+	nb_samples = (size_t) ret;
+
+	for (done = 0; done < nb_samples; done += nb) {
+		nb = nb_samples - done;
+		if (nb > COMPLEX_CHUNK_SAMPLES)
+			nb = COMPLEX_CHUNK_SAMPLES;
+
+		src = (uintptr_t) buffer->buffer + (offset + done) * step;
+
+		iio_channel_convert_float_strided(li->chn, tmp_i,
+				(const void *) (src + li->offset),
+				(ptrdiff_t) step, nb);
+		iio_channel_convert_float_strided(lq->chn, tmp_q,
+				(const void *) (src + lq->offset),
+				(ptrdiff_t) step, nb);
+
+		for (j = 0; j < nb; j++) {
+			dst[2 * (done + j)] = tmp_i[j];
+			dst[2 * (done + j) + 1] = tmp_q[j];
+		}
+	}
+
+	return (ssize_t) nb_samples;
+}
+
+ssize_t iio_buffer_write_complex_int16(struct iio_buffer *buffer,
+		const struct iio_channel *chn, const int16_t *src,
+		size_t offset, size_t nb_samples)
+{
+	const struct iio_channel_layout *li, *lq;
+	int16_t tmp_i[COMPLEX_CHUNK_SAMPLES], tmp_q[COMPLEX_CHUNK_SAMPLES];
+	size_t step = buffer->sample_size, done, nb, j;
+	uintptr_t dst;
+	ssize_t ret;
+
+	if (!is_complex_int16(chn))
+		return -EINVAL;
+
+	ret = buffer_get_iq_pair(buffer, chn, offset, nb_samples, &li, &lq);
+	if (ret <= 0)
+		return ret;
+
+	nb_samples = (size_t) ret;
+
+	for (done = 0; done < nb_samples; done += nb) {
+		nb = nb_samples - done;
+		if (nb > COMPLEX_CHUNK_SAMPLES)
+			nb = COMPLEX_CHUNK_SAMPLES;
+
+		for (j = 0; j < nb; j++) {
+			tmp_i[j] = src[2 * (done + j)];
+			tmp_q[j] = src[2 * (done + j) + 1];
+		}
+
+		dst = (uintptr_t) buffer->buffer + (offset + done) * step;
+
+		iio_channel_convert_inverse_strided(li->chn,
+				(void *) (dst + li->offset), tmp_i,
+				(ptrdiff_t) step, nb);
+		iio_channel_convert_inverse_strided(lq->chn,
+				(void *) (dst + lq->offset), tmp_q,
+				(ptrdiff_t) step, nb);
+	}
+
+	return (ssize_t) nb_samples;
+}
+
+static int16_t float_to_raw_int16(const struct iio_channel *chn, float value)
+{
+	const struct iio_convert_params *params = &chn->convert_params;
+	float raw = value / (float) params->scale - (float) params->offset;
+
+	if (raw >= 32767.0f)
+		return 32767;
+	if (raw <= -32768.0f)
+		return -32768;
+
+	return (int16_t) (raw < 0.0f ? raw - 0.5f : raw + 0.5f);
+}
+
+ssize_t iio_buffer_write_complex_cf32(struct iio_buffer *buffer,
+		const struct iio_channel *chn, const float *src,
+		size_t offset, size_t nb_samples)
+{
+	const struct iio_channel_layout *li, *lq;
+	int16_t tmp_i[COMPLEX_CHUNK_SAMPLES], tmp_q[COMPLEX_CHUNK_SAMPLES];
+	size_t step = buffer->sample_size, done, nb, j;
+	uintptr_t dst;
+	ssize_t ret;
+
+	if (!is_complex_int16(chn))
+		return -EINVAL;
+
+	ret = buffer_get_iq_pair(buffer, chn, offset, nb_samples, &li, &lq);
+	if (ret <= 0)
+		return ret;
+
+	nb_samples = (size_t) ret;
+
+	for (done = 0; done < nb_samples; done += nb) {
+		nb = nb_samples - done;
+		if (nb > COMPLEX_CHUNK_SAMPLES)
+			nb = COMPLEX_CHUNK_SAMPLES;
+
+		for (j = 0; j < nb; j++) {
+			tmp_i[j] = float_to_raw_int16(li->chn,
+					src[2 * (done + j)]);
+			tmp_q[j] = float_to_raw_int16(lq->chn,
+					src[2 * (done + j) + 1]);
+		}
+
+		dst = (uintptr_t) buffer->buffer + (offset + done) * step;
+
+		iio_channel_convert_inverse_strided(li->chn,
+				(void *) (dst + li->offset), tmp_i,
+				(ptrdiff_t) step, nb);
+		iio_channel_convert_inverse_strided(lq->chn,
+				(void *) (dst + lq->offset), tmp_q,
+				(ptrdiff_t) step, nb);
+	}
+
+	return (ssize_t) nb_samples;
+}
+
 void * iio_buffer_start(const struct iio_buffer *buffer)
 {
 	return buffer->buffer;
@@ -317,3 +1324,137 @@ void iio_buffer_cancel(struct iio_buffer *buf)
 	if (ops->cancel)
 		ops->cancel(buf->dev);
 }
+
+static struct iio_block * buffer_get_block(struct iio_buffer *buffer,
+		unsigned int id)
+{
+	struct iio_block **blocks, *block;
+	unsigned int i;
+
+	if (id < buffer->nb_blocks && buffer->blocks[id])
+		return buffer->blocks[id];
+
+	if (id >= buffer->nb_blocks) {
+		blocks = realloc(buffer->blocks, (id + 1) * sizeof(*blocks));
+		if (!blocks)
+			return NULL;
+
+		for (i = buffer->nb_blocks; i <= id; i++)
+			blocks[i] = NULL;
+
+		buffer->blocks = blocks;
+		buffer->nb_blocks = id + 1;
+	}
+
+	block = zalloc(sizeof(*block));
+	if (!block)
+		return NULL;
+
+	block->buf = buffer;
+	block->id = id;
+	buffer->blocks[id] = block;
+	return block;
+}
+
+struct iio_block * iio_buffer_dequeue_block(struct iio_buffer *buffer)
+{
+	const struct iio_device *dev = buffer->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	struct iio_block *block;
+	uint64_t timestamp = 0;
+	unsigned int id;
+	void *data;
+	ssize_t ret;
+
+	if (!buffer->dev_is_high_speed || !ops->dequeue_block) {
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	ret = ops->dequeue_block(dev, &id, &data, &timestamp);
+	if (ret < 0) {
+		errno = -(int) ret;
+		return NULL;
+	}
+
+	block = buffer_get_block(buffer, id);
+	if (!block) {
+		ops->enqueue_block(dev, id, buffer->length);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	block->data = data;
+	block->timestamp = timestamp;
+	block->bytes_used = iio_device_is_tx(dev) ? buffer->length : (size_t) ret;
+	block->dequeued = true;
+	return block;
+}
+
+int iio_block_enqueue(struct iio_block *block, size_t bytes_used)
+{
+	struct iio_buffer *buffer = block->buf;
+	const struct iio_device *dev = buffer->dev;
+	int ret;
+
+	if (!block->dequeued)
+		return -EINVAL;
+
+	/* Input blocks are always handed back whole to the hardware */
+	if (!bytes_used || !iio_device_is_tx(dev))
+		bytes_used = buffer->length;
+	else if (bytes_used > buffer->length)
+		return -EINVAL;
+
+	/* Once enqueued, the block can be dequeued again by another thread
+	 * before the call returns, so the flag is cleared beforehand */
+	block->dequeued = false;
+
+	ret = dev->ctx->ops->enqueue_block(dev, block->id, bytes_used);
+	if (ret < 0)
+		block->dequeued = true;
+
+	return ret < 0 ? ret : 0;
+}
+
+void * iio_block_start(const struct iio_block *block)
+{
+	return block->data;
+}
+
+void * iio_block_first(const struct iio_block *block,
+		const struct iio_channel *chn)
+{
+	const struct iio_channel_layout *layout;
+
+	layout = buffer_find_layout(block->buf, chn);
+	if (!layout || !iio_channel_is_enabled(chn))
+		return iio_block_end(block);
+
+	return (void *) ((uintptr_t) block->data + layout->offset);
+}
+
+void * iio_block_end(const struct iio_block *block)
+{
+	return (void *) ((uintptr_t) block->data + block->bytes_used);
+}
+
+struct iio_buffer * iio_block_get_buffer(const struct iio_block *block)
+{
+	return block->buf;
+}
+
+int iio_block_get_dmabuf_fd(const struct iio_block *block)
+{
+	const struct iio_device *dev = block->buf->dev;
+
+	if (!dev->ctx->ops->get_dmabuf_fd)
+		return -ENOSYS;
+
+	return dev->ctx->ops->get_dmabuf_fd(dev, block->id);
+}
+
+uint64_t iio_block_get_timestamp(const struct iio_block *block)
+{
+	return block->timestamp;
+}
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "iio-capture.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Writer of the capture files, see iio-capture.h for the format */
+
+struct iio_capture {
+	const struct iio_buffer *buf;
+	unsigned int dev_index;
+	FILE *f;
+
+	uint64_t offset, data_offset, index_offset;
+	struct iio_capture_index_entry *index;
+	size_t nb_blocks, nb_alloc;
+
+	/* Sticky: once a write failed, the file is unusable */
+	int err;
+};
+
+static const uint8_t capture_zeros[IIO_CAPTURE_DATA_ALIGN];
+
+static int capture_write(struct iio_capture *cap, const void *src, size_t len)
+{
+	if (cap->err)
+		return cap->err;
+
+	if (len && fwrite(src, 1, len, cap->f) != len)
+		cap->err = errno ? -errno : -EIO;
+	else
+		cap->offset += len;
+
+	return cap->err;
+}
+
+static int capture_pad(struct iio_capture *cap, uint64_t align)
+{
+	uint64_t offset = iio_capture_align(cap->offset, align);
+
+	return capture_write(cap, capture_zeros, (size_t) (offset - cap->offset));
+}
+
+static int capture_write_header(struct iio_capture *cap)
+{
+	const struct iio_device *dev = cap->buf->dev;
+	const char *xml = iio_context_get_xml(dev->ctx);
+	struct iio_capture_hdr hdr = {
+		.magic = IIO_CAPTURE_MAGIC,
+		.version = IIO_CAPTURE_VERSION,
+		.nb_words = (uint16_t) dev->words,
+		.dev = cap->dev_index,
+		.xml_len = (uint32_t) strlen(xml) + 1,
+		.data_offset = cap->data_offset,
+		.index_offset = cap->index_offset,
+		.nb_blocks = cap->index_offset ? cap->nb_blocks : 0,
+	};
+	uint8_t buf[IIO_CAPTURE_HDR_SIZE], word[4];
+	ssize_t sample_size;
+	unsigned int i;
+	int ret;
+
+	sample_size = iio_device_get_sample_size_mask(dev,
+			cap->buf->mask, dev->words);
+	if (sample_size < 0)
+		return (int) sample_size;
+
+	hdr.sample_size = (uint32_t) sample_size;
+	iio_capture_pack(buf, &hdr);
+
+	cap->offset = 0;
+	ret = capture_write(cap, buf, sizeof(buf));
+
+	for (i = 0; !ret && i < dev->words; i++) {
+		iiod_bin_put_le32(word, cap->buf->mask[i]);
+		ret = capture_write(cap, word, sizeof(word));
+	}
+
+	if (!ret)
+		ret = capture_write(cap, xml, hdr.xml_len);
+
+	return ret;
+}
+
+struct iio_capture * iio_buffer_create_capture(const struct iio_buffer *buf,
+		const char *path)
+{
+	const struct iio_device *dev = buf->dev;
+	const struct iio_context *ctx = dev->ctx;
+	const char *xml = iio_context_get_xml(ctx);
+	struct iio_capture *cap;
+	unsigned int i;
+	int err;
+
+	if (iio_device_is_tx(dev) || dev->words > UINT16_MAX) {
+		err = -EINVAL;
+		goto err_set_errno;
+	}
+
+	cap = zalloc(sizeof(*cap));
+	if (!cap) {
+		err = -ENOMEM;
+		goto err_set_errno;
+	}
+
+	cap->buf = buf;
+	cap->data_offset = iio_capture_align(IIO_CAPTURE_HDR_SIZE +
+			dev->words * sizeof(uint32_t) + strlen(xml) + 1,
+			IIO_CAPTURE_DATA_ALIGN);
+
+	for (i = 0; i < ctx->nb_devices; i++)
+		if (ctx->devices[i] == dev)
+			break;
+	cap->dev_index = i;
+
+	cap->f = fopen(path, "wb");
+	if (!cap->f) {
+		err = -errno;
+		goto err_free_cap;
+	}
+
+	/* The header is written again once the capture is complete */
+	err = capture_write_header(cap);
+	if (!err)
+		err = capture_pad(cap, IIO_CAPTURE_DATA_ALIGN);
+	if (!err && cap->offset != cap->data_offset)
+		err = -EINVAL;
+	if (err)
+		goto err_close_file;
+
+	return cap;
+
+err_close_file:
+	fclose(cap->f);
+	remove(path);
+err_free_cap:
+	free(cap);
+err_set_errno:
+	errno = -err;
+	return NULL;
+}
+
+int iio_capture_write(struct iio_capture *cap, const void *src, size_t len,
+		uint64_t timestamp)
+{
+	struct iio_capture_block_hdr hdr = {
+		.magic = IIO_CAPTURE_BLOCK_MAGIC,
+		.len = len,
+		.timestamp = timestamp,
+	};
+	struct iio_capture_index_entry *index;
+	uint8_t buf[IIO_CAPTURE_BLOCK_HDR_SIZE];
+	uint64_t offset = cap->offset;
+	size_t nb;
+	int ret;
+
+	if (cap->err)
+		return cap->err;
+
+	if (cap->nb_blocks == cap->nb_alloc) {
+		nb = cap->nb_alloc ? cap->nb_alloc * 2 : 64;
+
+		index = realloc(cap->index, nb * sizeof(*index));
+		if (!index)
+			return -ENOMEM;
+
+		cap->index = index;
+		cap->nb_alloc = nb;
+	}
+
+	iio_capture_block_pack(buf, &hdr);
+
+	ret = capture_write(cap, buf, sizeof(buf));
+	if (!ret)
+		ret = capture_write(cap, src, len);
+	if (!ret)
+		ret = capture_pad(cap, IIO_CAPTURE_BLOCK_ALIGN);
+	if (ret)
+		return ret;
+
+	cap->index[cap->nb_blocks].offset = offset;
+	cap->index[cap->nb_blocks].timestamp = timestamp;
+	cap->nb_blocks++;
+
+	return 0;
+}
+
+int iio_capture_close(struct iio_capture *cap)
+{
+	uint8_t buf[IIO_CAPTURE_INDEX_ENTRY_SIZE];
+	uint64_t index_offset = cap->offset;
+	size_t i;
+	int ret = cap->err;
+
+	for (i = 0; !ret && i < cap->nb_blocks; i++) {
+		iio_capture_index_pack(buf, &cap->index[i]);
+		ret = capture_write(cap, buf, sizeof(buf));
+	}
+
+	if (!ret) {
+		/* Fill in the position of the index and the number of blocks */
+		cap->index_offset = index_offset;
+
+		if (fseek(cap->f, 0, SEEK_SET))
+			ret = -errno;
+		else
+			ret = capture_write_header(cap);
+	}
+
+	if (fclose(cap->f) && !ret)
+		ret = -errno;
+
+	free(cap->index);
+	free(cap);
+	return ret;
+}
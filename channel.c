@@ -8,6 +8,7 @@
 
 #include "debug.h"
 #include "iio-private.h"
+#include "sort.h"
 
 #include <errno.h>
 #include <stdio.h>
@@ -167,6 +168,57 @@ void iio_channel_init_finalize(struct iio_channel *chn)
 	}
 }
 
+/*
+ * Look for the channel that forms a I/Q pair with the given one: it must have
+ * the opposite I or Q modifier, the same type and direction, and an ID that
+ * only differs by its modifier (e.g. "voltage0_i" and "voltage0_q").
+ */
+void iio_channel_init_iq_pair(struct iio_channel *chn)
+{
+	const struct iio_device *dev = chn->dev;
+	enum iio_modifier other;
+	const char *mod;
+	unsigned int i;
+	size_t pos;
+
+	chn->iq_pair = NULL;
+
+	if (chn->modifier == IIO_MOD_I)
+		other = IIO_MOD_Q;
+	else if (chn->modifier == IIO_MOD_Q)
+		other = IIO_MOD_I;
+	else
+		return;
+
+	mod = strchr(chn->id, '_');
+	if (!mod)
+		return;
+
+	pos = mod + 1 - chn->id;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *cur = dev->channels[i];
+
+		if (cur == chn || cur->modifier != other ||
+				cur->type != chn->type ||
+				cur->is_output != chn->is_output ||
+				strlen(cur->id) != strlen(chn->id))
+			continue;
+
+		if (strncmp(cur->id, chn->id, pos) ||
+				strcmp(cur->id + pos + 1, chn->id + pos + 1))
+			continue;
+
+		chn->iq_pair = cur;
+		break;
+	}
+}
+
+struct iio_channel * iio_channel_get_iq_pair(const struct iio_channel *chn)
+{
+	return chn->iq_pair;
+}
+
 static ssize_t iio_snprintf_chan_attr_xml(char *str, ssize_t len,
 					  struct iio_channel_attr *attr)
 {
@@ -193,7 +245,7 @@ static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
 					     const struct iio_channel *chn)
 {
 	char processed = (chn->format.is_fully_defined ? 'A' - 'a' : 0);
-	char repeat[12] = "", scale[48] = "";
+	char repeat[12] = "", scale[48] = "", offset[48] = "";
 
 	if (chn->format.repeat > 1)
 		iio_snprintf(repeat, sizeof(repeat), "X%u", chn->format.repeat);
@@ -201,12 +253,15 @@ static ssize_t iio_snprintf_scan_element_xml(char *str, ssize_t len,
 	if (chn->format.with_scale)
 		iio_snprintf(scale, sizeof(scale), "scale=\"%f\" ", chn->format.scale);
 
+	if (chn->format.offset != 0.0)
+		iio_snprintf(offset, sizeof(offset), "offset=\"%f\" ", chn->format.offset);
+
 	return iio_snprintf(str, len,
-			"<scan-element index=\"%li\" format=\"%ce:%c%u/%u%s&gt;&gt;%u\" %s/>",
+			"<scan-element index=\"%li\" format=\"%ce:%c%u/%u%s&gt;&gt;%u\" %s%s/>",
 			chn->index, chn->format.is_be ? 'b' : 'l',
 			chn->format.is_signed ? 's' + processed : 'u' + processed,
 			chn->format.bits, chn->format.length, repeat,
-			chn->format.shift, scale);
+			chn->format.shift, scale, offset);
 }
 
 ssize_t iio_snprintf_channel_xml(char *ptr, ssize_t len,
@@ -303,6 +358,12 @@ const char * iio_channel_find_attr(const struct iio_channel *chn,
 		const char *name)
 {
 	unsigned int i;
+	int ret;
+
+	ret = iio_index_find(&chn->attrs_index, name);
+	if (ret != -ENOSYS)
+		return ret < 0 ? NULL : chn->attrs[ret].name;
+
 	for (i = 0; i < chn->nb_attrs; i++) {
 		const char *attr = chn->attrs[i].name;
 		if (!strcmp(attr, name))
@@ -314,21 +375,39 @@ const char * iio_channel_find_attr(const struct iio_channel *chn,
 ssize_t iio_channel_attr_read(const struct iio_channel *chn,
 		const char *attr, char *dst, size_t len)
 {
-	if (chn->dev->ctx->ops->read_channel_attr)
-		return chn->dev->ctx->ops->read_channel_attr(chn,
-				attr, dst, len);
-	else
+	const struct iio_context *ctx = chn->dev->ctx;
+	uint64_t start;
+	ssize_t ret;
+
+	if (!ctx->ops->read_channel_attr)
 		return -ENOSYS;
+
+	IIO_TRACE(attr_read_start, chn, attr);
+	start = iio_stats_start();
+	ret = ctx->ops->read_channel_attr(chn, attr, dst, len);
+	iio_stats_record(ctx->stats, IIO_STATS_ATTR_READ, start, ret);
+	IIO_TRACE(attr_read_done, chn, ret);
+
+	return ret;
 }
 
 ssize_t iio_channel_attr_write_raw(const struct iio_channel *chn,
 		const char *attr, const void *src, size_t len)
 {
-	if (chn->dev->ctx->ops->write_channel_attr)
-		return chn->dev->ctx->ops->write_channel_attr(chn,
-				attr, src, len);
-	else
+	const struct iio_context *ctx = chn->dev->ctx;
+	uint64_t start;
+	ssize_t ret;
+
+	if (!ctx->ops->write_channel_attr)
 		return -ENOSYS;
+
+	IIO_TRACE(attr_write_start, chn, attr);
+	start = iio_stats_start();
+	ret = ctx->ops->write_channel_attr(chn, attr, src, len);
+	iio_stats_record(ctx->stats, IIO_STATS_ATTR_WRITE, start, ret);
+	IIO_TRACE(attr_write_done, chn, ret);
+
+	return ret;
 }
 
 ssize_t iio_channel_attr_write(const struct iio_channel *chn,
@@ -384,6 +463,7 @@ void free_channel(struct iio_channel *chn)
 		free(chn->attrs[i].filename);
 	}
 	free(chn->attrs);
+	iio_index_free(&chn->attrs_index);
 	free(chn->name);
 	free(chn->id);
 	free(chn);
@@ -478,7 +558,7 @@ static void mask_upper_bits(uint8_t *dst, size_t bits, size_t len)
 }
 
 
-void iio_channel_convert(const struct iio_channel *chn,
+static void convert_sample(const struct iio_channel *chn,
 		void *dst, const void *src)
 {
 	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
@@ -510,7 +590,7 @@ void iio_channel_convert(const struct iio_channel *chn,
 	}
 }
 
-void iio_channel_convert_inverse(const struct iio_channel *chn,
+static void convert_inverse_sample(const struct iio_channel *chn,
 		void *dst, const void *src)
 {
 	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
@@ -539,6 +619,510 @@ void iio_channel_convert_inverse(const struct iio_channel *chn,
 	}
 }
 
+/*
+ * Conversion plans.
+ *
+ * The per-sample functions above work on arbitrary sample lengths by
+ * manipulating single bytes, which is slow. For elements that are 8, 16, 32
+ * or 64 bits long, the conversion can be expressed with plain integer
+ * operations instead: a byte swap, a right shift, and a mask / sign extension
+ * that does not need any branch.
+ *
+ * Since the data format of a channel never changes once the context has been
+ * created, the kernel to use is selected once by iio_channel_init_convert(),
+ * and the parameters it needs are precomputed in chn->convert_params. The
+ * kernels are specialized on the element size and on whether a byte swap is
+ * needed, so that their inner loop has no branch and can be vectorized by the
+ * compiler when the samples are contiguous. Formats that don't need any
+ * processing at all (e.g. le:S16/16>>0 on a little-endian host) are simply
+ * copied.
+ *
+ * All kernels convert 'nb' samples; on the hardware side the samples are
+ * located every 'step' bytes, on the host side they are contiguous.
+ */
+
+static inline uint16_t iio_bswap16(uint16_t word)
+{
+	return (uint16_t) ((word << 8) | (word >> 8));
+}
+
+static inline uint32_t iio_bswap32(uint32_t word)
+{
+#ifdef __GNUC__
+	return __builtin_bswap32(word);
+#else
+	return ((word & 0xff) << 24) | ((word & 0xff00) << 8) |
+		((word >> 8) & 0xff00) | ((word >> 24) & 0xff);
+#endif
+}
+
+static inline uint64_t iio_bswap64(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_bswap64(word);
+#else
+	return ((uint64_t) iio_bswap32((uint32_t) word) << 32) |
+		iio_bswap32((uint32_t) (word >> 32));
+#endif
+}
+
+#define iio_nobswap(word) (word)
+
+#define DEFINE_CONVERT_KERNELS(name, bits, swap)			\
+static void convert_##name(const struct iio_channel *chn,		\
+		void *dst, const void *src, ptrdiff_t step, size_t nb)	\
+{									\
+	const struct iio_convert_params *params = &chn->convert_params;	\
+	const uint##bits##_t mask = (uint##bits##_t) params->mask;	\
+	const uint##bits##_t sign = (uint##bits##_t) params->sign;	\
+	const unsigned int shift = params->shift;			\
+	unsigned int repeat = chn->format.repeat;			\
+	const uint8_t *s = src;						\
+	uint##bits##_t *d = dst, v;					\
+	size_t i, j;							\
+									\
+	if (step == (ptrdiff_t) (repeat * sizeof(v))) {			\
+		nb *= repeat;						\
+		repeat = 1;						\
+		step = sizeof(v);					\
+	}								\
+									\
+	for (i = 0; i < nb; i++, s += step) {				\
+		for (j = 0; j < repeat; j++) {				\
+			memcpy(&v, s + j * sizeof(v), sizeof(v));	\
+			v = (uint##bits##_t) ((swap(v) >> shift) & mask); \
+			*d++ = (uint##bits##_t) ((v ^ sign) - sign);	\
+		}							\
+	}								\
+}									\
+									\
+static void convert_inverse_##name(const struct iio_channel *chn,	\
+		void *dst, const void *src, ptrdiff_t step, size_t nb)	\
+{									\
+	const struct iio_convert_params *params = &chn->convert_params;	\
+	const uint##bits##_t mask = (uint##bits##_t) params->inverse_mask; \
+	const unsigned int shift = params->shift;			\
+	unsigned int repeat = chn->format.repeat;			\
+	const uint##bits##_t *s = src;					\
+	uint8_t *d = dst;						\
+	uint##bits##_t v;						\
+	size_t i, j;							\
+									\
+	if (step == (ptrdiff_t) (repeat * sizeof(v))) {			\
+		nb *= repeat;						\
+		repeat = 1;						\
+		step = sizeof(v);					\
+	}								\
+									\
+	for (i = 0; i < nb; i++, d += step) {				\
+		for (j = 0; j < repeat; j++) {				\
+			v = (uint##bits##_t) ((*s++ & mask) << shift);	\
+			v = swap(v);					\
+			memcpy(d + j * sizeof(v), &v, sizeof(v));	\
+		}							\
+	}								\
+}
+
+DEFINE_CONVERT_KERNELS(u8, 8, iio_nobswap)
+DEFINE_CONVERT_KERNELS(u16, 16, iio_nobswap)
+DEFINE_CONVERT_KERNELS(u32, 32, iio_nobswap)
+DEFINE_CONVERT_KERNELS(u64, 64, iio_nobswap)
+DEFINE_CONVERT_KERNELS(u16_swap, 16, iio_bswap16)
+DEFINE_CONVERT_KERNELS(u32_swap, 32, iio_bswap32)
+DEFINE_CONVERT_KERNELS(u64_swap, 64, iio_bswap64)
+
+static void convert_copy(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
+	size_t i;
+
+	if (step == (ptrdiff_t) length) {
+		memcpy(dst, src, nb * length);
+		return;
+	}
+
+	for (i = 0; i < nb; i++, src_ptr += step, dst_ptr += length)
+		memcpy((void *) dst_ptr, (const void *) src_ptr, length);
+}
+
+static void convert_inverse_copy(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
+	size_t i;
+
+	if (step == (ptrdiff_t) length) {
+		memcpy(dst, src, nb * length);
+		return;
+	}
+
+	for (i = 0; i < nb; i++, src_ptr += length, dst_ptr += step)
+		memcpy((void *) dst_ptr, (const void *) src_ptr, length);
+}
+
+static void convert_generic(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
+	size_t i;
+
+	for (i = 0; i < nb; i++, src_ptr += step, dst_ptr += length)
+		convert_sample(chn, (void *) dst_ptr, (const void *) src_ptr);
+}
+
+static void convert_inverse_generic(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	uintptr_t src_ptr = (uintptr_t) src, dst_ptr = (uintptr_t) dst;
+	size_t i;
+
+	for (i = 0; i < nb; i++, src_ptr += length, dst_ptr += step)
+		convert_inverse_sample(chn, (void *) dst_ptr,
+				(const void *) src_ptr);
+}
+
+/*
+ * The floating-point kernels do the same work as the integer ones, and then
+ * apply the channel's offset and scale, so that the processed value
+ * ((raw + offset) * scale) is obtained in a single pass.
+ */
+#define DEFINE_CONVERT_FP_KERNEL(name, bits, swap, type)		\
+static void convert_##name##_##type(const struct iio_channel *chn,	\
+		void *dst, const void *src, ptrdiff_t step, size_t nb)	\
+{									\
+	const struct iio_convert_params *params = &chn->convert_params;	\
+	const uint##bits##_t mask = (uint##bits##_t) params->mask;	\
+	const uint##bits##_t sign = (uint##bits##_t) params->sign;	\
+	const unsigned int shift = params->shift;			\
+	const type scale = (type) params->scale;			\
+	const type offset = (type) params->offset;			\
+	unsigned int repeat = chn->format.repeat;			\
+	const uint8_t *s = src;						\
+	type *d = dst;							\
+	uint##bits##_t v;						\
+	size_t i, j;							\
+									\
+	if (step == (ptrdiff_t) (repeat * sizeof(v))) {			\
+		nb *= repeat;						\
+		repeat = 1;						\
+		step = sizeof(v);					\
+	}								\
+									\
+	for (i = 0; i < nb; i++, s += step) {				\
+		for (j = 0; j < repeat; j++) {				\
+			memcpy(&v, s + j * sizeof(v), sizeof(v));	\
+			v = (uint##bits##_t) ((swap(v) >> shift) & mask); \
+			v = (uint##bits##_t) ((v ^ sign) - sign);	\
+			if (params->is_signed)				\
+				*d++ = ((type) (int##bits##_t) v + offset) * scale; \
+			else						\
+				*d++ = ((type) v + offset) * scale;	\
+		}							\
+	}								\
+}
+
+#define DEFINE_CONVERT_FP_KERNELS(name, bits, swap)			\
+	DEFINE_CONVERT_FP_KERNEL(name, bits, swap, float)		\
+	DEFINE_CONVERT_FP_KERNEL(name, bits, swap, double)
+
+DEFINE_CONVERT_FP_KERNELS(u8, 8, iio_nobswap)
+DEFINE_CONVERT_FP_KERNELS(u16, 16, iio_nobswap)
+DEFINE_CONVERT_FP_KERNELS(u32, 32, iio_nobswap)
+DEFINE_CONVERT_FP_KERNELS(u64, 64, iio_nobswap)
+DEFINE_CONVERT_FP_KERNELS(u16_swap, 16, iio_bswap16)
+DEFINE_CONVERT_FP_KERNELS(u32_swap, 32, iio_bswap32)
+DEFINE_CONVERT_FP_KERNELS(u64_swap, 64, iio_bswap64)
+
+/*
+ * Convert one element with the generic code, and return it as a 64-bit
+ * integer. Elements larger than 64 bits are not supported.
+ */
+static uint64_t convert_generic_element(const struct iio_channel *chn,
+		const uint8_t *src)
+{
+	unsigned int k, len = chn->format.length / 8;
+	struct iio_channel tmp = *chn;
+	uint8_t buf[8];
+	uint64_t v = 0;
+
+	if (len > sizeof(buf) || !len)
+		return 0;
+
+	tmp.format.repeat = 1;
+	convert_sample(&tmp, buf, src);
+
+	for (k = 0; k < len; k++)
+		v |= (uint64_t) buf[is_little_endian() ? k : len - k - 1] << (8 * k);
+
+	if (chn->format.is_signed && len < 8 && (v >> (len * 8 - 1)) & 1)
+		v |= ~(uint64_t) 0 << (len * 8);
+
+	return v;
+}
+
+#define DEFINE_CONVERT_FP_GENERIC(type)					\
+static void convert_generic_##type(const struct iio_channel *chn,	\
+		void *dst, const void *src, ptrdiff_t step, size_t nb)	\
+{									\
+	const struct iio_convert_params *params = &chn->convert_params;	\
+	unsigned int j, len = chn->format.length / 8;			\
+	const uint8_t *s = src;						\
+	type *d = dst;							\
+	uint64_t v;							\
+	size_t i;							\
+									\
+	for (i = 0; i < nb; i++, s += step) {				\
+		for (j = 0; j < chn->format.repeat; j++) {		\
+			v = convert_generic_element(chn, s + j * len);	\
+			if (params->is_signed)				\
+				*d++ = (type) (((double) (int64_t) v +	\
+					params->offset) * params->scale); \
+			else						\
+				*d++ = (type) (((double) v +		\
+					params->offset) * params->scale); \
+		}							\
+	}								\
+}
+
+DEFINE_CONVERT_FP_GENERIC(float)
+DEFINE_CONVERT_FP_GENERIC(double)
+
+/*
+ * Selects the conversion kernels of the channel according to its data format.
+ * Must be called once the data format of the channel is known.
+ */
+void iio_channel_init_convert(struct iio_channel *chn)
+{
+	const struct iio_data_format *fmt = &chn->format;
+	struct iio_convert_params *params = &chn->convert_params;
+	unsigned int length = fmt->length;
+	bool swap = length > 8 && (is_little_endian() ^ !fmt->is_be);
+
+	chn->convert = convert_generic;
+	chn->convert_inverse = convert_inverse_generic;
+	chn->convert_float = convert_generic_float;
+	chn->convert_double = convert_generic_double;
+
+	params->is_signed = fmt->is_signed;
+	params->scale = fmt->with_scale ? fmt->scale : 1.0;
+	params->offset = fmt->offset;
+
+	if (length != 8 && length != 16 && length != 32 && length != 64)
+		return;
+	if (fmt->shift >= length || fmt->bits > length)
+		return;
+
+	params->shift = fmt->shift;
+
+	if (fmt->bits >= 64)
+		params->inverse_mask = ~(uint64_t) 0;
+	else
+		params->inverse_mask = ((uint64_t) 1 << fmt->bits) - 1;
+
+	if (fmt->is_fully_defined) {
+		params->mask = ~(uint64_t) 0;
+		params->sign = 0;
+	} else {
+		params->mask = params->inverse_mask;
+		if (fmt->is_signed && fmt->bits)
+			params->sign = (uint64_t) 1 << (fmt->bits - 1);
+		else
+			params->sign = 0;
+	}
+
+	switch (length) {
+	case 8:
+		chn->convert = convert_u8;
+		chn->convert_inverse = convert_inverse_u8;
+		chn->convert_float = convert_u8_float;
+		chn->convert_double = convert_u8_double;
+		break;
+	case 16:
+		chn->convert = swap ? convert_u16_swap : convert_u16;
+		chn->convert_inverse = swap ?
+			convert_inverse_u16_swap : convert_inverse_u16;
+		chn->convert_float = swap ?
+			convert_u16_swap_float : convert_u16_float;
+		chn->convert_double = swap ?
+			convert_u16_swap_double : convert_u16_double;
+		break;
+	case 32:
+		chn->convert = swap ? convert_u32_swap : convert_u32;
+		chn->convert_inverse = swap ?
+			convert_inverse_u32_swap : convert_inverse_u32;
+		chn->convert_float = swap ?
+			convert_u32_swap_float : convert_u32_float;
+		chn->convert_double = swap ?
+			convert_u32_swap_double : convert_u32_double;
+		break;
+	default:
+		chn->convert = swap ? convert_u64_swap : convert_u64;
+		chn->convert_inverse = swap ?
+			convert_inverse_u64_swap : convert_inverse_u64;
+		chn->convert_float = swap ?
+			convert_u64_swap_float : convert_u64_float;
+		chn->convert_double = swap ?
+			convert_u64_swap_double : convert_u64_double;
+		break;
+	}
+
+	if (!swap && !fmt->shift) {
+		if (fmt->is_fully_defined || fmt->bits == length)
+			chn->convert = convert_copy;
+		if (fmt->bits == length)
+			chn->convert_inverse = convert_inverse_copy;
+	}
+}
+
+void iio_channel_convert_strided(const struct iio_channel *chn, void *dst,
+		const void *src, ptrdiff_t step, size_t nb)
+{
+	if (chn->convert)
+		chn->convert(chn, dst, src, step, nb);
+	else
+		convert_generic(chn, dst, src, step, nb);
+}
+
+void iio_channel_convert_inverse_strided(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	if (chn->convert_inverse)
+		chn->convert_inverse(chn, dst, src, step, nb);
+	else
+		convert_inverse_generic(chn, dst, src, step, nb);
+}
+
+void iio_channel_convert_float_strided(const struct iio_channel *chn,
+		float *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	if (chn->convert_float)
+		chn->convert_float(chn, dst, src, step, nb);
+	else
+		convert_generic_float(chn, dst, src, step, nb);
+}
+
+void iio_channel_convert_double_strided(const struct iio_channel *chn,
+		double *dst, const void *src, ptrdiff_t step, size_t nb)
+{
+	if (chn->convert_double)
+		chn->convert_double(chn, dst, src, step, nb);
+	else
+		convert_generic_double(chn, dst, src, step, nb);
+}
+
+void iio_channel_convert(const struct iio_channel *chn,
+		void *dst, const void *src)
+{
+	ptrdiff_t step = chn->format.length / 8 * chn->format.repeat;
+
+	iio_channel_convert_strided(chn, dst, src, step, 1);
+}
+
+void iio_channel_convert_inverse(const struct iio_channel *chn,
+		void *dst, const void *src)
+{
+	ptrdiff_t step = chn->format.length / 8 * chn->format.repeat;
+
+	iio_channel_convert_inverse_strided(chn, dst, src, step, 1);
+}
+
+void iio_channel_convert_block(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples)
+{
+	ptrdiff_t step = chn->format.length / 8 * chn->format.repeat;
+
+	iio_channel_convert_strided(chn, dst, src, step, nb_samples);
+}
+
+void iio_channel_convert_inverse_block(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples)
+{
+	ptrdiff_t step = chn->format.length / 8 * chn->format.repeat;
+
+	iio_channel_convert_inverse_strided(chn, dst, src, step, nb_samples);
+}
+
+/* Returns the number of samples of the channel present in the buffer */
+static size_t channel_buffer_samples(const struct iio_channel *chn,
+		const struct iio_buffer *buf, uintptr_t *first)
+{
+	uintptr_t buf_end = (uintptr_t) iio_buffer_end(buf);
+	size_t step = (size_t) iio_buffer_step(buf);
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+
+	*first = (uintptr_t) iio_buffer_first(buf, chn);
+
+	if (!step || !length || *first + length > buf_end)
+		return 0;
+
+	return (buf_end - *first - length) / step + 1;
+}
+
+size_t iio_channel_read_block(const struct iio_channel *chn,
+		struct iio_buffer *buf, void *dst,
+		size_t offset, size_t nb_samples)
+{
+	ptrdiff_t step = iio_buffer_step(buf);
+	uintptr_t first;
+	size_t nb = channel_buffer_samples(chn, buf, &first);
+
+	if (offset >= nb)
+		return 0;
+
+	if (nb_samples > nb - offset)
+		nb_samples = nb - offset;
+
+	iio_channel_convert_strided(chn, dst,
+			(const void *) (first + offset * step),
+			step, nb_samples);
+	return nb_samples;
+}
+
+size_t iio_channel_read_float(const struct iio_channel *chn,
+		struct iio_buffer *buf, float *dst,
+		size_t offset, size_t nb_samples)
+{
+	ptrdiff_t step = iio_buffer_step(buf);
+	uintptr_t first;
+	size_t nb = channel_buffer_samples(chn, buf, &first);
+
+	if (offset >= nb)
+		return 0;
+
+	if (nb_samples > nb - offset)
+		nb_samples = nb - offset;
+
+	iio_channel_convert_float_strided(chn, dst,
+			(const void *) (first + offset * step),
+			step, nb_samples);
+	return nb_samples;
+}
+
+size_t iio_channel_read_double(const struct iio_channel *chn,
+		struct iio_buffer *buf, double *dst,
+		size_t offset, size_t nb_samples)
+{
+	ptrdiff_t step = iio_buffer_step(buf);
+	uintptr_t first;
+	size_t nb = channel_buffer_samples(chn, buf, &first);
+
+	if (offset >= nb)
+		return 0;
+
+	if (nb_samples > nb - offset)
+		nb_samples = nb - offset;
+
+	iio_channel_convert_double_strided(chn, dst,
+			(const void *) (first + offset * step),
+			step, nb_samples);
+	return nb_samples;
+}
+
 size_t iio_channel_read_raw(const struct iio_channel *chn,
 		struct iio_buffer *buf, void *dst, size_t len)
 {
@@ -557,17 +1141,19 @@ size_t iio_channel_read_raw(const struct iio_channel *chn,
 size_t iio_channel_read(const struct iio_channel *chn,
 		struct iio_buffer *buf, void *dst, size_t len)
 {
-	uintptr_t src_ptr, dst_ptr = (uintptr_t) dst, end = dst_ptr + len;
-	unsigned int length = chn->format.length / 8 * chn->format.repeat;
-	uintptr_t buf_end = (uintptr_t) iio_buffer_end(buf);
-	ptrdiff_t buf_step = iio_buffer_step(buf);
+	uintptr_t first;
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	size_t nb = channel_buffer_samples(chn, buf, &first);
 
-	for (src_ptr = (uintptr_t) iio_buffer_first(buf, chn);
-			src_ptr < buf_end && dst_ptr + length <= end;
-			src_ptr += buf_step, dst_ptr += length)
-		iio_channel_convert(chn,
-				(void *) dst_ptr, (const void *) src_ptr);
-	return dst_ptr - (uintptr_t) dst;
+	if (!length)
+		return 0;
+
+	if (nb > len / length)
+		nb = len / length;
+
+	iio_channel_convert_strided(chn, dst, (const void *) first,
+			iio_buffer_step(buf), nb);
+	return nb * length;
 }
 
 size_t iio_channel_write_raw(const struct iio_channel *chn,
@@ -588,17 +1174,19 @@ size_t iio_channel_write_raw(const struct iio_channel *chn,
 size_t iio_channel_write(const struct iio_channel *chn,
 		struct iio_buffer *buf, const void *src, size_t len)
 {
-	uintptr_t dst_ptr, src_ptr = (uintptr_t) src, end = src_ptr + len;
-	unsigned int length = chn->format.length / 8 * chn->format.repeat;
-	uintptr_t buf_end = (uintptr_t) iio_buffer_end(buf);
-	ptrdiff_t buf_step = iio_buffer_step(buf);
+	uintptr_t first;
+	size_t length = chn->format.length / 8 * chn->format.repeat;
+	size_t nb = channel_buffer_samples(chn, buf, &first);
 
-	for (dst_ptr = (uintptr_t) iio_buffer_first(buf, chn);
-			dst_ptr < buf_end && src_ptr + length <= end;
-			dst_ptr += buf_step, src_ptr += length)
-		iio_channel_convert_inverse(chn,
-				(void *) dst_ptr, (const void *) src_ptr);
-	return src_ptr - (uintptr_t) src;
+	if (!length)
+		return 0;
+
+	if (nb > len / length)
+		nb = len / length;
+
+	iio_channel_convert_inverse_strided(chn, (void *) first, src,
+			iio_buffer_step(buf), nb);
+	return nb * length;
 }
 
 int iio_channel_attr_read_longlong(const struct iio_channel *chn,
@@ -12,6 +12,7 @@
 #include "sort.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 static const char xml_header[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
@@ -29,7 +30,7 @@ static const char xml_header[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
 "<!ATTLIST context-attribute name CDATA #REQUIRED value CDATA #REQUIRED>"
 "<!ATTLIST device id CDATA #REQUIRED name CDATA #IMPLIED label CDATA #IMPLIED>"
 "<!ATTLIST channel id CDATA #REQUIRED type (input|output) #REQUIRED name CDATA #IMPLIED>"
-"<!ATTLIST scan-element index CDATA #REQUIRED format CDATA #REQUIRED scale CDATA #IMPLIED>"
+"<!ATTLIST scan-element index CDATA #REQUIRED format CDATA #REQUIRED scale CDATA #IMPLIED offset CDATA #IMPLIED>"
 "<!ATTLIST attribute name CDATA #REQUIRED filename CDATA #IMPLIED>"
 "<!ATTLIST debug-attribute name CDATA #REQUIRED>"
 "<!ATTLIST buffer-attribute name CDATA #REQUIRED>"
@@ -165,7 +166,7 @@ static ssize_t iio_snprintf_context_xml(char *ptr, ssize_t len,
 }
 
 /* Returns a string containing the XML representation of this context */
-static char * iio_context_create_xml(const struct iio_context *ctx)
+char * iio_context_create_xml(const struct iio_context *ctx)
 {
 	ssize_t len;
 	char *str;
@@ -239,7 +240,10 @@ struct iio_context_pdata * iio_context_get_pdata(const struct iio_context *ctx)
 
 const char * iio_context_get_xml(const struct iio_context *ctx)
 {
-	return ctx->xml;
+	if (ctx->ops->get_xml)
+		return ctx->ops->get_xml(ctx);
+	else
+		return ctx->xml;
 }
 
 const char * iio_context_get_name(const struct iio_context *ctx)
@@ -270,6 +274,7 @@ void iio_context_destroy(struct iio_context *ctx)
 	for (i = 0; i < ctx->nb_devices; i++)
 		free_device(ctx->devices[i]);
 	free(ctx->devices);
+	iio_index_free(&ctx->devices_index);
 	free(ctx->xml);
 	free(ctx->description);
 	free(ctx->git_tag);
@@ -295,6 +300,12 @@ struct iio_device * iio_context_find_device(const struct iio_context *ctx,
 		const char *name)
 {
 	unsigned int i;
+	int ret;
+
+	ret = iio_index_find(&ctx->devices_index, name);
+	if (ret != -ENOSYS)
+		return ret < 0 ? NULL : ctx->devices[ret];
+
 	for (i = 0; i < ctx->nb_devices; i++) {
 		struct iio_device *dev = ctx->devices[i];
 		if (!strcmp(dev->id, name) ||
@@ -338,12 +349,26 @@ static void reorder_channels(struct iio_device *dev)
 
 int iio_context_init(struct iio_context *ctx)
 {
-	unsigned int i;
+	unsigned int i, j;
+	int ret;
 
-	for (i = 0; i < ctx->nb_devices; i++)
-		reorder_channels(ctx->devices[i]);
+	for (i = 0; i < ctx->nb_devices; i++) {
+		struct iio_device *dev = ctx->devices[i];
+
+		reorder_channels(dev);
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			iio_channel_init_convert(dev->channels[j]);
+			iio_channel_init_iq_pair(dev->channels[j]);
+		}
+	}
+
+	ret = iio_context_build_indexes(ctx);
+	if (ret)
+		return ret;
 
-	if (!ctx->xml) {
+	/* Backends providing get_xml may generate it on demand */
+	if (!ctx->xml && !ctx->ops->get_xml) {
 		ctx->xml = iio_context_create_xml(ctx);
 		if (IS_ERR(ctx->xml))
 			return PTR_ERR(ctx->xml);
@@ -381,6 +406,66 @@ int iio_context_set_timeout(struct iio_context *ctx, unsigned int timeout)
 		return -ENOSYS;
 }
 
+int iio_context_set_attr_cache(struct iio_context *ctx, unsigned int ttl_ms)
+{
+	if (ttl_ms > INT_MAX)
+		return -EINVAL;
+
+	if (ctx->ops->set_attr_cache)
+		return ctx->ops->set_attr_cache(ctx, NULL, (int) ttl_ms);
+	else
+		return -ENOSYS;
+}
+
+int iio_context_set_attr_cache_ttl(struct iio_context *ctx,
+		const char *attr, int ttl_ms)
+{
+	if (!attr)
+		return -EINVAL;
+
+	if (ctx->ops->set_attr_cache)
+		return ctx->ops->set_attr_cache(ctx, attr, ttl_ms);
+	else
+		return -ENOSYS;
+}
+
+int iio_context_set_io_uring(struct iio_context *ctx, bool enable)
+{
+	if (ctx->ops->set_io_uring)
+		return ctx->ops->set_io_uring(ctx, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_context_enable_multiplexing(struct iio_context *ctx)
+{
+	if (ctx->ops->enable_multiplexing)
+		return ctx->ops->enable_multiplexing(ctx);
+	else
+		return -ENOSYS;
+}
+
+int iio_context_close_attr_fds(const struct iio_context *ctx)
+{
+	if (ctx->ops->close_attr_fds)
+		return ctx->ops->close_attr_fds(ctx);
+	else
+		return -ENOSYS;
+}
+
+int iio_context_set_buffer_allocator(struct iio_context *ctx,
+		void * (*alloc_fn)(size_t size, void *d),
+		void (*free_fn)(void *ptr, size_t size, void *d), void *d)
+{
+	if (!alloc_fn != !free_fn)
+		return -EINVAL;
+
+	ctx->buffer_alloc = alloc_fn;
+	ctx->buffer_free = free_fn;
+	ctx->buffer_alloc_data = d;
+	return 0;
+}
+
 struct iio_context * iio_context_clone(const struct iio_context *ctx)
 {
 	if (ctx->ops->clone) {
@@ -408,6 +493,13 @@ struct iio_context * iio_create_context_from_uri(const char *uri)
 	if (WITH_SERIAL_BACKEND && strncmp(uri, "serial:", sizeof("serial:") - 1) == 0)
 		return serial_create_context_from_uri(uri);
 
+	if (WITH_FILE_BACKEND && strncmp(uri, "file:", sizeof("file:") - 1) == 0)
+		return file_create_context(uri + sizeof("file:") - 1);
+
+	if (WITH_SYNTHETIC_BACKEND &&
+	    strncmp(uri, "synthetic:", sizeof("synthetic:") - 1) == 0)
+		return synthetic_create_context(uri + sizeof("synthetic:") - 1);
+
 	errno = ENOSYS;
 	return NULL;
 }
@@ -462,6 +554,15 @@ struct iio_context * iio_create_xml_context(const char *xml_file)
 	return NULL;
 }
 
+struct iio_context * iio_create_file_context(const char *path)
+{
+	if (WITH_FILE_BACKEND)
+		return file_create_context(path);
+
+	errno = ENOSYS;
+	return NULL;
+}
+
 unsigned int iio_context_get_attrs_count(const struct iio_context *ctx)
 {
 	return ctx->nb_attrs;
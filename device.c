@@ -8,6 +8,7 @@
 
 #include "debug.h"
 #include "iio-private.h"
+#include "sort.h"
 
 #include <inttypes.h>
 #include <errno.h>
@@ -29,6 +30,13 @@ static ssize_t iio_snprintf_xml_attr(char *buf, ssize_t len, const char *attr,
 	}
 }
 
+/* Backends may discover the debug attributes on first use */
+static void iio_device_load_debug_attrs(const struct iio_device *dev)
+{
+	if (dev->ctx->ops->load_debug_attrs)
+		dev->ctx->ops->load_debug_attrs(dev);
+}
+
 ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
 				const struct iio_device *dev)
 {
@@ -88,6 +96,8 @@ ssize_t iio_snprintf_device_xml(char *ptr, ssize_t len,
 		iio_update_xml_indexes(ret, &ptr, &len, &alen);
 	}
 
+	iio_device_load_debug_attrs(dev);
+
 	for (i = 0; i < dev->debug_attrs.num; i++) {
 		ret = iio_snprintf_xml_attr(ptr, len, dev->debug_attrs.names[i],
 					    IIO_ATTR_TYPE_DEBUG);
@@ -121,6 +131,9 @@ int add_iio_dev_attr(struct iio_dev_attrs *attrs, const char *attr,
 
 	names[attrs->num++] = name;
 	attrs->names = names;
+
+	/* The index has to be built again */
+	iio_index_free(&attrs->index);
 	IIO_DEBUG("Added%s attr \'%s\' to device \'%s\'\n", type, attr, dev_id);
 	return 0;
 }
@@ -158,6 +171,12 @@ struct iio_channel * iio_device_find_channel(const struct iio_device *dev,
 		const char *name, bool output)
 {
 	unsigned int i;
+	int ret;
+
+	ret = iio_index_find(&dev->channels_index[output], name);
+	if (ret != -ENOSYS)
+		return ret < 0 ? NULL : dev->channels[ret];
+
 	for (i = 0; i < dev->nb_channels; i++) {
 		struct iio_channel *chn = dev->channels[i];
 		if (iio_channel_is_output(chn) != output)
@@ -183,6 +202,12 @@ const char * iio_device_find_dev_attr(const struct iio_dev_attrs *attrs,
 		const char *name)
 {
 	unsigned int i;
+	int ret;
+
+	ret = iio_index_find(&attrs->index, name);
+	if (ret != -ENOSYS)
+		return ret < 0 ? NULL : attrs->names[ret];
+
 	for (i = 0; i < attrs->num; i++) {
 		const char *attr = attrs->names[i];
 		if (!strcmp(attr, name))
@@ -228,6 +253,8 @@ const char * iio_device_find_buffer_attr(const struct iio_device *dev,
 const char * iio_device_find_debug_attr(const struct iio_device *dev,
 		const char *name)
 {
+	iio_device_load_debug_attrs(dev);
+
 	return iio_device_find_dev_attr(&dev->debug_attrs, name);
 }
 
@@ -249,24 +276,35 @@ int iio_device_open(const struct iio_device *dev,
 {
 	unsigned int i;
 	bool has_channels = false;
+	uint64_t start;
+	int ret;
 
 	for (i = 0; !has_channels && i < dev->words; i++)
 		has_channels = !!dev->mask[i];
 	if (!has_channels)
 		return -EINVAL;
 
-	if (dev->ctx->ops->open)
-		return dev->ctx->ops->open(dev, samples_count, cyclic);
-	else
+	if (!dev->ctx->ops->open)
 		return -ENOSYS;
+
+	start = iio_stats_start();
+	ret = dev->ctx->ops->open(dev, samples_count, cyclic);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_OPEN, start, ret);
+	return ret;
 }
 
 int iio_device_close(const struct iio_device *dev)
 {
-	if (dev->ctx->ops->close)
-		return dev->ctx->ops->close(dev);
-	else
+	uint64_t start;
+	int ret;
+
+	if (!dev->ctx->ops->close)
 		return -ENOSYS;
+
+	start = iio_stats_start();
+	ret = dev->ctx->ops->close(dev);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_CLOSE, start, ret);
+	return ret;
 }
 
 int iio_device_get_poll_fd(const struct iio_device *dev)
@@ -288,39 +326,80 @@ int iio_device_set_blocking_mode(const struct iio_device *dev, bool blocking)
 ssize_t iio_device_read_raw(const struct iio_device *dev,
 		void *dst, size_t len, uint32_t *mask, size_t words)
 {
-	if (dev->ctx->ops->read)
-		return dev->ctx->ops->read(dev, dst, len, mask, words);
-	else
+	uint64_t start;
+	ssize_t ret;
+
+	if (!dev->ctx->ops->read)
 		return -ENOSYS;
+
+	start = iio_stats_start();
+	ret = dev->ctx->ops->read(dev, dst, len, mask, words);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_READ, start, ret);
+	return ret;
 }
 
 ssize_t iio_device_write_raw(const struct iio_device *dev,
 		const void *src, size_t len)
 {
-	if (dev->ctx->ops->write)
-		return dev->ctx->ops->write(dev, src, len);
-	else
+	uint64_t start;
+	ssize_t ret;
+
+	if (!dev->ctx->ops->write)
+		return -ENOSYS;
+
+	start = iio_stats_start();
+	ret = dev->ctx->ops->write(dev, src, len);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_WRITE, start, ret);
+	return ret;
+}
+
+static ssize_t device_attr_read(const struct iio_device *dev,
+		const char *attr, char *dst, size_t len, enum iio_attr_type type)
+{
+	uint64_t start;
+	ssize_t ret;
+
+	if (!dev->ctx->ops->read_device_attr)
 		return -ENOSYS;
+
+	IIO_TRACE(attr_read_start, dev, attr);
+	start = iio_stats_start();
+	ret = dev->ctx->ops->read_device_attr(dev, attr, dst, len, type);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_ATTR_READ, start, ret);
+	IIO_TRACE(attr_read_done, dev, ret);
+
+	return ret;
+}
+
+static ssize_t device_attr_write(const struct iio_device *dev,
+		const char *attr, const void *src, size_t len,
+		enum iio_attr_type type)
+{
+	uint64_t start;
+	ssize_t ret;
+
+	if (!dev->ctx->ops->write_device_attr)
+		return -ENOSYS;
+
+	IIO_TRACE(attr_write_start, dev, attr);
+	start = iio_stats_start();
+	ret = dev->ctx->ops->write_device_attr(dev, attr, src, len, type);
+	iio_stats_record(dev->ctx->stats, IIO_STATS_ATTR_WRITE, start, ret);
+	IIO_TRACE(attr_write_done, dev, ret);
+
+	return ret;
 }
 
 ssize_t iio_device_attr_read(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len)
 {
-	if (dev->ctx->ops->read_device_attr)
-		return dev->ctx->ops->read_device_attr(dev,
-				attr, dst, len, IIO_ATTR_TYPE_DEVICE);
-	else
-		return -ENOSYS;
+	return device_attr_read(dev, attr, dst, len, IIO_ATTR_TYPE_DEVICE);
 }
 
 ssize_t iio_device_attr_write_raw(const struct iio_device *dev,
 		const char *attr, const void *src, size_t len)
 {
-	if (dev->ctx->ops->write_device_attr)
-		return dev->ctx->ops->write_device_attr(dev,
-				attr, src, len, IIO_ATTR_TYPE_DEVICE);
-	else
-		return -ENOSYS;
+	return device_attr_write(dev, attr, src, len, IIO_ATTR_TYPE_DEVICE);
 }
 
 ssize_t iio_device_attr_write(const struct iio_device *dev,
@@ -332,21 +411,13 @@ ssize_t iio_device_attr_write(const struct iio_device *dev,
 ssize_t iio_device_buffer_attr_read(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len)
 {
-	if (dev->ctx->ops->read_device_attr)
-		return dev->ctx->ops->read_device_attr(dev,
-				attr, dst, len, IIO_ATTR_TYPE_BUFFER);
-	else
-		return -ENOSYS;
+	return device_attr_read(dev, attr, dst, len, IIO_ATTR_TYPE_BUFFER);
 }
 
 ssize_t iio_device_buffer_attr_write_raw(const struct iio_device *dev,
 		const char *attr, const void *src, size_t len)
 {
-	if (dev->ctx->ops->write_device_attr)
-		return dev->ctx->ops->write_device_attr(dev,
-				attr, src, len, IIO_ATTR_TYPE_BUFFER);
-	else
-		return -ENOSYS;
+	return device_attr_write(dev, attr, src, len, IIO_ATTR_TYPE_BUFFER);
 }
 
 ssize_t iio_device_buffer_attr_write(const struct iio_device *dev,
@@ -377,6 +448,49 @@ bool iio_device_is_trigger(const struct iio_device *dev)
 		!strncmp(id, "trigger", sizeof("trigger") - 1));
 }
 
+int iio_device_set_dmabuf(const struct iio_device *dev, bool enable)
+{
+	if (dev->ctx->ops->set_dmabuf)
+		return dev->ctx->ops->set_dmabuf(dev, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_set_cyclic_double_buffer(const struct iio_device *dev,
+		bool enable)
+{
+	if (dev->ctx->ops->set_cyclic_double_buffer)
+		return dev->ctx->ops->set_cyclic_double_buffer(dev, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_set_transfers(const struct iio_device *dev,
+		unsigned int nb_transfers, size_t transfer_size)
+{
+	if (dev->ctx->ops->set_transfers)
+		return dev->ctx->ops->set_transfers(dev,
+				nb_transfers, transfer_size);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_seek(const struct iio_device *dev, uint64_t timestamp)
+{
+	if (dev->ctx->ops->seek)
+		return dev->ctx->ops->seek(dev, timestamp);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_set_playback_loop(const struct iio_device *dev, bool loop)
+{
+	if (dev->ctx->ops->set_playback_loop)
+		return dev->ctx->ops->set_playback_loop(dev, loop);
+	else
+		return -ENOSYS;
+}
+
 int iio_device_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_buffers)
 {
@@ -388,6 +502,41 @@ int iio_device_set_kernel_buffers_count(const struct iio_device *dev,
 		return -ENOSYS;
 }
 
+int iio_device_set_kernel_buffers_auto(const struct iio_device *dev,
+		bool enable)
+{
+	if (dev->ctx->ops->set_kernel_buffers_auto)
+		return dev->ctx->ops->set_kernel_buffers_auto(dev, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_get_kernel_buffers_stats(const struct iio_device *dev,
+		struct iio_kernel_buffers_stats *stats)
+{
+	if (dev->ctx->ops->get_kernel_buffers_stats)
+		return dev->ctx->ops->get_kernel_buffers_stats(dev, stats);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_set_low_latency(const struct iio_device *dev, bool enable)
+{
+	if (dev->ctx->ops->set_low_latency)
+		return dev->ctx->ops->set_low_latency(dev, enable);
+	else
+		return -ENOSYS;
+}
+
+int iio_device_get_latency_stats(const struct iio_device *dev,
+		struct iio_latency_stats *stats)
+{
+	if (dev->ctx->ops->get_latency_stats)
+		return dev->ctx->ops->get_latency_stats(dev, stats);
+	else
+		return -ENOSYS;
+}
+
 int iio_device_get_trigger(const struct iio_device *dev,
 		const struct iio_device **trigger)
 {
@@ -418,6 +567,7 @@ static void free_iio_dev_attrs(struct iio_dev_attrs *attrs)
 		free(attrs->names[i]);
 
 	free(attrs->names);
+	iio_index_free(&attrs->index);
 }
 
 void free_device(struct iio_device *dev)
@@ -431,6 +581,8 @@ void free_device(struct iio_device *dev)
 	for (i = 0; i < dev->nb_channels; i++)
 		free_channel(dev->channels[i]);
 	free(dev->channels);
+	for (i = 0; i < ARRAY_SIZE(dev->channels_index); i++)
+		iio_index_free(&dev->channels_index[i]);
 	free(dev->mask);
 	free(dev->label);
 	free(dev->name);
@@ -635,21 +787,13 @@ int iio_device_buffer_attr_write_bool(const struct iio_device *dev,
 ssize_t iio_device_debug_attr_read(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len)
 {
-	if (dev->ctx->ops->read_device_attr)
-		return dev->ctx->ops->read_device_attr(dev,
-				attr, dst, len, IIO_ATTR_TYPE_DEBUG);
-	else
-		return -ENOSYS;
+	return device_attr_read(dev, attr, dst, len, IIO_ATTR_TYPE_DEBUG);
 }
 
 ssize_t iio_device_debug_attr_write_raw(const struct iio_device *dev,
 		const char *attr, const void *src, size_t len)
 {
-	if (dev->ctx->ops->write_device_attr)
-		return dev->ctx->ops->write_device_attr(dev,
-				attr, src, len, IIO_ATTR_TYPE_DEBUG);
-	else
-		return -ENOSYS;
+	return device_attr_write(dev, attr, src, len, IIO_ATTR_TYPE_DEBUG);
 }
 
 ssize_t iio_device_debug_attr_write(const struct iio_device *dev,
@@ -660,12 +804,16 @@ ssize_t iio_device_debug_attr_write(const struct iio_device *dev,
 
 unsigned int iio_device_get_debug_attrs_count(const struct iio_device *dev)
 {
+	iio_device_load_debug_attrs(dev);
+
 	return dev->debug_attrs.num;
 }
 
 const char * iio_device_get_debug_attr(const struct iio_device *dev,
 		unsigned int index)
 {
+	iio_device_load_debug_attrs(dev);
+
 	return iio_device_get_dev_attr(&dev->debug_attrs, index);
 }
 
@@ -774,6 +922,8 @@ int iio_device_identify_filename(const struct iio_device *dev,
 		}
 	}
 
+	iio_device_load_debug_attrs(dev);
+
 	for (i = 0; i < dev->debug_attrs.num; i++) {
 		if (!strcmp(dev->debug_attrs.names[i], filename)) {
 			*attr = dev->debug_attrs.names[i];
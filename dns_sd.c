@@ -298,3 +298,300 @@ void dnssd_free_all_discovery_data(struct dns_sd_discovery_data *d)
 	while (d)
 		dnssd_remove_node(&d, 0);
 }
+
+/*
+ * Discovery sessions: a thread browses the network every 'interval_ms', and
+ * keeps a cache of the hosts found. A host is only connected to the first
+ * time it is seen, to validate it and fetch its description; hosts which
+ * could not be validated are cached too, so that they are not retried until
+ * they expire. A host not seen for 'ttl_ms' is dropped from the cache.
+ */
+
+#define DNS_SD_DEFAULT_INTERVAL_MS 5000
+
+struct dns_sd_cache_entry {
+	struct iio_context_info info;
+	char *hostname;
+	char addr_str[DNS_SD_ADDRESS_STR_MAX];
+	uint16_t port;
+	bool valid;
+	uint64_t last_seen;
+	struct dns_sd_cache_entry *next;
+};
+
+struct iio_discovery {
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+	struct iio_thrd *thrd;
+	bool stop, scanned;
+
+	unsigned int interval_ms, ttl_ms;
+
+	void (*cb)(enum iio_discovery_event event,
+		   const struct iio_context_info *info, void *d);
+	void *d;
+
+	struct dns_sd_cache_entry *entries;
+};
+
+static void dnssd_cache_entry_free(struct dns_sd_cache_entry *entry)
+{
+	free(entry->info.description);
+	free(entry->info.uri);
+	free(entry->hostname);
+	free(entry);
+}
+
+/* Must be called with the lock held */
+static struct dns_sd_cache_entry *
+dnssd_cache_find(struct iio_discovery *disc,
+		 const struct dns_sd_discovery_data *ddata)
+{
+	struct dns_sd_cache_entry *entry;
+
+	for (entry = disc->entries; entry; entry = entry->next) {
+		if (entry->port == ddata->port &&
+		    !strcmp(entry->addr_str, ddata->addr_str) &&
+		    !strcmp(entry->hostname, ddata->hostname))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static struct dns_sd_cache_entry *
+dnssd_cache_entry_new(const struct dns_sd_discovery_data *ddata)
+{
+	struct dns_sd_cache_entry *entry;
+	int ret;
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->hostname = iio_strdup(ddata->hostname);
+	if (!entry->hostname) {
+		free(entry);
+		return NULL;
+	}
+
+	iio_strlcpy(entry->addr_str, ddata->addr_str, sizeof(entry->addr_str));
+	entry->port = ddata->port;
+
+	ret = dnssd_fill_context_info(&entry->info, entry->hostname,
+				      entry->addr_str, entry->port);
+	if (ret < 0)
+		IIO_DEBUG("Caching invalid host %s (%s)\n",
+			  entry->hostname, entry->addr_str);
+	else
+		entry->valid = true;
+
+	return entry;
+}
+
+static void dnssd_discovery_refresh(struct iio_discovery *disc)
+{
+	struct dns_sd_discovery_data *ddata = NULL, *ndata;
+	struct dns_sd_cache_entry *entry, **prev;
+	uint64_t now;
+	int ret;
+
+	ret = dnssd_find_hosts(&ddata);
+	now = iio_time_ms();
+
+	/* On errors, keep the cache as it is, as it's unknown which hosts
+	 * are still there */
+	if (ret < 0 && ret != -ENXIO) {
+		IIO_DEBUG("DNS-SD browse failed: %d\n", ret);
+		goto out_free_ddata;
+	}
+
+	for (ndata = ddata; ret >= 0 && ndata && ndata->next;
+	     ndata = ndata->next) {
+		iio_mutex_lock(disc->lock);
+		entry = dnssd_cache_find(disc, ndata);
+		if (entry)
+			entry->last_seen = now;
+		iio_mutex_unlock(disc->lock);
+
+		if (entry)
+			continue;
+
+		/* Connecting to the host is slow, don't hold the lock */
+		entry = dnssd_cache_entry_new(ndata);
+		if (!entry)
+			continue;
+
+		entry->last_seen = now;
+
+		iio_mutex_lock(disc->lock);
+		entry->next = disc->entries;
+		disc->entries = entry;
+
+		if (entry->valid && disc->cb)
+			disc->cb(IIO_DISCOVERY_ADDED, &entry->info, disc->d);
+		iio_mutex_unlock(disc->lock);
+	}
+
+	iio_mutex_lock(disc->lock);
+
+	for (prev = &disc->entries; *prev; ) {
+		entry = *prev;
+
+		if (now - entry->last_seen < disc->ttl_ms) {
+			prev = &entry->next;
+			continue;
+		}
+
+		*prev = entry->next;
+
+		if (entry->valid && disc->cb)
+			disc->cb(IIO_DISCOVERY_REMOVED, &entry->info, disc->d);
+		dnssd_cache_entry_free(entry);
+	}
+
+	iio_mutex_unlock(disc->lock);
+
+out_free_ddata:
+	dnssd_free_all_discovery_data(ddata);
+
+	iio_mutex_lock(disc->lock);
+	disc->scanned = true;
+	iio_cond_broadcast(disc->cond);
+	iio_mutex_unlock(disc->lock);
+}
+
+static int dnssd_discovery_thd(void *d)
+{
+	struct iio_discovery *disc = d;
+
+	iio_mutex_lock(disc->lock);
+
+	while (!disc->stop) {
+		iio_mutex_unlock(disc->lock);
+		dnssd_discovery_refresh(disc);
+		iio_mutex_lock(disc->lock);
+
+		if (!disc->stop)
+			iio_cond_wait(disc->cond, disc->lock, disc->interval_ms);
+	}
+
+	iio_mutex_unlock(disc->lock);
+
+	return 0;
+}
+
+struct iio_discovery * dnssd_create_discovery(unsigned int interval_ms,
+		unsigned int ttl_ms,
+		void (*cb)(enum iio_discovery_event event,
+			   const struct iio_context_info *info, void *d),
+		void *d)
+{
+	struct iio_discovery *disc;
+	int err;
+
+	disc = zalloc(sizeof(*disc));
+	if (!disc) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	disc->interval_ms = interval_ms ? interval_ms : DNS_SD_DEFAULT_INTERVAL_MS;
+	disc->ttl_ms = ttl_ms ? ttl_ms : 3 * disc->interval_ms;
+	disc->cb = cb;
+	disc->d = d;
+
+	disc->lock = iio_mutex_create();
+	if (!disc->lock) {
+		err = -ENOMEM;
+		goto err_free_disc;
+	}
+
+	disc->cond = iio_cond_create();
+	if (!disc->cond) {
+		err = -ENOMEM;
+		goto err_free_lock;
+	}
+
+	disc->thrd = iio_thrd_create(dnssd_discovery_thd, disc);
+	if (!disc->thrd) {
+		err = -errno;
+		goto err_free_cond;
+	}
+
+	return disc;
+
+err_free_cond:
+	iio_cond_destroy(disc->cond);
+err_free_lock:
+	iio_mutex_destroy(disc->lock);
+err_free_disc:
+	free(disc);
+	errno = -err;
+	return NULL;
+}
+
+void dnssd_discovery_destroy(struct iio_discovery *disc)
+{
+	struct dns_sd_cache_entry *entry, *next;
+
+	iio_mutex_lock(disc->lock);
+	disc->stop = true;
+	iio_cond_broadcast(disc->cond);
+	iio_mutex_unlock(disc->lock);
+
+	iio_thrd_join_and_destroy(disc->thrd);
+
+	for (entry = disc->entries; entry; entry = next) {
+		next = entry->next;
+		dnssd_cache_entry_free(entry);
+	}
+
+	iio_cond_destroy(disc->cond);
+	iio_mutex_destroy(disc->lock);
+	free(disc);
+}
+
+ssize_t dnssd_discovery_get_info_list(struct iio_discovery *disc,
+		struct iio_context_info ***info)
+{
+	struct iio_scan_result scan_result = { 0, NULL };
+	struct dns_sd_cache_entry *entry;
+	struct iio_context_info *new;
+	ssize_t ret = 0;
+
+	iio_mutex_lock(disc->lock);
+
+	/* Wait for the first browse to complete */
+	while (!disc->scanned)
+		iio_cond_wait(disc->cond, disc->lock, 0);
+
+	for (entry = disc->entries; entry; entry = entry->next) {
+		if (!entry->valid)
+			continue;
+
+		new = iio_scan_result_add(&scan_result);
+		if (!new) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		new->uri = iio_strdup(entry->info.uri);
+		new->description = iio_strdup(entry->info.description);
+		if (!new->uri || !new->description) {
+			ret = -ENOMEM;
+			break;
+		}
+	}
+
+	iio_mutex_unlock(disc->lock);
+
+	if (ret < 0) {
+		iio_context_info_list_free(scan_result.info);
+		return ret;
+	}
+
+	*info = scan_result.info;
+
+	return (ssize_t) scan_result.size;
+}
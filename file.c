@@ -0,0 +1,557 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "debug.h"
+#include "iio-capture.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Playback of the capture files written with iio_buffer_create_capture(),
+ * see iio-capture.h for the format. The file is mapped in memory, and the
+ * recorded device is exposed as a high-speed device, whose refills point to
+ * the blocks of the mapping: they never block and never copy, so that the
+ * consumers can be benchmarked at memory speed.
+ */
+
+struct file_block {
+	uint8_t *data;
+	size_t len;
+	uint64_t timestamp;
+};
+
+struct iio_context_pdata {
+	char *path;
+	uint8_t *map;
+	size_t map_len;
+
+	struct iio_capture_hdr hdr;
+	uint32_t *mask;
+	const struct iio_device *dev;
+
+	struct file_block *blocks;
+	size_t nb_blocks;
+
+	/* Playback position */
+	size_t block, offset;
+	uint64_t timestamp;
+	bool opened, cancelled, loop;
+};
+
+static const struct iio_backend_ops file_ops;
+
+static int file_map(struct iio_context_pdata *pdata, const char *path)
+{
+#ifdef _WIN32
+	long len;
+	FILE *f;
+	int err;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return -errno;
+
+	if (fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		err = -errno;
+		goto out_close_file;
+	}
+
+	pdata->map_len = (size_t) len;
+	pdata->map = malloc(pdata->map_len ? pdata->map_len : 1);
+	if (!pdata->map) {
+		err = -ENOMEM;
+		goto out_close_file;
+	}
+
+	err = 0;
+	if (fread(pdata->map, 1, pdata->map_len, f) != pdata->map_len) {
+		free(pdata->map);
+		pdata->map = NULL;
+		err = -EIO;
+	}
+
+out_close_file:
+	fclose(f);
+	return err;
+#else
+	struct stat st;
+	void *map;
+	int fd, err = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		goto out_close_fd;
+	}
+
+	if (!st.st_size) {
+		err = -EINVAL;
+		goto out_close_fd;
+	}
+
+	/* Private and writable, so that the application can process the
+	 * samples in place without modifying the file */
+	map = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		err = -errno;
+		goto out_close_fd;
+	}
+
+	posix_madvise(map, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	pdata->map = map;
+	pdata->map_len = (size_t) st.st_size;
+
+out_close_fd:
+	close(fd);
+	return err;
+#endif
+}
+
+static void file_unmap(struct iio_context_pdata *pdata)
+{
+	if (!pdata->map)
+		return;
+#ifdef _WIN32
+	free(pdata->map);
+#else
+	munmap(pdata->map, pdata->map_len);
+#endif
+	pdata->map = NULL;
+}
+
+static int file_add_block(struct iio_context_pdata *pdata, uint64_t offset,
+		uint64_t end, size_t *nb_alloc)
+{
+	struct iio_capture_block_hdr hdr;
+	struct file_block *blocks;
+	size_t nb;
+
+	if (offset > end || end - offset < IIO_CAPTURE_BLOCK_HDR_SIZE)
+		return -EINVAL;
+
+	iio_capture_block_unpack(&hdr, pdata->map + offset);
+	offset += IIO_CAPTURE_BLOCK_HDR_SIZE;
+
+	if (hdr.magic != IIO_CAPTURE_BLOCK_MAGIC || hdr.len > end - offset)
+		return -EINVAL;
+
+	if (pdata->nb_blocks == *nb_alloc) {
+		nb = *nb_alloc ? *nb_alloc * 2 : 64;
+
+		blocks = realloc(pdata->blocks, nb * sizeof(*blocks));
+		if (!blocks)
+			return -ENOMEM;
+
+		pdata->blocks = blocks;
+		*nb_alloc = nb;
+	}
+
+	pdata->blocks[pdata->nb_blocks].data = pdata->map + offset;
+	pdata->blocks[pdata->nb_blocks].len = (size_t) hdr.len;
+	pdata->blocks[pdata->nb_blocks].timestamp = hdr.timestamp;
+	pdata->nb_blocks++;
+
+	return 0;
+}
+
+static int file_load_blocks(struct iio_context_pdata *pdata)
+{
+	const struct iio_capture_hdr *hdr = &pdata->hdr;
+	struct iio_capture_index_entry entry;
+	struct iio_capture_block_hdr bhdr;
+	size_t i, nb_alloc = 0;
+	uint64_t offset;
+	int ret;
+
+	if (hdr->index_offset) {
+		if (hdr->index_offset > pdata->map_len ||
+		    hdr->nb_blocks > (pdata->map_len - hdr->index_offset) /
+				     IIO_CAPTURE_INDEX_ENTRY_SIZE)
+			return -EINVAL;
+
+		for (i = 0; i < hdr->nb_blocks; i++) {
+			iio_capture_index_unpack(&entry, pdata->map +
+					hdr->index_offset +
+					i * IIO_CAPTURE_INDEX_ENTRY_SIZE);
+
+			ret = file_add_block(pdata, entry.offset,
+					     hdr->index_offset, &nb_alloc);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	/* The capture was not closed: walk the blocks, up to the first one
+	 * which was not completely written */
+	IIO_WARNING("Capture file %s is incomplete\n", pdata->path);
+
+	for (offset = hdr->data_offset; offset < pdata->map_len; ) {
+		ret = file_add_block(pdata, offset, pdata->map_len, &nb_alloc);
+		if (ret == -ENOMEM)
+			return ret;
+		if (ret)
+			break;
+
+		iio_capture_block_unpack(&bhdr, pdata->map + offset);
+		offset = iio_capture_align(offset + IIO_CAPTURE_BLOCK_HDR_SIZE
+					   + bhdr.len, IIO_CAPTURE_BLOCK_ALIGN);
+	}
+
+	return 0;
+}
+
+static int file_parse_header(struct iio_context_pdata *pdata)
+{
+	struct iio_capture_hdr *hdr = &pdata->hdr;
+	uint64_t xml_offset;
+	unsigned int i;
+
+	if (pdata->map_len < IIO_CAPTURE_HDR_SIZE)
+		return -EINVAL;
+
+	iio_capture_unpack(hdr, pdata->map);
+
+	if (hdr->magic != IIO_CAPTURE_MAGIC) {
+		IIO_ERROR("%s is not a capture file\n", pdata->path);
+		return -EINVAL;
+	}
+
+	if (hdr->version != IIO_CAPTURE_VERSION) {
+		IIO_ERROR("Unsupported version %u of capture file\n",
+			  hdr->version);
+		return -EINVAL;
+	}
+
+	xml_offset = IIO_CAPTURE_HDR_SIZE + hdr->nb_words * sizeof(uint32_t);
+
+	if (!hdr->sample_size || !hdr->nb_words || !hdr->xml_len ||
+	    xml_offset + hdr->xml_len > hdr->data_offset ||
+	    hdr->data_offset > pdata->map_len ||
+	    pdata->map[xml_offset + hdr->xml_len - 1] != '\0')
+		return -EINVAL;
+
+	pdata->mask = calloc(hdr->nb_words, sizeof(*pdata->mask));
+	if (!pdata->mask)
+		return -ENOMEM;
+
+	for (i = 0; i < hdr->nb_words; i++)
+		pdata->mask[i] = iiod_bin_get_le32(pdata->map +
+				IIO_CAPTURE_HDR_SIZE + i * sizeof(uint32_t));
+
+	return file_load_blocks(pdata);
+}
+
+static void file_free_pdata(struct iio_context_pdata *pdata)
+{
+	file_unmap(pdata);
+	free(pdata->blocks);
+	free(pdata->mask);
+	free(pdata->path);
+}
+
+static void file_shutdown(struct iio_context *ctx)
+{
+	file_free_pdata(iio_context_get_pdata(ctx));
+}
+
+static struct iio_context_pdata * file_get_pdata(const struct iio_device *dev)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return pdata->dev == dev ? pdata : NULL;
+}
+
+static int file_open(const struct iio_device *dev,
+		size_t samples_count, bool cyclic)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+
+	/* Only the device whose samples were recorded can stream */
+	if (!pdata)
+		return -ENODEV;
+	if (cyclic)
+		return -EINVAL;
+	if (pdata->opened)
+		return -EBUSY;
+
+	pdata->opened = true;
+	pdata->cancelled = false;
+	return 0;
+}
+
+static int file_close(const struct iio_device *dev)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+
+	if (!pdata || !pdata->opened)
+		return -EBADF;
+
+	pdata->opened = false;
+	return 0;
+}
+
+/* Returns the number of bytes available at the playback position, up to
+ * 'len', and moves past them */
+static ssize_t file_next(struct iio_context_pdata *pdata, size_t len,
+		uint8_t **ptr, uint32_t *mask, size_t words)
+{
+	const struct file_block *block;
+	bool wrapped = false;
+	size_t nb;
+
+	if (!pdata->opened || pdata->cancelled)
+		return -EBADF;
+
+	/* Hand out whole samples only */
+	len -= len % pdata->hdr.sample_size;
+	if (!len || words != pdata->hdr.nb_words)
+		return -EINVAL;
+
+	for (;;) {
+		if (pdata->block == pdata->nb_blocks) {
+			if (!pdata->loop || wrapped)
+				return -ENODATA;
+
+			pdata->block = 0;
+			pdata->offset = 0;
+			wrapped = true;
+		}
+
+		if (pdata->offset < pdata->blocks[pdata->block].len)
+			break;
+
+		pdata->block++;
+		pdata->offset = 0;
+	}
+
+	block = &pdata->blocks[pdata->block];
+	nb = block->len - pdata->offset;
+	if (nb > len)
+		nb = len;
+
+	*ptr = block->data + pdata->offset;
+	pdata->offset += nb;
+	pdata->timestamp = block->timestamp;
+
+	/* The samples are laid out as when they were recorded */
+	memcpy(mask, pdata->mask, words * sizeof(*mask));
+
+	return (ssize_t) nb;
+}
+
+static ssize_t file_read(const struct iio_device *dev, void *dst, size_t len,
+		uint32_t *mask, size_t words)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+	uint8_t *src;
+	ssize_t ret;
+
+	if (!pdata)
+		return -ENODEV;
+
+	ret = file_next(pdata, len, &src, mask, words);
+	if (ret > 0)
+		memcpy(dst, src, (size_t) ret);
+
+	return ret;
+}
+
+static ssize_t file_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used,
+		uint32_t *mask, size_t words)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+	uint8_t *ptr;
+	ssize_t ret;
+
+	if (!pdata)
+		return -ENOSYS;
+	if (!addr_ptr)
+		return -EINVAL;
+
+	ret = file_next(pdata, bytes_used, &ptr, mask, words);
+	if (ret >= 0)
+		*addr_ptr = ptr;
+
+	return ret;
+}
+
+static void file_cancel(const struct iio_device *dev)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+
+	if (pdata)
+		pdata->cancelled = true;
+}
+
+static int file_get_timestamp(const struct iio_device *dev,
+		uint64_t *timestamp)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+
+	if (!pdata)
+		return -ENODEV;
+
+	*timestamp = pdata->timestamp;
+	return 0;
+}
+
+static int file_seek(const struct iio_device *dev, uint64_t timestamp)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+	size_t lo = 0, hi, mid;
+
+	if (!pdata)
+		return -ENODEV;
+
+	/* First block recorded at or after the timestamp */
+	for (hi = pdata->nb_blocks; lo < hi; ) {
+		mid = lo + (hi - lo) / 2;
+
+		if (pdata->blocks[mid].timestamp < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	pdata->block = lo;
+	pdata->offset = 0;
+	return 0;
+}
+
+static int file_set_playback_loop(const struct iio_device *dev, bool loop)
+{
+	struct iio_context_pdata *pdata = file_get_pdata(dev);
+
+	if (!pdata)
+		return -ENODEV;
+
+	pdata->loop = loop;
+	return 0;
+}
+
+static struct iio_context * file_clone(const struct iio_context *ctx)
+{
+	return file_create_context(iio_context_get_pdata(ctx)->path);
+}
+
+static const struct iio_backend_ops file_ops = {
+	.clone = file_clone,
+	.read = file_read,
+	.try_read = file_read,
+	.open = file_open,
+	.close = file_close,
+	.get_buffer = file_get_buffer,
+	.try_get_buffer = file_get_buffer,
+	.cancel = file_cancel,
+	.get_timestamp = file_get_timestamp,
+	.seek = file_seek,
+	.set_playback_loop = file_set_playback_loop,
+	.shutdown = file_shutdown,
+};
+
+struct iio_context * file_create_context(const char *path)
+{
+	struct iio_context_pdata *pdata;
+	struct iio_context *ctx;
+	const char *xml;
+	size_t uri_len;
+	char *uri;
+	int ret;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	pdata->path = iio_strdup(path);
+	if (!pdata->path) {
+		ret = -ENOMEM;
+		goto err_free_pdata;
+	}
+
+	ret = file_map(pdata, path);
+	if (ret)
+		goto err_free_pdata;
+
+	ret = file_parse_header(pdata);
+	if (ret)
+		goto err_free_pdata;
+
+	xml = (const char *) pdata->map + IIO_CAPTURE_HDR_SIZE +
+		pdata->hdr.nb_words * sizeof(uint32_t);
+
+	ctx = xml_create_context_mem(xml, pdata->hdr.xml_len - 1);
+	if (!ctx) {
+		ret = -errno;
+		goto err_free_pdata;
+	}
+
+	/* Override the name and low-level functions of the XML context
+	 * with those corresponding to the file context */
+	ctx->name = "file";
+	ctx->ops = &file_ops;
+	ctx->pdata = pdata;
+
+	if (pdata->hdr.dev >= ctx->nb_devices ||
+	    ctx->devices[pdata->hdr.dev]->words != pdata->hdr.nb_words) {
+		IIO_ERROR("Recorded device not found in capture file\n");
+		ret = -EINVAL;
+		goto err_context_destroy;
+	}
+
+	pdata->dev = ctx->devices[pdata->hdr.dev];
+
+	ret = iio_context_add_attr(ctx, "file,path", path);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	uri_len = strlen(path) + sizeof("file:");
+	uri = malloc(uri_len);
+	if (!uri) {
+		ret = -ENOMEM;
+		goto err_context_destroy;
+	}
+
+	iio_snprintf(uri, uri_len, "file:%s", path);
+	ret = iio_context_add_attr(ctx, "uri", uri);
+	free(uri);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	return ctx;
+
+err_context_destroy:
+	iio_context_destroy(ctx);
+	errno = -ret;
+	return NULL;
+
+err_free_pdata:
+	file_free_pdata(pdata);
+	free(pdata);
+	errno = -ret;
+	return NULL;
+}
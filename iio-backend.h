@@ -32,16 +32,66 @@ struct iio_backend_ops {
 	int (*open)(const struct iio_device *dev,
 			size_t samples_count, bool cyclic);
 	int (*close)(const struct iio_device *dev);
+	int (*reconfigure)(const struct iio_device *dev, size_t samples_count);
 	int (*get_fd)(const struct iio_device *dev);
 	int (*set_blocking_mode)(const struct iio_device *dev, bool blocking);
+	int (*set_busy_poll)(const struct iio_device *dev,
+			unsigned int busy_poll_us, int cpu);
+	int (*set_read_ahead)(const struct iio_device *dev,
+			unsigned int nb_requests);
+	int (*set_compression)(const struct iio_device *dev, bool enable);
+	int (*publish)(const struct iio_device *dev,
+			const char *addr, unsigned int ttl);
+	int (*subscribe)(const struct iio_device *dev, const char *addr);
+	int (*set_decimation)(const struct iio_device *dev,
+			unsigned int factor);
+	int (*set_capture_window)(const struct iio_device *dev,
+			const struct iio_channel *chn, enum iio_window_edge edge,
+			long long level, unsigned int pre, unsigned int post);
+	int (*get_multicast_losses)(const struct iio_device *dev,
+			uint64_t *nb_lost);
 
 	void (*cancel)(const struct iio_device *dev);
 
 	int (*set_kernel_buffers_count)(const struct iio_device *dev,
 			unsigned int nb_blocks);
+	int (*set_kernel_buffers_auto)(const struct iio_device *dev,
+			bool enable);
+	int (*get_kernel_buffers_stats)(const struct iio_device *dev,
+			struct iio_kernel_buffers_stats *stats);
+	int (*set_low_latency)(const struct iio_device *dev, bool enable);
+	int (*get_latency_stats)(const struct iio_device *dev,
+			struct iio_latency_stats *stats);
 	ssize_t (*get_buffer)(const struct iio_device *dev,
 			void **addr_ptr, size_t bytes_used,
 			uint32_t *mask, size_t words);
+	ssize_t (*dequeue_block)(const struct iio_device *dev,
+			unsigned int *id, void **addr_ptr, uint64_t *timestamp);
+	int (*enqueue_block)(const struct iio_device *dev,
+			unsigned int id, size_t bytes_used);
+	int (*get_dmabuf_fd)(const struct iio_device *dev, unsigned int id);
+	int (*set_dmabuf)(const struct iio_device *dev, bool enable);
+	int (*set_cyclic_double_buffer)(const struct iio_device *dev,
+			bool enable);
+	int (*set_transfers)(const struct iio_device *dev,
+			unsigned int nb_transfers, size_t transfer_size);
+	int (*seek)(const struct iio_device *dev, uint64_t timestamp);
+	int (*set_playback_loop)(const struct iio_device *dev, bool loop);
+
+	/* Non-blocking variants of read/write/get_buffer, used by the
+	 * asynchronous buffer API. They must return -EAGAIN instead of
+	 * waiting, whatever the blocking mode of the device. */
+	ssize_t (*try_read)(const struct iio_device *dev, void *dst, size_t len,
+			uint32_t *mask, size_t words);
+	ssize_t (*try_write)(const struct iio_device *dev,
+			const void *src, size_t len);
+	ssize_t (*try_get_buffer)(const struct iio_device *dev,
+			void **addr_ptr, size_t bytes_used,
+			uint32_t *mask, size_t words);
+	/* Optional; called when an asynchronous refill of 'len' bytes is
+	 * submitted, for the backends that must request the samples before
+	 * the poll file descriptor can become readable */
+	int (*request_read)(const struct iio_device *dev, size_t len);
 
 	ssize_t (*read_device_attr)(const struct iio_device *dev,
 			const char *attr, char *dst, size_t len, enum iio_attr_type);
@@ -53,6 +103,9 @@ struct iio_backend_ops {
 	ssize_t (*write_channel_attr)(const struct iio_channel *chn,
 			const char *attr, const char *src, size_t len);
 
+	int (*get_timestamp)(const struct iio_device *dev,
+			uint64_t *timestamp);
+
 	int (*get_trigger)(const struct iio_device *dev,
 			const struct iio_device **trigger);
 	int (*set_trigger)(const struct iio_device *dev,
@@ -60,6 +113,19 @@ struct iio_backend_ops {
 
 	void (*shutdown)(struct iio_context *ctx);
 
+	int (*close_attr_fds)(const struct iio_context *ctx);
+
+	/* Return -ENOSYS to have the accesses performed one by one */
+	int (*commit_attr_batch)(struct iio_attr_batch *batch,
+			bool stop_on_error);
+	int (*set_attr_cache)(struct iio_context *ctx,
+			const char *attr, int ttl_ms);
+
+	const char * (*get_xml)(const struct iio_context *ctx);
+	int (*set_io_uring)(struct iio_context *ctx, bool enable);
+	int (*enable_multiplexing)(struct iio_context *ctx);
+	int (*load_debug_attrs)(const struct iio_device *dev);
+
 	char * (*get_description)(const struct iio_context *ctx);
 
 	int (*get_version)(const struct iio_context *ctx, unsigned int *major,
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#ifndef _IIO_CAPTURE_H
+#define _IIO_CAPTURE_H
+
+#include "iiod-binary.h"
+
+#include <string.h>
+
+/*
+ * Capture files, written with iio_buffer_create_capture() and played back by
+ * the "file:" backend. All the fields are encoded in little-endian.
+ *
+ * The file starts with a header of IIO_CAPTURE_HDR_SIZE bytes, followed by
+ * the channel mask of the recorded device as 'nb_words' 32-bit words, then
+ * the XML string of the context, 'xml_len' bytes long, including the final
+ * \0. The channel formats are those of the XML string.
+ *
+ * The blocks of samples start at 'data_offset', which is aligned to
+ * IIO_CAPTURE_DATA_ALIGN, so that they can be used straight from a mapping
+ * of the file. Each block is made of a header of IIO_CAPTURE_BLOCK_HDR_SIZE
+ * bytes followed by 'len' bytes of samples, laid out as in the buffer of the
+ * recorded device; the next block starts at the next multiple of
+ * IIO_CAPTURE_BLOCK_ALIGN.
+ *
+ * The index, written when the capture is closed, sits at 'index_offset' and
+ * holds one entry per block, with the offset of the block and its timestamp.
+ * A capture which was not closed has 'index_offset' set to zero; its blocks
+ * can still be found by walking their headers.
+ */
+
+#define IIO_CAPTURE_MAGIC	0x50414349 /* "ICAP" */
+#define IIO_CAPTURE_VERSION	1
+#define IIO_CAPTURE_HDR_SIZE	64
+#define IIO_CAPTURE_DATA_ALIGN	4096
+
+#define IIO_CAPTURE_BLOCK_MAGIC	0x4b4c4249 /* "IBLK" */
+#define IIO_CAPTURE_BLOCK_HDR_SIZE 64
+#define IIO_CAPTURE_BLOCK_ALIGN	64
+
+#define IIO_CAPTURE_INDEX_ENTRY_SIZE 16
+
+struct iio_capture_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t nb_words;
+	uint32_t dev;
+	uint32_t sample_size;
+	uint32_t xml_len;
+	uint64_t data_offset;
+	uint64_t index_offset;
+	uint64_t nb_blocks;
+};
+
+struct iio_capture_block_hdr {
+	uint32_t magic;
+	uint64_t len;
+	uint64_t timestamp;
+};
+
+struct iio_capture_index_entry {
+	uint64_t offset;
+	uint64_t timestamp;
+};
+
+static inline void iio_capture_put_le64(uint8_t *buf, uint64_t val)
+{
+	iiod_bin_put_le32(buf, (uint32_t) val);
+	iiod_bin_put_le32(buf + 4, (uint32_t) (val >> 32));
+}
+
+static inline uint64_t iio_capture_get_le64(const uint8_t *buf)
+{
+	return (uint64_t) iiod_bin_get_le32(buf) |
+		((uint64_t) iiod_bin_get_le32(buf + 4) << 32);
+}
+
+static inline uint64_t iio_capture_align(uint64_t offset, uint64_t align)
+{
+	return (offset + align - 1) & ~(align - 1);
+}
+
+static inline void iio_capture_pack(uint8_t *buf,
+				    const struct iio_capture_hdr *hdr)
+{
+	memset(buf, 0, IIO_CAPTURE_HDR_SIZE);
+	iiod_bin_put_le32(buf, hdr->magic);
+	iiod_bin_put_le16(buf + 4, hdr->version);
+	iiod_bin_put_le16(buf + 6, hdr->nb_words);
+	iiod_bin_put_le32(buf + 8, hdr->dev);
+	iiod_bin_put_le32(buf + 12, hdr->sample_size);
+	iiod_bin_put_le32(buf + 16, hdr->xml_len);
+	iio_capture_put_le64(buf + 24, hdr->data_offset);
+	iio_capture_put_le64(buf + 32, hdr->index_offset);
+	iio_capture_put_le64(buf + 40, hdr->nb_blocks);
+}
+
+static inline void iio_capture_unpack(struct iio_capture_hdr *hdr,
+				      const uint8_t *buf)
+{
+	hdr->magic = iiod_bin_get_le32(buf);
+	hdr->version = iiod_bin_get_le16(buf + 4);
+	hdr->nb_words = iiod_bin_get_le16(buf + 6);
+	hdr->dev = iiod_bin_get_le32(buf + 8);
+	hdr->sample_size = iiod_bin_get_le32(buf + 12);
+	hdr->xml_len = iiod_bin_get_le32(buf + 16);
+	hdr->data_offset = iio_capture_get_le64(buf + 24);
+	hdr->index_offset = iio_capture_get_le64(buf + 32);
+	hdr->nb_blocks = iio_capture_get_le64(buf + 40);
+}
+
+static inline void iio_capture_block_pack(uint8_t *buf,
+		const struct iio_capture_block_hdr *hdr)
+{
+	memset(buf, 0, IIO_CAPTURE_BLOCK_HDR_SIZE);
+	iiod_bin_put_le32(buf, hdr->magic);
+	iio_capture_put_le64(buf + 8, hdr->len);
+	iio_capture_put_le64(buf + 16, hdr->timestamp);
+}
+
+static inline void iio_capture_block_unpack(struct iio_capture_block_hdr *hdr,
+					    const uint8_t *buf)
+{
+	hdr->magic = iiod_bin_get_le32(buf);
+	hdr->len = iio_capture_get_le64(buf + 8);
+	hdr->timestamp = iio_capture_get_le64(buf + 16);
+}
+
+static inline void iio_capture_index_pack(uint8_t *buf,
+		const struct iio_capture_index_entry *entry)
+{
+	iio_capture_put_le64(buf, entry->offset);
+	iio_capture_put_le64(buf + 8, entry->timestamp);
+}
+
+static inline void iio_capture_index_unpack(
+		struct iio_capture_index_entry *entry, const uint8_t *buf)
+{
+	entry->offset = iio_capture_get_le64(buf);
+	entry->timestamp = iio_capture_get_le64(buf + 8);
+}
+
+#endif /* _IIO_CAPTURE_H */
@@ -17,4 +17,25 @@ void iio_mutex_destroy(struct iio_mutex *lock);
 void iio_mutex_lock(struct iio_mutex *lock);
 void iio_mutex_unlock(struct iio_mutex *lock);
 
+struct iio_cond;
+
+struct iio_cond * iio_cond_create(void);
+void iio_cond_destroy(struct iio_cond *cond);
+
+/* Returns 0 if signaled, -ETIMEDOUT on timeout. A timeout of 0 means
+ * waiting forever. The mutex must be locked by the caller. */
+int iio_cond_wait(struct iio_cond *cond, struct iio_mutex *lock,
+		unsigned int timeout_ms);
+void iio_cond_signal(struct iio_cond *cond);
+void iio_cond_broadcast(struct iio_cond *cond);
+
+struct iio_thrd;
+
+struct iio_thrd * iio_thrd_create(int (*thrd)(void *), void *d);
+int iio_thrd_join_and_destroy(struct iio_thrd *thrd);
+
+/* The resources of a detached thread are released once it returns.
+ * Returns 0 on success, or a negative error code. */
+int iio_thrd_create_detached(int (*thrd)(void *), void *d);
+
 #endif /* _IIO_LOCK_H */
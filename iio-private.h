@@ -125,6 +125,17 @@ struct iio_context_pdata;
 struct iio_device_pdata;
 struct iio_channel_pdata;
 
+struct iio_index_entry {
+	const char *name;
+	unsigned int pos;
+};
+
+/* Names of a list of objects, sorted for binary searches (see sort.c) */
+struct iio_index {
+	struct iio_index_entry *entries;
+	unsigned int nb;
+};
+
 struct iio_channel_attr {
 	char *name;
 	char *filename;
@@ -142,14 +153,34 @@ struct iio_context {
 
 	struct iio_device **devices;
 	unsigned int nb_devices;
+	struct iio_index devices_index;
 
 	char *xml;
 
 	char **attrs;
 	char **values;
 	unsigned int nb_attrs;
+
+	/* Allocator used for the memory of the buffers; malloc() if NULL */
+	void * (*buffer_alloc)(size_t size, void *d);
+	void (*buffer_free)(void *ptr, size_t size, void *d);
+	void *buffer_alloc_data;
+
+#if WITH_PERF_COUNTERS
+	struct iio_op_stats stats[IIO_STATS_NB_OPS];
+#endif
+};
+
+struct iio_convert_params {
+	unsigned int shift;
+	uint64_t mask, sign, inverse_mask;
+	bool is_signed;
+	double scale, offset;
 };
 
+typedef void (*iio_convert_fn)(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb);
+
 struct iio_channel {
 	struct iio_device *dev;
 	struct iio_channel_pdata *pdata;
@@ -165,13 +196,23 @@ struct iio_channel {
 
 	struct iio_channel_attr *attrs;
 	unsigned int nb_attrs;
+	struct iio_index attrs_index;
 
 	unsigned int number;
+
+	/* The other half of a I/Q channel pair, if any */
+	struct iio_channel *iq_pair;
+
+	/* Conversion kernels selected by iio_channel_init_convert() */
+	iio_convert_fn convert, convert_inverse;
+	iio_convert_fn convert_float, convert_double;
+	struct iio_convert_params convert_params;
 };
 
 struct iio_dev_attrs {
 	char **names;
 	unsigned int num;
+	struct iio_index index;
 };
 
 struct iio_device {
@@ -188,19 +229,89 @@ struct iio_device {
 	struct iio_channel **channels;
 	unsigned int nb_channels;
 
+	/* Indexed by direction: inputs, then outputs */
+	struct iio_index channels_index[2];
+
 	uint32_t *mask;
 	size_t words;
 };
 
+/* Position of the samples of one channel within a sample frame */
+struct iio_channel_layout {
+	const struct iio_channel *chn;
+	size_t offset;
+};
+
 struct iio_buffer {
 	const struct iio_device *dev;
 	void *buffer, *userdata;
 	size_t length, data_length;
 
+	/* Size of the sample memory, which can be larger than 'length' once
+	 * the buffer was reconfigured */
+	size_t mem_length;
+
 	uint32_t *mask;
 	unsigned int dev_sample_size;
 	unsigned int sample_size;
 	bool dev_is_high_speed;
+
+	/* How to free the sample memory; not freed if it was supplied by the
+	 * application, or if it belongs to the backend (high-speed mode) */
+	bool owns_memory;
+	void (*buffer_free)(void *ptr, size_t size, void *d);
+	void *buffer_alloc_data;
+
+	/* One entry per channel present in the buffer, updated with the mask */
+	struct iio_channel_layout *layout;
+	unsigned int nb_layout;
+
+	/* Channels visited by iio_buffer_foreach_sample(), computed for the
+	 * buffer's mask and the device mask saved in foreach_dev_mask */
+	struct iio_channel_layout *foreach_layout;
+	unsigned int nb_foreach_layout;
+	uint32_t *foreach_dev_mask;
+	size_t foreach_frame_len;
+	bool foreach_layout_valid;
+
+	/* Blocks handed out by iio_buffer_dequeue_block(), indexed by ID */
+	struct iio_block **blocks;
+	unsigned int nb_blocks;
+
+	/* Pending asynchronous refill or push */
+	void (*async_cb)(struct iio_buffer *buf, ssize_t ret, void *d);
+	void *async_data;
+	size_t async_done;
+	bool async_tx;
+};
+
+struct iio_block {
+	struct iio_buffer *buf;
+	unsigned int id;
+	void *data;
+	size_t bytes_used;
+	uint64_t timestamp;
+	bool dequeued;
+};
+
+struct iio_attr_batch_entry {
+	const struct iio_device *dev;
+	const struct iio_channel *chn;
+	char *attr;
+
+	/* The value to write, or NULL for a read */
+	char *src;
+
+	char *dst;
+	size_t len;
+
+	ssize_t ret;
+};
+
+struct iio_attr_batch {
+	const struct iio_context *ctx;
+	struct iio_attr_batch_entry *entries;
+	unsigned int nb_entries;
 };
 
 struct iio_context_info {
@@ -225,6 +336,7 @@ ssize_t iio_snprintf_device_xml(char *str, ssize_t slen,
 				const struct iio_device *dev);
 
 int iio_context_init(struct iio_context *ctx);
+char * iio_context_create_xml(const struct iio_context *ctx);
 
 bool iio_device_is_tx(const struct iio_device *dev);
 int iio_device_open(const struct iio_device *dev,
@@ -244,24 +356,75 @@ struct iio_context * local_create_context(void);
 struct iio_context * network_create_context(const char *hostname);
 struct iio_context * xml_create_context_mem(const char *xml, size_t len);
 struct iio_context * xml_create_context(const char *xml_file);
+struct iio_context * xml_create_context_zstd(const void *src, size_t len);
 struct iio_context * usb_create_context_from_uri(const char *uri);
 struct iio_context * serial_create_context_from_uri(const char *uri);
+struct iio_context * file_create_context(const char *path);
+struct iio_context * synthetic_create_context(const char *args);
 
 int local_context_scan(struct iio_scan_result *scan_result);
 
 int usb_context_scan(struct iio_scan_result *scan_result);
 
 int dnssd_context_scan(struct iio_scan_result *scan_result);
+struct iio_discovery * dnssd_create_discovery(unsigned int interval_ms,
+		unsigned int ttl_ms,
+		void (*cb)(enum iio_discovery_event event,
+			   const struct iio_context_info *info, void *d),
+		void *d);
+void dnssd_discovery_destroy(struct iio_discovery *disc);
+ssize_t dnssd_discovery_get_info_list(struct iio_discovery *disc,
+		struct iio_context_info ***info);
 
 ssize_t iio_device_get_sample_size_mask(const struct iio_device *dev,
 		const uint32_t *mask, size_t words);
 
 void iio_channel_init_finalize(struct iio_channel *chn);
+void iio_channel_init_convert(struct iio_channel *chn);
+void iio_channel_init_iq_pair(struct iio_channel *chn);
+void iio_channel_convert_strided(const struct iio_channel *chn, void *dst,
+		const void *src, ptrdiff_t step, size_t nb);
+void iio_channel_convert_inverse_strided(const struct iio_channel *chn,
+		void *dst, const void *src, ptrdiff_t step, size_t nb);
+void iio_channel_convert_float_strided(const struct iio_channel *chn,
+		float *dst, const void *src, ptrdiff_t step, size_t nb);
+void iio_channel_convert_double_strided(const struct iio_channel *chn,
+		double *dst, const void *src, ptrdiff_t step, size_t nb);
 unsigned int find_channel_modifier(const char *s, size_t *len_p);
 
 char *iio_strdup(const char *str);
 size_t iio_strlcpy(char * __restrict dst, const char * __restrict src, size_t dsize);
 char * iio_getenv (char * envvar);
+uint64_t iio_time_ms(void);
+uint64_t iio_time_ns(void);
+
+/*
+ * Performance counters, see iio_context_get_stats(). Without
+ * WITH_PERF_COUNTERS, the arguments are not even evaluated:
+ *
+ *	uint64_t start = iio_stats_start();
+ *	ret = ...;
+ *	iio_stats_record(ctx->stats, IIO_STATS_READ, start, ret);
+ *
+ * 'ret' is a byte count on success, and a negative error code otherwise.
+ */
+#if WITH_PERF_COUNTERS
+#define iio_stats_start() iio_time_ns()
+void iio_stats_record(const struct iio_op_stats *stats, enum iio_stats_op op,
+		uint64_t start, ssize_t ret);
+#else
+#define iio_stats_start() 0
+#define iio_stats_record(stats, op, start, ret) ((void) (start))
+#endif
+
+/* USDT tracepoints of the "libiio" provider, at the boundaries of the
+ * refills, pushes and attribute accesses */
+#if WITH_USDT
+#include <sys/sdt.h>
+#define IIO_TRACE(name, obj, val) DTRACE_PROBE2(libiio, name, obj, val)
+#else
+#define IIO_TRACE(name, obj, val) do { } while (0)
+#endif
 
 int iio_context_add_device(struct iio_context *ctx, struct iio_device *dev);
 
@@ -79,10 +79,16 @@ struct iio_context;
 struct iio_device;
 struct iio_channel;
 struct iio_buffer;
+struct iio_block;
+struct iio_stream;
+struct iio_buffer_group;
+struct iio_capture;
+struct iio_attr_batch;
 
 struct iio_context_info;
 struct iio_scan_context;
 struct iio_scan_block;
+struct iio_discovery;
 
 /*
  * <linux/iio/types.h> header guard to protect these enums from being defined
@@ -265,6 +271,31 @@ __api __check_ret ssize_t iio_scan_context_get_info_list(struct iio_scan_context
 		struct iio_context_info ***info);
 
 
+/** @brief Enumerate available contexts, within a time budget
+ * @param ctx A pointer to an iio_scan_context structure
+ * @param timeout_ms The total time budget of the scan, in milliseconds, or 0
+ * to wait for all the backends
+ * @param cb A function called with each context found, as soon as its
+ * backend answered, or NULL
+ * @param d A pointer passed to the callback
+ * @param info A pointer to a 'const struct iio_context_info **' typed variable.
+ * The pointed variable will be initialized on success. Can be NULL, if only
+ * the callback is of interest.
+ * @returns On success, the number of contexts found.
+ * @returns On failure, a negative error number.
+ *
+ * <b>NOTE:</b> The backends are scanned in parallel; the contexts found by a
+ * backend which did not answer before the timeout are not reported. The
+ * callback is never called concurrently, nor after the function returns.
+ * It must not use the scan context. The list has the contexts in the order
+ * of the backends (local, USB, network), whatever the order of the calls to
+ * the callback. */
+__api __check_ret ssize_t iio_scan_context_get_info_list_timeout(
+		struct iio_scan_context *ctx, unsigned int timeout_ms,
+		void (*cb)(const struct iio_context_info *info, void *d),
+		void *d, struct iio_context_info ***info);
+
+
 /** @brief Free a context info list
  * @param info A pointer to a 'const struct iio_context_info *' typed variable
  */
@@ -287,6 +318,58 @@ __api __check_ret __pure const char * iio_context_info_get_uri(
 		const struct iio_context_info *info);
 
 
+/** @brief Events of a discovery session */
+enum iio_discovery_event {
+	/** @brief A context appeared on the network */
+	IIO_DISCOVERY_ADDED,
+	/** @brief A context was not seen for the TTL of the session */
+	IIO_DISCOVERY_REMOVED,
+};
+
+
+/** @brief Start a persistent discovery session of the network contexts
+ * @param interval_ms The period of the DNS-SD browses, in milliseconds, or 0
+ * for the default (5 seconds)
+ * @param ttl_ms How long a context is kept once it is not seen anymore, in
+ * milliseconds, or 0 for three times the period
+ * @param cb A function called with each context added or removed, or NULL
+ * @param d A pointer passed to the callback
+ * @return On success, a pointer to an iio_discovery structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * <b>NOTE:</b> The session keeps browsing the network from a thread of its
+ * own, and caches the contexts found: each host is only connected to once,
+ * when it first appears. The callback is called from that thread; it must
+ * not call the functions of the session. */
+__api __check_ret struct iio_discovery * iio_create_discovery(
+		unsigned int interval_ms, unsigned int ttl_ms,
+		void (*cb)(enum iio_discovery_event event,
+			   const struct iio_context_info *info, void *d),
+		void *d);
+
+
+/** @brief Stop a discovery session
+ * @param disc A pointer to an iio_discovery structure
+ *
+ * <b>NOTE:</b> After that function, the iio_discovery pointer shall be
+ * invalid. */
+__api void iio_discovery_destroy(struct iio_discovery *disc);
+
+
+/** @brief List the contexts cached by a discovery session
+ * @param disc A pointer to an iio_discovery structure
+ * @param info A pointer to a 'const struct iio_context_info **' typed variable.
+ * The pointed variable will be initialized on success, and must be freed with
+ * iio_context_info_list_free().
+ * @returns On success, the number of contexts found.
+ * @returns On failure, a negative error number.
+ *
+ * <b>NOTE:</b> Only the first call after the creation of the session waits
+ * for a browse to complete; the next ones answer from the cache. */
+__api __check_ret ssize_t iio_discovery_get_info_list(
+		struct iio_discovery *disc, struct iio_context_info ***info);
+
+
 /** @brief Create a scan block
  * @param backend A NULL-terminated string containing the backend to use for
  * scanning. If NULL, all the available backends are used.
@@ -395,7 +478,12 @@ __api __check_ret struct iio_context * iio_create_default_context(void);
 
 /** @brief Create a context from local IIO devices (Linux only)
  * @return On success, A pointer to an iio_context structure
- * @return On failure, NULL is returned and errno is set appropriately */
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * <b>NOTE:</b> If the LIBIIO_LOCAL_CACHE environment variable contains the
+ * path of a file, the description of the context is cached there, and reused
+ * by the next calls as long as the devices did not change, instead of scanning
+ * sysfs again. */
 __api __check_ret struct iio_context * iio_create_local_context(void);
 
 
@@ -421,6 +509,19 @@ __api __check_ret struct iio_context * iio_create_xml_context_mem(
 		const char *xml, size_t len);
 
 
+/** @brief Create a context from a capture file
+ * @param path Path to a capture file written with iio_buffer_create_capture()
+ * @return On success, A pointer to an iio_context structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * The context is the one the capture was recorded from. The recorded device
+ * streams the samples of the file, as fast as they are consumed: its buffers
+ * point straight into a mapping of the file. The attributes cannot be read
+ * or written. */
+__api __check_ret struct iio_context * iio_create_file_context(
+		const char *path);
+
+
 /** @brief Create a context from the network
  * @param host Hostname, IPv4 or IPv6 address where the IIO Daemon is running
  * @return On success, a pointer to an iio_context structure
@@ -457,7 +558,16 @@ __api __check_ret struct iio_context * iio_create_network_context(const char *ho
  *        - stop bits (<b>1</b> 2)
  *        - flow control ('<b>\0</b>' none, 'x' Xon Xoff, 'r' RTSCTS, 'd' DTRDSR)
  *
- *  For example <i>"serial:/dev/ttyUSB0,115200"</i> <b>or</b> <i>"serial:/dev/ttyUSB0,115200,8n1"</i>*/
+ *  For example <i>"serial:/dev/ttyUSB0,115200"</i> <b>or</b> <i>"serial:/dev/ttyUSB0,115200,8n1"</i>
+ * - File backend, "file:"\n Requires a path to a capture file for the address
+ *   part. For example <i>"file:/home/user/capture.iio"</i>
+ * - Synthetic backend, "synthetic:"\n Requires:
+ *     - a path to the XML file describing the devices,
+ *     - the pattern of the samples (<b>ramp</b>, tone, noise, or loopback to
+ *       replay the samples pushed to the output devices),
+ *     - the rate, in samples per second (default <b>0</b>, as fast as possible)
+ *
+ *  For example <i>"synthetic:/home/user/file.xml,tone,1000000"</i>*/
 __api __check_ret struct iio_context * iio_create_context_from_uri(const char *uri);
 
 
@@ -468,7 +578,11 @@ __api __check_ret struct iio_context * iio_create_context_from_uri(const char *u
  *
  * <b>NOTE:</b> This function is not supported on 'usb:' contexts, since libusb
  * can only claim the interface once. "Function not implemented" is the expected errno.
- * Any context which is cloned, must be destroyed via calling iio_context_destroy() */
+ * Any context which is cloned, must be destroyed via calling iio_context_destroy()
+ *
+ * <b>NOTE:</b> A clone of a network context is built from the XML string of
+ * the original, without downloading it again. The clone of a multiplexed
+ * context shares its connection, see iio_context_enable_multiplexing(). */
 __api __check_ret struct iio_context * iio_context_clone(const struct iio_context *ctx);
 
 
@@ -492,7 +606,11 @@ __api __check_ret int iio_context_get_version(const struct iio_context *ctx,
 
 /** @brief Obtain a XML representation of the given context
  * @param ctx A pointer to an iio_context structure
- * @return A pointer to a static NULL-terminated string */
+ * @return A pointer to a static NULL-terminated string
+ * @return If the XML cannot be generated, NULL is returned and errno is set
+ * appropriately
+ *
+ * <b>NOTE:</b> The local backend generates the XML on the first call. */
 __api __check_ret __pure const char * iio_context_get_xml(const struct iio_context *ctx);
 
 
@@ -589,6 +707,268 @@ __api __check_ret int iio_context_set_timeout(
 		struct iio_context *ctx, unsigned int timeout_ms);
 
 
+/** @brief Read the devices of a context through io_uring
+ * @param ctx A pointer to an iio_context structure
+ * @param enable If True, the buffers created afterwards use io_uring
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> This only applies to input devices of the local backend that
+ * do not support the high-speed interface. Several reads are kept queued
+ * against the device, so that no sample is lost between two refills. If the
+ * kernel lacks the needed io_uring features, the buffers fall back to the
+ * usual data path. In this mode, iio_buffer_get_poll_fd() returns -ENOSYS.
+ * Other backends return -ENOSYS. */
+__api __check_ret int iio_context_set_io_uring(struct iio_context *ctx,
+		bool enable);
+
+
+/** @brief Exchange the samples of all the devices over the connection of a
+ * context
+ * @param ctx A pointer to an iio_context structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The devices opened afterwards share the connection of the
+ * context with the attribute accesses, instead of using a connection each,
+ * which helps when the number of connections or the latency of opening one
+ * matters. Their buffers can't use the zero-copy interface, and a buffer
+ * that the application stops reading may delay the others. The connection
+ * stays multiplexed until the context is destroyed. This only applies to
+ * the network backend; other backends, and older versions of IIOD, return
+ * -ENOSYS. The connection is closed once the context and all its clones are
+ * destroyed. */
+__api __check_ret int iio_context_enable_multiplexing(struct iio_context *ctx);
+
+
+/** @brief Close the attribute files kept open by a context
+ * @param ctx A pointer to an iio_context structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The local backend keeps the files of the most recently used
+ * attributes open, so that they can be accessed again with one system call.
+ * This function closes them, e.g. to release the file descriptors, or after
+ * the attributes of a device were re-created by its driver. They are
+ * re-opened on the next access. Other backends return -ENOSYS. */
+__api __check_ret int iio_context_close_attr_fds(const struct iio_context *ctx);
+
+
+/** @brief Set the allocator used for the memory of the buffers
+ * @param ctx A pointer to an iio_context structure
+ * @param alloc_fn A pointer to a function that allocates the given number of
+ * bytes, or NULL to use malloc()
+ * @param free_fn A pointer to a function that frees the memory returned by
+ * alloc_fn, or NULL to use free()
+ * @param d A user-specified pointer that will be passed to alloc_fn and
+ * free_fn
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> This can be used to place the samples in huge pages, or in
+ * memory pinned or shared with another device. The allocator only applies to
+ * the buffers created afterwards, and is not used by high-speed devices, whose
+ * samples live in memory provided by the kernel. */
+__api __check_ret int iio_context_set_buffer_allocator(
+		struct iio_context *ctx, void * (*alloc_fn)(size_t size, void *d),
+		void (*free_fn)(void *ptr, size_t size, void *d), void *d);
+
+
+/** @brief Enable or disable the attribute cache of a remote context
+ * @param ctx A pointer to an iio_context structure
+ * @param ttl_ms The time in milliseconds for which the value read from an
+ * attribute is reused, or 0 to disable the cache
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The cache is disabled by default, and is supported by the
+ * network, USB and serial backends. The lists of available values, whose
+ * name ends with "_available", are only read once. Writing an attribute of a
+ * device drops the cached values of that device, but the cache cannot see
+ * the writes made by other clients. Any call flushes the cache. */
+__api __check_ret int iio_context_set_attr_cache(struct iio_context *ctx,
+		unsigned int ttl_ms);
+
+
+/** @brief Set the time for which the value of an attribute is cached
+ * @param ctx A pointer to an iio_context structure
+ * @param attr A NULL-terminated string corresponding to the name of the
+ * attribute, in any device or channel
+ * @param ttl_ms The time in milliseconds for which the value read is reused,
+ * 0 to never cache it, or a negative value to read it only once
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> This overrides the time set with iio_context_set_attr_cache(),
+ * which has to be called for the cache to be enabled. */
+__api __check_ret int iio_context_set_attr_cache_ttl(struct iio_context *ctx,
+		const char *attr, int ttl_ms);
+
+
+/** @brief The operations whose performance counters are kept by a context */
+enum iio_stats_op {
+	/** @brief Opening a device for streaming, e.g. to create a buffer */
+	IIO_STATS_OPEN,
+
+	/** @brief Closing a device */
+	IIO_STATS_CLOSE,
+
+	/** @brief Reading samples from the backend, with iio_device_read_raw() */
+	IIO_STATS_READ,
+
+	/** @brief Writing samples to the backend, with iio_device_write_raw() */
+	IIO_STATS_WRITE,
+
+	/** @brief Exchanging a block with the backend of a high-speed device */
+	IIO_STATS_GET_BUFFER,
+
+	/** @brief iio_buffer_refill(), including the work done by the library */
+	IIO_STATS_REFILL,
+
+	/** @brief iio_buffer_push(), including the work done by the library */
+	IIO_STATS_PUSH,
+
+	/** @brief Reading an attribute of a device, buffer or channel */
+	IIO_STATS_ATTR_READ,
+
+	/** @brief Writing an attribute of a device, buffer or channel */
+	IIO_STATS_ATTR_WRITE,
+
+	/** @brief Sending data to IIOD, with the network, USB and serial backends */
+	IIO_STATS_CLIENT_WRITE,
+
+	/** @brief Receiving data from IIOD, including the time spent waiting */
+	IIO_STATS_CLIENT_READ,
+
+	/** @brief Waiting for the lock of a connection to IIOD */
+	IIO_STATS_CLIENT_LOCK,
+
+	/** @brief Number of operations; not an operation */
+	IIO_STATS_NB_OPS,
+};
+
+
+/** @brief Performance counters of one operation */
+struct iio_op_stats {
+	/** @brief Number of calls */
+	uint64_t nb_calls;
+
+	/** @brief Number of calls which returned an error */
+	uint64_t nb_errors;
+
+	/** @brief Number of bytes transferred by the successful calls */
+	uint64_t bytes;
+
+	/** @brief Cumulative time spent in the calls, in nanoseconds */
+	uint64_t total_ns;
+
+	/** @brief Longest call, in nanoseconds */
+	uint64_t max_ns;
+};
+
+
+/** @brief Retrieve the performance counters of an operation
+ * @param ctx A pointer to an iio_context structure
+ * @param op The operation to report
+ * @param stats A pointer to an iio_op_stats structure to fill
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned; -ENOSYS if the
+ * library was built without WITH_PERF_COUNTERS
+ *
+ * <b>NOTE:</b> The counters are kept for all the devices of the context and
+ * updated from any thread; each of them is consistent, but they are not
+ * read atomically as a whole. */
+__api __check_ret int iio_context_get_stats(const struct iio_context *ctx,
+		enum iio_stats_op op, struct iio_op_stats *stats);
+
+
+/** @brief Reset the performance counters of a context
+ * @param ctx A pointer to an iio_context structure */
+__api void iio_context_reset_stats(struct iio_context *ctx);
+
+
+/** @brief Get the name of an operation of the performance counters
+ * @param op The operation
+ * @return A pointer to a static NULL-terminated string, or NULL if the
+ * operation is invalid */
+__api __check_ret __cnst const char * iio_stats_op_get_name(enum iio_stats_op op);
+
+
+/** @brief Create an empty batch of attribute accesses
+ * @param ctx A pointer to an iio_context structure
+ * @return On success, a pointer to an iio_attr_batch structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * <b>NOTE:</b> The reads and writes added to a batch are performed in order
+ * by iio_attr_batch_commit(). With the network backend, the whole batch
+ * takes one round trip to the server, when it speaks the binary protocol;
+ * other backends perform the accesses one by one. */
+__api __check_ret struct iio_attr_batch * iio_context_create_attr_batch(
+		struct iio_context *ctx);
+
+
+/** @brief Destroy a batch of attribute accesses
+ * @param batch A pointer to an iio_attr_batch structure */
+__api void iio_attr_batch_destroy(struct iio_attr_batch *batch);
+
+
+/** @brief Add the read of an attribute to a batch
+ * @param batch A pointer to an iio_attr_batch structure
+ * @param dev A pointer to an iio_device structure
+ * @param chn A pointer to an iio_channel structure of the device, to read a
+ * channel-specific attribute, or NULL to read a device-specific attribute
+ * @param attr A NULL-terminated string corresponding to the name of the
+ * attribute
+ * @param dst A pointer to the memory area where the NULL-terminated string
+ * corresponding to the value read will be stored on commit
+ * @param len The available length of the memory area, in bytes
+ * @return On success, the index of the access in the batch
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_attr_batch_add_read(struct iio_attr_batch *batch,
+		const struct iio_device *dev, const struct iio_channel *chn,
+		const char *attr, char *dst, size_t len);
+
+
+/** @brief Add the write of an attribute to a batch
+ * @param batch A pointer to an iio_attr_batch structure
+ * @param dev A pointer to an iio_device structure
+ * @param chn A pointer to an iio_channel structure of the device, to write
+ * a channel-specific attribute, or NULL to write a device-specific attribute
+ * @param attr A NULL-terminated string corresponding to the name of the
+ * attribute
+ * @param src A NULL-terminated string to write; it is copied
+ * @return On success, the index of the access in the batch
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_attr_batch_add_write(struct iio_attr_batch *batch,
+		const struct iio_device *dev, const struct iio_channel *chn,
+		const char *attr, const char *src);
+
+
+/** @brief Perform the accesses of a batch
+ * @param batch A pointer to an iio_attr_batch structure
+ * @param stop_on_error If True, the accesses following one that failed are
+ * not performed, and their result is -ECANCELED
+ * @return On success, 0 is returned, and the result of each access can be
+ * obtained with iio_attr_batch_get_result()
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The accesses are performed in the order they were added.
+ * Those performed before an error are not undone. A batch can be committed
+ * again, e.g. to poll the same attributes periodically. */
+__api __check_ret int iio_attr_batch_commit(struct iio_attr_batch *batch,
+		bool stop_on_error);
+
+
+/** @brief Get the result of an access of a committed batch
+ * @param batch A pointer to an iio_attr_batch structure
+ * @param index The index of the access, as returned when it was added
+ * @return The number of bytes read or written on success, or a negative
+ * errno code, as iio_device_attr_read() and iio_device_attr_write() would
+ * return */
+__api ssize_t iio_attr_batch_get_result(const struct iio_attr_batch *batch,
+		unsigned int index);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Device functions --------------------------------*/
 /** @defgroup Device Device
@@ -1062,6 +1442,88 @@ __api __check_ret int iio_device_set_trigger(const struct iio_device *dev,
  * @return True if the device is a trigger, False otherwise */
 __api __check_ret __pure bool iio_device_is_trigger(const struct iio_device *dev);
 
+/** @brief Make the buffers of a device use DMABUF objects
+ * @param dev A pointer to an iio_device structure
+ * @param enable If True, the blocks of the buffers created afterwards are
+ * allocated as DMABUF objects
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> With DMABUF, the memory of each block can be shared with other
+ * devices (e.g. a GPU or a NIC) without any copy, using the file descriptor
+ * returned by iio_block_get_dmabuf_fd(). Only supported by the local backend,
+ * on kernels with the IIO DMABUF interface; otherwise, the buffer silently
+ * falls back to the regular high-speed or low-speed interface. This must be
+ * called while the device has no buffer. */
+__api __check_ret int iio_device_set_dmabuf(const struct iio_device *dev,
+		bool enable);
+
+
+/** @brief Double-buffer the cyclic buffers of a device
+ * @param dev A pointer to an iio_device structure
+ * @param enable If True, the cyclic buffers created afterwards can be pushed
+ * more than once
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Once a cyclic buffer has been pushed, iio_buffer_start() points
+ * to a second block, in which the next waveform can be prepared. Pushing the
+ * buffer again replaces the waveform being output at the end of its current
+ * period, without having to destroy the buffer; the call returns once the
+ * previous block has been retired, and can be filled again. This requires a
+ * DMA driver able to end a cyclic transfer when a new one is queued. Only
+ * supported by the local backend; remote cyclic buffers are double-buffered
+ * by IIOD when available. This must be called while the device has no
+ * buffer. */
+__api __check_ret int iio_device_set_cyclic_double_buffer(
+		const struct iio_device *dev, bool enable);
+
+
+/** @brief Stream the samples of a device through a queue of transfers
+ * @param dev A pointer to an iio_device structure
+ * @param nb_transfers The number of transfers kept submitted, or 0 to use
+ * a single transfer at a time, which is the default
+ * @param transfer_size The size of each transfer in bytes, or 0 for the
+ * default of 256 KiB
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The transfers are allocated once, when the buffer is created,
+ * and are kept submitted on the endpoints of the device while samples move,
+ * so that the bus does not idle between two of them. Only supported by the
+ * USB backend, with at most 64 transfers of at most 1 MiB. This must be
+ * called while the device has no buffer. */
+__api __check_ret int iio_device_set_transfers(const struct iio_device *dev,
+		unsigned int nb_transfers, size_t transfer_size);
+
+
+/** @brief Move the playback of a recorded device
+ * @param dev A pointer to an iio_device structure
+ * @param timestamp The timestamp to seek to
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * The next refill starts at the first block recorded with a timestamp equal
+ * to or greater than the one given, found through the index of the capture
+ * file; a timestamp of 0 rewinds to the start. Only supported by the file
+ * backend. */
+__api __check_ret int iio_device_seek(const struct iio_device *dev,
+		uint64_t timestamp);
+
+
+/** @brief Replay a recorded device in a loop
+ * @param dev A pointer to an iio_device structure
+ * @param loop If True, the playback restarts from the first block once the
+ * last one was read; otherwise, the refills fail with -ENODATA
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only supported by the file backend. Looping is disabled by
+ * default. */
+__api __check_ret int iio_device_set_playback_loop(
+		const struct iio_device *dev, bool loop);
+
+
 /** @brief Configure the number of kernel buffers for a device
  *
  * This function allows to change the number of buffers on kernel side.
@@ -1072,6 +1534,115 @@ __api __check_ret __pure bool iio_device_is_trigger(const struct iio_device *dev
 __api __check_ret int iio_device_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_buffers);
 
+
+/** @brief Statistics of the kernel buffers of a device */
+struct iio_kernel_buffers_stats {
+	/** @brief Number of kernel buffers of the current or last buffer */
+	unsigned int nb_blocks;
+
+	/** @brief Number of kernel buffers the next buffer will request */
+	unsigned int next_nb_blocks;
+
+	/** @brief Number of kernel buffers dequeued */
+	uint64_t nb_dequeued;
+
+	/** @brief Number of kernel buffers that were already complete when
+	 * dequeued */
+	uint64_t nb_ready;
+
+	/** @brief Longest run of kernel buffers complete when dequeued, i.e.
+	 * how far the application lagged behind the hardware */
+	unsigned int max_ready;
+};
+
+
+/** @brief Tune the number of kernel buffers of a device automatically
+ * @param dev A pointer to an iio_device structure
+ * @param enable If True, the number of kernel buffers is adapted each time a
+ * buffer is destroyed, for the next one
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The count starts from the one set with
+ * iio_device_set_kernel_buffers_count(). It is doubled when the application
+ * lagged behind the hardware by all the kernel buffers, which means that
+ * samples were lost, and otherwise reduced to the deepest lag seen plus one.
+ * The decision is reported by iio_device_get_kernel_buffers_stats(). Only
+ * supported by the local backend, with the high-speed interface. This must
+ * be called while the device has no buffer. */
+__api __check_ret int iio_device_set_kernel_buffers_auto(
+		const struct iio_device *dev, bool enable);
+
+
+/** @brief Retrieve the statistics of the kernel buffers of a device
+ * @param dev A pointer to an iio_device structure
+ * @param stats A pointer to an iio_kernel_buffers_stats structure to fill
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The dequeue statistics are only gathered in auto mode, see
+ * iio_device_set_kernel_buffers_auto(). */
+__api __check_ret int iio_device_get_kernel_buffers_stats(
+		const struct iio_device *dev,
+		struct iio_kernel_buffers_stats *stats);
+
+
+/** @brief Enable the low-latency streaming mode of a device
+ * @param dev A pointer to an iio_device structure
+ * @param enable If True, the next buffers are configured for the lowest
+ * latency instead of the highest throughput
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> In low-latency mode, the kernel buffer holds at most two
+ * blocks of the buffer's size, its watermark is set to one block so that the
+ * application is woken up as soon as one is complete, and the blocks are
+ * dequeued without polling first whenever one is ready. This is meant to be
+ * used with small buffers, e.g. for closed-loop control; samples are lost
+ * when the application lags behind by more than one block. This must be
+ * called while the device has no buffer. With remote contexts, the setting
+ * is forwarded to the server. */
+__api __check_ret int iio_device_set_low_latency(const struct iio_device *dev,
+		bool enable);
+
+
+/** @brief Latency statistics of the buffers of a device */
+struct iio_latency_stats {
+	/** @brief Number of blocks delivered to the application */
+	uint64_t nb_blocks;
+
+	/** @brief Number of blocks whose delivery latency was measured */
+	uint64_t nb_measured;
+
+	/** @brief Shortest time between the completion of a block by the
+	 * hardware and its delivery to the application, in nanoseconds */
+	uint64_t min_ns;
+
+	/** @brief Longest delivery latency, in nanoseconds */
+	uint64_t max_ns;
+
+	/** @brief Sum of the delivery latencies, in nanoseconds */
+	uint64_t total_ns;
+
+	/** @brief Longest time between the deliveries of two consecutive
+	 * blocks, in nanoseconds */
+	uint64_t max_interval_ns;
+};
+
+
+/** @brief Retrieve the latency statistics of the current or last buffer of
+ * a device
+ * @param dev A pointer to an iio_device structure
+ * @param stats A pointer to an iio_latency_stats structure to fill
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only supported by the local backend. The statistics are reset
+ * when a buffer is created. The delivery latency can only be measured with
+ * the high-speed interface, from the timestamps of the blocks. */
+__api __check_ret int iio_device_get_latency_stats(
+		const struct iio_device *dev, struct iio_latency_stats *stats);
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Channel functions -------------------------------*/
 /** @defgroup Channel Channel
@@ -1357,6 +1928,59 @@ __api __check_ret size_t iio_channel_read(const struct iio_channel *chn,
 		struct iio_buffer *buffer, void *dst, size_t len);
 
 
+/** @brief Demultiplex and convert a range of samples of a given channel
+ * @param chn A pointer to an iio_channel structure
+ * @param buffer A pointer to an iio_buffer structure
+ * @param dst A pointer to the memory area where the converted data will be
+ * stored
+ * @param offset The index of the first sample to convert
+ * @param nb_samples The maximum number of samples to convert
+ * @return The number of samples actually converted
+ *
+ * <b>NOTE:</b> The memory area pointed by dst must be large enough to hold
+ * nb_samples converted samples. Converting a buffer in chunks that fit in
+ * the CPU cache can be done by calling this function repeatedly with an
+ * increasing offset. */
+__api __check_ret size_t iio_channel_read_block(const struct iio_channel *chn,
+		struct iio_buffer *buffer, void *dst,
+		size_t offset, size_t nb_samples);
+
+
+/** @brief Demultiplex a range of samples of a given channel, and convert them
+ * to processed values in single precision
+ * @param chn A pointer to an iio_channel structure
+ * @param buffer A pointer to an iio_buffer structure
+ * @param dst A pointer to the memory area where the processed values will be
+ * stored
+ * @param offset The index of the first sample to convert
+ * @param nb_samples The maximum number of samples to convert
+ * @return The number of samples actually converted
+ *
+ * <b>NOTE:</b> The processed value is computed as (raw + offset) * scale,
+ * using the offset and scale of the channel's data format. If the channel
+ * has no scale, a scale of 1.0 is used. The memory area pointed by dst must
+ * be large enough to hold nb_samples * repeat values. */
+__api __check_ret size_t iio_channel_read_float(const struct iio_channel *chn,
+		struct iio_buffer *buffer, float *dst,
+		size_t offset, size_t nb_samples);
+
+
+/** @brief Demultiplex a range of samples of a given channel, and convert them
+ * to processed values in double precision
+ * @param chn A pointer to an iio_channel structure
+ * @param buffer A pointer to an iio_buffer structure
+ * @param dst A pointer to the memory area where the processed values will be
+ * stored
+ * @param offset The index of the first sample to convert
+ * @param nb_samples The maximum number of samples to convert
+ * @return The number of samples actually converted
+ *
+ * <b>NOTE:</b> See iio_channel_read_float. */
+__api __check_ret size_t iio_channel_read_double(const struct iio_channel *chn,
+		struct iio_buffer *buffer, double *dst,
+		size_t offset, size_t nb_samples);
+
+
 /** @brief Multiplex the samples of a given channel
  * @param chn A pointer to an iio_channel structure
  * @param buffer A pointer to an iio_buffer structure
@@ -1405,6 +2029,15 @@ __api __check_ret __pure enum iio_modifier iio_channel_get_modifier(
 		const struct iio_channel *chn);
 
 
+/** @brief Get the channel that forms a I/Q pair with the given channel
+ * @param chn A pointer to an iio_channel structure
+ * @return On success, a pointer to the channel with the opposite I or Q
+ * modifier (e.g. "voltage0_q" for "voltage0_i")
+ * @return If the channel is not part of a I/Q pair, NULL is returned */
+__api __check_ret __pure struct iio_channel * iio_channel_get_iq_pair(
+		const struct iio_channel *chn);
+
+
 /** @} *//* ------------------------------------------------------------------*/
 /* ------------------------- Buffer functions --------------------------------*/
 /** @defgroup Buffer Buffer
@@ -1433,12 +2066,51 @@ __api __check_ret struct iio_buffer * iio_device_create_buffer(const struct iio_
 		size_t samples_count, bool cyclic);
 
 
+/** @brief Create an input or output buffer on memory supplied by the caller
+ * @param dev A pointer to an iio_device structure
+ * @param samples_count The number of samples that the buffer should contain
+ * @param cyclic If True, enable cyclic mode
+ * @param mem A pointer to the memory area the samples will be stored into
+ * @param mem_size The size of the memory area, in bytes. It must be at least
+ * samples_count times the sample size of the device.
+ * @return On success, a pointer to an iio_buffer structure
+ * @return On error, NULL is returned, and errno is set to the error code
+ *
+ * <b>NOTE:</b> The memory area belongs to the caller, and must stay valid until
+ * the buffer is destroyed. The backends read and write the samples directly
+ * from and to it. This is not possible on high-speed devices, whose samples
+ * live in memory provided by the kernel; ENOTSUP is returned in that case. */
+__api __check_ret struct iio_buffer * iio_device_create_buffer_with_memory(
+		const struct iio_device *dev, size_t samples_count,
+		bool cyclic, void *mem, size_t mem_size);
+
+
 /** @brief Destroy the given buffer
  * @param buf A pointer to an iio_buffer structure
  *
  * <b>NOTE:</b> After that function, the iio_buffer pointer shall be invalid. */
 __api void iio_buffer_destroy(struct iio_buffer *buf);
 
+
+/** @brief Apply the channels currently enabled to an existing buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param samples_count The number of samples that the buffer should contain
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned. With -ENOSYS or
+ * -ENOSPC, the buffer is left untouched, and has to be destroyed then
+ * re-created to use the new channels. On any other error, the buffer can
+ * only be destroyed.
+ *
+ * Same as destroying the buffer then creating it again with
+ * iio_device_create_buffer(), but the backend keeps the memory and the
+ * kernel blocks already allocated, if the new samples fit in them.
+ *
+ * <b>NOTE:</b> The samples not read yet are lost. The buffer must not be in
+ * use meanwhile: no block dequeued, no stream or asynchronous operation
+ * pending. Cyclic buffers cannot be reconfigured. */
+__api __check_ret int iio_buffer_reconfigure(struct iio_buffer *buf,
+		size_t samples_count);
+
 /** @brief Get a pollable file descriptor
  *
  * Can be used to know when iio_buffer_refill() or iio_buffer_push() can be
@@ -1463,6 +2135,177 @@ __api __check_ret int iio_buffer_get_poll_fd(struct iio_buffer *buf);
 __api __check_ret int iio_buffer_set_blocking_mode(struct iio_buffer *buf, bool blocking);
 
 
+/** @brief Spin for a while before waiting for a buffer to be ready
+ * @param buf A pointer to an iio_buffer structure
+ * @param busy_poll_us Number of microseconds during which the readiness of
+ * the device is polled without sleeping, or 0 to disable busy-polling
+ * @param cpu If positive or zero, the CPU to which the calling thread will be
+ * pinned
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> This is meant for low-latency loops using small buffers: the
+ * refill latency is lowered at the price of a CPU core spinning. The CPU
+ * affinity applies to the thread calling this function, which should be the
+ * one calling iio_buffer_refill() or iio_buffer_push(). Only supported by
+ * the local backend. */
+__api __check_ret int iio_buffer_set_busy_poll(struct iio_buffer *buf,
+		unsigned int busy_poll_us, int cpu);
+
+
+/** @brief Keep requests for the next buffers in flight while refilling
+ * @param buf A pointer to an iio_buffer structure
+ * @param nb_requests Number of requests sent ahead of the one being served
+ * by iio_buffer_refill(), or 0 to disable read-ahead
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> With remote contexts, this hides the round-trip time of the
+ * link: the server always has the request for the next buffer queued, so
+ * the throughput is bounded by the bandwidth instead. The samples read
+ * ahead are dropped when the buffer is destroyed or read-ahead disabled,
+ * and iio_buffer_get_timestamp() fails with -EBUSY while read-ahead is in
+ * use. Only supported by the network backend, when the server speaks the
+ * binary protocol, and for input buffers. */
+__api __check_ret int iio_buffer_set_read_ahead(struct iio_buffer *buf,
+		unsigned int nb_requests);
+
+
+/** @brief Let the server compress the samples sent to a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param enable If True, the samples are received compressed when that
+ * makes them smaller
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> This is meant for slow links and samples that vary slowly:
+ * each byte of the samples is replaced with its difference to the same byte
+ * of the previous sample, then compressed with zstd. It costs CPU time on
+ * both ends, and is pointless for noisy signals; the server then sends the
+ * samples as they are. Only supported by the network backend built with
+ * zstd support, when the server speaks the binary protocol, and for input
+ * buffers. */
+__api __check_ret int iio_buffer_set_compression(struct iio_buffer *buf,
+		bool enable);
+
+
+/** @brief Have the server publish the samples of a buffer to a multicast group
+ * @param buf A pointer to an iio_buffer structure
+ * @param addr The IPv4 multicast group and the UDP port, as "group:port"
+ * @param ttl The time-to-live of the datagrams, or 0 for the default of the
+ * server (usually 1, which keeps them on the local network)
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The server then refills its buffer continuously, and sends
+ * each block once to the group, whatever the number of subscribers; see
+ * iio_buffer_subscribe(). This lasts until the buffer is destroyed, and the
+ * buffer cannot be refilled meanwhile. Only supported by the network
+ * backend, when the server speaks the binary protocol, and for input
+ * buffers. */
+__api __check_ret int iio_buffer_publish(struct iio_buffer *buf,
+		const char *addr, unsigned int ttl);
+
+
+/** @brief Receive the samples of a buffer from a multicast group
+ * @param buf A pointer to an iio_buffer structure
+ * @param addr The IPv4 multicast group and the UDP port, as "group:port"
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Past this call, iio_buffer_refill() returns the next complete
+ * block published to the group with iio_buffer_publish(), instead of asking
+ * the server for samples. The blocks that could not be received entirely are
+ * dropped; see iio_buffer_get_multicast_losses(). The buffer should have the
+ * same size as the one of the publisher: larger blocks are truncated. The
+ * channel mask of the publisher applies. Only supported by the network
+ * backend, and for input buffers. */
+__api __check_ret int iio_buffer_subscribe(struct iio_buffer *buf,
+		const char *addr);
+
+
+/** @brief Have the server filter and decimate the samples of a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param factor The decimation factor, or 1 to receive all the samples
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The server then sends one sample out of 'factor', after a
+ * low-pass filter that removes the frequencies above the Nyquist frequency
+ * of the decimated samples. Channels of more than 32 bits, such as
+ * timestamps, are decimated without filtering. Each refill still fills the
+ * whole buffer, which then takes 'factor' times more samples of the device.
+ * Only supported by the network backend, for input buffers, and for factors
+ * of up to 256. */
+__api __check_ret int iio_buffer_set_decimation(struct iio_buffer *buf,
+		unsigned int factor);
+
+
+/** @brief Conditions which trigger a capture window */
+enum iio_window_edge {
+	/** @brief No capture windows: all the samples are read */
+	IIO_WINDOW_OFF,
+	/** @brief The sample reaches the level, the previous one was below */
+	IIO_WINDOW_RISING,
+	/** @brief The sample reaches the level, the previous one was above */
+	IIO_WINDOW_FALLING,
+	/** @brief The sample is at or above the level */
+	IIO_WINDOW_ABOVE,
+	/** @brief The sample is at or below the level */
+	IIO_WINDOW_BELOW,
+};
+
+
+/** @brief Have the server only send the samples around a trigger condition
+ * @param buf A pointer to an iio_buffer structure
+ * @param chn A pointer to the enabled channel whose samples are compared to
+ * the level, or NULL with IIO_WINDOW_OFF
+ * @param edge The condition, or IIO_WINDOW_OFF to receive all the samples
+ * @param level The level, as a raw value of the channel, sign-extended
+ * @param pre The number of samples sent before the one meeting the condition
+ * @param post The number of samples sent from the one meeting the condition
+ * @return On success, 0
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The server evaluates the condition on each sample captured,
+ * and only sends windows of exactly (pre + post) samples, one after the
+ * other; the buffer should hold a whole number of windows. The conditions
+ * met during a window are ignored, and the samples before the trigger may
+ * also belong to the previous window. A refill returns once the buffer is
+ * full of windows, which may take long: set a timeout accordingly. Only
+ * supported by the network backend, for input buffers, and not together
+ * with iio_buffer_set_decimation(). */
+__api __check_ret int iio_buffer_set_capture_window(struct iio_buffer *buf,
+		const struct iio_channel *chn, enum iio_window_edge edge,
+		long long level, unsigned int pre, unsigned int post);
+
+
+/** @brief Get the number of blocks lost by a buffer receiving from a
+ * multicast group
+ * @param buf A pointer to an iio_buffer structure
+ * @param nb_lost A pointer to a variable where the number of blocks lost
+ * since iio_buffer_subscribe() will be stored
+ * @return On success, 0
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_buffer_get_multicast_losses(
+		const struct iio_buffer *buf, uint64_t *nb_lost);
+
+
+/** @brief Get the hardware timestamp of the samples in a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @param timestamp A pointer to a variable where the timestamp will be stored
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The timestamp is the one the driver attached to the DMA block
+ * last obtained with iio_buffer_refill() or iio_buffer_push(), in the
+ * driver's time base. It is only available on high-speed devices, either
+ * locally or through the network and USB backends; -ENOSYS is returned
+ * otherwise. */
+__api __check_ret int iio_buffer_get_timestamp(const struct iio_buffer *buf,
+		uint64_t *timestamp);
+
+
 /** @brief Fetch more samples from the hardware
  * @param buf A pointer to an iio_buffer structure
  * @return On success, the number of bytes read is returned
@@ -1491,6 +2334,59 @@ __api __check_ret ssize_t iio_buffer_push(struct iio_buffer *buf);
 __api __check_ret ssize_t iio_buffer_push_partial(struct iio_buffer *buf,
 		size_t samples_count);
 
+
+/** @brief Start fetching samples from the hardware, without blocking
+ * @param buf A pointer to an iio_buffer structure
+ * @param callback A pointer to a function to call once the refill completed
+ * @param data A user-specified pointer that will be passed to the callback
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The refill progresses each time iio_buffer_process_async() is
+ * called. The callback receives the buffer, the value iio_buffer_refill()
+ * would have returned, and the user-specified pointer. Until the callback is
+ * called, the content of the buffer must not be accessed, and no other
+ * refill can be started.
+ *
+ * Only valid for input buffers, and only supported by the local and network
+ * backends for now; -ENOSYS is returned otherwise, in particular for the
+ * buffers of USB and serial contexts. With the network backend,
+ * the device must use the binary protocol on a connection of its own: it
+ * must not be multiplexed, subscribed to a multicast group, or use the
+ * zero-copy interface. */
+__api __check_ret int iio_buffer_refill_async(struct iio_buffer *buf,
+		void (*callback)(struct iio_buffer *buf, ssize_t ret, void *d),
+		void *data);
+
+
+/** @brief Start sending the samples to the hardware, without blocking
+ * @param buf A pointer to an iio_buffer structure
+ * @param callback A pointer to a function to call once the push completed
+ * @param data A user-specified pointer that will be passed to the callback
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Asynchronous counterpart of iio_buffer_push(); see
+ * iio_buffer_refill_async() for the supported backends (-ENOSYS is returned
+ * on USB and serial contexts). Only valid for output buffers. */
+__api __check_ret int iio_buffer_push_async(struct iio_buffer *buf,
+		void (*callback)(struct iio_buffer *buf, ssize_t ret, void *d),
+		void *data);
+
+
+/** @brief Make progress on the pending asynchronous operation of a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @return 0 if the operation completed (its callback has been called) or if
+ * no operation was pending
+ * @return -EAGAIN if the operation is still in progress
+ *
+ * <b>NOTE:</b> This function never blocks. It is meant to be called from an
+ * event loop, each time the file descriptor returned by
+ * iio_buffer_get_poll_fd() becomes readable (input buffers) or writable
+ * (output buffers), so that a single thread can drive many buffers. The
+ * callback may start the next asynchronous operation on the same buffer. */
+__api __check_ret int iio_buffer_process_async(struct iio_buffer *buf);
+
 /** @brief Cancel all buffer operations
  * @param buf The buffer for which operations should be canceled
  *
@@ -1572,6 +2468,453 @@ __api __check_ret ssize_t iio_buffer_foreach_sample(struct iio_buffer *buf,
 			void *src, size_t bytes, void *d), void *data);
 
 
+/** @brief Call the supplied callback once for each channel found in a buffer,
+ * with all the samples of that channel
+ * @param buf A pointer to an iio_buffer structure
+ * @param callback A pointer to a function to call for each channel found
+ * @param data A user-specified pointer that will be passed to the callback
+ * @return number of bytes processed.
+ *
+ * <b>NOTE:</b> The callback receives six arguments:
+ * * A pointer to the iio_channel structure corresponding to the samples,
+ * * A pointer to the first sample,
+ * * The length of one sample in bytes,
+ * * The distance in bytes between two consecutive samples,
+ * * The number of samples,
+ * * The user-specified pointer passed to iio_buffer_foreach_sample_batch.
+ *
+ * The samples visited are the same as with iio_buffer_foreach_sample; only
+ * the order of the calls differs. When the samples of a channel cannot be
+ * described with a constant step, the callback is called once per sample. */
+__api __check_ret ssize_t iio_buffer_foreach_sample_batch(
+		struct iio_buffer *buf,
+		ssize_t (*callback)(const struct iio_channel *chn,
+			void *src, size_t bytes, ptrdiff_t step,
+			size_t nb_samples, void *d), void *data);
+
+
+/** @brief Dequeue one hardware block from a buffer
+ * @param buf A pointer to an iio_buffer structure
+ * @return On success, a pointer to an iio_block structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * Contrary to iio_buffer_refill() and iio_buffer_push(), which only let the
+ * application access one block at a time, this function can be called
+ * repeatedly to hold several blocks at once, while the hardware keeps filling
+ * (or emptying) the other ones. Each block must be given back to the hardware
+ * with iio_block_enqueue() once it has been processed.
+ *
+ * For input buffers, the block contains the captured samples; for output
+ * buffers, the block is empty and should be filled before being enqueued.
+ *
+ * <b>NOTE:</b> Only available on high-speed devices of the local backend, and
+ * not in cyclic mode; it will fail with ENOSYS otherwise. Blocks of a buffer
+ * share its channel mask, so the iio_buffer_first() position of a channel is
+ * also valid within a block (see iio_block_first()). The returned structure
+ * belongs to the buffer, and is valid until the buffer is destroyed. */
+__api __check_ret struct iio_block * iio_buffer_dequeue_block(
+		struct iio_buffer *buf);
+
+
+/** @brief Give a block back to the hardware
+ * @param block A pointer to an iio_block structure
+ * @param bytes_used The number of bytes to submit, for output buffers.
+ * If zero, or for input buffers, the whole block is submitted.
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_block_enqueue(struct iio_block *block,
+		size_t bytes_used);
+
+
+/** @brief Get the start address of a block
+ * @param block A pointer to an iio_block structure
+ * @return A pointer corresponding to the start address of the block */
+__api void * iio_block_start(const struct iio_block *block);
+
+
+/** @brief Find the first sample of a channel in a block
+ * @param block A pointer to an iio_block structure
+ * @param chn A pointer to an iio_channel structure
+ * @return A pointer to the first sample found, or to the end of the block if
+ * no sample for the given channel is present in the block
+ *
+ * <b>NOTE:</b> The samples of the channel can be iterated on using
+ * iio_buffer_step() of the block's buffer and iio_block_end(). */
+__api void * iio_block_first(const struct iio_block *block,
+		const struct iio_channel *chn);
+
+
+/** @brief Get the address that follows the last sample in a block
+ * @param block A pointer to an iio_block structure
+ * @return A pointer corresponding to the address that follows the last sample
+ * present in the block */
+__api void * iio_block_end(const struct iio_block *block);
+
+
+/** @brief Retrieve the buffer a block belongs to
+ * @param block A pointer to an iio_block structure
+ * @return A pointer to an iio_buffer structure */
+__api struct iio_buffer * iio_block_get_buffer(const struct iio_block *block);
+
+
+/** @brief Get the DMABUF file descriptor of a block
+ * @param block A pointer to an iio_block structure
+ * @return On success, a file descriptor referring to the memory of the block
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only available when DMABUF mode was enabled with
+ * iio_device_set_dmabuf(). The file descriptor belongs to the buffer and is
+ * closed when the buffer is destroyed; it can be imported into other APIs
+ * (Vulkan, CUDA, RDMA...) for as long as the block is dequeued. */
+__api __check_ret int iio_block_get_dmabuf_fd(const struct iio_block *block);
+
+
+/** @brief Get the hardware timestamp of a block
+ * @param block A pointer to an iio_block structure
+ * @return The timestamp the driver attached to the block, or 0 if the
+ * driver does not provide timestamps */
+__api uint64_t iio_block_get_timestamp(const struct iio_block *block);
+
+
+/** @brief Statistics of a capture stream */
+struct iio_stream_stats {
+	/** @brief Number of blocks handed to the consumer */
+	uint64_t nb_blocks;
+
+	/** @brief Number of blocks dropped because the consumer lagged behind */
+	uint64_t nb_overruns;
+
+	/** @brief Number of blocks captured but not released yet */
+	unsigned int lag;
+
+	/** @brief Highest value of the lag seen so far */
+	unsigned int max_lag;
+};
+
+
+/** @brief Start capturing samples from a background thread
+ * @param buf A pointer to an iio_buffer structure
+ * @param nb_slots The number of blocks that can wait for the consumer;
+ * it is rounded up to a power of two
+ * @param cpu The CPU to run the capture thread on, or -1 to let the
+ * scheduler decide
+ * @return On success, a pointer to an iio_stream structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * The capture thread keeps the hardware busy, and publishes the captured
+ * blocks through a lock-free ring, which the application consumes with
+ * iio_stream_acquire() and iio_stream_release(). When the ring is full, the
+ * newest blocks are dropped and counted as overruns, instead of stalling the
+ * capture.
+ *
+ * On high-speed devices, the DMA blocks are handed to the consumer without
+ * any copy (see iio_buffer_dequeue_block()); otherwise the samples are read
+ * into memory owned by the stream.
+ *
+ * <b>NOTE:</b> Only valid for input buffers. While the stream exists, the
+ * buffer must not be refilled by the application. See iio_stream_destroy()
+ * for the backends where the buffer cannot be used once the stream is
+ * destroyed. */
+__api __check_ret struct iio_stream * iio_buffer_create_stream(
+		struct iio_buffer *buf, unsigned int nb_slots, int cpu);
+
+
+/** @brief Stop the capture thread and destroy the stream
+ * @param stream A pointer to an iio_stream structure
+ *
+ * <b>NOTE:</b> With the local backend, the buffer can be refilled or used
+ * by another stream afterwards. With the other backends, as well as with
+ * local contexts reading through io_uring (no poll file descriptor, see
+ * iio_buffer_get_poll_fd()), the capture thread can only be woken up by
+ * cancelling the buffer operations (see iio_buffer_cancel()), which is
+ * permanent: the buffer must then be destroyed. */
+__api void iio_stream_destroy(struct iio_stream *stream);
+
+
+/** @brief Get the next block of samples captured by a stream
+ * @param stream A pointer to an iio_stream structure
+ * @param len A pointer to a variable where the size of the block in bytes
+ * will be stored, or NULL
+ * @param timeout_ms The maximum time to wait for a block, in milliseconds.
+ * If zero, wait forever.
+ * @return On success, a pointer to the samples
+ * @return On failure, NULL is returned and errno is set appropriately. If the
+ * capture thread stopped because of an error, errno is set to that error once
+ * all the blocks captured before it have been acquired.
+ *
+ * <b>NOTE:</b> The samples are laid out as in the stream's buffer, so the
+ * offsets and step given by iio_buffer_first() and iio_buffer_step() can be
+ * used. The block stays valid until it is released with
+ * iio_stream_release(). Several blocks can be acquired before releasing
+ * them. This function must always be called from the same thread. */
+__api __check_ret const void * iio_stream_acquire(struct iio_stream *stream,
+		size_t *len, unsigned int timeout_ms);
+
+
+/** @brief Release the oldest block acquired from a stream
+ * @param stream A pointer to an iio_stream structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned */
+__api __check_ret int iio_stream_release(struct iio_stream *stream);
+
+
+/** @brief Get the hardware timestamp of the block last acquired from a stream
+ * @param stream A pointer to an iio_stream structure
+ * @param timestamp A pointer to a variable where the timestamp will be stored
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned. -ENOSYS means that
+ * the device does not timestamp its blocks, see iio_buffer_get_timestamp().
+ *
+ * <b>NOTE:</b> The block must not have been released yet. */
+__api __check_ret int iio_stream_get_timestamp(const struct iio_stream *stream,
+		uint64_t *timestamp);
+
+
+/** @brief Retrieve the statistics of a stream
+ * @param stream A pointer to an iio_stream structure
+ * @param stats A pointer to an iio_stream_stats structure to fill */
+__api void iio_stream_get_stats(const struct iio_stream *stream,
+		struct iio_stream_stats *stats);
+
+
+/** @brief Status of a member of a buffer group, after a refill */
+struct iio_buffer_group_status {
+	/** @brief Result of the last iio_buffer_refill() of the member */
+	ssize_t ret;
+
+	/** @brief Hardware timestamp of the samples, or 0 if unavailable
+	 * (see iio_buffer_get_timestamp()) */
+	uint64_t timestamp;
+
+	/** @brief Difference between the timestamp of the member and the one
+	 * of the first member, or 0 if one of them is unavailable */
+	int64_t skew;
+};
+
+
+/** @brief Create buffers for several devices, to be refilled as a unit
+ * @param devs An array of pointers to the iio_device structures
+ * @param nb_devs The number of devices
+ * @param trigger A pointer to the iio_device structure of a trigger to
+ * assign to all the devices, or NULL to keep their current triggers
+ * @param samples_count The number of samples of each buffer
+ * @param parallel If true, the buffers are refilled concurrently, from one
+ * thread per device; otherwise one after the other
+ * @return On success, a pointer to an iio_buffer_group structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * The trigger is assigned to all the devices before any buffer is created,
+ * so that they all capture on the same trigger events from then on; to have
+ * them start on the same sample, the trigger should only be started after
+ * the group is created. The devices can belong to different contexts, and
+ * any backend can be used.
+ *
+ * <b>NOTE:</b> Only valid for input devices, whose channels have been
+ * enabled beforehand. */
+__api __check_ret struct iio_buffer_group * iio_create_buffer_group(
+		const struct iio_device * const *devs, unsigned int nb_devs,
+		const struct iio_device *trigger, size_t samples_count,
+		bool parallel);
+
+
+/** @brief Destroy a buffer group, and the buffers it contains
+ * @param group A pointer to an iio_buffer_group structure */
+__api void iio_buffer_group_destroy(struct iio_buffer_group *group);
+
+
+/** @brief Get the buffer of a member of a buffer group
+ * @param group A pointer to an iio_buffer_group structure
+ * @param index The index of the member, in the order of the devices passed
+ * to iio_create_buffer_group()
+ * @return On success, a pointer to the iio_buffer structure
+ * @return If the index is invalid, NULL is returned
+ *
+ * <b>NOTE:</b> The buffer belongs to the group: it must not be refilled or
+ * destroyed by the application. */
+__api __check_ret __pure struct iio_buffer * iio_buffer_group_get_buffer(
+		const struct iio_buffer_group *group, unsigned int index);
+
+
+/** @brief Refill all the buffers of a buffer group
+ * @param group A pointer to an iio_buffer_group structure
+ * @return On success, 0 is returned
+ * @return On error, the error code of the first member that failed is
+ * returned; the others may still have been refilled, see
+ * iio_buffer_group_get_status() */
+__api __check_ret int iio_buffer_group_refill(struct iio_buffer_group *group);
+
+
+/** @brief Get the status of a member of a buffer group after a refill
+ * @param group A pointer to an iio_buffer_group structure
+ * @param index The index of the member
+ * @param status A pointer to an iio_buffer_group_status structure to fill
+ * @return On success, 0 is returned
+ * @return If the index is invalid, -EINVAL is returned
+ *
+ * <b>NOTE:</b> The skew, in the time base of the drivers, tells how much
+ * the samples of the member lag behind the ones of the first member. It can
+ * be compensated by offsetting the start of the samples with
+ * iio_buffer_first(), instead of copying them. */
+__api __check_ret int iio_buffer_group_get_status(
+		const struct iio_buffer_group *group, unsigned int index,
+		struct iio_buffer_group_status *status);
+
+
+/** @brief Cancel all the operations of a buffer group
+ * @param group A pointer to an iio_buffer_group structure
+ *
+ * <b>NOTE:</b> See iio_buffer_cancel(); the group should be destroyed
+ * afterwards. */
+__api void iio_buffer_group_cancel(struct iio_buffer_group *group);
+
+
+/** @brief Start recording the samples of a buffer into a capture file
+ * @param buf A pointer to an iio_buffer structure
+ * @param path The path of the capture file to create
+ * @return On success, a pointer to an iio_capture structure
+ * @return On failure, NULL is returned and errno is set appropriately
+ *
+ * The capture file holds the XML string of the context, the channel mask of
+ * the buffer and the blocks of samples, with an index to seek through them.
+ * It can be played back with iio_create_file_context().
+ *
+ * <b>NOTE:</b> Only valid for input buffers. The blocks are expected to be
+ * laid out as in the buffer, with the channel mask it has when the capture
+ * is closed. */
+__api __check_ret struct iio_capture * iio_buffer_create_capture(
+		const struct iio_buffer *buf, const char *path);
+
+
+/** @brief Append a block of samples to a capture file
+ * @param cap A pointer to an iio_capture structure
+ * @param src A pointer to the samples, e.g. iio_buffer_start()
+ * @param len The size of the block in bytes
+ * @param timestamp The timestamp of the block, e.g. as returned by
+ * iio_buffer_get_timestamp(). The timestamps should not decrease, for the
+ * seeking to work.
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned. After a write error,
+ * the capture can only be closed. */
+__api __check_ret int iio_capture_write(struct iio_capture *cap,
+		const void *src, size_t len, uint64_t timestamp);
+
+
+/** @brief Complete a capture file and destroy the capture
+ * @param cap A pointer to an iio_capture structure
+ * @return On success, 0 is returned
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The index of the blocks is written at this point. A capture
+ * which was not closed can still be played back, up to its last complete
+ * block. */
+__api __check_ret int iio_capture_close(struct iio_capture *cap);
+
+
+/** @brief Demultiplex the samples of all the enabled channels in one pass
+ * @param buf A pointer to an iio_buffer structure
+ * @param dst An array of pointers to the memory areas where the samples of
+ * each channel will be stored, indexed like iio_device_get_channel. Entries
+ * set to NULL are skipped.
+ * @param offset The index of the first sample to demultiplex
+ * @param nb_samples The maximum number of samples to demultiplex
+ * @param raw If True, the samples are copied as-is; otherwise they are
+ * converted to host format, like with iio_channel_read
+ * @return On success, the number of samples stored for each channel
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Each memory area must be large enough to hold nb_samples
+ * samples of its channel. Disjoint ranges of a buffer can be demultiplexed
+ * from different threads by using different offsets. */
+__api __check_ret ssize_t iio_buffer_demux(const struct iio_buffer *buf,
+		void * const *dst, size_t offset, size_t nb_samples, bool raw);
+
+
+/** @brief Demultiplex the samples of all the enabled channels in one pass,
+ * and convert them to processed values in single precision
+ * @param buf A pointer to an iio_buffer structure
+ * @param dst An array of pointers to the memory areas where the processed
+ * values of each channel will be stored, indexed like iio_device_get_channel.
+ * Entries set to NULL are skipped.
+ * @param offset The index of the first sample to demultiplex
+ * @param nb_samples The maximum number of samples to demultiplex
+ * @return On success, the number of samples stored for each channel
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> See iio_buffer_demux and iio_channel_read_float. */
+__api __check_ret ssize_t iio_buffer_demux_float(const struct iio_buffer *buf,
+		float * const *dst, size_t offset, size_t nb_samples);
+
+
+/** @brief Read the samples of a I/Q channel pair as interleaved complex
+ * 16-bit integers
+ * @param buf A pointer to an iio_buffer structure
+ * @param chn A pointer to the I or the Q channel of the pair
+ * @param dst A pointer to the memory area where the complex samples will be
+ * stored, as I0, Q0, I1, Q1, ...
+ * @param offset The index of the first sample to read
+ * @param nb_samples The maximum number of complex samples to read
+ * @return On success, the number of complex samples stored
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only channels stored on 16 bits are supported. The samples
+ * are converted to host format, like with iio_channel_read. */
+__api __check_ret ssize_t iio_buffer_read_complex_int16(
+		const struct iio_buffer *buf, const struct iio_channel *chn,
+		int16_t *dst, size_t offset, size_t nb_samples);
+
+
+/** @brief Read the samples of a I/Q channel pair as interleaved complex
+ * single-precision floats
+ * @param buf A pointer to an iio_buffer structure
+ * @param chn A pointer to the I or the Q channel of the pair
+ * @param dst A pointer to the memory area where the complex samples will be
+ * stored, as I0, Q0, I1, Q1, ...
+ * @param offset The index of the first sample to read
+ * @param nb_samples The maximum number of complex samples to read
+ * @return On success, the number of complex samples stored
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> The values are processed like with iio_channel_read_float. */
+__api __check_ret ssize_t iio_buffer_read_complex_cf32(
+		const struct iio_buffer *buf, const struct iio_channel *chn,
+		float *dst, size_t offset, size_t nb_samples);
+
+
+/** @brief Write interleaved complex 16-bit integers to a I/Q channel pair
+ * @param buf A pointer to an iio_buffer structure
+ * @param chn A pointer to the I or the Q channel of the pair
+ * @param src A pointer to the complex samples, as I0, Q0, I1, Q1, ...
+ * @param offset The index of the first sample to write
+ * @param nb_samples The maximum number of complex samples to write
+ * @return On success, the number of complex samples written
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only channels stored on 16 bits are supported. The samples
+ * are converted to hardware format, like with iio_channel_write. */
+__api __check_ret ssize_t iio_buffer_write_complex_int16(
+		struct iio_buffer *buf, const struct iio_channel *chn,
+		const int16_t *src, size_t offset, size_t nb_samples);
+
+
+/** @brief Write interleaved complex single-precision floats to a I/Q channel
+ * pair
+ * @param buf A pointer to an iio_buffer structure
+ * @param chn A pointer to the I or the Q channel of the pair
+ * @param src A pointer to the complex samples, as I0, Q0, I1, Q1, ...
+ * @param offset The index of the first sample to write
+ * @param nb_samples The maximum number of complex samples to write
+ * @return On success, the number of complex samples written
+ * @return On error, a negative errno code is returned
+ *
+ * <b>NOTE:</b> Only channels stored on 16 bits are supported. The values
+ * are the inverse of the ones returned by iio_buffer_read_complex_cf32:
+ * the channel's scale and offset are removed, and the result is rounded and
+ * saturated to 16 bits. */
+__api __check_ret ssize_t iio_buffer_write_complex_cf32(
+		struct iio_buffer *buf, const struct iio_channel *chn,
+		const float *src, size_t offset, size_t nb_samples);
+
+
 /** @brief Associate a pointer to an iio_buffer structure
  * @param buf A pointer to an iio_buffer structure
  * @param data The pointer to be associated */
@@ -1622,6 +2965,9 @@ struct iio_data_format {
 
 	/** @brief Number of times length repeats (added in v0.8) */
 	unsigned int repeat;
+
+	/** @brief Offset to add to the raw value before scaling (added in v0.24) */
+	double offset;
 };
 
 
@@ -1667,6 +3013,34 @@ __api void iio_channel_convert_inverse(const struct iio_channel *chn,
 		void *dst, const void *src);
 
 
+/** @brief Convert a block of samples from hardware format to host format
+ * @param chn A pointer to an iio_channel structure
+ * @param dst A pointer to the destination buffer where the converted samples
+ * should be written
+ * @param src A pointer to the source buffer containing the samples
+ * @param nb_samples The number of samples to convert
+ *
+ * <b>NOTE:</b> The samples are expected to be contiguous in the source
+ * buffer. This function produces the same result as calling
+ * iio_channel_convert on each sample, but is much faster for the common
+ * 8, 16, 32 and 64-bit formats. */
+__api void iio_channel_convert_block(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples);
+
+
+/** @brief Convert a block of samples from host format to hardware format
+ * @param chn A pointer to an iio_channel structure
+ * @param dst A pointer to the destination buffer where the converted samples
+ * should be written
+ * @param src A pointer to the source buffer containing the samples
+ * @param nb_samples The number of samples to convert
+ *
+ * <b>NOTE:</b> The samples are stored contiguously in the destination
+ * buffer. */
+__api void iio_channel_convert_inverse_block(const struct iio_channel *chn,
+		void *dst, const void *src, size_t nb_samples);
+
+
 /** @brief Enumerate the debug attributes of the given device
  * @param dev A pointer to an iio_device structure
  * @return The number of debug attributes found */
@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#ifndef _IIOD_BINARY_H
+#define _IIOD_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Binary variant of the IIOD protocol, entered with the ASCII "BINARY"
+ * command. Each request and each response starts with a fixed-size header,
+ * encoded in little-endian, followed by 'len' bytes of payload. Responses
+ * carry the ID and opcode of the request they answer; 'code' is a negative
+ * error code, or a positive value whose meaning depends on the opcode.
+ *
+ * Devices and channels are designated by their index in the context and in
+ * the device, as found in the XML string of the context.
+ */
+
+#define IIOD_BIN_HDR_SIZE 16
+
+#define IIOD_BIN_NONE 0xffff
+
+enum iiod_bin_op {
+	IIOD_OP_EXIT = 0,
+	IIOD_OP_PRINT,
+	IIOD_OP_TIMEOUT,
+	IIOD_OP_OPEN,
+	IIOD_OP_CLOSE,
+	IIOD_OP_READ_ATTR,
+	IIOD_OP_WRITE_ATTR,
+	IIOD_OP_READBUF,
+	IIOD_OP_WRITEBUF,
+	IIOD_OP_GETTRIG,
+	IIOD_OP_SETTRIG,
+	IIOD_OP_TIMESTAMP,
+	IIOD_OP_SET_BUFFERS_COUNT,
+	IIOD_OP_VERSION,
+	IIOD_OP_MUX,
+	IIOD_OP_PUBLISH,
+	IIOD_OP_BATCH,
+	IIOD_OP_DECIMATE,
+	IIOD_OP_WINDOW,
+	IIOD_OP_STATS,
+	IIOD_OP_SET_LOW_LATENCY,
+
+	IIOD_OP_NB,
+};
+
+/* Flags of the 'type' field */
+#define IIOD_BIN_CYCLIC		(1 << 0) /* OPEN request */
+#define IIOD_BIN_HAS_MASK	(1 << 0) /* READBUF response */
+#define IIOD_BIN_ZSTD		(1 << 1) /* READBUF request and response */
+#define IIOD_BIN_DELTA		(1 << 2) /* READBUF response */
+#define IIOD_BIN_OVERRUN	(1 << 3) /* READBUF response */
+#define IIOD_BIN_BATCH_STOP	(1 << 0) /* BATCH request */
+
+/* Maximum length of the payload of a request, except for WRITEBUF whose
+ * samples are not buffered */
+#define IIOD_BIN_MAX_PAYLOAD	(16 * 1024 * 1024)
+
+/*
+ * Layout of the requests:
+ * - TIMEOUT, SET_BUFFERS_COUNT, DECIMATE: the value is in 'code';
+ * - OPEN: 'code' is the number of samples, the payload is the channel mask,
+ *   as 32-bit words;
+ * - READ_ATTR: 'type' is the attribute type (enum iio_attr_type), 'chn' set
+ *   for channel attributes, and the payload is the attribute name, or
+ *   nothing to read all the attributes;
+ * - WRITE_ATTR: same as READ_ATTR, with the payload being the attribute name
+ *   followed by the value; 'code' is the length of the name;
+ * - READBUF: 'code' is the number of bytes to read. The data comes as a
+ *   series of responses, 'code' being the number of bytes of samples; the
+ *   first one also carries the channel mask in front of the samples. With
+ *   IIOD_BIN_ZSTD, the client accepts compressed responses, which have the
+ *   samples as a zstd frame; with IIOD_BIN_DELTA, each byte of the samples
+ *   was replaced with its difference to the byte 'chn' bytes before, see
+ *   iiod_bin_delta_encode(). IIOD_BIN_OVERRUN tells
+ *   that IIOD dropped samples before this response, as the client did not
+ *   keep up with the device;
+ * - WRITEBUF: the payload is the samples;
+ * - SETTRIG: the payload is the name of the trigger, or nothing to
+ *   disassociate the trigger;
+ * - PUBLISH: the payload is the address of a multicast group and the UDP
+ *   port, as "group:port"; 'code' is the TTL of the datagrams, or 0 for the
+ *   default. See below;
+ * - BATCH: the payload is a series of READ_ATTR and WRITE_ATTR requests,
+ *   each one with its header, which IIOD runs in order. With
+ *   IIOD_BIN_BATCH_STOP, it stops at the first one that fails. The response
+ *   has the number of requests run in 'code', and their responses, each one
+ *   with its header, in the payload;
+ * - WINDOW: 'type' is the condition (enum iio_window_edge), 'chn' the
+ *   channel it applies to, and the payload has the numbers of samples
+ *   before and after the trigger, as 32-bit words, then the level, as a
+ *   64-bit word.
+ *
+ * PRINT, READ_ATTR and GETTRIG answer with the string in the payload,
+ * TIMESTAMP with the 64-bit timestamp. VERSION answers with the major and
+ * minor numbers in the upper and lower halves of 'code', and the git tag in
+ * the payload. MUX answers like the ASCII "MUX" command, see below. STATS
+ * answers with the statistics of IIOD as text in the payload, in the format
+ * of Prometheus, and their length in 'code'.
+ */
+struct iiod_bin_hdr {
+	uint16_t id;
+	uint8_t op;
+	uint8_t type;
+	uint16_t dev;
+	uint16_t chn;
+	int32_t code;
+	uint32_t len;
+};
+
+static inline void iiod_bin_put_le16(uint8_t *buf, uint16_t val)
+{
+	buf[0] = (uint8_t) val;
+	buf[1] = (uint8_t) (val >> 8);
+}
+
+static inline void iiod_bin_put_le32(uint8_t *buf, uint32_t val)
+{
+	iiod_bin_put_le16(buf, (uint16_t) val);
+	iiod_bin_put_le16(buf + 2, (uint16_t) (val >> 16));
+}
+
+static inline uint16_t iiod_bin_get_le16(const uint8_t *buf)
+{
+	return (uint16_t) (buf[0] | (buf[1] << 8));
+}
+
+static inline uint32_t iiod_bin_get_le32(const uint8_t *buf)
+{
+	return (uint32_t) iiod_bin_get_le16(buf) |
+		((uint32_t) iiod_bin_get_le16(buf + 2) << 16);
+}
+
+static inline void iiod_bin_pack(uint8_t *buf, const struct iiod_bin_hdr *hdr)
+{
+	iiod_bin_put_le16(buf, hdr->id);
+	buf[2] = hdr->op;
+	buf[3] = hdr->type;
+	iiod_bin_put_le16(buf + 4, hdr->dev);
+	iiod_bin_put_le16(buf + 6, hdr->chn);
+	iiod_bin_put_le32(buf + 8, (uint32_t) hdr->code);
+	iiod_bin_put_le32(buf + 12, hdr->len);
+}
+
+static inline void iiod_bin_unpack(struct iiod_bin_hdr *hdr, const uint8_t *buf)
+{
+	hdr->id = iiod_bin_get_le16(buf);
+	hdr->op = buf[2];
+	hdr->type = buf[3];
+	hdr->dev = iiod_bin_get_le16(buf + 4);
+	hdr->chn = iiod_bin_get_le16(buf + 6);
+	hdr->code = (int32_t) iiod_bin_get_le32(buf + 8);
+	hdr->len = iiod_bin_get_le32(buf + 12);
+}
+
+/*
+ * Prefilter for the compression of samples: slowly varying samples, 'stride'
+ * bytes long, give mostly zeros. 'dst' and 'src' must not overlap.
+ */
+static inline void iiod_bin_delta_encode(uint8_t *dst, const uint8_t *src,
+					 size_t len, size_t stride)
+{
+	size_t i;
+
+	for (i = 0; i < len && i < stride; i++)
+		dst[i] = src[i];
+	for (; i < len; i++)
+		dst[i] = (uint8_t) (src[i] - src[i - stride]);
+}
+
+static inline void iiod_bin_delta_decode(uint8_t *buf, size_t len,
+					 size_t stride)
+{
+	size_t i;
+
+	for (i = stride; i < len; i++)
+		buf[i] = (uint8_t) (buf[i] + buf[i - stride]);
+}
+
+/*
+ * Multiplexed connections, entered with the ASCII "MUX" command or the MUX
+ * request of the binary protocol. Past the response, the connection carries
+ * frames, each one made of a header followed by 'len' bytes of the byte
+ * stream of one channel. Each channel behaves as a connection of its own: it
+ * starts in text mode, and IIOD runs one session per channel. The channel of
+ * the session that sent "MUX" is channel 0, which stays in the mode it was
+ * in; the first frame sent to another channel creates it.
+ *
+ * A frame with the IIOD_MUX_CLOSE flag ends the stream of its channel, in
+ * either direction; IIOD sends one once the session of the channel ended,
+ * after which the channel number can be reused.
+ */
+
+#define IIOD_MUX_HDR_SIZE 8
+#define IIOD_MUX_MAX_CHANNELS 64
+
+#define IIOD_MUX_CLOSE (1 << 0)
+
+struct iiod_mux_hdr {
+	uint16_t chan;
+	uint16_t flags;
+	uint32_t len;
+};
+
+static inline void iiod_mux_pack(uint8_t *buf, const struct iiod_mux_hdr *hdr)
+{
+	iiod_bin_put_le16(buf, hdr->chan);
+	iiod_bin_put_le16(buf + 2, hdr->flags);
+	iiod_bin_put_le32(buf + 4, hdr->len);
+}
+
+static inline void iiod_mux_unpack(struct iiod_mux_hdr *hdr, const uint8_t *buf)
+{
+	hdr->chan = iiod_bin_get_le16(buf);
+	hdr->flags = iiod_bin_get_le16(buf + 2);
+	hdr->len = iiod_bin_get_le32(buf + 4);
+}
+
+/*
+ * Multicast streaming, started with the PUBLISH request on a device opened
+ * for reading. IIOD then refills the buffer of the device continuously, and
+ * sends each block once to the multicast group, whatever the number of
+ * subscribers, until the device is closed. READBUF is refused meanwhile.
+ *
+ * A block is split into datagrams of at most IIOD_MCAST_MAX_DGRAM bytes, each
+ * one made of a header, the channel mask as 'nb_words' 32-bit words, and the
+ * samples found at 'offset' in the block. 'seq' is incremented with each
+ * datagram, and 'block' with each block, so that subscribers can detect the
+ * datagrams lost and drop the incomplete blocks.
+ */
+
+#define IIOD_MCAST_MAGIC 0x4d4f4949 /* "IIOM" */
+#define IIOD_MCAST_HDR_SIZE 24
+#define IIOD_MCAST_MAX_DGRAM 1472 /* Fits in an Ethernet frame */
+
+struct iiod_mcast_hdr {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t block;
+	uint32_t offset;
+	uint32_t block_len;
+	uint16_t nb_words;
+	uint16_t reserved;
+};
+
+static inline void iiod_mcast_pack(uint8_t *buf,
+				   const struct iiod_mcast_hdr *hdr)
+{
+	iiod_bin_put_le32(buf, hdr->magic);
+	iiod_bin_put_le32(buf + 4, hdr->seq);
+	iiod_bin_put_le32(buf + 8, hdr->block);
+	iiod_bin_put_le32(buf + 12, hdr->offset);
+	iiod_bin_put_le32(buf + 16, hdr->block_len);
+	iiod_bin_put_le16(buf + 20, hdr->nb_words);
+	iiod_bin_put_le16(buf + 22, hdr->reserved);
+}
+
+static inline void iiod_mcast_unpack(struct iiod_mcast_hdr *hdr,
+				     const uint8_t *buf)
+{
+	hdr->magic = iiod_bin_get_le32(buf);
+	hdr->seq = iiod_bin_get_le32(buf + 4);
+	hdr->block = iiod_bin_get_le32(buf + 8);
+	hdr->offset = iiod_bin_get_le32(buf + 12);
+	hdr->block_len = iiod_bin_get_le32(buf + 16);
+	hdr->nb_words = iiod_bin_get_le16(buf + 20);
+	hdr->reserved = iiod_bin_get_le16(buf + 22);
+}
+
+#endif /* _IIOD_BINARY_H */
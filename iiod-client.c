@@ -7,6 +7,7 @@
  */
 
 #include "debug.h"
+#include "iiod-binary.h"
 #include "iiod-client.h"
 #include "iio-config.h"
 #include "iio-lock.h"
@@ -20,10 +21,43 @@
 #include <zstd.h>
 #endif
 
+struct iiod_cache_entry {
+	const struct iio_device *dev;
+	const struct iio_channel *chn;
+	enum iio_attr_type type;
+	char *name, *value;
+	size_t len;
+
+	/* Time of expiry in milliseconds, or 0 if the entry never expires */
+	uint64_t expires;
+
+	struct iiod_cache_entry *next;
+};
+
+struct iiod_cache_rule {
+	char *name;
+	int ttl_ms;
+	struct iiod_cache_rule *next;
+};
+
 struct iiod_client {
 	struct iio_context_pdata *pdata;
 	const struct iiod_client_ops *ops;
 	struct iio_mutex *lock;
+
+	/* Set once IIOD refused the binary protocol */
+	bool no_binary;
+
+	/* Attribute cache, disabled while cache_ttl is 0 */
+	struct iio_mutex *cache_lock;
+	struct iiod_cache_entry *cache;
+	struct iiod_cache_rule *cache_rules;
+	unsigned int cache_ttl;
+
+#if WITH_PERF_COUNTERS
+	/* Counters of the context, once created */
+	const struct iio_op_stats *stats;
+#endif
 };
 
 void iiod_client_mutex_lock(struct iiod_client *client)
@@ -36,6 +70,71 @@ void iiod_client_mutex_unlock(struct iiod_client *client)
 	iio_mutex_unlock(client->lock);
 }
 
+/* Connections with a lock of their own can be used concurrently with the
+ * other ones; the others share the lock of the client. The serial backend
+ * has no connection structure, and always uses the lock of the client. */
+static struct iio_mutex * iiod_client_get_lock(struct iiod_client *client,
+					       struct iiod_client_pdata *desc)
+{
+	struct iiod_client_conn *conn = (struct iiod_client_conn *) desc;
+
+	return conn && conn->lock ? conn->lock : client->lock;
+}
+
+static void iiod_client_lock(struct iiod_client *client,
+			     struct iiod_client_pdata *desc)
+{
+	uint64_t start = iio_stats_start();
+
+	iio_mutex_lock(iiod_client_get_lock(client, desc));
+	iio_stats_record(client->stats, IIO_STATS_CLIENT_LOCK, start, 0);
+}
+
+static void iiod_client_unlock(struct iiod_client *client,
+			       struct iiod_client_pdata *desc)
+{
+	iio_mutex_unlock(iiod_client_get_lock(client, desc));
+}
+
+static ssize_t iiod_client_write(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const char *src, size_t len)
+{
+	uint64_t start = iio_stats_start();
+	ssize_t ret;
+
+	ret = client->ops->write(client->pdata, desc, src, len);
+	iio_stats_record(client->stats, IIO_STATS_CLIENT_WRITE, start, ret);
+
+	return ret;
+}
+
+static ssize_t iiod_client_read(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				char *dst, size_t len)
+{
+	uint64_t start = iio_stats_start();
+	ssize_t ret;
+
+	ret = client->ops->read(client->pdata, desc, dst, len);
+	iio_stats_record(client->stats, IIO_STATS_CLIENT_READ, start, ret);
+
+	return ret;
+}
+
+static ssize_t iiod_client_read_line(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     char *dst, size_t len)
+{
+	uint64_t start = iio_stats_start();
+	ssize_t ret;
+
+	ret = client->ops->read_line(client->pdata, desc, dst, len);
+	iio_stats_record(client->stats, IIO_STATS_CLIENT_READ, start, ret);
+
+	return ret;
+}
+
 static ssize_t iiod_client_read_integer(struct iiod_client *client,
 					struct iiod_client_pdata *desc,
 					int *val)
@@ -46,8 +145,7 @@ static ssize_t iiod_client_read_integer(struct iiod_client *client,
 	int value;
 
 	do {
-		ret = client->ops->read_line(client->pdata,
-				desc, buf, sizeof(buf));
+		ret = iiod_client_read_line(client, desc, buf, sizeof(buf));
 		if (ret < 0) {
 			IIO_ERROR("READ LINE: %zd\n", ret);
 			return ret;
@@ -81,7 +179,7 @@ static int iiod_client_exec_command(struct iiod_client *client,
 	int resp;
 	ssize_t ret;
 
-	ret = client->ops->write(client->pdata, desc, cmd, strlen(cmd));
+	ret = iiod_client_write(client, desc, cmd, strlen(cmd));
 	if (ret < 0)
 		return (int) ret;
 
@@ -93,12 +191,11 @@ static ssize_t iiod_client_write_all(struct iiod_client *client,
 				     struct iiod_client_pdata *desc,
 				     const void *src, size_t len)
 {
-	struct iio_context_pdata *pdata = client->pdata;
-	const struct iiod_client_ops *ops = client->ops;
 	uintptr_t ptr = (uintptr_t) src;
 
 	while (len) {
-		ssize_t ret = ops->write(pdata, desc, (const void *) ptr, len);
+		ssize_t ret = iiod_client_write(client, desc,
+						(const char *) ptr, len);
 
 		if (ret < 0) {
 			if (ret == -EINTR)
@@ -121,12 +218,10 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 				    struct iiod_client_pdata *desc,
 				    void *dst, size_t len)
 {
-	struct iio_context_pdata *pdata = client->pdata;
-	const struct iiod_client_ops *ops = client->ops;
 	uintptr_t ptr = (uintptr_t) dst;
 
 	while (len) {
-		ssize_t ret = ops->read(pdata, desc, (void *) ptr, len);
+		ssize_t ret = iiod_client_read(client, desc, (char *) ptr, len);
 
 		if (ret < 0) {
 			if (ret == -EINTR)
@@ -145,12 +240,167 @@ static ssize_t iiod_client_read_all(struct iiod_client *client,
 	return (ssize_t) (ptr - (uintptr_t) dst);
 }
 
+static int iiod_client_discard(struct iiod_client *client,
+			       struct iiod_client_pdata *desc,
+			       char *buf, size_t buf_len, size_t to_discard)
+{
+	do {
+		size_t read_len;
+		ssize_t ret;
+
+		if (to_discard > buf_len)
+			read_len = buf_len;
+		else
+			read_len = to_discard;
+
+		ret = iiod_client_read_all(client, desc, buf, read_len);
+		if (ret < 0)
+			return (int) ret;
+
+		to_discard -= (size_t) ret;
+	} while (to_discard);
+
+	return 0;
+}
+static struct iiod_client_conn * iiod_client_get_conn(
+		struct iiod_client_pdata *desc)
+{
+	/* The iiod_client_pdata structures of the backends start with it */
+	return (struct iiod_client_conn *) desc;
+}
+
+static bool iiod_client_is_binary(struct iiod_client_pdata *desc)
+{
+	return desc && iiod_client_get_conn(desc)->binary;
+}
+
+static uint16_t iiod_client_dev_index(const struct iio_device *dev)
+{
+	const struct iio_context *ctx = dev->ctx;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices; i++)
+		if (ctx->devices[i] == dev)
+			return (uint16_t) i;
+
+	return IIOD_BIN_NONE;
+}
+
+static uint16_t iiod_client_chn_index(const struct iio_channel *chn)
+{
+	const struct iio_device *dev = chn->dev;
+	unsigned int i;
+
+	for (i = 0; i < dev->nb_channels; i++)
+		if (dev->channels[i] == chn)
+			return (uint16_t) i;
+
+	return IIOD_BIN_NONE;
+}
+
+static void iiod_client_bin_init(struct iiod_client_pdata *desc,
+				 struct iiod_bin_hdr *hdr, enum iiod_bin_op op,
+				 const struct iio_device *dev,
+				 const struct iio_channel *chn)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->id = iiod_client_get_conn(desc)->next_id++;
+	hdr->op = (uint8_t) op;
+	hdr->dev = dev ? iiod_client_dev_index(dev) : IIOD_BIN_NONE;
+	hdr->chn = chn ? iiod_client_chn_index(chn) : IIOD_BIN_NONE;
+}
+
+/* Send a request, whose payload is the concatenation of two buffers */
+static int iiod_client_bin_send(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				struct iiod_bin_hdr *hdr,
+				const void *src1, size_t len1,
+				const void *src2, size_t len2)
+{
+	uint8_t buf[IIOD_BIN_HDR_SIZE];
+	ssize_t ret;
+
+	hdr->len = (uint32_t) (len1 + len2);
+	iiod_bin_pack(buf, hdr);
+
+	ret = iiod_client_write_all(client, desc, buf, sizeof(buf));
+	if (ret >= 0 && len1)
+		ret = iiod_client_write_all(client, desc, src1, len1);
+	if (ret >= 0 && len2)
+		ret = iiod_client_write_all(client, desc, src2, len2);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+static int iiod_client_bin_recv(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				const struct iiod_bin_hdr *req,
+				struct iiod_bin_hdr *resp)
+{
+	uint8_t buf[IIOD_BIN_HDR_SIZE];
+	ssize_t ret;
+
+	ret = iiod_client_read_all(client, desc, buf, sizeof(buf));
+	if (ret < 0)
+		return (int) ret;
+
+	iiod_bin_unpack(resp, buf);
+
+	if (resp->id != req->id || resp->op != req->op) {
+		IIO_ERROR("Unexpected response to request %u\n", req->id);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Send a request, and receive the response. Its payload, if any, is stored
+ * into 'dst'; it is an error if it does not fit. Returns the code of the
+ * response.
+ */
+static int iiod_client_bin_exec(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				struct iiod_bin_hdr *hdr,
+				const void *src1, size_t len1,
+				const void *src2, size_t len2,
+				void *dst, size_t *dst_len)
+{
+	struct iiod_bin_hdr resp;
+	char tmp[256];
+	size_t max_len = dst_len ? *dst_len : 0;
+	int ret;
+
+	ret = iiod_client_bin_send(client, desc, hdr, src1, len1, src2, len2);
+	if (ret < 0)
+		return ret;
+
+	ret = iiod_client_bin_recv(client, desc, hdr, &resp);
+	if (ret < 0)
+		return ret;
+
+	if (resp.len > max_len) {
+		ret = iiod_client_discard(client, desc, tmp, sizeof(tmp), resp.len);
+		return ret < 0 ? ret : -EIO;
+	}
+
+	if (resp.len) {
+		ret = (int) iiod_client_read_all(client, desc, dst, resp.len);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (dst_len)
+		*dst_len = resp.len;
+	return (int) resp.code;
+}
+
 struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 				     const struct iiod_client_ops *ops)
 {
 	struct iiod_client *client;
 
-	client = malloc(sizeof(*client));
+	client = zalloc(sizeof(*client));
 	if (!client) {
 		errno = ENOMEM;
 		return NULL;
@@ -162,42 +412,300 @@ struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 		goto err_free_client;
 	}
 
+	client->cache_lock = iio_mutex_create();
+	if (!client->cache_lock) {
+		errno = ENOMEM;
+		goto err_free_lock;
+	}
+
 	client->pdata = pdata;
 	client->ops = ops;
 	return client;
 
+err_free_lock:
+	iio_mutex_destroy(client->lock);
 err_free_client:
 	free(client);
 	return NULL;
 }
 
+static void iiod_client_cache_free(struct iiod_cache_entry *entry)
+{
+	free(entry->name);
+	free(entry->value);
+	free(entry);
+}
+
+static struct iiod_cache_entry **
+iiod_client_cache_find(struct iiod_client *client,
+		       const struct iio_device *dev,
+		       const struct iio_channel *chn,
+		       const char *attr, enum iio_attr_type type)
+{
+	struct iiod_cache_entry **ptr, *entry;
+
+	for (ptr = &client->cache; *ptr; ptr = &entry->next) {
+		entry = *ptr;
+
+		if (entry->dev == dev && entry->chn == chn
+		    && entry->type == type && !strcmp(entry->name, attr))
+			break;
+	}
+
+	return ptr;
+}
+
+static void iiod_client_cache_unlink(struct iiod_cache_entry **ptr)
+{
+	struct iiod_cache_entry *entry = *ptr;
+
+	*ptr = entry->next;
+	iiod_client_cache_free(entry);
+}
+
+/* Remove the entries of the device 'dev' named 'name', each one being a
+ * wildcard when NULL; with 'keep_static', the entries that never expire are
+ * kept. Must be called with cache_lock held. */
+static void iiod_client_cache_remove(struct iiod_client *client,
+				     const struct iio_device *dev,
+				     const char *name, bool keep_static)
+{
+	struct iiod_cache_entry **ptr = &client->cache, *entry;
+
+	while (*ptr) {
+		entry = *ptr;
+
+		if ((dev && entry->dev != dev)
+		    || (name && strcmp(entry->name, name))
+		    || (keep_static && !entry->expires))
+			ptr = &entry->next;
+		else
+			iiod_client_cache_unlink(ptr);
+	}
+}
+
 void iiod_client_destroy(struct iiod_client *client)
 {
+	struct iiod_cache_rule *rule, *next;
+
+	iiod_client_cache_remove(client, NULL, NULL, false);
+
+	for (rule = client->cache_rules; rule; rule = next) {
+		next = rule->next;
+		free(rule->name);
+		free(rule);
+	}
+
+	iio_mutex_destroy(client->cache_lock);
 	iio_mutex_destroy(client->lock);
 	free(client);
 }
 
+/* Returns the TTL of the attribute 'name' in milliseconds, 0 if it must not
+ * be cached, or -1 if it never expires. Must be called with cache_lock held. */
+static int iiod_client_cache_ttl(const struct iiod_client *client,
+				 const char *name)
+{
+	const struct iiod_cache_rule *rule;
+	size_t len = strlen(name);
+
+	if (!client->cache_ttl)
+		return 0;
+
+	for (rule = client->cache_rules; rule; rule = rule->next)
+		if (!strcmp(rule->name, name))
+			return rule->ttl_ms;
+
+	/* The lists of available values are fixed by the drivers */
+	if (len >= sizeof("_available") - 1 &&
+	    !strcmp(name + len - (sizeof("_available") - 1), "_available"))
+		return -1;
+
+	return (int) client->cache_ttl;
+}
+
+int iiod_client_set_attr_cache(struct iiod_client *client,
+			       const char *attr, int ttl_ms)
+{
+	struct iiod_cache_rule *rule;
+	int ret = 0;
+
+	if (!attr && ttl_ms < 0)
+		return -EINVAL;
+
+	iio_mutex_lock(client->cache_lock);
+
+	if (!attr) {
+		client->cache_ttl = (unsigned int) ttl_ms;
+		iiod_client_cache_remove(client, NULL, NULL, false);
+		goto out_unlock;
+	}
+
+	for (rule = client->cache_rules; rule; rule = rule->next)
+		if (!strcmp(rule->name, attr))
+			break;
+
+	if (!rule) {
+		rule = zalloc(sizeof(*rule));
+		if (!rule) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+
+		rule->name = iio_strdup(attr);
+		if (!rule->name) {
+			free(rule);
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+
+		rule->next = client->cache_rules;
+		client->cache_rules = rule;
+	}
+
+	rule->ttl_ms = ttl_ms;
+	iiod_client_cache_remove(client, NULL, attr, false);
+
+out_unlock:
+	iio_mutex_unlock(client->cache_lock);
+	return ret;
+}
+
+void iiod_client_invalidate_attr(struct iiod_client *client,
+				 const struct iio_device *dev,
+				 const struct iio_channel *chn,
+				 const char *attr, enum iio_attr_type type)
+{
+	struct iiod_cache_entry **ptr;
+
+	iio_mutex_lock(client->cache_lock);
+
+	/* The attribute itself is dropped, and as writing an attribute often
+	 * changes others, so are the values of the device that may change */
+	if (attr) {
+		ptr = iiod_client_cache_find(client, dev, chn, attr, type);
+		if (*ptr)
+			iiod_client_cache_unlink(ptr);
+	}
+
+	iiod_client_cache_remove(client, dev, NULL, !!attr);
+
+	iio_mutex_unlock(client->cache_lock);
+}
+
+static ssize_t iiod_client_cache_lookup(struct iiod_client *client,
+					const struct iio_device *dev,
+					const struct iio_channel *chn,
+					const char *attr, char *dest,
+					size_t len, enum iio_attr_type type)
+{
+	struct iiod_cache_entry **ptr, *entry;
+	ssize_t ret = -ENOENT;
+
+	iio_mutex_lock(client->cache_lock);
+
+	ptr = iiod_client_cache_find(client, dev, chn, attr, type);
+	entry = *ptr;
+
+	if (entry && entry->expires && entry->expires <= iio_time_ms()) {
+		iiod_client_cache_unlink(ptr);
+	} else if (entry && entry->len < len) {
+		memcpy(dest, entry->value, entry->len + 1);
+		ret = (ssize_t) entry->len;
+	}
+
+	iio_mutex_unlock(client->cache_lock);
+	return ret;
+}
+
+static void iiod_client_cache_store(struct iiod_client *client,
+				    const struct iio_device *dev,
+				    const struct iio_channel *chn,
+				    const char *attr, const char *value,
+				    size_t len, enum iio_attr_type type)
+{
+	struct iiod_cache_entry **ptr, *entry;
+	int ttl;
+
+	iio_mutex_lock(client->cache_lock);
+
+	ttl = iiod_client_cache_ttl(client, attr);
+	if (!ttl)
+		goto out_unlock;
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry)
+		goto out_unlock;
+
+	entry->name = iio_strdup(attr);
+	entry->value = malloc(len + 1);
+	if (!entry->name || !entry->value) {
+		iiod_client_cache_free(entry);
+		goto out_unlock;
+	}
+
+	memcpy(entry->value, value, len);
+	entry->value[len] = '\0';
+	entry->len = len;
+	entry->dev = dev;
+	entry->chn = chn;
+	entry->type = type;
+	if (ttl > 0)
+		entry->expires = iio_time_ms() + (uint64_t) ttl;
+
+	ptr = iiod_client_cache_find(client, dev, chn, attr, type);
+	if (*ptr)
+		iiod_client_cache_unlink(ptr);
+
+	entry->next = client->cache;
+	client->cache = entry;
+
+out_unlock:
+	iio_mutex_unlock(client->cache_lock);
+}
+
 int iiod_client_get_version(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    unsigned int *major, unsigned int *minor,
 			    char *git_tag)
 {
-	struct iio_context_pdata *pdata = client->pdata;
-	const struct iiod_client_ops *ops = client->ops;
 	char buf[256], *ptr = buf, *end;
 	long maj, min;
 	int ret;
 
-	iio_mutex_lock(client->lock);
+	iiod_client_lock(client, desc);
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		size_t tag_len = sizeof(buf) - 1;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_VERSION, NULL, NULL);
+		ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					   NULL, 0, buf, &tag_len);
+		iiod_client_unlock(client, desc);
+
+		if (ret < 0)
+			return ret;
+
+		buf[tag_len] = '\0';
+		if (major)
+			*major = (unsigned int) ret >> 16;
+		if (minor)
+			*minor = (unsigned int) ret & 0xffff;
+		if (git_tag)
+			iio_strlcpy(git_tag, buf, 8);
+		return 0;
+	}
 
-	ret = (int) ops->write(pdata, desc, "VERSION\r\n", sizeof("VERSION\r\n") - 1);
+	ret = (int) iiod_client_write(client, desc, "VERSION\r\n",
+				      sizeof("VERSION\r\n") - 1);
 	if (ret < 0) {
-		iio_mutex_unlock(client->lock);
+		iiod_client_unlock(client, desc);
 		return ret;
 	}
 
-	ret = (int) ops->read_line(pdata, desc, buf, sizeof(buf));
-	iio_mutex_unlock(client->lock);
+	ret = (int) iiod_client_read_line(client, desc, buf, sizeof(buf));
+	iiod_client_unlock(client, desc);
 
 	if (ret < 0)
 		return ret;
@@ -229,21 +737,238 @@ int iiod_client_get_version(struct iiod_client *client,
 	return 0;
 }
 
+int iiod_client_enable_binary(struct iiod_client *client,
+			      struct iiod_client_pdata *desc)
+{
+	int ret;
+
+	if (!desc)
+		return -ENOSYS;
+
+	iiod_client_lock(client, desc);
+
+	if (iiod_client_get_conn(desc)->binary) {
+		ret = 0;
+		goto out_unlock;
+	}
+
+	if (client->no_binary) {
+		ret = -ENOSYS;
+		goto out_unlock;
+	}
+
+	ret = iiod_client_exec_command(client, desc, "BINARY\r\n");
+	if (ret == -EINVAL) {
+		/* Older IIOD: keep using the text protocol */
+		client->no_binary = true;
+		ret = -ENOSYS;
+	} else if (!ret) {
+		iiod_client_get_conn(desc)->binary = true;
+		iiod_client_get_conn(desc)->next_id = 0;
+	}
+
+out_unlock:
+	iiod_client_unlock(client, desc);
+	return ret;
+}
+
+/* Past a successful return, the connection of 'desc' carries frames; see
+ * iiod-binary.h */
+int iiod_client_enable_mux_unlocked(struct iiod_client *client,
+				    struct iiod_client_pdata *desc)
+{
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_MUX, NULL, NULL);
+		return iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					    NULL, 0, NULL, NULL);
+	}
+
+	return iiod_client_exec_command(client, desc, "MUX\r\n");
+}
+
+/* Have IIOD send the blocks of 'dev' to the multicast group 'addr', given as
+ * "group:port"; see iiod-binary.h */
+int iiod_client_publish_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 const char *addr, unsigned int ttl)
+{
+	struct iiod_bin_hdr hdr;
+
+	if (!iiod_client_is_binary(desc))
+		return -ENOSYS;
+
+	iiod_client_bin_init(desc, &hdr, IIOD_OP_PUBLISH, dev, NULL);
+	hdr.code = (int32_t) ttl;
+
+	return iiod_client_bin_exec(client, desc, &hdr, addr, strlen(addr),
+				    NULL, 0, NULL, NULL);
+}
+
+int iiod_client_set_decimation_unlocked(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					const struct iio_device *dev,
+					unsigned int factor)
+{
+	char buf[1024];
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_DECIMATE, dev, NULL);
+		hdr.code = (int32_t) factor;
+
+		return iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					    NULL, 0, NULL, NULL);
+	}
+
+	iio_snprintf(buf, sizeof(buf), "DECIMATE %s %u\r\n",
+			iio_device_get_id(dev), factor);
+
+	return iiod_client_exec_command(client, desc, buf);
+}
+
+int iiod_client_set_capture_window_unlocked(struct iiod_client *client,
+					    struct iiod_client_pdata *desc,
+					    const struct iio_device *dev,
+					    const struct iio_channel *chn,
+					    enum iio_window_edge edge,
+					    long long level, unsigned int pre,
+					    unsigned int post)
+{
+	static const char * const edges[] = {
+		[IIO_WINDOW_OFF] = "OFF",
+		[IIO_WINDOW_RISING] = "RISING",
+		[IIO_WINDOW_FALLING] = "FALLING",
+		[IIO_WINDOW_ABOVE] = "ABOVE",
+		[IIO_WINDOW_BELOW] = "BELOW",
+	};
+	char buf[1024];
+
+	if ((unsigned int) edge >= ARRAY_SIZE(edges))
+		return -EINVAL;
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		uint8_t payload[16];
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_WINDOW, dev,
+				     edge != IIO_WINDOW_OFF ? chn : NULL);
+		hdr.type = (uint8_t) edge;
+
+		iiod_bin_put_le32(payload, pre);
+		iiod_bin_put_le32(payload + 4, post);
+		iiod_bin_put_le32(payload + 8, (uint32_t) level);
+		iiod_bin_put_le32(payload + 12,
+				  (uint32_t) ((unsigned long long) level >> 32));
+
+		return iiod_client_bin_exec(client, desc, &hdr, payload,
+					    sizeof(payload), NULL, 0,
+					    NULL, NULL);
+	}
+
+	if (edge == IIO_WINDOW_OFF)
+		iio_snprintf(buf, sizeof(buf), "WINDOW %s OFF\r\n",
+			     iio_device_get_id(dev));
+	else
+		iio_snprintf(buf, sizeof(buf), "WINDOW %s %s %s %lld %u %u\r\n",
+			     iio_device_get_id(dev), iio_channel_get_id(chn),
+			     edges[edge], level, pre, post);
+
+	return iiod_client_exec_command(client, desc, buf);
+}
+
+int iiod_client_exit_unlocked(struct iiod_client *client,
+			      struct iiod_client_pdata *desc)
+{
+	static const char cmd[] = "\r\nEXIT\r\n";
+	ssize_t ret;
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		/* No response is sent to an EXIT request */
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_EXIT, NULL, NULL);
+		return iiod_client_bin_send(client, desc, &hdr,
+					    NULL, 0, NULL, 0);
+	}
+
+	ret = iiod_client_write_all(client, desc, cmd, sizeof(cmd) - 1);
+	return ret < 0 ? (int) ret : 0;
+}
+
+static int iiod_client_find_trigger(const struct iio_device *dev,
+				    const char *name, size_t name_len,
+				    const struct iio_device **trigger)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	unsigned int i, nb_devices = iio_context_get_devices_count(ctx);
+
+	for (i = 0; i < nb_devices; i++) {
+		struct iio_device *cur = iio_context_get_device(ctx, i);
+
+		if (iio_device_is_trigger(cur)) {
+			const char *cur_name = iio_device_get_name(cur);
+
+			if (!cur_name)
+				continue;
+
+			if (!strncmp(cur_name, name, name_len)) {
+				*trigger = cur;
+				return 0;
+			}
+		}
+	}
+
+	return -ENXIO;
+}
+
+static int iiod_client_bin_get_trigger(struct iiod_client *client,
+				       struct iiod_client_pdata *desc,
+				       const struct iio_device *dev,
+				       const struct iio_device **trigger)
+{
+	struct iiod_bin_hdr hdr;
+	char buf[1024];
+	size_t name_len = sizeof(buf);
+	int ret;
+
+	iiod_client_bin_init(desc, &hdr, IIOD_OP_GETTRIG, dev, NULL);
+
+	ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0, NULL, 0,
+				   buf, &name_len);
+	if (ret < 0)
+		return ret;
+
+	if (!name_len) {
+		*trigger = NULL;
+		return 0;
+	}
+
+	return iiod_client_find_trigger(dev, buf, name_len, trigger);
+}
+
 int iiod_client_get_trigger(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    const struct iio_device *dev,
 			    const struct iio_device **trigger)
 {
-	const struct iio_context *ctx = iio_device_get_context(dev);
-	unsigned int i, nb_devices = iio_context_get_devices_count(ctx);
 	char buf[1024];
 	unsigned int name_len;
 	int ret;
 
+	iiod_client_lock(client, desc);
+
+	if (iiod_client_is_binary(desc)) {
+		ret = iiod_client_bin_get_trigger(client, desc, dev, trigger);
+		goto out_unlock;
+	}
+
 	iio_snprintf(buf, sizeof(buf), "GETTRIG %s\r\n",
 			iio_device_get_id(dev));
 
-	iio_mutex_lock(client->lock);
 	ret = iiod_client_exec_command(client, desc, buf);
 
 	if (ret == 0)
@@ -262,28 +987,57 @@ int iiod_client_get_trigger(struct iiod_client *client,
 	if (ret < 0)
 		goto out_unlock;
 
-	ret = -ENXIO;
+	ret = iiod_client_find_trigger(dev, buf, name_len, trigger);
 
-	for (i = 0; i < nb_devices; i++) {
-		struct iio_device *cur = iio_context_get_device(ctx, i);
+out_unlock:
+	iiod_client_unlock(client, desc);
+	return ret;
+}
 
-		if (iio_device_is_trigger(cur)) {
-			const char *name = iio_device_get_name(cur);
+int iiod_client_get_timestamp_unlocked(struct iiod_client *client,
+				       struct iiod_client_pdata *desc,
+				       const struct iio_device *dev,
+				       uint64_t *timestamp)
+{
+	char buf[32];
+	int ret;
 
-			if (!name)
-				continue;
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		uint8_t val[8];
+		size_t val_len = sizeof(val);
 
-			if (!strncmp(name, buf, name_len)) {
-				*trigger = cur;
-				ret = 0;
-				goto out_unlock;
-			}
-		}
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_TIMESTAMP, dev, NULL);
+
+		ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					   NULL, 0, val, &val_len);
+		if (ret < 0)
+			return ret;
+		if (val_len != sizeof(val))
+			return -EIO;
+
+		*timestamp = (uint64_t) iiod_bin_get_le32(val) |
+			((uint64_t) iiod_bin_get_le32(val + 4) << 32);
+		return 0;
 	}
 
-out_unlock:
-	iio_mutex_unlock(client->lock);
-	return ret;
+	iio_snprintf(buf, sizeof(buf), "TIMESTAMP %s\r\n",
+			iio_device_get_id(dev));
+
+	ret = iiod_client_exec_command(client, desc, buf);
+	if (ret < 0)
+		return ret;
+
+	if (!ret || (unsigned int) ret > sizeof(buf) - 1)
+		return -EIO;
+
+	ret = (int) iiod_client_read_all(client, desc, buf, ret + 1);
+	if (ret < 0)
+		return ret;
+
+	buf[ret - 1] = '\0';
+	*timestamp = (uint64_t) strtoull(buf, NULL, 10);
+	return 0;
 }
 
 int iiod_client_set_trigger(struct iiod_client *client,
@@ -294,6 +1048,18 @@ int iiod_client_set_trigger(struct iiod_client *client,
 	char buf[1024];
 	int ret;
 
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		const char *trig_id = trigger ? iio_device_get_id(trigger) : "";
+
+		iiod_client_lock(client, desc);
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_SETTRIG, dev, NULL);
+		ret = iiod_client_bin_exec(client, desc, &hdr, trig_id,
+					   strlen(trig_id), NULL, 0, NULL, NULL);
+		iiod_client_unlock(client, desc);
+		return ret;
+	}
+
 	if (trigger) {
 		iio_snprintf(buf, sizeof(buf), "SETTRIG %s %s\r\n",
 				iio_device_get_id(dev),
@@ -303,9 +1069,9 @@ int iiod_client_set_trigger(struct iiod_client *client,
 				iio_device_get_id(dev));
 	}
 
-	iio_mutex_lock(client->lock);
+	iiod_client_lock(client, desc);
 	ret = iiod_client_exec_command(client, desc, buf);
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
 	return ret;
 }
 
@@ -317,51 +1083,82 @@ int iiod_client_set_kernel_buffers_count(struct iiod_client *client,
 	int ret;
 	char buf[1024];
 
+	iiod_client_lock(client, desc);
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_SET_BUFFERS_COUNT,
+				     dev, NULL);
+		hdr.code = (int32_t) nb_blocks;
+		ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					   NULL, 0, NULL, NULL);
+		iiod_client_unlock(client, desc);
+		return ret;
+	}
+
 	iio_snprintf(buf, sizeof(buf), "SET %s BUFFERS_COUNT %u\r\n",
 			iio_device_get_id(dev), nb_blocks);
 
-	iio_mutex_lock(client->lock);
 	ret = iiod_client_exec_command(client, desc, buf);
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
 	return ret;
 }
 
-int iiod_client_set_timeout(struct iiod_client *client,
-			    struct iiod_client_pdata *desc,
-			    unsigned int timeout)
+int iiod_client_set_low_latency(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				const struct iio_device *dev, bool enable)
 {
 	int ret;
 	char buf[1024];
 
-	iio_snprintf(buf, sizeof(buf), "TIMEOUT %u\r\n", timeout);
+	iiod_client_lock(client, desc);
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_SET_LOW_LATENCY,
+				     dev, NULL);
+		hdr.code = (int32_t) enable;
+		ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					   NULL, 0, NULL, NULL);
+		iiod_client_unlock(client, desc);
+		return ret;
+	}
+
+	iio_snprintf(buf, sizeof(buf), "SET %s LOW_LATENCY %u\r\n",
+			iio_device_get_id(dev), (unsigned int) enable);
 
-	iio_mutex_lock(client->lock);
 	ret = iiod_client_exec_command(client, desc, buf);
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
 	return ret;
 }
 
-static int iiod_client_discard(struct iiod_client *client,
-			       struct iiod_client_pdata *desc,
-			       char *buf, size_t buf_len, size_t to_discard)
+int iiod_client_set_timeout(struct iiod_client *client,
+			    struct iiod_client_pdata *desc,
+			    unsigned int timeout)
 {
-	do {
-		size_t read_len;
-		ssize_t ret;
+	int ret;
+	char buf[1024];
 
-		if (to_discard > buf_len)
-			read_len = buf_len;
-		else
-			read_len = to_discard;
+	iiod_client_lock(client, desc);
 
-		ret = iiod_client_read_all(client, desc, buf, read_len);
-		if (ret < 0)
-			return (int) ret;
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
 
-		to_discard -= (size_t) ret;
-	} while (to_discard);
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_TIMEOUT, NULL, NULL);
+		hdr.code = (int32_t) timeout;
+		ret = iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					   NULL, 0, NULL, NULL);
+		iiod_client_unlock(client, desc);
+		return ret;
+	}
 
-	return 0;
+	iio_snprintf(buf, sizeof(buf), "TIMEOUT %u\r\n", timeout);
+
+	ret = iiod_client_exec_command(client, desc, buf);
+	iiod_client_unlock(client, desc);
+	return ret;
 }
 
 ssize_t iiod_client_read_attr(struct iiod_client *client,
@@ -399,6 +1196,38 @@ ssize_t iiod_client_read_attr(struct iiod_client *client,
 		}
 	}
 
+	if (attr && client->cache_ttl) {
+		ret = iiod_client_cache_lookup(client, dev, chn, attr,
+					       dest, len, type);
+		if (ret >= 0)
+			return ret;
+	}
+
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		size_t dst_len;
+
+		if (!len)
+			return -EINVAL;
+
+		dst_len = len - 1;
+		iiod_client_lock(client, desc);
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_READ_ATTR, dev, chn);
+		hdr.type = (uint8_t) type;
+
+		ret = iiod_client_bin_exec(client, desc, &hdr, attr,
+					   attr ? strlen(attr) : 0, NULL, 0,
+					   dest, &dst_len);
+		iiod_client_unlock(client, desc);
+
+		if (ret < 0)
+			return ret;
+
+		dest[dst_len] = '\0';
+		ret = (ssize_t) dst_len;
+		goto out_store;
+	}
+
 	if (chn) {
 		iio_snprintf(buf, sizeof(buf), "READ %s %s %s %s\r\n", id,
 				iio_channel_is_output(chn) ? "OUTPUT" : "INPUT",
@@ -420,7 +1249,7 @@ ssize_t iiod_client_read_attr(struct iiod_client *client,
 		}
 	}
 
-	iio_mutex_lock(client->lock);
+	iiod_client_lock(client, desc);
 
 	ret = (ssize_t) iiod_client_exec_command(client, desc, buf);
 	if (ret < 0)
@@ -443,8 +1272,19 @@ ssize_t iiod_client_read_attr(struct iiod_client *client,
 		dest[ret] = '\0';
 	}
 
+	iiod_client_unlock(client, desc);
+
+	if (ret < 0)
+		return ret;
+
+out_store:
+	if (attr && client->cache_ttl)
+		iiod_client_cache_store(client, dev, chn, attr, dest,
+					(size_t) ret, type);
+	return ret;
+
 out_unlock:
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
 	return ret;
 }
 
@@ -455,8 +1295,6 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 			       const char *attr, const char *src,
 			       size_t len, enum iio_attr_type type)
 {
-	struct iio_context_pdata *pdata = client->pdata;
-	const struct iiod_client_ops *ops = client->ops;
 	const char *id = iio_device_get_id(dev);
 	char buf[1024];
 	ssize_t ret;
@@ -486,6 +1324,21 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 		}
 	}
 
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		size_t name_len = attr ? strlen(attr) : 0;
+
+		iiod_client_lock(client, desc);
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_WRITE_ATTR, dev, chn);
+		hdr.type = (uint8_t) type;
+		hdr.code = (int32_t) name_len;
+
+		ret = iiod_client_bin_exec(client, desc, &hdr, attr, name_len,
+					   src, len, NULL, NULL);
+		iiod_client_unlock(client, desc);
+		goto out_invalidate;
+	}
+
 	if (chn) {
 		iio_snprintf(buf, sizeof(buf), "WRITE %s %s %s %s %lu\r\n", id,
 				iio_channel_is_output(chn) ? "OUTPUT" : "INPUT",
@@ -508,8 +1361,8 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 		}
 	}
 
-	iio_mutex_lock(client->lock);
-	ret = ops->write(pdata, desc, buf, strlen(buf));
+	iiod_client_lock(client, desc);
+	ret = iiod_client_write(client, desc, buf, strlen(buf));
 	if (ret < 0)
 		goto out_unlock;
 
@@ -524,7 +1377,173 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 	ret = (ssize_t) resp;
 
 out_unlock:
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
+out_invalidate:
+	/* Even a failed write may have changed the values */
+	if (client->cache_ttl)
+		iiod_client_invalidate_attr(client, dev, chn, attr, type);
+	return ret;
+}
+
+/* Size of the BATCH request of 'batch', and of its sub-requests */
+static size_t iiod_client_batch_len(const struct iio_attr_batch *batch)
+{
+	const struct iio_attr_batch_entry *entry;
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < batch->nb_entries; i++) {
+		entry = &batch->entries[i];
+		len += IIOD_BIN_HDR_SIZE + strlen(entry->attr);
+		if (entry->src)
+			len += strlen(entry->src) + 1;
+	}
+
+	return len;
+}
+
+static void iiod_client_batch_pack(const struct iio_attr_batch *batch,
+				   uint8_t *ptr)
+{
+	const struct iio_attr_batch_entry *entry;
+	struct iiod_bin_hdr hdr;
+	size_t name_len, val_len;
+	unsigned int i;
+
+	for (i = 0; i < batch->nb_entries; i++) {
+		entry = &batch->entries[i];
+		name_len = strlen(entry->attr);
+		val_len = entry->src ? strlen(entry->src) + 1 : 0;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.id = (uint16_t) i;
+		hdr.op = entry->src ? IIOD_OP_WRITE_ATTR : IIOD_OP_READ_ATTR;
+		hdr.type = IIO_ATTR_TYPE_DEVICE;
+		hdr.dev = iiod_client_dev_index(entry->dev);
+		hdr.chn = entry->chn ? iiod_client_chn_index(entry->chn)
+			: IIOD_BIN_NONE;
+		hdr.code = entry->src ? (int32_t) name_len : 0;
+		hdr.len = (uint32_t) (name_len + val_len);
+
+		iiod_bin_pack(ptr, &hdr);
+		ptr += IIOD_BIN_HDR_SIZE;
+
+		memcpy(ptr, entry->attr, name_len);
+		ptr += name_len;
+
+		if (val_len)
+			memcpy(ptr, entry->src, val_len);
+		ptr += val_len;
+	}
+}
+
+/* Receive the response to one access of a batch */
+static int iiod_client_batch_recv(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  struct iio_attr_batch_entry *entry,
+				  unsigned int id)
+{
+	uint8_t buf[IIOD_BIN_HDR_SIZE];
+	struct iiod_bin_hdr hdr;
+	char tmp[256];
+	ssize_t ret;
+
+	ret = iiod_client_read_all(client, desc, buf, sizeof(buf));
+	if (ret < 0)
+		return (int) ret;
+
+	iiod_bin_unpack(&hdr, buf);
+	if (hdr.id != id)
+		return -EIO;
+
+	if (!entry->src && hdr.code >= 0 && hdr.len < entry->len) {
+		ret = iiod_client_read_all(client, desc, entry->dst, hdr.len);
+		if (ret < 0)
+			return (int) ret;
+
+		entry->dst[hdr.len] = '\0';
+		entry->ret = (ssize_t) hdr.len;
+		return 0;
+	}
+
+	/* A value too large for the destination is an error, as with
+	 * iiod_client_read_attr() */
+	if (hdr.code < 0 || entry->src)
+		entry->ret = hdr.code;
+	else
+		entry->ret = -EIO;
+
+	return iiod_client_discard(client, desc, tmp, sizeof(tmp), hdr.len);
+}
+
+/* Perform all the accesses of 'batch' with one BATCH request; see
+ * iiod-binary.h */
+int iiod_client_attr_batch(struct iiod_client *client,
+			   struct iiod_client_pdata *desc,
+			   struct iio_attr_batch *batch, bool stop_on_error)
+{
+	struct iiod_bin_hdr hdr, resp;
+	size_t len = iiod_client_batch_len(batch);
+	unsigned int i;
+	uint8_t *req;
+	char tmp[256];
+	int ret;
+
+	if (!iiod_client_is_binary(desc))
+		return -ENOSYS;
+
+	req = malloc(len ? len : 1);
+	if (!req)
+		return -ENOMEM;
+
+	iiod_client_batch_pack(batch, req);
+
+	iiod_client_lock(client, desc);
+	iiod_client_bin_init(desc, &hdr, IIOD_OP_BATCH, NULL, NULL);
+	if (stop_on_error)
+		hdr.type = IIOD_BIN_BATCH_STOP;
+
+	ret = iiod_client_bin_send(client, desc, &hdr, req, len, NULL, 0);
+	free(req);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = iiod_client_bin_recv(client, desc, &hdr, &resp);
+	if (ret < 0)
+		goto out_unlock;
+
+	if (resp.code < 0 || (unsigned int) resp.code > batch->nb_entries) {
+		ret = iiod_client_discard(client, desc, tmp, sizeof(tmp),
+					  resp.len);
+		if (!ret)
+			ret = resp.code < 0 ? (int) resp.code : -EIO;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < batch->nb_entries; i++) {
+		if (i >= (unsigned int) resp.code) {
+			batch->entries[i].ret = -ECANCELED;
+			continue;
+		}
+
+		ret = iiod_client_batch_recv(client, desc,
+					     &batch->entries[i], i);
+		if (ret < 0)
+			break;
+	}
+
+out_unlock:
+	iiod_client_unlock(client, desc);
+
+	for (i = 0; client->cache_ttl && i < batch->nb_entries; i++) {
+		if (batch->entries[i].src)
+			iiod_client_invalidate_attr(client,
+						    batch->entries[i].dev,
+						    batch->entries[i].chn,
+						    batch->entries[i].attr,
+						    IIO_ATTR_TYPE_DEVICE);
+	}
+
 	return ret;
 }
 
@@ -538,13 +1557,13 @@ iiod_client_create_context_private(struct iiod_client *client,
 	char *xml;
 	int ret;
 
-	iio_mutex_lock(client->lock);
+	iiod_client_lock(client, desc);
 	ret = iiod_client_exec_command(client, desc, cmd);
 	if (ret < 0) {
 		if (ret == -EINVAL && zstd) {
 			/* If the ZPRINT command does not exist, try again
 			 * with the regular PRINT command. */
-			iio_mutex_unlock(client->lock);
+			iiod_client_unlock(client, desc);
 
 			return iiod_client_create_context_private(client, desc, false);
 		}
@@ -566,47 +1585,27 @@ iiod_client_create_context_private(struct iiod_client *client,
 
 #if WITH_ZSTD
 	if (zstd) {
-		unsigned long long len;
-		char *xml_zstd;
-
 		IIO_DEBUG("Received ZSTD-compressed XML string.\n");
 
-		len = ZSTD_getFrameContentSize(xml, xml_len);
-		if (len == ZSTD_CONTENTSIZE_UNKNOWN ||
-		    len == ZSTD_CONTENTSIZE_ERROR) {
-			ret = -EIO;
-			goto out_free_xml;
-		}
-
-		xml_zstd = malloc(len);
-		if (!xml_zstd) {
-			ret = -ENOMEM;
-			goto out_free_xml;
-		}
-
-		xml_len = ZSTD_decompress(xml_zstd, len, xml, xml_len);
-		if (ZSTD_isError(xml_len)) {
-			IIO_ERROR("Unable to decompress ZSTD data: %s\n",
-				  ZSTD_getErrorName(xml_len));
-			ret = -EIO;
-			free(xml_zstd);
-			goto out_free_xml;
-		}
-
-		/* Free compressed data, make "xml" point to uncompressed data */
-		free(xml);
-		xml = xml_zstd;
-	}
+		/* Parsed as it is uncompressed */
+		ctx = xml_create_context_zstd(xml, xml_len);
+	} else
 #endif
+	{
+		ctx = iio_create_xml_context_mem(xml, xml_len);
+	}
 
-	ctx = iio_create_xml_context_mem(xml, xml_len);
 	if (!ctx)
 		ret = -errno;
+#if WITH_PERF_COUNTERS
+	else
+		client->stats = ctx->stats;
+#endif
 
 out_free_xml:
 	free(xml);
 out_unlock:
-	iio_mutex_unlock(client->lock);
+	iiod_client_unlock(client, desc);
 	if (!ctx)
 		errno = -ret;
 	return ctx;
@@ -627,6 +1626,24 @@ int iiod_client_open_unlocked(struct iiod_client *client,
 	size_t i;
 	ssize_t len;
 
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+		uint8_t mask[sizeof(buf)];
+
+		if (dev->words * 4 > sizeof(mask))
+			return -ENOMEM;
+
+		for (i = 0; i < dev->words; i++)
+			iiod_bin_put_le32(&mask[i * 4], dev->mask[i]);
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_OPEN, dev, NULL);
+		hdr.code = (int32_t) samples_count;
+		hdr.type = cyclic ? IIOD_BIN_CYCLIC : 0;
+
+		return iiod_client_bin_exec(client, desc, &hdr, mask,
+					    dev->words * 4, NULL, 0, NULL, NULL);
+	}
+
 	len = sizeof(buf);
 	len -= iio_snprintf(buf, len, "OPEN %s %lu ",
 			iio_device_get_id(dev), (unsigned long) samples_count);
@@ -653,6 +1670,14 @@ int iiod_client_close_unlocked(struct iiod_client *client,
 {
 	char buf[1024];
 
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_CLOSE, dev, NULL);
+		return iiod_client_bin_exec(client, desc, &hdr, NULL, 0,
+					    NULL, 0, NULL, NULL);
+	}
+
 	iio_snprintf(buf, sizeof(buf), "CLOSE %s\r\n", iio_device_get_id(dev));
 	return iiod_client_exec_command(client, desc, buf);
 }
@@ -693,6 +1718,286 @@ out_buf_free:
 	return (int) ret;
 }
 
+/* Receive the response to a READBUF request. If 'dst' is NULL, the samples
+ * are discarded. Returns a negative error code if the connection is broken;
+ * otherwise 'result' receives the number of bytes read or the error code
+ * sent by the server. */
+/* Receive the zstd frame of a compressed READBUF response, and uncompress
+ * its 'len' bytes of samples into 'dst', or drop them if 'dst' is NULL */
+static int iiod_client_bin_read_zstd(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iiod_bin_hdr *resp,
+				     void *dst, size_t len, size_t zlen)
+{
+	char tmp[256];
+#if WITH_ZSTD
+	void *zbuf;
+	size_t ret;
+	int err;
+
+	if (!dst)
+		return iiod_client_discard(client, desc, tmp, sizeof(tmp), zlen);
+
+	zbuf = malloc(zlen);
+	if (!zbuf) {
+		err = iiod_client_discard(client, desc, tmp, sizeof(tmp), zlen);
+		return err < 0 ? err : -ENOMEM;
+	}
+
+	err = (int) iiod_client_read_all(client, desc, zbuf, zlen);
+	if (err >= 0) {
+		ret = ZSTD_decompress(dst, len, zbuf, zlen);
+		if (ZSTD_isError(ret) || ret != len) {
+			IIO_ERROR("Unable to decompress samples\n");
+			err = -EIO;
+		} else if (resp->type & IIOD_BIN_DELTA) {
+			if (resp->chn)
+				iiod_bin_delta_decode(dst, len, resp->chn);
+			else
+				err = -EIO;
+		}
+	}
+
+	free(zbuf);
+	return err < 0 ? err : 0;
+#else
+	/* Compressed responses are only sent if the client asked for them */
+	int ret = iiod_client_discard(client, desc, tmp, sizeof(tmp), zlen);
+
+	return ret < 0 ? ret : -EIO;
+#endif
+}
+
+static int iiod_client_bin_read_resp(struct iiod_client *client,
+				     struct iiod_client_pdata *desc,
+				     const struct iiod_bin_hdr *hdr,
+				     void *dst, size_t len,
+				     uint32_t *mask, size_t words,
+				     ssize_t *result)
+{
+	uintptr_t ptr = (uintptr_t) dst;
+	struct iiod_bin_hdr resp;
+	ssize_t ret, read = 0;
+	uint8_t word[4];
+	char tmp[256];
+	size_t i;
+
+	do {
+		size_t to_read, payload_len;
+
+		ret = iiod_client_bin_recv(client, desc, hdr, &resp);
+		if (ret < 0)
+			return (int) ret;
+		if (resp.code <= 0) {
+			/* Error, or end of a partial transfer. On error, the
+			 * data read so far is lost, as with READBUF. */
+			*result = resp.code ? (ssize_t) resp.code : read;
+			return iiod_client_discard(client, desc, tmp,
+						   sizeof(tmp), resp.len);
+		}
+
+		to_read = (size_t) resp.code;
+		payload_len = resp.len;
+
+		if (resp.type & IIOD_BIN_OVERRUN)
+			IIO_WARNING("IIOD dropped samples of device %u\n",
+				    resp.dev);
+
+		if (resp.type & IIOD_BIN_HAS_MASK) {
+			if (payload_len < words * 4)
+				return -EIO;
+
+			payload_len -= words * 4;
+
+			for (i = 0; i < words; i++) {
+				ret = iiod_client_read_all(client, desc,
+							   word, sizeof(word));
+				if (ret < 0)
+					return (int) ret;
+
+				if (mask)
+					mask[i] = iiod_bin_get_le32(word);
+			}
+
+			mask = NULL; /* We read the mask only once */
+		}
+
+		if (to_read > len)
+			return -EIO;
+
+		if (resp.type & IIOD_BIN_ZSTD)
+			ret = iiod_client_bin_read_zstd(client, desc, &resp,
+					dst ? (void *) ptr : NULL, to_read,
+					payload_len);
+		else if (payload_len != to_read)
+			return -EIO;
+		else if (dst)
+			ret = iiod_client_read_all(client, desc,
+						   (char *) ptr, to_read);
+		else
+			ret = iiod_client_discard(client, desc, tmp,
+						  sizeof(tmp), to_read);
+		if (ret < 0)
+			return (int) ret;
+
+		ptr += to_read;
+		read += to_read;
+		len -= to_read;
+	} while (len);
+
+	*result = read;
+	return 0;
+}
+
+static int iiod_client_bin_read_req(struct iiod_client *client,
+				    struct iiod_client_pdata *desc,
+				    const struct iio_device *dev,
+				    size_t len, struct iiod_bin_hdr *hdr)
+{
+	iiod_client_bin_init(desc, hdr, IIOD_OP_READBUF, dev, NULL);
+	hdr->code = (int32_t) len;
+
+	if (WITH_ZSTD && iiod_client_get_conn(desc)->compress)
+		hdr->type = IIOD_BIN_ZSTD;
+
+	return iiod_client_bin_send(client, desc, hdr, NULL, 0, NULL, 0);
+}
+
+static ssize_t iiod_client_bin_read(struct iiod_client *client,
+				    struct iiod_client_pdata *desc,
+				    const struct iio_device *dev,
+				    void *dst, size_t len,
+				    uint32_t *mask, size_t words)
+{
+	struct iiod_bin_hdr hdr;
+	ssize_t result;
+	int ret;
+
+	ret = iiod_client_bin_read_req(client, desc, dev, len, &hdr);
+	if (ret < 0)
+		return ret;
+
+	ret = iiod_client_bin_read_resp(client, desc, &hdr,
+					dst, len, mask, words, &result);
+	return ret < 0 ? ret : result;
+}
+
+int iiod_client_drain_unlocked(struct iiod_client *client,
+			       struct iiod_client_pdata *desc,
+			       size_t words)
+{
+	struct iiod_client_conn *conn = iiod_client_get_conn(desc);
+	struct iiod_bin_hdr hdr = { .op = IIOD_OP_READBUF };
+	ssize_t result;
+	int ret;
+
+	if (!desc)
+		return 0;
+
+	for (; conn->nb_pending; conn->nb_pending--) {
+		hdr.id = (uint16_t) (conn->next_id - conn->nb_pending);
+
+		ret = iiod_client_bin_read_resp(client, desc, &hdr, NULL,
+						conn->pending_len, NULL, words,
+						&result);
+		if (ret < 0) {
+			conn->nb_pending = 0;
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+int iiod_client_read_req_unlocked(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iio_device *dev, size_t len)
+{
+	struct iiod_client_conn *conn = iiod_client_get_conn(desc);
+	struct iiod_bin_hdr hdr;
+	int ret;
+
+	if (!iiod_client_is_binary(desc))
+		return -ENOSYS;
+
+	if (!len || (conn->nb_pending && conn->pending_len != len))
+		return -EINVAL;
+
+	/* Not compressed, so that the samples can be parsed as they arrive */
+	iiod_client_bin_init(desc, &hdr, IIOD_OP_READBUF, dev, NULL);
+	hdr.code = (int32_t) len;
+
+	ret = iiod_client_bin_send(client, desc, &hdr, NULL, 0, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	conn->nb_pending++;
+	conn->pending_len = len;
+	return 0;
+}
+
+void iiod_client_pack_write_req(struct iiod_client_pdata *desc,
+				const struct iio_device *dev,
+				size_t len, uint8_t *buf)
+{
+	struct iiod_bin_hdr hdr;
+
+	iiod_client_bin_init(desc, &hdr, IIOD_OP_WRITEBUF, dev, NULL);
+	hdr.len = (uint32_t) len;
+	iiod_bin_pack(buf, &hdr);
+}
+
+ssize_t iiod_client_read_ahead_unlocked(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					const struct iio_device *dev,
+					void *dst, size_t len,
+					uint32_t *mask, size_t words,
+					unsigned int nb_ahead)
+{
+	struct iiod_client_conn *conn = iiod_client_get_conn(desc);
+	struct iiod_bin_hdr hdr;
+	ssize_t result;
+	int ret;
+
+	if (!iiod_client_is_binary(desc))
+		return -ENOSYS;
+
+	if (!len || words != (iio_device_get_channels_count(dev) + 31) / 32)
+		return -EINVAL;
+
+	/* The requests sent ahead were for a different size */
+	if (conn->nb_pending && conn->pending_len != len) {
+		ret = iiod_client_drain_unlocked(client, desc, words);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* Keep the request for this call plus 'nb_ahead' other ones on the
+	 * wire, so that the server always has the next one queued */
+	while (conn->nb_pending <= nb_ahead) {
+		ret = iiod_client_bin_read_req(client, desc, dev, len, &hdr);
+		if (ret < 0)
+			return ret;
+
+		conn->nb_pending++;
+		conn->pending_len = len;
+	}
+
+	hdr.id = (uint16_t) (conn->next_id - conn->nb_pending);
+	hdr.op = IIOD_OP_READBUF;
+
+	ret = iiod_client_bin_read_resp(client, desc, &hdr,
+					dst, len, mask, words, &result);
+	if (ret < 0) {
+		/* The connection is broken; the other responses are lost */
+		conn->nb_pending = 0;
+		return ret;
+	}
+
+	conn->nb_pending--;
+	return result;
+}
+
 ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 				  struct iiod_client_pdata *desc,
 				  const struct iio_device *dev,
@@ -707,6 +2012,10 @@ ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 	if (!len || words != (nb_channels + 31) / 32)
 		return -EINVAL;
 
+	if (iiod_client_is_binary(desc))
+		return iiod_client_bin_read(client, desc, dev,
+					    dst, len, mask, words);
+
 	iio_snprintf(buf, sizeof(buf), "READBUF %s %lu\r\n",
 			iio_device_get_id(dev), (unsigned long) len);
 
@@ -760,6 +2069,15 @@ ssize_t iiod_client_write_unlocked(struct iiod_client *client,
 	char buf[1024];
 	int val;
 
+	if (iiod_client_is_binary(desc)) {
+		struct iiod_bin_hdr hdr;
+
+		iiod_client_bin_init(desc, &hdr, IIOD_OP_WRITEBUF, dev, NULL);
+		ret = iiod_client_bin_exec(client, desc, &hdr, src, len,
+					   NULL, 0, NULL, NULL);
+		return ret < 0 ? ret : (ssize_t) len;
+	}
+
 	iio_snprintf(buf, sizeof(buf), "WRITEBUF %s %lu\r\n",
 			dev->id, (unsigned long) len);
 
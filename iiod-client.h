@@ -16,6 +16,25 @@ struct iiod_client;
 struct iiod_client_pdata;
 struct iio_context_pdata;
 
+/* State of a connection to IIOD. The iiod_client_pdata structure of the
+ * backends must start with it. */
+struct iiod_client_conn {
+	/* The connection uses the binary protocol, see iiod-binary.h */
+	bool binary;
+	uint16_t next_id;
+
+	/* READBUF requests sent ahead, whose response was not read yet */
+	unsigned int nb_pending;
+	size_t pending_len;
+
+	/* Let IIOD compress the samples of the READBUF responses */
+	bool compress;
+
+	/* Serializes the requests of this connection only, if set; the
+	 * connections without one share the lock of the client */
+	struct iio_mutex *lock;
+};
+
 struct iiod_client_ops {
 	ssize_t (*write)(struct iio_context_pdata *pdata,
 			 struct iiod_client_pdata *desc,
@@ -35,6 +54,28 @@ struct iiod_client * iiod_client_new(struct iio_context_pdata *pdata,
 				     const struct iiod_client_ops *ops);
 void iiod_client_destroy(struct iiod_client *client);
 
+int iiod_client_enable_binary(struct iiod_client *client,
+			      struct iiod_client_pdata *desc);
+int iiod_client_enable_mux_unlocked(struct iiod_client *client,
+				    struct iiod_client_pdata *desc);
+int iiod_client_publish_unlocked(struct iiod_client *client,
+				 struct iiod_client_pdata *desc,
+				 const struct iio_device *dev,
+				 const char *addr, unsigned int ttl);
+int iiod_client_set_decimation_unlocked(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					const struct iio_device *dev,
+					unsigned int factor);
+int iiod_client_set_capture_window_unlocked(struct iiod_client *client,
+					    struct iiod_client_pdata *desc,
+					    const struct iio_device *dev,
+					    const struct iio_channel *chn,
+					    enum iio_window_edge edge,
+					    long long level, unsigned int pre,
+					    unsigned int post);
+int iiod_client_exit_unlocked(struct iiod_client *client,
+			      struct iiod_client_pdata *desc);
+
 int iiod_client_get_version(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    unsigned int *major, unsigned int *minor,
@@ -45,6 +86,11 @@ int iiod_client_get_trigger(struct iiod_client *client,
 			    const struct iio_device *dev,
 			    const struct iio_device **trigger);
 
+int iiod_client_get_timestamp_unlocked(struct iiod_client *client,
+				       struct iiod_client_pdata *desc,
+				       const struct iio_device *dev,
+				       uint64_t *timestamp);
+
 int iiod_client_set_trigger(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    const struct iio_device *dev,
@@ -55,6 +101,10 @@ int iiod_client_set_kernel_buffers_count(struct iiod_client *client,
 					 const struct iio_device *dev,
 					 unsigned int nb_blocks);
 
+int iiod_client_set_low_latency(struct iiod_client *client,
+				struct iiod_client_pdata *desc,
+				const struct iio_device *dev, bool enable);
+
 int iiod_client_set_timeout(struct iiod_client *client,
 			    struct iiod_client_pdata *desc,
 			    unsigned int timeout);
@@ -73,6 +123,17 @@ ssize_t iiod_client_write_attr(struct iiod_client *client,
 			       const char *attr, const char *src,
 			       size_t len, enum iio_attr_type type);
 
+int iiod_client_attr_batch(struct iiod_client *client,
+			   struct iiod_client_pdata *desc,
+			   struct iio_attr_batch *batch, bool stop_on_error);
+
+int iiod_client_set_attr_cache(struct iiod_client *client,
+			       const char *attr, int ttl_ms);
+void iiod_client_invalidate_attr(struct iiod_client *client,
+				 const struct iio_device *dev,
+				 const struct iio_channel *chn,
+				 const char *attr, enum iio_attr_type type);
+
 int iiod_client_open_unlocked(struct iiod_client *client,
 			      struct iiod_client_pdata *desc,
 			      const struct iio_device *dev,
@@ -87,6 +148,27 @@ ssize_t iiod_client_read_unlocked(struct iiod_client *client,
 				  const struct iio_device *dev,
 				  void *dst, size_t len,
 				  uint32_t *mask, size_t words);
+ssize_t iiod_client_read_ahead_unlocked(struct iiod_client *client,
+					struct iiod_client_pdata *desc,
+					const struct iio_device *dev,
+					void *dst, size_t len,
+					uint32_t *mask, size_t words,
+					unsigned int nb_ahead);
+int iiod_client_drain_unlocked(struct iiod_client *client,
+			       struct iiod_client_pdata *desc,
+			       size_t words);
+
+/* Send a READBUF request without waiting for its response, which is then
+ * received by iiod_client_read_ahead_unlocked() or parsed by the caller */
+int iiod_client_read_req_unlocked(struct iiod_client *client,
+				  struct iiod_client_pdata *desc,
+				  const struct iio_device *dev, size_t len);
+
+/* Build the header of a WRITEBUF request of 'len' bytes into 'buf', for
+ * callers sending the request and its samples at their own pace */
+void iiod_client_pack_write_req(struct iiod_client_pdata *desc,
+				const struct iio_device *dev,
+				size_t len, uint8_t *buf);
 
 ssize_t iiod_client_write_unlocked(struct iiod_client *client,
 				   struct iiod_client_pdata *desc,
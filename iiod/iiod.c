@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
@@ -24,6 +25,7 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -40,9 +42,39 @@ struct client_data {
 	struct iio_context *ctx;
 	const void *xml_zstd;
 	size_t xml_zstd_len;
+
+	/* Used when the clients are served by the workers */
+	LIST_ENTRY(client_data) entry;
+	struct parser_pdata *pdata;
+	int watch_fd;
+};
+
+/*
+ * With --workers, the idle clients wait in an epoll set instead of each one
+ * sleeping in its own thread. A worker serves a client once it sent a
+ * command, until none of its input is left to parse, then puts it back in
+ * the set. Only the threads streaming the samples of the devices opened by
+ * the clients run for their whole session.
+ */
+struct client_loop {
+	int epoll_fd;
+	struct thread_pool *pool;
+
+	/* All the clients, parked or being served; protected by 'lock' */
+	pthread_mutex_t lock;
+	LIST_HEAD(ClientHead, client_data) clients;
 };
 
 bool server_demux;
+bool server_zerocopy;
+unsigned int server_client_queue;
+enum slow_client_policy server_slow_client;
+
+/* Size of the send and receive buffers of the sockets, 0 for the default */
+static int sock_buf_size;
+
+/* Number of threads serving the network clients, 0 for one per client */
+static unsigned int nb_workers;
 
 struct thread_pool *main_thread_pool;
 
@@ -80,6 +112,17 @@ static const struct option options[] = {
 	  {"ffs", required_argument, 0, 'F'},
 	  {"nb-pipes", required_argument, 0, 'n'},
 	  {"serial", required_argument, 0, 's'},
+	  {"zerocopy", no_argument, 0, 'z'},
+	  {"sock-buf-size", required_argument, 0, 'b'},
+	  {"workers", required_argument, 0, 'w'},
+	  {"client-queue", required_argument, 0, 'q'},
+	  {"slow-client", required_argument, 0, 'P'},
+	  {"metrics-port", required_argument, 0, 'm'},
+	  {"data-cpus", required_argument, 0, 'A'},
+	  {"data-priority", required_argument, 0, 'R'},
+	  {"ctrl-cpus", required_argument, 0, 'c'},
+	  {"ctrl-priority", required_argument, 0, 'r'},
+	  {"uri", required_argument, 0, 'u'},
 	  {0, 0, 0, 0},
 };
 
@@ -93,8 +136,78 @@ static const char *options_descriptions[] = {
 	"Use the given FunctionFS mountpoint to serve over USB",
 	"Specify the number of USB pipes (ep couples) to use",
 	"Run " MY_NAME " on the specified UART.",
+	"Send the samples with MSG_ZEROCOPY, without copying them.",
+	"Set the size of the socket buffers, in bytes.",
+	"Serve the network clients with the given number of threads.",
+	"Queue up to the given number of blocks for each reading client.",
+	"What to do with a client whose queue is full: block, drop or disconnect.",
+	"Serve the statistics over HTTP on the given port, for Prometheus.",
+	"Run the threads streaming the samples on the given CPUs, e.g. \"1\" or \"0,2-3\".",
+	"Run the threads streaming the samples with SCHED_FIFO at the given priority.",
+	"Run the other threads on the given CPUs.",
+	"Run the other threads with SCHED_FIFO at the given priority.",
+	"Serve the context at the given URI instead of the local devices, e.g. \"synthetic:devices.xml\".",
 };
 
+/* Parses a list of CPUs, as "0,2-3" */
+static int parse_cpu_list(const char *str, cpu_set_t *set)
+{
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO(set);
+
+	do {
+		errno = 0;
+		first = strtoul(str, &end, 10);
+		if (end == str || errno == ERANGE)
+			return -EINVAL;
+
+		last = first;
+		if (*end == '-') {
+			str = end + 1;
+			last = strtoul(str, &end, 10);
+			if (end == str || errno == ERANGE || last < first)
+				return -EINVAL;
+		}
+
+		if (last >= CPU_SETSIZE)
+			return -EINVAL;
+
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+
+		str = end + 1;
+	} while (*end == ',');
+
+	return *end ? -EINVAL : 0;
+}
+
+static int parse_sched(enum thread_class cls, const char *cpus,
+		       const char *priority)
+{
+	cpu_set_t set;
+	long prio = 0;
+	char *end;
+	int ret;
+
+	if (cpus) {
+		ret = parse_cpu_list(cpus, &set);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (priority) {
+		errno = 0;
+		prio = strtol(priority, &end, 10);
+		if (priority == end || *end || errno == ERANGE ||
+		    prio < 1 || prio > INT_MAX)
+			return -EINVAL;
+	}
+
+	return thread_sched_set(cls, cpus ? &set : NULL, (int) prio);
+}
+
 static void usage(void)
 {
 	unsigned int i;
@@ -119,6 +232,181 @@ static void client_thd(struct thread_pool *pool, void *d)
 	free(cdata);
 }
 
+static void client_free(struct client_data *cdata)
+{
+	interpreter_free(cdata->pdata);
+
+	IIO_INFO("Client exited\n");
+	close(cdata->fd);
+	free(cdata);
+}
+
+/* Returns 0 once the client is back in the epoll set, or a negative error
+ * code, in which case the client must be freed */
+static int client_loop_park(struct client_loop *loop,
+		struct client_data *cdata)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+		.data.ptr = cdata,
+	};
+	int ret;
+
+	/* Past MUX, the session reads the pipe fed by the demux thread */
+	if (cdata->watch_fd != cdata->pdata->fd_in) {
+		if (cdata->watch_fd >= 0)
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL,
+				  cdata->watch_fd, NULL);
+
+		cdata->watch_fd = cdata->pdata->fd_in;
+		ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD,
+				cdata->watch_fd, &ev);
+	} else {
+		ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD,
+				cdata->watch_fd, &ev);
+	}
+
+	return ret ? -errno : 0;
+}
+
+static void client_worker_thd(struct thread_pool *pool, void *d)
+{
+	struct client_loop *loop = d;
+	struct client_data *cdata;
+	struct epoll_event ev;
+	char err_str[1024];
+	int ret;
+
+	while (true) {
+		ret = epoll_wait(loop->epoll_fd, &ev, 1, -1);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			iio_strerror(errno, err_str, sizeof(err_str));
+			IIO_ERROR("epoll_wait failed: %s\n", err_str);
+			break;
+		}
+
+		cdata = ev.data.ptr;
+		if (!cdata) /* STOP event */
+			break;
+
+		if (!interpreter_run(cdata->pdata, true)) {
+			ret = client_loop_park(loop, cdata);
+			if (!ret)
+				continue;
+
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to wait for client: %s\n", err_str);
+		}
+
+		pthread_mutex_lock(&loop->lock);
+		LIST_REMOVE(cdata, entry);
+		pthread_mutex_unlock(&loop->lock);
+
+		if (cdata->watch_fd != cdata->fd)
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL,
+				  cdata->watch_fd, NULL);
+		client_free(cdata);
+	}
+}
+
+static int client_loop_init(struct client_loop *loop)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = NULL,
+	};
+	unsigned int i;
+	int ret;
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd < 0)
+		return -errno;
+
+	loop->pool = thread_pool_new();
+	if (!loop->pool) {
+		ret = -errno;
+		goto err_close_epoll_fd;
+	}
+
+	/* Level-triggered, to wake up all the workers */
+	ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD,
+			thread_pool_get_poll_fd(loop->pool), &ev);
+	if (ret) {
+		ret = -errno;
+		goto err_destroy_pool;
+	}
+
+	pthread_mutex_init(&loop->lock, NULL);
+	LIST_INIT(&loop->clients);
+
+	for (i = 0; i < nb_workers; i++) {
+		ret = thread_pool_add_thread(loop->pool, client_worker_thd,
+					     loop, "net_worker_thd");
+		if (ret) {
+			ret = -ret;
+			goto err_stop_pool;
+		}
+	}
+
+	return 0;
+
+err_stop_pool:
+	thread_pool_stop_and_wait(loop->pool);
+	pthread_mutex_destroy(&loop->lock);
+err_destroy_pool:
+	thread_pool_destroy(loop->pool);
+err_close_epoll_fd:
+	close(loop->epoll_fd);
+	return ret;
+}
+
+static void client_loop_destroy(struct client_loop *loop)
+{
+	struct client_data *cdata;
+
+	thread_pool_stop_and_wait(loop->pool);
+
+	/* The workers are gone: the clients left are all parked */
+	while (!LIST_EMPTY(&loop->clients)) {
+		cdata = LIST_FIRST(&loop->clients);
+		LIST_REMOVE(cdata, entry);
+		client_free(cdata);
+	}
+
+	pthread_mutex_destroy(&loop->lock);
+	thread_pool_destroy(loop->pool);
+	close(loop->epoll_fd);
+}
+
+static int client_loop_add(struct client_loop *loop, struct client_data *cdata)
+{
+	int ret;
+
+	cdata->pdata = interpreter_new(cdata->ctx, cdata->fd, cdata->fd,
+				       cdata->debug, true, false, false,
+				       main_thread_pool, cdata->xml_zstd,
+				       cdata->xml_zstd_len);
+	if (!cdata->pdata)
+		return -ENOMEM;
+
+	cdata->watch_fd = -1;
+
+	pthread_mutex_lock(&loop->lock);
+	LIST_INSERT_HEAD(&loop->clients, cdata, entry);
+
+	ret = client_loop_park(loop, cdata);
+	if (ret)
+		LIST_REMOVE(cdata, entry);
+	pthread_mutex_unlock(&loop->lock);
+
+	if (ret)
+		interpreter_free(cdata->pdata);
+
+	return ret;
+}
+
 static void set_handler(int signal, void (*handler)(int))
 {
 	struct sigaction sig;
@@ -172,6 +460,7 @@ static int main_server(struct iio_context *ctx, bool debug,
 	    keepalive_time = 10,
 	    keepalive_intvl = 10,
 	    keepalive_probes = 6;
+	struct client_loop loop;
 	struct pollfd pfd[2];
 	char err_str[1024];
 	bool ipv6;
@@ -198,6 +487,23 @@ static int main_server(struct iio_context *ctx, bool debug,
 		IIO_WARNING("setsockopt SO_REUSEADDR : %s\n", err_str);
 	}
 
+	/* Set on the listening socket, so that the accepted sockets inherit
+	 * the sizes, and the TCP window scale is chosen accordingly */
+	if (sock_buf_size) {
+		ret = setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sock_buf_size,
+				sizeof(sock_buf_size));
+		if (ret < 0) {
+			iio_strerror(errno, err_str, sizeof(err_str));
+			IIO_WARNING("setsockopt SO_SNDBUF : %s\n", err_str);
+		}
+		ret = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sock_buf_size,
+				sizeof(sock_buf_size));
+		if (ret < 0) {
+			iio_strerror(errno, err_str, sizeof(err_str));
+			IIO_WARNING("setsockopt SO_RCVBUF : %s\n", err_str);
+		}
+	}
+
 #ifdef HAVE_IPV6
 	if (ipv6)
 		ret = bind(fd, (struct sockaddr *) &sockaddr6,
@@ -220,6 +526,15 @@ static int main_server(struct iio_context *ctx, bool debug,
 		goto err_close_socket;
 	}
 
+	if (nb_workers) {
+		ret = client_loop_init(&loop);
+		if (ret) {
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to start the workers: %s\n", err_str);
+			goto err_close_socket;
+		}
+	}
+
 	if (HAVE_AVAHI)
 		start_avahi(main_thread_pool);
 
@@ -300,6 +615,18 @@ static int main_server(struct iio_context *ctx, bool debug,
 		IIO_INFO("New client connected from %s\n",
 				inet_ntoa(caddr.sin_addr));
 
+		if (nb_workers) {
+			ret = client_loop_add(&loop, cdata);
+			if (ret) {
+				iio_strerror(-ret, err_str, sizeof(err_str));
+				IIO_ERROR("Failed to add new client: %s\n",
+					err_str);
+				close(new);
+				free(cdata);
+			}
+			continue;
+		}
+
 		ret = thread_pool_add_thread(main_thread_pool, client_thd, cdata, "net_client_thd");
 		if (ret) {
 			iio_strerror(ret, err_str, sizeof(err_str));
@@ -313,6 +640,8 @@ static int main_server(struct iio_context *ctx, bool debug,
 	IIO_DEBUG("Cleaning up\n");
 	if (HAVE_AVAHI)
 		stop_avahi();
+	if (nb_workers)
+		client_loop_destroy(&loop);
 	close(fd);
 	return EXIT_SUCCESS;
 
@@ -353,18 +682,21 @@ static void *get_xml_zstd_data(const struct iio_context *ctx, size_t *out_len)
 int main(int argc, char **argv)
 {
 	bool debug = false, interactive = false, use_aio = false;
-	long nb_pipes = 3;
+	long nb_pipes = 3, metrics_port = 0;
 	char *end;
 	struct iio_context *ctx;
 	int c, option_index = 0;
 	char *ffs_mountpoint = NULL;
 	char *uart_params = NULL;
+	char *data_cpus = NULL, *data_prio = NULL;
+	char *ctrl_cpus = NULL, *ctrl_prio = NULL;
+	const char *uri = NULL;
 	char err_str[1024];
 	void *xml_zstd;
 	size_t xml_zstd_len = 0;
 	int ret;
 
-	while ((c = getopt_long(argc, argv, "+hVdDiaF:n:s:",
+	while ((c = getopt_long(argc, argv, "+hVdDiaF:n:s:zb:w:q:P:m:A:R:c:r:u:",
 					options, &option_index)) != -1) {
 		switch (c) {
 		case 'd':
@@ -414,6 +746,77 @@ int main(int argc, char **argv)
 
 			uart_params = optarg;
 			break;
+		case 'z':
+#ifdef HAS_SO_ZEROCOPY
+			server_zerocopy = true;
+			break;
+#else
+			IIO_ERROR("IIOD was not compiled with MSG_ZEROCOPY support.\n");
+			return EXIT_FAILURE;
+#endif
+		case 'b':
+			errno = 0;
+			sock_buf_size = (int) strtol(optarg, &end, 10);
+			if (optarg == end || *end || sock_buf_size < 1 ||
+			    errno == ERANGE) {
+				IIO_ERROR("--sock-buf-size: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'w':
+			errno = 0;
+			nb_workers = (unsigned int) strtoul(optarg, &end, 10);
+			if (optarg == end || *end || !nb_workers ||
+			    errno == ERANGE) {
+				IIO_ERROR("--workers: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'q':
+			errno = 0;
+			server_client_queue = (unsigned int) strtoul(optarg,
+								     &end, 10);
+			if (optarg == end || *end || errno == ERANGE) {
+				IIO_ERROR("--client-queue: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'P':
+			if (!strcmp(optarg, "block")) {
+				server_slow_client = SLOW_CLIENT_BLOCK;
+			} else if (!strcmp(optarg, "drop")) {
+				server_slow_client = SLOW_CLIENT_DROP;
+			} else if (!strcmp(optarg, "disconnect")) {
+				server_slow_client = SLOW_CLIENT_DISCONNECT;
+			} else {
+				IIO_ERROR("--slow-client: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'm':
+			errno = 0;
+			metrics_port = strtol(optarg, &end, 10);
+			if (optarg == end || *end || metrics_port < 1 ||
+			    metrics_port > UINT16_MAX || errno == ERANGE) {
+				IIO_ERROR("--metrics-port: Invalid parameter\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'A':
+			data_cpus = optarg;
+			break;
+		case 'R':
+			data_prio = optarg;
+			break;
+		case 'c':
+			ctrl_cpus = optarg;
+			break;
+		case 'r':
+			ctrl_prio = optarg;
+			break;
+		case 'u':
+			uri = optarg;
+			break;
 		case 'h':
 			usage();
 			return EXIT_SUCCESS;
@@ -426,10 +829,27 @@ int main(int argc, char **argv)
 		}
 	}
 
-	ctx = iio_create_local_context();
+	if (parse_sched(THREAD_DATA, data_cpus, data_prio) < 0) {
+		IIO_ERROR("--data-cpus/--data-priority: Invalid parameter\n");
+		return EXIT_FAILURE;
+	}
+
+	if (parse_sched(THREAD_CONTROL, ctrl_cpus, ctrl_prio) < 0) {
+		IIO_ERROR("--ctrl-cpus/--ctrl-priority: Invalid parameter\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The main thread accepts the clients */
+	thread_sched_apply(THREAD_CONTROL);
+
+	if (uri)
+		ctx = iio_create_context_from_uri(uri);
+	else
+		ctx = iio_create_local_context();
 	if (!ctx) {
 		iio_strerror(errno, err_str, sizeof(err_str));
-		IIO_ERROR("Unable to create local context: %s\n", err_str);
+		IIO_ERROR("Unable to create %s context: %s\n",
+			  uri ? uri : "local", err_str);
 		return EXIT_FAILURE;
 	}
 
@@ -474,6 +894,17 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (metrics_port) {
+		ret = start_metrics_server(ctx, (uint16_t) metrics_port,
+					   main_thread_pool);
+		if (ret) {
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to start metrics server: %s\n", err_str);
+			ret = EXIT_FAILURE;
+			goto out_destroy_thread_pool;
+		}
+	}
+
 	if (interactive)
 		ret = main_interactive(ctx, debug, use_aio, xml_zstd, xml_zstd_len);
 	else
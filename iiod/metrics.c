@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "../debug.h"
+#include "ops.h"
+#include "thread-pool.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*
+ * Minimal HTTP server, answering any GET request with the statistics of
+ * IIOD (see get_stats()), so that they can be scraped by Prometheus. The
+ * connections are served one at a time, by a single thread; a client which
+ * does not send its request within METRICS_TIMEOUT_MS is dropped.
+ */
+
+#define METRICS_TIMEOUT_MS 1000
+
+static const char metrics_header[] =
+	"HTTP/1.0 200 OK\r\n"
+	"Content-Type: text/plain; version=0.0.4\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+static const char metrics_bad_method[] =
+	"HTTP/1.0 405 Method Not Allowed\r\n"
+	"Allow: GET\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+struct metrics_pdata {
+	struct iio_context *ctx;
+	int fd;
+};
+
+static int metrics_send(int fd, const void *src, size_t len)
+{
+	const char *ptr = src;
+	ssize_t ret;
+
+	while (len) {
+		ret = send(fd, ptr, len, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		ptr += ret;
+		len -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+static void metrics_serve(struct iio_context *ctx, int fd)
+{
+	struct timeval timeout = {
+		.tv_sec = METRICS_TIMEOUT_MS / 1000,
+		.tv_usec = (METRICS_TIMEOUT_MS % 1000) * 1000,
+	};
+	char req[1024];
+	size_t len = 0;
+	ssize_t ret;
+	char *text;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	/* Read up to the end of the headers; the request itself is ignored,
+	 * but for its method */
+	while (len < sizeof(req) - 1) {
+		ret = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return;
+
+		len += (size_t) ret;
+		req[len] = '\0';
+
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+			break;
+	}
+
+	if (strncmp(req, "GET ", sizeof("GET ") - 1)) {
+		metrics_send(fd, metrics_bad_method,
+			     sizeof(metrics_bad_method) - 1);
+		return;
+	}
+
+	text = get_stats(ctx, &len);
+	if (!text) {
+		IIO_WARNING("Unable to allocate memory for the statistics\n");
+		return;
+	}
+
+	if (!metrics_send(fd, metrics_header, sizeof(metrics_header) - 1))
+		metrics_send(fd, text, len);
+
+	free(text);
+}
+
+static void metrics_main(struct thread_pool *pool, void *d)
+{
+	struct metrics_pdata *pdata = d;
+	struct pollfd pfd[2];
+	char err_str[1024];
+	int fd;
+
+	pfd[0].fd = pdata->fd;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	pfd[1].fd = thread_pool_get_poll_fd(pool);
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	while (true) {
+		poll_nointr(pfd, 2);
+
+		if (pfd[1].revents & POLLIN) /* STOP event */
+			break;
+
+		fd = accept4(pdata->fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			iio_strerror(errno, err_str, sizeof(err_str));
+			IIO_ERROR("Failed to accept metrics connection: %s\n",
+				  err_str);
+			continue;
+		}
+
+		metrics_serve(pdata->ctx, fd);
+		close(fd);
+	}
+
+	close(pdata->fd);
+	free(pdata);
+}
+
+int start_metrics_server(struct iio_context *ctx, uint16_t port,
+			 struct thread_pool *pool)
+{
+	struct sockaddr_in sockaddr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+		.sin_port = htons(port),
+	};
+	struct metrics_pdata *pdata;
+	int fd, yes = 1, err;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return -ENOMEM;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		err = -errno;
+		goto err_free_pdata;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	if (bind(fd, (struct sockaddr *) &sockaddr, sizeof(sockaddr)) < 0 ||
+	    listen(fd, 4) < 0) {
+		err = -errno;
+		goto err_close_socket;
+	}
+
+	pdata->ctx = ctx;
+	pdata->fd = fd;
+
+	IIO_DEBUG("Serving the metrics on port %u\n", port);
+
+	err = thread_pool_add_thread(pool, metrics_main,
+				     pdata, "iiod_metrics_thd");
+	if (err) {
+		/* pthread_create() errors are positive */
+		err = err < 0 ? err : -err;
+		goto err_close_socket;
+	}
+
+	return 0;
+
+err_close_socket:
+	close(fd);
+err_free_pdata:
+	free(pdata);
+	return err;
+}
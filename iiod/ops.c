@@ -11,22 +11,49 @@
 #include "thread-pool.h"
 #include "../debug.h"
 
+#include <arpa/inet.h>
+#include <endian.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <math.h>
+#include <netinet/in.h>
 #include <pthread.h>
 #include <poll.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <stdarg.h>
+
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAS_SO_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
 
 int yyparse(yyscan_t scanner);
 
 struct DevEntry;
 
 /* Corresponds to a thread reading from a device */
+/* A block of samples queued for a client */
+struct thd_slot {
+	void *data;
+	size_t size, len;
+	uint32_t *mask;
+	unsigned int sample_size;
+	uint64_t timestamp;
+	bool demux;
+};
+
 struct ThdEntry {
 	SLIST_ENTRY(ThdEntry) parser_list_entry;
 	SLIST_ENTRY(ThdEntry) dev_list_entry;
@@ -41,6 +68,61 @@ struct ThdEntry {
 
 	uint32_t *mask;
 	bool active, is_writer, new_client, wait_for_open;
+
+	/* Number of bytes transferred by the current READBUF/WRITEBUF */
+	unsigned int nb_xfer;
+
+	/* Timestamp of the block the last READBUF started with */
+	uint64_t timestamp;
+
+#if WITH_ZSTD
+	/* Compression of the READBUF responses, see send_compressed() */
+	ZSTD_CCtx *zctx;
+	void *zbuf;
+	size_t zbuf_size;
+#endif
+
+	/* Multicast publication of the blocks, see bin_publish() */
+	bool mcast;
+	int mcast_fd;
+	struct sockaddr_in mcast_addr;
+	uint32_t mcast_seq, mcast_block;
+
+	/* Samples of the client's channels, see demux_samples() */
+	void *demux_buf;
+	size_t demux_buf_size;
+
+	/* Decimation of the samples sent, see decimate_samples(). 'decim_phase'
+	 * is the position of the next input sample in the decimation period;
+	 * 'decim_history' has the last (decim_taps - 1) input samples of each
+	 * channel, by channel number. */
+	unsigned int decim, decim_taps, decim_phase;
+	float *decim_coeffs, *decim_history, *decim_work;
+	size_t decim_work_size;
+
+	/* Capture windows around the samples of 'win_chn' which meet the
+	 * condition, see window_samples(). 'win_hist' has the last
+	 * 'win_hist_len' samples, in the layout of the client; 'win_left' is
+	 * the number of samples of the current window not captured yet. */
+	enum iio_window_edge win_edge;
+	const struct iio_channel *win_chn;
+	int64_t win_level, win_prev;
+	bool win_has_prev;
+	size_t win_pre, win_post, win_left, win_hist_len;
+	void *win_hist, *win_buf;
+	size_t win_buf_size, win_len, *win_hits, win_hits_size;
+
+	/* Blocks refilled for the client and not sent yet, see
+	 * thd_queue_push(). The indexes are free-running counters. */
+	struct thd_slot *queue;
+	unsigned int queue_head, queue_tail;
+	struct thd_slot sending;
+	uint64_t nb_overruns;
+	bool overrun, kicked;
+
+	/* Statistics, see get_stats() */
+	uint64_t nb_bytes;
+	unsigned int max_lag;
 };
 
 static void thd_entry_event_signal(struct ThdEntry *thd)
@@ -66,13 +148,16 @@ static int thd_entry_event_wait(struct ThdEntry *thd, pthread_mutex_t *mutex,
 	pfd[0].events = POLLIN;
 	pfd[1].fd = fd_in;
 	pfd[1].events = POLLRDHUP;
+	pfd[1].revents = 0;
 	pfd[2].fd = thread_pool_get_poll_fd(thd->pdata->pool);
 	pfd[2].events = POLLIN;
 
 	do {
 		poll_nointr(pfd, 3);
 
-		if ((pfd[1].revents & POLLRDHUP) || (pfd[2].revents & POLLIN)) {
+		/* POLLHUP: the input is a pipe, see enable_mux() */
+		if ((pfd[1].revents & (POLLRDHUP | POLLHUP)) ||
+				(pfd[2].revents & POLLIN)) {
 			pthread_mutex_lock(mutex);
 			return -EPIPE;
 		}
@@ -109,6 +194,10 @@ struct DevEntry {
 
 	uint32_t *mask;
 	size_t nb_words;
+
+	/* Statistics, see get_stats() */
+	uint64_t nb_refills, refill_bytes, refill_us, max_refill_us;
+	uint64_t nb_pushes, push_bytes, push_us;
 };
 
 struct sample_cb_info {
@@ -117,10 +206,139 @@ struct sample_cb_info {
 	uint32_t *mask;
 };
 
+struct demux_cb_info {
+	/* NULL to only check the layout */
+	uint8_t *buf;
+	size_t sample_size, nb_samples, offset;
+	uint32_t *mask;
+
+	/* Set to copy from 'buf' to the buffer of the device */
+	bool mux;
+};
+
 /* Protects iio_device_{set,get}_data() from concurrent access from multiple
  * clients */
 static pthread_mutex_t devlist_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Statistics of the commands, shared by all the sessions, see get_stats().
+ * The commands are counted by opcode of the binary protocol; STATS_OTHER
+ * counts the commands of the text protocol which have none. Bucket 'i' of
+ * the histogram counts the commands which took at most 2^i microseconds,
+ * the last one all the others.
+ */
+#define STATS_OTHER IIOD_OP_NB
+#define STATS_NB_BUCKETS 22
+
+struct cmd_stats {
+	uint64_t count, sum_us;
+	uint64_t buckets[STATS_NB_BUCKETS];
+};
+
+static struct cmd_stats cmd_stats[STATS_OTHER + 1];
+static uint64_t nb_sessions, nb_sessions_total;
+
+/* By opcode; the names of the commands of the text protocol */
+static const char * const cmd_names[STATS_OTHER + 1] = {
+	[IIOD_OP_EXIT] = "EXIT",
+	[IIOD_OP_PRINT] = "PRINT",
+	[IIOD_OP_TIMEOUT] = "TIMEOUT",
+	[IIOD_OP_OPEN] = "OPEN",
+	[IIOD_OP_CLOSE] = "CLOSE",
+	[IIOD_OP_READ_ATTR] = "READ",
+	[IIOD_OP_WRITE_ATTR] = "WRITE",
+	[IIOD_OP_READBUF] = "READBUF",
+	[IIOD_OP_WRITEBUF] = "WRITEBUF",
+	[IIOD_OP_GETTRIG] = "GETTRIG",
+	[IIOD_OP_SETTRIG] = "SETTRIG",
+	[IIOD_OP_TIMESTAMP] = "TIMESTAMP",
+	[IIOD_OP_SET_BUFFERS_COUNT] = "SET",
+	[IIOD_OP_VERSION] = "VERSION",
+	[IIOD_OP_MUX] = "MUX",
+	[IIOD_OP_PUBLISH] = "PUBLISH",
+	[IIOD_OP_BATCH] = "BATCH",
+	[IIOD_OP_DECIMATE] = "DECIMATE",
+	[IIOD_OP_WINDOW] = "WINDOW",
+	[IIOD_OP_STATS] = "STATS",
+	[IIOD_OP_SET_LOW_LATENCY] = "LOW_LATENCY",
+	[STATS_OTHER] = "OTHER",
+};
+
+static inline void stats_add(uint64_t *ptr, uint64_t val)
+{
+	__atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stats_load(const uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+static uint64_t stats_elapsed_us(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t) ((now.tv_sec - start->tv_sec) * 1000000ll +
+			   (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+/* Called once the command 'cmd' was received */
+static void stats_begin(struct parser_pdata *pdata, unsigned int cmd)
+{
+	pdata->cmd = cmd <= STATS_OTHER ? cmd : STATS_OTHER;
+	pdata->cmd_pending = true;
+	clock_gettime(CLOCK_MONOTONIC, &pdata->cmd_start);
+}
+
+/* Called once a line of the text protocol was received */
+void stats_begin_line(struct parser_pdata *pdata,
+		const char *line, size_t len)
+{
+	unsigned int i;
+	size_t j;
+
+	for (j = 0; j < len; j++) {
+		if (line[j] == ' ' || line[j] == '\t' ||
+		    line[j] == '\r' || line[j] == '\n')
+			break;
+	}
+	len = j;
+
+	for (i = 0; i < STATS_OTHER; i++) {
+		if (strlen(cmd_names[i]) == len &&
+		    !strncasecmp(line, cmd_names[i], len))
+			break;
+	}
+
+	stats_begin(pdata, i);
+}
+
+/* Called once the command was processed */
+static void stats_end(struct parser_pdata *pdata)
+{
+	struct cmd_stats *stats = &cmd_stats[pdata->cmd];
+	unsigned int bucket = 0;
+	uint64_t us;
+
+	if (!pdata->cmd_pending)
+		return;
+
+	pdata->cmd_pending = false;
+	us = stats_elapsed_us(&pdata->cmd_start);
+
+	/* The smallest power of two not below the duration */
+	if (us > 1)
+		bucket = 64 - __builtin_clzll(us - 1);
+	if (bucket >= STATS_NB_BUCKETS)
+		bucket = STATS_NB_BUCKETS - 1;
+
+	stats_add(&stats->count, 1);
+	stats_add(&stats->sum_us, us);
+	stats_add(&stats->buckets[bucket], 1);
+}
+
 static unsigned int get_channel_number(const struct iio_channel *chn)
 {
 	const struct iio_device *dev = iio_channel_get_device(chn);
@@ -152,99 +370,327 @@ static inline const char *dev_label_or_name_or_id(const struct iio_device *dev)
 }
 
 #if WITH_AIO
-static ssize_t async_io(struct parser_pdata *pdata, void *buf, size_t len,
-	bool do_read)
+/* Largest request; bigger transfers are split */
+#define MAX_AIO_REQ_SIZE (1024 * 1024)
+
+static int aio_queue_init(struct aio_queue *q, int fd, bool is_write)
 {
-	ssize_t ret;
-	struct pollfd pfd[2];
-	unsigned int num_pfds;
-	struct iocb iocb;
-	struct iocb *ios[1];
-	struct io_event e[1];
+	char err_str[1024];
+	int ret;
+
+	q->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (q->eventfd < 0) {
+		ret = -errno;
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_ERROR("Failed to create AIO eventfd: %s\n", err_str);
+		return ret;
+	}
 
-	ios[0] = &iocb;
+	q->ctx = 0;
+	ret = io_setup(AIO_NB_SLOTS, &q->ctx);
+	if (ret < 0) {
+		iio_strerror(-ret, err_str, sizeof(err_str));
+		IIO_ERROR("Failed to create AIO context: %s\n", err_str);
+		close(q->eventfd);
+		return ret;
+	}
 
-	if (do_read)
-		io_prep_pread(&iocb, pdata->fd_in, buf, len, 0);
-	else
-		io_prep_pwrite(&iocb, pdata->fd_out, buf, len, 0);
+	q->fd = fd;
+	q->is_write = is_write;
+	pthread_mutex_init(&q->lock, NULL);
+	return 0;
+}
+
+static void aio_queue_destroy(struct aio_queue *q)
+{
+	unsigned int i;
+
+	pthread_mutex_destroy(&q->lock);
+	io_destroy(q->ctx);
+	close(q->eventfd);
+
+	for (i = 0; i < AIO_NB_SLOTS; i++)
+		free(q->slots[i].buf);
+}
 
-	io_set_eventfd(&iocb, pdata->aio_eventfd);
+static int aio_submit(struct aio_queue *q, struct aio_slot *slot, void *buf)
+{
+	struct iocb *ios[1] = { &slot->iocb };
+	void *ptr = (void *) ((uintptr_t) buf + slot->done);
+	size_t len = slot->len - slot->done;
+	int ret;
+
+	if (q->is_write)
+		io_prep_pwrite(&slot->iocb, q->fd, ptr, len, 0);
+	else
+		io_prep_pread(&slot->iocb, q->fd, ptr, len, 0);
 
-	pthread_mutex_lock(&pdata->aio_mutex);
+	io_set_eventfd(&slot->iocb, q->eventfd);
+	slot->iocb.data = slot;
 
-	ret = io_submit(pdata->aio_ctx, 1, ios);
+	ret = io_submit(q->ctx, 1, ios);
 	if (ret != 1) {
-		pthread_mutex_unlock(&pdata->aio_mutex);
-		IIO_ERROR("Failed to submit IO operation: %zd\n", ret);
+		IIO_ERROR("Failed to submit IO operation: %i\n", ret);
 		return -EIO;
 	}
 
-	pfd[0].fd = pdata->aio_eventfd;
+	slot->busy = true;
+	return 0;
+}
+
+static void aio_queue_cancel(struct aio_queue *q)
+{
+	struct io_event e;
+	unsigned int i;
+	int ret;
+
+	q->stopped = true;
+
+	for (i = 0; i < AIO_NB_SLOTS; i++) {
+		if (!q->slots[i].busy)
+			continue;
+
+		ret = io_cancel(q->ctx, &q->slots[i].iocb, &e);
+		if (ret != -EINPROGRESS && ret != -EINVAL)
+			IIO_ERROR("Failed to cancel IO transfer: %i\n", ret);
+	}
+}
+
+/* Handle the requests that completed; with 'wait', sleep until something
+ * completes. Callers loop until the slot they wait for is not busy anymore.
+ * Past a STOP event, the requests are cancelled and 'stopped' is set. */
+static int aio_queue_reap(struct parser_pdata *pdata, struct aio_queue *q,
+		bool wait)
+{
+	struct io_event e[AIO_NB_SLOTS];
+	struct aio_slot *slot;
+	struct pollfd pfd[2];
+	uint64_t event;
+	int i, ret;
+	long res;
+
+	pfd[0].fd = q->eventfd;
 	pfd[0].events = POLLIN;
-	pfd[0].revents = 0;
 	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
 	pfd[1].events = POLLIN;
-	pfd[1].revents = 0;
-	num_pfds = 2;
 
 	do {
-		poll_nointr(pfd, num_pfds);
-
-		if (pfd[0].revents & POLLIN) {
-			uint64_t event;
-			ret = read(pdata->aio_eventfd, &event, sizeof(event));
-			if (ret != sizeof(event)) {
-				IIO_ERROR("Failed to read from eventfd: %d\n", -errno);
-				ret = -EIO;
-				break;
-			}
+		pfd[0].revents = 0;
+		pfd[1].revents = 0;
 
-			ret = io_getevents(pdata->aio_ctx, 0, 1, e, NULL);
-			if (ret != 1) {
-				IIO_ERROR("Failed to read IO events: %zd\n", ret);
-				ret = -EIO;
-				break;
-			} else {
-				ret = (long)e[0].res;
-			}
-		} else if ((num_pfds > 1 && pfd[1].revents & POLLIN)) {
-			/* Got a STOP event to abort this whole session */
-			ret = io_cancel(pdata->aio_ctx, &iocb, e);
-			if (ret != -EINPROGRESS && ret != -EINVAL) {
-				IIO_ERROR("Failed to cancel IO transfer: %zd\n", ret);
-				ret = -EIO;
-				break;
-			}
-			/* It should not be long now until we get the cancellation event */
-			num_pfds = 1;
-		}
-	} while (!(pfd[0].revents & POLLIN));
+		ret = poll(pfd, q->stopped ? 1 : 2, wait ? -1 : 0);
+		if (ret < 0 && errno != EINTR)
+			return -errno;
 
-	pthread_mutex_unlock(&pdata->aio_mutex);
+		/* Got a STOP event to abort this whole session */
+		if (!q->stopped && (pfd[1].revents & POLLIN))
+			aio_queue_cancel(q);
+	} while (wait && !(pfd[0].revents & POLLIN));
 
-	/* Got STOP event, treat it as EOF */
-	if (num_pfds == 1)
+	if (!(pfd[0].revents & POLLIN))
 		return 0;
 
-	return ret;
-}
+	ret = read(q->eventfd, &event, sizeof(event));
+	if (ret != sizeof(event)) {
+		IIO_ERROR("Failed to read from eventfd: %d\n", -errno);
+		return -EIO;
+	}
 
-#define MAX_AIO_REQ_SIZE (1024 * 1024)
+	ret = io_getevents(q->ctx, 0, AIO_NB_SLOTS, e, NULL);
+	if (ret < 0) {
+		IIO_ERROR("Failed to read IO events: %i\n", ret);
+		return -EIO;
+	}
+
+	for (i = 0; i < ret; i++) {
+		slot = e[i].data;
+		res = (long) e[i].res;
+
+		if (q->is_write && !q->stopped && res > 0 &&
+		    slot->done + (size_t) res < slot->len) {
+			/* Short write: send the rest */
+			slot->done += (size_t) res;
+			if (!aio_submit(q, slot, slot->buf))
+				continue;
+			res = -EIO;
+		} else if (q->is_write && !res) {
+			res = -EPIPE;
+		}
+
+		slot->busy = false;
+		slot->res = res;
 
+		if (q->is_write && res < 0 && !q->err)
+			q->err = (int) res;
+	}
+
+	/* Release the write slots in order */
+	while (q->tail != q->head &&
+	       !q->slots[q->tail % AIO_NB_SLOTS].busy)
+		q->tail++;
+
+	return 0;
+}
+
+/*
+ * Big reads are split in requests of a multiple of the burst size, up to
+ * AIO_NB_SLOTS of them queued at once, so that the endpoint is never left
+ * without a request while the previous one is handed to the caller. The
+ * requests never ask for more than 'len' bytes altogether, as a request
+ * only completes once full or on a short packet; as they complete in
+ * order, the data following a short one is moved up.
+ */
 static ssize_t readfd_aio(struct parser_pdata *pdata, void *dest, size_t len)
 {
-	if (len > MAX_AIO_REQ_SIZE)
-		len = MAX_AIO_REQ_SIZE;
-	return async_io(pdata, dest, len, true);
+	struct aio_queue *q = &pdata->aio_rd;
+	void *ptrs[AIO_NB_SLOTS];
+	unsigned int first = 0, last = 0, idx;
+	size_t chunk = len, submitted = 0, done = 0;
+	bool short_read = false;
+	struct aio_slot *slot;
+	ssize_t ret = 0;
+
+	if (len > AIO_BURST_SIZE) {
+		chunk = (len / AIO_NB_SLOTS + AIO_BURST_SIZE - 1)
+			/ AIO_BURST_SIZE * AIO_BURST_SIZE;
+		if (chunk > MAX_AIO_REQ_SIZE)
+			chunk = MAX_AIO_REQ_SIZE;
+	}
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->stopped) {
+		pthread_mutex_unlock(&q->lock);
+		return 0;
+	}
+
+	while (true) {
+		while (!ret && !short_read && !q->stopped && submitted < len &&
+		       last - first < AIO_NB_SLOTS) {
+			idx = last % AIO_NB_SLOTS;
+			slot = &q->slots[idx];
+			slot->len = len - submitted < chunk ?
+				len - submitted : chunk;
+			slot->done = 0;
+			ptrs[idx] = (void *) ((uintptr_t) dest + submitted);
+
+			ret = aio_submit(q, slot, ptrs[idx]);
+			if (!ret) {
+				submitted += slot->len;
+				last++;
+			}
+		}
+
+		if (first == last)
+			break;
+
+		idx = first % AIO_NB_SLOTS;
+		slot = &q->slots[idx];
+
+		while (slot->busy) {
+			ret = aio_queue_reap(pdata, q, true);
+			if (ret < 0)
+				goto out_unlock;
+		}
+
+		first++;
+
+		/* Got STOP event, treat it as EOF */
+		if (q->stopped)
+			continue;
+
+		if (slot->res < 0) {
+			if (!ret)
+				ret = slot->res;
+			continue;
+		}
+
+		if (ptrs[idx] != (void *) ((uintptr_t) dest + done))
+			memmove((void *) ((uintptr_t) dest + done),
+				ptrs[idx], (size_t) slot->res);
+
+		done += (size_t) slot->res;
+		if ((size_t) slot->res < slot->len)
+			short_read = true;
+	}
+
+	if (q->stopped)
+		ret = 0;
+	else if (done)
+		ret = (ssize_t) done;
+
+out_unlock:
+	pthread_mutex_unlock(&q->lock);
+
+	return ret;
 }
 
-static ssize_t writefd_aio(struct parser_pdata *pdata, const void *dest,
+/*
+ * The data is copied to one of the slots, and written in the background:
+ * the caller can refill the buffer of the device meanwhile, and the
+ * endpoint always has requests queued. An error is reported by the calls
+ * that follow it.
+ */
+static ssize_t writefd_aio(struct parser_pdata *pdata, const void *src,
 		size_t len)
 {
+	struct aio_queue *q = &pdata->aio_wr;
+	struct aio_slot *slot;
+	ssize_t ret;
+	void *buf;
+
 	if (len > MAX_AIO_REQ_SIZE)
 		len = MAX_AIO_REQ_SIZE;
-	return async_io(pdata, (void *)dest, len, false);
+
+	pthread_mutex_lock(&q->lock);
+
+	ret = aio_queue_reap(pdata, q, false);
+	while (!ret && !q->stopped && !q->err &&
+	       q->head - q->tail == AIO_NB_SLOTS)
+		ret = aio_queue_reap(pdata, q, true);
+
+	if (!ret && q->err)
+		ret = q->err;
+	if (ret || q->stopped)
+		goto out_unlock;
+
+	slot = &q->slots[q->head % AIO_NB_SLOTS];
+	if (slot->size < len) {
+		buf = realloc(slot->buf, len);
+		if (!buf) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+
+		slot->buf = buf;
+		slot->size = len;
+	}
+
+	memcpy(slot->buf, src, len);
+	slot->len = len;
+	slot->done = 0;
+
+	ret = aio_submit(q, slot, slot->buf);
+	if (!ret) {
+		q->head++;
+		ret = (ssize_t) len;
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&q->lock);
+
+	return ret;
+}
+
+/* Wait for the writes still in flight */
+static void aio_queue_drain(struct parser_pdata *pdata, struct aio_queue *q)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&q->lock);
+	while (!ret && q->tail != q->head)
+		ret = aio_queue_reap(pdata, q, true);
+	pthread_mutex_unlock(&q->lock);
 }
 #endif /* WITH_AIO */
 
@@ -268,6 +714,10 @@ static ssize_t readfd_io(struct parser_pdata *pdata, void *dest, size_t len)
 			return 0;
 		if (pfd[0].revents & POLLERR)
 			return -EIO;
+
+		/* Write end of a pipe closed, and nothing left to read */
+		if ((pfd[0].revents & (POLLIN | POLLHUP)) == POLLHUP)
+			return 0;
 		if (!(pfd[0].revents & POLLIN))
 			continue;
 
@@ -345,6 +795,144 @@ ssize_t write_all(struct parser_pdata *pdata, const void *src, size_t len)
 	return ptr - (uintptr_t) src;
 }
 
+#ifdef HAS_SO_ZEROCOPY
+/* Below that size, copying the samples is cheaper than pinning the pages */
+#define ZEROCOPY_MIN_LEN 0x4000
+
+/* Read the completions of the MSG_ZEROCOPY sends from the error queue,
+ * until the kernel released the pages of all of them */
+static int zerocopy_wait(struct parser_pdata *pdata)
+{
+	struct sock_extended_err *serr;
+	struct pollfd pfd[2];
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	char control[128];
+	ssize_t ret;
+	int err;
+
+	/* POLLERR is reported as long as the error queue is not empty */
+	pfd[0].fd = pdata->fd_out;
+	pfd[0].events = 0;
+	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
+	pfd[1].events = POLLIN;
+
+	while (pdata->zc_done != pdata->zc_next) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(pdata->fd_out, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return -errno;
+
+			pfd[0].revents = 0;
+			pfd[1].revents = 0;
+			poll_nointr(pfd, 2);
+
+			if (pfd[1].revents & POLLIN || pfd[0].revents & POLLHUP)
+				return -EPIPE;
+
+			/* POLLERR is also set if the connection failed */
+			if (pfd[0].revents & POLLERR) {
+				socklen_t optlen = sizeof(err);
+
+				if (!getsockopt(pdata->fd_out, SOL_SOCKET,
+						SO_ERROR, &err, &optlen) && err)
+					return -err;
+			}
+			continue;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP &&
+			      cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			      cm->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (serr->ee_errno ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* The range of completed sends is in ee_info..ee_data */
+			pdata->zc_done = serr->ee_data + 1;
+
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				/* e.g. loopback, or a NIC without scatter-gather:
+				 * the pinning only costs time */
+				IIO_DEBUG("Samples were copied, disabling MSG_ZEROCOPY\n");
+				pdata->zerocopy = false;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Send the samples without copying them to the socket buffer. The pages stay
+ * referenced by the socket until the data is acknowledged, so this waits for
+ * the completions before returning: the block can be refilled afterwards.
+ */
+static ssize_t write_all_zerocopy(struct parser_pdata *pdata,
+		const void *src, size_t len)
+{
+	uintptr_t ptr = (uintptr_t) src;
+	struct pollfd pfd[2];
+	ssize_t ret;
+	int err;
+
+	pfd[0].fd = pdata->fd_out;
+	pfd[0].events = POLLOUT;
+	pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
+	pfd[1].events = POLLIN;
+
+	while (len) {
+		ret = send(pdata->fd_out, (const void *) ptr, len,
+			   MSG_NOSIGNAL | MSG_ZEROCOPY);
+		if (ret > 0) {
+			pdata->zc_next++;
+			ptr += ret;
+			len -= ret;
+			continue;
+		}
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		if (ret == -1 && errno == ENOBUFS) {
+			/* Out of pinned memory: copy what remains */
+			ret = write_all(pdata, (const void *) ptr, len);
+			if (ret < 0)
+				return ret;
+			ptr += len;
+			break;
+		}
+
+		if (ret == 0 || errno != EAGAIN)
+			return ret ? -errno : -EPIPE;
+
+		pfd[0].revents = 0;
+		pfd[1].revents = 0;
+		poll_nointr(pfd, 2);
+
+		if (pfd[1].revents & POLLIN || pfd[0].revents & POLLHUP)
+			return -EPIPE;
+	}
+
+	err = zerocopy_wait(pdata);
+	if (err < 0)
+		return err;
+
+	return ptr - (uintptr_t) src;
+}
+#endif
+
 static ssize_t read_all(struct parser_pdata *pdata,
 		void *dst, size_t len)
 {
@@ -363,9 +951,66 @@ static ssize_t read_all(struct parser_pdata *pdata,
 	return ptr - (uintptr_t) dst;
 }
 
-static void print_value(struct parser_pdata *pdata, long value)
+/* The response carries the ID, opcode and device of the request it
+ * answers. The channel is the one of the request as well, except for a
+ * compressed READBUF response. */
+static ssize_t write_bin_header_chn(struct parser_pdata *pdata, int32_t code,
+		uint8_t type, uint32_t len, uint16_t chn)
 {
-	if (pdata->verbose && value < 0) {
+	struct iiod_bin_hdr hdr = pdata->bin_hdr;
+	uint8_t buf[IIOD_BIN_HDR_SIZE];
+	ssize_t ret;
+
+	hdr.chn = chn;
+	hdr.code = code;
+	hdr.type = type;
+	hdr.len = len;
+	iiod_bin_pack(buf, &hdr);
+
+	ret = write_all(pdata, buf, sizeof(buf));
+	if (ret <= 0)
+		pdata->stop = true;
+	return ret;
+}
+
+static ssize_t write_bin_header(struct parser_pdata *pdata, int32_t code,
+		uint8_t type, uint32_t len)
+{
+	return write_bin_header_chn(pdata, code, type, len, pdata->bin_hdr.chn);
+}
+
+/* Small blocks of samples are sent in a single write with their header:
+ * as the sockets have TCP_NODELAY set, they leave in one segment instead of
+ * two, and the client gets them with one wakeup. */
+#define SMALL_WRITE_MAX 4096
+
+static ssize_t write_bin_small(struct parser_pdata *pdata, int32_t code,
+		uint8_t type, const void *src, size_t len)
+{
+	uint8_t buf[IIOD_BIN_HDR_SIZE + SMALL_WRITE_MAX];
+	struct iiod_bin_hdr hdr = pdata->bin_hdr;
+	ssize_t ret;
+
+	hdr.code = code;
+	hdr.type = type;
+	hdr.len = (uint32_t) len;
+	iiod_bin_pack(buf, &hdr);
+	memcpy(buf + IIOD_BIN_HDR_SIZE, src, len);
+
+	ret = write_all(pdata, buf, IIOD_BIN_HDR_SIZE + len);
+	if (ret <= 0) {
+		pdata->stop = true;
+		return ret;
+	}
+
+	return (ssize_t) len;
+}
+
+static void print_value(struct parser_pdata *pdata, long value)
+{
+	if (pdata->binary) {
+		write_bin_header(pdata, (int32_t) value, 0, 0);
+	} else if (pdata->verbose && value < 0) {
 		char buf[1024];
 		iio_strerror(-value, buf, sizeof(buf));
 		output(pdata, "ERROR: ");
@@ -436,1113 +1081,3793 @@ static ssize_t receive_sample(const struct iio_channel *chn,
 	return read_all(info->pdata, dst, length);
 }
 
-static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
+/* Fixed-size copies, which the compiler turns into single loads and stores */
+#define DEMUX_COPY(size, dst, dst_step, src, src_step, nb) do {		\
+	ptrdiff_t k;							\
+	for (k = 0; k < (ptrdiff_t) (nb); k++)				\
+		memcpy((dst) + k * (dst_step), (src) + k * (src_step), size); \
+} while (0)
+
+static void demux_copy(uint8_t *dst, ptrdiff_t dst_step, const uint8_t *src,
+		ptrdiff_t src_step, size_t length, size_t nb)
 {
-	struct parser_pdata *pdata = thd->pdata;
-	bool demux = server_demux && dev->sample_size != thd->sample_size;
-	void *start;
+	switch (length) {
+	case 1:
+		DEMUX_COPY(1, dst, dst_step, src, src_step, nb);
+		break;
+	case 2:
+		DEMUX_COPY(2, dst, dst_step, src, src_step, nb);
+		break;
+	case 4:
+		DEMUX_COPY(4, dst, dst_step, src, src_step, nb);
+		break;
+	case 8:
+		DEMUX_COPY(8, dst, dst_step, src, src_step, nb);
+		break;
+	default:
+		DEMUX_COPY(length, dst, dst_step, src, src_step, nb);
+		break;
+	}
+}
 
-	if (demux)
-		len = (len / dev->sample_size) * thd->sample_size;
-	if (len > thd->nb)
+static ssize_t demux_channel(const struct iio_channel *chn, void *ptr,
+		size_t length, ptrdiff_t step, size_t nb, void *d)
+{
+	unsigned int number = get_channel_number(chn);
+	struct demux_cb_info *info = d;
+
+	if (iio_channel_get_index(chn) < 0 || !TEST_BIT(info->mask, number))
+		return 0;
+
+	/* The samples must sit at the same offset in each sample of the
+	 * client, as send_sample() and receive_sample() pad relative to the
+	 * start of the stream */
+	if (info->sample_size % length ||
+	    (nb < info->nb_samples && nb == 1))
+		return -EAGAIN;
+
+	if (info->offset % length)
+		info->offset += length - info->offset % length;
+
+	if (nb > info->nb_samples)
+		nb = info->nb_samples;
+
+	if (info->buf && info->mux)
+		demux_copy(ptr, step, info->buf + info->offset,
+				(ptrdiff_t) info->sample_size, length, nb);
+	else if (info->buf)
+		demux_copy(info->buf + info->offset,
+				(ptrdiff_t) info->sample_size,
+				ptr, step, length, nb);
+	info->offset += length;
+	return 0;
+}
+
+static void * get_demux_buf(struct ThdEntry *thd, size_t size)
+{
+	void *buf;
+
+	if (thd->demux_buf_size < size) {
+		buf = realloc(thd->demux_buf, size);
+		if (!buf)
+			return NULL;
+
+		thd->demux_buf = buf;
+		thd->demux_buf_size = size;
+	}
+
+	return thd->demux_buf;
+}
+
+/*
+ * Gather the samples of the client's channels into thd->demux_buf, one
+ * channel at a time. Returns the data to send, or NULL if the layout of the
+ * client's samples requires send_sample().
+ */
+static void * demux_samples(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t len)
+{
+	size_t nb_samples = (len + thd->sample_size - 1) / thd->sample_size;
+	size_t size = nb_samples * thd->sample_size;
+	struct demux_cb_info info = {
+		.sample_size = thd->sample_size,
+		.nb_samples = nb_samples,
+		.mask = thd->mask,
+	};
+
+	info.buf = get_demux_buf(thd, size);
+	if (!info.buf)
+		return NULL;
+
+	/* Zero the padding */
+	memset(info.buf, 0, size);
+
+	if (iio_buffer_foreach_sample_batch(dev->buf, demux_channel, &info) < 0)
+		return NULL;
+
+	return info.buf;
+}
+
+/*
+ * Receive the client's samples into thd->demux_buf, and spread them over
+ * the buffer of the device, one channel at a time. Returns -EAGAIN if the
+ * layout of the client's samples requires receive_sample().
+ */
+static ssize_t mux_samples(struct DevEntry *dev, struct ThdEntry *thd)
+{
+	size_t len = (size_t) dev->samples_count * thd->sample_size;
+	size_t nb_samples, size;
+	struct demux_cb_info info = {
+		.sample_size = thd->sample_size,
+		.mask = thd->mask,
+		.mux = true,
+	};
+	ssize_t ret;
+
+	if (thd->nb < len)
 		len = thd->nb;
 
-	print_value(pdata, len);
+	nb_samples = (len + thd->sample_size - 1) / thd->sample_size;
+	size = nb_samples * thd->sample_size;
+	info.nb_samples = nb_samples;
 
-	if (thd->new_client) {
-		unsigned int i;
-		char buf[129], *ptr = buf;
-		uint32_t *mask = demux ? thd->mask : dev->mask;
-		ssize_t ret, length;
+	/* Nothing can be read before the layout is known to be usable */
+	if (iio_buffer_foreach_sample_batch(dev->buf, demux_channel, &info) < 0)
+		return -EAGAIN;
 
-		length = sizeof(buf);
-		/* Send the current mask */
-		for (i = dev->nb_words; i > 0 && ptr < buf + sizeof(buf);
-				i--, ptr += 8) {
-			snprintf(ptr, length, "%08x", mask[i - 1]);
-			length -= 8;
-		}
+	info.buf = get_demux_buf(thd, size);
+	if (!info.buf)
+		return -EAGAIN;
 
-		*ptr = '\n';
-		length--;
+	ret = read_all(thd->pdata, info.buf, len);
+	if (ret < 0)
+		return ret;
 
-		if (length < 0) {
-			IIO_ERROR("send_data: string length error\n");
-			return -ENOSPC;
-		}
+	/* The channels missing from an incomplete last sample */
+	memset(info.buf + len, 0, size - len);
 
-		ret = write_all(pdata, buf, ptr + 1 - buf);
-		if (ret < 0)
-			return ret;
+	info.offset = 0;
+	ret = iio_buffer_foreach_sample_batch(dev->buf, demux_channel, &info);
+	return ret < 0 ? ret : (ssize_t) len;
+}
 
-		thd->new_client = false;
+/* Samples sent to a reading client by one response */
+struct send_chunk {
+	/* NULL to send the samples of the buffer one by one */
+	const void *start;
+	size_t len;
+
+	/* The mask and size of the samples of the device */
+	const uint32_t *mask;
+	unsigned int sample_size;
+	bool demux;
+
+	/* Timestamp of the block, if it was queued */
+	uint64_t timestamp;
+	bool has_timestamp;
+
+	/* Set if samples were dropped since the previous response */
+	bool overrun;
+};
+
+static void get_chunk_timestamp(struct DevEntry *dev, struct ThdEntry *thd,
+		const struct send_chunk *chunk)
+{
+	if (chunk->has_timestamp)
+		thd->timestamp = chunk->timestamp;
+	else if (iio_buffer_get_timestamp(dev->buf, &thd->timestamp) < 0)
+		thd->timestamp = 0;
+}
+
+#if WITH_ZSTD
+/* Compress the samples of a READBUF response. Returns the size of the zstd
+ * frame in thd->zbuf, or 0 if the samples are better sent as they are. */
+static size_t compress_samples(struct ThdEntry *thd, const void *src,
+		size_t len, size_t stride)
+{
+	size_t bound = ZSTD_compressBound(len), ret;
+	uint8_t *delta;
+	void *buf;
+
+	if (!thd->zctx) {
+		thd->zctx = ZSTD_createCCtx();
+		if (!thd->zctx)
+			return 0;
 	}
 
-	if (!demux) {
-		/* Short path */
-		start = iio_buffer_start(dev->buf);
-		return write_all(pdata, start, len);
-	} else {
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = len,
-			.mask = thd->mask,
-		};
+	if (thd->zbuf_size < bound + len) {
+		buf = realloc(thd->zbuf, bound + len);
+		if (!buf)
+			return 0;
 
-		return iio_buffer_foreach_sample(dev->buf, send_sample, &info);
+		thd->zbuf = buf;
+		thd->zbuf_size = bound + len;
 	}
+
+	/* The prefilter works on the second part of the buffer */
+	delta = (uint8_t *) thd->zbuf + bound;
+	iiod_bin_delta_encode(delta, src, len, stride);
+
+	/* The fastest level: compression must not slow the capture down */
+	ret = ZSTD_compressCCtx(thd->zctx, thd->zbuf, bound, delta, len, 1);
+	if (ZSTD_isError(ret) || ret >= len)
+		return 0;
+
+	return ret;
 }
 
-static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
+static ssize_t send_compressed(struct DevEntry *dev, struct ThdEntry *thd,
+		const struct send_chunk *chunk)
 {
 	struct parser_pdata *pdata = thd->pdata;
+	size_t mask_len = thd->new_client ? dev->nb_words * 4 : 0;
+	uint8_t type = IIOD_BIN_ZSTD | IIOD_BIN_DELTA;
+	size_t zlen;
+	ssize_t ret;
+
+	zlen = compress_samples(thd, chunk->start, chunk->len,
+				chunk->sample_size);
+	if (!zlen)
+		return 0;
+
+	if (thd->new_client)
+		type |= IIOD_BIN_HAS_MASK;
+	if (chunk->overrun)
+		type |= IIOD_BIN_OVERRUN;
+
+	ret = write_bin_header_chn(pdata, (int32_t) chunk->len, type,
+			(uint32_t) (zlen + mask_len),
+			(uint16_t) chunk->sample_size);
+	if (ret < 0)
+		return ret;
 
-	/* Inform that no error occurred, and that we'll start reading data */
 	if (thd->new_client) {
-		print_value(thd->pdata, 0);
+		uint8_t word[4];
+		unsigned int i;
+
+		for (i = 0; i < dev->nb_words; i++) {
+			iiod_bin_put_le32(word, chunk->mask[i]);
+
+			ret = write_all(pdata, word, sizeof(word));
+			if (ret < 0)
+				return ret;
+		}
+
+		get_chunk_timestamp(dev, thd, chunk);
 		thd->new_client = false;
 	}
 
-	if (dev->sample_size == thd->sample_size) {
-		/* Short path: Receive directly in the buffer */
+	ret = write_all(pdata, thd->zbuf, zlen);
+	return ret < 0 ? ret : (ssize_t) chunk->len;
+}
+#endif
 
-		size_t len = dev->sample_size * dev->samples_count;
-		if (thd->nb < len)
-			len = thd->nb;
+/*
+ * Decimation of the samples sent to a client, set with the DECIMATE command:
+ * a low-pass FIR filter, followed by the selection of one sample out of
+ * 'decim'. Only the outputs kept are computed, which amounts to a polyphase
+ * decimator. The filter has DECIM_TAPS_PER_PHASE taps per phase, and its
+ * cut-off frequency is the Nyquist frequency of the decimated samples.
+ */
+#define DECIM_MAX_FACTOR 256
+#define DECIM_TAPS_PER_PHASE 16
 
-		return read_all(pdata, iio_buffer_start(dev->buf), len);
-	} else {
-		/* Long path: Mux the samples to the buffer */
+struct decim_cb_info {
+	struct ThdEntry *thd;
+	uint8_t *buf;
+	size_t offset, nb_in, first;
+	unsigned int sample_size;
+	const uint32_t *mask;
+};
 
-		struct sample_cb_info info = {
-			.pdata = pdata,
-			.cpt = 0,
-			.nb_bytes = thd->nb,
-			.mask = thd->mask,
-		};
+/* Windowed-sinc (Blackman) low-pass filter, with a gain of 1 at DC */
+static float * decim_design(unsigned int factor, unsigned int nb_taps)
+{
+	double center = (double) (nb_taps - 1) / 2.0, sum = 0.0, *h;
+	float *coeffs;
+	unsigned int i;
 
-		return iio_buffer_foreach_sample(dev->buf,
-				receive_sample, &info);
+	h = malloc(nb_taps * sizeof(*h));
+	coeffs = malloc(nb_taps * sizeof(*coeffs));
+	if (!h || !coeffs) {
+		free(h);
+		free(coeffs);
+		return NULL;
+	}
+
+	for (i = 0; i < nb_taps; i++) {
+		double t = (double) i - center, x = M_PI * t / factor,
+		       w = 2.0 * M_PI * i / (nb_taps - 1);
+
+		h[i] = (t == 0.0 ? 1.0 : sin(x) / x) *
+			(0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w));
+		sum += h[i];
 	}
+
+	/* The filter is symmetric, so the coefficients don't need to be
+	 * reversed for decim_dot() */
+	for (i = 0; i < nb_taps; i++)
+		coeffs[i] = (float) (h[i] / sum);
+
+	free(h);
+	return coeffs;
 }
 
-static void dev_entry_put(struct DevEntry *entry)
+/* Four partial sums, so that the compiler can vectorize the loop */
+static float decim_dot(const float *coeffs, const float *x, size_t nb)
 {
-	bool free_entry = false;
+	float acc0 = 0.0f, acc1 = 0.0f, acc2 = 0.0f, acc3 = 0.0f;
+	size_t i;
+
+	for (i = 0; i + 4 <= nb; i += 4) {
+		acc0 += coeffs[i] * x[i];
+		acc1 += coeffs[i + 1] * x[i + 1];
+		acc2 += coeffs[i + 2] * x[i + 2];
+		acc3 += coeffs[i + 3] * x[i + 3];
+	}
 
-	pthread_mutex_lock(&entry->thdlist_lock);
-	entry->ref_count--;
-	if (entry->ref_count == 0)
-		free_entry = true;
-	pthread_mutex_unlock(&entry->thdlist_lock);
+	for (; i < nb; i++)
+		acc0 += coeffs[i] * x[i];
 
-	if (free_entry) {
-		pthread_mutex_destroy(&entry->thdlist_lock);
-		pthread_cond_destroy(&entry->rw_ready_cond);
+	return (acc0 + acc1) + (acc2 + acc3);
+}
 
-		free(entry->mask);
-		free(entry);
+static uint64_t decim_read(const uint8_t *src, size_t length, bool is_be)
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	switch (length) {
+	case 1:
+		return *src;
+	case 2:
+		memcpy(&v16, src, sizeof(v16));
+		return is_be ? be16toh(v16) : le16toh(v16);
+	case 4:
+		memcpy(&v32, src, sizeof(v32));
+		return is_be ? be32toh(v32) : le32toh(v32);
+	default:
+		memcpy(&v64, src, sizeof(v64));
+		return is_be ? be64toh(v64) : le64toh(v64);
 	}
 }
 
-static void signal_thread(struct ThdEntry *thd, ssize_t ret)
+static void decim_write(uint8_t *dst, uint64_t val, size_t length, bool is_be)
 {
-	thd->err = ret;
-	thd->nb = 0;
-	thd->active = false;
-	thd_entry_event_signal(thd);
+	uint16_t v16;
+	uint32_t v32;
+
+	switch (length) {
+	case 1:
+		*dst = (uint8_t) val;
+		break;
+	case 2:
+		v16 = is_be ? htobe16((uint16_t) val) : htole16((uint16_t) val);
+		memcpy(dst, &v16, sizeof(v16));
+		break;
+	default:
+		v32 = is_be ? htobe32((uint32_t) val) : htole32((uint32_t) val);
+		memcpy(dst, &v32, sizeof(v32));
+		break;
+	}
 }
 
-static void rw_thd(struct thread_pool *pool, void *d)
+/* The value of a sample, sign-extended; 'fmt' must pass
+ * sample_format_is_valid() */
+static int64_t sample_value(const uint8_t *src,
+		const struct iio_data_format *fmt, size_t length)
 {
-	struct DevEntry *entry = d;
-	struct ThdEntry *thd, *next_thd;
-	struct iio_device *dev = entry->dev;
-	unsigned int nb_words = entry->nb_words;
-	ssize_t ret = 0;
-
-	IIO_DEBUG("R/W thread started for device %s\n",
-		  dev_label_or_name_or_id(dev));
+	uint64_t mask = fmt->bits < 64 ? (1ull << fmt->bits) - 1 : UINT64_MAX,
+		 val = (decim_read(src, length, fmt->is_be) >> fmt->shift) & mask;
 
-	while (true) {
-		bool has_readers = false, has_writers = false,
-		     mask_updated = false;
-		unsigned int sample_size;
+	if (fmt->is_signed && fmt->bits < 64 && (val >> (fmt->bits - 1)))
+		val |= ~mask;
 
-		/* NOTE: this while loop must exit with thdlist_lock locked. */
-		pthread_mutex_lock(&entry->thdlist_lock);
+	return (int64_t) val;
+}
 
-		if (SLIST_EMPTY(&entry->thdlist_head))
-			break;
+static bool sample_format_is_valid(const struct iio_data_format *fmt)
+{
+	size_t length = fmt->length / 8;
 
-		if (entry->update_mask) {
-			unsigned int i;
-			unsigned int samples_count = 0;
+	return (length == 1 || length == 2 || length == 4 || length == 8) &&
+		fmt->length == length * 8 && fmt->repeat <= 1 && fmt->bits &&
+		fmt->bits + fmt->shift <= fmt->length;
+}
 
-			memset(entry->mask, 0, nb_words * sizeof(*entry->mask));
-			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
-				for (i = 0; i < nb_words; i++)
-					entry->mask[i] |= thd->mask[i];
+static float decim_load(const uint8_t *src, const struct iio_data_format *fmt,
+		size_t length)
+{
+	return (float) sample_value(src, fmt, length);
+}
 
-				if (thd->samples_count > samples_count)
-					samples_count = thd->samples_count;
-			}
+static void decim_store(uint8_t *dst, float sample,
+		const struct iio_data_format *fmt, size_t length)
+{
+	uint64_t mask = (1ull << fmt->bits) - 1;
+	double max = (double) (fmt->is_signed ? mask >> 1 : mask),
+	       min = fmt->is_signed ? -max - 1.0 : 0.0,
+	       val = sample < 0.0f ? sample - 0.5 : sample + 0.5;
+
+	if (val > max)
+		val = max;
+	else if (val < min)
+		val = min;
+
+	decim_write(dst, ((uint64_t) (int64_t) val & mask) << fmt->shift,
+		    length, fmt->is_be);
+}
 
-			if (entry->buf)
-				iio_buffer_destroy(entry->buf);
+static ssize_t decimate_channel(const struct iio_channel *chn, void *ptr,
+		size_t length, ptrdiff_t step, size_t nb, void *d)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(chn);
+	unsigned int number = get_channel_number(chn);
+	struct decim_cb_info *info = d;
+	struct ThdEntry *thd = info->thd;
+	size_t i, k, hist = thd->decim_taps - 1;
+	const uint8_t *src = ptr;
+	float *x, *history;
+	uint8_t *dst;
 
-			for (i = 0; i < iio_device_get_channels_count(dev); i++) {
-				struct iio_channel *chn = iio_device_get_channel(dev, i);
-				unsigned int number = get_channel_number(chn);
-				long index = iio_channel_get_index(chn);
+	if (iio_channel_get_index(chn) < 0 || !TEST_BIT(info->mask, number))
+		return 0;
 
-				if (index < 0)
-					continue;
+	/* Same constraints as demux_channel() */
+	if (info->sample_size % length || nb != info->nb_in ||
+	    fmt->repeat > 1 || fmt->length != length * 8)
+		return -EINVAL;
 
-				if (TEST_BIT(entry->mask, number))
-					iio_channel_enable(chn);
-				else
-					iio_channel_disable(chn);
-			}
+	if (info->offset % length)
+		info->offset += length - info->offset % length;
 
-			entry->buf = iio_device_create_buffer(dev,
-					samples_count, entry->cyclic);
-			if (!entry->buf) {
-				ret = -errno;
-				IIO_ERROR("Unable to create buffer\n");
-				break;
-			}
-			entry->cancelled = false;
+	dst = info->buf + info->offset;
+	info->offset += length;
 
-			/* Signal the threads that we opened the device */
-			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
-				if (thd->wait_for_open) {
-					thd->wait_for_open = false;
-					signal_thread(thd, 0);
-				}
-			}
+	/* 64-bit samples, such as timestamps, don't fit in a float: they are
+	 * decimated without filtering */
+	if (length > 4 || !fmt->bits || fmt->bits + fmt->shift > length * 8) {
+		for (i = info->first, k = 0; i < nb; i += thd->decim, k++)
+			memcpy(dst + k * info->sample_size,
+			       src + i * step, length);
+		return 0;
+	}
 
-			IIO_DEBUG("IIO device %s reopened with new mask:\n",
-				  dev_label_or_name_or_id(dev));
-			for (i = 0; i < nb_words; i++)
-				IIO_DEBUG("Mask[%i] = 0x%08x\n", i, entry->mask[i]);
-			entry->update_mask = false;
+	x = thd->decim_work;
+	history = thd->decim_history + (size_t) number * hist;
 
-			entry->sample_size = iio_device_get_sample_size(dev);
-			entry->samples_count = samples_count;
-			mask_updated = true;
-		}
+	memcpy(x, history, hist * sizeof(*x));
+	for (i = 0; i < nb; i++)
+		x[hist + i] = decim_load(src + i * step, fmt, length);
 
-		sample_size = entry->sample_size;
+	/* The output for the input sample 'i' covers x[i] to x[i + hist] */
+	for (i = info->first, k = 0; i < nb; i += thd->decim, k++)
+		decim_store(dst + k * info->sample_size,
+			    decim_dot(thd->decim_coeffs, x + i, hist + 1),
+			    fmt, length);
 
-		SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
-			thd->active = !thd->err && thd->nb >= sample_size;
-			if (mask_updated && thd->active)
-				signal_thread(thd, thd->nb);
+	memcpy(history, x + nb, hist * sizeof(*x));
+	return 0;
+}
 
-			if (thd->is_writer)
-				has_writers |= thd->active;
-			else
-				has_readers |= thd->active;
-		}
-
-		if (!has_readers && !has_writers) {
-			pthread_cond_wait(&entry->rw_ready_cond,
-					&entry->thdlist_lock);
-		}
-
-		pthread_mutex_unlock(&entry->thdlist_lock);
-
-		if (!has_readers && !has_writers)
-			continue;
-
-		if (has_readers) {
-			ssize_t nb_bytes;
-
-			ret = iio_buffer_refill(entry->buf);
+/*
+ * Decimate the samples of the client's channels into thd->demux_buf, which
+ * then holds them in the layout of the client. Returns -EINVAL if the layout
+ * of the samples is not supported.
+ */
+static int decimate_samples(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t len, struct send_chunk *chunk)
+{
+	size_t nb_in = len / dev->sample_size,
+	       first = (thd->decim - thd->decim_phase) % thd->decim,
+	       nb_out = nb_in > first ? (nb_in - first - 1) / thd->decim + 1 : 0,
+	       size = nb_out * thd->sample_size,
+	       work_size = (thd->decim_taps - 1 + nb_in) * sizeof(float);
+	struct decim_cb_info info = {
+		.thd = thd,
+		.nb_in = nb_in,
+		.first = first,
+		.sample_size = thd->sample_size,
+		.mask = thd->mask,
+	};
+	ssize_t ret;
+	void *buf;
 
-			pthread_mutex_lock(&entry->thdlist_lock);
+	if (thd->decim_work_size < work_size) {
+		buf = realloc(thd->decim_work, work_size);
+		if (!buf)
+			return -ENOMEM;
 
-			/*
-			 * When the last client disconnects the buffer is
-			 * cancelled and iio_buffer_refill() returns an error. A
-			 * new client might have connected before we got here
-			 * though, in that case the rw thread has to stay active
-			 * and a new buffer is created. If the list is still empty the loop
-			 * will exit normally.
-			 */
-			if (entry->cancelled) {
-				pthread_mutex_unlock(&entry->thdlist_lock);
-				continue;
-			}
+		thd->decim_work = buf;
+		thd->decim_work_size = work_size;
+	}
 
-			if (ret < 0) {
-				IIO_ERROR("Reading from device failed: %i\n",
-						(int) ret);
-				break;
-			}
+	if (size) {
+		info.buf = get_demux_buf(thd, size);
+		if (!info.buf)
+			return -ENOMEM;
 
-			nb_bytes = ret;
+		/* Zero the padding */
+		memset(info.buf, 0, size);
+	}
 
-			/* We don't use SLIST_FOREACH here. As soon as a thread is
-			 * signaled, its "thd" structure might be freed;
-			 * SLIST_FOREACH would then cause a segmentation fault, as it
-			 * reads "thd" to get the address of the next element. */
-			for (thd = SLIST_FIRST(&entry->thdlist_head);
-					thd; thd = next_thd) {
-				next_thd = SLIST_NEXT(thd, dev_list_entry);
+	ret = iio_buffer_foreach_sample_batch(dev->buf,
+					      decimate_channel, &info);
+	if (ret < 0)
+		return (int) ret;
 
-				if (!thd->active || thd->is_writer)
-					continue;
+	thd->decim_phase = (unsigned int) ((thd->decim_phase + nb_in) %
+					   thd->decim);
 
-				ret = send_data(entry, thd, nb_bytes);
-				if (ret > 0)
-					thd->nb -= ret;
+	chunk->start = info.buf;
+	chunk->len = size < thd->nb ? size : thd->nb;
+	chunk->mask = thd->mask;
+	chunk->demux = true;
 
-				if (ret < 0 || thd->nb < sample_size)
-					signal_thread(thd, (ret < 0) ?
-							ret : (ssize_t) thd->nb);
-			}
+	return 0;
+}
 
-			pthread_mutex_unlock(&entry->thdlist_lock);
-		}
+/*
+ * Capture windows, set with the WINDOW command: only the samples around those
+ * of a channel which meet a condition are sent to the client. Each window
+ * has 'win_pre' samples before the one that triggered it and 'win_post'
+ * samples from it, so that the client can split the stream; the samples
+ * before the trigger may belong to the previous window too. Conditions met
+ * during a window are ignored.
+ */
+#define WINDOW_MAX_SAMPLES (1 << 20)
 
-		if (has_writers) {
-			ssize_t nb_bytes = 0;
+struct window_cb_info {
+	struct ThdEntry *thd;
+	size_t nb_in, nb_hits;
+};
 
-			pthread_mutex_lock(&entry->thdlist_lock);
+static bool window_is_hit(const struct ThdEntry *thd, int64_t val)
+{
+	int64_t level = thd->win_level, prev = thd->win_prev;
+
+	switch (thd->win_edge) {
+	case IIO_WINDOW_RISING:
+		return thd->win_has_prev && prev < level && val >= level;
+	case IIO_WINDOW_FALLING:
+		return thd->win_has_prev && prev > level && val <= level;
+	case IIO_WINDOW_ABOVE:
+		return val >= level;
+	case IIO_WINDOW_BELOW:
+		return val <= level;
+	default:
+		return false;
+	}
+}
 
-			/* Reset the size of the buffer to its maximum size.
-			 *
-			 * XXX(pcercuei): There is no way to perform this with
-			 * the public libiio API. However, it probably does not
-			 * matter; we only need to reset the size of the buffer
-			 * if the buffer was used for receiving samples, and
-			 * to date there is no IIO device that supports both
-			 * receiving and sending samples.
-			 *
-			 * entry->buf->data_length = entry->buf->length;
-			 */
+/* Record the indexes of the samples which meet the condition */
+static ssize_t window_find_hits(const struct iio_channel *chn, void *ptr,
+		size_t length, ptrdiff_t step, size_t nb, void *d)
+{
+	const struct iio_data_format *fmt = iio_channel_get_data_format(chn);
+	struct window_cb_info *info = d;
+	struct ThdEntry *thd = info->thd;
+	const uint8_t *src = ptr;
+	int64_t val;
+	size_t i;
+
+	if (chn != thd->win_chn)
+		return 0;
 
-			/* Same comment as above */
-			for (thd = SLIST_FIRST(&entry->thdlist_head);
-					thd; thd = next_thd) {
-				next_thd = SLIST_NEXT(thd, dev_list_entry);
+	if (nb != info->nb_in)
+		return -EINVAL;
 
-				if (!thd->active || !thd->is_writer)
-					continue;
+	for (i = 0; i < nb; i++) {
+		val = sample_value(src + i * step, fmt, length);
 
-				ret = receive_data(entry, thd);
-				if (ret > 0) {
-					thd->nb -= ret;
-					if (ret > nb_bytes)
-						nb_bytes = ret;
-				}
+		if (window_is_hit(thd, val))
+			thd->win_hits[info->nb_hits++] = i;
 
-				if (ret < 0)
-					signal_thread(thd, ret);
-			}
+		thd->win_prev = val;
+		thd->win_has_prev = true;
+	}
 
-			ret = iio_buffer_push_partial(entry->buf,
-				nb_bytes / sample_size);
-			if (entry->cancelled) {
-				pthread_mutex_unlock(&entry->thdlist_lock);
-				continue;
-			}
-			if (ret < 0) {
-				IIO_ERROR("Writing to device failed: %i\n",
-						(int) ret);
-				break;
-			}
+	return 0;
+}
 
-			/* Signal threads which completed their RW command */
-			for (thd = SLIST_FIRST(&entry->thdlist_head);
-					thd; thd = next_thd) {
-				next_thd = SLIST_NEXT(thd, dev_list_entry);
-				if (thd->active && thd->is_writer &&
-						thd->nb < sample_size)
-					signal_thread(thd, thd->nb);
-			}
+static int window_emit(struct ThdEntry *thd, const void *src, size_t len)
+{
+	void *buf;
 
-			pthread_mutex_unlock(&entry->thdlist_lock);
-		}
-	}
+	if (thd->win_buf_size < thd->win_len + len) {
+		buf = realloc(thd->win_buf, thd->win_len + len);
+		if (!buf)
+			return -ENOMEM;
 
-	/* Signal all remaining threads */
-	for (thd = SLIST_FIRST(&entry->thdlist_head); thd; thd = next_thd) {
-		next_thd = SLIST_NEXT(thd, dev_list_entry);
-		SLIST_REMOVE(&entry->thdlist_head, thd, ThdEntry, dev_list_entry);
-		thd->wait_for_open = false;
-		signal_thread(thd, ret);
-	}
-	if (entry->buf) {
-		iio_buffer_destroy(entry->buf);
-		entry->buf = NULL;
+		thd->win_buf = buf;
+		thd->win_buf_size = thd->win_len + len;
 	}
-	entry->closed = true;
-	pthread_mutex_unlock(&entry->thdlist_lock);
-
-	pthread_mutex_lock(&devlist_lock);
-	/* It is possible that a new thread has already started, make sure to
-	 * not overwrite it. */
-	if (iio_device_get_data(dev) == entry)
-		iio_device_set_data(dev, NULL);
-	pthread_mutex_unlock(&devlist_lock);
-
-	IIO_DEBUG("Stopping R/W thread for device %s\n",
-		  dev_label_or_name_or_id(dev));
 
-	dev_entry_put(entry);
+	memcpy((uint8_t *) thd->win_buf + thd->win_len, src, len);
+	thd->win_len += len;
+	return 0;
 }
 
-static struct ThdEntry *parser_lookup_thd_entry(struct parser_pdata *pdata,
-	struct iio_device *dev)
+/* Keep the last 'win_pre' samples of the client, for the next block */
+static void window_update_history(struct ThdEntry *thd, const uint8_t *src,
+		size_t nb)
 {
-	struct ThdEntry *t;
+	size_t keep, ss = thd->sample_size, pre = thd->win_pre;
+	uint8_t *hist = thd->win_hist;
 
-	SLIST_FOREACH(t, &pdata->thdlist_head, parser_list_entry) {
-		if (t->dev == dev)
-			return t;
+	if (nb >= pre) {
+		memcpy(hist, src + (nb - pre) * ss, pre * ss);
+		thd->win_hist_len = pre;
+		return;
 	}
 
-	return NULL;
+	keep = thd->win_hist_len < pre - nb ? thd->win_hist_len : pre - nb;
+	memmove(hist, hist + (thd->win_hist_len - keep) * ss, keep * ss);
+	memcpy(hist + keep * ss, src, nb * ss);
+	thd->win_hist_len = keep + nb;
 }
 
-static ssize_t rw_buffer(struct parser_pdata *pdata,
-		struct iio_device *dev, unsigned int nb, bool is_write)
+/*
+ * Gather the capture windows found in the block just refilled into
+ * thd->win_buf, in the layout of the client. Returns -EINVAL if the layout
+ * of the samples is not supported.
+ */
+static int window_samples(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t len, struct send_chunk *chunk)
 {
-	struct DevEntry *entry;
-	struct ThdEntry *thd;
+	size_t nb_in = len / dev->sample_size, ss = thd->sample_size,
+	       pre = thd->win_pre, i, pos;
+	struct window_cb_info info = {
+		.thd = thd,
+		.nb_in = nb_in,
+	};
+	const uint8_t *src;
 	ssize_t ret;
+	void *buf;
 
-	if (!dev)
-		return -ENODEV;
-
-	thd = parser_lookup_thd_entry(pdata, dev);
-	if (!thd)
-		return -EBADF;
-
-	entry = thd->entry;
+	if (dev->sample_size == thd->sample_size)
+		src = iio_buffer_start(dev->buf);
+	else
+		src = demux_samples(dev, thd, nb_in * ss);
+	if (!src)
+		return -EINVAL;
 
-	if (nb < entry->sample_size)
-		return 0;
+	if (thd->win_hits_size < nb_in) {
+		buf = realloc(thd->win_hits, nb_in * sizeof(*thd->win_hits));
+		if (!buf)
+			return -ENOMEM;
 
-	pthread_mutex_lock(&entry->thdlist_lock);
-	if (entry->closed) {
-		pthread_mutex_unlock(&entry->thdlist_lock);
-		return -EBADF;
+		thd->win_hits = buf;
+		thd->win_hits_size = nb_in;
 	}
 
-	if (thd->nb) {
-		pthread_mutex_unlock(&entry->thdlist_lock);
-		return -EBUSY;
-	}
+	ret = iio_buffer_foreach_sample_batch(dev->buf,
+					      window_find_hits, &info);
+	if (ret < 0)
+		return (int) ret;
 
-	thd->new_client = true;
-	thd->nb = nb;
-	thd->err = 0;
-	thd->is_writer = is_write;
-	thd->active = true;
+	thd->win_len = 0;
 
-	pthread_cond_signal(&entry->rw_ready_cond);
+	/* The end of the window triggered in a previous block */
+	pos = thd->win_left < nb_in ? thd->win_left : nb_in;
+	ret = window_emit(thd, src, pos * ss);
+	thd->win_left -= pos;
 
-	IIO_DEBUG("Waiting for completion...\n");
-	while (thd->active) {
-		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
-		if (ret)
-			break;
-	}
-	if (ret == 0)
-		ret = thd->err;
-	pthread_mutex_unlock(&entry->thdlist_lock);
+	for (i = 0; !ret && i < info.nb_hits; i++) {
+		size_t hit = thd->win_hits[i], start, end;
 
-	if (ret > 0 && ret < (ssize_t) nb)
-		print_value(thd->pdata, 0);
+		/* The condition was met during a window, or too early to
+		 * have the samples before the trigger */
+		if (hit < pos || hit + thd->win_hist_len < pre)
+			continue;
 
-	IIO_DEBUG("Exiting rw_buffer with code %li\n", (long) ret);
-	if (ret < 0)
-		return ret;
-	else
-		return nb - ret;
-}
+		if (hit < pre) {
+			ret = window_emit(thd, (uint8_t *) thd->win_hist +
+					  (thd->win_hist_len - (pre - hit)) * ss,
+					  (pre - hit) * ss);
+			if (ret)
+				break;
+		}
 
-static uint32_t *get_mask(const char *mask, size_t *len)
-{
-	size_t nb = (*len + 7) / 8;
-	uint32_t *ptr, *words = calloc(nb, sizeof(*words));
-	if (!words)
-		return NULL;
+		start = hit < pre ? 0 : hit - pre;
+		end = hit + thd->win_post;
+		if (end > nb_in)
+			thd->win_left = end - nb_in;
 
-	ptr = words + nb;
-	while (*mask) {
-		char buf[9];
-		snprintf(buf, sizeof(buf), "%.*s", 8, mask);
-		sscanf(buf, "%08x", --ptr);
-		mask += 8;
-		IIO_DEBUG("Mask[%lu]: 0x%08x\n",
-				(unsigned long) (words - ptr) / 4, *ptr);
+		ret = window_emit(thd, src + start * ss,
+				  ((end < nb_in ? end : nb_in) - start) * ss);
+		pos = end;
 	}
 
-	*len = nb;
-	return words;
-}
+	if (ret)
+		return (int) ret;
 
-static void free_thd_entry(struct ThdEntry *t)
-{
-	close(t->eventfd);
-	free(t->mask);
-	free(t);
+	if (pre)
+		window_update_history(thd, src, nb_in);
+
+	chunk->start = thd->win_buf;
+	chunk->len = thd->win_len < thd->nb ? thd->win_len : thd->nb;
+	chunk->mask = thd->mask;
+	chunk->demux = true;
+
+	return 0;
 }
 
-static void remove_thd_entry(struct ThdEntry *t)
+static int prepare_chunk(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t len, struct send_chunk *chunk)
 {
-	struct DevEntry *entry = t->entry;
+	bool demux = server_demux && dev->sample_size != thd->sample_size;
 
-	pthread_mutex_lock(&entry->thdlist_lock);
-	if (!entry->closed) {
-		entry->update_mask = true;
-		SLIST_REMOVE(&entry->thdlist_head, t, ThdEntry, dev_list_entry);
-		if (SLIST_EMPTY(&entry->thdlist_head) && entry->buf) {
-			entry->cancelled = true;
-			iio_buffer_cancel(entry->buf); /* Wakeup the rw thread */
-		}
+	chunk->sample_size = dev->sample_size;
+	chunk->has_timestamp = false;
+	chunk->overrun = false;
 
-		pthread_cond_signal(&entry->rw_ready_cond);
+	if (thd->decim > 1)
+		return decimate_samples(dev, thd, len, chunk);
+	if (thd->win_edge != IIO_WINDOW_OFF)
+		return window_samples(dev, thd, len, chunk);
+
+	if (demux)
+		len = (len / dev->sample_size) * thd->sample_size;
+	if (len > thd->nb)
+		len = thd->nb;
+
+	chunk->len = len;
+	chunk->mask = demux ? thd->mask : dev->mask;
+	chunk->demux = demux;
+
+	if (!demux) {
+		/* Short path */
+		chunk->start = iio_buffer_start(dev->buf);
+	} else {
+		chunk->start = demux_samples(dev, thd, len);
 	}
-	pthread_mutex_unlock(&entry->thdlist_lock);
-	dev_entry_put(entry);
 
-	free_thd_entry(t);
+	return 0;
 }
 
-static ssize_t get_dev_sample_size_mask(const struct iio_device *dev,
-					const uint32_t *mask, size_t words)
+static ssize_t send_chunk(struct DevEntry *dev, struct ThdEntry *thd,
+		const struct send_chunk *chunk)
 {
-	unsigned int i, len, number,
-		     nb_channels = iio_device_get_channels_count(dev);
+	struct parser_pdata *pdata = thd->pdata;
+	size_t len = chunk->len;
+
+#if WITH_ZSTD
+	/* Demuxed samples are never compressed */
+	if (pdata->binary && chunk->start && !chunk->demux &&
+	    (pdata->bin_hdr.type & IIOD_BIN_ZSTD)) {
+		ssize_t ret = send_compressed(dev, thd, chunk);
+		if (ret)
+			return ret;
+	}
+#endif
+
+	if (pdata->binary && chunk->start && !thd->new_client &&
+	    len <= SMALL_WRITE_MAX) {
+		return write_bin_small(pdata, (int32_t) len,
+				       chunk->overrun ? IIOD_BIN_OVERRUN : 0,
+				       chunk->start, len);
+	}
+
+	if (pdata->binary) {
+		/* The first chunk also carries the mask */
+		size_t mask_len = thd->new_client ? dev->nb_words * 4 : 0;
+		uint8_t type = thd->new_client ? IIOD_BIN_HAS_MASK : 0;
+		ssize_t ret;
+
+		if (chunk->overrun)
+			type |= IIOD_BIN_OVERRUN;
+
+		ret = write_bin_header(pdata, (int32_t) len, type,
+				(uint32_t) (len + mask_len));
+		if (ret < 0)
+			return ret;
+	} else {
+		print_value(pdata, len);
+	}
+
+	if (thd->new_client && pdata->binary) {
+		uint8_t word[4];
+		unsigned int i;
+		ssize_t ret;
+
+		for (i = 0; i < dev->nb_words; i++) {
+			iiod_bin_put_le32(word, chunk->mask[i]);
+
+			ret = write_all(pdata, word, sizeof(word));
+			if (ret < 0)
+				return ret;
+		}
+
+		get_chunk_timestamp(dev, thd, chunk);
+		thd->new_client = false;
+	} else if (thd->new_client) {
+		unsigned int i;
+		char buf[129], *ptr = buf;
+		ssize_t ret, length;
+
+		length = sizeof(buf);
+		/* Send the current mask */
+		for (i = dev->nb_words; i > 0 && ptr < buf + sizeof(buf);
+				i--, ptr += 8) {
+			snprintf(ptr, length, "%08x", chunk->mask[i - 1]);
+			length -= 8;
+		}
+
+		*ptr = '\n';
+		length--;
+
+		if (length < 0) {
+			IIO_ERROR("send_data: string length error\n");
+			return -ENOSPC;
+		}
+
+		ret = write_all(pdata, buf, ptr + 1 - buf);
+		if (ret < 0)
+			return ret;
+
+		get_chunk_timestamp(dev, thd, chunk);
+		thd->new_client = false;
+	}
+
+	if (chunk->start) {
+#ifdef HAS_SO_ZEROCOPY
+		if (pdata->zerocopy && !pdata->mux && len >= ZEROCOPY_MIN_LEN)
+			return write_all_zerocopy(pdata, chunk->start, len);
+#endif
+		return write_all(pdata, chunk->start, len);
+	} else {
+		/* Long path: one write per sample of each channel */
+		struct sample_cb_info info = {
+			.pdata = pdata,
+			.cpt = 0,
+			.nb_bytes = len,
+			.mask = thd->mask,
+		};
+
+		return iio_buffer_foreach_sample(dev->buf, send_sample, &info);
+	}
+}
+
+static ssize_t send_data(struct DevEntry *dev, struct ThdEntry *thd, size_t len)
+{
+	struct send_chunk chunk;
+	int ret;
+
+	ret = prepare_chunk(dev, thd, len, &chunk);
+	if (ret < 0)
+		return ret;
+
+	/* A block may be too short to give a decimated sample */
+	if (!chunk.len)
+		return 0;
+
+	return send_chunk(dev, thd, &chunk);
+}
+
+static bool thd_queue_pending(const struct ThdEntry *thd)
+{
+	return thd->queue_head != thd->queue_tail;
+}
+
+static bool thd_queue_full(const struct ThdEntry *thd)
+{
+	return thd->queue &&
+		thd->queue_head - thd->queue_tail == server_client_queue;
+}
+
+/*
+ * Queue a copy of the samples just refilled, which the thread of the client
+ * sends while the R/W thread refills the buffer again. Called with the
+ * thdlist_lock held. Returns the number of bytes queued, or a negative error
+ * code; -ENOTSUP if the samples must be sent right away.
+ */
+static ssize_t thd_queue_push(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t nb_bytes)
+{
+	struct send_chunk chunk;
+	struct thd_slot *slot;
+	void *data;
+	int ret;
+
+	if (!thd->queue) {
+		thd->queue = calloc(server_client_queue, sizeof(*thd->queue));
+		if (!thd->queue)
+			return -ENOMEM;
+	}
+
+	if (thd_queue_full(thd)) {
+		if (server_slow_client == SLOW_CLIENT_DISCONNECT) {
+			thd->kicked = true;
+			return -ENOBUFS;
+		}
+
+		/* Drop the oldest block; its bytes will be captured again */
+		slot = &thd->queue[thd->queue_tail++ % server_client_queue];
+		thd->nb += slot->len;
+		thd->nb_xfer -= slot->len;
+		thd->nb_overruns++;
+		thd->overrun = true;
+	}
+
+	ret = prepare_chunk(dev, thd, nb_bytes, &chunk);
+	if (ret < 0)
+		return ret;
+	if (!chunk.len)
+		return 0;
+
+	if (!chunk.start) {
+		/* The queued blocks must be sent first */
+		return thd_queue_pending(thd) ? -ENOMEM : -ENOTSUP;
+	}
+
+	slot = &thd->queue[thd->queue_head % server_client_queue];
+	if (slot->size < chunk.len) {
+		data = realloc(slot->data, chunk.len);
+		if (!data)
+			return -ENOMEM;
+
+		slot->data = data;
+		slot->size = chunk.len;
+	}
+
+	if (!slot->mask) {
+		slot->mask = malloc(dev->nb_words * sizeof(*slot->mask));
+		if (!slot->mask)
+			return -ENOMEM;
+	}
+
+	memcpy(slot->data, chunk.start, chunk.len);
+	memcpy(slot->mask, chunk.mask, dev->nb_words * sizeof(*slot->mask));
+	slot->len = chunk.len;
+	slot->sample_size = chunk.sample_size;
+	slot->demux = chunk.demux;
+
+	if (iio_buffer_get_timestamp(dev->buf, &slot->timestamp) < 0)
+		slot->timestamp = 0;
+
+	thd->queue_head++;
+	if (thd->queue_head - thd->queue_tail > thd->max_lag)
+		thd->max_lag = thd->queue_head - thd->queue_tail;
+
+	return (ssize_t) chunk.len;
+}
+
+/* Send the oldest block of the queue. Called with the thdlist_lock held,
+ * which is released meanwhile. */
+static int thd_queue_send(struct DevEntry *dev, struct ThdEntry *thd)
+{
+	struct thd_slot *slot, tmp;
+	struct send_chunk chunk;
+	ssize_t ret;
+
+	/* Swap the block with the spare one, so that the slot can be refilled
+	 * while the block is being sent */
+	slot = &thd->queue[thd->queue_tail++ % server_client_queue];
+	tmp = *slot;
+	*slot = thd->sending;
+	thd->sending = tmp;
+
+	chunk.start = tmp.data;
+	chunk.len = tmp.len;
+	chunk.mask = tmp.mask;
+	chunk.sample_size = tmp.sample_size;
+	chunk.demux = tmp.demux;
+	chunk.timestamp = tmp.timestamp;
+	chunk.has_timestamp = true;
+	chunk.overrun = thd->overrun;
+	thd->overrun = false;
+
+	/* Wake up the R/W thread if it waits for a free slot */
+	pthread_cond_signal(&dev->rw_ready_cond);
+	pthread_mutex_unlock(&dev->thdlist_lock);
+
+	ret = send_chunk(dev, thd, &chunk);
+
+	pthread_mutex_lock(&dev->thdlist_lock);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+static void thd_queue_flush(struct DevEntry *dev, struct ThdEntry *thd)
+{
+	if (thd_queue_pending(thd)) {
+		thd->queue_tail = thd->queue_head;
+		pthread_cond_signal(&dev->rw_ready_cond);
+	}
+}
+
+static ssize_t receive_data(struct DevEntry *dev, struct ThdEntry *thd)
+{
+	struct parser_pdata *pdata = thd->pdata;
+
+	/* Inform that no error occurred, and that we'll start reading data.
+	 * With the binary protocol, the data follows the request directly. */
+	if (thd->new_client) {
+		if (!pdata->binary)
+			print_value(thd->pdata, 0);
+		thd->new_client = false;
+	}
+
+	if (dev->sample_size == thd->sample_size) {
+		/* Short path: Receive directly in the buffer */
+
+		size_t len = dev->sample_size * dev->samples_count;
+		if (thd->nb < len)
+			len = thd->nb;
+
+		return read_all(pdata, iio_buffer_start(dev->buf), len);
+	} else {
+		/* Long path: Mux the samples to the buffer */
+
+		struct sample_cb_info info = {
+			.pdata = pdata,
+			.cpt = 0,
+			.nb_bytes = thd->nb,
+			.mask = thd->mask,
+		};
+		ssize_t ret;
+
+		ret = mux_samples(dev, thd);
+		if (ret != -EAGAIN)
+			return ret;
+
+		/* One read per sample of each channel */
+		return iio_buffer_foreach_sample(dev->buf,
+				receive_sample, &info);
+	}
+}
+
+static void dev_entry_put(struct DevEntry *entry)
+{
+	bool free_entry = false;
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	entry->ref_count--;
+	if (entry->ref_count == 0)
+		free_entry = true;
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	if (free_entry) {
+		pthread_mutex_destroy(&entry->thdlist_lock);
+		pthread_cond_destroy(&entry->rw_ready_cond);
+
+		free(entry->mask);
+		free(entry);
+	}
+}
+
+/* Send the block just refilled to the multicast group of the thread, as
+ * datagrams. The datagrams that could not be sent are lost, which the
+ * subscribers detect with the sequence numbers. */
+static void mcast_publish(struct DevEntry *dev, struct ThdEntry *thd,
+		size_t len)
+{
+	size_t mask_len = dev->nb_words * 4,
+	       max = IIOD_MCAST_MAX_DGRAM - IIOD_MCAST_HDR_SIZE - mask_len;
+	uint8_t hdr_buf[IIOD_MCAST_HDR_SIZE];
+	uint8_t mask[IIOD_MCAST_MAX_DGRAM - IIOD_MCAST_HDR_SIZE];
+	uint8_t *start = iio_buffer_start(dev->buf);
+	struct iiod_mcast_hdr hdr = {
+		.magic = IIOD_MCAST_MAGIC,
+		.block = thd->mcast_block++,
+		.block_len = (uint32_t) len,
+		.nb_words = (uint16_t) dev->nb_words,
+	};
+	struct iovec iov[3] = {
+		{ .iov_base = hdr_buf, .iov_len = sizeof(hdr_buf), },
+		{ .iov_base = mask, .iov_len = mask_len, },
+	};
+	struct msghdr msg = {
+		.msg_name = &thd->mcast_addr,
+		.msg_namelen = sizeof(thd->mcast_addr),
+		.msg_iov = iov,
+		.msg_iovlen = 3,
+	};
+	size_t i, nb;
+	ssize_t ret;
+
+	for (i = 0; i < dev->nb_words; i++)
+		iiod_bin_put_le32(&mask[i * 4], dev->mask[i]);
+
+	for (hdr.offset = 0; hdr.offset < len; hdr.offset += (uint32_t) nb) {
+		nb = len - hdr.offset;
+		if (nb > max)
+			nb = max;
+
+		hdr.seq = thd->mcast_seq++;
+		iiod_mcast_pack(hdr_buf, &hdr);
+
+		iov[2].iov_base = start + hdr.offset;
+		iov[2].iov_len = nb;
+
+		do {
+			ret = sendmsg(thd->mcast_fd, &msg, 0);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret < 0)
+			IIO_DEBUG("Unable to send datagram: %i\n", -errno);
+	}
+}
+
+static void signal_thread(struct ThdEntry *thd, ssize_t ret)
+{
+	thd->err = ret;
+	thd->nb = 0;
+	thd->active = false;
+	thd_entry_event_signal(thd);
+}
+
+/*
+ * Gets the buffer of the device ready for the channels just enabled, and at
+ * least 'samples_count' samples. Called with the thdlist_lock held, so the
+ * clients already attached see no gap when the buffer can be kept: as is,
+ * when the channels didn't change and the samples fit, or reconfigured in
+ * place otherwise, falling back to re-creating it.
+ */
+static int dev_entry_update_buffer(struct DevEntry *entry,
+		unsigned int samples_count, bool channels_changed)
+{
+	struct iio_device *dev = entry->dev;
+	int ret;
+
+	if (entry->buf && !entry->cancelled) {
+		if (!channels_changed && samples_count <= entry->samples_count)
+			return 0;
+
+		ret = iio_buffer_reconfigure(entry->buf, samples_count);
+		if (!ret) {
+			entry->samples_count = samples_count;
+			return 0;
+		}
+
+		IIO_DEBUG("Unable to reconfigure buffer, re-creating it\n");
+	}
+
+	if (entry->buf) {
+		iio_buffer_destroy(entry->buf);
+		entry->buf = NULL;
+	}
+
+	/* Let the clients update a cyclic waveform with
+	 * another WRITEBUF, without re-opening the device */
+	if (entry->cyclic &&
+	    iio_device_set_cyclic_double_buffer(dev, true) < 0)
+		IIO_DEBUG("Cyclic double-buffering unsupported\n");
+
+	entry->buf = iio_device_create_buffer(dev,
+			samples_count, entry->cyclic);
+	if (!entry->buf)
+		return -errno;
+
+	entry->cancelled = false;
+	entry->samples_count = samples_count;
+	return 0;
+}
+
+static void rw_thd(struct thread_pool *pool, void *d)
+{
+	struct DevEntry *entry = d;
+	struct ThdEntry *thd, *next_thd;
+	struct iio_device *dev = entry->dev;
+	unsigned int nb_words = entry->nb_words;
+	ssize_t ret = 0;
+
+	IIO_DEBUG("R/W thread started for device %s\n",
+		  dev_label_or_name_or_id(dev));
+
+	while (true) {
+		bool has_readers = false, has_writers = false,
+		     mask_updated = false, queue_full = false;
+		unsigned int sample_size;
+		struct timespec start;
+		uint64_t us;
+
+		/* NOTE: this while loop must exit with thdlist_lock locked. */
+		pthread_mutex_lock(&entry->thdlist_lock);
+
+		if (SLIST_EMPTY(&entry->thdlist_head))
+			break;
+
+		if (entry->update_mask) {
+			unsigned int i;
+			unsigned int samples_count = 0;
+			bool channels_changed = false;
+
+			memset(entry->mask, 0, nb_words * sizeof(*entry->mask));
+			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
+				for (i = 0; i < nb_words; i++)
+					entry->mask[i] |= thd->mask[i];
+
+				if (thd->samples_count > samples_count)
+					samples_count = thd->samples_count;
+			}
+
+			for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+				struct iio_channel *chn = iio_device_get_channel(dev, i);
+				unsigned int number = get_channel_number(chn);
+				long index = iio_channel_get_index(chn);
+				bool enabled;
+
+				if (index < 0)
+					continue;
+
+				enabled = TEST_BIT(entry->mask, number);
+				if (enabled != iio_channel_is_enabled(chn))
+					channels_changed = true;
+
+				if (enabled)
+					iio_channel_enable(chn);
+				else
+					iio_channel_disable(chn);
+			}
+
+			ret = dev_entry_update_buffer(entry, samples_count,
+						      channels_changed);
+			if (ret < 0) {
+				IIO_ERROR("Unable to create buffer\n");
+				break;
+			}
+
+			/* Signal the threads that we opened the device */
+			SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
+				if (thd->wait_for_open) {
+					thd->wait_for_open = false;
+					signal_thread(thd, 0);
+				}
+			}
+
+			IIO_DEBUG("IIO device %s reopened with new mask:\n",
+				  dev_label_or_name_or_id(dev));
+			for (i = 0; i < nb_words; i++)
+				IIO_DEBUG("Mask[%i] = 0x%08x\n", i, entry->mask[i]);
+			entry->update_mask = false;
+
+			entry->sample_size = iio_device_get_sample_size(dev);
+			mask_updated = true;
+		}
+
+		sample_size = entry->sample_size;
+
+		SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
+			thd->active = !thd->err && thd->nb >= sample_size;
+
+			/* Publishing threads don't wait for the new mask */
+			if (mask_updated && thd->active && !thd->mcast)
+				signal_thread(thd, thd->nb);
+
+			if (thd->is_writer)
+				has_writers |= thd->active;
+			else
+				has_readers |= thd->active;
+
+			/* Wait until the slow client catches up */
+			if (thd->active && !thd->is_writer &&
+			    server_slow_client == SLOW_CLIENT_BLOCK &&
+			    thd_queue_full(thd))
+				queue_full = true;
+		}
+
+		if ((!has_readers && !has_writers) || queue_full) {
+			pthread_cond_wait(&entry->rw_ready_cond,
+					&entry->thdlist_lock);
+		}
+
+		pthread_mutex_unlock(&entry->thdlist_lock);
+
+		if ((!has_readers && !has_writers) || queue_full)
+			continue;
+
+		if (has_readers) {
+			ssize_t nb_bytes;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			ret = iio_buffer_refill(entry->buf);
+			us = stats_elapsed_us(&start);
+
+			pthread_mutex_lock(&entry->thdlist_lock);
+
+			/*
+			 * When the last client disconnects the buffer is
+			 * cancelled and iio_buffer_refill() returns an error. A
+			 * new client might have connected before we got here
+			 * though, in that case the rw thread has to stay active
+			 * and a new buffer is created. If the list is still empty the loop
+			 * will exit normally.
+			 */
+			if (entry->cancelled) {
+				pthread_mutex_unlock(&entry->thdlist_lock);
+				continue;
+			}
+
+			if (ret < 0) {
+				IIO_ERROR("Reading from device failed: %i\n",
+						(int) ret);
+				break;
+			}
+
+			nb_bytes = ret;
+
+			entry->nb_refills++;
+			entry->refill_bytes += (uint64_t) nb_bytes;
+			entry->refill_us += us;
+			if (us > entry->max_refill_us)
+				entry->max_refill_us = us;
+
+			/* We don't use SLIST_FOREACH here. As soon as a thread is
+			 * signaled, its "thd" structure might be freed;
+			 * SLIST_FOREACH would then cause a segmentation fault, as it
+			 * reads "thd" to get the address of the next element. */
+			for (thd = SLIST_FIRST(&entry->thdlist_head);
+					thd; thd = next_thd) {
+				next_thd = SLIST_NEXT(thd, dev_list_entry);
+
+				if (!thd->active || thd->is_writer)
+					continue;
+
+				if (thd->mcast) {
+					mcast_publish(entry, thd, nb_bytes);
+					continue;
+				}
+
+				if (server_client_queue)
+					ret = thd_queue_push(entry, thd,
+							     nb_bytes);
+				else
+					ret = -ENOTSUP;
+
+				if (ret == -ENOTSUP)
+					ret = send_data(entry, thd, nb_bytes);
+				else if (ret > 0)
+					thd_entry_event_signal(thd);
+
+				if (ret > 0) {
+					thd->nb -= ret;
+					thd->nb_xfer += ret;
+				}
+
+				if (ret < 0 || thd->nb < sample_size)
+					signal_thread(thd, (ret < 0) ?
+							ret : (ssize_t) thd->nb);
+			}
+
+			pthread_mutex_unlock(&entry->thdlist_lock);
+		}
+
+		if (has_writers) {
+			size_t nb_samples = 0;
+
+			pthread_mutex_lock(&entry->thdlist_lock);
+
+			/* Reset the size of the buffer to its maximum size.
+			 *
+			 * XXX(pcercuei): There is no way to perform this with
+			 * the public libiio API. However, it probably does not
+			 * matter; we only need to reset the size of the buffer
+			 * if the buffer was used for receiving samples, and
+			 * to date there is no IIO device that supports both
+			 * receiving and sending samples.
+			 *
+			 * entry->buf->data_length = entry->buf->length;
+			 */
+
+			/* Same comment as above */
+			for (thd = SLIST_FIRST(&entry->thdlist_head);
+					thd; thd = next_thd) {
+				next_thd = SLIST_NEXT(thd, dev_list_entry);
+
+				if (!thd->active || !thd->is_writer)
+					continue;
+
+				ret = receive_data(entry, thd);
+				if (ret > 0) {
+					thd->nb -= ret;
+					thd->nb_xfer += ret;
+
+					/* The client's samples may be smaller
+					 * than those of the device */
+					if ((size_t) ret / thd->sample_size >
+							nb_samples)
+						nb_samples = (size_t) ret /
+							thd->sample_size;
+				}
+
+				if (ret < 0)
+					signal_thread(thd, ret);
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			ret = iio_buffer_push_partial(entry->buf, nb_samples);
+			if (ret >= 0) {
+				entry->nb_pushes++;
+				entry->push_bytes += (uint64_t) nb_samples *
+					entry->sample_size;
+				entry->push_us += stats_elapsed_us(&start);
+			}
+			if (entry->cancelled) {
+				pthread_mutex_unlock(&entry->thdlist_lock);
+				continue;
+			}
+			if (ret < 0) {
+				IIO_ERROR("Writing to device failed: %i\n",
+						(int) ret);
+				break;
+			}
+
+			/* Signal threads which completed their RW command */
+			for (thd = SLIST_FIRST(&entry->thdlist_head);
+					thd; thd = next_thd) {
+				next_thd = SLIST_NEXT(thd, dev_list_entry);
+				if (thd->active && thd->is_writer &&
+						thd->nb < sample_size)
+					signal_thread(thd, thd->nb);
+			}
+
+			pthread_mutex_unlock(&entry->thdlist_lock);
+		}
+	}
+
+	/* Signal all remaining threads */
+	for (thd = SLIST_FIRST(&entry->thdlist_head); thd; thd = next_thd) {
+		next_thd = SLIST_NEXT(thd, dev_list_entry);
+		SLIST_REMOVE(&entry->thdlist_head, thd, ThdEntry, dev_list_entry);
+		thd->wait_for_open = false;
+		signal_thread(thd, ret);
+	}
+	if (entry->buf) {
+		iio_buffer_destroy(entry->buf);
+		entry->buf = NULL;
+	}
+	entry->closed = true;
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	pthread_mutex_lock(&devlist_lock);
+	/* It is possible that a new thread has already started, make sure to
+	 * not overwrite it. */
+	if (iio_device_get_data(dev) == entry)
+		iio_device_set_data(dev, NULL);
+	pthread_mutex_unlock(&devlist_lock);
+
+	IIO_DEBUG("Stopping R/W thread for device %s\n",
+		  dev_label_or_name_or_id(dev));
+
+	dev_entry_put(entry);
+}
+
+static struct ThdEntry *parser_lookup_thd_entry(struct parser_pdata *pdata,
+	struct iio_device *dev)
+{
+	struct ThdEntry *t;
+
+	SLIST_FOREACH(t, &pdata->thdlist_head, parser_list_entry) {
+		if (t->dev == dev)
+			return t;
+	}
+
+	return NULL;
+}
+
+/* If non-NULL, 'xfer' receives the number of bytes actually transferred */
+static ssize_t rw_buffer(struct parser_pdata *pdata,
+		struct iio_device *dev, unsigned int nb, bool is_write,
+		unsigned int *xfer)
+{
+	struct DevEntry *entry;
+	struct ThdEntry *thd;
+	ssize_t ret;
+
+	if (xfer)
+		*xfer = 0;
+
+	if (!dev)
+		return -ENODEV;
+
+	thd = parser_lookup_thd_entry(pdata, dev);
+	if (!thd)
+		return -EBADF;
+
+	entry = thd->entry;
+
+	if (nb < entry->sample_size)
+		return 0;
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	if (entry->closed) {
+		pthread_mutex_unlock(&entry->thdlist_lock);
+		return -EBADF;
+	}
+
+	if (thd->nb) {
+		pthread_mutex_unlock(&entry->thdlist_lock);
+		return -EBUSY;
+	}
+
+	thd->new_client = true;
+	thd->nb = nb;
+	thd->nb_xfer = 0;
+	thd->err = 0;
+	thd->is_writer = is_write;
+	thd->active = true;
+	thd->overrun = false;
+	thd->kicked = false;
+
+	/* Each READBUF starts with a new capture window */
+	thd->win_left = 0;
+	thd->win_hist_len = 0;
+	thd->win_has_prev = false;
+
+	pthread_cond_signal(&entry->rw_ready_cond);
+
+	IIO_DEBUG("Waiting for completion...\n");
+	ret = 0;
+	while (thd->active || thd_queue_pending(thd)) {
+		if (thd->kicked) {
+			ret = -ENOBUFS;
+			break;
+		}
+
+		if (thd_queue_pending(thd))
+			ret = thd_queue_send(entry, thd);
+		else
+			ret = thd_entry_event_wait(thd, &entry->thdlist_lock,
+						   pdata->fd_in);
+		if (ret)
+			break;
+	}
+
+	if (ret < 0) {
+		/* Stop capturing for this client */
+		thd_queue_flush(entry, thd);
+		thd->nb = 0;
+		thd->active = false;
+	}
+
+	/* A client too slow to keep up gets disconnected */
+	if (thd->kicked)
+		pdata->stop = true;
+
+	if (ret == 0)
+		ret = thd->err;
+	if (xfer)
+		*xfer = thd->nb_xfer;
+	thd->nb_bytes += thd->nb_xfer;
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	/* With the binary protocol, a WRITEBUF gets one single response */
+	if (ret > 0 && ret < (ssize_t) nb && !(pdata->binary && is_write))
+		print_value(thd->pdata, 0);
+
+	IIO_DEBUG("Exiting rw_buffer with code %li\n", (long) ret);
+	if (ret < 0)
+		return ret;
+	else
+		return nb - ret;
+}
+
+static uint32_t *get_mask(const char *mask, size_t *len)
+{
+	size_t nb = (*len + 7) / 8;
+	uint32_t *ptr, *words = calloc(nb, sizeof(*words));
+	if (!words)
+		return NULL;
+
+	ptr = words + nb;
+	while (*mask) {
+		char buf[9];
+		snprintf(buf, sizeof(buf), "%.*s", 8, mask);
+		sscanf(buf, "%08x", --ptr);
+		mask += 8;
+		IIO_DEBUG("Mask[%lu]: 0x%08x\n",
+				(unsigned long) (words - ptr) / 4, *ptr);
+	}
+
+	*len = nb;
+	return words;
+}
+
+static void free_thd_entry(struct ThdEntry *t)
+{
+	unsigned int i;
+
+	if (t->nb_overruns)
+		IIO_INFO("%" PRIu64 " blocks were dropped for a slow client\n",
+			 t->nb_overruns);
+
+	if (t->queue) {
+		for (i = 0; i < server_client_queue; i++) {
+			free(t->queue[i].data);
+			free(t->queue[i].mask);
+		}
+		free(t->queue);
+	}
+	free(t->sending.data);
+	free(t->sending.mask);
+
+#if WITH_ZSTD
+	ZSTD_freeCCtx(t->zctx);
+	free(t->zbuf);
+#endif
+	if (t->mcast)
+		close(t->mcast_fd);
+	close(t->eventfd);
+	free(t->decim_coeffs);
+	free(t->decim_history);
+	free(t->decim_work);
+	free(t->win_hist);
+	free(t->win_buf);
+	free(t->win_hits);
+	free(t->demux_buf);
+	free(t->mask);
+	free(t);
+}
+
+static void remove_thd_entry(struct ThdEntry *t)
+{
+	struct DevEntry *entry = t->entry;
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	if (!entry->closed) {
+		entry->update_mask = true;
+		SLIST_REMOVE(&entry->thdlist_head, t, ThdEntry, dev_list_entry);
+		if (SLIST_EMPTY(&entry->thdlist_head) && entry->buf) {
+			entry->cancelled = true;
+			iio_buffer_cancel(entry->buf); /* Wakeup the rw thread */
+		}
+
+		pthread_cond_signal(&entry->rw_ready_cond);
+	}
+	pthread_mutex_unlock(&entry->thdlist_lock);
+	dev_entry_put(entry);
+
+	free_thd_entry(t);
+}
+
+static ssize_t get_dev_sample_size_mask(const struct iio_device *dev,
+					const uint32_t *mask, size_t words)
+{
+	unsigned int i, len, number,
+		     nb_channels = iio_device_get_channels_count(dev);
 	const struct iio_channel *prev = NULL;
 	const struct iio_channel *chn;
 	const struct iio_data_format *fmt;
 	long index;
 	ssize_t size = 0;
 
-	if (words != (nb_channels + 31) / 32)
-		return -EINVAL;
+	if (words != (nb_channels + 31) / 32)
+		return -EINVAL;
+
+	for (i = 0; i < nb_channels; i++) {
+		chn = iio_device_get_channel(dev, i);
+		number = get_channel_number(chn);
+		fmt = iio_channel_get_data_format(chn);
+		index = iio_channel_get_index(chn);
+		len = fmt->length / 8 * fmt->repeat;
+
+		if (index < 0)
+			break;
+		if (!TEST_BIT(mask, number))
+			continue;
+
+		if (prev && index == iio_channel_get_index(prev)) {
+			prev = chn;
+			continue;
+		}
+
+		if (size % len)
+			size += 2 * len - (size % len);
+		else
+			size += len;
+
+		prev = chn;
+	}
+
+	return size;
+}
+
+static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
+		size_t samples_count, const char *mask, bool cyclic)
+{
+	int ret = -ENOMEM;
+	struct DevEntry *entry;
+	struct ThdEntry *thd;
+	size_t len = strlen(mask);
+	uint32_t *words;
+	unsigned int nb_channels;
+	unsigned int cyclic_retry = 500;
+
+	if (!dev)
+		return -ENODEV;
+
+	nb_channels = iio_device_get_channels_count(dev);
+	if (len != ((nb_channels + 31) / 32) * 8)
+		return -EINVAL;
+
+	words = get_mask(mask, &len);
+	if (!words)
+		return -ENOMEM;
+
+	thd = zalloc(sizeof(*thd));
+	if (!thd)
+		goto err_free_words;
+
+	thd->wait_for_open = true;
+	thd->mask = words;
+	thd->nb = 0;
+	thd->samples_count = samples_count;
+	thd->sample_size = get_dev_sample_size_mask(dev, words, len);
+	thd->pdata = pdata;
+	thd->dev = dev;
+	thd->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+retry:
+	/* Atomically look up the thread and make sure that it is still active
+	 * or allocate new one. */
+	pthread_mutex_lock(&devlist_lock);
+	entry = iio_device_get_data(dev);
+	if (entry) {
+		if (cyclic || entry->cyclic) {
+			/* Only one client allowed in cyclic mode */
+			pthread_mutex_unlock(&devlist_lock);
+
+			/* There is an inherent race condition if a client
+			 * creates a new cyclic buffer shortly after destroying
+			 * a previous. E.g. like
+			 *
+			 *     iio_buffer_destroy(buf);
+			 *     buf = iio_device_create_buffer(dev, n, true);
+			 *
+			 * In this case the two buffers each use their own
+			 * communication channel which are unordered to each
+			 * other. E.g. the socket open might arrive before the
+			 * socket close on the host side, even though they were
+			 * sent in the opposite order on the client side. This
+			 * race condition can cause an error being reported back
+			 * to the client, even though the code on the client
+			 * side was well formed and would work fine e.g. using
+			 * the local backend.
+			 *
+			 * To avoid this issue go to sleep for up to 50ms in
+			 * intervals of 100us. This should be enough time for
+			 * the issue to resolve itself. If there actually is
+			 * contention on the buffer an error will eventually be
+			 * returned in which case the additional delay cause by
+			 * the retires should not matter too much.
+			 *
+			 * This is not pretty but it works.
+			 */
+			if (cyclic_retry) {
+				struct timespec wait;
+				wait.tv_sec = 0;
+				wait.tv_nsec = (100 * 1000);
+				cyclic_retry--;
+				nanosleep(&wait, &wait);
+				goto retry;
+			}
+
+			ret = -EBUSY;
+			goto err_free_thd;
+		}
+
+		pthread_mutex_lock(&entry->thdlist_lock);
+		if (!entry->closed) {
+			pthread_mutex_unlock(&devlist_lock);
+
+			entry->ref_count++;
+
+			SLIST_INSERT_HEAD(&entry->thdlist_head, thd, dev_list_entry);
+			thd->entry = entry;
+			entry->update_mask = true;
+			IIO_DEBUG("Added thread to client list\n");
+
+			pthread_cond_signal(&entry->rw_ready_cond);
+
+			/* Wait until the device is opened by the rw thread */
+			while (thd->wait_for_open) {
+				ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
+				if (ret)
+					break;
+			}
+			pthread_mutex_unlock(&entry->thdlist_lock);
+
+			if (ret == 0)
+				ret = (int) thd->err;
+			if (ret < 0)
+				remove_thd_entry(thd);
+			else
+				SLIST_INSERT_HEAD(&pdata->thdlist_head, thd, parser_list_entry);
+			return ret;
+		} else {
+			pthread_mutex_unlock(&entry->thdlist_lock);
+		}
+	}
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry) {
+		pthread_mutex_unlock(&devlist_lock);
+		goto err_free_thd;
+	}
+
+	entry->ref_count = 2; /* One for thread, one for the client */
+
+	entry->mask = malloc(len * sizeof(*words));
+	if (!entry->mask) {
+		pthread_mutex_unlock(&devlist_lock);
+		goto err_free_entry;
+	}
+
+	entry->cyclic = cyclic;
+	entry->nb_words = len;
+	entry->update_mask = true;
+	entry->dev = dev;
+	entry->buf = NULL;
+	SLIST_INIT(&entry->thdlist_head);
+	SLIST_INSERT_HEAD(&entry->thdlist_head, thd, dev_list_entry);
+	thd->entry = entry;
+	IIO_DEBUG("Added thread to client list\n");
+
+	pthread_mutex_init(&entry->thdlist_lock, NULL);
+	pthread_cond_init(&entry->rw_ready_cond, NULL);
+
+	ret = thread_pool_add_thread_class(main_thread_pool, rw_thd, entry,
+					   "rw_thd", THREAD_DATA);
+	if (ret) {
+		pthread_mutex_unlock(&devlist_lock);
+		goto err_free_entry_mask;
+	}
+
+	IIO_DEBUG("Adding new device thread to device list\n");
+	iio_device_set_data(dev, entry);
+	pthread_mutex_unlock(&devlist_lock);
+
+	pthread_mutex_lock(&entry->thdlist_lock);
+	/* Wait until the device is opened by the rw thread */
+	while (thd->wait_for_open) {
+		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
+		if (ret)
+			break;
+	}
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	if (ret == 0)
+		ret = (int) thd->err;
+	if (ret < 0)
+		remove_thd_entry(thd);
+	else
+		SLIST_INSERT_HEAD(&pdata->thdlist_head, thd, parser_list_entry);
+	return ret;
+
+err_free_entry_mask:
+	free(entry->mask);
+err_free_entry:
+	free(entry);
+err_free_thd:
+	close(thd->eventfd);
+	free(thd);
+err_free_words:
+	free(words);
+	return ret;
+}
+
+static int close_dev_helper(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	struct ThdEntry *t;
+
+	if (!dev)
+		return -ENODEV;
+
+	t = parser_lookup_thd_entry(pdata, dev);
+	if (!t)
+		return -ENXIO;
+
+	SLIST_REMOVE(&pdata->thdlist_head, t, ThdEntry, parser_list_entry);
+	remove_thd_entry(t);
+
+	return 0;
+}
+
+int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
+		size_t samples_count, const char *mask, bool cyclic)
+{
+	int ret = open_dev_helper(pdata, dev, samples_count, mask, cyclic);
+	print_value(pdata, ret);
+	return ret;
+}
+
+int close_dev(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	int ret = close_dev_helper(pdata, dev);
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t rw_dev(struct parser_pdata *pdata, struct iio_device *dev,
+		unsigned int nb, bool is_write)
+{
+	ssize_t ret = rw_buffer(pdata, dev, nb, is_write, NULL);
+	if (ret <= 0 || is_write)
+		print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t read_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
+		const char *attr, enum iio_attr_type type)
+{
+	/* We use a very large buffer here, as if attr is NULL all the
+	 * attributes will be read, which may represents a few kilobytes worth
+	 * of data. */
+	char buf[0x10000];
+	ssize_t ret = -EINVAL;
+
+	if (!dev) {
+		print_value(pdata, -ENODEV);
+		return -ENODEV;
+	}
+
+	switch (type) {
+		case IIO_ATTR_TYPE_DEVICE:
+			ret = iio_device_attr_read(dev, attr, buf, sizeof(buf) - 1);
+			break;
+		case IIO_ATTR_TYPE_DEBUG:
+			ret = iio_device_debug_attr_read(dev,
+				attr, buf, sizeof(buf) - 1);
+			break;
+		case IIO_ATTR_TYPE_BUFFER:
+			ret = iio_device_buffer_attr_read(dev,
+							attr, buf, sizeof(buf) - 1);
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+	}
+	print_value(pdata, ret);
+	if (ret < 0)
+		return ret;
+
+	buf[ret] = '\n';
+	return write_all(pdata, buf, ret + 1);
+}
+
+ssize_t write_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
+		const char *attr, size_t len, enum iio_attr_type type)
+{
+	ssize_t ret = -ENOMEM;
+	char *buf;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	buf = malloc(len);
+	if (!buf)
+		goto err_print_value;
+
+	ret = read_all(pdata, buf, len);
+	if (ret < 0)
+		goto err_free_buffer;
+
+	switch (type) {
+		case IIO_ATTR_TYPE_DEVICE:
+			ret = iio_device_attr_write_raw(dev, attr, buf, len);
+			break;
+		case IIO_ATTR_TYPE_DEBUG:
+			ret = iio_device_debug_attr_write_raw(dev, attr, buf, len);
+			break;
+		case IIO_ATTR_TYPE_BUFFER:
+			ret = iio_device_buffer_attr_write_raw(dev, attr, buf, len);
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+	}
+
+err_free_buffer:
+	free(buf);
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t read_chn_attr(struct parser_pdata *pdata,
+		struct iio_channel *chn, const char *attr)
+{
+	char buf[1024];
+	ssize_t ret = -ENODEV;
+
+	if (chn)
+		ret = iio_channel_attr_read(chn, attr, buf, sizeof(buf) - 1);
+	else if (pdata->dev)
+		ret = -ENXIO;
+	print_value(pdata, ret);
+	if (ret < 0)
+		return ret;
+
+	buf[ret] = '\n';
+	return write_all(pdata, buf, ret + 1);
+}
+
+ssize_t write_chn_attr(struct parser_pdata *pdata,
+		struct iio_channel *chn, const char *attr, size_t len)
+{
+	ssize_t ret = -ENOMEM;
+	char *buf = malloc(len);
+	if (!buf)
+		goto err_print_value;
+
+	ret = read_all(pdata, buf, len);
+	if (ret < 0)
+		goto err_free_buffer;
+
+	if (chn)
+		ret = iio_channel_attr_write_raw(chn, attr, buf, len);
+	else if (pdata->dev)
+		ret = -ENXIO;
+	else
+		ret = -ENODEV;
+err_free_buffer:
+	free(buf);
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t set_trigger(struct parser_pdata *pdata,
+		struct iio_device *dev, const char *trigger)
+{
+	struct iio_device *trig = NULL;
+	ssize_t ret = -ENOENT;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	if (trigger) {
+		trig = iio_context_find_device(pdata->ctx, trigger);
+		if (!trig)
+			goto err_print_value;
+	}
+
+	ret = iio_device_set_trigger(dev, trig);
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t get_trigger(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	const struct iio_device *trigger;
+	ssize_t ret;
+
+	if (!dev) {
+		print_value(pdata, -ENODEV);
+		return -ENODEV;
+	}
+
+	ret = iio_device_get_trigger(dev, &trigger);
+	if (!ret && trigger) {
+		const char *name = iio_device_get_name(trigger);
+		char buf[256];
+
+		ret = strlen(name);
+		print_value(pdata, ret);
+
+		snprintf(buf, sizeof(buf), "%s\n", name);
+		ret = write_all(pdata, buf, ret + 1);
+	} else {
+		print_value(pdata, ret);
+	}
+	return ret;
+}
+
+ssize_t get_timestamp(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	struct ThdEntry *thd;
+	uint64_t timestamp;
+	char buf[32];
+	ssize_t ret;
+
+	if (!dev) {
+		print_value(pdata, -ENODEV);
+		return -ENODEV;
+	}
+
+	thd = parser_lookup_thd_entry(pdata, dev);
+	if (!thd) {
+		print_value(pdata, -EBADF);
+		return -EBADF;
+	}
+
+	pthread_mutex_lock(&thd->entry->thdlist_lock);
+	timestamp = thd->timestamp;
+	pthread_mutex_unlock(&thd->entry->thdlist_lock);
+
+	ret = snprintf(buf, sizeof(buf), "%" PRIu64 "\n", timestamp);
+	print_value(pdata, ret - 1);
+
+	return write_all(pdata, buf, ret);
+}
+
+int set_timeout(struct parser_pdata *pdata, unsigned int timeout)
+{
+	int ret = iio_context_set_timeout(pdata->ctx, timeout);
+	print_value(pdata, ret);
+	return ret;
+}
+
+struct stats_buf {
+	char *buf;
+	size_t len, size;
+	bool failed;
+};
+
+static void stats_printf(struct stats_buf *sb, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void stats_printf(struct stats_buf *sb, const char *fmt, ...)
+{
+	va_list ap;
+	size_t size;
+	char *buf;
+	int ret;
+
+	if (sb->failed)
+		return;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(sb->buf + sb->len, sb->size - sb->len, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0) {
+		sb->failed = true;
+		return;
+	}
+
+	if (sb->len + (size_t) ret >= sb->size) {
+		size = 2 * (sb->len + (size_t) ret + 1);
+		buf = realloc(sb->buf, size);
+		if (!buf) {
+			sb->failed = true;
+			return;
+		}
+
+		sb->buf = buf;
+		sb->size = size;
+
+		va_start(ap, fmt);
+		ret = vsnprintf(sb->buf + sb->len, sb->size - sb->len, fmt, ap);
+		va_end(ap);
+	}
+
+	sb->len += (size_t) ret;
+}
+
+static void stats_print_commands(struct stats_buf *sb)
+{
+	unsigned int i, j;
+	uint64_t count;
+
+	stats_printf(sb, "# TYPE iiod_command_duration_us histogram\n");
+
+	for (i = 0; i <= STATS_OTHER; i++) {
+		const struct cmd_stats *stats = &cmd_stats[i];
+
+		if (!stats_load(&stats->count))
+			continue;
+
+		for (j = 0, count = 0; j < STATS_NB_BUCKETS - 1; j++) {
+			count += stats_load(&stats->buckets[j]);
+			stats_printf(sb, "iiod_command_duration_us_bucket{command=\"%s\",le=\"%llu\"} %" PRIu64 "\n",
+				     cmd_names[i], 1ull << j, count);
+		}
+
+		count += stats_load(&stats->buckets[j]);
+		stats_printf(sb, "iiod_command_duration_us_bucket{command=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+			     cmd_names[i], count);
+		stats_printf(sb, "iiod_command_duration_us_sum{command=\"%s\"} %" PRIu64 "\n",
+			     cmd_names[i], stats_load(&stats->sum_us));
+		stats_printf(sb, "iiod_command_duration_us_count{command=\"%s\"} %" PRIu64 "\n",
+			     cmd_names[i], count);
+	}
+}
+
+/* Counters of the opened devices and of their clients, in the order of
+ * dev_metrics[] and client_metrics[] */
+enum {
+	DEV_CLIENTS,
+	DEV_REFILLS,
+	DEV_REFILL_BYTES,
+	DEV_REFILL_US,
+	DEV_REFILL_MAX_US,
+	DEV_PUSHES,
+	DEV_PUSH_BYTES,
+	DEV_PUSH_US,
+	NB_DEV_METRICS,
+};
+
+enum {
+	CLIENT_BYTES,
+	CLIENT_OVERRUNS,
+	CLIENT_QUEUE_LAG,
+	CLIENT_QUEUE_MAX_LAG,
+	NB_CLIENT_METRICS,
+};
+
+struct stats_metric {
+	const char *name, *type;
+};
+
+static const struct stats_metric dev_metrics[NB_DEV_METRICS] = {
+	[DEV_CLIENTS] = { "iiod_device_clients", "gauge" },
+	[DEV_REFILLS] = { "iiod_device_refills_total", "counter" },
+	[DEV_REFILL_BYTES] = { "iiod_device_refill_bytes_total", "counter" },
+	[DEV_REFILL_US] = { "iiod_device_refill_us_total", "counter" },
+	[DEV_REFILL_MAX_US] = { "iiod_device_refill_max_us", "gauge" },
+	[DEV_PUSHES] = { "iiod_device_pushes_total", "counter" },
+	[DEV_PUSH_BYTES] = { "iiod_device_push_bytes_total", "counter" },
+	[DEV_PUSH_US] = { "iiod_device_push_us_total", "counter" },
+};
+
+static const struct stats_metric client_metrics[NB_CLIENT_METRICS] = {
+	[CLIENT_BYTES] = { "iiod_client_bytes_total", "counter" },
+	[CLIENT_OVERRUNS] = { "iiod_client_overruns_total", "counter" },
+	[CLIENT_QUEUE_LAG] = { "iiod_client_queue_lag", "gauge" },
+	[CLIENT_QUEUE_MAX_LAG] = { "iiod_client_queue_max_lag", "gauge" },
+};
+
+struct dev_stats {
+	const char *id;
+	uint64_t values[NB_DEV_METRICS];
+};
+
+struct client_stats {
+	const char *dev;
+	unsigned int id;
+	bool is_writer;
+	uint64_t values[NB_CLIENT_METRICS];
+};
+
+/* Called with the devlist_lock and the thdlist_lock of the device held */
+static int stats_snapshot_device(const struct DevEntry *entry,
+		struct dev_stats *dev, struct client_stats **clients,
+		unsigned int *nb_clients)
+{
+	const struct ThdEntry *thd;
+	struct client_stats *client;
+
+	dev->id = iio_device_get_id(entry->dev);
+	dev->values[DEV_CLIENTS] = 0;
+	dev->values[DEV_REFILLS] = entry->nb_refills;
+	dev->values[DEV_REFILL_BYTES] = entry->refill_bytes;
+	dev->values[DEV_REFILL_US] = entry->refill_us;
+	dev->values[DEV_REFILL_MAX_US] = entry->max_refill_us;
+	dev->values[DEV_PUSHES] = entry->nb_pushes;
+	dev->values[DEV_PUSH_BYTES] = entry->push_bytes;
+	dev->values[DEV_PUSH_US] = entry->push_us;
+
+	SLIST_FOREACH(thd, &entry->thdlist_head, dev_list_entry) {
+		client = realloc(*clients, (*nb_clients + 1) * sizeof(*client));
+		if (!client)
+			return -ENOMEM;
+
+		*clients = client;
+		client += (*nb_clients)++;
+		dev->values[DEV_CLIENTS]++;
+
+		client->dev = dev->id;
+		client->id = thd->pdata->id;
+		client->is_writer = thd->is_writer;
+		client->values[CLIENT_BYTES] = thd->nb_bytes + thd->nb_xfer;
+		client->values[CLIENT_OVERRUNS] = thd->nb_overruns;
+		client->values[CLIENT_QUEUE_LAG] =
+			thd->queue_head - thd->queue_tail;
+		client->values[CLIENT_QUEUE_MAX_LAG] = thd->max_lag;
+	}
+
+	return 0;
+}
+
+/*
+ * The statistics of IIOD, in the text format of Prometheus: the commands
+ * run, with a histogram of their durations, and for each opened device, the
+ * refills and pushes of its buffer and the transfers of each client. The
+ * clients are designated by the number of their session. The counters are
+ * copied first, so that the devices are not kept locked while formatting.
+ * Returns a string to free with free(), or NULL on error.
+ */
+char * get_stats(struct iio_context *ctx, size_t *len)
+{
+	unsigned int i, j, nb_devs = 0, nb_clients = 0;
+	struct client_stats *clients = NULL;
+	struct stats_buf sb = { .size = 4096, };
+	struct dev_stats *devs;
+	int ret = 0;
+
+	devs = calloc(iio_context_get_devices_count(ctx) + 1, sizeof(*devs));
+	if (!devs)
+		return NULL;
+
+	for (i = 0; !ret && i < iio_context_get_devices_count(ctx); i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct DevEntry *entry;
+
+		/* The R/W thread can't drop the entry meanwhile, as it
+		 * needs the devlist_lock to do so */
+		pthread_mutex_lock(&devlist_lock);
+		entry = iio_device_get_data(dev);
+		if (entry) {
+			pthread_mutex_lock(&entry->thdlist_lock);
+			ret = stats_snapshot_device(entry, &devs[nb_devs++],
+						    &clients, &nb_clients);
+			pthread_mutex_unlock(&entry->thdlist_lock);
+		}
+		pthread_mutex_unlock(&devlist_lock);
+	}
+
+	sb.buf = malloc(sb.size);
+	if (ret || !sb.buf)
+		goto err_free_stats;
+
+	sb.buf[0] = '\0';
+
+	stats_printf(&sb, "# TYPE iiod_sessions gauge\n");
+	stats_printf(&sb, "iiod_sessions %" PRIu64 "\n",
+		     stats_load(&nb_sessions));
+	stats_printf(&sb, "# TYPE iiod_sessions_total counter\n");
+	stats_printf(&sb, "iiod_sessions_total %" PRIu64 "\n",
+		     stats_load(&nb_sessions_total));
+
+	stats_print_commands(&sb);
+
+	/* All the samples of a metric have to come as one group */
+	for (j = 0; nb_devs && j < NB_DEV_METRICS; j++) {
+		stats_printf(&sb, "# TYPE %s %s\n",
+			     dev_metrics[j].name, dev_metrics[j].type);
+
+		for (i = 0; i < nb_devs; i++)
+			stats_printf(&sb, "%s{device=\"%s\"} %" PRIu64 "\n",
+				     dev_metrics[j].name, devs[i].id,
+				     devs[i].values[j]);
+	}
+
+	for (j = 0; nb_clients && j < NB_CLIENT_METRICS; j++) {
+		stats_printf(&sb, "# TYPE %s %s\n",
+			     client_metrics[j].name, client_metrics[j].type);
+
+		for (i = 0; i < nb_clients; i++)
+			stats_printf(&sb, "%s{device=\"%s\",client=\"%u\",direction=\"%s\"} %" PRIu64 "\n",
+				     client_metrics[j].name, clients[i].dev,
+				     clients[i].id,
+				     clients[i].is_writer ? "output" : "input",
+				     clients[i].values[j]);
+	}
+
+	if (sb.failed)
+		goto err_free_stats;
+
+	free(clients);
+	free(devs);
+
+	if (len)
+		*len = sb.len;
+	return sb.buf;
+
+err_free_stats:
+	free(sb.buf);
+	free(clients);
+	free(devs);
+	return NULL;
+}
+
+int set_buffers_count(struct parser_pdata *pdata,
+		struct iio_device *dev, long value)
+{
+	unsigned int i, nb = (unsigned int) value;
+	struct timespec wait;
+	int ret = -EINVAL;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	if (nb >= 1) {
+		/*
+		 * Avoid the same race condition described in open_dev_helper().
+		 * We must be sure that the buffer has not been enabled in order
+		 * to set the number of kernel buffers.
+		 */
+		for (i = 0; i < 500; i++) {
+			ret = iio_device_set_kernel_buffers_count(dev, nb);
+			if (ret != -EBUSY)
+				break;
+
+			wait.tv_sec = 0;
+			wait.tv_nsec = (100 * 1000);
+			do {
+				ret = nanosleep(&wait, &wait);
+			} while (ret == -1 && errno == EINTR);
+		}
+	}
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
+
+int set_low_latency(struct parser_pdata *pdata,
+		struct iio_device *dev, long value)
+{
+	struct timespec wait;
+	unsigned int i;
+	int ret = -EINVAL;
+
+	if (!dev) {
+		ret = -ENODEV;
+		goto err_print_value;
+	}
+
+	if (value == 0 || value == 1) {
+		/* Same race condition as in set_buffers_count() */
+		for (i = 0; i < 500; i++) {
+			ret = iio_device_set_low_latency(dev, !!value);
+			if (ret != -EBUSY)
+				break;
+
+			wait.tv_sec = 0;
+			wait.tv_nsec = (100 * 1000);
+			while (nanosleep(&wait, &wait) == -1 && errno == EINTR);
+		}
+	}
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
+
+ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
+{
+	size_t bytes_read = 0;
+	ssize_t ret;
+	bool found;
+
+	if (pdata->is_usb)
+	      return pdata->readfd(pdata, buf, len);
+
+	if (pdata->fd_in_is_socket) {
+		struct pollfd pfd[2];
+
+		pfd[0].fd = pdata->fd_in;
+		pfd[0].events = POLLIN | POLLRDHUP;
+		pfd[0].revents = 0;
+		pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
+		pfd[1].events = POLLIN;
+		pfd[1].revents = 0;
+
+		do {
+			size_t i, to_trunc;
+
+			poll_nointr(pfd, 2);
+
+			if (pfd[1].revents & POLLIN ||
+					pfd[0].revents & POLLRDHUP)
+				return 0;
+
+			/* First read from the socket, without advancing the
+			 * read offset */
+			ret = recv(pdata->fd_in, buf, len,
+					MSG_NOSIGNAL | MSG_PEEK);
+			if (ret < 0)
+				return -errno;
+
+			/* Lookup for the trailing \n */
+			for (i = 0; i < (size_t) ret && buf[i] != '\n'; i++);
+			found = i < (size_t) ret;
+
+			len -= ret;
+			buf += ret;
 
-	for (i = 0; i < nb_channels; i++) {
-		chn = iio_device_get_channel(dev, i);
-		number = get_channel_number(chn);
-		fmt = iio_channel_get_data_format(chn);
-		index = iio_channel_get_index(chn);
-		len = fmt->length / 8 * fmt->repeat;
+			to_trunc = found ? i + 1 : (size_t) ret;
 
-		if (index < 0)
-			break;
-		if (!TEST_BIT(mask, number))
-			continue;
+			/* Advance the read offset after the \n if found, or
+			 * after the last character read otherwise */
+			ret = recv(pdata->fd_in, NULL, to_trunc,
+					MSG_NOSIGNAL | MSG_TRUNC);
+			if (ret < 0)
+				return -errno;
 
-		if (prev && index == iio_channel_get_index(prev)) {
-			prev = chn;
-			continue;
+			bytes_read += to_trunc;
+		} while (!found && len);
+	} else {
+		while (len) {
+			ret = pdata->readfd(pdata, buf, 1);
+			if (ret < 0)
+			      return ret;
+
+			bytes_read++;
+
+			if (*buf == '\n')
+			      break;
+
+			len--;
+			buf++;
 		}
 
-		if (size % len)
-			size += 2 * len - (size % len);
-		else
-			size += len;
+		found = !!len;
+	}
 
-		prev = chn;
+	return found ? (ssize_t) bytes_read : -EIO;
+}
+
+static int bin_discard(struct parser_pdata *pdata, size_t len)
+{
+	char buf[256];
+	ssize_t ret;
+
+	while (len) {
+		ret = read_all(pdata, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (ret < 0)
+			return (int) ret;
+
+		len -= ret;
 	}
 
-	return size;
+	return 0;
 }
 
-static int open_dev_helper(struct parser_pdata *pdata, struct iio_device *dev,
-		size_t samples_count, const char *mask, bool cyclic)
+static ssize_t bin_reply(struct parser_pdata *pdata, int32_t code,
+		const void *src, size_t len)
 {
-	int ret = -ENOMEM;
-	struct DevEntry *entry;
-	struct ThdEntry *thd;
-	size_t len = strlen(mask);
-	uint32_t *words;
-	unsigned int nb_channels;
-	unsigned int cyclic_retry = 500;
+	ssize_t ret;
+
+	ret = write_bin_header(pdata, code, 0, (uint32_t) len);
+	if (ret >= 0 && len)
+		ret = write_all(pdata, src, len);
+	if (ret < 0)
+		pdata->stop = true;
+	return ret;
+}
+
+void print_stats(struct parser_pdata *pdata)
+{
+	size_t len;
+	char *str;
+
+	str = get_stats(pdata->ctx, &len);
+	if (!str) {
+		print_value(pdata, -ENOMEM);
+		return;
+	}
+
+	if (pdata->binary) {
+		bin_reply(pdata, (int32_t) len, str, len);
+	} else {
+		if (!pdata->verbose)
+			print_value(pdata, len);
+		output(pdata, str);
+	}
+
+	free(str);
+}
+
+static ssize_t bin_read_attr(struct parser_pdata *pdata,
+		struct iio_device *dev, struct iio_channel *chn,
+		const char *attr, uint8_t type)
+{
+	/* Reading all the attributes at once may represent a few kilobytes
+	 * worth of data, see read_dev_attr() */
+	size_t len = 0x10000;
+	char *buf;
+	ssize_t ret;
+
+	buf = malloc(len);
+	if (!buf)
+		return bin_reply(pdata, -ENOMEM, NULL, 0);
 
 	if (!dev)
-		return -ENODEV;
+		ret = -ENODEV;
+	else if (pdata->bin_hdr.chn != IIOD_BIN_NONE)
+		ret = chn ? iio_channel_attr_read(chn, attr, buf, len) : -ENXIO;
+	else if (type == IIO_ATTR_TYPE_DEVICE)
+		ret = iio_device_attr_read(dev, attr, buf, len);
+	else if (type == IIO_ATTR_TYPE_DEBUG)
+		ret = iio_device_debug_attr_read(dev, attr, buf, len);
+	else if (type == IIO_ATTR_TYPE_BUFFER)
+		ret = iio_device_buffer_attr_read(dev, attr, buf, len);
+	else
+		ret = -EINVAL;
 
-	nb_channels = iio_device_get_channels_count(dev);
-	if (len != ((nb_channels + 31) / 32) * 8)
-		return -EINVAL;
+	ret = bin_reply(pdata, (int32_t) ret, buf, ret > 0 ? (size_t) ret : 0);
+	free(buf);
+	return ret;
+}
 
-	words = get_mask(mask, &len);
-	if (!words)
-		return -ENOMEM;
+static void bin_write_attr(struct parser_pdata *pdata,
+		struct iio_device *dev, struct iio_channel *chn,
+		const char *payload, size_t len)
+{
+	size_t name_len = (size_t) pdata->bin_hdr.code;
+	uint8_t type = pdata->bin_hdr.type;
+	char *attr = NULL;
+	ssize_t ret;
 
-	thd = zalloc(sizeof(*thd));
-	if (!thd)
-		goto err_free_words;
+	if (pdata->bin_hdr.code < 0 || name_len > len) {
+		print_value(pdata, -EINVAL);
+		return;
+	}
 
-	thd->wait_for_open = true;
-	thd->mask = words;
-	thd->nb = 0;
-	thd->samples_count = samples_count;
-	thd->sample_size = get_dev_sample_size_mask(dev, words, len);
-	thd->pdata = pdata;
-	thd->dev = dev;
-	thd->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (name_len) {
+		attr = strndup(payload, name_len);
+		if (!attr) {
+			print_value(pdata, -ENOMEM);
+			return;
+		}
+	}
 
-retry:
-	/* Atomically look up the thread and make sure that it is still active
-	 * or allocate new one. */
-	pthread_mutex_lock(&devlist_lock);
-	entry = iio_device_get_data(dev);
-	if (entry) {
-		if (cyclic || entry->cyclic) {
-			/* Only one client allowed in cyclic mode */
-			pthread_mutex_unlock(&devlist_lock);
+	payload += name_len;
+	len -= name_len;
 
-			/* There is an inherent race condition if a client
-			 * creates a new cyclic buffer shortly after destroying
-			 * a previous. E.g. like
-			 *
-			 *     iio_buffer_destroy(buf);
-			 *     buf = iio_device_create_buffer(dev, n, true);
-			 *
-			 * In this case the two buffers each use their own
-			 * communication channel which are unordered to each
-			 * other. E.g. the socket open might arrive before the
-			 * socket close on the host side, even though they were
-			 * sent in the opposite order on the client side. This
-			 * race condition can cause an error being reported back
-			 * to the client, even though the code on the client
-			 * side was well formed and would work fine e.g. using
-			 * the local backend.
-			 *
-			 * To avoid this issue go to sleep for up to 50ms in
-			 * intervals of 100us. This should be enough time for
-			 * the issue to resolve itself. If there actually is
-			 * contention on the buffer an error will eventually be
-			 * returned in which case the additional delay cause by
-			 * the retires should not matter too much.
-			 *
-			 * This is not pretty but it works.
-			 */
-			if (cyclic_retry) {
-				struct timespec wait;
-				wait.tv_sec = 0;
-				wait.tv_nsec = (100 * 1000);
-				cyclic_retry--;
-				nanosleep(&wait, &wait);
-				goto retry;
-			}
+	if (!dev)
+		ret = -ENODEV;
+	else if (pdata->bin_hdr.chn != IIOD_BIN_NONE)
+		ret = chn ? iio_channel_attr_write_raw(chn, attr, payload, len)
+			: -ENXIO;
+	else if (type == IIO_ATTR_TYPE_DEVICE)
+		ret = iio_device_attr_write_raw(dev, attr, payload, len);
+	else if (type == IIO_ATTR_TYPE_DEBUG)
+		ret = iio_device_debug_attr_write_raw(dev, attr, payload, len);
+	else if (type == IIO_ATTR_TYPE_BUFFER)
+		ret = iio_device_buffer_attr_write_raw(dev, attr, payload, len);
+	else
+		ret = -EINVAL;
 
-			ret = -EBUSY;
-			goto err_free_thd;
+	free(attr);
+	print_value(pdata, ret);
+}
+
+static void bin_open(struct parser_pdata *pdata, struct iio_device *dev,
+		const uint8_t *payload, size_t len)
+{
+	size_t i, nb_words = len / 4;
+	char *mask, *ptr;
+
+	if (len % 4) {
+		print_value(pdata, -EINVAL);
+		return;
+	}
+
+	/* open_dev() takes the mask as an hexadecimal string, most
+	 * significant word first */
+	mask = malloc(nb_words * 8 + 1);
+	if (!mask) {
+		print_value(pdata, -ENOMEM);
+		return;
+	}
+
+	for (i = nb_words, ptr = mask; i > 0; i--, ptr += 8)
+		sprintf(ptr, "%08" PRIx32, iiod_bin_get_le32(&payload[(i - 1) * 4]));
+	*ptr = '\0';
+
+	open_dev(pdata, dev, (size_t) pdata->bin_hdr.code, mask,
+			!!(pdata->bin_hdr.type & IIOD_BIN_CYCLIC));
+	free(mask);
+}
+
+static void bin_get_trigger(struct parser_pdata *pdata, struct iio_device *dev)
+{
+	const struct iio_device *trigger = NULL;
+	const char *name = NULL;
+	int ret = -ENODEV;
+
+	if (dev)
+		ret = iio_device_get_trigger(dev, &trigger);
+	if (!ret && trigger)
+		name = iio_device_get_name(trigger);
+
+	bin_reply(pdata, ret, name, name ? strlen(name) : 0);
+}
+
+static void bin_get_timestamp(struct parser_pdata *pdata,
+		struct iio_device *dev)
+{
+	struct ThdEntry *thd;
+	uint64_t timestamp;
+	uint8_t buf[8];
+
+	thd = dev ? parser_lookup_thd_entry(pdata, dev) : NULL;
+	if (!thd) {
+		print_value(pdata, dev ? -EBADF : -ENODEV);
+		return;
+	}
+
+	pthread_mutex_lock(&thd->entry->thdlist_lock);
+	timestamp = thd->timestamp;
+	pthread_mutex_unlock(&thd->entry->thdlist_lock);
+
+	iiod_bin_put_le32(buf, (uint32_t) timestamp);
+	iiod_bin_put_le32(buf + 4, (uint32_t) (timestamp >> 32));
+	bin_reply(pdata, 0, buf, sizeof(buf));
+}
+
+static bool dev_has_output_scan_elements(const struct iio_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		const struct iio_channel *chn = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_scan_element(chn) &&
+		    iio_channel_is_output(chn))
+			return true;
+	}
+
+	return false;
+}
+
+int set_decimation(struct parser_pdata *pdata,
+		struct iio_device *dev, long factor)
+{
+	float *coeffs = NULL, *history = NULL;
+	unsigned int nb_taps = 0;
+	struct ThdEntry *thd;
+	int ret = 0;
+
+	thd = dev ? parser_lookup_thd_entry(pdata, dev) : NULL;
+	if (!thd) {
+		ret = dev ? -EBADF : -ENODEV;
+		goto err_print_value;
+	}
+
+	if (factor < 1 || factor > DECIM_MAX_FACTOR ||
+	    dev_has_output_scan_elements(dev)) {
+		ret = -EINVAL;
+		goto err_print_value;
+	}
+
+	if (factor > 1) {
+		nb_taps = (unsigned int) factor * DECIM_TAPS_PER_PHASE;
+		coeffs = decim_design((unsigned int) factor, nb_taps);
+		history = calloc((size_t) iio_device_get_channels_count(dev) *
+				 (nb_taps - 1), sizeof(*history));
+		if (!coeffs || !history) {
+			ret = -ENOMEM;
+			goto err_free;
 		}
+	}
 
-		pthread_mutex_lock(&entry->thdlist_lock);
-		if (!entry->closed) {
-			pthread_mutex_unlock(&devlist_lock);
+	pthread_mutex_lock(&thd->entry->thdlist_lock);
+	if (thd->mcast || (factor > 1 && thd->win_edge != IIO_WINDOW_OFF)) {
+		ret = -EBUSY;
+	} else {
+		float *tmp;
 
-			entry->ref_count++;
+		/* The filter starts again with zeros in its history */
+		thd->decim = (unsigned int) factor;
+		thd->decim_taps = nb_taps;
+		thd->decim_phase = 0;
 
-			SLIST_INSERT_HEAD(&entry->thdlist_head, thd, dev_list_entry);
-			thd->entry = entry;
-			entry->update_mask = true;
-			IIO_DEBUG("Added thread to client list\n");
+		tmp = thd->decim_coeffs;
+		thd->decim_coeffs = coeffs;
+		coeffs = tmp;
 
-			pthread_cond_signal(&entry->rw_ready_cond);
+		tmp = thd->decim_history;
+		thd->decim_history = history;
+		history = tmp;
+	}
+	pthread_mutex_unlock(&thd->entry->thdlist_lock);
 
-			/* Wait until the device is opened by the rw thread */
-			while (thd->wait_for_open) {
-				ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
-				if (ret)
-					break;
-			}
-			pthread_mutex_unlock(&entry->thdlist_lock);
+err_free:
+	free(coeffs);
+	free(history);
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
 
-			if (ret == 0)
-				ret = (int) thd->err;
-			if (ret < 0)
-				remove_thd_entry(thd);
-			else
-				SLIST_INSERT_HEAD(&pdata->thdlist_head, thd, parser_list_entry);
-			return ret;
-		} else {
-			pthread_mutex_unlock(&entry->thdlist_lock);
+static const char * const window_edges[] = {
+	[IIO_WINDOW_OFF] = "OFF",
+	[IIO_WINDOW_RISING] = "RISING",
+	[IIO_WINDOW_FALLING] = "FALLING",
+	[IIO_WINDOW_ABOVE] = "ABOVE",
+	[IIO_WINDOW_BELOW] = "BELOW",
+};
+
+#define NB_WINDOW_EDGES (sizeof(window_edges) / sizeof(*window_edges))
+
+int window_edge_from_name(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NB_WINDOW_EDGES; i++)
+		if (!strcasecmp(name, window_edges[i]))
+			return (int) i;
+
+	return -EINVAL;
+}
+
+int set_window(struct parser_pdata *pdata, struct iio_device *dev,
+		const struct iio_channel *chn, int edge, int64_t level,
+		unsigned long pre, unsigned long post)
+{
+	unsigned int number = 0;
+	struct ThdEntry *thd;
+	void *hist = NULL;
+	int ret = 0;
+
+	thd = dev ? parser_lookup_thd_entry(pdata, dev) : NULL;
+	if (!thd) {
+		ret = dev ? -EBADF : -ENODEV;
+		goto err_print_value;
+	}
+
+	if (edge < 0 || edge >= (int) NB_WINDOW_EDGES ||
+	    dev_has_output_scan_elements(dev)) {
+		ret = -EINVAL;
+		goto err_print_value;
+	}
+
+	if (edge != IIO_WINDOW_OFF) {
+		/* The channel must be one of the client's */
+		if (chn)
+			number = get_channel_number(chn);
+		if (!chn || iio_channel_get_device(chn) != dev ||
+		    iio_channel_get_index(chn) < 0 ||
+		    !TEST_BIT(thd->mask, number) ||
+		    !sample_format_is_valid(iio_channel_get_data_format(chn)) ||
+		    !post || post > WINDOW_MAX_SAMPLES ||
+		    pre > WINDOW_MAX_SAMPLES) {
+			ret = -EINVAL;
+			goto err_print_value;
+		}
+
+		if (pre) {
+			hist = malloc(pre * thd->sample_size);
+			if (!hist) {
+				ret = -ENOMEM;
+				goto err_print_value;
+			}
 		}
 	}
 
-	entry = zalloc(sizeof(*entry));
-	if (!entry) {
-		pthread_mutex_unlock(&devlist_lock);
-		goto err_free_thd;
+	pthread_mutex_lock(&thd->entry->thdlist_lock);
+	if (edge != IIO_WINDOW_OFF && (thd->mcast || thd->decim > 1)) {
+		ret = -EBUSY;
+	} else {
+		void *tmp = thd->win_hist;
+
+		thd->win_edge = (enum iio_window_edge) edge;
+		thd->win_chn = chn;
+		thd->win_level = level;
+		thd->win_pre = pre;
+		thd->win_post = post;
+		thd->win_left = 0;
+		thd->win_hist_len = 0;
+		thd->win_has_prev = false;
+
+		thd->win_hist = hist;
+		hist = tmp;
 	}
+	pthread_mutex_unlock(&thd->entry->thdlist_lock);
 
-	entry->ref_count = 2; /* One for thread, one for the client */
+	free(hist);
+err_print_value:
+	print_value(pdata, ret);
+	return ret;
+}
 
-	entry->mask = malloc(len * sizeof(*words));
-	if (!entry->mask) {
-		pthread_mutex_unlock(&devlist_lock);
-		goto err_free_entry;
+/* The payload has the numbers of samples before and after the trigger, and
+ * the level, as 64 bits */
+static void bin_set_window(struct parser_pdata *pdata, struct iio_device *dev,
+		const struct iio_channel *chn, uint8_t edge,
+		const uint8_t *payload, size_t len)
+{
+	uint64_t level;
+
+	if (len != 16) {
+		print_value(pdata, -EINVAL);
+		return;
 	}
 
-	entry->cyclic = cyclic;
-	entry->nb_words = len;
-	entry->update_mask = true;
-	entry->dev = dev;
-	entry->buf = NULL;
-	SLIST_INIT(&entry->thdlist_head);
-	SLIST_INSERT_HEAD(&entry->thdlist_head, thd, dev_list_entry);
-	thd->entry = entry;
-	IIO_DEBUG("Added thread to client list\n");
+	level = (uint64_t) iiod_bin_get_le32(payload + 8) |
+		((uint64_t) iiod_bin_get_le32(payload + 12) << 32);
 
-	pthread_mutex_init(&entry->thdlist_lock, NULL);
-	pthread_cond_init(&entry->rw_ready_cond, NULL);
+	set_window(pdata, dev, chn, edge, (int64_t) level,
+		   iiod_bin_get_le32(payload), iiod_bin_get_le32(payload + 4));
+}
 
-	ret = thread_pool_add_thread(main_thread_pool, rw_thd, entry, "rw_thd");
-	if (ret) {
-		pthread_mutex_unlock(&devlist_lock);
-		goto err_free_entry_mask;
+/* Start publishing the blocks of an opened device to the multicast group
+ * 'addr', as "group:port"; this lasts until the device is closed */
+static void bin_publish(struct parser_pdata *pdata, struct iio_device *dev,
+		char *addr, int32_t ttl)
+{
+	struct sockaddr_in sin = { .sin_family = AF_INET, };
+	struct DevEntry *entry;
+	struct ThdEntry *thd;
+	unsigned long port;
+	unsigned char val;
+	char *ptr, *end;
+	int fd, ret;
+
+	thd = dev ? parser_lookup_thd_entry(pdata, dev) : NULL;
+	if (!thd) {
+		print_value(pdata, dev ? -EBADF : -ENODEV);
+		return;
 	}
 
-	IIO_DEBUG("Adding new device thread to device list\n");
-	iio_device_set_data(dev, entry);
-	pthread_mutex_unlock(&devlist_lock);
+	entry = thd->entry;
 
-	pthread_mutex_lock(&entry->thdlist_lock);
-	/* Wait until the device is opened by the rw thread */
-	while (thd->wait_for_open) {
-		ret = thd_entry_event_wait(thd, &entry->thdlist_lock, pdata->fd_in);
-		if (ret)
-			break;
+	ptr = addr ? strrchr(addr, ':') : NULL;
+	if (!ptr || ttl < 0 || ttl > 255 ||
+	    dev_has_output_scan_elements(dev)) {
+		print_value(pdata, -EINVAL);
+		return;
 	}
-	pthread_mutex_unlock(&entry->thdlist_lock);
 
-	if (ret == 0)
-		ret = (int) thd->err;
-	if (ret < 0)
-		remove_thd_entry(thd);
-	else
-		SLIST_INSERT_HEAD(&pdata->thdlist_head, thd, parser_list_entry);
-	return ret;
+	*ptr++ = '\0';
+	port = strtoul(ptr, &end, 10);
+	if (*end || !port || port > 0xffff ||
+	    inet_pton(AF_INET, addr, &sin.sin_addr) != 1 ||
+	    !IN_MULTICAST(ntohl(sin.sin_addr.s_addr))) {
+		print_value(pdata, -EINVAL);
+		return;
+	}
 
-err_free_entry_mask:
-	free(entry->mask);
-err_free_entry:
-	free(entry);
-err_free_thd:
-	close(thd->eventfd);
-	free(thd);
-err_free_words:
-	free(words);
-	return ret;
-}
+	sin.sin_port = htons((uint16_t) port);
 
-static int close_dev_helper(struct parser_pdata *pdata, struct iio_device *dev)
-{
-	struct ThdEntry *t;
+	/* The mask must leave room for the samples in the datagrams */
+	if (entry->nb_words * 4 + IIOD_MCAST_HDR_SIZE >= IIOD_MCAST_MAX_DGRAM) {
+		print_value(pdata, -EMSGSIZE);
+		return;
+	}
 
-	if (!dev)
-		return -ENODEV;
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		print_value(pdata, -errno);
+		return;
+	}
 
-	t = parser_lookup_thd_entry(pdata, dev);
-	if (!t)
-		return -ENXIO;
+	val = (unsigned char) ttl;
+	if (ttl && setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL,
+			      &val, sizeof(val)) < 0) {
+		ret = -errno;
+		close(fd);
+		print_value(pdata, ret);
+		return;
+	}
 
-	SLIST_REMOVE(&pdata->thdlist_head, t, ThdEntry, parser_list_entry);
-	remove_thd_entry(t);
+	pthread_mutex_lock(&entry->thdlist_lock);
+	if (entry->closed) {
+		ret = -EBADF;
+	} else if (thd->nb || thd->mcast || thd->decim > 1 ||
+		   thd->win_edge != IIO_WINDOW_OFF) {
+		ret = -EBUSY;
+	} else {
+		thd->mcast = true;
+		thd->mcast_fd = fd;
+		thd->mcast_addr = sin;
+		thd->is_writer = false;
+		thd->err = 0;
 
-	return 0;
-}
+		/* Keep the thread active for as long as the device is open */
+		thd->nb = UINT_MAX;
+
+		pthread_cond_signal(&entry->rw_ready_cond);
+		fd = -1;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&entry->thdlist_lock);
+
+	if (fd >= 0)
+		close(fd);
 
-int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
-		size_t samples_count, const char *mask, bool cyclic)
-{
-	int ret = open_dev_helper(pdata, dev, samples_count, mask, cyclic);
 	print_value(pdata, ret);
-	return ret;
 }
 
-int close_dev(struct parser_pdata *pdata, struct iio_device *dev)
+static void bin_write_buffer(struct parser_pdata *pdata,
+		struct iio_device *dev, size_t len)
 {
-	int ret = close_dev_helper(pdata, dev);
+	unsigned int xfer;
+	ssize_t ret;
+
+	ret = rw_buffer(pdata, dev, (unsigned int) len, true, &xfer);
+
+	/* Drop what the device did not consume, to find the next header */
+	if (bin_discard(pdata, len - xfer) < 0) {
+		pdata->stop = true;
+		return;
+	}
+
 	print_value(pdata, ret);
-	return ret;
 }
 
-ssize_t rw_dev(struct parser_pdata *pdata, struct iio_device *dev,
-		unsigned int nb, bool is_write)
+/* Queue the responses to the requests of a BATCH */
+static ssize_t writefd_batch(struct parser_pdata *pdata,
+		const void *src, size_t len)
 {
-	ssize_t ret = rw_buffer(pdata, dev, nb, is_write);
-	if (ret <= 0 || is_write)
-		print_value(pdata, ret);
-	return ret;
-}
+	size_t size = pdata->batch_size ? pdata->batch_size : 0x1000;
+	char *buf;
 
-ssize_t read_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
-		const char *attr, enum iio_attr_type type)
-{
-	/* We use a very large buffer here, as if attr is NULL all the
-	 * attributes will be read, which may represents a few kilobytes worth
-	 * of data. */
-	char buf[0x10000];
-	ssize_t ret = -EINVAL;
+	while (pdata->batch_len + len > size)
+		size *= 2;
 
-	if (!dev) {
-		print_value(pdata, -ENODEV);
-		return -ENODEV;
+	if (size != pdata->batch_size) {
+		buf = realloc(pdata->batch_buf, size);
+		if (!buf)
+			return -ENOMEM;
+
+		pdata->batch_buf = buf;
+		pdata->batch_size = size;
 	}
 
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			ret = iio_device_attr_read(dev, attr, buf, sizeof(buf) - 1);
+	memcpy(pdata->batch_buf + pdata->batch_len, src, len);
+	pdata->batch_len += len;
+	return (ssize_t) len;
+}
+
+/* Run the attribute requests of a BATCH in order, and send all their
+ * responses at once */
+static void bin_batch(struct parser_pdata *pdata,
+		const uint8_t *payload, size_t len)
+{
+	ssize_t (*writefd)(struct parser_pdata *, const void *, size_t);
+	struct iiod_bin_hdr batch_hdr = pdata->bin_hdr, *hdr = &pdata->bin_hdr;
+	bool stop_on_error = !!(batch_hdr.type & IIOD_BIN_BATCH_STOP);
+	struct iio_device *dev;
+	struct iio_channel *chn;
+	size_t off = 0, start;
+	int32_t nb = 0, code;
+	char *arg;
+
+	writefd = pdata->writefd;
+	pdata->writefd = writefd_batch;
+	pdata->batch_buf = NULL;
+	pdata->batch_len = 0;
+	pdata->batch_size = 0;
+
+	while (!pdata->stop && len - off >= IIOD_BIN_HDR_SIZE) {
+		iiod_bin_unpack(hdr, &payload[off]);
+		off += IIOD_BIN_HDR_SIZE;
+
+		if (hdr->len > len - off)
 			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			ret = iio_device_debug_attr_read(dev,
-				attr, buf, sizeof(buf) - 1);
+
+		/* The attribute names are expected NULL-terminated */
+		arg = malloc((size_t) hdr->len + 1);
+		if (!arg) {
+			pdata->stop = true;
 			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			ret = iio_device_buffer_attr_read(dev,
-							attr, buf, sizeof(buf) - 1);
+		}
+
+		memcpy(arg, &payload[off], hdr->len);
+		arg[hdr->len] = '\0';
+		off += hdr->len;
+
+		dev = NULL;
+		chn = NULL;
+		if (hdr->dev != IIOD_BIN_NONE)
+			dev = iio_context_get_device(pdata->ctx, hdr->dev);
+		if (dev && hdr->chn != IIOD_BIN_NONE)
+			chn = iio_device_get_channel(dev, hdr->chn);
+
+		start = pdata->batch_len;
+
+		if (hdr->op == IIOD_OP_READ_ATTR)
+			bin_read_attr(pdata, dev, chn, hdr->len ? arg : NULL,
+					hdr->type);
+		else if (hdr->op == IIOD_OP_WRITE_ATTR)
+			bin_write_attr(pdata, dev, chn, arg, hdr->len);
+		else
+			print_value(pdata, -EINVAL);
+
+		free(arg);
+		nb++;
+
+		if (pdata->batch_len - start < IIOD_BIN_HDR_SIZE)
 			break;
-		default:
-			ret = -EINVAL;
+
+		code = (int32_t) iiod_bin_get_le32((const uint8_t *)
+				&pdata->batch_buf[start + 8]);
+		if (stop_on_error && code < 0)
 			break;
 	}
-	print_value(pdata, ret);
-	if (ret < 0)
-		return ret;
 
-	buf[ret] = '\n';
-	return write_all(pdata, buf, ret + 1);
+	pdata->writefd = writefd;
+	pdata->bin_hdr = batch_hdr;
+
+	if (!pdata->stop)
+		bin_reply(pdata, nb, pdata->batch_buf, pdata->batch_len);
+
+	free(pdata->batch_buf);
+	pdata->batch_buf = NULL;
 }
 
-ssize_t write_dev_attr(struct parser_pdata *pdata, struct iio_device *dev,
-		const char *attr, size_t len, enum iio_attr_type type)
+/* Process one request of the binary protocol */
+static int binary_parse(struct parser_pdata *pdata)
 {
-	ssize_t ret = -ENOMEM;
-	char *buf;
+	struct iiod_bin_hdr *hdr = &pdata->bin_hdr;
+	uint8_t buf[IIOD_BIN_HDR_SIZE];
+	struct iio_device *dev = NULL;
+	struct iio_channel *chn = NULL;
+	char *payload = NULL;
+	const char *xml;
+	ssize_t ret;
 
-	if (!dev) {
-		ret = -ENODEV;
-		goto err_print_value;
+	ret = read_all(pdata, buf, sizeof(buf));
+	if (ret < 0) {
+		pdata->stop = true;
+		return (int) ret;
 	}
 
-	buf = malloc(len);
-	if (!buf)
-		goto err_print_value;
+	iiod_bin_unpack(hdr, buf);
+	stats_begin(pdata, hdr->op);
 
-	ret = read_all(pdata, buf, len);
-	if (ret < 0)
-		goto err_free_buffer;
+	if (hdr->dev != IIOD_BIN_NONE)
+		dev = iio_context_get_device(pdata->ctx, hdr->dev);
+	if (dev && hdr->chn != IIOD_BIN_NONE)
+		chn = iio_device_get_channel(dev, hdr->chn);
 
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			ret = iio_device_attr_write_raw(dev, attr, buf, len);
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			ret = iio_device_debug_attr_write_raw(dev, attr, buf, len);
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			ret = iio_device_buffer_attr_write_raw(dev, attr, buf, len);
-			break;
-		default:
-			ret = -EINVAL;
-			break;
+	if (hdr->op == IIOD_OP_WRITEBUF) {
+		/* The samples are received directly into the buffer */
+		bin_write_buffer(pdata, dev, hdr->len);
+		return 0;
 	}
 
-err_free_buffer:
-	free(buf);
-err_print_value:
-	print_value(pdata, ret);
-	return ret;
+	if (hdr->len > IIOD_BIN_MAX_PAYLOAD) {
+		/* The payload can't be skipped safely: end the session */
+		print_value(pdata, -EINVAL);
+		pdata->stop = true;
+		return -EINVAL;
+	}
+
+	if (hdr->len) {
+		payload = malloc((size_t) hdr->len + 1);
+		if (!payload) {
+			ret = bin_discard(pdata, hdr->len);
+			if (ret < 0) {
+				pdata->stop = true;
+				return (int) ret;
+			}
+
+			print_value(pdata, -ENOMEM);
+			return 0;
+		}
+
+		ret = read_all(pdata, payload, hdr->len);
+		if (ret < 0) {
+			free(payload);
+			pdata->stop = true;
+			return (int) ret;
+		}
+
+		payload[hdr->len] = '\0';
+	}
+
+	switch (hdr->op) {
+	case IIOD_OP_EXIT:
+		pdata->stop = true;
+		break;
+	case IIOD_OP_PRINT:
+		xml = iio_context_get_xml(pdata->ctx);
+		bin_reply(pdata, (int32_t) strlen(xml), xml, strlen(xml));
+		break;
+	case IIOD_OP_VERSION:
+		bin_reply(pdata, (int32_t) ((LIBIIO_VERSION_MAJOR << 16) |
+					    LIBIIO_VERSION_MINOR),
+			  LIBIIO_VERSION_GIT, strnlen(LIBIIO_VERSION_GIT, 7));
+		break;
+	case IIOD_OP_TIMEOUT:
+		set_timeout(pdata, (unsigned int) hdr->code);
+		break;
+	case IIOD_OP_OPEN:
+		bin_open(pdata, dev, (const uint8_t *) payload, hdr->len);
+		break;
+	case IIOD_OP_CLOSE:
+		close_dev(pdata, dev);
+		break;
+	case IIOD_OP_READ_ATTR:
+		bin_read_attr(pdata, dev, chn, hdr->len ? payload : NULL,
+				hdr->type);
+		break;
+	case IIOD_OP_WRITE_ATTR:
+		bin_write_attr(pdata, dev, chn, payload, hdr->len);
+		break;
+	case IIOD_OP_READBUF:
+		if (hdr->code > 0)
+			rw_dev(pdata, dev, (unsigned int) hdr->code, false);
+		else
+			print_value(pdata, -EINVAL);
+		break;
+	case IIOD_OP_GETTRIG:
+		bin_get_trigger(pdata, dev);
+		break;
+	case IIOD_OP_SETTRIG:
+		set_trigger(pdata, dev, hdr->len ? payload : NULL);
+		break;
+	case IIOD_OP_TIMESTAMP:
+		bin_get_timestamp(pdata, dev);
+		break;
+	case IIOD_OP_SET_BUFFERS_COUNT:
+		set_buffers_count(pdata, dev, hdr->code);
+		break;
+	case IIOD_OP_MUX:
+		enable_mux(pdata);
+		break;
+	case IIOD_OP_PUBLISH:
+		bin_publish(pdata, dev, payload, hdr->code);
+		break;
+	case IIOD_OP_BATCH:
+		bin_batch(pdata, (const uint8_t *) payload, hdr->len);
+		break;
+	case IIOD_OP_DECIMATE:
+		set_decimation(pdata, dev, hdr->code);
+		break;
+	case IIOD_OP_WINDOW:
+		bin_set_window(pdata, dev, chn, hdr->type,
+			       (const uint8_t *) payload, hdr->len);
+		break;
+	case IIOD_OP_STATS:
+		print_stats(pdata);
+		break;
+	case IIOD_OP_SET_LOW_LATENCY:
+		set_low_latency(pdata, dev, hdr->code);
+		break;
+	default:
+		print_value(pdata, -EINVAL);
+		break;
+	}
+
+	free(payload);
+	return 0;
 }
 
-ssize_t read_chn_attr(struct parser_pdata *pdata,
-		struct iio_channel *chn, const char *attr)
+/* A channel of a multiplexed connection */
+struct iiod_mux_chan {
+	SLIST_ENTRY(iiod_mux_chan) entry;
+	struct iiod_mux *mux;
+	uint16_t id;
+
+	/* The demux thread feeds the input of the session through a pipe */
+	int pipefd[2];
+
+	/* Set once the session of the channel ended */
+	bool ended;
+};
+
+struct iiod_mux {
+	/* The connection itself */
+	struct parser_pdata raw;
+
+	/* Serializes the frames sent */
+	pthread_mutex_t wlock;
+
+	/* Protects the fields below */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	SLIST_HEAD(MuxChanHead, iiod_mux_chan) chans;
+	unsigned int nb_sessions;
+	bool demux_done;
+
+	struct parser_pdata *parent;
+};
+
+static void session_run(struct parser_pdata *pdata);
+
+static int mux_send_frame(struct iiod_mux *mux, uint16_t chan, uint16_t flags,
+		const void *src, size_t len)
 {
-	char buf[1024];
-	ssize_t ret = -ENODEV;
+	struct iiod_mux_hdr hdr = {
+		.chan = chan,
+		.flags = flags,
+		.len = (uint32_t) len,
+	};
+	uint8_t buf[IIOD_MUX_HDR_SIZE];
+	ssize_t ret;
 
-	if (chn)
-		ret = iio_channel_attr_read(chn, attr, buf, sizeof(buf) - 1);
-	else if (pdata->dev)
-		ret = -ENXIO;
-	print_value(pdata, ret);
-	if (ret < 0)
-		return ret;
+	iiod_mux_pack(buf, &hdr);
+
+	pthread_mutex_lock(&mux->wlock);
+	ret = write_all(&mux->raw, buf, sizeof(buf));
+	if (ret >= 0 && len)
+		ret = write_all(&mux->raw, src, len);
+	pthread_mutex_unlock(&mux->wlock);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+static ssize_t writefd_mux(struct parser_pdata *pdata,
+		const void *src, size_t len)
+{
+	int ret = mux_send_frame(pdata->mux, pdata->mux_chan, 0, src, len);
+
+	return ret < 0 ? (ssize_t) ret : (ssize_t) len;
+}
+
+static struct iiod_mux_chan * mux_chan_new(struct iiod_mux *mux, uint16_t id)
+{
+	struct iiod_mux_chan *chan;
+
+	chan = zalloc(sizeof(*chan));
+	if (!chan)
+		return NULL;
+
+	if (pipe2(chan->pipefd, O_CLOEXEC)) {
+		free(chan);
+		return NULL;
+	}
+
+	/* The demux thread must not block on a session that stopped reading,
+	 * see mux_forward() */
+	fcntl(chan->pipefd[1], F_SETFL, O_NONBLOCK);
+
+	chan->mux = mux;
+	chan->id = id;
+	return chan;
+}
+
+static void mux_chan_free(struct iiod_mux_chan *chan)
+{
+	close(chan->pipefd[0]);
+	if (chan->pipefd[1] >= 0)
+		close(chan->pipefd[1]);
+	free(chan);
+}
+
+/* Called by a session when it ends. The channel is freed by the demux
+ * thread; it must not be used past this point. */
+static void mux_chan_end(struct iiod_mux_chan *chan)
+{
+	struct iiod_mux *mux = chan->mux;
+	uint16_t id = chan->id;
 
-	buf[ret] = '\n';
-	return write_all(pdata, buf, ret + 1);
+	pthread_mutex_lock(&mux->lock);
+	chan->ended = true;
+	pthread_mutex_unlock(&mux->lock);
+
+	/* Let the client reuse the channel number */
+	mux_send_frame(mux, id, IIOD_MUX_CLOSE, NULL, 0);
+
+	pthread_mutex_lock(&mux->lock);
+	mux->nb_sessions--;
+	pthread_cond_broadcast(&mux->cond);
+	pthread_mutex_unlock(&mux->lock);
 }
 
-ssize_t write_chn_attr(struct parser_pdata *pdata,
-		struct iio_channel *chn, const char *attr, size_t len)
+static void mux_session_thd(struct thread_pool *pool, void *d)
 {
-	ssize_t ret = -ENOMEM;
-	char *buf = malloc(len);
-	if (!buf)
-		goto err_print_value;
+	struct iiod_mux_chan *chan = d;
+	struct parser_pdata *parent = chan->mux->parent;
+	struct parser_pdata pdata = {
+		.ctx = parent->ctx,
+		.fd_in = chan->pipefd[0],
+		.fd_out = -1,
+		.pool = pool,
+		.xml_zstd = parent->xml_zstd,
+		.xml_zstd_len = parent->xml_zstd_len,
+		.readfd = readfd_io,
+		.writefd = writefd_mux,
+		.mux = chan->mux,
+		.mux_chan = chan->id,
+	};
 
-	ret = read_all(pdata, buf, len);
-	if (ret < 0)
-		goto err_free_buffer;
+	SLIST_INIT(&pdata.thdlist_head);
 
-	if (chn)
-		ret = iio_channel_attr_write_raw(chn, attr, buf, len);
-	else if (pdata->dev)
-		ret = -ENXIO;
-	else
-		ret = -ENODEV;
-err_free_buffer:
-	free(buf);
-err_print_value:
-	print_value(pdata, ret);
-	return ret;
+	session_run(&pdata);
+	mux_chan_end(chan);
 }
 
-ssize_t set_trigger(struct parser_pdata *pdata,
-		struct iio_device *dev, const char *trigger)
+static struct iiod_mux_chan * mux_lookup(struct iiod_mux *mux, uint16_t id)
 {
-	struct iio_device *trig = NULL;
-	ssize_t ret = -ENOENT;
+	struct iiod_mux_chan *chan, *next;
 
-	if (!dev) {
-		ret = -ENODEV;
-		goto err_print_value;
+	/* Free the channels whose session ended */
+	for (chan = SLIST_FIRST(&mux->chans); chan; chan = next) {
+		next = SLIST_NEXT(chan, entry);
+
+		if (chan->ended) {
+			SLIST_REMOVE(&mux->chans, chan, iiod_mux_chan, entry);
+			mux_chan_free(chan);
+		}
 	}
 
-	if (trigger) {
-		trig = iio_context_find_device(pdata->ctx, trigger);
-		if (!trig)
-			goto err_print_value;
+	SLIST_FOREACH(chan, &mux->chans, entry) {
+		if (chan->id == id)
+			return chan;
 	}
 
-	ret = iio_device_set_trigger(dev, trig);
-err_print_value:
-	print_value(pdata, ret);
-	return ret;
+	return NULL;
 }
 
-ssize_t get_trigger(struct parser_pdata *pdata, struct iio_device *dev)
+static bool mux_chan_ended(struct iiod_mux_chan *chan)
 {
-	const struct iio_device *trigger;
+	struct iiod_mux *mux = chan->mux;
+	bool ended;
+
+	pthread_mutex_lock(&mux->lock);
+	ended = chan->ended;
+	pthread_mutex_unlock(&mux->lock);
+
+	return ended;
+}
+
+/* Copy the payload of a frame to the input of a session, or drop it if
+ * 'chan' is NULL */
+static int mux_forward(struct iiod_mux *mux, struct iiod_mux_chan *chan,
+		size_t len)
+{
+	struct pollfd pfd;
+	char buf[0x10000];
+	size_t i, nb;
 	ssize_t ret;
 
-	if (!dev) {
-		print_value(pdata, -ENODEV);
-		return -ENODEV;
-	}
+	while (len) {
+		nb = len < sizeof(buf) ? len : sizeof(buf);
 
-	ret = iio_device_get_trigger(dev, &trigger);
-	if (!ret && trigger) {
-		const char *name = iio_device_get_name(trigger);
-		char buf[256];
+		ret = read_all(&mux->raw, buf, nb);
+		if (ret < 0)
+			return (int) ret;
 
-		ret = strlen(name);
-		print_value(pdata, ret);
+		len -= nb;
 
-		snprintf(buf, sizeof(buf), "%s\n", name);
-		ret = write_all(pdata, buf, ret + 1);
-	} else {
-		print_value(pdata, ret);
+		for (i = 0; chan && i < nb; ) {
+			ret = write(chan->pipefd[1], buf + i, nb - i);
+			if (ret > 0) {
+				i += ret;
+				continue;
+			}
+			if (ret < 0 && errno != EAGAIN && errno != EINTR)
+				return -errno;
+
+			/* A session that ended does not read its input
+			 * anymore; its data is dropped */
+			if (mux_chan_ended(chan))
+				break;
+
+			pfd.fd = chan->pipefd[1];
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, 100);
+		}
 	}
-	return ret;
-}
 
-int set_timeout(struct parser_pdata *pdata, unsigned int timeout)
-{
-	int ret = iio_context_set_timeout(pdata->ctx, timeout);
-	print_value(pdata, ret);
-	return ret;
+	return 0;
 }
 
-int set_buffers_count(struct parser_pdata *pdata,
-		struct iio_device *dev, long value)
+static void mux_demux_thd(struct thread_pool *pool, void *d)
 {
-	unsigned int i, nb = (unsigned int) value;
-	struct timespec wait;
-	int ret = -EINVAL;
+	struct iiod_mux *mux = d;
+	struct iiod_mux_chan *chan;
+	uint8_t buf[IIOD_MUX_HDR_SIZE];
+	struct iiod_mux_hdr hdr;
+	int ret;
 
-	if (!dev) {
-		ret = -ENODEV;
-		goto err_print_value;
-	}
+	while (true) {
+		ret = (int) read_all(&mux->raw, buf, sizeof(buf));
+		if (ret < 0)
+			break;
 
-	if (nb >= 1) {
-		/*
-		 * Avoid the same race condition described in open_dev_helper().
-		 * We must be sure that the buffer has not been enabled in order
-		 * to set the number of kernel buffers.
-		 */
-		for (i = 0; i < 500; i++) {
-			ret = iio_device_set_kernel_buffers_count(dev, nb);
-			if (ret != -EBUSY)
-				break;
+		iiod_mux_unpack(&hdr, buf);
 
-			wait.tv_sec = 0;
-			wait.tv_nsec = (100 * 1000);
-			do {
-				ret = nanosleep(&wait, &wait);
-			} while (ret == -1 && errno == EINTR);
+		pthread_mutex_lock(&mux->lock);
+
+		chan = mux_lookup(mux, hdr.chan);
+		if (!chan && !(hdr.flags & IIOD_MUX_CLOSE) &&
+		    hdr.chan < IIOD_MUX_MAX_CHANNELS) {
+			chan = mux_chan_new(mux, hdr.chan);
+			if (chan && thread_pool_add_thread(pool, mux_session_thd,
+						chan, "mux_session_thd")) {
+				mux_chan_free(chan);
+				chan = NULL;
+			}
+			if (chan) {
+				SLIST_INSERT_HEAD(&mux->chans, chan, entry);
+				mux->nb_sessions++;
+			} else {
+				IIO_ERROR("Unable to create channel %u\n",
+					  hdr.chan);
+			}
+		}
+
+		if (chan && chan->ended)
+			chan = NULL;
+
+		pthread_mutex_unlock(&mux->lock);
+
+		ret = mux_forward(mux, chan, hdr.len);
+		if (ret < 0)
+			break;
+
+		if (chan && (hdr.flags & IIOD_MUX_CLOSE) &&
+		    chan->pipefd[1] >= 0) {
+			/* The session will read EOF */
+			close(chan->pipefd[1]);
+			chan->pipefd[1] = -1;
 		}
 	}
-err_print_value:
-	print_value(pdata, ret);
-	return ret;
+
+	/* The connection is closed: end all the sessions */
+	pthread_mutex_lock(&mux->lock);
+	SLIST_FOREACH(chan, &mux->chans, entry) {
+		if (chan->pipefd[1] >= 0) {
+			close(chan->pipefd[1]);
+			chan->pipefd[1] = -1;
+		}
+	}
+
+	mux->demux_done = true;
+	pthread_cond_broadcast(&mux->cond);
+	pthread_mutex_unlock(&mux->lock);
 }
 
-ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len)
+int enable_mux(struct parser_pdata *pdata)
 {
-	size_t bytes_read = 0;
-	ssize_t ret;
-	bool found;
+	struct iiod_mux_chan *chan;
+	struct iiod_mux *mux;
+	int ret;
 
-	if (pdata->is_usb)
-	      return pdata->readfd(pdata, buf, len);
+	/* Only sockets can be multiplexed */
+	if (pdata->mux || !pdata->fd_in_is_socket || pdata->is_usb) {
+		print_value(pdata, -EINVAL);
+		return -EINVAL;
+	}
 
-	if (pdata->fd_in_is_socket) {
-		struct pollfd pfd[2];
+	mux = zalloc(sizeof(*mux));
+	if (!mux) {
+		print_value(pdata, -ENOMEM);
+		return -ENOMEM;
+	}
 
-		pfd[0].fd = pdata->fd_in;
-		pfd[0].events = POLLIN | POLLRDHUP;
-		pfd[0].revents = 0;
-		pfd[1].fd = thread_pool_get_poll_fd(pdata->pool);
-		pfd[1].events = POLLIN;
-		pfd[1].revents = 0;
+	chan = mux_chan_new(mux, 0);
+	if (!chan) {
+		free(mux);
+		print_value(pdata, -ENOMEM);
+		return -ENOMEM;
+	}
 
-		do {
-			size_t i, to_trunc;
+	mux->raw.fd_in = pdata->fd_in;
+	mux->raw.fd_out = pdata->fd_out;
+	mux->raw.fd_in_is_socket = true;
+	mux->raw.fd_out_is_socket = pdata->fd_out_is_socket;
+	mux->raw.pool = pdata->pool;
+	mux->raw.readfd = readfd_io;
+	mux->raw.writefd = writefd_io;
+	mux->parent = pdata;
+
+	pthread_mutex_init(&mux->wlock, NULL);
+	pthread_mutex_init(&mux->lock, NULL);
+	pthread_cond_init(&mux->cond, NULL);
+	SLIST_INIT(&mux->chans);
+	SLIST_INSERT_HEAD(&mux->chans, chan, entry);
+	mux->nb_sessions = 1;
+
+	/* The answer is the last thing sent outside of a frame */
+	print_value(pdata, 0);
+
+	pdata->fd_in = chan->pipefd[0];
+	pdata->fd_in_is_socket = false;
+	pdata->writefd = writefd_mux;
+	pdata->mux_chan = 0;
+	pdata->mux = mux;
+
+	ret = thread_pool_add_thread(pdata->pool, mux_demux_thd,
+			mux, "mux_demux_thd");
+	if (ret) {
+		/* The session gets EOF, and will end */
+		close(chan->pipefd[1]);
+		chan->pipefd[1] = -1;
+		mux->demux_done = true;
+	}
 
-			poll_nointr(pfd, 2);
+	return 0;
+}
 
-			if (pfd[1].revents & POLLIN ||
-					pfd[0].revents & POLLRDHUP)
-				return 0;
+/* Called once the session of channel 0 ended */
+static void mux_destroy(struct iiod_mux *mux)
+{
+	struct iiod_mux_chan *chan;
 
-			/* First read from the socket, without advancing the
-			 * read offset */
-			ret = recv(pdata->fd_in, buf, len,
-					MSG_NOSIGNAL | MSG_PEEK);
-			if (ret < 0)
-				return -errno;
+	/* The demux thread may be using the list: don't free anything */
+	pthread_mutex_lock(&mux->lock);
+	SLIST_FOREACH(chan, &mux->chans, entry) {
+		if (chan->id == 0 && !chan->ended)
+			break;
+	}
+	pthread_mutex_unlock(&mux->lock);
 
-			/* Lookup for the trailing \n */
-			for (i = 0; i < (size_t) ret && buf[i] != '\n'; i++);
-			found = i < (size_t) ret;
+	if (chan)
+		mux_chan_end(chan);
 
-			len -= ret;
-			buf += ret;
+	/* Stop the demux thread, which closes the input of the other
+	 * sessions */
+	shutdown(mux->raw.fd_in, SHUT_RD);
 
-			to_trunc = found ? i + 1 : (size_t) ret;
+	pthread_mutex_lock(&mux->lock);
+	while (mux->nb_sessions || !mux->demux_done)
+		pthread_cond_wait(&mux->cond, &mux->lock);
 
-			/* Advance the read offset after the \n if found, or
-			 * after the last character read otherwise */
-			ret = recv(pdata->fd_in, NULL, to_trunc,
-					MSG_NOSIGNAL | MSG_TRUNC);
-			if (ret < 0)
-				return -errno;
+	while (!SLIST_EMPTY(&mux->chans)) {
+		chan = SLIST_FIRST(&mux->chans);
+		SLIST_REMOVE_HEAD(&mux->chans, entry);
+		mux_chan_free(chan);
+	}
+	pthread_mutex_unlock(&mux->lock);
 
-			bytes_read += to_trunc;
-		} while (!found && len);
-	} else {
-		while (len) {
-			ret = pdata->readfd(pdata, buf, 1);
-			if (ret < 0)
-			      return ret;
+	pthread_cond_destroy(&mux->cond);
+	pthread_mutex_destroy(&mux->lock);
+	pthread_mutex_destroy(&mux->wlock);
+	free(mux);
+}
 
-			bytes_read++;
+static void session_start(struct parser_pdata *pdata)
+{
+	yylex_init_extra(pdata, &pdata->scanner);
 
-			if (*buf == '\n')
-			      break;
+	if (pdata->verbose)
+		output(pdata, "iio-daemon > ");
+}
 
-			len--;
-			buf++;
+/* Returns true if the client sent something that was not parsed yet, or
+ * closed its end of the connection */
+static bool session_has_input(const struct parser_pdata *pdata)
+{
+	struct pollfd pfd = {
+		.fd = pdata->fd_in,
+		.events = POLLIN | POLLRDHUP,
+	};
+
+	return poll(&pfd, 1, 0) != 0;
+}
+
+/* Returns true once the session ended */
+static bool session_serve(struct parser_pdata *pdata, bool until_idle)
+{
+	int ret;
+
+	do {
+		if (pdata->binary) {
+			ret = binary_parse(pdata);
+		} else {
+			ret = yyparse(pdata->scanner);
+
+			if (pdata->verbose && !pdata->binary && !pdata->stop)
+				output(pdata, "iio-daemon > ");
 		}
 
-		found = !!len;
-	}
+		stats_end(pdata);
 
-	return found ? (ssize_t) bytes_read : -EIO;
+		if (pdata->stop || ret < 0)
+			return true;
+	} while (!until_idle || session_has_input(pdata));
+
+	return false;
 }
 
-void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
-		 bool is_socket, bool is_usb, bool use_aio,
-		 struct thread_pool *pool, const void *xml_zstd,
-		 size_t xml_zstd_len)
+static void session_end(struct parser_pdata *pdata)
 {
-	yyscan_t scanner;
-	struct parser_pdata pdata;
+	struct iio_context *ctx = pdata->ctx;
 	unsigned int i;
-	int ret;
 
-	pdata.ctx = ctx;
-	pdata.stop = false;
-	pdata.fd_in = fd_in;
-	pdata.fd_out = fd_out;
-	pdata.verbose = verbose;
-	pdata.pool = pool;
+	yylex_destroy(pdata->scanner);
 
-	pdata.xml_zstd = xml_zstd;
-	pdata.xml_zstd_len = xml_zstd_len;
+	/* Close all opened devices */
+	for (i = 0; i < iio_context_get_devices_count(ctx); i++)
+		close_dev_helper(pdata, iio_context_get_device(ctx, i));
+}
 
-	pdata.fd_in_is_socket = is_socket;
-	pdata.fd_out_is_socket = is_socket;
-	pdata.is_usb = is_usb;
+static void session_run(struct parser_pdata *pdata)
+{
+	session_start(pdata);
+	session_serve(pdata, false);
+	session_end(pdata);
+}
 
-	SLIST_INIT(&pdata.thdlist_head);
+struct parser_pdata * interpreter_new(struct iio_context *ctx, int fd_in,
+		int fd_out, bool verbose, bool is_socket, bool is_usb,
+		bool use_aio, struct thread_pool *pool,
+		const void *xml_zstd, size_t xml_zstd_len)
+{
+	struct parser_pdata *pdata;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata)
+		return NULL;
+
+	pdata->ctx = ctx;
+	pdata->stop = false;
+	pdata->fd_in = fd_in;
+	pdata->fd_out = fd_out;
+	pdata->verbose = verbose;
+	pdata->pool = pool;
+
+	pdata->xml_zstd = xml_zstd;
+	pdata->xml_zstd_len = xml_zstd_len;
+
+	pdata->fd_in_is_socket = is_socket;
+	pdata->fd_out_is_socket = is_socket;
+	pdata->is_usb = is_usb;
+	pdata->use_aio = use_aio;
+
+#ifdef HAS_SO_ZEROCOPY
+	/* With AIO, the samples are written by io_submit() */
+	if (server_zerocopy && is_socket && !use_aio) {
+		int yes = 1;
+
+		pdata->zerocopy = !setsockopt(fd_out, SOL_SOCKET, SO_ZEROCOPY,
+					      &yes, sizeof(yes));
+		if (!pdata->zerocopy)
+			IIO_WARNING("Unable to enable MSG_ZEROCOPY: %i\n",
+				    -errno);
+	}
+#endif
+
+	SLIST_INIT(&pdata->thdlist_head);
 
 	if (use_aio) {
 		/* Note: if WITH_AIO is not defined, use_aio is always false.
 		 * We ensure that in iiod.c. */
 #if WITH_AIO
-		char err_str[1024];
-
-		pdata.aio_eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
-		if (pdata.aio_eventfd < 0) {
-			iio_strerror(errno, err_str, sizeof(err_str));
-			IIO_ERROR("Failed to create AIO eventfd: %s\n", err_str);
-			return;
+		if (aio_queue_init(&pdata->aio_rd, fd_in, false)) {
+			free(pdata);
+			return NULL;
 		}
 
-		pdata.aio_ctx = 0;
-		ret = io_setup(1, &pdata.aio_ctx);
-		if (ret < 0) {
-			iio_strerror(-ret, err_str, sizeof(err_str));
-			IIO_ERROR("Failed to create AIO context: %s\n", err_str);
-			close(pdata.aio_eventfd);
-			return;
+		if (aio_queue_init(&pdata->aio_wr, fd_out, true)) {
+			aio_queue_destroy(&pdata->aio_rd);
+			free(pdata);
+			return NULL;
 		}
-		pthread_mutex_init(&pdata.aio_mutex, NULL);
-		pdata.readfd = readfd_aio;
-		pdata.writefd = writefd_aio;
+
+		pdata->readfd = readfd_aio;
+		pdata->writefd = writefd_aio;
 #endif
 	} else {
-		pdata.readfd = readfd_io;
-		pdata.writefd = writefd_io;
+		pdata->readfd = readfd_io;
+		pdata->writefd = writefd_io;
 	}
 
-	yylex_init_extra(&pdata, &scanner);
+	pdata->id = (unsigned int) __atomic_add_fetch(&nb_sessions_total, 1,
+						      __ATOMIC_RELAXED);
+	stats_add(&nb_sessions, 1);
 
-	do {
-		if (verbose)
-			output(&pdata, "iio-daemon > ");
-		ret = yyparse(scanner);
-	} while (!pdata.stop && ret >= 0);
+	session_start(pdata);
 
-	yylex_destroy(scanner);
+	return pdata;
+}
 
-	/* Close all opened devices */
-	for (i = 0; i < iio_context_get_devices_count(ctx); i++)
-		close_dev_helper(&pdata, iio_context_get_device(ctx, i));
+bool interpreter_run(struct parser_pdata *pdata, bool until_idle)
+{
+	return session_serve(pdata, until_idle);
+}
+
+void interpreter_free(struct parser_pdata *pdata)
+{
+	session_end(pdata);
+
+	if (pdata->mux)
+		mux_destroy(pdata->mux);
 
 #if WITH_AIO
-	if (use_aio) {
-		io_destroy(pdata.aio_ctx);
-		close(pdata.aio_eventfd);
+	if (pdata->use_aio) {
+		aio_queue_drain(pdata, &pdata->aio_wr);
+		aio_queue_destroy(&pdata->aio_wr);
+		aio_queue_destroy(&pdata->aio_rd);
 	}
 #endif
+
+	__atomic_fetch_sub(&nb_sessions, 1, __ATOMIC_RELAXED);
+	free(pdata);
+}
+
+void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
+		 bool is_socket, bool is_usb, bool use_aio,
+		 struct thread_pool *pool, const void *xml_zstd,
+		 size_t xml_zstd_len)
+{
+	struct parser_pdata *pdata;
+
+	pdata = interpreter_new(ctx, fd_in, fd_out, verbose, is_socket,
+				is_usb, use_aio, pool, xml_zstd, xml_zstd_len);
+	if (!pdata)
+		return;
+
+	interpreter_run(pdata, false);
+	interpreter_free(pdata);
 }
@@ -10,6 +10,7 @@
 #define __OPS_H__
 
 #include "../iio-config.h"
+#include "../iiod-binary.h"
 #include "queue.h"
 
 #include <endian.h>
@@ -20,6 +21,7 @@
 #include <string.h>
 #include <poll.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #if WITH_AIO
@@ -45,6 +47,39 @@
 #define TEST_BIT(addr, bit) (!!(*(((uint32_t *) addr) + BIT_WORD(bit)) \
 		& BIT_MASK(bit)))
 
+#if WITH_AIO
+/* Number of requests a session keeps in flight, in each direction */
+#define AIO_NB_SLOTS 4
+
+/* Largest burst of the SuperSpeed endpoints of usbd: 16 packets of 1 KiB */
+#define AIO_BURST_SIZE (16 * 1024)
+
+struct aio_slot {
+	struct iocb iocb;
+	void *buf;
+	size_t size, len, done;
+	ssize_t res;
+	bool busy;
+};
+
+/* The requests of one direction of a session, see ops.c */
+struct aio_queue {
+	io_context_t ctx;
+	int eventfd, fd;
+	bool is_write;
+	pthread_mutex_t lock;
+
+	/* The slots in flight are [tail, head), as free-running counters */
+	struct aio_slot slots[AIO_NB_SLOTS];
+	unsigned int head, tail;
+
+	/* Error of a write request that completed after the caller returned */
+	int err;
+	bool stopped;
+};
+#endif
+
+struct iiod_mux;
 struct thread_pool;
 extern struct thread_pool *main_thread_pool;
 
@@ -61,27 +96,62 @@ struct parser_pdata {
 
 	SLIST_HEAD(ParserDataThdHead, ThdEntry) thdlist_head;
 
+	/* State of the lexer of the session */
+	void *scanner;
+
 	/* Used as temporaries placements by the lexer */
 	struct iio_device *dev;
 	struct iio_channel *chn;
 	bool channel_is_output;
 	bool fd_in_is_socket, fd_out_is_socket;
-	bool is_usb;
+	bool is_usb, use_aio;
 #if WITH_AIO
-	io_context_t aio_ctx;
-	int aio_eventfd;
-	pthread_mutex_t aio_mutex;
+	struct aio_queue aio_rd, aio_wr;
 #endif
 	struct thread_pool *pool;
 
 	const void *xml_zstd;
 	size_t xml_zstd_len;
 
+	/* Set once the client switched to the binary protocol; bin_hdr is
+	 * the header of the request being processed */
+	bool binary;
+	struct iiod_bin_hdr bin_hdr;
+
+	/* Set if the samples are sent with MSG_ZEROCOPY; 'zc_next' is the
+	 * number of such sends, 'zc_done' the number of those completed */
+	bool zerocopy;
+	uint32_t zc_next, zc_done;
+
+	/* Responses to the requests of a BATCH, see bin_batch() */
+	char *batch_buf;
+	size_t batch_len, batch_size;
+
+	/* Set if the session is a channel of a multiplexed connection */
+	struct iiod_mux *mux;
+	uint16_t mux_chan;
+
+	/* Number of the session, and the command being processed, with the
+	 * time it was received, for the statistics; see get_stats() */
+	unsigned int id, cmd;
+	bool cmd_pending;
+	struct timespec cmd_start;
+
 	ssize_t (*writefd)(struct parser_pdata *pdata, const void *buf, size_t len);
 	ssize_t (*readfd)(struct parser_pdata *pdata, void *buf, size_t len);
 };
 
+/* What the R/W thread does once the queue of a client is full */
+enum slow_client_policy {
+	SLOW_CLIENT_BLOCK,
+	SLOW_CLIENT_DROP,
+	SLOW_CLIENT_DISCONNECT,
+};
+
 extern bool server_demux; /* Defined in iiod.c */
+extern bool server_zerocopy; /* Defined in iiod.c */
+extern unsigned int server_client_queue; /* Defined in iiod.c */
+extern enum slow_client_policy server_slow_client; /* Defined in iiod.c */
 
 static inline void *zalloc(size_t size)
 {
@@ -92,6 +162,17 @@ void interpreter(struct iio_context *ctx, int fd_in, int fd_out, bool verbose,
 		 bool is_socket, bool is_usb, bool use_aio, struct thread_pool *pool,
 		 const void *xml_zstd, size_t xml_zstd_len);
 
+/* Same as interpreter(), split so that a session can be served in several
+ * steps: interpreter_run() returns true once the session ended; with
+ * 'until_idle', it returns false as soon as none of the input of the client
+ * is left to parse. */
+struct parser_pdata * interpreter_new(struct iio_context *ctx, int fd_in,
+		int fd_out, bool verbose, bool is_socket, bool is_usb,
+		bool use_aio, struct thread_pool *pool,
+		const void *xml_zstd, size_t xml_zstd_len);
+bool interpreter_run(struct parser_pdata *pdata, bool until_idle);
+void interpreter_free(struct parser_pdata *pdata);
+
 int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 		bool debug, bool use_aio, unsigned int nb_pipes,
 		struct thread_pool *pool,
@@ -99,6 +180,8 @@ int start_usb_daemon(struct iio_context *ctx, const char *ffs,
 int start_serial_daemon(struct iio_context *ctx, const char *uart_params,
 			bool debug, struct thread_pool *pool,
 			const void *xml_zstd, size_t xml_zstd_len);
+int start_metrics_server(struct iio_context *ctx, uint16_t port,
+			 struct thread_pool *pool);
 
 int open_dev(struct parser_pdata *pdata, struct iio_device *dev,
 		size_t samples_count, const char *mask, bool cyclic);
@@ -118,12 +201,28 @@ ssize_t write_chn_attr(struct parser_pdata *pdata, struct iio_channel *chn,
 		const char *attr, size_t len);
 
 ssize_t get_trigger(struct parser_pdata *pdata, struct iio_device *dev);
+ssize_t get_timestamp(struct parser_pdata *pdata, struct iio_device *dev);
 ssize_t set_trigger(struct parser_pdata *pdata,
 		struct iio_device *dev, const char *trig);
 
+int enable_mux(struct parser_pdata *pdata);
+
 int set_timeout(struct parser_pdata *pdata, unsigned int timeout);
 int set_buffers_count(struct parser_pdata *pdata,
 		struct iio_device *dev, long value);
+int set_low_latency(struct parser_pdata *pdata,
+		struct iio_device *dev, long value);
+int set_decimation(struct parser_pdata *pdata,
+		struct iio_device *dev, long factor);
+int window_edge_from_name(const char *name);
+int set_window(struct parser_pdata *pdata, struct iio_device *dev,
+		const struct iio_channel *chn, int edge, int64_t level,
+		unsigned long pre, unsigned long post);
+
+void stats_begin_line(struct parser_pdata *pdata,
+		const char *line, size_t len);
+char * get_stats(struct iio_context *ctx, size_t *len);
+void print_stats(struct parser_pdata *pdata);
 
 ssize_t read_line(struct parser_pdata *pdata, char *buf, size_t len);
 ssize_t write_all(struct parser_pdata *pdata, const void *src, size_t len);
@@ -73,6 +73,7 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token WRITE
 %token SETTRIG
 %token GETTRIG
+%token TIMESTAMP
 %token TIMEOUT
 %token DEBUG_ATTR
 %token BUFFER_ATTR
@@ -80,6 +81,12 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size);
 %token CYCLIC
 %token SET
 %token BUFFERS_COUNT
+%token LOW_LATENCY
+%token BINARY
+%token MUX
+%token DECIMATE
+%token WINDOW
+%token STATS
 
 %token <word> WORD
 %token <dev> DEVICE
@@ -113,6 +120,10 @@ Line:
 		"\t\tGet a compressed XML string corresponding to the current IIO context\n"
 		"\tVERSION\n"
 		"\t\tGet the version of libiio in use\n"
+		"\tBINARY\n"
+		"\t\tSwitch the session to the binary protocol\n"
+		"\tMUX\n"
+		"\t\tMultiplex several sessions over the connection\n"
 		"\tTIMEOUT <timeout_ms>\n"
 		"\t\tSet the timeout (in ms) for I/O operations\n"
 		"\tOPEN <device> <samples_count> <mask> [CYCLIC]\n"
@@ -131,8 +142,18 @@ Line:
 		"\t\tGet the name of the trigger used by the specified device\n"
 		"\tSETTRIG <device> [<trigger>]\n"
 		"\t\tSet the trigger to use for the specified device\n"
+		"\tTIMESTAMP <device>\n"
+		"\t\tGet the hardware timestamp of the data last read with READBUF\n"
 		"\tSET <device> BUFFERS_COUNT <count>\n"
-		"\t\tSet the number of kernel buffers for the specified device\n");
+		"\t\tSet the number of kernel buffers for the specified device\n"
+		"\tSET <device> LOW_LATENCY 0|1\n"
+		"\t\tConfigure the buffers of the specified device for a low latency\n"
+		"\tDECIMATE <device> <factor>\n"
+		"\t\tFilter and decimate the samples read from the specified device\n"
+		"\tWINDOW <device> OFF|<channel> RISING|FALLING|ABOVE|BELOW <level> <pre> <post>\n"
+		"\t\tOnly read the samples around those of the channel which meet the condition\n"
+		"\tSTATS\n"
+		"\t\tPrint the statistics of the server\n");
 		YYACCEPT;
 	}
 	| VERSION END {
@@ -143,6 +164,24 @@ Line:
 		output(pdata, buf);
 		YYACCEPT;
 	}
+	| BINARY END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		output(pdata, "0\n");
+		pdata->binary = true;
+		YYACCEPT;
+	}
+	| MUX END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		if (enable_mux(pdata) < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| STATS END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		print_stats(pdata);
+		YYACCEPT;
+	}
 	| PRINT END {
 		struct parser_pdata *pdata = yyget_extra(scanner);
 		const char *xml = iio_context_get_xml(pdata->ctx);
@@ -427,6 +466,13 @@ Line:
 		else
 			YYACCEPT;
 	}
+	| TIMESTAMP SPACE DEVICE END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		if (get_timestamp(pdata, $3) < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
 	| SET SPACE DEVICE SPACE BUFFERS_COUNT SPACE VALUE END {
 		struct parser_pdata *pdata = yyget_extra(scanner);
 		if (set_buffers_count(pdata, $3, $7) < 0)
@@ -434,6 +480,52 @@ Line:
 		else
 			YYACCEPT;
 	}
+	| SET SPACE DEVICE SPACE LOW_LATENCY SPACE VALUE END {
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		if (set_low_latency(pdata, $3, $7) < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| DECIMATE SPACE DEVICE SPACE WORD END {
+		char *factor = $5;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		int ret = set_decimation(pdata, $3, atol(factor));
+		free(factor);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| WINDOW SPACE DEVICE SPACE WORD END {
+		char *edge = $5;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		int ret = set_window(pdata, $3, NULL,
+				window_edge_from_name(edge), 0, 0, 0);
+		free(edge);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
+	| WINDOW SPACE DEVICE SPACE WORD SPACE WORD SPACE WORD SPACE WORD SPACE WORD END {
+		char *chn = $5, *edge = $7, *level = $9, *pre = $11, *post = $13;
+		struct parser_pdata *pdata = yyget_extra(scanner);
+		struct iio_device *dev = $3;
+		int ret = set_window(pdata, dev, dev ?
+				iio_device_find_channel(dev, chn, false) : NULL,
+				window_edge_from_name(edge), atoll(level),
+				atol(pre), atol(post));
+		free(chn);
+		free(edge);
+		free(level);
+		free(pre);
+		free(post);
+		if (ret < 0)
+			YYABORT;
+		else
+			YYACCEPT;
+	}
 	| error END {
 		yyclearin;
 		yyerrok;
@@ -471,5 +563,7 @@ ssize_t yy_input(yyscan_t scanner, char *buf, size_t max_size)
 	if ((size_t) ret == max_size)
 		buf[max_size - 1] = '\0';
 
+	stats_begin_line(pdata, buf, (size_t) ret);
+
 	return ret;
 }
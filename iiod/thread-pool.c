@@ -7,6 +7,8 @@
  */
 
 #include "thread-pool.h"
+#include "../debug.h"
+#include "../iio.h"
 
 #include <errno.h>
 #include <pthread.h>
@@ -38,8 +40,64 @@ struct thread_body_data {
 	struct thread_pool *pool;
 	void (*f)(struct thread_pool *, void *);
 	void *d;
+	enum thread_class cls;
 };
 
+struct thread_sched {
+	cpu_set_t cpus;
+	bool has_cpus;
+	int priority;
+};
+
+/* Shared by all the pools; only written before the threads are started */
+static struct thread_sched thread_sched[THREAD_NB_CLASSES];
+
+int thread_sched_set(enum thread_class cls,
+		const cpu_set_t *cpus, int priority)
+{
+	struct thread_sched *sched = &thread_sched[cls];
+
+	if (priority < 0 || priority > sched_get_priority_max(SCHED_FIFO))
+		return -EINVAL;
+
+	sched->has_cpus = !!cpus;
+	if (cpus)
+		sched->cpus = *cpus;
+	sched->priority = priority;
+	return 0;
+}
+
+int thread_sched_apply(enum thread_class cls)
+{
+	const struct thread_sched *sched = &thread_sched[cls];
+	struct sched_param param = { .sched_priority = sched->priority, };
+	char err_str[1024];
+	int ret = 0, err;
+
+	if (sched->has_cpus) {
+		err = pthread_setaffinity_np(pthread_self(),
+					     sizeof(sched->cpus), &sched->cpus);
+		if (err) {
+			iio_strerror(err, err_str, sizeof(err_str));
+			IIO_WARNING("Unable to set the CPU affinity: %s\n",
+				    err_str);
+			ret = -err;
+		}
+	}
+
+	if (sched->priority) {
+		err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err) {
+			iio_strerror(err, err_str, sizeof(err_str));
+			IIO_WARNING("Unable to set SCHED_FIFO priority %i: %s\n",
+				    sched->priority, err_str);
+			ret = -err;
+		}
+	}
+
+	return ret;
+}
+
 static void thread_pool_thread_started(struct thread_pool *pool)
 {
 	pthread_mutex_lock(&pool->thread_count_lock);
@@ -59,6 +117,10 @@ static void * thread_body(void *d)
 {
 	struct thread_body_data *pdata = d;
 
+	/* Applied from the thread itself, so that missing privileges only
+	 * produce a warning, and the thread still runs */
+	thread_sched_apply(pdata->cls);
+
 	(*pdata->f)(pdata->pool, pdata->d);
 
 	thread_pool_thread_stopped(pdata->pool);
@@ -70,6 +132,13 @@ static void * thread_body(void *d)
 int thread_pool_add_thread(struct thread_pool *pool,
 		void (*f)(struct thread_pool *, void *),
 		void *d, const char *name)
+{
+	return thread_pool_add_thread_class(pool, f, d, name, THREAD_CONTROL);
+}
+
+int thread_pool_add_thread_class(struct thread_pool *pool,
+		void (*f)(struct thread_pool *, void *),
+		void *d, const char *name, enum thread_class cls)
 {
 	struct thread_body_data *pdata;
 	sigset_t sigmask, oldsigmask;
@@ -84,6 +153,7 @@ int thread_pool_add_thread(struct thread_pool *pool,
 	pdata->f = f;
 	pdata->d = d;
 	pdata->pool = pool;
+	pdata->cls = cls;
 
 	sigfillset(&sigmask);
 	pthread_sigmask(SIG_BLOCK, &sigmask, &oldsigmask);
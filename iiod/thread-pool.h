@@ -9,10 +9,29 @@
 #ifndef __THREAD_POOL_H__
 #define __THREAD_POOL_H__
 
+#include <sched.h>
 #include <stdbool.h>
 
 struct thread_pool;
 
+/* The threads moving the samples of the devices are in THREAD_DATA, all the
+ * others (sessions, discovery...) in THREAD_CONTROL */
+enum thread_class {
+	THREAD_CONTROL,
+	THREAD_DATA,
+
+	THREAD_NB_CLASSES,
+};
+
+/* Set the CPUs and the priority of the threads of the class created from
+ * now on; 'cpus' NULL for any CPU, 'priority' 0 for the default scheduler,
+ * or the SCHED_FIFO priority. */
+int thread_sched_set(enum thread_class cls,
+		const cpu_set_t *cpus, int priority);
+
+/* Apply the settings of the class to the calling thread */
+int thread_sched_apply(enum thread_class cls);
+
 struct thread_pool * thread_pool_new(void);
 
 int thread_pool_get_poll_fd(const struct thread_pool *pool);
@@ -25,5 +44,8 @@ void thread_pool_destroy(struct thread_pool *pool);
 int thread_pool_add_thread(struct thread_pool *pool,
 		void (*func)(struct thread_pool *, void *),
 		void *data, const char *name);
+int thread_pool_add_thread_class(struct thread_pool *pool,
+		void (*func)(struct thread_pool *, void *),
+		void *data, const char *name, enum thread_class cls);
 
 #endif /* __THREAD_POOL_H__ */
@@ -277,6 +277,7 @@ static struct usb_ffs_header * create_header(
 				comp = (struct usb_ss_ep_comp_descriptor *) ep;
 				comp->bLength = USB_DT_SS_EP_COMP_SIZE;
 				comp->bDescriptorType = USB_DT_SS_ENDPOINT_COMP;
+				comp->bMaxBurst = AIO_BURST_SIZE / 1024 - 1;
 				comp++;
 				ep = (struct usb_endpoint_descriptor_no_audio *) comp;
 			}
@@ -292,6 +293,7 @@ static struct usb_ffs_header * create_header(
 				comp = (struct usb_ss_ep_comp_descriptor *) ep;
 				comp->bLength = USB_DT_SS_EP_COMP_SIZE;
 				comp->bDescriptorType = USB_DT_SS_ENDPOINT_COMP;
+				comp->bMaxBurst = AIO_BURST_SIZE / 1024 - 1;
 				comp++;
 				ep = (struct usb_endpoint_descriptor_no_audio *) comp;
 			}
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include "iio-private.h"
+#include "local-uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Minimal io_uring wrapper, using the raw system calls so that libiio does
+ * not depend on liburing. A ring is not thread-safe: the callers have to
+ * serialize the accesses.
+ */
+struct local_uring {
+	int fd;
+	unsigned int sq_entries, features;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_len, cq_ring_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* Entries queued with local_uring_get_sqe(), and the ones submitted */
+	unsigned int sqe_tail, sqe_submitted;
+
+	bool ops[IORING_OP_LAST];
+};
+
+static inline unsigned int load_acquire(const unsigned int *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned int *ptr, unsigned int val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static int uring_enter(int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags,
+		const void *arg, size_t arg_size)
+{
+	long ret = syscall(__NR_io_uring_enter, fd, to_submit,
+			   min_complete, flags, arg, arg_size);
+
+	return ret < 0 ? -errno : (int) ret;
+}
+
+static void uring_probe(struct local_uring *ring)
+{
+	struct io_uring_probe *probe;
+	size_t len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	unsigned int i;
+	long ret;
+
+	probe = zalloc(len);
+	if (!probe)
+		return;
+
+	/* Probing appeared with the same kernel as the opcodes we need; if it
+	 * fails, no opcode is reported as supported. */
+	ret = syscall(__NR_io_uring_register, ring->fd,
+		      IORING_REGISTER_PROBE, probe, 256);
+	if (!ret) {
+		for (i = 0; i < probe->ops_len && i < IORING_OP_LAST; i++)
+			ring->ops[i] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+	}
+
+	free(probe);
+}
+
+struct local_uring * local_uring_create(unsigned int entries)
+{
+	struct io_uring_params p;
+	struct local_uring *ring;
+	int err;
+
+	ring = zalloc(sizeof(*ring));
+	if (!ring) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	memset(&p, 0, sizeof(p));
+
+	ring->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0) {
+		err = -errno;
+		goto err_free_ring;
+	}
+
+	ring->sq_entries = p.sq_entries;
+	ring->features = p.features;
+	ring->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_len = p.cq_off.cqes
+		+ p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_len > ring->sq_ring_len)
+			ring->sq_ring_len = ring->cq_ring_len;
+		ring->cq_ring_len = 0;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd,
+			     IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		err = -errno;
+		goto err_close_fd;
+	}
+
+	if (ring->cq_ring_len) {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_len,
+				     PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ring->fd,
+				     IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			err = -errno;
+			goto err_unmap_sq;
+		}
+	} else {
+		ring->cq_ring = ring->sq_ring;
+	}
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		err = -errno;
+		goto err_unmap_cq;
+	}
+
+	ring->sq_head = (void *) ((uintptr_t) ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (void *) ((uintptr_t) ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (void *) ((uintptr_t) ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (void *) ((uintptr_t) ring->sq_ring + p.sq_off.array);
+	ring->cq_head = (void *) ((uintptr_t) ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (void *) ((uintptr_t) ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (void *) ((uintptr_t) ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (void *) ((uintptr_t) ring->cq_ring + p.cq_off.cqes);
+
+	ring->sqe_tail = ring->sqe_submitted = *ring->sq_tail;
+
+	uring_probe(ring);
+
+	return ring;
+
+err_unmap_cq:
+	if (ring->cq_ring_len)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+err_unmap_sq:
+	munmap(ring->sq_ring, ring->sq_ring_len);
+err_close_fd:
+	close(ring->fd);
+err_free_ring:
+	free(ring);
+	errno = -err;
+	return NULL;
+}
+
+void local_uring_destroy(struct local_uring *ring)
+{
+	munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ring_len)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	munmap(ring->sq_ring, ring->sq_ring_len);
+	close(ring->fd);
+	free(ring);
+}
+
+bool local_uring_has_op(const struct local_uring *ring, unsigned int op)
+{
+	return op < IORING_OP_LAST && ring->ops[op];
+}
+
+bool local_uring_has_feature(const struct local_uring *ring, unsigned int feat)
+{
+	return (ring->features & feat) == feat;
+}
+
+int local_uring_register_buffers(struct local_uring *ring,
+		const struct iovec *iov, unsigned int nb)
+{
+	long ret = syscall(__NR_io_uring_register, ring->fd,
+			   IORING_REGISTER_BUFFERS, iov, nb);
+
+	return ret < 0 ? -errno : 0;
+}
+
+struct io_uring_sqe * local_uring_get_sqe(struct local_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (ring->sqe_tail - load_acquire(ring->sq_head) >= ring->sq_entries)
+		return NULL;
+
+	idx = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+
+	ring->sq_array[idx] = idx;
+	ring->sqe_tail++;
+
+	return sqe;
+}
+
+int local_uring_submit(struct local_uring *ring, unsigned int nb_wait)
+{
+	unsigned int to_submit;
+	int ret;
+
+	store_release(ring->sq_tail, ring->sqe_tail);
+
+	do {
+		to_submit = ring->sqe_tail - ring->sqe_submitted;
+
+		ret = uring_enter(ring->fd, to_submit, nb_wait,
+				  nb_wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (ret > 0)
+			ring->sqe_submitted += (unsigned int) ret;
+	} while (ret == -EINTR);
+
+	return ret < 0 ? ret : 0;
+}
+
+int local_uring_wait(struct local_uring *ring, uint64_t *user_data, int *res,
+		int timeout_ms)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+	int ret;
+#ifdef IORING_FEAT_EXT_ARG
+	struct __kernel_timespec ts = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_nsec = (timeout_ms % 1000) * 1000000LL,
+	};
+	struct io_uring_getevents_arg arg = {
+		.ts = (uintptr_t) &ts,
+	};
+#endif
+
+	for (;;) {
+		head = *ring->cq_head;
+
+		if (head != load_acquire(ring->cq_tail)) {
+			cqe = &ring->cqes[head & *ring->cq_mask];
+			*user_data = cqe->user_data;
+			*res = cqe->res;
+
+			store_release(ring->cq_head, head + 1);
+			return 0;
+		}
+
+		if (!timeout_ms)
+			return -EAGAIN;
+
+		if (timeout_ms < 0) {
+			ret = uring_enter(ring->fd, 0, 1,
+					  IORING_ENTER_GETEVENTS, NULL, 0);
+		} else {
+#ifdef IORING_FEAT_EXT_ARG
+			/* The timeout restarts if interrupted by a signal */
+			ret = uring_enter(ring->fd, 0, 1,
+					  IORING_ENTER_GETEVENTS
+					  | IORING_ENTER_EXT_ARG,
+					  &arg, sizeof(arg));
+			if (ret == -ETIME)
+				return -ETIMEDOUT;
+#else
+			return -ENOSYS;
+#endif
+		}
+
+		if (ret < 0 && ret != -EINTR)
+			return ret;
+	}
+}
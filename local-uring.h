@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#ifndef __IIO_LOCAL_URING_H__
+#define __IIO_LOCAL_URING_H__
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct local_uring;
+
+struct local_uring * local_uring_create(unsigned int entries);
+void local_uring_destroy(struct local_uring *ring);
+
+bool local_uring_has_op(const struct local_uring *ring, unsigned int op);
+bool local_uring_has_feature(const struct local_uring *ring, unsigned int feat);
+
+int local_uring_register_buffers(struct local_uring *ring,
+		const struct iovec *iov, unsigned int nb);
+
+/* Returns a zeroed submission entry, or NULL if the queue is full */
+struct io_uring_sqe * local_uring_get_sqe(struct local_uring *ring);
+
+/* Submits the queued entries, and waits for at least 'nb_wait' completions */
+int local_uring_submit(struct local_uring *ring, unsigned int nb_wait);
+
+/* Waits for, and consumes, one completion. A negative timeout means waiting
+ * forever; with a timeout of 0, -EAGAIN is returned if there is no completion
+ * available. A positive timeout requires the IORING_FEAT_EXT_ARG feature. */
+int local_uring_wait(struct local_uring *ring, uint64_t *user_data, int *res,
+		int timeout_ms);
+
+#endif /* __IIO_LOCAL_URING_H__ */
@@ -6,11 +6,21 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <sched.h>
+
 #include "debug.h"
+#include "iio-lock.h"
 #include "iio-private.h"
 #include "sort.h"
 #include "libini/ini.h"
 
+#if WITH_LOCAL_IO_URING
+#include "local-uring.h"
+#endif
+
 
 #include <dirent.h>
 #include <errno.h>
@@ -36,6 +46,22 @@
 
 #define NB_BLOCKS 4
 
+/* Bounds of the number of blocks picked in auto mode, and number of
+ * dequeues needed before taking a decision */
+#define AUTO_MIN_NB_BLOCKS 2
+#define AUTO_MAX_NB_BLOCKS 64
+#define AUTO_MIN_NB_DEQUEUED 32
+
+/* Number of blocks in low-latency mode: one being filled by the hardware
+ * while the application processes the other one */
+#define LOW_LATENCY_NB_BLOCKS 2
+
+/* Maximum number of sysfs attribute files kept open per device */
+#define NB_ATTR_FDS 32
+
+/* Maximum number of threads used to create the devices in parallel */
+#define LOCAL_NB_SCAN_THREADS 4
+
 #define BLOCK_ALLOC_IOCTL   _IOWR('i', 0xa0, struct block_alloc_req)
 #define BLOCK_FREE_IOCTL      _IO('i', 0xa1)
 #define BLOCK_QUERY_IOCTL   _IOWR('i', 0xa2, struct block)
@@ -44,11 +70,29 @@
 
 #define BLOCK_FLAG_CYCLIC BIT(1)
 
+/* Mainline DMABUF interface (Linux 6.9+) */
+#define IIO_BUFFER_GET_FD_IOCTL		_IOWR('i', 0x91, int)
+#define IIO_BUFFER_DMABUF_ATTACH_IOCTL	_IOW('i', 0x92, int)
+#define IIO_BUFFER_DMABUF_DETACH_IOCTL	_IOW('i', 0x93, int)
+#define IIO_BUFFER_DMABUF_ENQUEUE_IOCTL	_IOW('i', 0x94, struct iio_dmabuf)
+
+#define IIO_BUFFER_DMABUF_CYCLIC BIT(0)
+
+#define DMA_HEAP_IOCTL_ALLOC	_IOWR('H', 0x0, struct dma_heap_allocation_data)
+#define DMA_BUF_IOCTL_SYNC	_IOW('b', 0, struct dma_buf_sync)
+
+#define DMA_BUF_SYNC_RW		(BIT(0) | BIT(1))
+#define DMA_BUF_SYNC_START	0
+#define DMA_BUF_SYNC_END	BIT(2)
+
+#define DMA_HEAP_PATH "/dev/dma_heap/system"
+
 /* Forward declarations */
 static ssize_t local_read_dev_attr(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len, enum iio_attr_type type);
 static ssize_t local_read_chn_attr(const struct iio_channel *chn,
 		const char *attr, char *dst, size_t len);
+static int local_load_debug_attrs(const struct iio_device *dev);
 static ssize_t local_write_dev_attr(const struct iio_device *dev,
 		const char *attr, const char *src, size_t len, enum iio_attr_type type);
 static ssize_t local_write_chn_attr(const struct iio_channel *chn,
@@ -71,22 +115,127 @@ struct block {
 	uint64_t timestamp;
 };
 
+struct iio_dmabuf {
+	uint32_t fd;
+	uint32_t flags;
+	uint64_t bytes_used;
+};
+
+struct dma_heap_allocation_data {
+	uint64_t len;
+	uint32_t fd;
+	uint32_t fd_flags;
+	uint64_t heap_flags;
+};
+
+struct dma_buf_sync {
+	uint64_t flags;
+};
+
 struct iio_context_pdata {
 	unsigned int rw_timeout_ms;
+
+	/* Protects the generation of the XML, done on first use */
+	struct iio_mutex *xml_lock;
+
+	/* Read the low-speed interface through io_uring */
+	bool want_uring_rx;
+
+#if WITH_LOCAL_IO_URING
+	/* Used to batch attribute accesses; created on first use */
+	struct iio_mutex *uring_lock;
+	struct local_uring *uring;
+	bool uring_failed;
+#endif
+};
+
+/* The cache owns one reference, and each access in progress another one, so
+ * that the file is only closed once nobody uses it */
+struct local_attr_fd {
+	char *path;
+	int fd, flags;
+	unsigned int refs;
+};
+
+#if WITH_LOCAL_IO_URING
+/* Number of reads kept queued by the io_uring data path. They are submitted
+ * in two linked halves, so that they complete in order. */
+#define URING_RX_NB_BUFS 4
+
+#define URING_TAG_CANCEL ((uint64_t) -1)
+#define URING_TAG_IGNORE ((uint64_t) -2)
+
+enum local_rx_state {
+	LOCAL_RX_FREE,
+	LOCAL_RX_QUEUED,
+	LOCAL_RX_READY,
+};
+
+struct local_rx_buf {
+	void *data;
+	enum local_rx_state state;
+	int res;
+	size_t pos;
 };
+#endif
 
 struct iio_device_pdata {
 	int fd;
 	bool blocking;
+	unsigned int busy_poll_us;
 	unsigned int samples_count;
 	unsigned int max_nb_blocks;
+
+	/* Tuning of max_nb_blocks from the slack observed at dequeue time */
+	bool auto_nb_blocks;
+	unsigned int last_nb_blocks, ready_run, max_ready_run;
+	uint64_t nb_dequeued, nb_dequeued_ready;
 	unsigned int allocated_nb_blocks;
 
+	/* Low-latency mode: few blocks, and a watermark of one block */
+	bool low_latency;
+	struct iio_latency_stats latency;
+	uint64_t last_delivery_ns;
+
 	struct block *blocks;
 	void **addrs;
+	bool *block_dequeued;
 	int last_dequeued;
+	uint64_t last_timestamp;
 	bool is_high_speed, cyclic, cyclic_buffer_enqueued;
 
+	/* In cyclic mode, a second block can be staged while the first one
+	 * is being output, and swapped in by the next push */
+	bool want_cyclic_double, is_cyclic_double;
+
+	/* DMABUF mode: one DMABUF per block, attached to buffer_fd. The kernel
+	 * has no dequeue operation, so the blocks are waited for in the order
+	 * they were enqueued. */
+	bool want_dmabuf, is_dmabuf;
+	int buffer_fd;
+	int *dmabuf_fds;
+	unsigned int *dmabuf_queue;
+	unsigned int dmabuf_queue_head, dmabuf_queue_count;
+	unsigned int dmabuf_next_free;
+
+	/* Cache of opened attribute files, replaced in round-robin order */
+	struct iio_mutex *attr_lock;
+	struct local_attr_fd *attr_fds[NB_ATTR_FDS];
+	unsigned int nb_attr_fds, next_attr_fd;
+
+	/* The debug attributes are discovered on first use */
+	bool debug_attrs_loaded;
+
+#if WITH_LOCAL_IO_URING
+	/* io_uring data path of the low-speed interface */
+	struct local_uring *rx_ring;
+	struct local_rx_buf rx_bufs[URING_RX_NB_BUFS];
+	void *rx_mem;
+	size_t rx_buf_size;
+	unsigned int rx_head, rx_nb_queued;
+	bool rx_cancel_queued, rx_cancelled;
+#endif
+
 	int cancel_fd;
 };
 
@@ -128,6 +277,30 @@ static void local_free_channel_pdata(struct iio_channel *chn)
 	}
 }
 
+/* Drop the given number of references. The attr_lock mutex must be held */
+static void local_unref_attr_fd(struct local_attr_fd *entry, unsigned int nb)
+{
+	entry->refs -= nb;
+	if (entry->refs)
+		return;
+
+	close(entry->fd);
+	free(entry->path);
+	free(entry);
+}
+
+/* The attr_lock mutex must be held */
+static void local_close_attr_fds(struct iio_device_pdata *pdata)
+{
+	unsigned int i;
+
+	for (i = 0; i < pdata->nb_attr_fds; i++)
+		local_unref_attr_fd(pdata->attr_fds[i], 1);
+
+	pdata->nb_attr_fds = 0;
+	pdata->next_attr_fd = 0;
+}
+
 static void local_free_pdata(struct iio_device *device)
 {
 	unsigned int i;
@@ -136,12 +309,29 @@ static void local_free_pdata(struct iio_device *device)
 		local_free_channel_pdata(device->channels[i]);
 
 	if (device->pdata) {
+		local_close_attr_fds(device->pdata);
+		if (device->pdata->attr_lock)
+			iio_mutex_destroy(device->pdata->attr_lock);
 		free(device->pdata->blocks);
 		free(device->pdata->addrs);
+		free(device->pdata->block_dequeued);
 		free(device->pdata);
 	}
 }
 
+static void local_free_context_pdata(struct iio_context_pdata *pdata)
+{
+	if (pdata->xml_lock)
+		iio_mutex_destroy(pdata->xml_lock);
+
+#if WITH_LOCAL_IO_URING
+	if (pdata->uring)
+		local_uring_destroy(pdata->uring);
+	if (pdata->uring_lock)
+		iio_mutex_destroy(pdata->uring_lock);
+#endif
+}
+
 static void local_shutdown(struct iio_context *ctx)
 {
 	/* Free the backend data stored in every device structure */
@@ -153,6 +343,8 @@ static void local_shutdown(struct iio_context *ctx)
 		iio_device_close(dev);
 		local_free_pdata(dev);
 	}
+
+	local_free_context_pdata(iio_context_get_pdata(ctx));
 }
 
 /** Shrinks the first nb characters of a string
@@ -265,8 +457,21 @@ static int get_rel_timeout_ms(struct timespec *start, unsigned int timeout_rel)
 	return (int) timeout_rel;
 }
 
+static bool busy_poll_expired(const struct timespec *start, unsigned int us)
+{
+	struct timespec now;
+	uint64_t diff_us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	diff_us = (uint64_t) (now.tv_sec - start->tv_sec) * 1000000
+		+ (uint64_t) (now.tv_nsec - start->tv_nsec) / 1000;
+
+	return diff_us >= us;
+}
+
 static int device_check_ready(const struct iio_device *dev, short events,
-	struct timespec *start)
+	struct timespec *start, bool blocking)
 {
 	struct pollfd pollfd[2] = {
 		{
@@ -279,17 +484,31 @@ static int device_check_ready(const struct iio_device *dev, short events,
 	};
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
 	unsigned int rw_timeout_ms = pdata->rw_timeout_ms;
+	struct timespec spin_start;
 	int timeout_rel;
 	int ret;
 
-	if (!dev->pdata->blocking)
+	if (!blocking)
 		return 0;
 
+	if (dev->pdata->busy_poll_us) {
+		/* Spin before going to sleep, to skip the wakeup latency */
+		clock_gettime(CLOCK_MONOTONIC, &spin_start);
+
+		do {
+			ret = poll(pollfd, 2, 0);
+			if (ret > 0)
+				goto out_check;
+		} while (!busy_poll_expired(&spin_start,
+					    dev->pdata->busy_poll_us));
+	}
+
 	do {
 		timeout_rel = get_rel_timeout_ms(start, rw_timeout_ms);
 		ret = poll(pollfd, 2, timeout_rel);
 	} while (ret == -1 && errno == EINTR);
 
+out_check:
 	if ((pollfd[1].revents & POLLIN))
 		return -EBADF;
 
@@ -304,13 +523,343 @@ static int device_check_ready(const struct iio_device *dev, short events,
 	return 0;
 }
 
-static ssize_t local_read(const struct iio_device *dev,
-		void *dst, size_t len, uint32_t *mask, size_t words)
+#if WITH_LOCAL_IO_URING
+static void local_rx_queue(struct iio_device_pdata *pdata)
+{
+	unsigned int half = URING_RX_NB_BUFS / 2, first, i;
+	struct io_uring_sqe *sqe;
+
+	if (pdata->rx_nb_queued)
+		return;
+
+	/* Queue the half holding the next buffer to consume if it is free,
+	 * otherwise the other half, so that the data stays in order. */
+	first = pdata->rx_head - pdata->rx_head % half;
+	for (i = first; i < first + half; i++) {
+		if (pdata->rx_bufs[i].state != LOCAL_RX_FREE) {
+			first = (first + half) % URING_RX_NB_BUFS;
+			break;
+		}
+	}
+
+	for (i = first; i < first + half; i++) {
+		if (pdata->rx_bufs[i].state != LOCAL_RX_FREE)
+			return;
+	}
+
+	for (i = first; i < first + half; i++) {
+		sqe = local_uring_get_sqe(pdata->rx_ring);
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->fd = pdata->fd;
+		sqe->addr = (uintptr_t) pdata->rx_bufs[i].data;
+		sqe->len = (uint32_t) pdata->rx_buf_size;
+		sqe->buf_index = (uint16_t) i;
+		sqe->user_data = i;
+
+		/* Hard links are not broken by short reads */
+		if (i + 1 < first + half)
+			sqe->flags = IOSQE_IO_HARDLINK;
+
+		pdata->rx_bufs[i].state = LOCAL_RX_QUEUED;
+		pdata->rx_nb_queued++;
+	}
+
+	local_uring_submit(pdata->rx_ring, 0);
+}
+
+static int local_rx_reap(struct iio_device_pdata *pdata, int timeout_ms)
+{
+	struct local_rx_buf *buf;
+	uint64_t data;
+	int ret, res;
+
+	ret = local_uring_wait(pdata->rx_ring, &data, &res, timeout_ms);
+	if (ret < 0)
+		return ret;
+
+	if (data == URING_TAG_CANCEL) {
+		pdata->rx_cancel_queued = false;
+		pdata->rx_cancelled = res > 0;
+	} else if (data < URING_RX_NB_BUFS) {
+		buf = &pdata->rx_bufs[data];
+		buf->state = LOCAL_RX_READY;
+		buf->res = res;
+		buf->pos = 0;
+		pdata->rx_nb_queued--;
+	}
+
+	return 0;
+}
+
+static void local_rx_release(struct iio_device_pdata *pdata)
+{
+	pdata->rx_bufs[pdata->rx_head].state = LOCAL_RX_FREE;
+	pdata->rx_head = (pdata->rx_head + 1) % URING_RX_NB_BUFS;
+}
+
+static ssize_t local_rx_read(const struct iio_device *dev,
+		void *dst, size_t len, bool blocking)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	uintptr_t ptr = (uintptr_t) dst;
+	struct timespec start, spin_start;
+	struct local_rx_buf *buf;
+	ssize_t readsize;
+	size_t count;
+	int ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (len > 0) {
+		if (pdata->rx_cancelled) {
+			ret = -EBADF;
+			break;
+		}
+
+		local_rx_queue(pdata);
+
+		buf = &pdata->rx_bufs[pdata->rx_head];
+		if (buf->state != LOCAL_RX_READY) {
+			if (blocking && pdata->busy_poll_us) {
+				clock_gettime(CLOCK_MONOTONIC, &spin_start);
+
+				do {
+					ret = local_rx_reap(pdata, 0);
+				} while (ret == -EAGAIN &&
+					 !busy_poll_expired(&spin_start,
+							    pdata->busy_poll_us));
+				if (!ret)
+					continue;
+				if (ret != -EAGAIN)
+					break;
+			}
+
+			ret = local_rx_reap(pdata, blocking ? get_rel_timeout_ms(&start,
+						ctx_pdata->rw_timeout_ms) : 0);
+			if (ret == -EAGAIN && blocking)
+				ret = -ETIMEDOUT;
+			if (ret < 0)
+				break;
+
+			continue;
+		}
+
+		if (buf->res <= 0) {
+			ret = buf->res ? buf->res : -EIO;
+			local_rx_release(pdata);
+
+			/* Reads can be interrupted by a signal */
+			if (ret == -EINTR || ret == -EAGAIN)
+				continue;
+			break;
+		}
+
+		count = (size_t) buf->res - buf->pos;
+		if (count > len)
+			count = len;
+
+		memcpy((void *) ptr, (void *) ((uintptr_t) buf->data + buf->pos),
+		       count);
+		buf->pos += count;
+		ptr += count;
+		len -= count;
+
+		if (buf->pos == (size_t) buf->res)
+			local_rx_release(pdata);
+	}
+
+	readsize = (ssize_t)(ptr - (uintptr_t) dst);
+	if ((!ret || ret == -EAGAIN) && readsize > 0)
+		return readsize;
+	else
+		return ret;
+}
+
+/*
+ * Keep reads of the character device queued in an io_uring, into registered
+ * buffers. The cancellation eventfd is polled in the same ring, so that
+ * iio_buffer_cancel() wakes up a waiting reader.
+ */
+static int local_rx_setup(const struct iio_device *dev, size_t samples_count)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iovec iov[URING_RX_NB_BUFS];
+	struct io_uring_sqe *sqe;
+	struct local_uring *ring;
+	ssize_t sample_size;
+	unsigned int i;
+	void *mem;
+	int ret, flags;
+
+	sample_size = iio_device_get_sample_size(dev);
+	if (sample_size <= 0)
+		return -EINVAL;
+
+	ring = local_uring_create(2 * URING_RX_NB_BUFS);
+	if (!ring)
+		return -ENOSYS;
+
+	if (!local_uring_has_op(ring, IORING_OP_READ_FIXED)
+	    || !local_uring_has_op(ring, IORING_OP_POLL_ADD)
+	    || !local_uring_has_op(ring, IORING_OP_ASYNC_CANCEL)
+	    || !local_uring_has_feature(ring, IORING_FEAT_EXT_ARG)) {
+		ret = -ENOSYS;
+		goto err_destroy_ring;
+	}
+
+	pdata->rx_buf_size = samples_count * (size_t) sample_size;
+
+	mem = malloc(pdata->rx_buf_size * URING_RX_NB_BUFS);
+	if (!mem) {
+		ret = -ENOMEM;
+		goto err_destroy_ring;
+	}
+
+	for (i = 0; i < URING_RX_NB_BUFS; i++) {
+		iov[i].iov_base = (void *) ((uintptr_t) mem + i * pdata->rx_buf_size);
+		iov[i].iov_len = pdata->rx_buf_size;
+
+		pdata->rx_bufs[i].data = iov[i].iov_base;
+		pdata->rx_bufs[i].state = LOCAL_RX_FREE;
+	}
+
+	/* Fails e.g. if over the RLIMIT_MEMLOCK limit */
+	ret = local_uring_register_buffers(ring, iov, URING_RX_NB_BUFS);
+	if (ret < 0) {
+		ret = -ENOSYS;
+		goto err_free_mem;
+	}
+
+	/* The reads must wait for data, instead of failing with EAGAIN */
+	flags = fcntl(pdata->fd, F_GETFL);
+	if (flags < 0 || fcntl(pdata->fd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+		ret = -errno;
+		goto err_free_mem;
+	}
+
+	sqe = local_uring_get_sqe(ring);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = pdata->cancel_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_TAG_CANCEL;
+
+	ret = local_uring_submit(ring, 0);
+	if (ret < 0)
+		goto err_free_mem;
+
+	pdata->rx_ring = ring;
+	pdata->rx_mem = mem;
+	pdata->rx_head = 0;
+	pdata->rx_nb_queued = 0;
+	pdata->rx_cancel_queued = true;
+	pdata->rx_cancelled = false;
+
+	return 0;
+
+err_free_mem:
+	free(mem);
+err_destroy_ring:
+	local_uring_destroy(ring);
+	return ret;
+}
+
+static void local_rx_free(struct iio_device_pdata *pdata)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int i, tries;
+
+	/* Cancel the queued reads, and wait for them to complete. The reads
+	 * linked after a cancelled one only start then, so retry. */
+	for (tries = 0; tries < 50; tries++) {
+		if (!pdata->rx_nb_queued && !pdata->rx_cancel_queued)
+			break;
+
+		for (i = 0; i < URING_RX_NB_BUFS; i++) {
+			if (pdata->rx_bufs[i].state != LOCAL_RX_QUEUED)
+				continue;
+
+			sqe = local_uring_get_sqe(pdata->rx_ring);
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = i;
+			sqe->user_data = URING_TAG_IGNORE;
+		}
+
+		if (pdata->rx_cancel_queued) {
+			sqe = local_uring_get_sqe(pdata->rx_ring);
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = URING_TAG_CANCEL;
+			sqe->user_data = URING_TAG_IGNORE;
+		}
+
+		if (local_uring_submit(pdata->rx_ring, 0) < 0)
+			break;
+
+		while (!local_rx_reap(pdata, 10));
+	}
+
+	if (pdata->rx_nb_queued)
+		IIO_WARNING("Unable to cancel the queued reads\n");
+
+	/* Unregisters the buffers, before they can be freed */
+	local_uring_destroy(pdata->rx_ring);
+	pdata->rx_ring = NULL;
+
+	free(pdata->rx_mem);
+	pdata->rx_mem = NULL;
+}
+#endif /* WITH_LOCAL_IO_URING */
+
+/* Number of blocks of a non-cyclic buffer */
+static unsigned int local_nb_blocks(const struct iio_device_pdata *pdata)
+{
+	if (pdata->low_latency && pdata->max_nb_blocks > LOW_LATENCY_NB_BLOCKS)
+		return LOW_LATENCY_NB_BLOCKS;
+
+	return pdata->max_nb_blocks;
+}
+
+/*
+ * Account for a block delivered to the application. The drivers which
+ * support it timestamp the blocks of the high-speed interface when they are
+ * completed, with the monotonic clock; otherwise only the intervals between
+ * the deliveries are known.
+ */
+static void local_account_latency(struct iio_device_pdata *pdata,
+		uint64_t timestamp)
+{
+	struct iio_latency_stats *stats = &pdata->latency;
+	uint64_t now = iio_time_ns(), latency;
+
+	if (pdata->last_delivery_ns &&
+	    now - pdata->last_delivery_ns > stats->max_interval_ns)
+		stats->max_interval_ns = now - pdata->last_delivery_ns;
+
+	pdata->last_delivery_ns = now;
+	stats->nb_blocks++;
+
+	if (!timestamp || timestamp > now)
+		return;
+
+	latency = now - timestamp;
+
+	if (!stats->nb_measured || latency < stats->min_ns)
+		stats->min_ns = latency;
+	if (latency > stats->max_ns)
+		stats->max_ns = latency;
+
+	stats->total_ns += latency;
+	stats->nb_measured++;
+}
+
+static ssize_t local_do_read(const struct iio_device *dev, void *dst,
+		size_t len, uint32_t *mask, size_t words, bool blocking)
 {
 	struct iio_device_pdata *pdata = dev->pdata;
 	uintptr_t ptr = (uintptr_t) dst;
 	struct timespec start;
 	ssize_t readsize;
+	bool skip_poll;
 	ssize_t ret;
 
 	if (pdata->fd == -1)
@@ -323,19 +872,35 @@ static ssize_t local_read(const struct iio_device *dev,
 	if (len == 0)
 		return 0;
 
+#if WITH_LOCAL_IO_URING
+	if (pdata->rx_ring) {
+		ret = local_rx_read(dev, dst, len, blocking);
+		if (ret == (ssize_t) len)
+			local_account_latency(pdata, 0);
+		return ret;
+	}
+#endif
+
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
+	/* In low-latency mode, poll() is only called if no data is ready */
+	skip_poll = pdata->low_latency;
+
 	while (len > 0) {
-		ret = device_check_ready(dev, POLLIN, &start);
-		if (ret < 0)
-			break;
+		if (!skip_poll) {
+			ret = device_check_ready(dev, POLLIN, &start, blocking);
+			if (ret < 0)
+				break;
+		}
+
+		skip_poll = false;
 
 		do {
 			ret = read(pdata->fd, (void *) ptr, len);
 		} while (ret == -1 && errno == EINTR);
 
 		if (ret == -1) {
-			if (pdata->blocking && errno == EAGAIN)
+			if (blocking && errno == EAGAIN)
 				continue;
 			ret = -errno;
 			break;
@@ -349,14 +914,17 @@ static ssize_t local_read(const struct iio_device *dev,
 	}
 
 	readsize = (ssize_t)(ptr - (uintptr_t) dst);
-	if ((ret > 0 || ret == -EAGAIN) && (readsize > 0))
+	if ((ret > 0 || ret == -EAGAIN) && (readsize > 0)) {
+		if (!len)
+			local_account_latency(pdata, 0);
 		return readsize;
-	else
+	} else {
 		return ret;
+	}
 }
 
-static ssize_t local_write(const struct iio_device *dev,
-		const void *src, size_t len)
+static ssize_t local_do_write(const struct iio_device *dev,
+		const void *src, size_t len, bool blocking)
 {
 	struct iio_device_pdata *pdata = dev->pdata;
 	uintptr_t ptr = (uintptr_t) src;
@@ -373,7 +941,7 @@ static ssize_t local_write(const struct iio_device *dev,
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	while (len > 0) {
-		ret = device_check_ready(dev, POLLOUT, &start);
+		ret = device_check_ready(dev, POLLOUT, &start, blocking);
 		if (ret < 0)
 			break;
 
@@ -382,7 +950,7 @@ static ssize_t local_write(const struct iio_device *dev,
 		} while (ret == -1 && errno == EINTR);
 
 		if (ret == -1) {
-			if (pdata->blocking && errno == EAGAIN)
+			if (blocking && errno == EAGAIN)
 				continue;
 
 			ret = -errno;
@@ -403,6 +971,30 @@ static ssize_t local_write(const struct iio_device *dev,
 		return ret;
 }
 
+static ssize_t local_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	return local_do_read(dev, dst, len, mask, words, dev->pdata->blocking);
+}
+
+static ssize_t local_try_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	return local_do_read(dev, dst, len, mask, words, false);
+}
+
+static ssize_t local_write(const struct iio_device *dev,
+		const void *src, size_t len)
+{
+	return local_do_write(dev, src, len, dev->pdata->blocking);
+}
+
+static ssize_t local_try_write(const struct iio_device *dev,
+		const void *src, size_t len)
+{
+	return local_do_write(dev, src, len, false);
+}
+
 static int local_buffer_enabled_set(const struct iio_device *dev, bool en)
 {
 	int ret;
@@ -428,75 +1020,867 @@ static int local_set_kernel_buffers_count(const struct iio_device *dev,
 	return 0;
 }
 
-static ssize_t local_get_buffer(const struct iio_device *dev,
-		void **addr_ptr, size_t bytes_used,
-		uint32_t *mask, size_t words)
+static int local_set_kernel_buffers_auto(const struct iio_device *dev,
+		bool enable)
 {
-	struct block block;
 	struct iio_device_pdata *pdata = dev->pdata;
-	struct timespec start;
-	char err_str[1024];
-	int f = pdata->fd;
-	ssize_t ret;
 
-	if (!pdata->is_high_speed)
-		return -ENOSYS;
-	if (f == -1)
-		return -EBADF;
-	if (!addr_ptr)
-		return -EINVAL;
+	if (pdata->fd != -1)
+		return -EBUSY;
 
-	if (pdata->last_dequeued >= 0) {
-		struct block *last_block = &pdata->blocks[pdata->last_dequeued];
+	pdata->auto_nb_blocks = enable;
 
-		if (pdata->cyclic) {
-			if (pdata->cyclic_buffer_enqueued)
-				return -EBUSY;
-			pdata->blocks[0].flags |= BLOCK_FLAG_CYCLIC;
-			pdata->cyclic_buffer_enqueued = true;
-		}
+	return 0;
+}
 
-		last_block->bytes_used = bytes_used;
-		ret = (ssize_t) ioctl_nointr(f,
-				BLOCK_ENQUEUE_IOCTL, last_block);
-		if (ret) {
-			iio_strerror(-ret, err_str, sizeof(err_str));
-			IIO_ERROR("Unable to enqueue block: %s\n", err_str);
-			return ret;
-		}
+static int local_get_kernel_buffers_stats(const struct iio_device *dev,
+		struct iio_kernel_buffers_stats *stats)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	stats->nb_blocks = pdata->last_nb_blocks;
+	stats->next_nb_blocks = pdata->max_nb_blocks;
+	stats->nb_dequeued = pdata->nb_dequeued;
+	stats->nb_ready = pdata->nb_dequeued_ready;
+	stats->max_ready = pdata->max_ready_run;
+
+	return 0;
+}
+
+static int local_set_low_latency(const struct iio_device *dev, bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (pdata->fd != -1)
+		return -EBUSY;
+
+	pdata->low_latency = enable;
+
+	return 0;
+}
+
+static int local_get_latency_stats(const struct iio_device *dev,
+		struct iio_latency_stats *stats)
+{
+	*stats = dev->pdata->latency;
+
+	return 0;
+}
+
+/*
+ * Pick the number of blocks of the next buffer. A run of N blocks that were
+ * all complete when dequeued means that the application lagged N blocks
+ * behind the hardware: if that covers all the blocks owned by the kernel, the
+ * hardware was stalled, and more blocks are needed. Otherwise, shrink toward
+ * the deepest lag seen plus a margin of one block, halving at most each time.
+ */
+static void local_tune_nb_blocks(struct iio_device_pdata *pdata)
+{
+	unsigned int nb = pdata->allocated_nb_blocks, target;
+
+	if (pdata->nb_dequeued < AUTO_MIN_NB_DEQUEUED || !nb)
+		return;
+
+	if (pdata->max_ready_run + 1 >= nb) {
+		target = nb * 2;
+		if (target > AUTO_MAX_NB_BLOCKS)
+			target = AUTO_MAX_NB_BLOCKS;
+	} else {
+		target = pdata->max_ready_run + 2;
+		if (target < nb / 2)
+			target = nb / 2;
+		if (target < AUTO_MIN_NB_BLOCKS)
+			target = AUTO_MIN_NB_BLOCKS;
+		if (target > nb)
+			target = nb;
+	}
+
+	if (target != pdata->max_nb_blocks)
+		IIO_DEBUG("Using %u kernel buffers instead of %u\n",
+			  target, pdata->max_nb_blocks);
+
+	pdata->max_nb_blocks = target;
+}
+
+static bool local_block_ready(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct pollfd pollfd = {
+		.fd = pdata->fd,
+		.events = POLLIN | POLLOUT,
+	};
+
+	if (pdata->is_dmabuf) {
+		if (!pdata->dmabuf_queue_count)
+			return false;
+
+		pollfd.fd = pdata->dmabuf_fds[pdata->dmabuf_queue[
+			pdata->dmabuf_queue_head]];
+		pollfd.events = POLLOUT;
+	}
+
+	return poll(&pollfd, 1, 0) > 0;
+}
+
+static void local_account_dequeue(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	/* Output blocks that were never enqueued say nothing about the rate */
+	if (pdata->is_dmabuf && iio_device_is_tx(dev) &&
+	    pdata->dmabuf_next_free < pdata->allocated_nb_blocks)
+		return;
+
+	pdata->nb_dequeued++;
+
+	if (local_block_ready(dev)) {
+		pdata->nb_dequeued_ready++;
+		pdata->ready_run++;
+		if (pdata->ready_run > pdata->max_ready_run)
+			pdata->max_ready_run = pdata->ready_run;
+	} else {
+		pdata->ready_run = 0;
+	}
+}
+
+static int local_dmabuf_sync(int fd, uint64_t flags)
+{
+	struct dma_buf_sync req = {
+		.flags = flags | DMA_BUF_SYNC_RW,
+	};
+
+	return ioctl_nointr(fd, DMA_BUF_IOCTL_SYNC, &req);
+}
+
+/* Wait until the hardware is done with the given DMABUF, i.e. until all the
+ * fences attached to it are signaled */
+static int local_dmabuf_wait(const struct iio_device *dev, int fd,
+		bool blocking)
+{
+	struct pollfd pollfd[2] = {
+		{
+			.fd = fd,
+			.events = POLLOUT,
+		}, {
+			.fd = dev->pdata->cancel_fd,
+			.events = POLLIN,
+		}
+	};
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct timespec start;
+	int timeout_rel = 0;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	do {
+		if (blocking)
+			timeout_rel = get_rel_timeout_ms(&start,
+							 pdata->rw_timeout_ms);
+		ret = poll(pollfd, 2, timeout_rel);
+	} while (ret == -1 && errno == EINTR);
+
+	if ((pollfd[1].revents & POLLIN))
+		return -EBADF;
+
+	if (ret < 0)
+		return -errno;
+	if (!ret)
+		return blocking ? -ETIMEDOUT : -EAGAIN;
+	if (pollfd[0].revents & POLLNVAL)
+		return -EBADF;
+	if (!(pollfd[0].revents & POLLOUT))
+		return -EIO;
+	return 0;
+}
+
+static int local_dmabuf_dequeue(const struct iio_device *dev,
+		struct block *block, bool blocking)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	unsigned int id;
+	int ret;
+
+	if (iio_device_is_tx(dev) &&
+	    pdata->dmabuf_next_free < pdata->allocated_nb_blocks) {
+		/* Output blocks that were never enqueued are free to use */
+		id = pdata->dmabuf_next_free++;
+	} else {
+		if (!pdata->dmabuf_queue_count)
+			return -ENOBUFS;
+
+		id = pdata->dmabuf_queue[pdata->dmabuf_queue_head];
+
+		ret = local_dmabuf_wait(dev, pdata->dmabuf_fds[id], blocking);
+		if (ret < 0)
+			return ret;
+
+		pdata->dmabuf_queue_head = (pdata->dmabuf_queue_head + 1)
+			% pdata->allocated_nb_blocks;
+		pdata->dmabuf_queue_count--;
+	}
+
+	ret = local_dmabuf_sync(pdata->dmabuf_fds[id], DMA_BUF_SYNC_START);
+	if (ret < 0)
+		return ret;
+
+	*block = pdata->blocks[id];
+	block->bytes_used = block->size;
+	return 0;
+}
+
+static int local_dmabuf_enqueue(const struct iio_device *dev,
+		struct block *block)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iio_dmabuf req = {
+		.fd = (uint32_t) pdata->dmabuf_fds[block->id],
+		.bytes_used = block->bytes_used,
+	};
+	unsigned int pos;
+	int ret;
+
+	if (block->flags & BLOCK_FLAG_CYCLIC)
+		req.flags |= IIO_BUFFER_DMABUF_CYCLIC;
+
+	ret = local_dmabuf_sync(pdata->dmabuf_fds[block->id], DMA_BUF_SYNC_END);
+	if (ret < 0)
+		return ret;
+
+	ret = ioctl_nointr(pdata->buffer_fd,
+			   IIO_BUFFER_DMABUF_ENQUEUE_IOCTL, &req);
+	if (ret < 0)
+		return ret;
+
+	pos = (pdata->dmabuf_queue_head + pdata->dmabuf_queue_count)
+		% pdata->allocated_nb_blocks;
+	pdata->dmabuf_queue[pos] = block->id;
+	pdata->dmabuf_queue_count++;
+	return 0;
+}
+
+static int local_dequeue(const struct iio_device *dev, struct block *block,
+		bool blocking)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct timespec start;
+	char err_str[1024];
+	bool skip_poll;
+	int ret;
+
+	if (pdata->auto_nb_blocks && !pdata->cyclic)
+		local_account_dequeue(dev);
+
+	if (pdata->is_dmabuf)
+		return local_dmabuf_dequeue(dev, block, blocking);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* In low-latency mode, poll() is only called if no block is ready */
+	skip_poll = pdata->low_latency;
+
+	do {
+		if (!skip_poll) {
+			ret = device_check_ready(dev, POLLIN | POLLOUT,
+						 &start, blocking);
+			if (ret < 0)
+				return ret;
+		}
+
+		skip_poll = false;
+
+		memset(block, 0, sizeof(*block));
+		ret = ioctl_nointr(pdata->fd, BLOCK_DEQUEUE_IOCTL, block);
+	} while (blocking && ret == -EAGAIN);
+
+	if (ret) {
+		if ((!blocking && ret != -EAGAIN) ||
+				(blocking && ret != -ETIMEDOUT)) {
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to dequeue block: %s\n", err_str);
+		}
+		return ret;
+	}
+
+	if (block->id >= pdata->allocated_nb_blocks)
+		return -EIO;
+
+	return 0;
+}
+
+static int local_enqueue(const struct iio_device *dev, struct block *block)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	char err_str[1024];
+	int ret;
+
+	if (pdata->is_dmabuf)
+		ret = local_dmabuf_enqueue(dev, block);
+	else
+		ret = ioctl_nointr(pdata->fd, BLOCK_ENQUEUE_IOCTL, block);
+	if (ret) {
+		iio_strerror(-ret, err_str, sizeof(err_str));
+		IIO_ERROR("Unable to enqueue block: %s\n", err_str);
+	}
+
+	return ret;
+}
+
+static ssize_t local_do_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used, bool blocking)
+{
+	struct block block;
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t ret;
+
+	if (!pdata->is_high_speed)
+		return -ENOSYS;
+	if (pdata->fd == -1)
+		return -EBADF;
+	if (!addr_ptr)
+		return -EINVAL;
+
+	if (pdata->last_dequeued >= 0) {
+		struct block *last_block = &pdata->blocks[pdata->last_dequeued];
 
 		if (pdata->cyclic) {
+			if (pdata->cyclic_buffer_enqueued &&
+			    !pdata->is_cyclic_double)
+				return -EBUSY;
+			last_block->flags |= BLOCK_FLAG_CYCLIC;
+			pdata->cyclic_buffer_enqueued = true;
+		}
+
+		last_block->bytes_used = bytes_used;
+		ret = (ssize_t) local_enqueue(dev, last_block);
+		if (ret)
+			return ret;
+
+		if (pdata->cyclic && !pdata->is_cyclic_double) {
 			*addr_ptr = pdata->addrs[pdata->last_dequeued];
 			return (ssize_t) last_block->bytes_used;
 		}
 
-		pdata->last_dequeued = -1;
+		/* With double-buffering, the block dequeued below is the one
+		 * the hardware stops repeating once the new one is swapped in,
+		 * at the end of its current period. */
+
+		pdata->last_dequeued = -1;
+	}
+
+	ret = local_dequeue(dev, &block, blocking);
+	if (ret < 0)
+		return ret;
+
+	pdata->last_dequeued = block.id;
+	pdata->last_timestamp = block.timestamp;
+	local_account_latency(pdata, block.timestamp);
+	*addr_ptr = pdata->addrs[block.id];
+	return (ssize_t) block.bytes_used;
+}
+
+static ssize_t local_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used,
+		uint32_t *mask, size_t words)
+{
+	return local_do_get_buffer(dev, addr_ptr, bytes_used,
+				   dev->pdata->blocking);
+}
+
+static ssize_t local_try_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used,
+		uint32_t *mask, size_t words)
+{
+	return local_do_get_buffer(dev, addr_ptr, bytes_used, false);
+}
+
+static int local_get_timestamp(const struct iio_device *dev,
+		uint64_t *timestamp)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (!pdata->is_high_speed)
+		return -ENOSYS;
+	if (pdata->fd == -1)
+		return -EBADF;
+
+	*timestamp = pdata->last_timestamp;
+	return 0;
+}
+
+static ssize_t local_dequeue_block(const struct iio_device *dev,
+		unsigned int *id, void **addr_ptr, uint64_t *timestamp)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct block block;
+	int ret;
+
+	if (!pdata->is_high_speed)
+		return -ENOSYS;
+	if (pdata->fd == -1)
+		return -EBADF;
+
+	/* In cyclic mode, the only block is owned by iio_buffer_push() */
+	if (pdata->cyclic)
+		return -EPERM;
+
+	ret = local_dequeue(dev, &block, pdata->blocking);
+	if (ret < 0)
+		return (ssize_t) ret;
+
+	pdata->block_dequeued[block.id] = true;
+	*id = block.id;
+	*addr_ptr = pdata->addrs[block.id];
+	*timestamp = block.timestamp;
+	return (ssize_t) block.bytes_used;
+}
+
+static int local_enqueue_block(const struct iio_device *dev,
+		unsigned int id, size_t bytes_used)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct block *block;
+	int ret;
+
+	if (!pdata->is_high_speed)
+		return -ENOSYS;
+	if (pdata->fd == -1)
+		return -EBADF;
+	if (id >= pdata->allocated_nb_blocks || !pdata->block_dequeued[id])
+		return -EINVAL;
+
+	block = &pdata->blocks[id];
+	if (bytes_used > block->size)
+		return -EINVAL;
+
+	block->bytes_used = (uint32_t) bytes_used;
+
+	/* See iio_block_enqueue() */
+	pdata->block_dequeued[id] = false;
+
+	ret = local_enqueue(dev, block);
+	if (ret)
+		pdata->block_dequeued[id] = true;
+
+	return ret;
+}
+
+static int local_get_dmabuf_fd(const struct iio_device *dev, unsigned int id)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (!pdata->is_dmabuf)
+		return -ENOSYS;
+	if (id >= pdata->allocated_nb_blocks)
+		return -EINVAL;
+
+	return pdata->dmabuf_fds[id];
+}
+
+static int local_set_cyclic_double_buffer(const struct iio_device *dev,
+		bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (pdata->fd != -1)
+		return -EBUSY;
+
+	pdata->want_cyclic_double = enable;
+
+	return 0;
+}
+
+static int local_set_dmabuf(const struct iio_device *dev, bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (pdata->fd != -1)
+		return -EBUSY;
+
+	pdata->want_dmabuf = enable;
+
+	return 0;
+}
+
+static int local_attr_path(const struct iio_device *dev, const char *attr,
+		enum iio_attr_type type, char *buf, size_t len)
+{
+	switch (type) {
+		case IIO_ATTR_TYPE_DEVICE:
+			iio_snprintf(buf, len, "/sys/bus/iio/devices/%s/%s",
+					dev->id, attr);
+			break;
+		case IIO_ATTR_TYPE_DEBUG:
+			iio_snprintf(buf, len, "/sys/kernel/debug/iio/%s/%s",
+					dev->id, attr);
+			break;
+		case IIO_ATTR_TYPE_BUFFER:
+			iio_snprintf(buf, len, "/sys/bus/iio/devices/%s/buffer/%s",
+					dev->id, attr);
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+#if WITH_LOCAL_IO_URING
+#define URING_NB_ENTRIES 64
+
+/* Maximum size read from one attribute in a batch; sysfs attributes are
+ * limited to one page. Larger attributes are read again one by one. */
+#define URING_ATTR_SIZE 4096
+
+struct local_attr_io {
+	char path[1024];
+	char *buf;
+	size_t len;
+	int fd, ret;
+};
+
+/* Returns the io_uring of the context, created on first use, or NULL if the
+ * kernel cannot be used to batch attribute accesses. The uring_lock mutex
+ * must be held. */
+static struct local_uring * local_get_uring(struct iio_context_pdata *pdata)
+{
+	if (pdata->uring || pdata->uring_failed)
+		return pdata->uring;
+
+	pdata->uring = local_uring_create(URING_NB_ENTRIES);
+	if (pdata->uring && (!local_uring_has_op(pdata->uring, IORING_OP_OPENAT)
+			|| !local_uring_has_op(pdata->uring, IORING_OP_READ)
+			|| !local_uring_has_op(pdata->uring, IORING_OP_WRITE)
+			|| !local_uring_has_op(pdata->uring, IORING_OP_CLOSE))) {
+		local_uring_destroy(pdata->uring);
+		pdata->uring = NULL;
+	}
+
+	if (!pdata->uring) {
+		IIO_DEBUG("io_uring unavailable, attributes will be accessed one by one\n");
+		pdata->uring_failed = true;
+	}
+
+	return pdata->uring;
+}
+
+/* Submits the queued operations, and waits for 'nb' completions. If 'store'
+ * is set, their results are stored in the 'ret' field of the entries. */
+static int local_uring_complete(struct local_uring *ring,
+		struct local_attr_io *ios, unsigned int nb, bool store)
+{
+	uint64_t idx;
+	int ret, res;
+
+	ret = local_uring_submit(ring, nb);
+	while (!ret && nb--) {
+		ret = local_uring_wait(ring, &idx, &res, -1);
+		if (!ret && store)
+			ios[idx].ret = res;
+	}
+
+	return ret;
+}
+
+/* Returns a free submission entry in 'sqe'. If the queue is full, the
+ * 'nb_queued' operations queued so far are submitted and completed first,
+ * and their results stored if 'store' is set. 'last' points to the end of
+ * the chain of linked entries, if any, which is terminated beforehand. */
+static int local_uring_next_sqe(struct local_uring *ring,
+		struct local_attr_io *ios, unsigned int *nb_queued,
+		struct io_uring_sqe **last, bool store,
+		struct io_uring_sqe **sqe)
+{
+	int ret;
+
+	*sqe = local_uring_get_sqe(ring);
+	if (*sqe)
+		return 0;
+
+	if (!*nb_queued)
+		return -EBUSY;
+
+	if (last && *last) {
+		(*last)->flags = 0;
+		*last = NULL;
+	}
+
+	ret = local_uring_complete(ring, ios, *nb_queued, store);
+	*nb_queued = 0;
+	if (ret < 0)
+		return ret;
+
+	*sqe = local_uring_get_sqe(ring);
+
+	return *sqe ? 0 : -EBUSY;
+}
+
+/*
+ * Read or write a batch of attribute files with three submissions: one opens
+ * all the files, one accesses them, and one closes them. The writes are
+ * linked, so that they are applied in order.
+ */
+static int local_uring_run(struct local_uring *ring,
+		struct local_attr_io *ios, unsigned int nb, bool write)
+{
+	struct io_uring_sqe *sqe, *last;
+	unsigned int i, first = 0, nb_ops = 0;
+	int ret = 0;
+
+	for (i = 0; i < nb; i++)
+		ios[i].ret = -EBADF;
+
+	for (i = 0; !ret && i < nb; i++) {
+		ret = local_uring_next_sqe(ring, ios, &nb_ops,
+					   NULL, true, &sqe);
+		if (ret < 0)
+			break;
+
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t) ios[i].path;
+		sqe->open_flags = (write ? O_WRONLY : O_RDONLY) | O_CLOEXEC;
+		sqe->user_data = i;
+		nb_ops++;
+	}
+
+	if (!ret)
+		ret = local_uring_complete(ring, ios, nb_ops, true);
+
+	/* The entries that could not be opened keep the error code. On error,
+	 * the files opened so far are closed. */
+	for (i = 0; i < nb; i++)
+		ios[i].fd = ios[i].ret;
+
+	if (ret < 0)
+		goto out_close;
+
+	do {
+		last = NULL;
+
+		for (i = first, nb_ops = 0; i < nb; i++) {
+			if (ios[i].fd < 0)
+				continue;
+
+			ret = local_uring_next_sqe(ring, ios, &nb_ops,
+						   &last, true, &sqe);
+			if (ret < 0)
+				goto out_close;
+
+			sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+			sqe->fd = ios[i].fd;
+			sqe->addr = (uintptr_t) ios[i].buf;
+			sqe->len = (uint32_t) ios[i].len;
+			sqe->user_data = i;
+			if (write)
+				sqe->flags = IOSQE_IO_LINK;
+
+			last = sqe;
+			nb_ops++;
+		}
+
+		if (last)
+			last->flags = 0;
+
+		ret = local_uring_complete(ring, ios, nb_ops, true);
+		if (ret < 0)
+			goto out_close;
+
+		/* A failed write breaks the chain, and the following writes are
+		 * cancelled: submit them again. */
+		for (i = first, first = nb; write && i < nb; i++) {
+			if (ios[i].fd >= 0 && ios[i].ret == -ECANCELED) {
+				first = i;
+				break;
+			}
+		}
+	} while (first < nb);
+
+out_close:
+	/* After an error, the files are closed directly */
+	for (i = 0, nb_ops = 0; i < nb; i++) {
+		if (ios[i].fd < 0)
+			continue;
+
+		if (!ret) {
+			ret = local_uring_next_sqe(ring, ios, &nb_ops,
+						   NULL, false, &sqe);
+		}
+		if (ret) {
+			close(ios[i].fd);
+			continue;
+		}
+
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = ios[i].fd;
+		sqe->user_data = i;
+		nb_ops++;
+	}
+
+	if (!ret)
+		ret = local_uring_complete(ring, ios, nb_ops, false);
+
+	return ret;
+}
+
+static ssize_t local_uring_read_attrs(const struct iio_device *dev,
+		const char * const *attrs, unsigned int nb,
+		enum iio_attr_type type, char *dst, size_t len)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct local_attr_io *ios;
+	struct local_uring *ring;
+	unsigned int i, j, nb_ios;
+	char *ptr = dst, *data;
+	ssize_t ret;
+
+	ios = malloc(URING_NB_ENTRIES * sizeof(*ios));
+	data = malloc(URING_NB_ENTRIES * URING_ATTR_SIZE);
+	if (!ios || !data) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	iio_mutex_lock(ctx_pdata->uring_lock);
+
+	ring = local_get_uring(ctx_pdata);
+	if (!ring) {
+		ret = -ENOSYS;
+		goto out_unlock;
+	}
+
+	for (i = 0; len >= 4 && i < nb; i += nb_ios) {
+		nb_ios = nb - i < URING_NB_ENTRIES ? nb - i : URING_NB_ENTRIES;
+
+		for (j = 0; j < nb_ios; j++) {
+			ret = local_attr_path(dev, attrs[i + j], type,
+					ios[j].path, sizeof(ios[j].path));
+			if (ret < 0)
+				goto out_unlock;
+
+			ios[j].buf = data + j * URING_ATTR_SIZE;
+			ios[j].len = URING_ATTR_SIZE;
+		}
+
+		ret = local_uring_run(ring, ios, nb_ios, false);
+		if (ret < 0)
+			goto out_unlock;
+
+		for (j = 0; len >= 4 && j < nb_ios; j++) {
+			ret = ios[j].ret;
+
+			/* Same semantics as local_read_dev_attr() */
+			if (ret == URING_ATTR_SIZE) {
+				ret = local_read_dev_attr(dev, attrs[i + j],
+						ptr + 4, len - 4, type);
+			} else if (ret >= (ssize_t) (len - 4)) {
+				ret = -EFBIG;
+			} else if (ret > 0) {
+				memcpy(ptr + 4, ios[j].buf, ret);
+				ptr[4 + ret - 1] = '\0';
+			} else if (!ret) {
+				ret = -EIO;
+			}
+
+			*(uint32_t *) ptr = iio_htobe32(ret);
+
+			/* Align the length to 4 bytes */
+			if (ret > 0 && ret & 3)
+				ret = ((ret >> 2) + 1) << 2;
+			ptr += 4 + (ret < 0 ? 0 : ret);
+			len -= 4 + (ret < 0 ? 0 : ret);
+		}
+	}
+
+	ret = ptr - dst;
+
+out_unlock:
+	iio_mutex_unlock(ctx_pdata->uring_lock);
+out_free:
+	free(data);
+	free(ios);
+	return ret;
+}
+
+/* The buffer must have been verified with local_buffer_analyze() */
+static ssize_t local_uring_write_attrs(const struct iio_device *dev,
+		const char * const *attrs, unsigned int nb,
+		enum iio_attr_type type, const char *src)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct local_attr_io *ios;
+	struct local_uring *ring;
+	unsigned int i, nb_ios = 0;
+	const char *ptr = src;
+	ssize_t ret = 0;
+
+	ios = malloc(URING_NB_ENTRIES * sizeof(*ios));
+	if (!ios)
+		return -ENOMEM;
+
+	iio_mutex_lock(ctx_pdata->uring_lock);
+
+	ring = local_get_uring(ctx_pdata);
+	if (!ring) {
+		ret = -ENOSYS;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < nb; i++) {
+		int32_t val = (int32_t) iio_be32toh(*(uint32_t *) ptr);
+		ptr += 4;
+
+		if (val > 0) {
+			ret = local_attr_path(dev, attrs[i], type,
+					ios[nb_ios].path, sizeof(ios[nb_ios].path));
+			if (ret < 0)
+				goto out_unlock;
+
+			ios[nb_ios].buf = (char *) ptr;
+			ios[nb_ios].len = (size_t) val;
+			nb_ios++;
+
+			/* Align the length to 4 bytes */
+			if (val & 3)
+				val = ((val >> 2) + 1) << 2;
+			ptr += val;
+		}
+
+		if (nb_ios == URING_NB_ENTRIES || (nb_ios && i == nb - 1)) {
+			ret = local_uring_run(ring, ios, nb_ios, true);
+			if (ret < 0)
+				goto out_unlock;
+
+			nb_ios = 0;
+		}
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = ptr - src;
 
-	do {
-		ret = (ssize_t) device_check_ready(dev, POLLIN | POLLOUT, &start);
-		if (ret < 0)
-			return ret;
+out_unlock:
+	iio_mutex_unlock(ctx_pdata->uring_lock);
+	free(ios);
+	return ret;
+}
 
-		memset(&block, 0, sizeof(block));
-		ret = (ssize_t) ioctl_nointr(f, BLOCK_DEQUEUE_IOCTL, &block);
-	} while (pdata->blocking && ret == -EAGAIN);
+/* Returns NULL if the channel has no attribute */
+static const char ** local_chn_attr_filenames(const struct iio_channel *chn)
+{
+	const char **names;
+	unsigned int i;
 
-	if (ret) {
-		if ((!pdata->blocking && ret != -EAGAIN) ||
-				(pdata->blocking && ret != -ETIMEDOUT)) {
-			iio_strerror(-ret, err_str, sizeof(err_str));
-			IIO_ERROR("Unable to dequeue block: %s\n", err_str);
-		}
-		return ret;
+	if (!chn->nb_attrs)
+		return NULL;
+
+	names = calloc(chn->nb_attrs, sizeof(*names));
+	if (names) {
+		for (i = 0; i < chn->nb_attrs; i++)
+			names[i] = chn->attrs[i].filename;
 	}
 
-	pdata->last_dequeued = block.id;
-	*addr_ptr = pdata->addrs[block.id];
-	return (ssize_t) block.bytes_used;
+	return names;
 }
+#endif /* WITH_LOCAL_IO_URING */
 
 static ssize_t local_read_all_dev_attrs(const struct iio_device *dev,
 		char *dst, size_t len, enum iio_attr_type type)
@@ -511,6 +1895,7 @@ static ssize_t local_read_all_dev_attrs(const struct iio_device *dev,
 			attrs = dev->attrs.names;
 			break;
 		case IIO_ATTR_TYPE_DEBUG:
+			local_load_debug_attrs(dev);
 			nb =  dev->debug_attrs.num;
 			attrs = dev->debug_attrs.names;
 			break;
@@ -523,6 +1908,15 @@ static ssize_t local_read_all_dev_attrs(const struct iio_device *dev,
 			break;
 	}
 
+#if WITH_LOCAL_IO_URING
+	{
+		ssize_t ret = local_uring_read_attrs(dev,
+				(const char * const *) attrs, nb, type, dst, len);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+#endif
+
 	for (i = 0; len >= 4 && i < nb; i++) {
 		/* Recursive! */
 		ssize_t ret = local_read_dev_attr(dev, attrs[i],
@@ -545,6 +1939,19 @@ static ssize_t local_read_all_chn_attrs(const struct iio_channel *chn,
 	unsigned int i;
 	char *ptr = dst;
 
+#if WITH_LOCAL_IO_URING
+	const char **names = local_chn_attr_filenames(chn);
+
+	if (names) {
+		ssize_t ret = local_uring_read_attrs(chn->dev, names,
+				chn->nb_attrs, IIO_ATTR_TYPE_DEVICE, dst, len);
+
+		free(names);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+#endif
+
 	for (i = 0; len >= 4 && i < chn->nb_attrs; i++) {
 		/* Recursive! */
 		ssize_t ret = local_read_chn_attr(chn,
@@ -602,6 +2009,7 @@ static ssize_t local_write_all_dev_attrs(const struct iio_device *dev,
 			attrs = dev->attrs.names;
 			break;
 		case IIO_ATTR_TYPE_DEBUG:
+			local_load_debug_attrs(dev);
 			nb =  dev->debug_attrs.num;
 			attrs = dev->debug_attrs.names;
 			break;
@@ -618,6 +2026,15 @@ static ssize_t local_write_all_dev_attrs(const struct iio_device *dev,
 	if (local_buffer_analyze(nb, src, len))
 		return -EINVAL;
 
+#if WITH_LOCAL_IO_URING
+	{
+		ssize_t ret = local_uring_write_attrs(dev,
+				(const char * const *) attrs, nb, type, src);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+#endif
+
 	/* Second step: write the attributes */
 	for (i = 0; i < nb; i++) {
 		int32_t val = (int32_t) iio_be32toh(*(uint32_t *) ptr);
@@ -646,6 +2063,21 @@ static ssize_t local_write_all_chn_attrs(const struct iio_channel *chn,
 	if (local_buffer_analyze(nb, src, len))
 		return -EINVAL;
 
+#if WITH_LOCAL_IO_URING
+	if (nb) {
+		const char **names = local_chn_attr_filenames(chn);
+
+		if (names) {
+			ssize_t ret = local_uring_write_attrs(chn->dev, names,
+					nb, IIO_ATTR_TYPE_DEVICE, src);
+
+			free(names);
+			if (ret != -ENOSYS)
+				return ret;
+		}
+	}
+#endif
+
 	/* Second step: write the attributes */
 	for (i = 0; i < nb; i++) {
 		int32_t val = (int32_t) iio_be32toh(*(uint32_t *) ptr);
@@ -664,94 +2096,211 @@ static ssize_t local_write_all_chn_attrs(const struct iio_channel *chn,
 	return ptr - src;
 }
 
+/* The attr_lock mutex must be held */
+static struct local_attr_fd * local_find_attr_fd(
+		struct iio_device_pdata *pdata, const char *path, int flags)
+{
+	struct local_attr_fd *entry;
+	unsigned int i;
+
+	for (i = 0; i < pdata->nb_attr_fds; i++) {
+		entry = pdata->attr_fds[i];
+		if (entry->flags == flags && !strcmp(entry->path, path))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Get a file descriptor of the given attribute file, opened with the given
+ * flags. The file stays open, so that next accesses only cost one pread() or
+ * pwrite(). The attr_lock mutex is only held while looking up or updating the
+ * cache, so that a slow attribute does not delay the accesses to the others;
+ * the entry must be released with local_release_attr_fd().
+ */
+static int local_get_attr_fd(struct iio_device_pdata *pdata,
+		const char *path, int flags, struct local_attr_fd **entry_ptr)
+{
+	struct local_attr_fd *entry, *old;
+	int fd;
+
+	iio_mutex_lock(pdata->attr_lock);
+	entry = local_find_attr_fd(pdata, path, flags);
+	if (entry)
+		entry->refs++;
+	iio_mutex_unlock(pdata->attr_lock);
+
+	if (entry) {
+		*entry_ptr = entry;
+		return 0;
+	}
+
+	fd = open(path, flags | O_CLOEXEC);
+	if (fd == -1 && (errno == EMFILE || errno == ENFILE)) {
+		/* Release our cached files before failing */
+		iio_mutex_lock(pdata->attr_lock);
+		local_close_attr_fds(pdata);
+		iio_mutex_unlock(pdata->attr_lock);
+
+		fd = open(path, flags | O_CLOEXEC);
+	}
+	if (fd == -1)
+		return -errno;
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	entry->path = iio_strdup(path);
+	if (!entry->path) {
+		free(entry);
+		close(fd);
+		return -ENOMEM;
+	}
+
+	entry->fd = fd;
+	entry->flags = flags;
+	entry->refs = 2;
+
+	iio_mutex_lock(pdata->attr_lock);
+
+	/* Another thread may have opened the same file in the meantime */
+	old = local_find_attr_fd(pdata, path, flags);
+	if (old) {
+		old->refs++;
+		local_unref_attr_fd(entry, 2);
+		entry = old;
+	} else if (pdata->nb_attr_fds < NB_ATTR_FDS) {
+		pdata->attr_fds[pdata->nb_attr_fds++] = entry;
+	} else {
+		local_unref_attr_fd(pdata->attr_fds[pdata->next_attr_fd], 1);
+		pdata->attr_fds[pdata->next_attr_fd] = entry;
+		pdata->next_attr_fd = (pdata->next_attr_fd + 1) % NB_ATTR_FDS;
+	}
+
+	iio_mutex_unlock(pdata->attr_lock);
+
+	*entry_ptr = entry;
+	return 0;
+}
+
+/* Release an entry obtained with local_get_attr_fd(). After an error, the
+ * file is removed from the cache, in case it went stale (e.g. the device was
+ * removed). */
+static void local_release_attr_fd(struct iio_device_pdata *pdata,
+		struct local_attr_fd *entry, bool failed)
+{
+	unsigned int i, nb = 1;
+
+	iio_mutex_lock(pdata->attr_lock);
+
+	for (i = 0; failed && i < pdata->nb_attr_fds; i++) {
+		if (pdata->attr_fds[i] != entry)
+			continue;
+
+		/* Also drop the reference of the cache */
+		nb++;
+
+		pdata->attr_fds[i] = pdata->attr_fds[--pdata->nb_attr_fds];
+		if (pdata->next_attr_fd >= pdata->nb_attr_fds)
+			pdata->next_attr_fd = 0;
+		break;
+	}
+
+	local_unref_attr_fd(entry, nb);
+
+	iio_mutex_unlock(pdata->attr_lock);
+}
+
 static ssize_t local_read_dev_attr(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len, enum iio_attr_type type)
 {
-	FILE *f;
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct local_attr_fd *entry;
 	char buf[1024];
 	ssize_t ret;
 
 	if (!attr)
 		return local_read_all_dev_attrs(dev, dst, len, type);
 
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/%s",
-					dev->id, attr);
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			iio_snprintf(buf, sizeof(buf), "/sys/kernel/debug/iio/%s/%s",
-					dev->id, attr);
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/buffer/%s",
-					dev->id, attr);
-			break;
-		default:
-			return -EINVAL;
-	}
+	ret = local_attr_path(dev, attr, type, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
 
-	f = fopen(buf, "re");
-	if (!f)
-		return -errno;
+	ret = local_get_attr_fd(pdata, buf, O_RDONLY, &entry);
+	if (ret < 0)
+		return ret;
+
+	do {
+		ret = pread(entry->fd, dst, len, 0);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
+		ret = -errno;
 
-	ret = fread(dst, 1, len, f);
+	local_release_attr_fd(pdata, entry, ret < 0);
 
 	/* if we didn't read the entire file, fail */
-	if (!feof(f))
+	if (ret > 0 && (size_t) ret == len)
 		ret = -EFBIG;
 
 	if (ret > 0)
 		dst[ret - 1] = '\0';
-	else
+	else if (len)
 		dst[0] = '\0';
 
-	fflush(f);
-	if (ferror(f))
-		ret = -errno;
-	fclose(f);
 	return ret ? ret : -EIO;
 }
 
 static ssize_t local_write_dev_attr(const struct iio_device *dev,
 		const char *attr, const char *src, size_t len, enum iio_attr_type type)
 {
-	FILE *f;
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct local_attr_fd *entry;
 	char buf[1024];
 	ssize_t ret;
 
 	if (!attr)
 		return local_write_all_dev_attrs(dev, src, len, type);
 
-	switch (type) {
-		case IIO_ATTR_TYPE_DEVICE:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/%s",
-					dev->id, attr);
-			break;
-		case IIO_ATTR_TYPE_DEBUG:
-			iio_snprintf(buf, sizeof(buf), "/sys/kernel/debug/iio/%s/%s",
-					dev->id, attr);
-			break;
-		case IIO_ATTR_TYPE_BUFFER:
-			iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s/buffer/%s",
-					dev->id, attr);
-			break;
-		default:
-			return -EINVAL;
-	}
+	ret = local_attr_path(dev, attr, type, buf, sizeof(buf));
+	if (ret < 0)
+		return ret;
 
-	f = fopen(buf, "we");
-	if (!f)
-		return -errno;
+	ret = local_get_attr_fd(pdata, buf, O_WRONLY, &entry);
+	if (ret < 0)
+		return ret;
 
-	ret = fwrite(src, 1, len, f);
-	fflush(f);
-	if (ferror(f))
+	do {
+		ret = pwrite(entry->fd, src, len, 0);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
 		ret = -errno;
-	fclose(f);
+
+	local_release_attr_fd(pdata, entry, ret < 0);
+
 	return ret ? ret : -EIO;
 }
 
+static int local_close_ctx_attr_fds(const struct iio_context *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		struct iio_device_pdata *pdata = ctx->devices[i]->pdata;
+
+		iio_mutex_lock(pdata->attr_lock);
+		local_close_attr_fds(pdata);
+		iio_mutex_unlock(pdata->attr_lock);
+	}
+
+	return 0;
+}
+
 static const char * get_filename(const struct iio_channel *chn,
 		const char *attr)
 {
@@ -798,6 +2347,11 @@ static int channel_write_state(const struct iio_channel *chn, bool en)
 		return 0;
 }
 
+static unsigned int local_nb_cyclic_blocks(const struct iio_device_pdata *pdata)
+{
+	return pdata->want_cyclic_double ? 2 : 1;
+}
+
 static int enable_high_speed(const struct iio_device *dev)
 {
 	struct block_alloc_req req;
@@ -818,10 +2372,10 @@ static int enable_high_speed(const struct iio_device *dev)
 		return -ENOSYS;
 
 	if (pdata->cyclic) {
-		nb_blocks = 1;
+		nb_blocks = local_nb_cyclic_blocks(pdata);
 		IIO_DEBUG("Enabling cyclic mode\n");
 	} else {
-		nb_blocks = pdata->max_nb_blocks;
+		nb_blocks = local_nb_blocks(pdata);
 		IIO_DEBUG("Cyclic mode not enabled\n");
 	}
 
@@ -836,6 +2390,13 @@ static int enable_high_speed(const struct iio_device *dev)
 		return -ENOMEM;
 	}
 
+	pdata->block_dequeued = calloc(nb_blocks,
+			sizeof(*pdata->block_dequeued));
+	if (!pdata->block_dequeued) {
+		ret = -ENOMEM;
+		goto err_freemem;
+	}
+
 	req.id = 0;
 	req.type = 0;
 	req.size = pdata->samples_count *
@@ -874,21 +2435,228 @@ static int enable_high_speed(const struct iio_device *dev)
 		}
 	}
 
-	pdata->last_dequeued = -1;
+	pdata->last_dequeued = -1;
+	return 0;
+
+err_munmap:
+	for (; i > 0; i--)
+		munmap(pdata->addrs[i - 1], pdata->blocks[i - 1].size);
+err_block_free:
+	ioctl_nointr(fd, BLOCK_FREE_IOCTL, 0);
+	pdata->allocated_nb_blocks = 0;
+err_freemem:
+	free(pdata->block_dequeued);
+	pdata->block_dequeued = NULL;
+	free(pdata->addrs);
+	pdata->addrs = NULL;
+	free(pdata->blocks);
+	pdata->blocks = NULL;
+	return ret;
+}
+
+static void free_dmabuf_blocks(struct iio_device_pdata *pdata,
+		unsigned int nb_blocks)
+{
+	unsigned int i;
+
+	for (i = nb_blocks; i > 0; i--) {
+		munmap(pdata->addrs[i - 1], pdata->blocks[i - 1].size);
+		ioctl_nointr(pdata->buffer_fd, IIO_BUFFER_DMABUF_DETACH_IOCTL,
+			     &pdata->dmabuf_fds[i - 1]);
+		close(pdata->dmabuf_fds[i - 1]);
+	}
+
+	if (pdata->buffer_fd != pdata->fd)
+		close(pdata->buffer_fd);
+	pdata->buffer_fd = -1;
+	pdata->allocated_nb_blocks = 0;
+
+	free(pdata->dmabuf_queue);
+	pdata->dmabuf_queue = NULL;
+	free(pdata->dmabuf_fds);
+	pdata->dmabuf_fds = NULL;
+	free(pdata->block_dequeued);
+	pdata->block_dequeued = NULL;
+	free(pdata->addrs);
+	pdata->addrs = NULL;
+	free(pdata->blocks);
+	pdata->blocks = NULL;
+}
+
+static int enable_dmabuf(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct dma_heap_allocation_data req;
+	unsigned int i = 0, nb_blocks;
+	int ret, heap_fd, buffer_fd = 0;
+	size_t size;
+
+	nb_blocks = pdata->cyclic ? local_nb_cyclic_blocks(pdata)
+		: local_nb_blocks(pdata);
+	size = pdata->samples_count *
+		iio_device_get_sample_size_mask(dev, dev->mask, dev->words);
+
+	heap_fd = open(DMA_HEAP_PATH, O_RDWR | O_CLOEXEC);
+	if (heap_fd == -1)
+		return -ENOSYS;
+
+	/* Get a file descriptor for the first buffer of the device, on which
+	 * the DMABUF ioctls are done. Use the main fd on old kernels. */
+	ret = ioctl_nointr(pdata->fd, IIO_BUFFER_GET_FD_IOCTL, &buffer_fd);
+	pdata->buffer_fd = ret < 0 ? pdata->fd : buffer_fd;
+
+	pdata->blocks = calloc(nb_blocks, sizeof(*pdata->blocks));
+	pdata->addrs = calloc(nb_blocks, sizeof(*pdata->addrs));
+	pdata->block_dequeued = calloc(nb_blocks,
+			sizeof(*pdata->block_dequeued));
+	pdata->dmabuf_fds = calloc(nb_blocks, sizeof(*pdata->dmabuf_fds));
+	pdata->dmabuf_queue = calloc(nb_blocks, sizeof(*pdata->dmabuf_queue));
+	if (!pdata->blocks || !pdata->addrs || !pdata->block_dequeued ||
+	    !pdata->dmabuf_fds || !pdata->dmabuf_queue) {
+		ret = -ENOMEM;
+		goto err_free_blocks;
+	}
+
+	for (i = 0; i < nb_blocks; i++) {
+		memset(&req, 0, sizeof(req));
+		req.len = size;
+		req.fd_flags = O_RDWR | O_CLOEXEC;
+
+		ret = ioctl_nointr(heap_fd, DMA_HEAP_IOCTL_ALLOC, &req);
+		if (ret < 0)
+			goto err_free_blocks;
+
+		pdata->dmabuf_fds[i] = (int) req.fd;
+
+		ret = ioctl_nointr(pdata->buffer_fd,
+				   IIO_BUFFER_DMABUF_ATTACH_IOCTL,
+				   &pdata->dmabuf_fds[i]);
+		if (ret < 0) {
+			close(pdata->dmabuf_fds[i]);
+			/* The kernel does not support DMABUF */
+			if (ret == -ENOTTY || ret == -EINVAL)
+				ret = -ENOSYS;
+			goto err_free_blocks;
+		}
+
+		pdata->addrs[i] = mmap(0, size, PROT_READ | PROT_WRITE,
+				       MAP_SHARED, pdata->dmabuf_fds[i], 0);
+		if (pdata->addrs[i] == MAP_FAILED) {
+			ret = -errno;
+			ioctl_nointr(pdata->buffer_fd,
+				     IIO_BUFFER_DMABUF_DETACH_IOCTL,
+				     &pdata->dmabuf_fds[i]);
+			close(pdata->dmabuf_fds[i]);
+			goto err_free_blocks;
+		}
+
+		pdata->blocks[i].id = i;
+		pdata->blocks[i].size = (uint32_t) size;
+	}
+
+	close(heap_fd);
+
+	pdata->allocated_nb_blocks = nb_blocks;
+	pdata->dmabuf_queue_head = 0;
+	pdata->dmabuf_queue_count = 0;
+	pdata->dmabuf_next_free = 0;
+	pdata->last_dequeued = -1;
+	pdata->is_dmabuf = true;
+
+	/* Input blocks are all handed to the hardware right away */
+	if (!iio_device_is_tx(dev)) {
+		for (i = 0; i < nb_blocks; i++) {
+			pdata->blocks[i].bytes_used = (uint32_t) size;
+			ret = local_dmabuf_enqueue(dev, &pdata->blocks[i]);
+			if (ret < 0)
+				goto err_disable;
+		}
+	}
+
+	return 0;
+
+err_disable:
+	pdata->is_dmabuf = false;
+	free_dmabuf_blocks(pdata, nb_blocks);
+	return ret;
+
+err_free_blocks:
+	close(heap_fd);
+	free_dmabuf_blocks(pdata, i);
+	return ret;
+}
+
+/* Writes the enable state of all the channels; the disabled ones first, so
+ * that the kernel doesn't reject the new scan mask */
+static int local_write_channels_state(const struct iio_device *dev)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *chn = dev->channels[i];
+		if (chn->index >= 0 && !iio_channel_is_enabled(chn)) {
+			ret = channel_write_state(chn, false);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *chn = dev->channels[i];
+		if (chn->index >= 0 && iio_channel_is_enabled(chn)) {
+			ret = channel_write_state(chn, true);
+			if (ret < 0)
+				return ret;
+		}
+	}
+
 	return 0;
+}
 
-err_munmap:
-	for (; i > 0; i--)
-		munmap(pdata->addrs[i - 1], pdata->blocks[i - 1].size);
-err_block_free:
-	ioctl_nointr(fd, BLOCK_FREE_IOCTL, 0);
-	pdata->allocated_nb_blocks = 0;
-err_freemem:
-	free(pdata->addrs);
-	pdata->addrs = NULL;
-	free(pdata->blocks);
-	pdata->blocks = NULL;
-	return ret;
+/*
+ * Size the kernel buffer of the low-speed interface after the number of
+ * blocks. This avoids losing samples when refilling the iio_buffer.
+ */
+static int local_set_buffer_length(const struct iio_device *dev,
+		size_t samples_count)
+{
+	unsigned long size = samples_count * local_nb_blocks(dev->pdata);
+	char buf[32];
+	ssize_t ret;
+
+	iio_snprintf(buf, sizeof(buf), "%lu", size);
+	ret = local_write_dev_attr(dev, "buffer/length",
+			buf, strlen(buf) + 1, false);
+
+	return ret < 0 ? (int) ret : 0;
+}
+
+/*
+ * In low-latency mode, wake up the application as soon as one block is
+ * complete, whatever the watermark left by the previous user of the device.
+ * The watermark must not exceed the length, so it is set after it.
+ */
+static int local_set_watermark(const struct iio_device *dev,
+		size_t samples_count)
+{
+	char buf[32];
+	ssize_t ret;
+
+	if (!dev->pdata->low_latency)
+		return 0;
+
+	iio_snprintf(buf, sizeof(buf), "%lu", (unsigned long) samples_count);
+	ret = local_write_dev_attr(dev, "buffer/watermark",
+			buf, strlen(buf) + 1, false);
+
+	/* Kernels older than 4.2 have no watermark */
+	if (ret == -ENOENT) {
+		IIO_WARNING("Buffer watermark not supported\n");
+		return 0;
+	}
+
+	return ret < 0 ? (int) ret : 0;
 }
 
 static int local_close(const struct iio_device *dev);
@@ -896,7 +2664,6 @@ static int local_close(const struct iio_device *dev);
 static int local_open(const struct iio_device *dev,
 		size_t samples_count, bool cyclic)
 {
-	unsigned int i;
 	int ret;
 	char buf[1024];
 	struct iio_device_pdata *pdata = dev->pdata;
@@ -925,37 +2692,48 @@ static int local_open(const struct iio_device *dev,
 		return -errno;
 	}
 
-	/* Disable channels */
-	for (i = 0; i < dev->nb_channels; i++) {
-		struct iio_channel *chn = dev->channels[i];
-		if (chn->index >= 0 && !iio_channel_is_enabled(chn)) {
-			ret = channel_write_state(chn, false);
-			if (ret < 0)
-				goto err_close;
-		}
-	}
-	/* Enable channels */
-	for (i = 0; i < dev->nb_channels; i++) {
-		struct iio_channel *chn = dev->channels[i];
-		if (chn->index >= 0 && iio_channel_is_enabled(chn)) {
-			ret = channel_write_state(chn, true);
-			if (ret < 0)
-				goto err_close;
-		}
-	}
+	ret = local_write_channels_state(dev);
+	if (ret < 0)
+		goto err_close;
 
 	pdata->cyclic = cyclic;
 	pdata->cyclic_buffer_enqueued = false;
+	pdata->is_cyclic_double = false;
 	pdata->samples_count = samples_count;
 
-	ret = enable_high_speed(dev);
+	ret = -ENOSYS;
+	if (pdata->want_dmabuf) {
+		ret = enable_dmabuf(dev);
+		if (ret == -ENOSYS)
+			IIO_WARNING("DMABUF mode not supported\n");
+		else if (ret < 0)
+			goto err_close;
+	}
+
+	if (ret == -ENOSYS)
+		ret = enable_high_speed(dev);
 	if (ret < 0 && ret != -ENOSYS)
 		goto err_close;
 
 	pdata->is_high_speed = !ret;
 
+	pdata->last_nb_blocks = pdata->is_high_speed ?
+		pdata->allocated_nb_blocks : local_nb_blocks(pdata);
+	pdata->nb_dequeued = 0;
+	pdata->nb_dequeued_ready = 0;
+	pdata->ready_run = 0;
+	pdata->max_ready_run = 0;
+	memset(&pdata->latency, 0, sizeof(pdata->latency));
+	pdata->last_delivery_ns = 0;
+
+	if (pdata->is_high_speed && cyclic && pdata->want_cyclic_double) {
+		/* The kernel might give us less blocks than requested */
+		pdata->is_cyclic_double = pdata->allocated_nb_blocks >= 2;
+		if (!pdata->is_cyclic_double)
+			IIO_WARNING("Cyclic double-buffering not available\n");
+	}
+
 	if (!pdata->is_high_speed) {
-		unsigned long size = samples_count * pdata->max_nb_blocks;
 		IIO_WARNING("High-speed mode not enabled\n");
 
 		/* Cyclic mode is only supported in high-speed mode */
@@ -964,16 +2742,26 @@ static int local_open(const struct iio_device *dev,
 			goto err_close;
 		}
 
-		/* Increase the size of the kernel buffer, when using the
-		 * low-speed interface. This avoids losing samples when
-		 * refilling the iio_buffer. */
-		iio_snprintf(buf, sizeof(buf), "%lu", size);
-		ret = local_write_dev_attr(dev, "buffer/length",
-				buf, strlen(buf) + 1, false);
+		ret = local_set_buffer_length(dev, samples_count);
 		if (ret < 0)
 			goto err_close;
+
+#if WITH_LOCAL_IO_URING
+		if (!iio_device_is_tx(dev)
+		    && iio_context_get_pdata(dev->ctx)->want_uring_rx) {
+			ret = local_rx_setup(dev, samples_count);
+			if (ret == -ENOSYS)
+				IIO_WARNING("io_uring data path not supported\n");
+			else if (ret < 0)
+				goto err_close;
+		}
+#endif
 	}
 
+	ret = local_set_watermark(dev, samples_count);
+	if (ret < 0)
+		goto err_close;
+
 	ret = local_buffer_enabled_set(dev, true);
 	if (ret < 0)
 		goto err_close;
@@ -996,7 +2784,14 @@ static int local_close(const struct iio_device *dev)
 
 	ret = 0;
 	ret1 = 0;
-	if (pdata->is_high_speed) {
+
+	if (pdata->auto_nb_blocks && pdata->is_high_speed && !pdata->cyclic)
+		local_tune_nb_blocks(pdata);
+
+	if (pdata->is_dmabuf) {
+		free_dmabuf_blocks(pdata, pdata->allocated_nb_blocks);
+		pdata->is_dmabuf = false;
+	} else if (pdata->is_high_speed) {
 		if (pdata->addrs) {
 			for (i = 0; i < pdata->allocated_nb_blocks; i++)
 				munmap(pdata->addrs[i], pdata->blocks[i].size);
@@ -1008,12 +2803,21 @@ static int local_close(const struct iio_device *dev)
 			IIO_ERROR("Error during ioctl(): %s\n", err_str);
 		}
 		pdata->allocated_nb_blocks = 0;
+		free(pdata->block_dequeued);
+		pdata->block_dequeued = NULL;
 		free(pdata->addrs);
 		pdata->addrs = NULL;
 		free(pdata->blocks);
 		pdata->blocks = NULL;
 	}
 
+#if WITH_LOCAL_IO_URING
+	if (pdata->rx_ring)
+		local_rx_free(pdata);
+#endif
+
+	pdata->busy_poll_us = 0;
+
 	ret1 = close(pdata->fd);
 	if (ret1) {
 		ret1 = -errno;
@@ -1068,12 +2872,162 @@ static int local_close(const struct iio_device *dev)
 	return ret;
 }
 
+/* Hands the blocks filled before the channels were changed back to the
+ * hardware, so that their samples, laid out for the previous channels, are
+ * not read. Called with the buffer disabled. */
+static int local_recycle_blocks(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct block block;
+	unsigned int i;
+	int ret;
+
+	if (pdata->last_dequeued >= 0) {
+		block = pdata->blocks[pdata->last_dequeued];
+		block.bytes_used = block.size;
+		pdata->last_dequeued = -1;
+
+		ret = local_enqueue(dev, &block);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (i = 0; i < pdata->allocated_nb_blocks; i++) {
+		if (pdata->is_dmabuf) {
+			ret = local_dmabuf_dequeue(dev, &block, false);
+		} else {
+			memset(&block, 0, sizeof(block));
+			ret = ioctl_nointr(pdata->fd, BLOCK_DEQUEUE_IOCTL, &block);
+		}
+		if (ret == -EAGAIN || ret == -ENOBUFS)
+			break;
+		if (ret < 0)
+			return ret;
+		if (block.id >= pdata->allocated_nb_blocks)
+			return -EIO;
+
+		block = pdata->blocks[block.id];
+		block.bytes_used = block.size;
+
+		ret = local_enqueue(dev, &block);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int local_reconfigure(const struct iio_device *dev,
+		size_t samples_count)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t sample_size;
+	int ret;
+
+	if (pdata->fd == -1)
+		return -EBADF;
+
+	/* The blocks of cyclic and output buffers hold the samples of the
+	 * application, which can't be dropped */
+	if (pdata->cyclic || (pdata->is_high_speed && iio_device_is_tx(dev)))
+		return -ENOSYS;
+
+#if WITH_LOCAL_IO_URING
+	/* The ring was set up for the previous size of the samples */
+	if (pdata->rx_ring)
+		return -ENOSYS;
+#endif
+
+	if (pdata->is_high_speed) {
+		sample_size = iio_device_get_sample_size_mask(dev,
+				dev->mask, dev->words);
+		if (sample_size <= 0)
+			return sample_size ? (int) sample_size : -EINVAL;
+
+		/* The hardware fills the blocks completely, so the blocks
+		 * already allocated can only be kept if the new samples fill
+		 * them exactly */
+		if ((size_t) sample_size * samples_count != pdata->blocks[0].size)
+			return -ENOSPC;
+	}
+
+	ret = local_buffer_enabled_set(dev, false);
+	if (ret < 0)
+		return ret;
+
+	ret = local_write_channels_state(dev);
+	if (ret < 0)
+		return ret;
+
+	if (pdata->is_high_speed)
+		ret = local_recycle_blocks(dev);
+	else
+		ret = local_set_buffer_length(dev, samples_count);
+	if (ret < 0)
+		return ret;
+
+	ret = local_set_watermark(dev, samples_count);
+	if (ret < 0)
+		return ret;
+
+	pdata->samples_count = samples_count;
+
+	return local_buffer_enabled_set(dev, true);
+}
+
 static int local_get_fd(const struct iio_device *dev)
 {
 	if (dev->pdata->fd == -1)
 		return -EBADF;
-	else
-		return dev->pdata->fd;
+
+#if WITH_LOCAL_IO_URING
+	/* The queued reads consume the data: polling is meaningless */
+	if (dev->pdata->rx_ring)
+		return -ENOSYS;
+#endif
+
+	return dev->pdata->fd;
+}
+
+static int local_set_io_uring(struct iio_context *ctx, bool enable)
+{
+	if (!WITH_LOCAL_IO_URING)
+		return -ENOSYS;
+
+	iio_context_get_pdata(ctx)->want_uring_rx = enable;
+	return 0;
+}
+
+static int local_set_busy_poll(const struct iio_device *dev,
+		unsigned int busy_poll_us, int cpu)
+{
+	char err_str[1024];
+	cpu_set_t set;
+	int ret;
+
+	if (dev->pdata->fd == -1)
+		return -EBADF;
+
+	if (cpu >= 0) {
+		if (cpu >= CPU_SETSIZE)
+			return -EINVAL;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		ret = sched_setaffinity(0, sizeof(set), &set);
+		if (ret) {
+			ret = -errno;
+			iio_strerror(-ret, err_str, sizeof(err_str));
+			IIO_ERROR("Unable to pin thread to CPU %i: %s\n",
+				  cpu, err_str);
+			return ret;
+		}
+	}
+
+	dev->pdata->busy_poll_us = busy_poll_us;
+
+	return 0;
 }
 
 static int local_set_blocking_mode(const struct iio_device *dev, bool blocking)
@@ -1759,26 +3713,53 @@ static int add_buffer_attributes(struct iio_device *dev, const char *devpath)
 	return 0;
 }
 
-static int create_device(void *d, const char *path)
+static void init_data_offset(struct iio_channel *chn);
+static void init_data_scale(struct iio_channel *chn);
+
+static int local_init_device_pdata(struct iio_device *dev)
+{
+	dev->pdata = zalloc(sizeof(*dev->pdata));
+	if (!dev->pdata)
+		return -ENOMEM;
+
+	dev->pdata->fd = -1;
+	dev->pdata->buffer_fd = -1;
+	dev->pdata->blocking = true;
+	dev->pdata->max_nb_blocks = NB_BLOCKS;
+
+	dev->pdata->attr_lock = iio_mutex_create();
+	if (!dev->pdata->attr_lock) {
+		local_free_pdata(dev);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void local_free_device(struct iio_device *dev)
+{
+	local_free_pdata(dev);
+	free_device(dev);
+}
+
+/* Creates the device, without adding it to the context yet; this can be
+ * called from several threads at once. */
+static int local_create_device(struct iio_context *ctx, const char *path,
+		struct iio_device **devp)
 {
 	uint32_t *mask = NULL;
 	unsigned int i;
 	int ret;
-	struct iio_context *ctx = d;
 	struct iio_device *dev = zalloc(sizeof(*dev));
 	if (!dev)
 		return -ENOMEM;
 
-	dev->pdata = zalloc(sizeof(*dev->pdata));
-	if (!dev->pdata) {
+	ret = local_init_device_pdata(dev);
+	if (ret < 0) {
 		free(dev);
-		return -ENOMEM;
+		return ret;
 	}
 
-	dev->pdata->fd = -1;
-	dev->pdata->blocking = true;
-	dev->pdata->max_nb_blocks = NB_BLOCKS;
-
 	dev->ctx = ctx;
 	dev->id = iio_strdup(strrchr(path, '/') + 1);
 	if (!dev->id) {
@@ -1806,46 +3787,169 @@ static int create_device(void *d, const char *path)
 		if (ret < 0)
 			goto err_free_scan_elements;
 
-		ret = handle_scan_elements(chn);
-		free_protected_attrs(chn);
-		if (ret < 0)
-			goto err_free_scan_elements;
+		ret = handle_scan_elements(chn);
+		free_protected_attrs(chn);
+		if (ret < 0)
+			goto err_free_scan_elements;
+	}
+
+	ret = detect_and_move_global_attrs(dev);
+	if (ret < 0)
+		goto err_free_device;
+
+	/* sorting is done after global attrs are added */
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *chn = dev->channels[i];
+		qsort(chn->attrs,  chn->nb_attrs, sizeof(struct iio_channel_attr),
+			iio_channel_attr_compare);
+	}
+	qsort(dev->attrs.names, dev->attrs.num, sizeof(char *),
+		iio_device_attr_compare);
+
+	dev->words = (dev->nb_channels + 31) / 32;
+	if (dev->words) {
+		mask = calloc(dev->words, sizeof(*mask));
+		if (!mask) {
+			ret = -ENOMEM;
+			goto err_free_device;
+		}
+	}
+
+	dev->mask = mask;
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		init_data_scale(dev->channels[i]);
+		init_data_offset(dev->channels[i]);
+	}
+
+	/* Don't keep the files read during the scan open: growing the file
+	 * descriptor table of a multi-threaded process is slow. */
+	local_close_attr_fds(dev->pdata);
+
+	*devp = dev;
+	return 0;
+
+err_free_scan_elements:
+	for (i = 0; i < dev->nb_channels; i++)
+		free_protected_attrs(dev->channels[i]);
+err_free_device:
+	local_free_device(dev);
+	return ret;
+}
+
+struct local_scan {
+	struct iio_context *ctx;
+	struct iio_mutex *lock;
+	char **paths;
+	struct iio_device **devices;
+	unsigned int nb, next;
+	int err;
+};
+
+static int add_device_path(void *d, const char *path)
+{
+	struct local_scan *scan = d;
+	char **paths, *name;
+
+	name = iio_strdup(path);
+	if (!name)
+		return -ENOMEM;
+
+	paths = realloc(scan->paths, (scan->nb + 1) * sizeof(*paths));
+	if (!paths) {
+		free(name);
+		return -ENOMEM;
+	}
+
+	paths[scan->nb++] = name;
+	scan->paths = paths;
+	return 0;
+}
+
+static int local_scan_thread(void *d)
+{
+	struct local_scan *scan = d;
+	unsigned int idx;
+	int ret;
+
+	for (;;) {
+		iio_mutex_lock(scan->lock);
+		idx = scan->next++;
+		ret = scan->err;
+		iio_mutex_unlock(scan->lock);
+
+		if (ret || idx >= scan->nb)
+			return ret;
+
+		ret = local_create_device(scan->ctx, scan->paths[idx],
+					  &scan->devices[idx]);
+		if (ret < 0) {
+			iio_mutex_lock(scan->lock);
+			if (!scan->err)
+				scan->err = ret;
+			iio_mutex_unlock(scan->lock);
+		}
 	}
+}
 
-	ret = detect_and_move_global_attrs(dev);
+/*
+ * Create the devices in parallel: each one requires reading many sysfs files,
+ * which can take a long time for some drivers. The calling thread takes part
+ * in the work, so that it also works if no thread can be created.
+ */
+static int local_create_devices(struct iio_context *ctx)
+{
+	struct iio_thrd *thrds[LOCAL_NB_SCAN_THREADS];
+	struct local_scan scan = { .ctx = ctx, };
+	unsigned int i, nb_thrds = 0;
+	int ret;
+
+	ret = foreach_in_dir(&scan, "/sys/bus/iio/devices", true, add_device_path);
 	if (ret < 0)
-		goto err_free_device;
+		goto out_free_paths;
 
-	/* sorting is done after global attrs are added */
-	for (i = 0; i < dev->nb_channels; i++) {
-		struct iio_channel *chn = dev->channels[i];
-		qsort(chn->attrs,  chn->nb_attrs, sizeof(struct iio_channel_attr),
-			iio_channel_attr_compare);
+	scan.devices = calloc(scan.nb, sizeof(*scan.devices));
+	scan.lock = iio_mutex_create();
+	if ((scan.nb && !scan.devices) || !scan.lock) {
+		ret = -ENOMEM;
+		goto out_free_devices;
 	}
-	qsort(dev->attrs.names, dev->attrs.num, sizeof(char *),
-		iio_device_attr_compare);
 
-	dev->words = (dev->nb_channels + 31) / 32;
-	if (dev->words) {
-		mask = calloc(dev->words, sizeof(*mask));
-		if (!mask) {
-			ret = -ENOMEM;
-			goto err_free_device;
-		}
+	while (nb_thrds < LOCAL_NB_SCAN_THREADS && nb_thrds + 1 < scan.nb) {
+		thrds[nb_thrds] = iio_thrd_create(local_scan_thread, &scan);
+		if (!thrds[nb_thrds])
+			break;
+
+		nb_thrds++;
 	}
 
-	dev->mask = mask;
+	ret = local_scan_thread(&scan);
+
+	for (i = 0; i < nb_thrds; i++)
+		iio_thrd_join_and_destroy(thrds[i]);
 
-	ret = iio_context_add_device(ctx, dev);
 	if (!ret)
-		return 0;
+		ret = scan.err;
 
-err_free_scan_elements:
-	for (i = 0; i < dev->nb_channels; i++)
-		free_protected_attrs(dev->channels[i]);
-err_free_device:
-	local_free_pdata(dev);
-	free_device(dev);
+	for (i = 0; i < scan.nb; i++) {
+		if (!ret && scan.devices[i]) {
+			ret = iio_context_add_device(ctx, scan.devices[i]);
+			if (!ret)
+				continue;
+		}
+
+		if (scan.devices[i])
+			local_free_device(scan.devices[i]);
+	}
+
+out_free_devices:
+	if (scan.lock)
+		iio_mutex_destroy(scan.lock);
+	free(scan.devices);
+out_free_paths:
+	for (i = 0; i < scan.nb; i++)
+		free(scan.paths[i]);
+	free(scan.paths);
 	return ret;
 }
 
@@ -1857,15 +3961,53 @@ static int add_debug_attr(void *d, const char *path)
 	return add_iio_dev_attr(&dev->debug_attrs, attr, " debug", dev->id);
 }
 
-static int add_debug(void *d, const char *path)
+static int local_load_debug_attrs(const struct iio_device *dev)
 {
-	struct iio_context *ctx = d;
-	const char *name = strrchr(path, '/') + 1;
-	struct iio_device *dev = iio_context_find_device(ctx, name);
-	if (!dev)
-		return -ENODEV;
-	else
-		return foreach_in_dir(dev, path, false, add_debug_attr);
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct stat st;
+	char buf[1024];
+	int ret = 0;
+
+	iio_mutex_lock(pdata->attr_lock);
+
+	if (!pdata->debug_attrs_loaded) {
+		pdata->debug_attrs_loaded = true;
+
+		iio_snprintf(buf, sizeof(buf), "/sys/kernel/debug/iio/%s",
+			     dev->id);
+
+		if (!stat(buf, &st) && S_ISDIR(st.st_mode))
+			ret = foreach_in_dir((void *) dev, buf, false,
+					     add_debug_attr);
+		if (!ret)
+			ret = iio_dev_attrs_build_index((struct iio_dev_attrs *)
+							&dev->debug_attrs);
+	}
+
+	iio_mutex_unlock(pdata->attr_lock);
+
+	return ret;
+}
+
+static const char * local_get_xml(const struct iio_context *ctx)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	struct iio_context *context = (struct iio_context *) ctx;
+	char *xml;
+
+	iio_mutex_lock(pdata->xml_lock);
+
+	if (!ctx->xml) {
+		xml = iio_context_create_xml(ctx);
+		if (IS_ERR(xml))
+			errno = -PTR_ERR(xml);
+		else
+			context->xml = xml;
+	}
+
+	iio_mutex_unlock(pdata->xml_lock);
+
+	return ctx->xml;
 }
 
 static int local_set_timeout(struct iio_context *ctx, unsigned int timeout)
@@ -1920,12 +4062,27 @@ static const struct iio_backend_ops local_ops = {
 	.clone = local_clone,
 	.open = local_open,
 	.close = local_close,
+	.reconfigure = local_reconfigure,
 	.get_fd = local_get_fd,
 	.set_blocking_mode = local_set_blocking_mode,
+	.set_busy_poll = local_set_busy_poll,
 	.read = local_read,
 	.write = local_write,
 	.set_kernel_buffers_count = local_set_kernel_buffers_count,
+	.set_kernel_buffers_auto = local_set_kernel_buffers_auto,
+	.get_kernel_buffers_stats = local_get_kernel_buffers_stats,
+	.set_low_latency = local_set_low_latency,
+	.get_latency_stats = local_get_latency_stats,
 	.get_buffer = local_get_buffer,
+	.try_read = local_try_read,
+	.try_write = local_try_write,
+	.try_get_buffer = local_try_get_buffer,
+	.get_timestamp = local_get_timestamp,
+	.dequeue_block = local_dequeue_block,
+	.enqueue_block = local_enqueue_block,
+	.get_dmabuf_fd = local_get_dmabuf_fd,
+	.set_dmabuf = local_set_dmabuf,
+	.set_cyclic_double_buffer = local_set_cyclic_double_buffer,
 	.read_device_attr = local_read_dev_attr,
 	.write_device_attr = local_write_dev_attr,
 	.read_channel_attr = local_read_chn_attr,
@@ -1933,6 +4090,10 @@ static const struct iio_backend_ops local_ops = {
 	.get_trigger = local_get_trigger,
 	.set_trigger = local_set_trigger,
 	.shutdown = local_shutdown,
+	.close_attr_fds = local_close_ctx_attr_fds,
+	.get_xml = local_get_xml,
+	.set_io_uring = local_set_io_uring,
+	.load_debug_attrs = local_load_debug_attrs,
 	.get_description = local_get_description,
 	.set_timeout = local_set_timeout,
 	.cancel = local_cancel,
@@ -1946,14 +4107,14 @@ static const struct iio_backend local_backend = {
 	.sizeof_context_pdata = sizeof(struct iio_context_pdata),
 };
 
-static void init_data_scale(struct iio_channel *chn)
+static void init_data_offset(struct iio_channel *chn)
 {
 	char *end, buf[1024];
 	ssize_t ret;
 	float value;
 
-	chn->format.with_scale = false;
-	ret = iio_channel_attr_read(chn, "scale", buf, sizeof(buf));
+	chn->format.offset = 0.0;
+	ret = iio_channel_attr_read(chn, "offset", buf, sizeof(buf));
 	if (ret < 0)
 		return;
 
@@ -1962,20 +4123,27 @@ static void init_data_scale(struct iio_channel *chn)
 	if (end == buf || errno == ERANGE)
 		return;
 
-	chn->format.with_scale = true;
-	chn->format.scale = value;
+	chn->format.offset = value;
 }
 
-static void init_scan_elements(struct iio_context *ctx)
+static void init_data_scale(struct iio_channel *chn)
 {
-	unsigned int i, j;
+	char *end, buf[1024];
+	ssize_t ret;
+	float value;
 
-	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
-		struct iio_device *dev = iio_context_get_device(ctx, i);
+	chn->format.with_scale = false;
+	ret = iio_channel_attr_read(chn, "scale", buf, sizeof(buf));
+	if (ret < 0)
+		return;
 
-		for (j = 0; j < dev->nb_channels; j++)
-			init_data_scale(dev->channels[j]);
-	}
+	errno = 0;
+	value = strtof(buf, &end);
+	if (end == buf || errno == ERANGE)
+		return;
+
+	chn->format.with_scale = true;
+	chn->format.scale = value;
 }
 
 static int populate_context_attrs(struct iio_context *ctx, const char *file)
@@ -2032,13 +4200,338 @@ out_close_ini:
 	return ret;
 }
 
+static int local_init_context_pdata(struct iio_context *ctx)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	local_set_timeout(ctx, DEFAULT_TIMEOUT_MS);
+
+	pdata->xml_lock = iio_mutex_create();
+	if (!pdata->xml_lock)
+		return -ENOMEM;
+
+#if WITH_LOCAL_IO_URING
+	pdata->uring_lock = iio_mutex_create();
+	if (!pdata->uring_lock)
+		return -ENOMEM;
+#endif
+
+	return 0;
+}
+
+#define LOCAL_CACHE_MAGIC "libiio-local-cache 1\n"
+#define LOCAL_CACHE_SEPARATOR "%%\n"
+
+/*
+ * Describes what the cached context depends on: the library, the kernel, the
+ * sysfs nodes of the devices, debugfs and the INI file. sysfs nodes are
+ * re-created, and get a new modification time, when a driver is re-probed.
+ */
+static char * local_cache_fingerprint(void)
+{
+	const char *dirs[] = { "/sys/kernel/debug/iio", "/etc/libiio.ini", };
+	char buf[PATH_MAX], target[PATH_MAX];
+	struct dirent *entry;
+	struct utsname uts;
+	struct stat st;
+	char *str = NULL;
+	size_t len;
+	unsigned int i;
+	ssize_t ret;
+	FILE *f;
+	DIR *dir;
+
+	dir = opendir("/sys/bus/iio/devices");
+	if (!dir)
+		return NULL;
+
+	f = open_memstream(&str, &len);
+	if (!f) {
+		closedir(dir);
+		return NULL;
+	}
+
+	uname(&uts);
+	fprintf(f, "version %u.%u %s\nkernel %s %s\n", LIBIIO_VERSION_MAJOR,
+		LIBIIO_VERSION_MINOR, LIBIIO_VERSION_GIT, uts.release,
+		uts.version);
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		iio_snprintf(buf, sizeof(buf), "/sys/bus/iio/devices/%s",
+			     entry->d_name);
+
+		ret = readlink(buf, target, sizeof(target) - 1);
+		target[ret < 0 ? 0 : ret] = '\0';
+
+		if (stat(buf, &st) < 0)
+			memset(&st, 0, sizeof(st));
+
+		fprintf(f, "dev %s %s %lld.%09ld\n", entry->d_name, target,
+			(long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(dirs); i++) {
+		if (stat(dirs[i], &st) < 0)
+			memset(&st, 0, sizeof(st));
+
+		fprintf(f, "file %s %lld.%09ld\n", dirs[i],
+			(long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+	}
+
+	closedir(dir);
+
+	if (fclose(f)) {
+		free(str);
+		return NULL;
+	}
+
+	return str;
+}
+
+/*
+ * The XML is completed with what it does not describe, or not precisely
+ * enough: the "en" files of the channels, and their exact scale and offset.
+ */
+static void local_save_context_cache(const struct iio_context *ctx,
+		const char *path, const char *fingerprint)
+{
+	char tmp[PATH_MAX];
+	const char *xml;
+	unsigned int i, j;
+	FILE *f;
+	int fd;
+
+	xml = iio_context_get_xml(ctx);
+	if (!xml)
+		return;
+
+	iio_snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto err_warn;
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		goto err_unlink;
+	}
+
+	fputs(LOCAL_CACHE_MAGIC, f);
+	fputs(fingerprint, f);
+	fputs(LOCAL_CACHE_SEPARATOR, f);
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		const struct iio_device *dev = ctx->devices[i];
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			const struct iio_channel *chn = dev->channels[j];
+
+			fprintf(f, "chn %u %u %s %d %.17g %.17g\n", i, j,
+				chn->pdata->enable_fn ? chn->pdata->enable_fn : "-",
+				chn->format.with_scale, chn->format.scale,
+				chn->format.offset);
+		}
+	}
+
+	fputs(LOCAL_CACHE_SEPARATOR, f);
+	fputs(xml, f);
+
+	if (fclose(f) || rename(tmp, path))
+		goto err_unlink;
+
+	return;
+
+err_unlink:
+	unlink(tmp);
+err_warn:
+	IIO_WARNING("Unable to write context cache %s\n", path);
+}
+
+static int local_cache_parse_channels(struct iio_context *ctx, char *ptr)
+{
+	char *line, *saveptr = NULL, fn[PATH_MAX];
+	unsigned int dev_idx, chn_idx;
+	struct iio_channel *chn;
+	int with_scale;
+	double scale, offset;
+
+	for (line = strtok_r(ptr, "\n", &saveptr); line;
+			line = strtok_r(NULL, "\n", &saveptr)) {
+		if (sscanf(line, "chn %u %u %4095s %d %lf %lf", &dev_idx,
+			   &chn_idx, fn, &with_scale, &scale, &offset) != 6)
+			return -EINVAL;
+
+		if (dev_idx >= ctx->nb_devices
+		    || chn_idx >= ctx->devices[dev_idx]->nb_channels)
+			return -EINVAL;
+
+		chn = ctx->devices[dev_idx]->channels[chn_idx];
+		chn->format.with_scale = with_scale;
+		chn->format.scale = scale;
+		chn->format.offset = offset;
+
+		/* The conversion parameters were set from the rounded values
+		 * of the XML when the context was created */
+		iio_channel_init_convert(chn);
+
+		if (strcmp(fn, "-")) {
+			chn->pdata->enable_fn = iio_strdup(fn);
+			if (!chn->pdata->enable_fn)
+				return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/* Turns a context created from the cached XML into a local context */
+static int local_cache_convert(struct iio_context *ctx, char *channels)
+{
+	struct iio_channel *chn;
+	unsigned int i, j;
+	int ret;
+
+	ctx->pdata = zalloc(sizeof(*ctx->pdata));
+	if (!ctx->pdata)
+		return -ENOMEM;
+
+	ret = local_init_context_pdata(ctx);
+	if (ret < 0)
+		goto err_free_pdata;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		struct iio_device *dev = ctx->devices[i];
+
+		ret = local_init_device_pdata(dev);
+		if (ret < 0)
+			goto err_free_pdata;
+
+		/* The XML already lists the debug attributes */
+		dev->pdata->debug_attrs_loaded = true;
+
+		for (j = 0; j < dev->nb_channels; j++) {
+			chn = dev->channels[j];
+
+			chn->pdata = zalloc(sizeof(*chn->pdata));
+			if (!chn->pdata) {
+				ret = -ENOMEM;
+				goto err_free_pdata;
+			}
+		}
+	}
+
+	ret = local_cache_parse_channels(ctx, channels);
+	if (ret < 0)
+		goto err_free_pdata;
+
+	ctx->ops = &local_ops;
+	ctx->name = local_backend.name;
+
+	/* The XML will be generated again, with the name of the backend */
+	free(ctx->xml);
+	ctx->xml = NULL;
+
+	return 0;
+
+err_free_pdata:
+	for (i = 0; i < ctx->nb_devices; i++) {
+		struct iio_device *dev = ctx->devices[i];
+
+		local_free_pdata(dev);
+		dev->pdata = NULL;
+
+		for (j = 0; j < dev->nb_channels; j++)
+			dev->channels[j]->pdata = NULL;
+	}
+
+	local_free_context_pdata(ctx->pdata);
+	return ret;
+}
+
+static struct iio_context * local_load_context_cache(const char *path,
+		const char *fingerprint)
+{
+	struct iio_context *ctx = NULL;
+	char *data, *channels, *xml;
+	size_t len = strlen(LOCAL_CACHE_MAGIC);
+	struct stat st;
+	FILE *f;
+	int ret;
+
+	f = fopen(path, "re");
+	if (!f)
+		return NULL;
+
+	if (fstat(fileno(f), &st) < 0)
+		goto out_close;
+
+	data = malloc(st.st_size + 1);
+	if (!data)
+		goto out_close;
+
+	if (fread(data, 1, st.st_size, f) != (size_t) st.st_size)
+		goto out_free_data;
+
+	data[st.st_size] = '\0';
+
+	if (strncmp(data, LOCAL_CACHE_MAGIC, len)
+	    || strncmp(data + len, fingerprint, strlen(fingerprint))
+	    || strncmp(data + len + strlen(fingerprint), LOCAL_CACHE_SEPARATOR,
+		       strlen(LOCAL_CACHE_SEPARATOR))) {
+		IIO_DEBUG("Context cache %s is outdated\n", path);
+		goto out_free_data;
+	}
+
+	channels = data + len + strlen(fingerprint) + strlen(LOCAL_CACHE_SEPARATOR);
+	xml = strstr(channels, LOCAL_CACHE_SEPARATOR);
+	if (!xml)
+		goto out_free_data;
+
+	*xml = '\0';
+	xml += strlen(LOCAL_CACHE_SEPARATOR);
+
+	ctx = iio_create_xml_context_mem(xml, strlen(xml));
+	if (!ctx)
+		goto out_free_data;
+
+	ret = local_cache_convert(ctx, channels);
+	if (ret < 0) {
+		IIO_WARNING("Invalid context cache %s\n", path);
+		iio_context_destroy(ctx);
+		ctx = NULL;
+	}
+
+out_free_data:
+	free(data);
+out_close:
+	fclose(f);
+	return ctx;
+}
+
 struct iio_context * local_create_context(void)
 {
 	struct iio_context *ctx;
-	char *description;
+	char *description, *fingerprint = NULL;
+	const char *cache;
 	int ret = -ENOMEM;
 	struct utsname uts;
 
+	/* Optional cache of the context, to skip scanning sysfs */
+	cache = getenv("LIBIIO_LOCAL_CACHE");
+	if (cache && *cache)
+		fingerprint = local_cache_fingerprint();
+	if (fingerprint) {
+		ctx = local_load_context_cache(cache, fingerprint);
+		if (ctx) {
+			free(fingerprint);
+			return ctx;
+		}
+	}
+
 	description = local_get_description(NULL);
 
 	ctx = iio_context_create_from_backend(&local_backend, description);
@@ -2046,19 +4539,17 @@ struct iio_context * local_create_context(void)
 	if (!ctx)
 		goto err_set_errno;
 
-	local_set_timeout(ctx, DEFAULT_TIMEOUT_MS);
+	ret = local_init_context_pdata(ctx);
+	if (ret < 0)
+		goto err_context_destroy;
 
-	ret = foreach_in_dir(ctx, "/sys/bus/iio/devices", true, create_device);
+	ret = local_create_devices(ctx);
 	if (ret < 0)
 		goto err_context_destroy;
 
 	qsort(ctx->devices, ctx->nb_devices, sizeof(struct iio_device *),
 		iio_device_compare);
 
-	foreach_in_dir(ctx, "/sys/kernel/debug/iio", true, add_debug);
-
-	init_scan_elements(ctx);
-
 	if (WITH_LOCAL_CONFIG) {
 		ret = populate_context_attrs(ctx, "/etc/libiio.ini");
 		if (ret < 0)
@@ -2078,11 +4569,17 @@ struct iio_context * local_create_context(void)
 	if (ret < 0)
 		goto err_context_destroy;
 
+	if (fingerprint) {
+		local_save_context_cache(ctx, cache, fingerprint);
+		free(fingerprint);
+	}
+
 	return ctx;
 
 err_context_destroy:
 	iio_context_destroy(ctx);
 err_set_errno:
+	free(fingerprint);
 	errno = -ret;
 	return NULL;
 }
@@ -7,13 +7,17 @@
  */
 
 #include "iio-config.h"
+#include "iio-lock.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #elif !defined(NO_THREADS)
 #include <pthread.h>
+#include <time.h>
 #endif
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 struct iio_mutex {
@@ -78,3 +82,212 @@ void iio_mutex_unlock(struct iio_mutex *lock)
 #endif
 #endif
 }
+
+struct iio_cond {
+#ifdef NO_THREADS
+	int foo;
+#else
+#ifdef _WIN32
+	CONDITION_VARIABLE cond;
+#else
+	pthread_cond_t cond;
+#endif
+#endif
+};
+
+struct iio_cond * iio_cond_create(void)
+{
+	struct iio_cond *cond = malloc(sizeof(*cond));
+
+	if (!cond)
+		return NULL;
+
+#ifndef NO_THREADS
+#ifdef _WIN32
+	InitializeConditionVariable(&cond->cond);
+#else
+	pthread_cond_init(&cond->cond, NULL);
+#endif
+#endif
+	return cond;
+}
+
+void iio_cond_destroy(struct iio_cond *cond)
+{
+#if !defined(NO_THREADS) && !defined(_WIN32)
+	pthread_cond_destroy(&cond->cond);
+#endif
+	free(cond);
+}
+
+int iio_cond_wait(struct iio_cond *cond, struct iio_mutex *lock,
+		unsigned int timeout_ms)
+{
+#ifdef NO_THREADS
+	return -ETIMEDOUT;
+#else
+#ifdef _WIN32
+	if (!SleepConditionVariableCS(&cond->cond, &lock->lock,
+				      timeout_ms ? timeout_ms : INFINITE))
+		return -ETIMEDOUT;
+	return 0;
+#else
+	struct timespec ts;
+	int ret;
+
+	if (!timeout_ms)
+		return -pthread_cond_wait(&cond->cond, &lock->lock);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	ret = pthread_cond_timedwait(&cond->cond, &lock->lock, &ts);
+	return -ret;
+#endif
+#endif
+}
+
+void iio_cond_signal(struct iio_cond *cond)
+{
+#ifndef NO_THREADS
+#ifdef _WIN32
+	WakeConditionVariable(&cond->cond);
+#else
+	pthread_cond_signal(&cond->cond);
+#endif
+#endif
+}
+
+void iio_cond_broadcast(struct iio_cond *cond)
+{
+#ifndef NO_THREADS
+#ifdef _WIN32
+	WakeAllConditionVariable(&cond->cond);
+#else
+	pthread_cond_broadcast(&cond->cond);
+#endif
+#endif
+}
+
+struct iio_thrd {
+#ifndef NO_THREADS
+#ifdef _WIN32
+	HANDLE thid;
+#else
+	pthread_t thid;
+#endif
+#endif
+	int (*func)(void *);
+	void *d;
+	int ret;
+	bool detached;
+};
+
+#ifndef NO_THREADS
+#ifdef _WIN32
+static DWORD __stdcall iio_thrd_wrapper(void *d)
+#else
+static void * iio_thrd_wrapper(void *d)
+#endif
+{
+	struct iio_thrd *thrd = d;
+
+	thrd->ret = thrd->func(thrd->d);
+
+	/* Nobody will join a detached thread */
+	if (thrd->detached)
+		free(thrd);
+
+	return 0;
+}
+#endif
+
+static struct iio_thrd * __iio_thrd_create(int (*thrd)(void *), void *d,
+					   bool detached)
+{
+#ifdef NO_THREADS
+	errno = ENOSYS;
+	return NULL;
+#else
+	struct iio_thrd *iio_thrd;
+#ifdef _WIN32
+	HANDLE thid;
+#else
+	pthread_attr_t attr;
+	pthread_t thid;
+#endif
+	int ret;
+
+	iio_thrd = malloc(sizeof(*iio_thrd));
+	if (!iio_thrd) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	iio_thrd->func = thrd;
+	iio_thrd->d = d;
+	iio_thrd->detached = detached;
+
+#ifdef _WIN32
+	thid = CreateThread(NULL, 0, iio_thrd_wrapper, iio_thrd, 0, NULL);
+	ret = thid ? 0 : ENOMEM;
+	if (!ret && detached)
+		CloseHandle(thid);
+#else
+	pthread_attr_init(&attr);
+	if (detached)
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	ret = pthread_create(&thid, &attr, iio_thrd_wrapper, iio_thrd);
+	pthread_attr_destroy(&attr);
+#endif
+	if (ret) {
+		free(iio_thrd);
+		errno = ret;
+		return NULL;
+	}
+
+	/* A detached thread may already have freed its structure */
+	if (!detached)
+		iio_thrd->thid = thid;
+
+	return iio_thrd;
+#endif
+}
+
+struct iio_thrd * iio_thrd_create(int (*thrd)(void *), void *d)
+{
+	return __iio_thrd_create(thrd, d, false);
+}
+
+int iio_thrd_create_detached(int (*thrd)(void *), void *d)
+{
+	if (!__iio_thrd_create(thrd, d, true))
+		return -errno;
+
+	return 0;
+}
+
+int iio_thrd_join_and_destroy(struct iio_thrd *thrd)
+{
+	int ret;
+
+#ifndef NO_THREADS
+#ifdef _WIN32
+	WaitForSingleObject(thrd->thid, INFINITE);
+	CloseHandle(thrd->thid);
+#else
+	pthread_join(thrd->thid, NULL);
+#endif
+#endif
+
+	ret = thrd->ret;
+	free(thrd);
+
+	return ret;
+}
@@ -151,6 +151,22 @@ int wait_cancellable(struct iiod_client_pdata *io_ctx, bool read)
 	return 0;
 }
 
+bool network_is_ready(int fd, bool read)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = read ? POLLIN : POLLOUT,
+	};
+	int ret;
+
+	do {
+		ret = poll(&pfd, 1, 0);
+	} while (ret == -1 && errno == EINTR);
+
+	/* On error, let the caller find out with its next I/O */
+	return ret != 0;
+}
+
 int network_get_error(void)
 {
 	return -errno;
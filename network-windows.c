@@ -83,6 +83,21 @@ int wait_cancellable(struct iiod_client_pdata *io_ctx, bool read)
 	return 0;
 }
 
+bool network_is_ready(int fd, bool read)
+{
+	struct timeval tv = { 0, 0 };
+	fd_set set;
+
+	FD_ZERO(&set);
+	FD_SET((SOCKET) fd, &set);
+
+	/* On error, let the caller find out with its next I/O */
+	if (read)
+		return select(0, &set, NULL, NULL, &tv) != 0;
+	else
+		return select(0, NULL, &set, NULL, &tv) != 0;
+}
+
 int network_get_error(void)
 {
 	return -WSAGetLastError();
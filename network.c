@@ -11,6 +11,7 @@
 #include "iio-config.h"
 #include "iio-private.h"
 #include "iio-lock.h"
+#include "iiod-binary.h"
 #include "iiod-client.h"
 #include "network.h"
 
@@ -59,21 +60,62 @@
 
 #define DEFAULT_TIMEOUT_MS 5000
 
+/* Control connections opened on top of the one of the context */
+#define NETWORK_MAX_CTRL 4
+
 struct iio_context_pdata {
 	struct iiod_client_pdata io_ctx;
 	struct addrinfo *addrinfo;
 	struct iiod_client *iiod_client;
-	bool msg_trunc_supported;
+
+	/* Set once the connection is multiplexed */
+	struct network_mux *mux;
+
+	/* Control connections opened while the main one was busy, so that
+	 * threads can access attributes concurrently, see network_get_ctrl().
+	 * 'main_users' counts the threads using the main connection. */
+	struct iio_mutex *ctrl_lock;
+	struct iiod_client_pdata *ctrl[NETWORK_MAX_CTRL];
+	bool ctrl_busy[NETWORK_MAX_CTRL], ctrl_failed;
+	unsigned int main_users;
 };
 
 struct iio_device_pdata {
 	struct iiod_client_pdata io_ctx;
 #ifdef WITH_NETWORK_GET_BUFFER
-	int memfd;
-	void *mmap_addr;
+	/* Output buffers alternate between two memory files, see
+	 * network_get_buffer() */
+	int memfd[2];
+	void *mmap_addr[2];
 	size_t mmap_len;
+	unsigned int mmap_cur;
+	bool mmap_in_use;
+	int pipefd[2];
 #endif
 	bool wait_for_err_code, is_cyclic, is_tx;
+
+	/* Number of READBUF requests kept in flight, see network_read() */
+	unsigned int read_ahead;
+
+	/* Progress of the asynchronous transfers, see network_try_read() and
+	 * network_try_write(). 'rx_left' counts the bytes of the pending
+	 * READBUF request not received yet, 'tx_left' the bytes of the
+	 * WRITEBUF request being sent, and 'tx_nb_resp' the WRITEBUF requests
+	 * whose response was not received yet. */
+	uint8_t async_hdr[IIOD_BIN_HDR_SIZE], async_word[4];
+	size_t async_hdr_len, async_word_len;
+	size_t rx_left, rx_data_left, rx_mask_left, rx_mask_idx;
+	uint16_t rx_id;
+	uint8_t tx_resp[IIOD_BIN_HDR_SIZE];
+	size_t tx_left, tx_resp_len;
+	unsigned int tx_nb_resp;
+
+	/* Reception from a multicast group, see network_subscribe() */
+	struct iiod_client_pdata mcast;
+	uint32_t mcast_seq, mcast_block;
+	bool mcast_synced, mcast_has_block;
+	uint64_t mcast_lost;
+
 	struct iio_mutex *lock;
 };
 
@@ -138,6 +180,55 @@ static ssize_t network_send(struct iiod_client_pdata *io_ctx,
 	return ret;
 }
 
+/* Take the data received ahead, up to 'len' bytes */
+static size_t network_take_buffered(struct iiod_client_pdata *io_ctx,
+		void *dst, size_t len)
+{
+	if (len > io_ctx->rx_len)
+		len = io_ctx->rx_len;
+
+	memcpy(dst, io_ctx->rx_buf + io_ctx->rx_off, len);
+	io_ctx->rx_off += len;
+	io_ctx->rx_len -= len;
+
+	return len;
+}
+
+static ssize_t network_fill_buffer(struct iiod_client_pdata *io_ctx)
+{
+	ssize_t ret;
+
+	ret = network_recv(io_ctx, io_ctx->rx_buf, sizeof(io_ctx->rx_buf), 0);
+	if (ret < 0)
+		return ret;
+
+	io_ctx->rx_off = 0;
+	io_ctx->rx_len = (size_t) ret;
+	return ret;
+}
+
+/*
+ * Reads go through a buffer, so that a response and its payload usually
+ * come with one system call, whatever the number of reads the client code
+ * does to parse them. Large reads bypass the buffer once it is empty.
+ */
+static ssize_t network_recv_buffered(struct iiod_client_pdata *io_ctx,
+		void *dst, size_t len)
+{
+	ssize_t ret;
+
+	if (!io_ctx->rx_len) {
+		if (len >= sizeof(io_ctx->rx_buf))
+			return network_recv(io_ctx, dst, len, 0);
+
+		ret = network_fill_buffer(io_ctx);
+		if (ret < 0)
+			return ret;
+	}
+
+	return (ssize_t) network_take_buffered(io_ctx, dst, len);
+}
+
 static ssize_t write_all(struct iiod_client_pdata *io_ctx,
 		const void *src, size_t len)
 {
@@ -152,25 +243,492 @@ static ssize_t write_all(struct iiod_client_pdata *io_ctx,
 	return (ssize_t)(ptr - (uintptr_t) src);
 }
 
-static ssize_t write_command(struct iiod_client_pdata *io_ctx,
-		const char *cmd)
+static ssize_t read_all(struct iiod_client_pdata *io_ctx,
+		void *dst, size_t len)
+{
+	uintptr_t ptr = (uintptr_t) dst;
+	while (len) {
+		ssize_t ret = network_recv_buffered(io_ctx, (void *) ptr, len);
+		if (ret < 0) {
+			IIO_ERROR("NETWORK RECV: %zu\n", ret);
+			return ret;
+		}
+		ptr += ret;
+		len -= ret;
+	}
+	return (ssize_t)(ptr - (uintptr_t) dst);
+}
+
+/*
+ * Multiplexed connection, see iio_context_enable_multiplexing(). The socket
+ * of the context carries the byte streams of the context (channel 0) and of
+ * the devices opened afterwards, in frames. There is no demux thread: the
+ * thread that needs data reads the next frame, and queues the payload of a
+ * frame meant for another channel.
+ */
+struct network_mux_chan {
+	struct iiod_client_pdata *io_ctx;
+
+	/* Data received while another thread was reading */
+	char *buf;
+	size_t off, len, size;
+
+	/* 'eof' is set once IIOD ended the channel, 'closing' once we did.
+	 * The channel number is free again when both are set. */
+	bool used, eof, closing;
+};
+
+struct network_mux {
+	struct iiod_client_pdata raw;
+
+	/* Serializes the frames sent */
+	struct iio_mutex *wlock;
+
+	/* Protects the fields below */
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+
+	bool reading;
+	int err;
+
+	/* Number of contexts using the connection, see network_clone() */
+	unsigned int refs;
+
+	/* Channel and remaining length of the frame being received, only
+	 * accessed by the thread reading */
+	uint16_t cur_chan;
+	size_t cur_left;
+
+	struct network_mux_chan chans[IIOD_MUX_MAX_CHANNELS];
+};
+
+/* Frames are limited in size, so that a large write does not hold the
+ * connection for too long */
+#define NETWORK_MUX_MAX_FRAME 0x10000
+
+/* Data queued for a channel, past which the socket is not read anymore until
+ * the channel's owner catches up, see network_mux_recv() */
+#define NETWORK_MUX_MAX_QUEUE (4 * NETWORK_MUX_MAX_FRAME)
+
+static void network_mux_chan_release(struct network_mux_chan *chan)
+{
+	free(chan->buf);
+	memset(chan, 0, sizeof(*chan));
+}
+
+static ssize_t network_mux_send(struct network_mux *mux, uint16_t chan,
+		uint16_t flags, const void *src, size_t len)
 {
+	struct iiod_mux_hdr hdr = {
+		.chan = chan,
+		.flags = flags,
+		.len = (uint32_t) len,
+	};
+	uint8_t buf[IIOD_MUX_HDR_SIZE];
 	ssize_t ret;
 
-	IIO_DEBUG("Writing command: %s\n", cmd);
-	ret = write_all(io_ctx, cmd, strlen(cmd));
-	if (ret < 0) {
-		char buf[1024];
-		iio_strerror(-(int) ret, buf, sizeof(buf));
-		IIO_ERROR("Unable to send command: %s\n", buf);
+	iiod_mux_pack(buf, &hdr);
+
+	iio_mutex_lock(mux->wlock);
+	ret = write_all(&mux->raw, buf, sizeof(buf));
+	if (ret >= 0 && len)
+		ret = write_all(&mux->raw, src, len);
+	iio_mutex_unlock(mux->wlock);
+
+	return ret < 0 ? ret : (ssize_t) len;
+}
+
+static ssize_t network_mux_write(struct iiod_client_pdata *io_ctx,
+		const char *src, size_t len)
+{
+	struct network_mux *mux = io_ctx->mux;
+	size_t nb, done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		nb = len - done;
+		if (nb > NETWORK_MUX_MAX_FRAME)
+			nb = NETWORK_MUX_MAX_FRAME;
+
+		ret = network_mux_send(mux, io_ctx->chan, 0, src + done, nb);
+		if (ret < 0)
+			return ret;
+
+		done += nb;
+	}
+
+	return (ssize_t) done;
+}
+
+/* Handle the IIOD_MUX_CLOSE frame of a channel. Called with the lock held. */
+static void network_mux_chan_eof(struct network_mux *mux, uint16_t id)
+{
+	struct network_mux_chan *chan = &mux->chans[id];
+
+	if (chan->closing)
+		network_mux_chan_release(chan);
+	else if (chan->used)
+		chan->eof = true;
+}
+
+static ssize_t network_mux_discard(struct network_mux *mux, size_t len)
+{
+	char buf[1024];
+	ssize_t ret;
+
+	while (len) {
+		ret = read_all(&mux->raw, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (ret < 0)
+			return ret;
+
+		len -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Receive the next frame, or the rest of the current one. Returns the number
+ * of bytes received into 'dst' if the frame is for channel 'id', 0 if it was
+ * for another channel, -EAGAIN if that channel's queue is full, or another
+ * negative error code. Only one thread at a time can call this function, see
+ * network_mux_read().
+ */
+static ssize_t network_mux_recv(struct network_mux *mux, uint16_t id,
+		char *dst, size_t len)
+{
+	struct network_mux_chan *chan;
+	uint8_t buf[IIOD_MUX_HDR_SIZE];
+	struct iiod_mux_hdr hdr;
+	char *ptr = NULL;
+	size_t nb;
+	ssize_t ret;
+
+	if (!mux->cur_left) {
+		/* Between two frames, a timeout does not break the stream */
+		ret = mux->raw.rx_len ? 0 : wait_cancellable(&mux->raw, true);
+		if (ret == -EPIPE)
+			return -ETIMEDOUT;
+		if (ret < 0)
+			return ret;
+
+		ret = read_all(&mux->raw, buf, sizeof(buf));
+		if (ret < 0)
+			return ret;
+
+		iiod_mux_unpack(&hdr, buf);
+
+		if (hdr.chan >= IIOD_MUX_MAX_CHANNELS) {
+			IIO_ERROR("Frame received for invalid channel %u\n",
+				  hdr.chan);
+			return -EIO;
+		}
+
+		if (hdr.flags & IIOD_MUX_CLOSE) {
+			iio_mutex_lock(mux->lock);
+			network_mux_chan_eof(mux, hdr.chan);
+			iio_mutex_unlock(mux->lock);
+			return 0;
+		}
+
+		mux->cur_chan = hdr.chan;
+		mux->cur_left = hdr.len;
+		if (!hdr.len)
+			return 0;
+	}
+
+	if (mux->cur_chan == id) {
+		if (len > mux->cur_left)
+			len = mux->cur_left;
+
+		ret = network_recv_buffered(&mux->raw, dst, len);
+		if (ret > 0)
+			mux->cur_left -= (size_t) ret;
+		return ret;
+	}
+
+	iio_mutex_lock(mux->lock);
+	chan = &mux->chans[mux->cur_chan];
+	nb = mux->cur_left;
+
+	/* The owner of the queue only advances 'off' and reduces 'len'
+	 * meanwhile, so the data can be received without the lock */
+	if (chan->io_ctx && !chan->eof) {
+		if (chan->len >= NETWORK_MUX_MAX_QUEUE) {
+			iio_mutex_unlock(mux->lock);
+			return -EAGAIN;
+		}
+
+		/* Queue what fits; the rest of the frame stays on the wire */
+		if (nb > NETWORK_MUX_MAX_QUEUE - chan->len)
+			nb = NETWORK_MUX_MAX_QUEUE - chan->len;
+
+		if (chan->off) {
+			memmove(chan->buf, chan->buf + chan->off, chan->len);
+			chan->off = 0;
+		}
+
+		if (chan->size < chan->len + nb) {
+			ptr = realloc(chan->buf, chan->len + nb);
+			if (ptr) {
+				chan->buf = ptr;
+				chan->size = chan->len + nb;
+			}
+		}
+
+		if (chan->size >= chan->len + nb)
+			ptr = chan->buf + chan->len;
+		else
+			IIO_ERROR("Unable to queue data for channel %u\n",
+				  mux->cur_chan);
+	}
+	iio_mutex_unlock(mux->lock);
+
+	if (ptr) {
+		ret = read_all(&mux->raw, ptr, nb);
+	} else {
+		nb = mux->cur_left;
+		ret = network_mux_discard(mux, nb);
+	}
+	if (ret < 0)
+		return ret;
+
+	if (ptr) {
+		iio_mutex_lock(mux->lock);
+
+		/* Unless the channel was closed meanwhile */
+		if (chan->io_ctx)
+			chan->len += nb;
+		iio_mutex_unlock(mux->lock);
+	}
+
+	mux->cur_left -= nb;
+	return 0;
+}
+
+static ssize_t network_mux_read(struct iiod_client_pdata *io_ctx,
+		char *dst, size_t len)
+{
+	struct network_mux *mux = io_ctx->mux;
+	struct network_mux_chan *chan = &mux->chans[io_ctx->chan];
+	ssize_t ret;
+
+	iio_mutex_lock(mux->lock);
+
+	while (true) {
+		if (chan->len) {
+			/* The thread reading may wait for room in our queue */
+			if (chan->len >= NETWORK_MUX_MAX_QUEUE)
+				iio_cond_broadcast(mux->cond);
+
+			if (len > chan->len)
+				len = chan->len;
+
+			memcpy(dst, chan->buf + chan->off, len);
+			chan->off += len;
+			chan->len -= len;
+			ret = (ssize_t) len;
+			break;
+		}
+
+		if (mux->err) {
+			ret = mux->err;
+			break;
+		}
+
+		if (io_ctx->cancelled) {
+			ret = -EBADF;
+			break;
+		}
+
+		if (chan->eof) {
+			ret = -EPIPE;
+			break;
+		}
+
+		if (mux->reading) {
+			/* Wait for the thread reading to queue our data, or
+			 * to let us read */
+			ret = iio_cond_wait(mux->cond, mux->lock,
+					    io_ctx->timeout_ms);
+			if (ret < 0)
+				break;
+			continue;
+		}
+
+		mux->reading = true;
+		iio_mutex_unlock(mux->lock);
+
+		ret = network_mux_recv(mux, io_ctx->chan, dst, len);
+
+		iio_mutex_lock(mux->lock);
+		mux->reading = false;
+
+		if (ret == -EAGAIN) {
+			/* Stop reading until the owner of the full queue takes
+			 * some data. The other threads are not woken up, as
+			 * they would only find the same queue full. */
+			ret = iio_cond_wait(mux->cond, mux->lock,
+					    io_ctx->timeout_ms);
+			if (ret < 0)
+				break;
+			continue;
+		}
+
+		if (ret < 0 && ret != -ETIMEDOUT)
+			mux->err = (int) ret;
+		iio_cond_broadcast(mux->cond);
+
+		if (ret)
+			break;
+	}
+
+	iio_mutex_unlock(mux->lock);
+	return ret;
+}
+
+static ssize_t network_mux_read_line(struct iiod_client_pdata *io_ctx,
+		char *dst, size_t len)
+{
+	ssize_t ret;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i++) {
+		ret = network_mux_read(io_ctx, dst + i, 1);
+		if (ret < 0)
+			return ret;
+
+		if (dst[i] == '\n')
+			return (ssize_t) i + 1;
+	}
+
+	return -EIO;
+}
+
+static int network_mux_chan_open(struct network_mux *mux,
+		struct iiod_client_pdata *io_ctx)
+{
+	struct network_mux_chan *chan;
+	int ret = -EBUSY;
+	uint16_t i;
+
+	iio_mutex_lock(mux->lock);
+
+	/* Channel 0 is the one of the context */
+	for (i = 1; i < IIOD_MUX_MAX_CHANNELS; i++) {
+		chan = &mux->chans[i];
+
+		if (!chan->used) {
+			chan->used = true;
+			chan->io_ctx = io_ctx;
+			io_ctx->mux = mux;
+			io_ctx->chan = i;
+			ret = 0;
+			break;
+		}
 	}
+
+	iio_mutex_unlock(mux->lock);
 	return ret;
 }
 
+static void network_mux_chan_close(struct iiod_client_pdata *io_ctx)
+{
+	struct network_mux *mux = io_ctx->mux;
+	struct network_mux_chan *chan = &mux->chans[io_ctx->chan];
+
+	/* IIOD ends the session, and answers with its own close */
+	network_mux_send(mux, io_ctx->chan, IIOD_MUX_CLOSE, NULL, 0);
+
+	iio_mutex_lock(mux->lock);
+	if (chan->eof || mux->err) {
+		network_mux_chan_release(chan);
+	} else {
+		chan->closing = true;
+		chan->io_ctx = NULL;
+		chan->len = 0;
+	}
+
+	/* The thread reading may wait for room in the queue */
+	iio_cond_broadcast(mux->cond);
+	iio_mutex_unlock(mux->lock);
+
+	io_ctx->mux = NULL;
+}
+
+static void network_mux_cancel(struct iiod_client_pdata *io_ctx)
+{
+	struct network_mux *mux = io_ctx->mux;
+
+	iio_mutex_lock(mux->lock);
+	io_ctx->cancelled = true;
+	iio_cond_broadcast(mux->cond);
+	iio_mutex_unlock(mux->lock);
+}
+
+static struct network_mux * network_mux_new(int fd, unsigned int timeout_ms)
+{
+	struct network_mux *mux;
+
+	mux = zalloc(sizeof(*mux));
+	if (!mux)
+		return NULL;
+
+	mux->wlock = iio_mutex_create();
+	if (!mux->wlock)
+		goto err_free_mux;
+
+	mux->lock = iio_mutex_create();
+	if (!mux->lock)
+		goto err_destroy_wlock;
+
+	mux->cond = iio_cond_create();
+	if (!mux->cond)
+		goto err_destroy_lock;
+
+	mux->raw.fd = fd;
+	mux->raw.timeout_ms = timeout_ms;
+	mux->refs = 1;
+
+	return mux;
+
+err_destroy_lock:
+	iio_mutex_destroy(mux->lock);
+err_destroy_wlock:
+	iio_mutex_destroy(mux->wlock);
+err_free_mux:
+	free(mux);
+	return NULL;
+}
+
+static void network_mux_destroy(struct network_mux *mux)
+{
+	unsigned int i;
+
+	for (i = 0; i < IIOD_MUX_MAX_CHANNELS; i++)
+		free(mux->chans[i].buf);
+
+	if (mux->raw.cancellable)
+		cleanup_cancel(&mux->raw);
+
+	iio_cond_destroy(mux->cond);
+	iio_mutex_destroy(mux->lock);
+	iio_mutex_destroy(mux->wlock);
+	free(mux);
+}
+
 static void network_cancel(const struct iio_device *dev)
 {
 	struct iio_device_pdata *ppdata = dev->pdata;
 
+	if (ppdata->mcast.fd >= 0)
+		do_cancel(&ppdata->mcast);
+
+	if (ppdata->io_ctx.mux) {
+		network_mux_cancel(&ppdata->io_ctx);
+		return;
+	}
+
 	do_cancel(&ppdata->io_ctx);
 
 	ppdata->io_ctx.cancelled = true;
@@ -299,189 +857,1012 @@ static char * __network_get_description(struct addrinfo *res)
 		return NULL;
 	}
 
-	description[0] = '\0';
+	description[0] = '\0';
+
+#ifdef HAVE_IPV6
+	if (res->ai_family == AF_INET6) {
+		struct sockaddr_in6 *in = (struct sockaddr_in6 *) res->ai_addr;
+		char *ptr;
+		inet_ntop(AF_INET6, &in->sin6_addr,
+				description, INET6_ADDRSTRLEN);
+
+		if (IN6_IS_ADDR_LINKLOCAL(&in->sin6_addr)) {
+			ptr = if_indextoname(in->sin6_scope_id, description +
+					strlen(description) + 1);
+			if (!ptr) {
+				IIO_ERROR("Unable to lookup interface of IPv6 address\n");
+				free(description);
+				return NULL;
+			}
+
+			*(ptr - 1) = '%';
+		}
+	}
+#endif
+	if (res->ai_family == AF_INET) {
+		struct sockaddr_in *in = (struct sockaddr_in *) res->ai_addr;
+#if (!_WIN32 || _WIN32_WINNT >= 0x600)
+		inet_ntop(AF_INET, &in->sin_addr, description, INET_ADDRSTRLEN);
+#else
+		char *tmp = inet_ntoa(in->sin_addr);
+		iio_strlcpy(description, tmp, len);
+#endif
+	}
+
+	return description;
+}
+
+static char *network_get_description(const struct iio_context *ctx)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return __network_get_description(pdata->addrinfo);
+}
+
+#ifdef WITH_NETWORK_GET_BUFFER
+static void network_close_pipe(struct iio_device_pdata *pdata)
+{
+	if (pdata->pipefd[0] >= 0) {
+		close(pdata->pipefd[0]);
+		close(pdata->pipefd[1]);
+	}
+
+	pdata->pipefd[0] = -1;
+	pdata->pipefd[1] = -1;
+}
+
+static int network_create_memfd(void)
+{
+#ifdef HAS_MEMFD_CREATE
+	return memfd_create("libiio", MFD_CLOEXEC);
+#else
+	/* O_TMPFILE -> Linux 3.11 */
+	return open(P_tmpdir, O_RDWR | O_TMPFILE | O_EXCL | O_CLOEXEC, S_IRWXU);
+#endif
+}
+
+static void network_free_mmap(struct iio_device_pdata *pdata)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(pdata->memfd); i++) {
+		if (pdata->mmap_addr[i])
+			munmap(pdata->mmap_addr[i], pdata->mmap_len);
+		pdata->mmap_addr[i] = NULL;
+
+		if (pdata->memfd[i] >= 0)
+			close(pdata->memfd[i]);
+		pdata->memfd[i] = -1;
+	}
+
+	network_close_pipe(pdata);
+}
+
+/* Create the memory files and their mappings once, when the device is
+ * opened, so that a refill or push doesn't have to. */
+static int network_setup_mmap(struct iio_device_pdata *pdata)
+{
+	unsigned int i, nb = pdata->is_tx ? 2 : 1;
+	int ret;
+
+	pdata->mmap_cur = 0;
+	pdata->mmap_in_use = false;
+
+	for (i = 0; i < nb; i++) {
+		pdata->memfd[i] = network_create_memfd();
+		if (pdata->memfd[i] < 0) {
+			ret = -errno;
+			goto err_free_mmap;
+		}
+
+		ret = ftruncate(pdata->memfd[i], pdata->mmap_len);
+		if (ret < 0) {
+			ret = -errno;
+			IIO_ERROR("Unable to truncate temp file: %i\n", -ret);
+			goto err_free_mmap;
+		}
+
+		pdata->mmap_addr[i] = mmap(NULL, pdata->mmap_len,
+				PROT_READ | PROT_WRITE, MAP_SHARED,
+				pdata->memfd[i], 0);
+		if (pdata->mmap_addr[i] == MAP_FAILED) {
+			pdata->mmap_addr[i] = NULL;
+			ret = -errno;
+			IIO_ERROR("Unable to mmap: %i\n", -ret);
+			goto err_free_mmap;
+		}
+	}
+
+	ret = pipe2(pdata->pipefd, O_CLOEXEC);
+	if (ret < 0) {
+		ret = -errno;
+		goto err_free_mmap;
+	}
+
+	return 0;
+
+err_free_mmap:
+	network_free_mmap(pdata);
+	return ret;
+}
+#endif
+
+static int network_open(const struct iio_device *dev,
+		size_t samples_count, bool cyclic)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *ppdata = dev->pdata;
+	int ret = -EBUSY;
+
+	iio_mutex_lock(ppdata->lock);
+	if (ppdata->io_ctx.fd >= 0)
+		goto out_mutex_unlock;
+
+	if (pdata->mux) {
+		ret = network_mux_chan_open(pdata->mux, &ppdata->io_ctx);
+		if (ret < 0)
+			goto out_mutex_unlock;
+
+		ret = pdata->io_ctx.fd;
+	} else {
+		ret = create_socket(pdata->addrinfo);
+		if (ret < 0) {
+			IIO_ERROR("Create socket: %d\n", ret);
+			goto out_mutex_unlock;
+		}
+	}
+
+	ppdata->io_ctx.fd = ret;
+	ppdata->io_ctx.cancelled = false;
+	ppdata->io_ctx.cancellable = false;
+	ppdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+	ppdata->io_ctx.conn.binary = false;
+	ppdata->io_ctx.conn.compress = false;
+	ppdata->io_ctx.rx_len = 0;
+
+#ifdef WITH_NETWORK_GET_BUFFER
+	/* The zero-copy interface only speaks the text protocol, and needs a
+	 * socket of its own */
+	if (cyclic || ppdata->io_ctx.mux)
+#endif
+		iiod_client_enable_binary(pdata->iiod_client, &ppdata->io_ctx);
+
+	ret = iiod_client_open_unlocked(pdata->iiod_client,
+			&ppdata->io_ctx, dev, samples_count, cyclic);
+	if (ret < 0) {
+		IIO_ERROR("Open unlocked: %d\n", ret);
+		goto err_close_socket;
+	}
+
+	if (!ppdata->io_ctx.mux) {
+		ret = setup_cancel(&ppdata->io_ctx);
+		if (ret < 0)
+			goto err_close_socket;
+
+		set_socket_timeout(ppdata->io_ctx.fd, pdata->io_ctx.timeout_ms);
+		ppdata->io_ctx.cancellable = true;
+	}
+
+	ppdata->io_ctx.timeout_ms = pdata->io_ctx.timeout_ms;
+	ppdata->is_tx = iio_device_is_tx(dev);
+	ppdata->is_cyclic = cyclic;
+	ppdata->wait_for_err_code = false;
+	ppdata->read_ahead = 0;
+	ppdata->async_hdr_len = 0;
+	ppdata->async_word_len = 0;
+	ppdata->rx_left = 0;
+	ppdata->rx_data_left = 0;
+	ppdata->rx_mask_left = 0;
+	ppdata->tx_left = 0;
+	ppdata->tx_resp_len = 0;
+	ppdata->tx_nb_resp = 0;
+#ifdef WITH_NETWORK_GET_BUFFER
+	ppdata->mmap_len = samples_count * iio_device_get_sample_size(dev);
+
+	/* Cyclic buffers don't support the zero-copy interface */
+	if (!cyclic && !ppdata->io_ctx.mux && network_setup_mmap(ppdata) < 0)
+		IIO_DEBUG("Zero-copy interface not available\n");
+#endif
+
+	iio_mutex_unlock(ppdata->lock);
+
+	return 0;
+
+err_close_socket:
+	if (ppdata->io_ctx.mux)
+		network_mux_chan_close(&ppdata->io_ctx);
+	else
+		close(ppdata->io_ctx.fd);
+	ppdata->io_ctx.fd = -1;
+out_mutex_unlock:
+	iio_mutex_unlock(ppdata->lock);
+	return ret;
+}
+
+/* Whether the response to a READBUF or WRITEBUF request sent ahead is still
+ * on its way */
+static bool network_has_pending_read(const struct iio_device_pdata *pdata)
+{
+	return pdata->io_ctx.conn.nb_pending ||
+		pdata->tx_left || pdata->tx_nb_resp;
+}
+
+static int network_close(const struct iio_device *dev)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = -EBADF;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd >= 0) {
+		if (network_has_pending_read(pdata)) {
+			/* The data of the READBUF requests sent ahead would
+			 * have to be received before the response to CLOSE;
+			 * IIOD closes the device when the socket is closed. */
+			pdata->io_ctx.conn.nb_pending = 0;
+			ret = 0;
+		} else if (!pdata->io_ctx.cancelled) {
+			ret = iiod_client_close_unlocked(
+					ctx_pdata->iiod_client,
+					&pdata->io_ctx, dev);
+
+			iiod_client_exit_unlocked(ctx_pdata->iiod_client,
+						  &pdata->io_ctx);
+		} else {
+			ret = 0;
+		}
+
+		if (pdata->io_ctx.mux) {
+			network_mux_chan_close(&pdata->io_ctx);
+		} else {
+			cleanup_cancel(&pdata->io_ctx);
+			close(pdata->io_ctx.fd);
+		}
+		pdata->io_ctx.fd = -1;
+	}
+
+	if (pdata->mcast.fd >= 0) {
+		cleanup_cancel(&pdata->mcast);
+		close(pdata->mcast.fd);
+		pdata->mcast.fd = -1;
+	}
+
+#ifdef WITH_NETWORK_GET_BUFFER
+	network_free_mmap(pdata);
+#endif
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+/*
+ * Receive the next complete block published to the multicast group. A block
+ * is dropped as soon as one of its datagrams is found missing.
+ */
+static ssize_t network_mcast_read(struct iio_device_pdata *pdata,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	uint8_t dgram[IIOD_MCAST_MAX_DGRAM];
+	struct iiod_mcast_hdr hdr;
+	size_t i, nb, mask_len, filled = 0;
+	uint32_t block = 0;
+	bool gap, in_block = false;
+	ssize_t ret;
+
+	while (true) {
+		ret = network_recv(&pdata->mcast, dgram, sizeof(dgram), 0);
+		if (ret < 0)
+			return ret;
+
+		if ((size_t) ret < IIOD_MCAST_HDR_SIZE)
+			continue;
+
+		iiod_mcast_unpack(&hdr, dgram);
+		mask_len = hdr.nb_words * 4;
+
+		if (hdr.magic != IIOD_MCAST_MAGIC ||
+		    (size_t) ret < IIOD_MCAST_HDR_SIZE + mask_len)
+			continue;
+
+		nb = (size_t) ret - IIOD_MCAST_HDR_SIZE - mask_len;
+
+		gap = pdata->mcast_synced && hdr.seq != pdata->mcast_seq;
+		pdata->mcast_seq = hdr.seq + 1;
+		pdata->mcast_synced = true;
+
+		if (!hdr.offset) {
+			in_block = true;
+			block = hdr.block;
+			filled = 0;
+		} else if (gap || !in_block || hdr.block != block ||
+			   hdr.offset != filled) {
+			in_block = false;
+			continue;
+		}
+
+		if (filled < len) {
+			memcpy((char *) dst + filled,
+			       &dgram[IIOD_MCAST_HDR_SIZE + mask_len],
+			       nb < len - filled ? nb : len - filled);
+		}
+
+		filled += nb;
+		if (filled < hdr.block_len)
+			continue;
+
+		/* The blocks missing since the last one received are lost */
+		if (pdata->mcast_has_block)
+			pdata->mcast_lost += block - pdata->mcast_block;
+		pdata->mcast_block = block + 1;
+		pdata->mcast_has_block = true;
+
+		for (i = 0; mask && i < words; i++) {
+			mask[i] = i < hdr.nb_words ? iiod_bin_get_le32(
+					&dgram[IIOD_MCAST_HDR_SIZE + i * 4]) : 0;
+		}
+
+		return (ssize_t) (filled < len ? filled : len);
+	}
+}
+
+static ssize_t network_read(const struct iio_device *dev, void *dst, size_t len,
+		uint32_t *mask, size_t words)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t ret;
+
+	iio_mutex_lock(pdata->lock);
+	if (pdata->rx_left)
+		ret = -EBUSY;
+	else if (pdata->mcast.fd >= 0)
+		ret = network_mcast_read(pdata, dst, len, mask, words);
+	else if (pdata->read_ahead || pdata->io_ctx.conn.nb_pending)
+		ret = iiod_client_read_ahead_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, dst, len, mask, words,
+				pdata->read_ahead);
+	else
+		ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, dst, len, mask, words);
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
+/*
+ * The asynchronous interface needs a socket of its own, as the readiness of
+ * a multiplexed one says nothing about the channel of the device, and the
+ * binary protocol, whose responses can be parsed as they arrive.
+ */
+static int network_get_fd(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (pdata->io_ctx.mux || pdata->mcast.fd >= 0)
+		return -ENOSYS;
+	if (pdata->io_ctx.fd < 0)
+		return -EBADF;
+
+	return pdata->io_ctx.fd;
+}
+
+static int network_check_async(const struct iio_device_pdata *pdata)
+{
+	if (pdata->io_ctx.fd < 0)
+		return -EBADF;
+	if (pdata->io_ctx.mux || pdata->mcast.fd >= 0 ||
+	    !pdata->io_ctx.conn.binary)
+		return -ENOSYS;
+
+	return 0;
+}
+
+/* Receive what is available, up to 'len' bytes, or return -EAGAIN */
+static ssize_t network_try_recv(struct iiod_client_pdata *io_ctx,
+		void *dst, size_t len)
+{
+	if (!io_ctx->rx_len && !network_is_ready(io_ctx->fd, true))
+		return -EAGAIN;
+
+	/* The socket is readable, so this does one recv() that returns
+	 * right away */
+	return network_recv_buffered(io_ctx, dst, len);
+}
+
+/* Send what fits in the socket, up to 'len' bytes, or return -EAGAIN */
+static ssize_t network_try_send(struct iiod_client_pdata *io_ctx,
+		const void *src, size_t len)
+{
+	ssize_t ret;
+	int err;
+
+	ret = set_blocking_mode(io_ctx->fd, false);
+	if (ret < 0)
+		return ret;
+
+	ret = send(io_ctx->fd, src, (int) len, 0);
+	err = network_get_error();
+	set_blocking_mode(io_ctx->fd, true);
+
+	if (ret > 0)
+		return ret;
+	if (!ret)
+		return -EPIPE;
+	if (network_should_retry(err) || network_is_interrupted(err))
+		return -EAGAIN;
+
+	return (ssize_t) err;
+}
+
+static int network_request_read_unlocked(const struct iio_device *dev,
+		size_t len)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iiod_client_conn *conn = &pdata->io_ctx.conn;
+	int ret;
+
+	/* The responses to the requests sent ahead come first */
+	if (pdata->rx_left || conn->nb_pending)
+		return -EBUSY;
+
+	ret = iiod_client_read_req_unlocked(ctx_pdata->iiod_client,
+			&pdata->io_ctx, dev, len);
+	if (ret < 0)
+		return ret;
+
+	pdata->rx_id = (uint16_t) (conn->next_id - 1);
+	pdata->rx_left = len;
+	pdata->rx_data_left = 0;
+	pdata->rx_mask_left = 0;
+	pdata->async_hdr_len = 0;
+	return 0;
+}
+
+static int network_request_read(const struct iio_device *dev, size_t len)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+	ret = network_check_async(pdata);
+	if (!ret)
+		ret = network_request_read_unlocked(dev, len);
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
+/*
+ * Parse the header of the next response to the pending READBUF request.
+ * Returns 1 once the samples of a response are expected, 0 if the request
+ * must be sent again for the remaining samples, or a negative error code.
+ */
+static int network_parse_read_resp(const struct iio_device *dev,
+		size_t words)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iiod_bin_hdr resp;
+	size_t payload_len;
+
+	iiod_bin_unpack(&resp, pdata->async_hdr);
+	pdata->async_hdr_len = 0;
+
+	if (resp.id != pdata->rx_id || resp.op != IIOD_OP_READBUF) {
+		IIO_ERROR("Unexpected response to request %u\n", pdata->rx_id);
+		return -EIO;
+	}
+
+	if (resp.code <= 0) {
+		/* Error, or end of a partial transfer */
+		if (resp.len)
+			return -EIO;
+
+		pdata->io_ctx.conn.nb_pending--;
+		pdata->rx_left = 0;
+		return resp.code;
+	}
+
+	if (resp.type & IIOD_BIN_OVERRUN)
+		IIO_WARNING("IIOD dropped samples of device %u\n", resp.dev);
+
+	payload_len = resp.len;
+	if (resp.type & IIOD_BIN_HAS_MASK) {
+		if (payload_len < words * 4)
+			return -EIO;
+
+		payload_len -= words * 4;
+		pdata->rx_mask_left = words * 4;
+		pdata->rx_mask_idx = 0;
+	}
+
+	if ((resp.type & IIOD_BIN_ZSTD) || payload_len != (size_t) resp.code ||
+	    payload_len > pdata->rx_left)
+		return -EIO;
+
+	pdata->rx_data_left = payload_len;
+	return 1;
+}
+
+/*
+ * Receive the samples of the pending READBUF request that are available,
+ * without waiting. Each response is parsed as far as its bytes arrived,
+ * and the parsing resumes there on the next call.
+ */
+static ssize_t network_try_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct iiod_client_pdata *io_ctx = &pdata->io_ctx;
+	ssize_t ret = 0;
+	size_t nb, done = 0;
+
+	iio_mutex_lock(pdata->lock);
+
+	ret = network_check_async(pdata);
+	if (!ret && !pdata->rx_left)
+		ret = network_request_read_unlocked(dev, len);
+	if (ret < 0)
+		goto out_unlock;
+
+	while (done < len) {
+		if (!pdata->rx_data_left && !pdata->rx_mask_left) {
+			if (!pdata->rx_left) {
+				ret = network_request_read_unlocked(dev,
+						len - done);
+				if (ret < 0)
+					break;
+			}
+
+			ret = network_try_recv(io_ctx,
+					pdata->async_hdr + pdata->async_hdr_len,
+					IIOD_BIN_HDR_SIZE - pdata->async_hdr_len);
+			if (ret < 0)
+				break;
+
+			pdata->async_hdr_len += (size_t) ret;
+			if (pdata->async_hdr_len < IIOD_BIN_HDR_SIZE)
+				continue;
+
+			ret = network_parse_read_resp(dev, words);
+			if (ret < 0)
+				break;
+			continue;
+		}
+
+		if (pdata->rx_mask_left) {
+			ret = network_try_recv(io_ctx,
+					pdata->async_word + pdata->async_word_len,
+					4 - pdata->async_word_len);
+			if (ret < 0)
+				break;
+
+			pdata->async_word_len += (size_t) ret;
+			if (pdata->async_word_len < 4)
+				continue;
+
+			if (mask && pdata->rx_mask_idx < words) {
+				mask[pdata->rx_mask_idx] =
+					iiod_bin_get_le32(pdata->async_word);
+			}
+
+			pdata->async_word_len = 0;
+			pdata->rx_mask_idx++;
+			pdata->rx_mask_left -= 4;
+			continue;
+		}
+
+		nb = len - done;
+		if (nb > pdata->rx_data_left)
+			nb = pdata->rx_data_left;
+
+		ret = network_try_recv(io_ctx, (char *) dst + done, nb);
+		if (ret < 0)
+			break;
+
+		done += (size_t) ret;
+		pdata->rx_data_left -= (size_t) ret;
+		pdata->rx_left -= (size_t) ret;
+
+		if (!pdata->rx_left)
+			io_ctx->conn.nb_pending--;
+	}
+
+	if (ret < 0 && ret != -EAGAIN && !pdata->rx_left) {
+		/* Error code sent by IIOD; the request is over */
+	} else if (ret < 0 && ret != -EAGAIN) {
+		/* The stream cannot be parsed anymore */
+		pdata->rx_left = 0;
+		io_ctx->conn.nb_pending = 0;
+	} else if (done) {
+		ret = (ssize_t) done;
+	}
+out_unlock:
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_set_read_ahead(const struct iio_device *dev,
+		unsigned int nb_requests)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx)
+		ret = -EINVAL;
+	else if (!pdata->io_ctx.conn.binary)
+		ret = -ENOSYS;
+	else if (pdata->rx_left)
+		ret = -EBUSY;
+	else if (!nb_requests)
+		ret = iiod_client_drain_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev->words);
+
+	if (!ret)
+		pdata->read_ahead = nb_requests;
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_set_compression(const struct iio_device *dev,
+		bool enable)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = 0;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx)
+		ret = -EINVAL;
+	else if (!WITH_ZSTD || !pdata->io_ctx.conn.binary)
+		ret = -ENOSYS;
+	else
+		pdata->io_ctx.conn.compress = enable;
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_publish(const struct iio_device *dev,
+		const char *addr, unsigned int ttl)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx || pdata->read_ahead || pdata->mcast.fd >= 0)
+		ret = -EINVAL;
+	else
+		ret = iiod_client_publish_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, addr, ttl);
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_set_decimation(const struct iio_device *dev,
+		unsigned int factor)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx || pdata->read_ahead || pdata->mcast.fd >= 0)
+		ret = -EINVAL;
+	else
+		ret = iiod_client_set_decimation_unlocked(
+				ctx_pdata->iiod_client, &pdata->io_ctx,
+				dev, factor);
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+static int network_set_capture_window(const struct iio_device *dev,
+		const struct iio_channel *chn, enum iio_window_edge edge,
+		long long level, unsigned int pre, unsigned int post)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	if (pdata->io_ctx.fd < 0)
+		ret = -EBADF;
+	else if (pdata->is_tx || pdata->read_ahead || pdata->mcast.fd >= 0)
+		ret = -EINVAL;
+	else
+		ret = iiod_client_set_capture_window_unlocked(
+				ctx_pdata->iiod_client, &pdata->io_ctx,
+				dev, chn, edge, level, pre, post);
+
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+
+/* Parse "group:port", as given to iio_buffer_subscribe() */
+static int network_parse_mcast_addr(const char *addr,
+		struct sockaddr_in *sin)
+{
+	char buf[INET_ADDRSTRLEN], *end;
+	const char *port;
+	unsigned long nb;
+
+	port = strrchr(addr, ':');
+	if (!port || (size_t) (port - addr) >= sizeof(buf))
+		return -EINVAL;
 
-#ifdef HAVE_IPV6
-	if (res->ai_family == AF_INET6) {
-		struct sockaddr_in6 *in = (struct sockaddr_in6 *) res->ai_addr;
-		char *ptr;
-		inet_ntop(AF_INET6, &in->sin6_addr,
-				description, INET6_ADDRSTRLEN);
+	memcpy(buf, addr, port - addr);
+	buf[port - addr] = '\0';
 
-		if (IN6_IS_ADDR_LINKLOCAL(&in->sin6_addr)) {
-			ptr = if_indextoname(in->sin6_scope_id, description +
-					strlen(description) + 1);
-			if (!ptr) {
-				IIO_ERROR("Unable to lookup interface of IPv6 address\n");
-				free(description);
-				return NULL;
-			}
+	nb = strtoul(port + 1, &end, 10);
+	if (*end || !nb || nb > 0xffff)
+		return -EINVAL;
 
-			*(ptr - 1) = '%';
-		}
-	}
-#endif
-	if (res->ai_family == AF_INET) {
-		struct sockaddr_in *in = (struct sockaddr_in *) res->ai_addr;
-#if (!_WIN32 || _WIN32_WINNT >= 0x600)
-		inet_ntop(AF_INET, &in->sin_addr, description, INET_ADDRSTRLEN);
-#else
-		char *tmp = inet_ntoa(in->sin_addr);
-		iio_strlcpy(description, tmp, len);
-#endif
-	}
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons((uint16_t) nb);
 
-	return description;
+	if (inet_pton(AF_INET, buf, &sin->sin_addr) != 1 ||
+	    !IN_MULTICAST(ntohl(sin->sin_addr.s_addr)))
+		return -EINVAL;
+
+	return 0;
 }
 
-static char *network_get_description(const struct iio_context *ctx)
+/* Large enough to hold a few blocks arriving back-to-back */
+#define NETWORK_MCAST_RCVBUF 0x400000
+
+static int network_subscribe(const struct iio_device *dev, const char *addr)
 {
-	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	struct sockaddr_in sin;
+	struct ip_mreq mreq;
+	int fd, ret, val = 1;
 
-	return __network_get_description(pdata->addrinfo);
-}
+	ret = network_parse_mcast_addr(addr, &sin);
+	if (ret < 0)
+		return ret;
 
-static int network_open(const struct iio_device *dev,
-		size_t samples_count, bool cyclic)
-{
-	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
-	struct iio_device_pdata *ppdata = dev->pdata;
-	int ret = -EBUSY;
+	fd = (int) socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return network_get_error();
 
-	iio_mutex_lock(ppdata->lock);
-	if (ppdata->io_ctx.fd >= 0)
-		goto out_mutex_unlock;
+	ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+			 (const char *) &val, sizeof(val));
+	if (ret < 0)
+		goto err_close_socket;
 
-	ret = create_socket(pdata->addrinfo);
-	if (ret < 0) {
-		IIO_ERROR("Create socket: %d\n", ret);
-		goto out_mutex_unlock;
-	}
+	val = NETWORK_MCAST_RCVBUF;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+		       (const char *) &val, sizeof(val)) < 0)
+		IIO_DEBUG("Unable to enlarge the multicast receive buffer\n");
 
-	ppdata->io_ctx.fd = ret;
-	ppdata->io_ctx.cancelled = false;
-	ppdata->io_ctx.cancellable = false;
-	ppdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+	mreq.imr_multiaddr = sin.sin_addr;
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
 
-	ret = iiod_client_open_unlocked(pdata->iiod_client,
-			&ppdata->io_ctx, dev, samples_count, cyclic);
-	if (ret < 0) {
-		IIO_ERROR("Open unlocked: %d\n", ret);
+	ret = bind(fd, (const struct sockaddr *) &sin, sizeof(sin));
+	if (ret < 0)
 		goto err_close_socket;
-	}
 
-	ret = setup_cancel(&ppdata->io_ctx);
+	ret = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+			 (const char *) &mreq, sizeof(mreq));
 	if (ret < 0)
 		goto err_close_socket;
 
-	set_socket_timeout(ppdata->io_ctx.fd, pdata->io_ctx.timeout_ms);
+	iio_mutex_lock(pdata->lock);
 
-	ppdata->io_ctx.timeout_ms = pdata->io_ctx.timeout_ms;
-	ppdata->io_ctx.cancellable = true;
-	ppdata->is_tx = iio_device_is_tx(dev);
-	ppdata->is_cyclic = cyclic;
-	ppdata->wait_for_err_code = false;
-#ifdef WITH_NETWORK_GET_BUFFER
-	ppdata->mmap_len = samples_count * iio_device_get_sample_size(dev);
-#endif
+	if (pdata->io_ctx.fd < 0) {
+		ret = -EBADF;
+		goto err_unlock;
+	}
+	if (pdata->is_tx || pdata->mcast.fd >= 0) {
+		ret = -EINVAL;
+		goto err_unlock;
+	}
 
-	iio_mutex_unlock(ppdata->lock);
+	pdata->mcast.fd = fd;
+	ret = setup_cancel(&pdata->mcast);
+	if (ret < 0) {
+		pdata->mcast.fd = -1;
+		goto err_unlock;
+	}
+
+	pdata->mcast.cancellable = true;
+	pdata->mcast.timeout_ms = pdata->io_ctx.timeout_ms;
+	pdata->mcast_synced = false;
+	pdata->mcast_has_block = false;
+	pdata->mcast_lost = 0;
 
+	iio_mutex_unlock(pdata->lock);
 	return 0;
 
+err_unlock:
+	iio_mutex_unlock(pdata->lock);
+	close(fd);
+	return ret;
 err_close_socket:
-	close(ppdata->io_ctx.fd);
-	ppdata->io_ctx.fd = -1;
-out_mutex_unlock:
-	iio_mutex_unlock(ppdata->lock);
+	ret = network_get_error();
+	close(fd);
 	return ret;
 }
 
-static int network_close(const struct iio_device *dev)
+static int network_get_multicast_losses(const struct iio_device *dev,
+		uint64_t *nb_lost)
 {
-	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	int ret = -EBADF;
+	int ret = 0;
 
 	iio_mutex_lock(pdata->lock);
 
-	if (pdata->io_ctx.fd >= 0) {
-		if (!pdata->io_ctx.cancelled) {
-			ret = iiod_client_close_unlocked(
-					ctx_pdata->iiod_client,
-					&pdata->io_ctx, dev);
+	if (pdata->mcast.fd < 0)
+		ret = -EBADF;
+	else
+		*nb_lost = pdata->mcast_lost;
 
-			write_command(&pdata->io_ctx, "\r\nEXIT\r\n");
-		} else {
-			ret = 0;
-		}
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
 
-		cleanup_cancel(&pdata->io_ctx);
-		close(pdata->io_ctx.fd);
-		pdata->io_ctx.fd = -1;
-	}
+/* Receive the responses to the WRITEBUF requests sent by network_try_write().
+ * Returns the first error code reported by IIOD, if any, or -EAGAIN if some
+ * responses did not arrive yet and 'blocking' is false. */
+static int network_recv_write_resp(struct iio_device_pdata *pdata,
+		bool blocking)
+{
+	struct iiod_bin_hdr resp;
+	int err = 0;
+	ssize_t ret;
 
-#ifdef WITH_NETWORK_GET_BUFFER
-	if (pdata->memfd >= 0)
-		close(pdata->memfd);
-	pdata->memfd = -1;
+	while (pdata->tx_nb_resp) {
+		if (blocking)
+			ret = read_all(&pdata->io_ctx,
+				       pdata->tx_resp + pdata->tx_resp_len,
+				       IIOD_BIN_HDR_SIZE - pdata->tx_resp_len);
+		else
+			ret = network_try_recv(&pdata->io_ctx,
+				       pdata->tx_resp + pdata->tx_resp_len,
+				       IIOD_BIN_HDR_SIZE - pdata->tx_resp_len);
+		if (ret < 0)
+			return err ? err : (int) ret;
+
+		pdata->tx_resp_len += (size_t) ret;
+		if (pdata->tx_resp_len < IIOD_BIN_HDR_SIZE)
+			continue;
 
-	if (pdata->mmap_addr) {
-		munmap(pdata->mmap_addr, pdata->mmap_len);
-		pdata->mmap_addr = NULL;
+		pdata->tx_resp_len = 0;
+		pdata->tx_nb_resp--;
+
+		iiod_bin_unpack(&resp, pdata->tx_resp);
+		if (resp.op != IIOD_OP_WRITEBUF || resp.len)
+			return -EIO;
+		if (resp.code < 0 && !err)
+			err = resp.code;
 	}
-#endif
 
-	iio_mutex_unlock(pdata->lock);
-	return ret;
+	return err;
 }
 
-static ssize_t network_read(const struct iio_device *dev, void *dst, size_t len,
-		uint32_t *mask, size_t words)
+static ssize_t network_write(const struct iio_device *dev,
+		const void *src, size_t len)
 {
 	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
-	ssize_t ret;
+	ssize_t ret = 0;
 
 	iio_mutex_lock(pdata->lock);
-	ret = iiod_client_read_unlocked(ctx_pdata->iiod_client,
-			&pdata->io_ctx, dev, dst, len, mask, words);
+
+	if (pdata->tx_left)
+		ret = -EBUSY;
+	else if (pdata->tx_nb_resp)
+		ret = network_recv_write_resp(pdata, true);
+
+	if (!ret)
+		ret = iiod_client_write_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, src, len);
 	iio_mutex_unlock(pdata->lock);
 
 	return ret;
 }
 
-static ssize_t network_write(const struct iio_device *dev,
+/*
+ * Send the samples that fit in the socket, without waiting. The responses to
+ * the WRITEBUF requests are received as they arrive, by the next calls, so an
+ * error reported by IIOD is returned by a later push.
+ */
+static ssize_t network_try_write(const struct iio_device *dev,
 		const void *src, size_t len)
 {
-	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
 	struct iio_device_pdata *pdata = dev->pdata;
+	struct iiod_client_pdata *io_ctx = &pdata->io_ctx;
+	size_t done = 0;
 	ssize_t ret;
 
 	iio_mutex_lock(pdata->lock);
-	ret = iiod_client_write_unlocked(ctx_pdata->iiod_client,
-			&pdata->io_ctx, dev, src, len);
-	iio_mutex_unlock(pdata->lock);
 
+	ret = network_check_async(pdata);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = network_recv_write_resp(pdata, false);
+	if (ret < 0 && ret != -EAGAIN)
+		goto out_unlock;
+
+	if (!pdata->tx_left) {
+		iiod_client_pack_write_req(io_ctx, dev, len, pdata->async_hdr);
+		pdata->async_hdr_len = 0;
+		pdata->tx_left = len;
+	}
+
+	while (pdata->async_hdr_len < IIOD_BIN_HDR_SIZE) {
+		ret = network_try_send(io_ctx,
+				pdata->async_hdr + pdata->async_hdr_len,
+				IIOD_BIN_HDR_SIZE - pdata->async_hdr_len);
+		if (ret < 0)
+			goto out_unlock;
+
+		pdata->async_hdr_len += (size_t) ret;
+	}
+
+	if (len > pdata->tx_left)
+		len = pdata->tx_left;
+
+	while (done < len) {
+		ret = network_try_send(io_ctx, (const char *) src + done,
+				       len - done);
+		if (ret < 0)
+			break;
+
+		done += (size_t) ret;
+	}
+
+	pdata->tx_left -= done;
+	if (!pdata->tx_left) {
+		pdata->async_hdr_len = 0;
+		pdata->tx_nb_resp++;
+	}
+
+	if (done || ret >= 0)
+		ret = (ssize_t) done;
+out_unlock:
+	iio_mutex_unlock(pdata->lock);
 	return ret;
 }
 
 #ifdef WITH_NETWORK_GET_BUFFER
 
-static ssize_t read_all(struct iiod_client_pdata *io_ctx,
-		void *dst, size_t len)
+static ssize_t write_command(struct iiod_client_pdata *io_ctx,
+		const char *cmd)
 {
-	uintptr_t ptr = (uintptr_t) dst;
-	while (len) {
-		ssize_t ret = network_recv(io_ctx, (void *) ptr, len, 0);
-		if (ret < 0) {
-			IIO_ERROR("NETWORK RECV: %zu\n", ret);
-			return ret;
-		}
-		ptr += ret;
-		len -= ret;
+	ssize_t ret;
+
+	IIO_DEBUG("Writing command: %s\n", cmd);
+	ret = write_all(io_ctx, cmd, strlen(cmd));
+	if (ret < 0) {
+		char buf[1024];
+		iio_strerror(-(int) ret, buf, sizeof(buf));
+		IIO_ERROR("Unable to send command: %s\n", buf);
 	}
-	return (ssize_t)(ptr - (uintptr_t) dst);
+	return ret;
 }
 
 static int read_integer(struct iiod_client_pdata *io_ctx, long *val)
@@ -599,23 +1980,30 @@ static ssize_t write_rwbuf_command(const struct iio_device *dev,
 	return write_command(&pdata->io_ctx, cmd);
 }
 
-static ssize_t network_do_splice(struct iio_device_pdata *pdata, size_t len,
-		bool read)
+static ssize_t network_do_splice(struct iio_device_pdata *pdata, int memfd,
+		loff_t offset, size_t len, bool read)
 {
-	int pipefd[2];
+	loff_t *off_in = NULL, *off_out = NULL;
 	int fd_in, fd_out;
 	ssize_t ret, read_len = len, write_len = 0;
 
-	ret = (ssize_t) pipe2(pipefd, O_CLOEXEC);
-	if (ret < 0)
-		return -errno;
+	/* The pipe is kept across calls, and only re-created after an error,
+	 * as it might still hold data then */
+	if (pdata->pipefd[0] < 0) {
+		ret = (ssize_t) pipe2(pdata->pipefd, O_CLOEXEC);
+		if (ret < 0)
+			return -errno;
+	}
 
+	/* The memory file is reused, so its offset must be explicit */
 	if (read) {
 	    fd_in = pdata->io_ctx.fd;
-	    fd_out = pdata->memfd;
+	    fd_out = memfd;
+	    off_out = &offset;
 	} else {
-	    fd_in = pdata->memfd;
+	    fd_in = memfd;
 	    fd_out = pdata->io_ctx.fd;
+	    off_in = &offset;
 	}
 
 	do {
@@ -630,8 +2018,8 @@ static ssize_t network_do_splice(struct iio_device_pdata *pdata, size_t len,
 			 * non-blocking mode, it should never return -EAGAIN.
 			 * TODO(pcercuei): Find why it locks...
 			 * */
-			ret = splice(fd_in, NULL, pipefd[1], NULL, read_len,
-					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			ret = splice(fd_in, off_in, pdata->pipefd[1], NULL,
+					read_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
 			if (!ret)
 				ret = -EIO;
 			if (ret < 0 && errno != EAGAIN) {
@@ -644,8 +2032,8 @@ static ssize_t network_do_splice(struct iio_device_pdata *pdata, size_t len,
 		}
 
 		if (write_len) {
-			ret = splice(pipefd[0], NULL, fd_out, NULL, write_len,
-					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			ret = splice(pdata->pipefd[0], NULL, fd_out, off_out,
+					write_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
 			if (!ret)
 				ret = -EIO;
 			if (ret < 0 && errno != EAGAIN) {
@@ -658,10 +2046,11 @@ static ssize_t network_do_splice(struct iio_device_pdata *pdata, size_t len,
 
 	} while (write_len || read_len);
 
+	return (ssize_t) len;
+
 err_close_pipe:
-	close(pipefd[0]);
-	close(pipefd[1]);
-	return ret < 0 ? ret : (ssize_t)len;
+	network_close_pipe(pdata);
+	return ret;
 }
 
 static ssize_t network_get_buffer(const struct iio_device *dev,
@@ -670,30 +2059,15 @@ static ssize_t network_get_buffer(const struct iio_device *dev,
 {
 	struct iio_device_pdata *pdata = dev->pdata;
 	ssize_t ret, read = 0;
-	int memfd;
 
-	if (pdata->is_cyclic)
+	/* -ENOSYS indicates that the high-speed interface is not available */
+	if (pdata->is_cyclic || !pdata->mmap_addr[0])
 		return -ENOSYS;
 
-	/* We check early that the temporary file can be created, so that we can
-	 * return -ENOSYS in case it fails, which will indicate that the
-	 * high-speed interface is not available.
-	 *
-	 * O_TMPFILE -> Linux 3.11.
-	 * TODO: use memfd_create (Linux 3.17) */
-	memfd = open(P_tmpdir, O_RDWR | O_TMPFILE | O_EXCL | O_CLOEXEC, S_IRWXU);
-	if (memfd < 0)
-		return -ENOSYS;
-
-	if (!addr_ptr || words != (dev->nb_channels + 31) / 32) {
-		close(memfd);
+	if (!addr_ptr || words != (dev->nb_channels + 31) / 32)
 		return -EINVAL;
-	}
 
-	if (pdata->mmap_addr)
-		munmap(pdata->mmap_addr, pdata->mmap_len);
-
-	if (pdata->mmap_addr && pdata->is_tx) {
+	if (pdata->mmap_in_use && pdata->is_tx) {
 		char buf[1024];
 
 		iio_snprintf(buf, sizeof(buf), "WRITEBUF %s %lu\r\n",
@@ -703,31 +2077,38 @@ static ssize_t network_get_buffer(const struct iio_device *dev,
 
 		ret = write_rwbuf_command(dev, buf);
 		if (ret < 0)
-			goto err_close_memfd;
+			goto err_unlock;
 
-		ret = network_do_splice(pdata, bytes_used, false);
+		ret = network_do_splice(pdata, pdata->memfd[pdata->mmap_cur],
+				0, bytes_used, false);
 		if (ret < 0)
-			goto err_close_memfd;
+			goto err_unlock;
 
 		pdata->wait_for_err_code = true;
 		iio_mutex_unlock(pdata->lock);
-	}
 
-	if (pdata->memfd >= 0)
-		close(pdata->memfd);
-
-	pdata->memfd = memfd;
-
-	ret = (ssize_t) ftruncate(pdata->memfd, pdata->mmap_len);
-	if (ret < 0) {
-		ret = -errno;
-		IIO_ERROR("Unable to truncate temp file: %zi\n", -ret);
-		return ret;
+		/*
+		 * The spliced pages are referenced by the socket until they
+		 * are acknowledged, so the same file cannot be written to
+		 * right away. Switch to the other one: its data was sent by
+		 * the previous WRITEBUF, whose reply was read above, which
+		 * guarantees that it has been acknowledged.
+		 */
+		pdata->mmap_cur ^= 1;
 	}
 
-	if (!pdata->is_tx) {
+	if (!pdata->is_tx && pdata->mcast.fd >= 0) {
+		iio_mutex_lock(pdata->lock);
+		ret = network_mcast_read(pdata, pdata->mmap_addr[0],
+				pdata->mmap_len, mask, words);
+		if (ret < 0)
+			goto err_unlock;
+
+		read = ret;
+		iio_mutex_unlock(pdata->lock);
+	} else if (!pdata->is_tx) {
 		char buf[1024];
-		size_t len = pdata->mmap_len;
+		size_t nb, len = pdata->mmap_len;
 
 		iio_snprintf(buf, sizeof(buf), "READBUF %s %lu\r\n",
 				dev->id, (unsigned long) len);
@@ -744,73 +2125,289 @@ static ssize_t network_get_buffer(const struct iio_device *dev,
 			if (ret < 0)
 				goto err_unlock;
 
-			mask = NULL; /* We read the mask only once */
+			mask = NULL; /* We read the mask only once */
+
+			/* The first samples may have been received along with
+			 * the mask */
+			nb = network_take_buffered(&pdata->io_ctx,
+					(char *) pdata->mmap_addr[0] + read,
+					(size_t) ret);
+			if ((size_t) ret > nb) {
+				ret = network_do_splice(pdata, pdata->memfd[0],
+						(loff_t) (read + nb),
+						(size_t) ret - nb, true);
+				if (ret < 0)
+					goto err_unlock;
+
+				ret += nb;
+			}
+
+			read += ret;
+			len -= ret;
+		} while (len);
+
+		iio_mutex_unlock(pdata->lock);
+	}
+
+	pdata->mmap_in_use = true;
+	*addr_ptr = pdata->mmap_addr[pdata->mmap_cur];
+	return read ? read : (ssize_t) bytes_used;
+
+err_unlock:
+	iio_mutex_unlock(pdata->lock);
+	return ret;
+}
+#endif
+
+static struct iiod_client_pdata *
+network_ctrl_new(struct iio_context_pdata *pdata)
+{
+	struct iiod_client_pdata *io_ctx;
+	int ret;
+
+	io_ctx = zalloc(sizeof(*io_ctx));
+	if (!io_ctx)
+		return NULL;
+
+	/* Requests on this connection don't take the lock of the client */
+	io_ctx->conn.lock = iio_mutex_create();
+	if (!io_ctx->conn.lock)
+		goto err_free_io_ctx;
+
+	io_ctx->timeout_ms = pdata->io_ctx.timeout_ms;
+
+	if (pdata->mux) {
+		ret = network_mux_chan_open(pdata->mux, io_ctx);
+		if (ret < 0)
+			goto err_destroy_lock;
+
+		io_ctx->fd = pdata->mux->raw.fd;
+	} else {
+		ret = create_socket(pdata->addrinfo);
+		if (ret < 0)
+			goto err_destroy_lock;
+
+		io_ctx->fd = ret;
+		set_socket_timeout(io_ctx->fd, io_ctx->timeout_ms);
+	}
+
+	if (pdata->io_ctx.conn.binary)
+		iiod_client_enable_binary(pdata->iiod_client, io_ctx);
+
+	IIO_DEBUG("Opened control connection %d\n", io_ctx->fd);
+	return io_ctx;
+
+err_destroy_lock:
+	iio_mutex_destroy(io_ctx->conn.lock);
+err_free_io_ctx:
+	free(io_ctx);
+	return NULL;
+}
+
+static void network_ctrl_free(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, bool broken)
+{
+	if (!broken)
+		iiod_client_exit_unlocked(pdata->iiod_client, io_ctx);
+
+	if (io_ctx->mux)
+		network_mux_chan_close(io_ctx);
+	else
+		close(io_ctx->fd);
+
+	iio_mutex_destroy(io_ctx->conn.lock);
+	free(io_ctx);
+}
+
+/*
+ * Returns the connection to use for the attributes: the main one when no
+ * other thread uses it, or else an idle control connection, opened on
+ * demand. Once NETWORK_MAX_CTRL are busy, or if one could not be opened,
+ * the threads share the main connection again, and serialize on the lock of
+ * the client. On a multiplexed connection, where opening one only takes a
+ * free channel, control connections are always preferred, so that attribute
+ * requests are not queued behind the frames of the context's channel.
+ * Must be paired with network_put_ctrl().
+ */
+static struct iiod_client_pdata *
+network_get_ctrl(struct iio_context_pdata *pdata)
+{
+	struct iiod_client_pdata *io_ctx;
+	unsigned int i, slot = NETWORK_MAX_CTRL;
+
+	iio_mutex_lock(pdata->ctrl_lock);
+
+	if ((!pdata->main_users && !pdata->mux) || pdata->ctrl_failed)
+		goto out_use_main;
+
+	for (i = 0; i < NETWORK_MAX_CTRL; i++) {
+		if (pdata->ctrl_busy[i])
+			continue;
+
+		if (pdata->ctrl[i]) {
+			pdata->ctrl_busy[i] = true;
+			iio_mutex_unlock(pdata->ctrl_lock);
+			return pdata->ctrl[i];
+		}
+
+		if (slot == NETWORK_MAX_CTRL)
+			slot = i;
+	}
+
+	if (slot == NETWORK_MAX_CTRL)
+		goto out_use_main;
+
+	/* Connecting is slow, reserve the slot and drop the lock */
+	pdata->ctrl_busy[slot] = true;
+	iio_mutex_unlock(pdata->ctrl_lock);
+
+	io_ctx = network_ctrl_new(pdata);
+
+	iio_mutex_lock(pdata->ctrl_lock);
+
+	if (io_ctx) {
+		pdata->ctrl[slot] = io_ctx;
+		iio_mutex_unlock(pdata->ctrl_lock);
+		return io_ctx;
+	}
+
+	IIO_DEBUG("Unable to open a control connection, sharing the main one\n");
+	pdata->ctrl_busy[slot] = false;
+	pdata->ctrl_failed = true;
 
-			ret = network_do_splice(pdata, ret, true);
-			if (ret < 0)
-				goto err_unlock;
+out_use_main:
+	pdata->main_users++;
+	iio_mutex_unlock(pdata->ctrl_lock);
 
-			read += ret;
-			len -= ret;
-		} while (len);
+	return &pdata->io_ctx;
+}
 
-		iio_mutex_unlock(pdata->lock);
-	}
+static void network_put_ctrl(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, ssize_t ret)
+{
+	/* The stream may be out of sync; open a new connection next time */
+	bool broken = ret == -EPIPE || ret == -ECONNRESET ||
+		ret == -ETIMEDOUT || ret == -EIO;
+	unsigned int i;
 
-	pdata->mmap_addr = mmap(NULL, pdata->mmap_len,
-			PROT_READ | PROT_WRITE, MAP_SHARED, pdata->memfd, 0);
-	if (pdata->mmap_addr == MAP_FAILED) {
-		pdata->mmap_addr = NULL;
-		ret = -errno;
-		IIO_ERROR("Unable to mmap: %zi\n", -ret);
-		return ret;
+	iio_mutex_lock(pdata->ctrl_lock);
+
+	if (io_ctx == &pdata->io_ctx) {
+		pdata->main_users--;
+		iio_mutex_unlock(pdata->ctrl_lock);
+		return;
 	}
 
-	*addr_ptr = pdata->mmap_addr;
-	return read ? read : (ssize_t) bytes_used;
+	for (i = 0; pdata->ctrl[i] != io_ctx; i++);
 
-err_close_memfd:
-	close(memfd);
-err_unlock:
-	iio_mutex_unlock(pdata->lock);
-	return ret;
+	if (broken)
+		pdata->ctrl[i] = NULL;
+	pdata->ctrl_busy[i] = false;
+
+	iio_mutex_unlock(pdata->ctrl_lock);
+
+	if (broken)
+		network_ctrl_free(pdata, io_ctx, true);
 }
-#endif
 
 static ssize_t network_read_dev_attr(const struct iio_device *dev,
 		const char *attr, char *dst, size_t len, enum iio_attr_type type)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct iiod_client_pdata *io_ctx = network_get_ctrl(pdata);
+	ssize_t ret;
+
+	ret = iiod_client_read_attr(pdata->iiod_client,
+			io_ctx, dev, NULL, attr, dst, len, type);
+	network_put_ctrl(pdata, io_ctx, ret);
 
-	return iiod_client_read_attr(pdata->iiod_client,
-			&pdata->io_ctx, dev, NULL, attr, dst, len, type);
+	return ret;
 }
 
 static ssize_t network_write_dev_attr(const struct iio_device *dev,
 		const char *attr, const char *src, size_t len, enum iio_attr_type type)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+	struct iiod_client_pdata *io_ctx = network_get_ctrl(pdata);
+	ssize_t ret;
 
-	return iiod_client_write_attr(pdata->iiod_client,
-			&pdata->io_ctx, dev, NULL, attr, src, len, type);
+	ret = iiod_client_write_attr(pdata->iiod_client,
+			io_ctx, dev, NULL, attr, src, len, type);
+	network_put_ctrl(pdata, io_ctx, ret);
+
+	return ret;
 }
 
 static ssize_t network_read_chn_attr(const struct iio_channel *chn,
 		const char *attr, char *dst, size_t len)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(chn->dev->ctx);
+	struct iiod_client_pdata *io_ctx = network_get_ctrl(pdata);
+	ssize_t ret;
+
+	ret = iiod_client_read_attr(pdata->iiod_client,
+			io_ctx, chn->dev, chn, attr, dst, len, false);
+	network_put_ctrl(pdata, io_ctx, ret);
 
-	return iiod_client_read_attr(pdata->iiod_client,
-			&pdata->io_ctx, chn->dev, chn, attr, dst, len, false);
+	return ret;
 }
 
 static ssize_t network_write_chn_attr(const struct iio_channel *chn,
 		const char *attr, const char *src, size_t len)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(chn->dev->ctx);
+	struct iiod_client_pdata *io_ctx = network_get_ctrl(pdata);
+	ssize_t ret;
 
-	return iiod_client_write_attr(pdata->iiod_client,
-			&pdata->io_ctx, chn->dev, chn, attr, src, len, false);
+	ret = iiod_client_write_attr(pdata->iiod_client,
+			io_ctx, chn->dev, chn, attr, src, len, false);
+	network_put_ctrl(pdata, io_ctx, ret);
+
+	return ret;
+}
+
+static int network_commit_attr_batch(struct iio_attr_batch *batch,
+		bool stop_on_error)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(batch->ctx);
+	struct iiod_client_pdata *io_ctx = network_get_ctrl(pdata);
+	int ret;
+
+	ret = iiod_client_attr_batch(pdata->iiod_client, io_ctx,
+			batch, stop_on_error);
+	network_put_ctrl(pdata, io_ctx, ret);
+
+	return ret;
+}
+
+static int network_set_attr_cache(struct iio_context *ctx,
+		const char *attr, int ttl_ms)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_set_attr_cache(pdata->iiod_client, attr, ttl_ms);
+}
+
+static int network_get_timestamp(const struct iio_device *dev,
+		uint64_t *timestamp)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+
+	/* IIOD would answer with the timestamp of the last request sent
+	 * ahead, after all their data */
+	if (pdata->io_ctx.conn.nb_pending)
+		ret = -EBUSY;
+	else
+		ret = iiod_client_get_timestamp_unlocked(ctx_pdata->iiod_client,
+				&pdata->io_ctx, dev, timestamp);
+
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
 }
 
 static int network_get_trigger(const struct iio_device *dev,
@@ -831,15 +2428,57 @@ static int network_set_trigger(const struct iio_device *dev,
 			&pdata->io_ctx, dev, trigger);
 }
 
+/* Drop the reference of a context to its multiplexed connection, which is
+ * closed once no context uses it anymore */
+static void network_mux_put(struct iio_context_pdata *pdata)
+{
+	struct network_mux *mux = pdata->mux;
+	bool last;
+
+	iio_mutex_lock(mux->lock);
+	last = !--mux->refs;
+
+	/* IIOD ends the whole connection with the session of channel 0, so
+	 * it lives as long as the connection; its frames are now dropped */
+	if (!last && !pdata->io_ctx.chan)
+		mux->chans[0].io_ctx = NULL;
+	iio_mutex_unlock(mux->lock);
+
+	if (last || pdata->io_ctx.chan) {
+		iiod_client_mutex_lock(pdata->iiod_client);
+		iiod_client_exit_unlocked(pdata->iiod_client, &pdata->io_ctx);
+		iiod_client_mutex_unlock(pdata->iiod_client);
+	}
+
+	if (pdata->io_ctx.chan)
+		network_mux_chan_close(&pdata->io_ctx);
+
+	if (last) {
+		close(mux->raw.fd);
+		network_mux_destroy(mux);
+	}
+}
+
 static void network_shutdown(struct iio_context *ctx)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
 	unsigned int i;
 
-	iiod_client_mutex_lock(pdata->iiod_client);
-	write_command(&pdata->io_ctx, "\r\nEXIT\r\n");
-	close(pdata->io_ctx.fd);
-	iiod_client_mutex_unlock(pdata->iiod_client);
+	for (i = 0; i < NETWORK_MAX_CTRL; i++) {
+		if (pdata->ctrl[i])
+			network_ctrl_free(pdata, pdata->ctrl[i], false);
+	}
+
+	if (pdata->ctrl_lock)
+		iio_mutex_destroy(pdata->ctrl_lock);
+
+	/* The devices still use a multiplexed connection, see below */
+	if (!pdata->mux) {
+		iiod_client_mutex_lock(pdata->iiod_client);
+		iiod_client_exit_unlocked(pdata->iiod_client, &pdata->io_ctx);
+		close(pdata->io_ctx.fd);
+		iiod_client_mutex_unlock(pdata->iiod_client);
+	}
 
 	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
 		struct iio_device *dev = iio_context_get_device(ctx, i);
@@ -852,6 +2491,9 @@ static void network_shutdown(struct iio_context *ctx)
 		}
 	}
 
+	if (pdata->mux)
+		network_mux_put(pdata);
+
 	iiod_client_destroy(pdata->iiod_client);
 	freeaddrinfo(pdata->addrinfo);
 }
@@ -883,8 +2525,26 @@ static int network_set_timeout(struct iio_context *ctx, unsigned int timeout)
 
 		ret = iiod_client_set_timeout(pdata->iiod_client,
 			&pdata->io_ctx, remote_timeout);
-		if (!ret)
+		if (!ret) {
 			pdata->io_ctx.timeout_ms = timeout;
+			if (pdata->mux)
+				pdata->mux->raw.timeout_ms = timeout;
+		}
+	}
+	if (!ret) {
+		unsigned int i;
+
+		iio_mutex_lock(pdata->ctrl_lock);
+		for (i = 0; i < NETWORK_MAX_CTRL; i++) {
+			struct iiod_client_pdata *io_ctx = pdata->ctrl[i];
+
+			if (io_ctx) {
+				if (!io_ctx->mux)
+					set_socket_timeout(io_ctx->fd, timeout);
+				io_ctx->timeout_ms = timeout;
+			}
+		}
+		iio_mutex_unlock(pdata->ctrl_lock);
 	}
 	if (ret < 0) {
 		char buf[1024];
@@ -903,13 +2563,72 @@ static int network_set_kernel_buffers_count(const struct iio_device *dev,
 			 &pdata->io_ctx, dev, nb_blocks);
 }
 
-static struct iio_context * network_clone(const struct iio_context *ctx)
+static int network_set_low_latency(const struct iio_device *dev, bool enable)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_set_low_latency(pdata->iiod_client,
+			 &pdata->io_ctx, dev, enable);
+}
+
+static int network_enable_multiplexing(struct iio_context *ctx)
 {
-	const char *addr = iio_context_get_attr_value(ctx, "ip,ip-addr");
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	struct network_mux *mux;
+	int ret = 0;
+
+	iiod_client_mutex_lock(pdata->iiod_client);
+
+	if (pdata->mux)
+		goto out_unlock;
+
+	mux = network_mux_new(pdata->io_ctx.fd, pdata->io_ctx.timeout_ms);
+	if (!mux) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	ret = iiod_client_enable_mux_unlocked(pdata->iiod_client,
+					      &pdata->io_ctx);
+	if (ret == -EINVAL) {
+		/* Older IIOD */
+		ret = -ENOSYS;
+	}
+	if (ret < 0)
+		goto err_destroy_mux;
+
+	/* Waiting for the next frame must not block the thread reading, so
+	 * that a timeout can be told apart from a broken stream */
+	ret = setup_cancel(&mux->raw);
+	if (ret < 0) {
+		/* The connection is now unusable */
+		IIO_ERROR("Unable to set up multiplexing: %d\n", ret);
+		goto err_destroy_mux;
+	}
+
+	/* Keep what was received past the response */
+	mux->raw.rx_len = network_take_buffered(&pdata->io_ctx,
+			mux->raw.rx_buf, sizeof(mux->raw.rx_buf));
+
+	mux->raw.cancellable = true;
+	mux->chans[0].used = true;
+	mux->chans[0].io_ctx = &pdata->io_ctx;
+	pdata->io_ctx.mux = mux;
+	pdata->io_ctx.chan = 0;
+	pdata->mux = mux;
+
+	iiod_client_mutex_unlock(pdata->iiod_client);
+	return 0;
 
-	return iio_create_network_context(addr);
+err_destroy_mux:
+	network_mux_destroy(mux);
+out_unlock:
+	iiod_client_mutex_unlock(pdata->iiod_client);
+	return ret;
 }
 
+static struct iio_context * network_clone(const struct iio_context *ctx);
+
 static const struct iio_backend_ops network_ops = {
 	.clone = network_clone,
 	.open = network_open,
@@ -919,10 +2638,17 @@ static const struct iio_backend_ops network_ops = {
 #ifdef WITH_NETWORK_GET_BUFFER
 	.get_buffer = network_get_buffer,
 #endif
+	.get_fd = network_get_fd,
+	.try_read = network_try_read,
+	.try_write = network_try_write,
+	.request_read = network_request_read,
 	.read_device_attr = network_read_dev_attr,
 	.write_device_attr = network_write_dev_attr,
 	.read_channel_attr = network_read_chn_attr,
 	.write_channel_attr = network_write_chn_attr,
+	.commit_attr_batch = network_commit_attr_batch,
+	.set_attr_cache = network_set_attr_cache,
+	.get_timestamp = network_get_timestamp,
 	.get_trigger = network_get_trigger,
 	.set_trigger = network_set_trigger,
 	.shutdown = network_shutdown,
@@ -930,6 +2656,15 @@ static const struct iio_backend_ops network_ops = {
 	.get_version = network_get_version,
 	.set_timeout = network_set_timeout,
 	.set_kernel_buffers_count = network_set_kernel_buffers_count,
+	.set_low_latency = network_set_low_latency,
+	.set_read_ahead = network_set_read_ahead,
+	.set_compression = network_set_compression,
+	.publish = network_publish,
+	.subscribe = network_subscribe,
+	.set_decimation = network_set_decimation,
+	.set_capture_window = network_set_capture_window,
+	.get_multicast_losses = network_get_multicast_losses,
+	.enable_multiplexing = network_enable_multiplexing,
 
 	.cancel = network_cancel,
 };
@@ -940,6 +2675,9 @@ static ssize_t network_write_data(struct iio_context_pdata *pdata,
 {
 	struct iiod_client_pdata *io_ctx = io_data;
 
+	if (io_ctx->mux)
+		return network_mux_write(io_ctx, src, len);
+
 	return network_send(io_ctx, src, len, 0);
 }
 
@@ -949,76 +2687,48 @@ static ssize_t network_read_data(struct iio_context_pdata *pdata,
 {
 	struct iiod_client_pdata *io_ctx = io_data;
 
-	return network_recv(io_ctx, dst, len, 0);
+	if (io_ctx->mux)
+		return network_mux_read(io_ctx, dst, len);
+
+	return network_recv_buffered(io_ctx, dst, len);
 }
 
 static ssize_t network_read_line(struct iio_context_pdata *pdata,
 				 struct iiod_client_pdata *io_data,
 				 char *dst, size_t len)
 {
-	bool found = false;
-	size_t i;
-#ifdef __linux__
 	struct iiod_client_pdata *io_ctx = io_data;
+	size_t nb, bytes_read = 0;
 	ssize_t ret;
-	size_t bytes_read = 0;
-
-	do {
-		size_t to_trunc;
-
-		ret = network_recv(io_ctx, dst, len, MSG_PEEK);
-		if (ret < 0)
-			return ret;
-
-		/* Lookup for the trailing \n */
-		for (i = 0; i < (size_t) ret && dst[i] != '\n'; i++);
-		found = i < (size_t) ret;
+	char *end;
 
-		len -= ret;
-		dst += ret;
-
-		if (found)
-			to_trunc = i + 1;
-		else
-			to_trunc = (size_t) ret;
+	if (io_ctx->mux)
+		return network_mux_read_line(io_ctx, dst, len);
 
-		/* Advance the read offset to the byte following the \n if
-		 * found, or after the last character read otherwise */
-		if (pdata->msg_trunc_supported)
-			ret = network_recv(io_ctx, NULL, to_trunc, MSG_TRUNC);
-		else
-			ret = network_recv(io_ctx, dst - ret, to_trunc, 0);
-		if (ret < 0) {
-			IIO_ERROR("NETWORK RECV: %zu\n", ret);
-			return ret;
+	while (bytes_read < len) {
+		if (!io_ctx->rx_len) {
+			ret = network_fill_buffer(io_ctx);
+			if (ret < 0)
+				return ret;
 		}
 
-		bytes_read += to_trunc;
-	} while (!found && len);
-
-	if (!found) {
-		IIO_ERROR("EIO: %zu\n", ret);
-		return -EIO;
-	} else
-		return bytes_read;
-#else
-	for (i = 0; i < len - 1; i++) {
-		ssize_t ret = network_read_data(pdata, io_data, dst + i, 1);
-
-		if (ret < 0)
-			return ret;
+		nb = len - bytes_read;
+		if (nb > io_ctx->rx_len)
+			nb = io_ctx->rx_len;
 
-		if (dst[i] != '\n')
-			found = true;
-		else if (found)
-			break;
+		/* Lookup for the trailing \n */
+		end = memchr(io_ctx->rx_buf + io_ctx->rx_off, '\n', nb);
+		if (end)
+			nb = (size_t) (end - (io_ctx->rx_buf + io_ctx->rx_off)) + 1;
+
+		bytes_read += network_take_buffered(io_ctx,
+				dst + bytes_read, nb);
+		if (end)
+			return (ssize_t) bytes_read;
 	}
 
-	if (!found || i == len - 1)
-		return -EIO;
-
-	return (ssize_t) i + 1;
-#endif
+	IIO_ERROR("EIO: %zu\n", bytes_read);
+	return -EIO;
 }
 
 static const struct iiod_client_ops network_iiod_client_ops = {
@@ -1027,27 +2737,195 @@ static const struct iiod_client_ops network_iiod_client_ops = {
 	.read_line = network_read_line,
 };
 
-#ifdef __linux__
-/*
- * As of build 16299, Windows Subsystem for Linux presents a Linux API but
- * without support for MSG_TRUNC. Since WSL allows running native Linux
- * applications this is not something that can be detected at compile time. If
- * we want to support WSL we have to have a runtime workaround.
- */
-static bool msg_trunc_supported(struct iiod_client_pdata *io_ctx)
+static int network_setup_devices(struct iio_context *ctx)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	unsigned int i;
+
+	/* Also set up the pool of control connections */
+	pdata->ctrl_lock = iio_mutex_create();
+	if (!pdata->ctrl_lock)
+		return -ENOMEM;
+
+	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+
+		dev->pdata = zalloc(sizeof(*dev->pdata));
+		if (!dev->pdata)
+			return -ENOMEM;
+
+		dev->pdata->io_ctx.fd = -1;
+		dev->pdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
+		dev->pdata->mcast.fd = -1;
+#ifdef WITH_NETWORK_GET_BUFFER
+		dev->pdata->memfd[0] = -1;
+		dev->pdata->memfd[1] = -1;
+		dev->pdata->pipefd[0] = -1;
+		dev->pdata->pipefd[1] = -1;
+#endif
+
+		dev->pdata->lock = iio_mutex_create();
+		if (!dev->pdata->lock)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* An addrinfo cannot be copied, so resolve its numeric address again */
+static struct addrinfo * network_dup_addrinfo(const struct addrinfo *res)
 {
+	/* Large enough for an IPv6 address with an interface name */
+	char host[128], port[8];
+	struct addrinfo hints, *dup;
 	int ret;
 
-	ret = network_recv(io_ctx, NULL, 0, MSG_TRUNC | MSG_DONTWAIT);
+	ret = getnameinfo(res->ai_addr, (socklen_t) res->ai_addrlen,
+			  host, sizeof(host), port, sizeof(port),
+			  NI_NUMERICHOST | NI_NUMERICSERV);
+	if (!ret) {
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = res->ai_family;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICHOST;
+
+		ret = getaddrinfo(host, port, &hints, &dup);
+	}
+	if (ret) {
+		IIO_ERROR("Unable to copy address: %s\n", gai_strerror(ret));
+		errno = EINVAL;
+		return NULL;
+	}
 
-	return ret != -EFAULT && ret != -EINVAL;
+	return dup;
 }
-#else
-static bool msg_trunc_supported(struct iiod_client_pdata *io_ctx)
+
+/*
+ * The clone is created from the XML string of the context, instead of the
+ * one IIOD would send again. It shares the connection of a multiplexed
+ * context, on a channel of its own, and opens a new one otherwise.
+ */
+static struct iio_context * network_clone(const struct iio_context *ctx)
 {
-	return false;
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+	struct network_mux *mux = pdata->mux;
+	struct iio_context_pdata *new_pdata;
+	struct iio_context *new_ctx;
+	struct addrinfo *res;
+	const char *xml, *attr;
+	char *description;
+	int fd, ret;
+
+	xml = iio_context_get_xml(ctx);
+	res = network_dup_addrinfo(pdata->addrinfo);
+	if (!res)
+		return NULL;
+
+	new_pdata = zalloc(sizeof(*new_pdata));
+	if (!new_pdata) {
+		ret = -ENOMEM;
+		goto err_free_addrinfo;
+	}
+
+	new_pdata->addrinfo = res;
+	new_pdata->io_ctx.timeout_ms = pdata->io_ctx.timeout_ms;
+
+	new_pdata->iiod_client = iiod_client_new(new_pdata,
+						 &network_iiod_client_ops);
+	if (!new_pdata->iiod_client) {
+		ret = -errno;
+		goto err_free_pdata;
+	}
+
+	if (mux) {
+		ret = network_mux_chan_open(mux, &new_pdata->io_ctx);
+		if (ret < 0)
+			goto err_destroy_iiod_client;
+
+		iio_mutex_lock(mux->lock);
+		mux->refs++;
+		iio_mutex_unlock(mux->lock);
+
+		new_pdata->mux = mux;
+		fd = mux->raw.fd;
+	} else {
+		fd = create_socket(res);
+		if (fd < 0) {
+			ret = fd;
+			goto err_destroy_iiod_client;
+		}
+	}
+
+	new_pdata->io_ctx.fd = fd;
+
+	new_ctx = iio_create_xml_context_mem(xml, strlen(xml));
+	if (!new_ctx) {
+		ret = -errno;
+		goto err_close_socket;
+	}
+
+	/* From now on, network_shutdown() undoes everything */
+	new_ctx->name = "network";
+	new_ctx->ops = &network_ops;
+	new_ctx->pdata = new_pdata;
+
+	ret = network_setup_devices(new_ctx);
+	if (ret < 0)
+		goto err_destroy_ctx;
+
+	attr = iio_context_get_attr_value(ctx, "ip,ip-addr");
+	if (attr) {
+		ret = iio_context_add_attr(new_ctx, "ip,ip-addr", attr);
+		if (ret < 0)
+			goto err_destroy_ctx;
+	}
+
+	attr = iio_context_get_attr_value(ctx, "uri");
+	if (attr) {
+		ret = iio_context_add_attr(new_ctx, "uri", attr);
+		if (ret < 0)
+			goto err_destroy_ctx;
+	}
+
+	if (ctx->description) {
+		description = iio_strdup(ctx->description);
+		if (!description) {
+			ret = -ENOMEM;
+			goto err_destroy_ctx;
+		}
+
+		free(new_ctx->description);
+		new_ctx->description = description;
+	}
+
+	iiod_client_enable_binary(new_pdata->iiod_client, &new_pdata->io_ctx);
+	iiod_client_set_timeout(new_pdata->iiod_client, &new_pdata->io_ctx,
+			calculate_remote_timeout(new_pdata->io_ctx.timeout_ms));
+	return new_ctx;
+
+err_destroy_ctx:
+	iio_context_destroy(new_ctx);
+	errno = -ret;
+	return NULL;
+
+err_close_socket:
+	if (mux) {
+		network_mux_chan_close(&new_pdata->io_ctx);
+		iio_mutex_lock(mux->lock);
+		mux->refs--;
+		iio_mutex_unlock(mux->lock);
+	} else {
+		close(fd);
+	}
+err_destroy_iiod_client:
+	iiod_client_destroy(new_pdata->iiod_client);
+err_free_pdata:
+	free(new_pdata);
+err_free_addrinfo:
+	freeaddrinfo(res);
+	errno = -ret;
+	return NULL;
 }
-#endif
 
 struct iio_context * network_create_context(const char *host)
 {
@@ -1056,7 +2934,6 @@ struct iio_context * network_create_context(const char *host)
 	struct iiod_client *iiod_client;
 	struct iio_context_pdata *pdata;
 	size_t uri_len;
-	unsigned int i;
 	int fd, ret;
 	char *description, *uri;
 #ifdef _WIN32
@@ -1157,12 +3034,6 @@ struct iio_context * network_create_context(const char *host)
 	pdata->addrinfo = res;
 	pdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
 
-	pdata->msg_trunc_supported = msg_trunc_supported(&pdata->io_ctx);
-	if (pdata->msg_trunc_supported)
-		IIO_DEBUG("MSG_TRUNC is supported\n");
-	else
-		IIO_DEBUG("MSG_TRUNC is NOT supported\n");
-
 	IIO_DEBUG("Creating context...\n");
 	ctx = iiod_client_create_context(pdata->iiod_client, &pdata->io_ctx);
 	if (!ctx)
@@ -1198,27 +3069,9 @@ struct iio_context * network_create_context(const char *host)
 	if (ret < 0)
 		goto err_free_uri;
 
-	for (i = 0; i < iio_context_get_devices_count(ctx); i++) {
-		struct iio_device *dev = iio_context_get_device(ctx, i);
-
-		dev->pdata = zalloc(sizeof(*dev->pdata));
-		if (!dev->pdata) {
-			ret = -ENOMEM;
-			goto err_free_uri;
-		}
-
-		dev->pdata->io_ctx.fd = -1;
-		dev->pdata->io_ctx.timeout_ms = DEFAULT_TIMEOUT_MS;
-#ifdef WITH_NETWORK_GET_BUFFER
-		dev->pdata->memfd = -1;
-#endif
-
-		dev->pdata->lock = iio_mutex_create();
-		if (!dev->pdata->lock) {
-			ret = -ENOMEM;
-			goto err_free_uri;
-		}
-	}
+	ret = network_setup_devices(ctx);
+	if (ret < 0)
+		goto err_free_uri;
 
 	if (ctx->description) {
 		size_t desc_len = strlen(description);
@@ -1239,6 +3092,7 @@ struct iio_context * network_create_context(const char *host)
 	}
 
 	free(uri);
+	iiod_client_enable_binary(pdata->iiod_client, &pdata->io_ctx);
 	iiod_client_set_timeout(pdata->iiod_client, &pdata->io_ctx,
 			calculate_remote_timeout(DEFAULT_TIMEOUT_MS));
 	return ctx;
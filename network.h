@@ -10,11 +10,18 @@
 #ifndef __IIO_NETWORK_H
 #define __IIO_NETWORK_H
 
+#include "iiod-client.h"
+
 #include <stdbool.h>
 
 struct addrinfo;
+struct network_mux;
+
+#define NETWORK_RX_BUF_SIZE 0x1000
 
 struct iiod_client_pdata {
+	struct iiod_client_conn conn;
+
 	int fd;
 
 	/* Only buffer IO contexts can be cancelled. */
@@ -23,6 +30,14 @@ struct iiod_client_pdata {
 	void * events[2];
 	int cancel_fd[2];
 	unsigned int timeout_ms;
+
+	/* Set for the channels of a multiplexed connection */
+	struct network_mux *mux;
+	uint16_t chan;
+
+	/* Data received ahead of the reads, see network_recv_buffered() */
+	char rx_buf[NETWORK_RX_BUF_SIZE];
+	size_t rx_off, rx_len;
 };
 
 int setup_cancel(struct iiod_client_pdata *io_ctx);
@@ -30,6 +45,9 @@ void cleanup_cancel(struct iiod_client_pdata *io_ctx);
 void do_cancel(struct iiod_client_pdata *io_ctx);
 int wait_cancellable(struct iiod_client_pdata *io_ctx, bool read);
 
+/* Check, without waiting, whether a socket can be read from or written to */
+bool network_is_ready(int fd, bool read);
+
 int do_create_socket(const struct addrinfo *addrinfo);
 
 int set_blocking_mode(int s, bool blocking);
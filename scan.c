@@ -6,7 +6,9 @@
  * Author: Paul Cercueil <paul.cercueil@analog.com>
  */
 
+#include "debug.h"
 #include "iio-config.h"
+#include "iio-lock.h"
 #include "iio-private.h"
 
 #include <errno.h>
@@ -31,41 +33,247 @@ const char * iio_context_info_get_uri(
 	return info->uri;
 }
 
-ssize_t iio_scan_context_get_info_list(struct iio_scan_context *ctx,
+/*
+ * The backends are scanned in parallel, each one by a thread of its own. The
+ * threads can't be interrupted, so when the time budget expires, the caller
+ * returns with the results that arrived and the remaining threads release the
+ * scan state once they are done: the last one out frees it.
+ */
+
+enum iio_scan_backend {
+	IIO_SCAN_LOCAL,
+	IIO_SCAN_USB,
+	IIO_SCAN_NETWORK,
+	IIO_SCAN_NB,
+};
+
+struct iio_scan_job {
+	struct iio_scan_state *state;
+	int (*scan)(struct iio_scan_result *scan_result);
+	struct iio_scan_result result;
+	int ret;
+	bool enabled, done;
+};
+
+struct iio_scan_state {
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+
+	/* The caller, plus one for each running job */
+	unsigned int refs;
+	bool abandoned;
+
+	void (*cb)(const struct iio_context_info *info, void *d);
+	void *d;
+
+	struct iio_scan_job jobs[IIO_SCAN_NB];
+	unsigned int nb_jobs, nb_done;
+};
+
+static void iio_scan_state_free(struct iio_scan_state *state)
+{
+	unsigned int i;
+
+	for (i = 0; i < IIO_SCAN_NB; i++)
+		iio_context_info_list_free(state->jobs[i].result.info);
+
+	iio_cond_destroy(state->cond);
+	iio_mutex_destroy(state->lock);
+	free(state);
+}
+
+static void iio_scan_state_put(struct iio_scan_state *state)
+{
+	bool last;
+
+	iio_mutex_lock(state->lock);
+	last = !--state->refs;
+	iio_mutex_unlock(state->lock);
+
+	if (last)
+		iio_scan_state_free(state);
+}
+
+static int iio_scan_job_run(void *d)
+{
+	struct iio_scan_job *job = d;
+	struct iio_scan_state *state = job->state;
+	struct iio_scan_result result = { 0, NULL };
+	size_t i;
+	int ret;
+
+	ret = job->scan(&result);
+
+	iio_mutex_lock(state->lock);
+
+	if (!state->abandoned) {
+		job->result = result;
+		job->ret = ret;
+		job->done = true;
+
+		/* The callbacks are serialized by the lock */
+		for (i = 0; !ret && state->cb && i < result.size; i++)
+			state->cb(result.info[i], state->d);
+
+		state->nb_done++;
+		iio_cond_signal(state->cond);
+	} else {
+		iio_context_info_list_free(result.info);
+	}
+
+	iio_mutex_unlock(state->lock);
+
+	iio_scan_state_put(state);
+	return ret;
+}
+
+static int iio_scan_state_start(struct iio_scan_state *state,
+		enum iio_scan_backend backend,
+		int (*scan)(struct iio_scan_result *scan_result))
+{
+	struct iio_scan_job *job = &state->jobs[backend];
+	int ret;
+
+	job->state = state;
+	job->scan = scan;
+	job->enabled = true;
+
+	iio_mutex_lock(state->lock);
+	state->nb_jobs++;
+	state->refs++;
+	iio_mutex_unlock(state->lock);
+
+	ret = iio_thrd_create_detached(iio_scan_job_run, job);
+	if (ret == -ENOSYS) {
+		/* Without thread support, scan from the calling thread */
+		iio_scan_job_run(job);
+		ret = 0;
+	} else if (ret) {
+		iio_mutex_lock(state->lock);
+		state->nb_jobs--;
+		state->refs--;
+		job->enabled = false;
+		iio_mutex_unlock(state->lock);
+	}
+
+	return ret;
+}
+
+/* Gathers the results in the order of the backends, whatever the order in
+ * which they arrived. Must be called with the lock held. */
+static ssize_t iio_scan_state_collect(struct iio_scan_state *state,
 		struct iio_context_info ***info)
 {
 	struct iio_scan_result scan_result = { 0, NULL };
+	struct iio_context_info *entry;
+	unsigned int i;
+	size_t j;
 
-	if (WITH_LOCAL_BACKEND && ctx->scan_local) {
-		int ret = local_context_scan(&scan_result);
-		if (ret < 0) {
-			if (scan_result.info)
-				iio_context_info_list_free(scan_result.info);
-			return ret;
-		}
+	for (i = 0; i < IIO_SCAN_NB; i++) {
+		if (state->jobs[i].done && state->jobs[i].ret < 0)
+			return state->jobs[i].ret;
 	}
 
-	if (WITH_USB_BACKEND && ctx->scan_usb) {
-		int ret = usb_context_scan(&scan_result);
-		if (ret < 0) {
-			if (scan_result.info)
+	for (i = 0; i < IIO_SCAN_NB; i++) {
+		struct iio_scan_result *result = &state->jobs[i].result;
+
+		for (j = 0; state->jobs[i].done && j < result->size; j++) {
+			entry = iio_scan_result_add(&scan_result);
+			if (!entry) {
 				iio_context_info_list_free(scan_result.info);
-			return ret;
+				return -ENOMEM;
+			}
+
+			/* Move the entry to the new list */
+			*entry = *result->info[j];
+			memset(result->info[j], 0, sizeof(*entry));
 		}
 	}
 
-	if (HAVE_DNS_SD && ctx->scan_network) {
-		int ret = dnssd_context_scan(&scan_result);
-		if (ret < 0) {
-			if (scan_result.info)
-				iio_context_info_list_free(scan_result.info);
-			return ret;
+	if (info)
+		*info = scan_result.info;
+	else
+		iio_context_info_list_free(scan_result.info);
+
+	return (ssize_t) scan_result.size;
+}
+
+ssize_t iio_scan_context_get_info_list_timeout(struct iio_scan_context *ctx,
+		unsigned int timeout_ms,
+		void (*cb)(const struct iio_context_info *info, void *d),
+		void *d, struct iio_context_info ***info)
+{
+	struct iio_scan_state *state;
+	uint64_t deadline = iio_time_ms() + timeout_ms, now;
+	ssize_t ret = 0;
+
+	state = zalloc(sizeof(*state));
+	if (!state)
+		return -ENOMEM;
+
+	state->lock = iio_mutex_create();
+	if (!state->lock) {
+		free(state);
+		return -ENOMEM;
+	}
+
+	state->cond = iio_cond_create();
+	if (!state->cond) {
+		iio_mutex_destroy(state->lock);
+		free(state);
+		return -ENOMEM;
+	}
+
+	state->refs = 1;
+	state->cb = cb;
+	state->d = d;
+
+	if (WITH_LOCAL_BACKEND && ctx->scan_local)
+		ret = iio_scan_state_start(state, IIO_SCAN_LOCAL,
+					   local_context_scan);
+
+	if (!ret && WITH_USB_BACKEND && ctx->scan_usb)
+		ret = iio_scan_state_start(state, IIO_SCAN_USB,
+					   usb_context_scan);
+
+	if (!ret && HAVE_DNS_SD && ctx->scan_network)
+		ret = iio_scan_state_start(state, IIO_SCAN_NETWORK,
+					   dnssd_context_scan);
+
+	iio_mutex_lock(state->lock);
+
+	while (!ret && state->nb_done < state->nb_jobs) {
+		now = iio_time_ms();
+
+		if (!timeout_ms) {
+			iio_cond_wait(state->cond, state->lock, 0);
+		} else if (now < deadline) {
+			iio_cond_wait(state->cond, state->lock,
+				      (unsigned int) (deadline - now));
+		} else {
+			IIO_DEBUG("Scan timed out, %u backend(s) pending\n",
+				  state->nb_jobs - state->nb_done);
+			break;
 		}
 	}
 
-	*info = scan_result.info;
+	/* From now on, the jobs still running drop their results */
+	state->abandoned = true;
 
-	return (ssize_t) scan_result.size;
+	if (!ret)
+		ret = iio_scan_state_collect(state, info);
+
+	iio_mutex_unlock(state->lock);
+
+	iio_scan_state_put(state);
+
+	return ret;
+}
+
+ssize_t iio_scan_context_get_info_list(struct iio_scan_context *ctx,
+		struct iio_context_info ***info)
+{
+	return iio_scan_context_get_info_list_timeout(ctx, 0, NULL, NULL, info);
 }
 
 void iio_context_info_list_free(struct iio_context_info **list)
@@ -143,6 +351,36 @@ void iio_scan_context_destroy(struct iio_scan_context *ctx)
 	free(ctx);
 }
 
+struct iio_discovery * iio_create_discovery(unsigned int interval_ms,
+		unsigned int ttl_ms,
+		void (*cb)(enum iio_discovery_event event,
+			   const struct iio_context_info *info, void *d),
+		void *d)
+{
+	if (!HAVE_DNS_SD) {
+		errno = ENOSYS;
+		return NULL;
+	}
+
+	return dnssd_create_discovery(interval_ms, ttl_ms, cb, d);
+}
+
+void iio_discovery_destroy(struct iio_discovery *disc)
+{
+	/* A session can only exist with DNS-SD support */
+	if (HAVE_DNS_SD)
+		dnssd_discovery_destroy(disc);
+}
+
+ssize_t iio_discovery_get_info_list(struct iio_discovery *disc,
+		struct iio_context_info ***info)
+{
+	if (!HAVE_DNS_SD)
+		return -ENOSYS;
+
+	return dnssd_discovery_get_info_list(disc, info);
+}
+
 struct iio_scan_block {
 	struct iio_scan_context *ctx;
 	struct iio_context_info **info;
@@ -20,11 +20,18 @@
 
 #define DEFAULT_TIMEOUT_MS 1000
 
+/* Size of the read buffer; bigger reads go straight to the caller */
+#define SERIAL_RBUF_SIZE 4096
+
 struct iio_context_pdata {
 	struct sp_port *port;
 	struct iiod_client *iiod_client;
 
 	unsigned int timeout_ms;
+
+	/* Bytes received but not consumed yet are in [rbuf_start, rbuf_end) */
+	char rbuf[SERIAL_RBUF_SIZE];
+	size_t rbuf_start, rbuf_end;
 };
 
 struct iio_device_pdata {
@@ -244,6 +251,14 @@ static ssize_t serial_write_chn_attr(const struct iio_channel *chn,
 			dev, chn, attr, src, len, false);
 }
 
+static int serial_set_attr_cache(struct iio_context *ctx,
+		const char *attr, int ttl_ms)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_set_attr_cache(pdata->iiod_client, attr, ttl_ms);
+}
+
 static int serial_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_blocks)
 {
@@ -254,6 +269,15 @@ static int serial_set_kernel_buffers_count(const struct iio_device *dev,
 			dev, nb_blocks);
 }
 
+static int serial_set_low_latency(const struct iio_device *dev, bool enable)
+{
+	const struct iio_context *ctx = iio_device_get_context(dev);
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_set_low_latency(pdata->iiod_client, NULL,
+			dev, enable);
+}
+
 static ssize_t serial_write_data(struct iio_context_pdata *pdata,
 				 struct iiod_client_pdata *io_data,
 				 const char *data, size_t len)
@@ -274,48 +298,86 @@ static ssize_t serial_write_data(struct iio_context_pdata *pdata,
 	return ret;
 }
 
-static ssize_t serial_read_data(struct iio_context_pdata *pdata,
-				struct iiod_client_pdata *io_data,
+/* Read whatever is available, waiting for at least one byte */
+static ssize_t serial_read_next(struct iio_context_pdata *pdata,
 				char *buf, size_t len)
 {
 	ssize_t ret = (ssize_t) libserialport_to_errno(sp_blocking_read_next(
 				pdata->port, buf, len, pdata->timeout_ms));
 
-	IIO_DEBUG("Read returned %li: %.*s\n", (long) ret, (int) ret, buf);
-
 	if (ret == 0) {
 		IIO_ERROR("sp_blocking_read_next has timedout\n");
 		return -ETIMEDOUT;
 	}
 
+	if (ret < 0) {
+		IIO_ERROR("sp_blocking_read_next returned %i\n", (int) ret);
+		return ret;
+	}
+
+	IIO_DEBUG("Read returned %li: %.*s\n", (long) ret, (int) ret, buf);
+
 	return ret;
 }
 
+static ssize_t serial_fill_rbuf(struct iio_context_pdata *pdata)
+{
+	ssize_t ret;
+
+	ret = serial_read_next(pdata, pdata->rbuf, sizeof(pdata->rbuf));
+	if (ret < 0)
+		return ret;
+
+	pdata->rbuf_start = 0;
+	pdata->rbuf_end = (size_t) ret;
+	return ret;
+}
+
+static ssize_t serial_read_data(struct iio_context_pdata *pdata,
+				struct iiod_client_pdata *io_data,
+				char *buf, size_t len)
+{
+	size_t avail = pdata->rbuf_end - pdata->rbuf_start;
+	ssize_t ret;
+
+	if (!avail) {
+		if (len >= sizeof(pdata->rbuf))
+			return serial_read_next(pdata, buf, len);
+
+		ret = serial_fill_rbuf(pdata);
+		if (ret < 0)
+			return ret;
+
+		avail = (size_t) ret;
+	}
+
+	if (len > avail)
+		len = avail;
+
+	memcpy(buf, &pdata->rbuf[pdata->rbuf_start], len);
+	pdata->rbuf_start += len;
+
+	return (ssize_t) len;
+}
+
 static ssize_t serial_read_line(struct iio_context_pdata *pdata,
 				struct iiod_client_pdata *io_data,
 				char *buf, size_t len)
 {
 	size_t i;
 	bool found = false;
-	int ret;
+	ssize_t ret;
 
 	IIO_DEBUG("Readline size 0x%lx\n", (unsigned long) len);
 
 	for (i = 0; i < len - 1; i++) {
-		ret = libserialport_to_errno(sp_blocking_read_next(
-					pdata->port, &buf[i], 1,
-					pdata->timeout_ms));
-		if (ret == 0) {
-			IIO_ERROR("sp_blocking_read_next has timedout\n");
-			return -ETIMEDOUT;
+		if (pdata->rbuf_start == pdata->rbuf_end) {
+			ret = serial_fill_rbuf(pdata);
+			if (ret < 0)
+				return ret;
 		}
 
-		if (ret < 0) {
-			IIO_ERROR("sp_blocking_read_next returned %i\n", ret);
-			return (ssize_t) ret;
-		}
-
-		IIO_DEBUG("Character: %c\n", buf[i]);
+		buf[i] = pdata->rbuf[pdata->rbuf_start++];
 
 		if (buf[i] != '\n')
 			found = true;
@@ -327,6 +389,8 @@ static ssize_t serial_read_line(struct iio_context_pdata *pdata,
 	if (!found || i == len - 1)
 		return -EIO;
 
+	IIO_DEBUG("Line: %.*s", (int) i + 1, buf);
+
 	return (ssize_t) i + 1;
 }
 
@@ -384,11 +448,13 @@ static const struct iio_backend_ops serial_ops = {
 	.read_channel_attr = serial_read_chn_attr,
 	.write_channel_attr = serial_write_chn_attr,
 	.set_kernel_buffers_count = serial_set_kernel_buffers_count,
+	.set_low_latency = serial_set_low_latency,
 	.shutdown = serial_shutdown,
 	.get_description = serial_get_description,
 	.set_timeout = serial_set_timeout,
 	.get_trigger = serial_get_trigger,
 	.set_trigger = serial_set_trigger,
+	.set_attr_cache = serial_set_attr_cache,
 };
 
 static const struct iiod_client_ops serial_iiod_client_ops = {
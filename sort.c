@@ -7,6 +7,10 @@
  */
 
 #include "iio-private.h"
+#include "sort.h"
+
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* These are a few functions to do sorting via qsort for various
@@ -81,3 +85,176 @@ int iio_buffer_attr_compare(const void *p1, const void *p2)
 	return strcmp(tmp1, tmp2);
 }
 
+
+/* Sorted indexes of the names of the devices, channels and attributes, so
+ * that the iio_*_find_*() functions can do binary searches. The entries with
+ * the same name are sorted by position, so that the lookups return the first
+ * object which matches, like a linear search would. */
+
+static int iio_index_entry_compare(const void *p1, const void *p2)
+{
+	const struct iio_index_entry *tmp1 = p1;
+	const struct iio_index_entry *tmp2 = p2;
+	int ret = strcmp(tmp1->name, tmp2->name);
+
+	if (ret)
+		return ret;
+	if (tmp1->pos == tmp2->pos)
+		return 0;
+	return tmp1->pos > tmp2->pos ? 1 : -1;
+}
+
+static int iio_index_alloc(struct iio_index *index, unsigned int nb)
+{
+	iio_index_free(index);
+
+	/* Allocate at least one entry, as a non-NULL array tells that the
+	 * index was built */
+	index->entries = malloc((nb ? nb : 1) * sizeof(*index->entries));
+	if (!index->entries)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void iio_index_add(struct iio_index *index,
+		const char *name, unsigned int pos)
+{
+	if (name) {
+		index->entries[index->nb].name = name;
+		index->entries[index->nb++].pos = pos;
+	}
+}
+
+static void iio_index_sort(struct iio_index *index)
+{
+	qsort(index->entries, index->nb, sizeof(*index->entries),
+	      iio_index_entry_compare);
+}
+
+void iio_index_free(struct iio_index *index)
+{
+	free(index->entries);
+	index->entries = NULL;
+	index->nb = 0;
+}
+
+int iio_index_find(const struct iio_index *index, const char *name)
+{
+	unsigned int low = 0, high = index->nb, mid;
+
+	if (!index->entries)
+		return -ENOSYS;
+
+	/* Lower bound, to get the first entry with this name */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+
+		if (strcmp(index->entries[mid].name, name) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == index->nb || strcmp(index->entries[low].name, name))
+		return -ENOENT;
+
+	return (int) index->entries[low].pos;
+}
+
+int iio_dev_attrs_build_index(struct iio_dev_attrs *attrs)
+{
+	unsigned int i;
+	int ret;
+
+	ret = iio_index_alloc(&attrs->index, attrs->num);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < attrs->num; i++)
+		iio_index_add(&attrs->index, attrs->names[i], i);
+
+	iio_index_sort(&attrs->index);
+	return 0;
+}
+
+static int iio_channel_build_index(struct iio_channel *chn)
+{
+	unsigned int i;
+	int ret;
+
+	ret = iio_index_alloc(&chn->attrs_index, chn->nb_attrs);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < chn->nb_attrs; i++)
+		iio_index_add(&chn->attrs_index, chn->attrs[i].name, i);
+
+	iio_index_sort(&chn->attrs_index);
+	return 0;
+}
+
+static int iio_device_build_index(struct iio_device *dev)
+{
+	unsigned int i;
+	int ret;
+
+	/* One index per direction, for iio_device_find_channel() */
+	for (i = 0; i < ARRAY_SIZE(dev->channels_index); i++) {
+		ret = iio_index_alloc(&dev->channels_index[i],
+				      2 * dev->nb_channels);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < dev->nb_channels; i++) {
+		struct iio_channel *chn = dev->channels[i];
+		struct iio_index *index = &dev->channels_index[chn->is_output];
+
+		iio_index_add(index, chn->id, i);
+		iio_index_add(index, chn->name, i);
+
+		ret = iio_channel_build_index(chn);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(dev->channels_index); i++)
+		iio_index_sort(&dev->channels_index[i]);
+
+	ret = iio_dev_attrs_build_index(&dev->attrs);
+	if (!ret)
+		ret = iio_dev_attrs_build_index(&dev->buffer_attrs);
+
+	/* The debug attributes may be loaded later on, in which case the
+	 * backend builds their index */
+	if (!ret && dev->debug_attrs.num)
+		ret = iio_dev_attrs_build_index(&dev->debug_attrs);
+
+	return ret;
+}
+
+int iio_context_build_indexes(struct iio_context *ctx)
+{
+	unsigned int i;
+	int ret;
+
+	ret = iio_index_alloc(&ctx->devices_index, 3 * ctx->nb_devices);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		struct iio_device *dev = ctx->devices[i];
+
+		iio_index_add(&ctx->devices_index, dev->id, i);
+		iio_index_add(&ctx->devices_index, dev->label, i);
+		iio_index_add(&ctx->devices_index, dev->name, i);
+
+		ret = iio_device_build_index(dev);
+		if (ret)
+			return ret;
+	}
+
+	iio_index_sort(&ctx->devices_index);
+	return 0;
+}
@@ -9,10 +9,22 @@
 #ifndef __IIO_QSORT_H__
 #define __IIO_QSORT_H__
 
+struct iio_context;
+struct iio_dev_attrs;
+struct iio_index;
+
 int iio_channel_compare(const void *p1, const void *p2);
 int iio_channel_attr_compare(const void *p1, const void *p2);
 int iio_device_compare(const void *p1, const void *p2);
 int iio_device_attr_compare(const void *p1, const void *p2);
 int iio_buffer_attr_compare(const void *p1, const void *p2);
 
+int iio_context_build_indexes(struct iio_context *ctx);
+int iio_dev_attrs_build_index(struct iio_dev_attrs *attrs);
+
+/* Returns the position of the first object with that name, -ENOENT if there
+ * is none, or -ENOSYS if the index was not built */
+int iio_index_find(const struct iio_index *index, const char *name);
+void iio_index_free(struct iio_index *index);
+
 #endif /* __IIO_QSORT_H__ */
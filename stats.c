@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/*
+ * Performance counters of the contexts. They are updated with relaxed
+ * atomic operations from the wrappers of the backend operations, so that
+ * concurrent threads can share a context without a lock.
+ */
+
+static const char * const iio_stats_op_names[] = {
+	[IIO_STATS_OPEN] = "open",
+	[IIO_STATS_CLOSE] = "close",
+	[IIO_STATS_READ] = "read",
+	[IIO_STATS_WRITE] = "write",
+	[IIO_STATS_GET_BUFFER] = "get_buffer",
+	[IIO_STATS_REFILL] = "refill",
+	[IIO_STATS_PUSH] = "push",
+	[IIO_STATS_ATTR_READ] = "attr_read",
+	[IIO_STATS_ATTR_WRITE] = "attr_write",
+	[IIO_STATS_CLIENT_WRITE] = "client_write",
+	[IIO_STATS_CLIENT_READ] = "client_read",
+	[IIO_STATS_CLIENT_LOCK] = "client_lock",
+};
+
+#if WITH_PERF_COUNTERS
+#ifdef _WIN32
+static inline void add_u64(uint64_t *ptr, uint64_t val)
+{
+	InterlockedExchangeAdd64((volatile LONG64 *) ptr, (LONG64) val);
+}
+
+static inline uint64_t load_u64(const uint64_t *ptr)
+{
+	return (uint64_t) InterlockedCompareExchange64(
+			(volatile LONG64 *) ptr, 0, 0);
+}
+
+static inline void store_u64(uint64_t *ptr, uint64_t val)
+{
+	InterlockedExchange64((volatile LONG64 *) ptr, (LONG64) val);
+}
+
+static inline void max_u64(uint64_t *ptr, uint64_t val)
+{
+	LONG64 old = (LONG64) load_u64(ptr);
+
+	while ((uint64_t) old < val) {
+		LONG64 prev = InterlockedCompareExchange64(
+				(volatile LONG64 *) ptr, (LONG64) val, old);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+#else
+static inline void add_u64(uint64_t *ptr, uint64_t val)
+{
+	__atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load_u64(const uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+static inline void store_u64(uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline void max_u64(uint64_t *ptr, uint64_t val)
+{
+	uint64_t old = load_u64(ptr);
+
+	while (old < val && !__atomic_compare_exchange_n(ptr, &old, val, true,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+#endif
+
+void iio_stats_record(const struct iio_op_stats *stats, enum iio_stats_op op,
+		uint64_t start, ssize_t ret)
+{
+	struct iio_op_stats *op_stats;
+	uint64_t elapsed;
+
+	/* The connections to IIOD are used before the context exists */
+	if (!stats)
+		return;
+
+	/* The counters are updated even through a const context */
+	op_stats = (struct iio_op_stats *) &stats[op];
+	elapsed = iio_time_ns() - start;
+
+	add_u64(&op_stats->nb_calls, 1);
+	add_u64(&op_stats->total_ns, elapsed);
+	max_u64(&op_stats->max_ns, elapsed);
+
+	if (ret < 0)
+		add_u64(&op_stats->nb_errors, 1);
+	else
+		add_u64(&op_stats->bytes, (uint64_t) ret);
+}
+#endif /* WITH_PERF_COUNTERS */
+
+int iio_context_get_stats(const struct iio_context *ctx,
+		enum iio_stats_op op, struct iio_op_stats *stats)
+{
+#if WITH_PERF_COUNTERS
+	const struct iio_op_stats *op_stats;
+
+	if ((unsigned int) op >= IIO_STATS_NB_OPS)
+		return -EINVAL;
+
+	op_stats = &ctx->stats[op];
+
+	stats->nb_calls = load_u64(&op_stats->nb_calls);
+	stats->nb_errors = load_u64(&op_stats->nb_errors);
+	stats->bytes = load_u64(&op_stats->bytes);
+	stats->total_ns = load_u64(&op_stats->total_ns);
+	stats->max_ns = load_u64(&op_stats->max_ns);
+
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
+void iio_context_reset_stats(struct iio_context *ctx)
+{
+#if WITH_PERF_COUNTERS
+	struct iio_op_stats *op_stats;
+	unsigned int i;
+
+	for (i = 0; i < IIO_STATS_NB_OPS; i++) {
+		op_stats = &ctx->stats[i];
+
+		store_u64(&op_stats->nb_calls, 0);
+		store_u64(&op_stats->nb_errors, 0);
+		store_u64(&op_stats->bytes, 0);
+		store_u64(&op_stats->total_ns, 0);
+		store_u64(&op_stats->max_ns, 0);
+	}
+#endif
+}
+
+const char * iio_stats_op_get_name(enum iio_stats_op op)
+{
+	if ((unsigned int) op >= IIO_STATS_NB_OPS)
+		return NULL;
+
+	return iio_stats_op_names[op];
+}
@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <sched.h>
+#endif
+
+#include "debug.h"
+#include "iio-config.h"
+#include "iio-lock.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+/* Interval at which the capture thread checks whether it must stop, when it
+ * can wait for the samples by itself, see stream_wait() */
+#define STREAM_POLL_MS 100
+
+#ifdef _MSC_VER
+#include <windows.h>
+
+/* On x86, volatile accesses have acquire/release semantics with MSVC */
+static inline unsigned int load_acquire(const unsigned int *ptr)
+{
+	return *(const volatile unsigned int *) ptr;
+}
+
+static inline void store_release(unsigned int *ptr, unsigned int val)
+{
+	*(volatile unsigned int *) ptr = val;
+}
+
+static inline void full_barrier(void)
+{
+	MemoryBarrier();
+}
+
+static inline void add_u64(uint64_t *ptr, uint64_t val)
+{
+	InterlockedExchangeAdd64((volatile LONG64 *) ptr, (LONG64) val);
+}
+
+static inline uint64_t load_u64(const uint64_t *ptr)
+{
+	return (uint64_t) InterlockedCompareExchange64(
+			(volatile LONG64 *) ptr, 0, 0);
+}
+#else
+static inline unsigned int load_acquire(const unsigned int *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned int *ptr, unsigned int val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline void full_barrier(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void add_u64(uint64_t *ptr, uint64_t val)
+{
+	__atomic_fetch_add(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t load_u64(const uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+#endif
+
+struct iio_stream_slot {
+	void *data;
+	size_t len;
+	struct iio_block *block;
+
+	/* Hardware timestamp of the block, if has_timestamp is set */
+	uint64_t timestamp;
+	bool has_timestamp;
+};
+
+struct iio_stream {
+	struct iio_buffer *buf;
+	struct iio_thrd *thrd;
+	struct iio_mutex *lock;
+	struct iio_cond *cond;
+
+	struct iio_stream_slot *slots;
+	unsigned int nb_slots;
+	void *mem, *spare;
+	uint32_t *mask;
+	bool use_blocks;
+	int cpu;
+
+	/* File descriptor that becomes readable once samples are available,
+	 * or -1 if the capture can only be interrupted by cancelling the
+	 * buffer */
+	int poll_fd;
+
+	/*
+	 * Single-producer, single-consumer ring. The indexes are free-running
+	 * counters, and nb_slots is a power of two, so that they can wrap.
+	 * 'head' is only written by the capture thread; 'next' (the next slot
+	 * to acquire) and 'tail' (the next slot to release) only by the
+	 * consumer.
+	 */
+	unsigned int head, next, tail;
+
+	/* Set when the consumer sleeps, waiting for the capture thread */
+	unsigned int waiting;
+	unsigned int stop;
+	int err;
+
+	uint64_t nb_blocks, nb_overruns;
+	unsigned int max_lag;
+};
+
+static void stream_set_affinity(int cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	char err_str[1024];
+	int ret;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	ret = sched_setaffinity(0, sizeof(set), &set);
+	if (ret) {
+		iio_strerror(errno, err_str, sizeof(err_str));
+		IIO_WARNING("Unable to pin capture thread to CPU %i: %s\n",
+			    cpu, err_str);
+	}
+#else
+	IIO_WARNING("CPU affinity is not supported on this platform\n");
+#endif
+}
+
+static void stream_wake_consumer(struct iio_stream *stream)
+{
+	full_barrier();
+
+	if (load_acquire(&stream->waiting)) {
+		iio_mutex_lock(stream->lock);
+		iio_cond_signal(stream->cond);
+		iio_mutex_unlock(stream->lock);
+	}
+}
+
+/* Returns true if the ring had no free slot, in which case the data
+ * just captured has to be dropped */
+static bool stream_is_full(struct iio_stream *stream)
+{
+	return stream->head - load_acquire(&stream->tail) == stream->nb_slots;
+}
+
+static ssize_t stream_capture_block(struct iio_stream *stream,
+		struct iio_stream_slot *slot)
+{
+	struct iio_block *block;
+	int ret;
+
+	block = iio_buffer_dequeue_block(stream->buf);
+	if (!block)
+		return -errno;
+
+	if (stream_is_full(stream)) {
+		ret = iio_block_enqueue(block, 0);
+		return ret < 0 ? (ssize_t) ret : -ENOSPC;
+	}
+
+	slot->block = block;
+	slot->data = iio_block_start(block);
+	slot->len = (uintptr_t) iio_block_end(block) -
+		(uintptr_t) iio_block_start(block);
+	slot->timestamp = iio_block_get_timestamp(block);
+	slot->has_timestamp = true;
+	return (ssize_t) slot->len;
+}
+
+static ssize_t stream_capture_read(struct iio_stream *stream,
+		struct iio_stream_slot *slot)
+{
+	const struct iio_device *dev = stream->buf->dev;
+	bool full = stream_is_full(stream);
+	ssize_t ret;
+
+	ret = iio_device_read_raw(dev, full ? stream->spare : slot->data,
+			stream->buf->length, stream->mask, dev->words);
+	if (ret < 0)
+		return ret;
+
+	if (full)
+		return -ENOSPC;
+
+	slot->len = (size_t) ret;
+	slot->has_timestamp = !iio_buffer_get_timestamp(stream->buf,
+							&slot->timestamp);
+	return ret;
+}
+
+/* Wait for samples, for STREAM_POLL_MS at most, so that the stop flag is
+ * checked regularly. Returns -ETIMEDOUT if the capture must not start yet. */
+static int stream_wait(struct iio_stream *stream)
+{
+#ifndef _WIN32
+	struct pollfd pfd = {
+		.fd = stream->poll_fd,
+		.events = POLLIN,
+	};
+	int ret;
+
+	ret = poll(&pfd, 1, STREAM_POLL_MS);
+	if (ret < 0)
+		return errno == EINTR ? -ETIMEDOUT : -errno;
+
+	return ret ? 0 : -ETIMEDOUT;
+#else
+	return 0;
+#endif
+}
+
+static int stream_thread(void *d)
+{
+	struct iio_stream *stream = d;
+	struct iio_stream_slot *slot;
+	unsigned int lag;
+	ssize_t ret = 0;
+
+	if (stream->cpu >= 0)
+		stream_set_affinity(stream->cpu);
+
+	while (!load_acquire(&stream->stop)) {
+		slot = &stream->slots[stream->head & (stream->nb_slots - 1)];
+
+		if (stream->poll_fd >= 0) {
+			ret = stream_wait(stream);
+			if (ret == -ETIMEDOUT)
+				continue;
+			if (ret < 0)
+				break;
+		}
+
+		if (stream->use_blocks)
+			ret = stream_capture_block(stream, slot);
+		else
+			ret = stream_capture_read(stream, slot);
+
+		if (ret == -ENOSPC) {
+			/* The consumer is lagging behind: drop the data, but
+			 * keep the hardware busy */
+			add_u64(&stream->nb_overruns, 1);
+			continue;
+		}
+		if (ret == -ETIMEDOUT || ret == -EAGAIN)
+			continue;
+		if (ret < 0)
+			break;
+
+		store_release(&stream->head, stream->head + 1);
+		stream_wake_consumer(stream);
+
+		add_u64(&stream->nb_blocks, 1);
+		lag = stream->head - load_acquire(&stream->tail);
+		if (lag > load_acquire(&stream->max_lag))
+			store_release(&stream->max_lag, lag);
+	}
+
+	if (ret < 0 && !load_acquire(&stream->stop)) {
+		char err_str[1024];
+
+		iio_strerror((int) -ret, err_str, sizeof(err_str));
+		IIO_ERROR("Capture thread stopped: %s\n", err_str);
+	}
+
+	stream->err = ret < 0 ? (int) ret : -EBADF;
+	store_release(&stream->stop, 1);
+	stream_wake_consumer(stream);
+
+	return (int) ret;
+}
+
+struct iio_stream * iio_buffer_create_stream(struct iio_buffer *buf,
+		unsigned int nb_slots, int cpu)
+{
+	const struct iio_device *dev = buf->dev;
+	const struct iio_backend_ops *ops = dev->ctx->ops;
+	struct iio_stream *stream;
+	unsigned int i, nb = 1;
+	int err;
+
+	if (iio_device_is_tx(dev) || !nb_slots) {
+		err = -EINVAL;
+		goto err_set_errno;
+	}
+
+	/* Round up to a power of two, so that the ring indexes can wrap */
+	while (nb < nb_slots)
+		nb <<= 1;
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream) {
+		err = -ENOMEM;
+		goto err_set_errno;
+	}
+
+	stream->buf = buf;
+	stream->nb_slots = nb;
+	stream->cpu = cpu;
+	stream->use_blocks = buf->dev_is_high_speed &&
+		ops->dequeue_block && ops->enqueue_block;
+
+	/* Backends that must request the samples first cannot be polled
+	 * before the capture starts */
+	stream->poll_fd = -1;
+#ifndef _WIN32
+	if (!ops->request_read) {
+		int fd = iio_buffer_get_poll_fd(buf);
+
+		if (fd >= 0)
+			stream->poll_fd = fd;
+	}
+#endif
+
+	stream->slots = calloc(nb, sizeof(*stream->slots));
+	if (!stream->slots) {
+		err = -ENOMEM;
+		goto err_free_stream;
+	}
+
+	if (!stream->use_blocks) {
+		/* One extra area receives the samples dropped on overrun */
+		stream->mem = malloc((nb + 1) * buf->length);
+		stream->mask = malloc(dev->words * sizeof(*stream->mask));
+		if (!stream->mem || !stream->mask) {
+			err = -ENOMEM;
+			goto err_free_mem;
+		}
+
+		for (i = 0; i < nb; i++)
+			stream->slots[i].data = (void *) ((uintptr_t) stream->mem
+					+ i * buf->length);
+		stream->spare = (void *) ((uintptr_t) stream->mem
+				+ nb * buf->length);
+	}
+
+	stream->lock = iio_mutex_create();
+	if (!stream->lock) {
+		err = -ENOMEM;
+		goto err_free_mem;
+	}
+
+	stream->cond = iio_cond_create();
+	if (!stream->cond) {
+		err = -ENOMEM;
+		goto err_free_lock;
+	}
+
+	stream->thrd = iio_thrd_create(stream_thread, stream);
+	if (!stream->thrd) {
+		err = -errno;
+		goto err_free_cond;
+	}
+
+	return stream;
+
+err_free_cond:
+	iio_cond_destroy(stream->cond);
+err_free_lock:
+	iio_mutex_destroy(stream->lock);
+err_free_mem:
+	free(stream->mask);
+	free(stream->mem);
+	free(stream->slots);
+err_free_stream:
+	free(stream);
+err_set_errno:
+	errno = -err;
+	return NULL;
+}
+
+void iio_stream_destroy(struct iio_stream *stream)
+{
+	store_release(&stream->stop, 1);
+
+	/* A capture thread waiting in stream_wait() notices the stop flag by
+	 * itself; otherwise, it has to be woken up by cancelling the buffer */
+	if (stream->poll_fd < 0)
+		iio_buffer_cancel(stream->buf);
+	iio_thrd_join_and_destroy(stream->thrd);
+
+	iio_cond_destroy(stream->cond);
+	iio_mutex_destroy(stream->lock);
+	free(stream->mask);
+	free(stream->mem);
+	free(stream->slots);
+	free(stream);
+}
+
+const void * iio_stream_acquire(struct iio_stream *stream, size_t *len,
+		unsigned int timeout_ms)
+{
+	struct iio_stream_slot *slot;
+	int ret = 0;
+
+	if (stream->next == load_acquire(&stream->head)) {
+		iio_mutex_lock(stream->lock);
+		store_release(&stream->waiting, 1);
+		full_barrier();
+
+		while (!ret && stream->next == load_acquire(&stream->head)
+				&& !load_acquire(&stream->stop))
+			ret = iio_cond_wait(stream->cond, stream->lock,
+					    timeout_ms);
+
+		store_release(&stream->waiting, 0);
+		iio_mutex_unlock(stream->lock);
+
+		/* Blocks captured before an error are still handed out */
+		if (stream->next == load_acquire(&stream->head)) {
+			errno = ret ? -ret : -stream->err;
+			return NULL;
+		}
+	}
+
+	slot = &stream->slots[stream->next & (stream->nb_slots - 1)];
+	stream->next++;
+
+	if (len)
+		*len = slot->len;
+	return slot->data;
+}
+
+int iio_stream_release(struct iio_stream *stream)
+{
+	struct iio_stream_slot *slot;
+	int ret;
+
+	if (stream->tail == stream->next)
+		return -EINVAL;
+
+	slot = &stream->slots[stream->tail & (stream->nb_slots - 1)];
+	if (stream->use_blocks) {
+		ret = iio_block_enqueue(slot->block, 0);
+		if (ret < 0)
+			return ret;
+	}
+
+	store_release(&stream->tail, stream->tail + 1);
+	return 0;
+}
+
+int iio_stream_get_timestamp(const struct iio_stream *stream,
+		uint64_t *timestamp)
+{
+	const struct iio_stream_slot *slot;
+
+	if (stream->tail == stream->next)
+		return -EINVAL;
+
+	slot = &stream->slots[(stream->next - 1) & (stream->nb_slots - 1)];
+	if (!slot->has_timestamp)
+		return -ENOSYS;
+
+	*timestamp = slot->timestamp;
+	return 0;
+}
+
+void iio_stream_get_stats(const struct iio_stream *stream,
+		struct iio_stream_stats *stats)
+{
+	stats->nb_blocks = load_u64(&stream->nb_blocks);
+	stats->nb_overruns = load_u64(&stream->nb_overruns);
+	stats->lag = load_acquire(&stream->head) - load_acquire(&stream->tail);
+	stats->max_lag = load_acquire(&stream->max_lag);
+}
@@ -0,0 +1,736 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * libiio - Library for interfacing industrial I/O (IIO) devices
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include "debug.h"
+#include "iio-lock.h"
+#include "iio-private.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Synthetic devices, described by an XML file, which generate samples at a
+ * configurable rate. The URI is "synthetic:<xml file>[,<pattern>[,<rate>]]",
+ * where the pattern is one of:
+ * - "ramp": each channel counts up, wrapping at its number of bits;
+ * - "tone": a sine wave at half of the full scale, with a period of
+ *   SYNTHETIC_TONE_PERIOD samples; each channel is a quarter of a period
+ *   ahead of the previous one, so that I/Q pairs form a complex tone;
+ * - "noise": uniformly distributed pseudo-random values;
+ * - "loopback": the samples last pushed to an output device of the context
+ *   are replayed, byte by byte, on the input devices.
+ *
+ * The rate is in samples per second for each device; zero, the default,
+ * generates samples as fast as they are consumed.
+ *
+ * All the devices are high-speed devices. For the first three patterns, one
+ * table of samples is generated when the device is opened, in the layout of
+ * its buffer; the refills then only copy from the table, so that the
+ * consumers (e.g. IIOD and its clients) can be benchmarked at memory speed.
+ * Output devices consume the samples pushed at the same rate, and accept
+ * cyclic buffers.
+ */
+
+/* The ramp of a 16-bit channel fits in the table without discontinuity */
+#define SYNTHETIC_TABLE_SAMPLES	65536
+#define SYNTHETIC_TONE_PERIOD	1024
+
+enum synthetic_pattern {
+	SYNTHETIC_RAMP,
+	SYNTHETIC_TONE,
+	SYNTHETIC_NOISE,
+	SYNTHETIC_LOOPBACK,
+};
+
+static const char * const synthetic_patterns[] = {
+	[SYNTHETIC_RAMP] = "ramp",
+	[SYNTHETIC_TONE] = "tone",
+	[SYNTHETIC_NOISE] = "noise",
+	[SYNTHETIC_LOOPBACK] = "loopback",
+};
+
+struct iio_context_pdata {
+	char *args;
+	enum synthetic_pattern pattern;
+	uint64_t rate;
+
+	/* Protects the loopback samples and the waits of the devices */
+	struct iio_mutex *lock;
+	uint8_t *loop_data;
+	size_t loop_len;
+};
+
+struct iio_device_pdata {
+	struct iio_cond *cond;
+
+	/* Samples handed out by the refills, or filled in before a push */
+	uint8_t *block;
+	size_t block_len, sample_size;
+	bool has_block;
+
+	/* Generated samples, and the position of the next refill in them */
+	uint8_t *table;
+	size_t table_len, pos;
+
+	/* Samples produced or consumed since the device was opened */
+	uint64_t nb_samples;
+	uint64_t start_ms;
+
+	bool opened, cancelled, cyclic;
+};
+
+static const struct iio_backend_ops synthetic_ops;
+
+static double synthetic_sin_cos(double x, bool cosine)
+{
+	double term = cosine ? 1.0 : x, sum = 0.0;
+	unsigned int n;
+
+	/* Taylor series; only used for a small angle */
+	for (n = cosine ? 0 : 1; n < 20; n += 2) {
+		sum += term;
+		term *= -x * x / ((n + 1) * (n + 2));
+	}
+
+	return sum;
+}
+
+static uint64_t synthetic_value(enum synthetic_pattern pattern,
+		const struct iio_data_format *fmt, size_t idx, unsigned int phase,
+		const double *sine, uint64_t *rng)
+{
+	unsigned int bits = fmt->bits ? fmt->bits : fmt->length;
+	double amplitude, val;
+
+	switch (pattern) {
+	case SYNTHETIC_TONE:
+		amplitude = (double) (1ull << (bits - 1)) / 2.0;
+		val = amplitude * sine[(idx + phase * SYNTHETIC_TONE_PERIOD / 4)
+				       % SYNTHETIC_TONE_PERIOD];
+
+		if (fmt->is_signed)
+			return (uint64_t) (int64_t) (val < 0 ? val - 0.5 : val + 0.5);
+
+		return (uint64_t) (val + 2.0 * amplitude + 0.5);
+	case SYNTHETIC_NOISE:
+		/* xorshift64* */
+		*rng ^= *rng >> 12;
+		*rng ^= *rng << 25;
+		*rng ^= *rng >> 27;
+		return (*rng * 0x2545f4914f6cdd1dull) >> (64 - bits);
+	default:
+		return (uint64_t) idx;
+	}
+}
+
+static uint64_t synthetic_mask(const struct iio_data_format *fmt,
+		uint64_t val)
+{
+	unsigned int bits = fmt->bits ? fmt->bits : fmt->length;
+
+	return bits < 64 ? val & ((1ull << bits) - 1) : val;
+}
+
+/* Generates the table of samples, in the layout of the buffer */
+static int synthetic_gen_table(const struct iio_device *dev,
+		enum synthetic_pattern pattern)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+	const struct iio_channel *chn, *prev = NULL;
+	double sine[SYNTHETIC_TONE_PERIOD], c, s, x, y, tmp;
+	size_t i, offset, size = 0, nb, length, nb_values;
+	uint64_t val, rng = 0x9e3779b97f4a7c15ull;
+	unsigned int j, phase = 0;
+	uint8_t *values;
+
+	/* One period of the sine, by rotating a phasor */
+	c = synthetic_sin_cos(2.0 * 3.14159265358979323846 /
+			      SYNTHETIC_TONE_PERIOD, true);
+	s = synthetic_sin_cos(2.0 * 3.14159265358979323846 /
+			      SYNTHETIC_TONE_PERIOD, false);
+
+	for (i = 0, x = 1.0, y = 0.0; i < SYNTHETIC_TONE_PERIOD; i++) {
+		sine[i] = y;
+		tmp = x * c - y * s;
+		y = x * s + y * c;
+		x = tmp;
+	}
+
+	pdata->table_len = pdata->sample_size * SYNTHETIC_TABLE_SAMPLES;
+	pdata->table = calloc(SYNTHETIC_TABLE_SAMPLES, pdata->sample_size);
+	if (!pdata->table)
+		return -ENOMEM;
+
+	for (j = 0; j < dev->nb_channels; j++) {
+		chn = dev->channels[j];
+		length = chn->format.length / 8 * chn->format.repeat;
+
+		if (chn->index < 0)
+			break;
+		if (!TEST_BIT(dev->mask, chn->number))
+			continue;
+		if (prev && chn->index == prev->index) {
+			prev = chn;
+			continue;
+		}
+
+		/* Same layout as iio_device_get_sample_size_mask() */
+		offset = size % length ? size + length - size % length : size;
+		size = offset + length;
+		prev = chn;
+
+		nb = chn->format.length / 8;
+		if (!nb || nb > sizeof(uint64_t))
+			continue;
+
+		nb_values = (size_t) SYNTHETIC_TABLE_SAMPLES * chn->format.repeat;
+		values = malloc(nb_values * nb);
+		if (!values)
+			return -ENOMEM;
+
+		for (i = 0; i < nb_values; i++) {
+			val = synthetic_value(pattern, &chn->format,
+					      i / chn->format.repeat, phase,
+					      sine, &rng);
+			val = synthetic_mask(&chn->format, val);
+
+			switch (nb) {
+			case 1:
+				values[i] = (uint8_t) val;
+				break;
+			case 2:
+				((uint16_t *) values)[i] = (uint16_t) val;
+				break;
+			case 4:
+				((uint32_t *) values)[i] = (uint32_t) val;
+				break;
+			default:
+				((uint64_t *) values)[i] = val;
+				break;
+			}
+		}
+
+		iio_channel_convert_inverse_strided(chn,
+				pdata->table + offset, values,
+				(ptrdiff_t) pdata->sample_size,
+				SYNTHETIC_TABLE_SAMPLES);
+		free(values);
+		phase++;
+	}
+
+	return 0;
+}
+
+/* Copies the given samples cyclically, from the given position */
+static void synthetic_copy_cyclic(uint8_t *dst, size_t len,
+		const uint8_t *src, size_t src_len, size_t *pos)
+{
+	size_t nb;
+
+	while (len) {
+		nb = src_len - *pos;
+		if (nb > len)
+			nb = len;
+
+		memcpy(dst, src + *pos, nb);
+		dst += nb;
+		len -= nb;
+
+		*pos += nb;
+		if (*pos == src_len)
+			*pos = 0;
+	}
+}
+
+static int synthetic_open(const struct iio_device *dev,
+		size_t samples_count, bool cyclic)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	ssize_t sample_size;
+	int ret;
+
+	if (pdata->opened)
+		return -EBUSY;
+	if (cyclic && !iio_device_is_tx(dev))
+		return -EINVAL;
+
+	sample_size = iio_device_get_sample_size_mask(dev, dev->mask,
+						      dev->words);
+	if (sample_size <= 0)
+		return sample_size ? (int) sample_size : -EINVAL;
+
+	pdata->sample_size = (size_t) sample_size;
+	pdata->block_len = pdata->sample_size * samples_count;
+	pdata->block = malloc(pdata->block_len ? pdata->block_len : 1);
+	if (!pdata->block)
+		return -ENOMEM;
+
+	if (!iio_device_is_tx(dev) && ctx_pdata->pattern != SYNTHETIC_LOOPBACK) {
+		ret = synthetic_gen_table(dev, ctx_pdata->pattern);
+		if (ret)
+			goto err_free_buffers;
+	}
+
+	pdata->pos = 0;
+	pdata->nb_samples = 0;
+	pdata->start_ms = iio_time_ms();
+	pdata->has_block = false;
+	pdata->cyclic = cyclic;
+	pdata->cancelled = false;
+	pdata->opened = true;
+	return 0;
+
+err_free_buffers:
+	free(pdata->table);
+	pdata->table = NULL;
+	free(pdata->block);
+	pdata->block = NULL;
+	return ret;
+}
+
+static int synthetic_close(const struct iio_device *dev)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (!pdata->opened)
+		return -EBADF;
+
+	free(pdata->table);
+	pdata->table = NULL;
+	free(pdata->block);
+	pdata->block = NULL;
+
+	pdata->opened = false;
+	return 0;
+}
+
+/* Waits until the given number of samples would have been transferred at
+ * the configured rate */
+static int synthetic_wait(const struct iio_device *dev, size_t nb,
+		bool blocking)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	uint64_t deadline, now;
+	int ret = 0;
+
+	if (!ctx_pdata->rate)
+		return 0;
+
+	deadline = pdata->start_ms +
+		(pdata->nb_samples + nb) * 1000 / ctx_pdata->rate;
+
+	iio_mutex_lock(ctx_pdata->lock);
+
+	while (!pdata->cancelled && (now = iio_time_ms()) < deadline) {
+		if (!blocking) {
+			ret = -EAGAIN;
+			break;
+		}
+
+		iio_cond_wait(pdata->cond, ctx_pdata->lock,
+			      (unsigned int) (deadline - now));
+	}
+
+	if (pdata->cancelled)
+		ret = -EBADF;
+
+	iio_mutex_unlock(ctx_pdata->lock);
+
+	return ret;
+}
+
+/* Produces the next samples of an input device into the given buffer;
+ * the length is rounded down to whole samples */
+static ssize_t synthetic_fill(const struct iio_device *dev,
+		uint8_t *dst, size_t len, bool blocking)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	len -= len % pdata->sample_size;
+	if (!len)
+		return -EINVAL;
+
+	ret = synthetic_wait(dev, len / pdata->sample_size, blocking);
+	if (ret)
+		return ret;
+
+	if (ctx_pdata->pattern != SYNTHETIC_LOOPBACK) {
+		synthetic_copy_cyclic(dst, len, pdata->table,
+				      pdata->table_len, &pdata->pos);
+	} else {
+		iio_mutex_lock(ctx_pdata->lock);
+
+		if (ctx_pdata->loop_len) {
+			pdata->pos %= ctx_pdata->loop_len;
+			synthetic_copy_cyclic(dst, len,
+					      ctx_pdata->loop_data,
+					      ctx_pdata->loop_len, &pdata->pos);
+		} else {
+			memset(dst, 0, len);
+		}
+
+		iio_mutex_unlock(ctx_pdata->lock);
+	}
+
+	pdata->nb_samples += len / pdata->sample_size;
+	return (ssize_t) len;
+}
+
+static ssize_t synthetic_refill(const struct iio_device *dev,
+		void **addr_ptr, size_t len, bool blocking)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (len > pdata->block_len)
+		len = pdata->block_len;
+
+	*addr_ptr = pdata->block;
+	return synthetic_fill(dev, pdata->block, len, blocking);
+}
+
+/* Low-speed interface of the input devices, used e.g. by iio_stream */
+static ssize_t synthetic_do_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words,
+		bool blocking)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	if (iio_device_is_tx(dev))
+		return -EINVAL;
+	if (!pdata->opened || pdata->cancelled)
+		return -EBADF;
+	if (words != dev->words)
+		return -EINVAL;
+
+	memcpy(mask, dev->mask, words * sizeof(*mask));
+
+	return synthetic_fill(dev, dst, len, blocking);
+}
+
+static ssize_t synthetic_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	return synthetic_do_read(dev, dst, len, mask, words, true);
+}
+
+static ssize_t synthetic_try_read(const struct iio_device *dev,
+		void *dst, size_t len, uint32_t *mask, size_t words)
+{
+	return synthetic_do_read(dev, dst, len, mask, words, false);
+}
+
+static ssize_t synthetic_push(const struct iio_device *dev,
+		void **addr_ptr, size_t len, bool blocking)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	uint8_t *data;
+	int ret;
+
+	/* The first call only hands out the block to fill */
+	if (!pdata->has_block) {
+		pdata->has_block = true;
+		*addr_ptr = pdata->block;
+		return (ssize_t) pdata->block_len;
+	}
+
+	if (len > pdata->block_len)
+		return -EINVAL;
+
+	/* A cyclic buffer is consumed once, and then plays forever */
+	if (!pdata->cyclic) {
+		ret = synthetic_wait(dev, len / pdata->sample_size, blocking);
+		if (ret)
+			return ret;
+	}
+
+	if (ctx_pdata->pattern == SYNTHETIC_LOOPBACK && len) {
+		iio_mutex_lock(ctx_pdata->lock);
+
+		data = realloc(ctx_pdata->loop_data, len);
+		if (data) {
+			memcpy(data, pdata->block, len);
+			ctx_pdata->loop_data = data;
+			ctx_pdata->loop_len = len;
+		}
+
+		iio_mutex_unlock(ctx_pdata->lock);
+
+		if (!data)
+			return -ENOMEM;
+	}
+
+	pdata->nb_samples += len / pdata->sample_size;
+	*addr_ptr = pdata->block;
+	return (ssize_t) len;
+}
+
+static ssize_t synthetic_do_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used, uint32_t *mask, size_t words,
+		bool blocking)
+{
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	/* All the devices are high-speed devices */
+	if (!addr_ptr)
+		return -EINVAL;
+
+	if (!pdata->opened || pdata->cancelled)
+		return -EBADF;
+	if (words != dev->words)
+		return -EINVAL;
+
+	if (iio_device_is_tx(dev))
+		return synthetic_push(dev, addr_ptr, bytes_used, blocking);
+
+	memcpy(mask, dev->mask, words * sizeof(*mask));
+
+	return synthetic_refill(dev, addr_ptr, bytes_used, blocking);
+}
+
+static ssize_t synthetic_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used,
+		uint32_t *mask, size_t words)
+{
+	return synthetic_do_get_buffer(dev, addr_ptr, bytes_used,
+				       mask, words, true);
+}
+
+static ssize_t synthetic_try_get_buffer(const struct iio_device *dev,
+		void **addr_ptr, size_t bytes_used,
+		uint32_t *mask, size_t words)
+{
+	return synthetic_do_get_buffer(dev, addr_ptr, bytes_used,
+				       mask, words, false);
+}
+
+static void synthetic_cancel(const struct iio_device *dev)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	iio_mutex_lock(ctx_pdata->lock);
+	pdata->cancelled = true;
+	iio_cond_signal(pdata->cond);
+	iio_mutex_unlock(ctx_pdata->lock);
+}
+
+static int synthetic_get_timestamp(const struct iio_device *dev,
+		uint64_t *timestamp)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+
+	/* Time of the samples according to the rate, when there is one */
+	if (ctx_pdata->rate)
+		*timestamp = pdata->start_ms * 1000000ull +
+			pdata->nb_samples * 1000000000ull / ctx_pdata->rate;
+	else
+		*timestamp = iio_time_ms() * 1000000ull;
+
+	return 0;
+}
+
+static void synthetic_free_pdata(struct iio_context_pdata *pdata)
+{
+	if (pdata->lock)
+		iio_mutex_destroy(pdata->lock);
+	free(pdata->loop_data);
+	free(pdata->args);
+}
+
+static void synthetic_shutdown(struct iio_context *ctx)
+{
+	struct iio_device_pdata *dev_pdata;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev_pdata = ctx->devices[i]->pdata;
+		if (!dev_pdata)
+			continue;
+
+		if (dev_pdata->cond)
+			iio_cond_destroy(dev_pdata->cond);
+		free(dev_pdata->table);
+		free(dev_pdata->block);
+		free(dev_pdata);
+		ctx->devices[i]->pdata = NULL;
+	}
+
+	synthetic_free_pdata(iio_context_get_pdata(ctx));
+}
+
+static struct iio_context * synthetic_clone(const struct iio_context *ctx)
+{
+	return synthetic_create_context(iio_context_get_pdata(ctx)->args);
+}
+
+static const struct iio_backend_ops synthetic_ops = {
+	.clone = synthetic_clone,
+	.open = synthetic_open,
+	.close = synthetic_close,
+	.read = synthetic_read,
+	.try_read = synthetic_try_read,
+	.get_buffer = synthetic_get_buffer,
+	.try_get_buffer = synthetic_try_get_buffer,
+	.cancel = synthetic_cancel,
+	.get_timestamp = synthetic_get_timestamp,
+	.shutdown = synthetic_shutdown,
+};
+
+/* Parses "<xml file>[,<pattern>[,<rate>]]"; the path is cut at the first
+ * comma */
+static int synthetic_parse_args(struct iio_context_pdata *pdata, char *path)
+{
+	char *pattern, *rate, *end;
+	unsigned long long val;
+	unsigned int i;
+
+	pattern = strchr(path, ',');
+	if (!pattern)
+		return 0;
+
+	*pattern++ = '\0';
+
+	rate = strchr(pattern, ',');
+	if (rate)
+		*rate++ = '\0';
+
+	for (i = 0; i < ARRAY_SIZE(synthetic_patterns); i++)
+		if (!strcmp(pattern, synthetic_patterns[i]))
+			break;
+
+	if (i == ARRAY_SIZE(synthetic_patterns)) {
+		IIO_ERROR("Unknown synthetic pattern '%s'\n", pattern);
+		return -EINVAL;
+	}
+
+	pdata->pattern = (enum synthetic_pattern) i;
+
+	if (rate) {
+		errno = 0;
+		val = strtoull(rate, &end, 10);
+		if (end == rate || *end || errno == ERANGE) {
+			IIO_ERROR("Invalid synthetic rate '%s'\n", rate);
+			return -EINVAL;
+		}
+
+		pdata->rate = (uint64_t) val;
+	}
+
+	return 0;
+}
+
+struct iio_context * synthetic_create_context(const char *args)
+{
+	struct iio_context_pdata *pdata;
+	struct iio_device_pdata *dev_pdata;
+	struct iio_context *ctx;
+	char rate[32], *path, *uri;
+	size_t uri_len;
+	unsigned int i;
+	int ret;
+
+	pdata = zalloc(sizeof(*pdata));
+	if (!pdata) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* The path is cut out of a copy of the arguments; the original is
+	 * kept for clone() */
+	pdata->args = iio_strdup(args);
+	path = iio_strdup(args);
+	if (!pdata->args || !path) {
+		ret = -ENOMEM;
+		goto err_free_path;
+	}
+
+	ret = synthetic_parse_args(pdata, path);
+	if (ret)
+		goto err_free_path;
+
+	pdata->lock = iio_mutex_create();
+	if (!pdata->lock) {
+		ret = -ENOMEM;
+		goto err_free_path;
+	}
+
+	ctx = xml_create_context(path);
+	if (!ctx) {
+		ret = -errno;
+		goto err_free_path;
+	}
+
+	free(path);
+
+	/* Override the name and low-level functions of the XML context
+	 * with those corresponding to the synthetic context */
+	ctx->name = "synthetic";
+	ctx->ops = &synthetic_ops;
+	ctx->pdata = pdata;
+
+	for (i = 0; i < ctx->nb_devices; i++) {
+		dev_pdata = zalloc(sizeof(*dev_pdata));
+		if (!dev_pdata) {
+			ret = -ENOMEM;
+			goto err_context_destroy;
+		}
+
+		ctx->devices[i]->pdata = dev_pdata;
+
+		dev_pdata->cond = iio_cond_create();
+		if (!dev_pdata->cond) {
+			ret = -ENOMEM;
+			goto err_context_destroy;
+		}
+	}
+
+	ret = iio_context_add_attr(ctx, "synthetic,pattern",
+				   synthetic_patterns[pdata->pattern]);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	iio_snprintf(rate, sizeof(rate), "%llu",
+		     (unsigned long long) pdata->rate);
+	ret = iio_context_add_attr(ctx, "synthetic,rate", rate);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	uri_len = strlen(pdata->args) + sizeof("synthetic:");
+	uri = malloc(uri_len);
+	if (!uri) {
+		ret = -ENOMEM;
+		goto err_context_destroy;
+	}
+
+	iio_snprintf(uri, uri_len, "synthetic:%s", pdata->args);
+	ret = iio_context_add_attr(ctx, "uri", uri);
+	free(uri);
+	if (ret < 0)
+		goto err_context_destroy;
+
+	return ctx;
+
+err_context_destroy:
+	iio_context_destroy(ctx);
+	errno = -ret;
+	return NULL;
+
+err_free_path:
+	free(path);
+	synthetic_free_pdata(pdata);
+	free(pdata);
+	errno = -ret;
+	return NULL;
+}
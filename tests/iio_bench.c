@@ -0,0 +1,592 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * iio_bench - Part of the Industrial I/O (IIO) utilities
+ *
+ * Copyright (C) 2021 Analog Devices, Inc.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <iio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iio_common.h"
+
+#define MY_NAME "iio_bench"
+
+#ifdef _WIN32
+#define snprintf sprintf_s
+#endif
+
+#define DEFAULT_BUFFER_SIZE 4096
+#define DEFAULT_MIN_TIME_MS 200
+#define CONVERT_NB_SAMPLES  4096
+
+#define BENCH_CONVERT	(1 << 0)
+#define BENCH_DEMUX	(1 << 1)
+#define BENCH_TRANSPORT	(1 << 2)
+
+static const struct option options[] = {
+	  {"buffer-size", required_argument, 0, 'b'},
+	  {"min-time", required_argument, 0, 't'},
+	  {"group", required_argument, 0, 'g'},
+	  {0, 0, 0, 0},
+};
+
+static const char *options_descriptions[] = {
+	"[-b <buffer-size>] [-t <min-time>] [-g <groups>] [<iio_device>]",
+	"Size of the capture buffer, in samples. Default is 4096.",
+	"Minimum duration of each benchmark, in milliseconds. Default is 200.",
+	"Comma-separated list of the groups of benchmarks to run,"
+		"\n\t\t\tamong 'convert', 'demux' and 'transport'. Default is all."
+		"\n\t\t\tThe 'demux' and 'transport' groups need a device.",
+};
+
+/* Formats of the synthetic context used by the conversion benchmarks */
+static const char * const convert_formats[] = {
+	"le:u8/8>>0",
+	"le:s12/16>>4",
+	"le:s16/16>>0",
+	"be:s16/16>>0",
+	"le:s24/32>>8",
+	"le:s32/32>>0",
+	"be:s32/32>>0",
+	"le:s64/64>>0",
+};
+
+#define NB_CONVERT_FORMATS (sizeof(convert_formats) / sizeof(convert_formats[0]))
+
+static uint64_t min_time_ns = DEFAULT_MIN_TIME_MS * 1000000ull;
+static bool first_result = true;
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	return get_time_us() * 1000;
+#else
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec * 1000000000ull + tp.tv_nsec;
+#endif
+}
+
+/* Results are printed as a JSON document, one object per benchmark. Each
+ * one gives the number of operations timed, the mean time per operation,
+ * and the throughput when the operations move samples. */
+static void print_result(const char *group, const char *name,
+		const char *unit, uint64_t nb_ops, uint64_t nb_bytes,
+		uint64_t elapsed_ns)
+{
+	printf("%s\n\t\t{ \"group\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", "
+	       "\"ops\": %" PRIu64 ", \"ns_per_op\": %.3f",
+	       first_result ? "" : ",", group, name, unit, nb_ops,
+	       nb_ops ? (double) elapsed_ns / (double) nb_ops : 0.0);
+
+	if (nb_bytes)
+		printf(", \"mb_per_s\": %.3f",
+		       elapsed_ns ? (double) nb_bytes * 1000.0 / elapsed_ns : 0.0);
+
+	printf(" }");
+	first_result = false;
+}
+
+static void print_error(const char *group, const char *name, int err)
+{
+	char buf[256];
+
+	iio_strerror(-err, buf, sizeof(buf));
+	fprintf(stderr, "%s/%s: %s\n", group, name, buf);
+}
+
+/*
+ * Conversion of samples, for each format of convert_formats, with a context
+ * described in XML: no hardware is needed.
+ */
+
+static struct iio_context * create_convert_context(void)
+{
+	char xml[4096];
+	size_t len;
+	unsigned int i;
+
+	len = (size_t) snprintf(xml, sizeof(xml),
+			   "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+			   "<context name=\"bench\"><device id=\"iio:device0\" "
+			   "name=\"bench\">");
+
+	for (i = 0; i < NB_CONVERT_FORMATS && len < sizeof(xml); i++)
+		len += (size_t) snprintf(xml + len, sizeof(xml) - len,
+				    "<channel id=\"voltage%u\" type=\"input\">"
+				    "<scan-element index=\"%u\" format=\"%s\" />"
+				    "</channel>", i, i, convert_formats[i]);
+
+	if (len < sizeof(xml))
+		len += (size_t) snprintf(xml + len, sizeof(xml) - len,
+				    "</device></context>");
+	if (len >= sizeof(xml)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return iio_create_xml_context_mem(xml, len);
+}
+
+static void bench_convert(void)
+{
+	uint8_t *src, *dst;
+	struct iio_context *ctx;
+	const struct iio_device *dev;
+	const struct iio_channel *chn;
+	const struct iio_data_format *fmt;
+	uint64_t start, elapsed, nb;
+	unsigned int i;
+	size_t j, sample_len;
+
+	ctx = create_convert_context();
+	if (!ctx) {
+		print_error("convert", "context", -errno);
+		return;
+	}
+
+	src = xmalloc(CONVERT_NB_SAMPLES * sizeof(uint64_t), "src");
+	dst = xmalloc(CONVERT_NB_SAMPLES * sizeof(uint64_t), "dst");
+
+	srand(0);
+	for (j = 0; j < CONVERT_NB_SAMPLES * sizeof(uint64_t); j++)
+		src[j] = (uint8_t) rand();
+
+	dev = iio_context_get_device(ctx, 0);
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		chn = iio_device_get_channel(dev, i);
+		fmt = iio_channel_get_data_format(chn);
+		sample_len = fmt->length / 8;
+
+		/* One sample at a time */
+		start = now_ns();
+		for (nb = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += CONVERT_NB_SAMPLES)
+			for (j = 0; j < CONVERT_NB_SAMPLES; j++)
+				iio_channel_convert(chn, dst + j * sample_len,
+						    src + j * sample_len);
+
+		print_result("convert", convert_formats[i], "sample",
+			     nb, nb * sample_len, elapsed);
+
+		/* Whole blocks */
+		start = now_ns();
+		for (nb = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += CONVERT_NB_SAMPLES)
+			iio_channel_convert_block(chn, dst, src,
+						  CONVERT_NB_SAMPLES);
+
+		print_result("convert_block", convert_formats[i], "sample",
+			     nb, nb * sample_len, elapsed);
+
+		start = now_ns();
+		for (nb = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += CONVERT_NB_SAMPLES)
+			for (j = 0; j < CONVERT_NB_SAMPLES; j++)
+				iio_channel_convert_inverse(chn,
+						dst + j * sample_len,
+						src + j * sample_len);
+
+		print_result("convert_inverse", convert_formats[i], "sample",
+			     nb, nb * sample_len, elapsed);
+	}
+
+	free(dst);
+	free(src);
+	iio_context_destroy(ctx);
+}
+
+/*
+ * Demultiplexing of a refilled buffer with different channel masks. The
+ * buffer is refilled once; the same samples are then processed repeatedly,
+ * so that only the processing is measured.
+ */
+
+enum demux_mask {
+	MASK_ALL,
+	MASK_FIRST,
+	MASK_ALTERNATE,
+	MASK_NB,
+};
+
+static const char * const demux_mask_names[] = {
+	"all", "first", "alternate",
+};
+
+static unsigned int enable_channels(struct iio_device *dev,
+		enum demux_mask mask)
+{
+	unsigned int i, nb_scan = 0, nb_enabled = 0;
+	struct iio_channel *chn;
+	bool enable;
+
+	for (i = 0; i < iio_device_get_channels_count(dev); i++) {
+		chn = iio_device_get_channel(dev, i);
+		iio_channel_disable(chn);
+
+		if (iio_channel_is_output(chn) || !iio_channel_is_scan_element(chn))
+			continue;
+
+		switch (mask) {
+		case MASK_FIRST:
+			enable = nb_scan == 0;
+			break;
+		case MASK_ALTERNATE:
+			enable = !(nb_scan & 1);
+			break;
+		default:
+			enable = true;
+			break;
+		}
+
+		if (enable) {
+			iio_channel_enable(chn);
+			nb_enabled++;
+		}
+		nb_scan++;
+	}
+
+	return nb_enabled;
+}
+
+static ssize_t demux_nop(const struct iio_channel *chn,
+		void *src, size_t bytes, void *d)
+{
+	return (ssize_t) bytes;
+}
+
+static void bench_demux(struct iio_device *dev, size_t buffer_size)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	void **dst;
+	struct iio_buffer *buf;
+	uint64_t start, elapsed, nb, bytes;
+	enum demux_mask mask;
+	size_t len, max_len, read = 0;
+	ssize_t ret;
+
+	dst = calloc(nb_channels, sizeof(*dst));
+	if (!dst)
+		return;
+
+	for (mask = MASK_ALL; mask < MASK_NB; mask++) {
+		const char *name = demux_mask_names[mask];
+
+		if (!enable_channels(dev, mask) ||
+		    (mask != MASK_ALL && enable_channels(dev, MASK_ALL) ==
+		     enable_channels(dev, mask)))
+			continue;
+
+		/* Playback of capture files ends, unless looping */
+		if (iio_device_set_playback_loop(dev, true) < 0)
+			errno = 0;
+
+		buf = iio_device_create_buffer(dev, buffer_size, false);
+		if (!buf) {
+			print_error("demux", name, -errno);
+			continue;
+		}
+
+		ret = iio_buffer_refill(buf);
+		if (ret <= 0) {
+			print_error("demux", name, ret ? (int) ret : -ENODATA);
+			iio_buffer_destroy(buf);
+			continue;
+		}
+
+		len = (uintptr_t) iio_buffer_end(buf) -
+			(uintptr_t) iio_buffer_start(buf);
+		max_len = len / iio_buffer_step(buf) * sizeof(uint64_t);
+
+		for (i = 0; i < nb_channels; i++) {
+			const struct iio_channel *chn =
+				iio_device_get_channel(dev, i);
+
+			if (iio_channel_is_enabled(chn))
+				dst[i] = xmalloc(max_len, "dst");
+		}
+
+		start = now_ns();
+		for (nb = 0, bytes = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += len / iio_buffer_step(buf), bytes += len) {
+			ret = iio_buffer_foreach_sample(buf, demux_nop, NULL);
+			if (ret < 0)
+				break;
+		}
+		if (ret < 0)
+			print_error("foreach_sample", name, (int) ret);
+		else
+			print_result("foreach_sample", name, "sample",
+				     nb, bytes, elapsed);
+
+		start = now_ns();
+		for (nb = 0, bytes = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += len / iio_buffer_step(buf), bytes += len) {
+			for (i = 0; i < nb_channels; i++) {
+				if (dst[i])
+					read += iio_channel_read_raw(
+						iio_device_get_channel(dev, i),
+						buf, dst[i], max_len);
+			}
+		}
+		print_result("channel_read_raw", name, "sample",
+			     nb, bytes, elapsed);
+
+		start = now_ns();
+		for (nb = 0, bytes = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += len / iio_buffer_step(buf), bytes += len) {
+			for (i = 0; i < nb_channels; i++) {
+				if (dst[i])
+					read += iio_channel_read(
+						iio_device_get_channel(dev, i),
+						buf, dst[i], max_len);
+			}
+		}
+		print_result("channel_read", name, "sample",
+			     nb, bytes, elapsed);
+
+		start = now_ns();
+		for (nb = 0, bytes = 0; (elapsed = now_ns() - start) < min_time_ns;
+		     nb += len / iio_buffer_step(buf), bytes += len) {
+			ret = iio_buffer_demux(buf, dst, 0, len, true);
+			if (ret < 0)
+				break;
+		}
+		if (ret < 0)
+			print_error("buffer_demux", name, (int) ret);
+		else
+			print_result("buffer_demux", name, "sample",
+				     nb, bytes, elapsed);
+
+		for (i = 0; i < nb_channels; i++) {
+			free(dst[i]);
+			dst[i] = NULL;
+		}
+
+		iio_buffer_destroy(buf);
+	}
+
+	free(dst);
+
+	/* Keep the reads from being optimized out */
+	if (!read)
+		errno = 0;
+}
+
+/*
+ * Transport: latency of the attribute accesses, and throughput of the
+ * refills. Against a network context, these are the round-trip time and the
+ * READBUF throughput of IIOD.
+ */
+
+static void bench_attr(const struct iio_device *dev)
+{
+	const struct iio_channel *chn = NULL;
+	const char *attr = NULL;
+	uint64_t start, elapsed, nb;
+	unsigned int i;
+	char buf[BUF_SIZE];
+	ssize_t ret = 0;
+
+	if (iio_device_get_attrs_count(dev)) {
+		attr = iio_device_get_attr(dev, 0);
+	} else {
+		for (i = 0; !attr && i < iio_device_get_channels_count(dev); i++) {
+			chn = iio_device_get_channel(dev, i);
+			if (iio_channel_get_attrs_count(chn))
+				attr = iio_channel_get_attr(chn, 0);
+		}
+	}
+
+	if (!attr) {
+		print_error("attr_read", "device", -ENOENT);
+		return;
+	}
+
+	start = now_ns();
+	for (nb = 0; (elapsed = now_ns() - start) < min_time_ns; nb++) {
+		if (chn)
+			ret = iio_channel_attr_read(chn, attr, buf, sizeof(buf));
+		else
+			ret = iio_device_attr_read(dev, attr, buf, sizeof(buf));
+		if (ret < 0)
+			break;
+	}
+
+	if (ret < 0)
+		print_error("attr_read", attr, (int) ret);
+	else
+		print_result("attr_read", attr, "op", nb, 0, elapsed);
+}
+
+static void bench_refill(struct iio_device *dev, size_t buffer_size)
+{
+	struct iio_buffer *buf;
+	uint64_t start, elapsed, nb, bytes;
+	ssize_t ret = 0;
+
+	if (!enable_channels(dev, MASK_ALL))
+		return;
+
+	if (iio_device_set_playback_loop(dev, true) < 0)
+		errno = 0;
+
+	buf = iio_device_create_buffer(dev, buffer_size, false);
+	if (!buf) {
+		print_error("refill", "all", -errno);
+		return;
+	}
+
+	start = now_ns();
+	for (nb = 0, bytes = 0; (elapsed = now_ns() - start) < min_time_ns;
+	     nb++, bytes += ret) {
+		ret = iio_buffer_refill(buf);
+		if (ret < 0)
+			break;
+	}
+
+	if (ret < 0)
+		print_error("refill", "all", (int) ret);
+	else
+		print_result("refill", "all", "refill", nb, bytes, elapsed);
+
+	iio_buffer_destroy(buf);
+}
+
+static unsigned int parse_groups(const char *str)
+{
+	unsigned int groups = 0;
+
+	if (strstr(str, "convert"))
+		groups |= BENCH_CONVERT;
+	if (strstr(str, "demux"))
+		groups |= BENCH_DEMUX;
+	if (strstr(str, "transport"))
+		groups |= BENCH_TRANSPORT;
+
+	return groups;
+}
+
+#define MY_OPTS "b:t:g:"
+int main(int argc, char **argv)
+{
+	unsigned int major, minor, groups = BENCH_CONVERT | BENCH_DEMUX
+		| BENCH_TRANSPORT;
+	size_t buffer_size = DEFAULT_BUFFER_SIZE;
+	struct iio_context *ctx = NULL;
+	struct iio_device *dev = NULL;
+	const char *dev_name = NULL;
+	struct option *opts;
+	char git_tag[8];
+	char **argw;
+	int c;
+
+	argw = dup_argv(MY_NAME, argc, argv);
+
+	opts = add_common_options(options);
+	if (!opts) {
+		fprintf(stderr, "Failed to add common options\n");
+		return EXIT_FAILURE;
+	}
+
+	while ((c = getopt_long(argc, argw, "+" COMMON_OPTIONS MY_OPTS,	/* Flawfinder: ignore */
+					opts, NULL)) != -1) {
+		switch (c) {
+		/* All these are handled in the common */
+		case 'n':
+		case 'x':
+		case 'u':
+		case 'T':
+			break;
+		case 'S':
+		case 'a':
+			if (!optarg && argc > optind && argv[optind] != NULL
+					&& argv[optind][0] != '-')
+				optind++;
+			break;
+		case 'h':
+			usage(MY_NAME, options, options_descriptions);
+			free(opts);
+			free_argw(argc, argw);
+			return EXIT_SUCCESS;
+		case 'b':
+			buffer_size = sanitize_clamp("buffer size", optarg, 1, SIZE_MAX);
+			break;
+		case 't':
+			min_time_ns = sanitize_clamp("minimum time", optarg, 1,
+						     UINT32_MAX) * 1000000ull;
+			break;
+		case 'g':
+			groups = parse_groups(optarg);
+			if (!groups) {
+				fprintf(stderr, "Unknown group in '%s'\n", optarg);
+				free(opts);
+				free_argw(argc, argw);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+			printf("Unknown argument '%c'\n", c);
+			free(opts);
+			free_argw(argc, argw);
+			return EXIT_FAILURE;
+		}
+	}
+	free(opts);
+
+	/* The conversion benchmarks do not need any context */
+	if (argc > optind) {
+		dev_name = argw[optind];
+
+		ctx = handle_common_opts(MY_NAME, argc, argw, MY_OPTS,
+					 options, options_descriptions);
+		if (!ctx) {
+			free_argw(argc, argw);
+			return EXIT_FAILURE;
+		}
+
+		dev = iio_context_find_device(ctx, dev_name);
+		if (!dev) {
+			fprintf(stderr, "Device %s not found\n", dev_name);
+			iio_context_destroy(ctx);
+			free_argw(argc, argw);
+			return EXIT_FAILURE;
+		}
+	}
+
+	iio_library_get_version(&major, &minor, git_tag);
+
+	printf("{\n\t\"library\": \"%u.%u\",\n\t\"git_tag\": \"%.*s\",\n",
+	       major, minor, (int) sizeof(git_tag), git_tag);
+	if (ctx)
+		printf("\t\"backend\": \"%s\",\n\t\"device\": \"%s\",\n",
+		       iio_context_get_name(ctx), dev_name);
+	printf("\t\"buffer_size\": %zu,\n\t\"results\": [", buffer_size);
+
+	if (groups & BENCH_CONVERT)
+		bench_convert();
+
+	if (dev && (groups & BENCH_DEMUX))
+		bench_demux(dev, buffer_size);
+
+	if (dev && (groups & BENCH_TRANSPORT)) {
+		bench_attr(dev);
+		bench_refill(dev, buffer_size);
+	}
+
+	printf("\n\t]\n}\n");
+
+	if (ctx)
+		iio_context_destroy(ctx);
+	free_argw(argc, argw);
+	return EXIT_SUCCESS;
+}
@@ -71,14 +71,26 @@ char *cmn_strndup(const char *str, size_t n)
 #endif
 }
 
+/* Lists the contexts as soon as their backend answered */
+static void print_context_info(const struct iio_context_info *info, void *d)
+{
+	unsigned int *nb = d;
+
+	if (!*nb)
+		printf("Available contexts:\n");
+
+	printf("\t%u: %s [%s]\n", (*nb)++,
+	       iio_context_info_get_description(info),
+	       iio_context_info_get_uri(info));
+}
+
 struct iio_context * autodetect_context(bool rtn, const char * name, const char * scan)
 {
 	struct iio_scan_context *scan_ctx;
-	struct iio_context_info **info;
+	struct iio_context_info **info = NULL;
 	struct iio_context *ctx = NULL;
-	unsigned int i;
+	unsigned int i, nb = 0;
 	ssize_t ret;
-	FILE *out;
 
 	scan_ctx = iio_create_scan_context(scan, 0);
 	if (!scan_ctx) {
@@ -86,7 +98,12 @@ struct iio_context * autodetect_context(bool rtn, const char * name, const char
 		return NULL;
 	}
 
-	ret = iio_scan_context_get_info_list(scan_ctx, &info);
+	/* When listing the contexts, print them as they are found */
+	if (rtn)
+		ret = iio_scan_context_get_info_list(scan_ctx, &info);
+	else
+		ret = iio_scan_context_get_info_list_timeout(scan_ctx, 0,
+				print_context_info, &nb, NULL);
 	if (ret < 0) {
 		char *err_str = xmalloc(BUF_SIZE, name);
 		iio_strerror(-(int)ret, err_str, BUF_SIZE);
@@ -99,20 +116,17 @@ struct iio_context * autodetect_context(bool rtn, const char * name, const char
 		fprintf(stderr, "No IIO context found.\n");
 		goto err_free_info_list;
 	}
-	if (rtn && ret == 1) {
+	if (!rtn)
+		goto err_free_info_list;
+
+	if (ret == 1) {
 		fprintf(stderr, "Using auto-detected IIO context at URI \"%s\"\n",
 		iio_context_info_get_uri(info[0]));
 		ctx = iio_create_context_from_uri(iio_context_info_get_uri(info[0]));
 	} else {
-		if (rtn) {
-			out = stderr;
-			fprintf(out, "Multiple contexts found. Please select one using --uri:\n");
-		} else {
-			out = stdout;
-			fprintf(out, "Available contexts:\n");
-		}
+		fprintf(stderr, "Multiple contexts found. Please select one using --uri:\n");
 		for (i = 0; i < (size_t) ret; i++) {
-			fprintf(out, "\t%u: %s [%s]\n",
+			fprintf(stderr, "\t%u: %s [%s]\n",
 					i, iio_context_info_get_description(info[i]),
 					iio_context_info_get_uri(info[i]));
 		}
@@ -19,6 +19,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  * */
 
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* For O_DIRECT and fallocate() */
+#endif
+#endif
+
 #include <errno.h>
 #include <getopt.h>
 #include <iio.h>
@@ -42,18 +48,27 @@ static const struct option options[] = {
 	  {"samples", required_argument, 0, 's' },
 	  {"auto", no_argument, 0, 'a'},
 	  {"benchmark", no_argument, 0, 'B'},
+	  {"output", required_argument, 0, 'o'},
+	  {"preallocate", required_argument, 0, 'P'},
+	  {"capture", no_argument, 0, 'c'},
 	  {0, 0, 0, 0},
 };
 
 static const char *options_descriptions[] = {
 	"[-t <trigger>] [-b <buffer-size>]"
-		"[-s <samples>] <iio_device> [<channel> ...]",
+		"[-s <samples>] [-o <file>] <iio_device> [<channel> ...]",
 	"Use the specified trigger.",
 	"Size of the capture buffer. Default is 256.",
 	"Number of samples to capture, 0 = infinite. Default is 0.",
 	"Scan for available contexts and if only one is available use it.",
 	"Benchmark throughput."
 		"\n\t\t\tStatistics will be printed on the standard input.",
+	"Record the raw samples into the specified file, refilling"
+		"\n\t\t\tthe buffer from a separate thread.",
+	"Number of bytes to preallocate for the recording."
+		"\n\t\t\tDefault is the size of the requested samples.",
+	"Record in the libiio capture format, which can be played"
+		"\n\t\t\tback with the 'file:' backend.",
 };
 
 static struct iio_context *ctx;
@@ -191,7 +206,252 @@ static ssize_t print_sample(const struct iio_channel *chn,
 	return (ssize_t) len;
 }
 
-#define MY_OPTS "t:b:s:T:B"
+/* The record mode needs the iio_stream helper of the library */
+#if defined(WITH_STREAM) && !defined(_WIN32)
+#define WITH_RECORD 1
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Record mode: the buffer is refilled by the capture thread of an iio_stream,
+ * while the main thread writes the blocks to the output file, so that a slow
+ * write does not delay the next refill. When possible, the file is opened with
+ * O_DIRECT to bypass the page cache; the blocks are then gathered into an
+ * aligned chunk, written once full.
+ */
+#define RECORD_ALIGN      4096
+#define RECORD_CHUNK_SIZE (4 * 1024 * 1024)
+#define RECORD_NB_SLOTS   32
+
+struct record {
+	int fd;
+	bool direct;
+	char *chunk;
+	size_t fill;
+	uint64_t total;
+};
+
+static int record_write(int fd, const char *src, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, src, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		src += ret;
+		len -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+static int record_open(struct record *rec, const char *path, uint64_t prealloc)
+{
+	int err, flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->fd = -1;
+
+	err = posix_memalign((void **) &rec->chunk,
+			     RECORD_ALIGN, RECORD_CHUNK_SIZE);
+	if (err)
+		return -err;
+
+#ifdef O_DIRECT
+	rec->fd = open(path, flags | O_DIRECT, 0644);
+	rec->direct = rec->fd >= 0;
+#endif
+	if (rec->fd < 0)
+		rec->fd = open(path, flags, 0644);
+	if (rec->fd < 0) {
+		err = -errno;
+		free(rec->chunk);
+		return err;
+	}
+
+#ifdef __linux__
+	/* Reserve the space upfront, so that the filesystem does not have to
+	 * allocate it while recording; the excess is truncated at the end */
+	if (prealloc && fallocate(rec->fd, 0, 0, (off_t) prealloc) < 0) {
+		char buf[256];
+		iio_strerror(errno, buf, sizeof(buf));
+		fprintf(stderr, "Unable to preallocate %" PRIu64 " bytes: %s\n",
+			prealloc, buf);
+	}
+#endif
+
+	return 0;
+}
+
+static int record_add(struct record *rec, const char *src, size_t len)
+{
+	size_t nb;
+	int ret;
+
+	while (len) {
+		nb = RECORD_CHUNK_SIZE - rec->fill;
+		if (nb > len)
+			nb = len;
+
+		memcpy(rec->chunk + rec->fill, src, nb);
+		rec->fill += nb;
+		src += nb;
+		len -= nb;
+
+		if (rec->fill == RECORD_CHUNK_SIZE) {
+			ret = record_write(rec->fd, rec->chunk, rec->fill);
+			if (ret)
+				return ret;
+
+			rec->total += rec->fill;
+			rec->fill = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int record_close(struct record *rec)
+{
+	int ret = 0;
+
+	if (rec->fill) {
+#ifdef O_DIRECT
+		/* The last chunk is not a multiple of the block size */
+		if (rec->direct)
+			fcntl(rec->fd, F_SETFL,
+			      fcntl(rec->fd, F_GETFL) & ~O_DIRECT);
+#endif
+		ret = record_write(rec->fd, rec->chunk, rec->fill);
+		if (!ret)
+			rec->total += rec->fill;
+	}
+
+	if (ftruncate(rec->fd, (off_t) rec->total) < 0 && !ret)
+		ret = -errno;
+	if (close(rec->fd) < 0 && !ret)
+		ret = -errno;
+
+	free(rec->chunk);
+	return ret;
+}
+
+static int record_buffer(const char *path, uint64_t prealloc,
+		size_t sample_size, bool capture, bool benchmark)
+{
+	struct iio_stream_stats stats;
+	struct iio_capture *cap = NULL;
+	struct iio_stream *stream;
+	struct record rec;
+	uint64_t before, after, total = 0, timestamp;
+	const char *data;
+	char buf[256];
+	size_t len;
+	int ret, err;
+
+	/* In the capture format, the file can be played back with the
+	 * "file:" backend */
+	if (capture) {
+		cap = iio_buffer_create_capture(buffer, path);
+		ret = cap ? 0 : -errno;
+	} else {
+		ret = record_open(&rec, path, prealloc);
+	}
+	if (ret) {
+		iio_strerror(-ret, buf, sizeof(buf));
+		fprintf(stderr, "Unable to open %s: %s\n", path, buf);
+		return ret;
+	}
+
+	stream = iio_buffer_create_stream(buffer, RECORD_NB_SLOTS, -1);
+	if (!stream) {
+		ret = -errno;
+		iio_strerror(-ret, buf, sizeof(buf));
+		fprintf(stderr, "Unable to start the capture: %s\n", buf);
+		if (cap)
+			err = iio_capture_close(cap);
+		else
+			record_close(&rec);
+		return ret;
+	}
+
+	before = get_time_us();
+
+	while (true) {
+		data = iio_stream_acquire(stream, &len, 0);
+		if (!data) {
+			if (app_running) {
+				ret = -errno;
+				iio_strerror(-ret, buf, sizeof(buf));
+				fprintf(stderr, "Unable to refill buffer: %s\n", buf);
+			}
+			break;
+		}
+
+		if (num_samples && len > num_samples * sample_size)
+			len = num_samples * sample_size;
+
+		if (cap) {
+			/* Without hardware timestamps, use the time at which
+			 * the block is recorded */
+			if (iio_stream_get_timestamp(stream, &timestamp) < 0)
+				timestamp = get_time_us() * 1000;
+
+			ret = iio_capture_write(cap, data, len, timestamp);
+		} else
+			ret = record_add(&rec, data, len);
+
+		err = iio_stream_release(stream);
+		if (ret || err) {
+			ret = ret ? ret : err;
+			iio_strerror(-ret, buf, sizeof(buf));
+			fprintf(stderr, "Unable to record the samples: %s\n", buf);
+			break;
+		}
+
+		total += len;
+
+		if (num_samples) {
+			num_samples -= len / sample_size;
+			if (!num_samples)
+				break;
+		}
+	}
+
+	after = get_time_us();
+
+	iio_stream_get_stats(stream, &stats);
+	iio_stream_destroy(stream);
+
+	err = cap ? iio_capture_close(cap) : record_close(&rec);
+	if (!ret && err) {
+		ret = err;
+		iio_strerror(-ret, buf, sizeof(buf));
+		fprintf(stderr, "Unable to write to %s: %s\n", path, buf);
+	}
+
+	if (stats.nb_overruns)
+		fprintf(stderr, "%" PRIu64 " refills were dropped, as the writes "
+			"did not keep up\n", stats.nb_overruns);
+
+	if (benchmark && after > before)
+		fprintf(stderr, "Recorded %" PRIu64 " bytes at %" PRIu64 " KiB/s\n",
+			total, total * (uint64_t) 1000000 /
+			((after - before) * 1024));
+
+	return ret;
+}
+
+#endif /* WITH_RECORD */
+
+#define MY_OPTS "t:b:s:T:Bo:P:c"
 int main(int argc, char **argv)
 {
 	char **argw;
@@ -205,6 +465,9 @@ int main(int argc, char **argv)
 	struct option *opts;
 	bool mib, benchmark = false;
 	uint64_t before, after, rate, total;
+	const char *output = NULL;
+	uint64_t prealloc = 0;
+	bool capture = false;
 
 	argw = dup_argv(MY_NAME, argc, argv);
 
@@ -255,6 +518,28 @@ int main(int argc, char **argv)
 			}
 			num_samples = sanitize_clamp("number of samples", optarg, 0, SIZE_MAX);
 			break;
+		case 'o':
+			if (!optarg) {
+				fprintf(stderr, "Output requires an argument\n");
+				return EXIT_FAILURE;
+			}
+#ifdef WITH_RECORD
+			output = optarg;
+			break;
+#else
+			fprintf(stderr, "Recording is not supported by this build\n");
+			return EXIT_FAILURE;
+#endif
+		case 'P':
+			if (!optarg) {
+				fprintf(stderr, "Preallocation requires an argument\n");
+				return EXIT_FAILURE;
+			}
+			prealloc = sanitize_clamp("preallocation", optarg, 0, SIZE_MAX);
+			break;
+		case 'c':
+			capture = true;
+			break;
 		case '?':
 			printf("Unknown argument '%c'\n", c);
 			return EXIT_FAILURE;
@@ -268,6 +553,11 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	if (capture && !output) {
+		fprintf(stderr, "The capture format requires an output file\n");
+		return EXIT_FAILURE;
+	}
+
 	if (!ctx)
 		return EXIT_FAILURE;
 
@@ -381,6 +671,21 @@ int main(int argc, char **argv)
 	_setmode(_fileno(stdout), _O_BINARY);
 #endif
 
+#ifdef WITH_RECORD
+	if (output) {
+		if (!prealloc)
+			prealloc = (uint64_t) num_samples * sample_size;
+
+		ret = record_buffer(output, prealloc, sample_size,
+				    capture, benchmark);
+		if (ret < 0)
+			exit_code = EXIT_FAILURE;
+		goto err_destroy_buffer;
+	}
+#else
+	(void) prealloc;
+#endif
+
 
 	for (i = 0, total = 0; app_running; ) {
 		if (benchmark)
@@ -17,7 +17,9 @@
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <inttypes.h>
 #include <sys/time.h>
+#include <time.h>
 
 #ifdef __APPLE__
 	/* Needed for sysctlbyname */
@@ -35,6 +37,14 @@
 #define SAMPLES_PER_READ 256
 #define NUM_TIMESTAMPS (16*1024)
 
+/* Log-linear latency histograms, in the manner of HdrHistogram: each power
+ * of two is split in HIST_SUB buckets, so that the values are recorded with
+ * a precision of about 3%, from 1 ns up to 2^HIST_MAX_MSB ns (~18 min). */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_MSB 40
+#define HIST_NB_BUCKETS ((HIST_MAX_MSB - HIST_SUB_BITS) * HIST_SUB + 2 * HIST_SUB)
+
 static int getNumCores(void) {
 #ifdef _WIN32
 	SYSTEM_INFO sysinfo;
@@ -103,11 +113,12 @@ static const struct option options[] = {
 	{"Timeout", required_argument, 0, 'T'},
 	{"threads", required_argument, 0, 't'},
 	{"verbose", no_argument, 0, 'v'},
+	{"json", no_argument, 0, 'j'},
 	{0, 0, 0, 0},
 };
 
 static const char *options_descriptions[] = {
-	"[-n <hostname>] [-u <vid>:<pid>] [-t <trigger>] [-b <buffer-size>] [-s <samples>]"
+	"[-n <hostname>] [-u <vid>:<pid>] [-t <trigger>] [-b <buffer-size>] [-s <samples>] [-j] "
 		"<iio_device> [<channel> ...]",
 	"Show this help and quit.",
 	"Use the context at the provided URI.",
@@ -116,6 +127,7 @@ static const char *options_descriptions[] = {
 	"Time to wait (in s) between stopping all threads",
 	"Number of Threads",
 	"Increase verbosity (-vv and -vvv for more)",
+	"Print the statistics as JSON.",
 };
 
 static bool app_running = true;
@@ -193,11 +205,137 @@ enum verbosity {
 	VERYVERBOSE,
 };
 
+enum latency_op {
+	OP_CONTEXT,
+	OP_BUFFER,
+	OP_REFILL,
+	OP_ATTR,
+	NB_OPS,
+};
+
+static const char * const latency_op_names[] = {
+	"context_create",
+	"buffer_create",
+	"refill",
+	"attr_read",
+};
+
+struct latency_hist {
+	uint64_t counts[HIST_NB_BUCKETS];
+	uint64_t count, min, max, sum;
+};
+
+/* Written by one client thread only, read once the threads are joined */
+struct thread_stats {
+	struct latency_hist hist[NB_OPS];
+	uint64_t bytes, run_ns;
+};
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	return get_time_us() * 1000;
+#else
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec * 1000000000ull + tp.tv_nsec;
+#endif
+}
+
+static unsigned int hist_index(uint64_t val)
+{
+	unsigned int msb = 0, shift;
+
+	if (val < 2 * HIST_SUB)
+		return (unsigned int) val;
+
+	while (msb < 63 && (val >> (msb + 1)))
+		msb++;
+
+	if (msb > HIST_MAX_MSB) {
+		msb = HIST_MAX_MSB;
+		val = (2ull << HIST_MAX_MSB) - 1;
+	}
+
+	shift = msb - HIST_SUB_BITS;
+	return shift * HIST_SUB + (unsigned int) (val >> shift);
+}
+
+/* Highest value recorded in the given bucket */
+static uint64_t hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < 2 * HIST_SUB)
+		return idx;
+
+	shift = idx / HIST_SUB - 1;
+	return (((uint64_t) (idx - shift * HIST_SUB) + 1) << shift) - 1;
+}
+
+static void hist_record(struct latency_hist *hist, uint64_t val)
+{
+	hist->counts[hist_index(val)]++;
+
+	if (!hist->count || val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+
+	hist->count++;
+	hist->sum += val;
+}
+
+static void hist_merge(struct latency_hist *dst, const struct latency_hist *src)
+{
+	unsigned int i;
+
+	if (!src->count)
+		return;
+
+	for (i = 0; i < HIST_NB_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+}
+
+static uint64_t hist_percentile(const struct latency_hist *hist, double pct)
+{
+	uint64_t nb = 0, rank = (uint64_t) (pct / 100.0 * hist->count + 0.5);
+	unsigned int i;
+
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_NB_BUCKETS; i++) {
+		nb += hist->counts[i];
+		if (nb >= rank)
+			break;
+	}
+
+	if (i == HIST_NB_BUCKETS || hist_value(i) > hist->max)
+		return hist->max;
+
+	return hist_value(i);
+}
+
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+#define NB_PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
 struct info {
 	int argc;
 	char **argv;
 	enum backend back;
 	enum verbosity verbose;
+	bool json;
 
 	int uri_index, device_index, arg_index;
 	unsigned int buffer_size, timeout;
@@ -206,6 +344,7 @@ struct info {
 	unsigned int *starts, *buffers, *refills;
 	pthread_t *threads;
 	struct timeval **start;
+	struct thread_stats *stats;
 };
 
 static void thread_err(int id, ssize_t ret, char * what)
@@ -224,8 +363,13 @@ static void *client_thread(void *data)
 	struct iio_buffer *buffer;
 	unsigned int i, nb_channels, duration;
 	struct iio_device *dev;
+	struct iio_channel *attr_chn;
+	const char *attr;
+	struct thread_stats *stats;
 	struct timeval start, end;
 	int id = -1, stamp, r_errno;
+	uint64_t t0, t_start = now_ns();
+	char attr_buf[1024];
 	ssize_t ret;
 
 	/* Find my ID */
@@ -240,6 +384,8 @@ static void *client_thread(void *data)
 	if (info->verbose == VERYVERBOSE)
 		printf("%2d: Entered\n", id);
 
+	stats = &info->stats[id];
+
 	stamp = 0;
 	while (stamp < NUM_TIMESTAMPS && info->start[id][stamp].tv_sec) {
 		stamp++;
@@ -249,6 +395,7 @@ static void *client_thread(void *data)
 		gettimeofday(&start, NULL);
 		do {
 			errno = 0;
+			t0 = now_ns();
 			if (info->uri_index) {
 				ctx = iio_create_context_from_uri(info->argv[info->uri_index]);
 			} else {
@@ -266,6 +413,8 @@ static void *client_thread(void *data)
 			goto thread_fail;
 		}
 
+		hist_record(&stats->hist[OP_CONTEXT], now_ns() - t0);
+
 		/* store the timestamp of the context creation */
 		info->start[id][stamp].tv_sec = end.tv_sec;
 		info->start[id][stamp].tv_usec = end.tv_usec;
@@ -287,6 +436,17 @@ static void *client_thread(void *data)
 
 		nb_channels = iio_device_get_channels_count(dev);
 
+		/* Read one attribute of the device, or of its first channel
+		 * which has some, between the buffers */
+		attr_chn = NULL;
+		attr = iio_device_get_attrs_count(dev) ?
+			iio_device_get_attr(dev, 0) : NULL;
+		for (i = 0; !attr && i < nb_channels; i++) {
+			attr_chn = iio_device_get_channel(dev, i);
+			if (iio_channel_get_attrs_count(attr_chn))
+				attr = iio_channel_get_attr(attr_chn, 0);
+		}
+
 		if (info->argc == info->arg_index + 2) {
 			/* Enable all channels */
 			for (i = 0; i < nb_channels; i++)
@@ -309,7 +469,20 @@ static void *client_thread(void *data)
 
 		i = 0;
 		while (threads_running || i == 0) {
+			if (attr) {
+				t0 = now_ns();
+				if (attr_chn)
+					ret = iio_channel_attr_read(attr_chn, attr,
+							attr_buf, sizeof(attr_buf));
+				else
+					ret = iio_device_attr_read(dev, attr,
+							attr_buf, sizeof(attr_buf));
+				if (ret >= 0)
+					hist_record(&stats->hist[OP_ATTR], now_ns() - t0);
+			}
+
 			info->buffers[id]++;
+			t0 = now_ns();
 			buffer = iio_device_create_buffer(dev, info->buffer_size, false);
 			if (!buffer) {
 				struct timespec wait;
@@ -319,14 +492,19 @@ static void *client_thread(void *data)
 				nanosleep(&wait, &wait);
 				continue;
 			}
-	
+
+			hist_record(&stats->hist[OP_BUFFER], now_ns() - t0);
+
 			while (threads_running || i == 0) {
+				t0 = now_ns();
 				ret = iio_buffer_refill(buffer);
 				thread_err(id, ret, "iio_buffer_refill failed");
 				if (ret < 0) {
 					threads_running = 0;
 					break;
 				}
+				hist_record(&stats->hist[OP_REFILL], now_ns() - t0);
+				stats->bytes += ret;
 				info->refills[id]++;
 				i = 1;
 
@@ -364,6 +542,7 @@ static void *client_thread(void *data)
 
 	if (info->verbose == VERYVERBOSE)
 		printf("%2d: Stopped normal\n", id);
+	stats->run_ns += now_ns() - t_start;
 	info->tid[id] = 0;
 	info->start[id][stamp].tv_sec = 0; info->start[id][stamp].tv_usec = 0;
 	return (void *)0;
@@ -371,17 +550,111 @@ static void *client_thread(void *data)
 thread_fail:
 	if (info->verbose == VERYVERBOSE)
 		printf("%2d: Stopped via error\n", id);
+	stats->run_ns += now_ns() - t_start;
 	info->tid[id] = 0;
 	info->start[id][stamp].tv_sec = 0; info->start[id][stamp].tv_usec = 0;
 	return (void *)EXIT_FAILURE;
 }
 
+/* The text reports are always printed when stopping, unless printing JSON */
+static bool print_text(const struct info *info, enum verbosity level)
+{
+	return !info->json && (!app_running || info->verbose >= level);
+}
+
+static void print_latencies(const struct info *info)
+{
+	struct latency_hist *total;
+	unsigned int i, op;
+
+	total = calloc(NB_OPS, sizeof(*total));
+	if (!total)
+		return;
+
+	for (i = 0; i < info->num_threads; i++)
+		for (op = 0; op < NB_OPS; op++)
+			hist_merge(&total[op], &info->stats[i].hist[op]);
+
+	printf("latency (us)      count      min      p50      p90      p99    p99.9      max\n");
+	for (op = 0; op < NB_OPS; op++) {
+		if (!total[op].count)
+			continue;
+
+		printf("%-15s %8" PRIu64 " %8.1f", latency_op_names[op],
+		       total[op].count, total[op].min / 1000.0);
+		for (i = 0; i < NB_PERCENTILES; i++)
+			printf(" %8.1f", hist_percentile(&total[op],
+						percentiles[i]) / 1000.0);
+		printf(" %8.1f\n", total[op].max / 1000.0);
+	}
+	printf("\n");
+
+	free(total);
+}
+
+static void print_json_hist(const struct latency_hist *hist)
+{
+	unsigned int i;
+
+	printf("{ \"count\": %" PRIu64, hist->count);
+	if (hist->count) {
+		printf(", \"min_ns\": %" PRIu64 ", \"mean_ns\": %" PRIu64,
+		       hist->min, hist->sum / hist->count);
+		for (i = 0; i < NB_PERCENTILES; i++)
+			printf(", \"p%g_ns\": %" PRIu64, percentiles[i],
+			       hist_percentile(hist, percentiles[i]));
+		printf(", \"max_ns\": %" PRIu64, hist->max);
+	}
+	printf(" }");
+}
+
+static void print_json(const struct info *info, unsigned int duration)
+{
+	const struct thread_stats *stats;
+	struct latency_hist *total;
+	uint64_t bytes = 0;
+	unsigned int i, op;
+
+	total = calloc(NB_OPS, sizeof(*total));
+	if (!total)
+		return;
+
+	printf("{\n\t\"duration_ms\": %u,\n\t\"threads\": [", duration);
+
+	for (i = 0; i < info->num_threads; i++) {
+		stats = &info->stats[i];
+		bytes += stats->bytes;
+
+		printf("%s\n\t\t{ \"id\": %u, \"contexts\": %u, \"buffers\": %u, "
+		       "\"refills\": %u, \"bytes\": %" PRIu64 ", \"mb_per_s\": %.3f }",
+		       i ? "," : "", i, info->starts[i], info->buffers[i],
+		       info->refills[i], stats->bytes, stats->run_ns ?
+		       (double) stats->bytes * 1000.0 / stats->run_ns : 0.0);
+
+		for (op = 0; op < NB_OPS; op++)
+			hist_merge(&total[op], &stats->hist[op]);
+	}
+
+	printf("\n\t],\n\t\"total\": { \"bytes\": %" PRIu64
+	       ", \"mb_per_s\": %.3f },\n\t\"latencies\": {", bytes,
+	       duration ? (double) bytes / 1000.0 / duration : 0.0);
+
+	for (op = 0; op < NB_OPS; op++) {
+		printf("%s\n\t\t\"%s\": ", op ? "," : "", latency_op_names[op]);
+		print_json_hist(&total[op]);
+	}
+
+	printf("\n\t}\n}\n");
+
+	free(total);
+}
+
 int main(int argc, char **argv)
 {
 	sigset_t set, oldset;
 	struct info info;
 	int option_index;
-	unsigned int i, duration;
+	unsigned int i, duration, total_duration;
 	int c, pret;
 	struct timeval start, end, s_loop;
 	void **ret;
@@ -401,6 +674,7 @@ int main(int argc, char **argv)
 	info.uri_index = 0;
 	info.timeout = UINT_MAX;
 	info.verbose = QUIET;
+	info.json = false;
 	info.argc = argc;
 	info.argv = argv;
 
@@ -408,7 +682,7 @@ int main(int argc, char **argv)
 	if(!min_samples)
 		min_samples = 128;
 
-	while ((c = getopt_long(argc, argv, "hvu:b:s:t:T:",
+	while ((c = getopt_long(argc, argv, "hvju:b:s:t:T:",
 					options, &option_index)) != -1) {
 		switch (c) {
 		case 'h':
@@ -441,6 +715,10 @@ int main(int argc, char **argv)
 				info.arg_index++;
 			info.verbose++;
 			break;
+		case 'j':
+			info.arg_index++;
+			info.json = true;
+			break;
 		case '?':
 			return EXIT_FAILURE;
 		}
@@ -516,6 +794,7 @@ int main(int argc, char **argv)
 	info.buffers = calloc(info.num_threads, sizeof(unsigned int));
 	info.refills = calloc(info.num_threads, sizeof(unsigned int));
 	info.start = calloc(info.num_threads, sizeof(struct timeval *));
+	info.stats = calloc(info.num_threads, sizeof(*info.stats));
 
 	ret = (void *)calloc(info.num_threads, sizeof(void *));
 
@@ -578,12 +857,13 @@ int main(int argc, char **argv)
 		gettimeofday(&end, NULL);
 		duration = ((end.tv_sec - s_loop.tv_sec) * 1000) +
 			((end.tv_usec - s_loop.tv_usec) / 1000);
+		total_duration = duration;
 
 		flag = 0;
 		threads_running = false;
 
 		/* let all the threads end */
-		if (!app_running || info.verbose >= SUMMARY)
+		if (print_text(&info, SUMMARY))
 			printf("-------------------------------------------------------------\n");
 		for (i = 0; i < info.num_threads; i++) {
 			pret = pthread_join(info.threads[i], &ret[i]);
@@ -610,22 +890,22 @@ int main(int argc, char **argv)
 			a+= info.starts[i];
 			b+= info.buffers[i];
 			c+= info.refills[i];
-			if (!app_running || info.verbose >= VERBOSE)
+			if (print_text(&info, VERBOSE))
 				printf("%2u: Ran : %u times, opening %u buffers, doing %u refills\n",
 						i, info.starts[i], info.buffers[i], info.refills[i]);
 		}
-		if (!app_running || info.verbose >= SUMMARY)
+		if (print_text(&info, SUMMARY))
 			printf("total: ");
 		i = duration/1000;
 		flag=0;
 		if (i > 60*60*24) {
-			if (!app_running || info.verbose >= SUMMARY)
+			if (print_text(&info, SUMMARY))
 				printf("%ud", i/(60*60*24));
 			i -= (i/(60*60*24))*60*60*24;
 			flag = 1;
 		}
 		if (flag || i > 60*60) {
-			if (!app_running || info.verbose >= SUMMARY) {
+			if (print_text(&info, SUMMARY)) {
 				if (flag)
 					printf("%02uh", i/(60*60));
 				else
@@ -635,7 +915,7 @@ int main(int argc, char **argv)
 			flag = 1;
 		}
 		if (flag || i > 60) {
-			if (!app_running || info.verbose >= SUMMARY) {
+			if (print_text(&info, SUMMARY)) {
 				if (flag)
 					printf("%02um", i/60);
 				else
@@ -645,11 +925,11 @@ int main(int argc, char **argv)
 			flag = 1;
 		}
 		if (flag || i) {
-			if (!app_running || info.verbose >= SUMMARY)
+			if (print_text(&info, SUMMARY))
 				printf("%02us", i);
 		}
 
-		if (!app_running || info.verbose >= SUMMARY) {
+		if (print_text(&info, SUMMARY)) {
 			printf(" Context : %i (%2.2f/s), buffers: %i (%2.2f/s), refills : %i (%2.2f/s)\n",
 					a, (double)a * 1000 / duration,
 					b, (double)b * 1000 / duration,
@@ -697,7 +977,7 @@ int main(int argc, char **argv)
 				histogram[7]++;
 		}
 		/* dump */
-		if (!app_running || info.verbose >= SUMMARY) {
+		if (print_text(&info, SUMMARY)) {
 			printf("    0        : %7zu (%5.2f%%)\n",
 					histogram[0],
 					(double)histogram[0]*100/histogram[8]);
@@ -723,9 +1003,14 @@ int main(int argc, char **argv)
 					histogram[7],
 					(double)histogram[7]*100/histogram[8]);
 			printf("\n");
+
+			print_latencies(&info);
 		}
 		free(sort);
 
+		if (info.json)
+			print_json(&info, total_duration);
+
 		/* if the app is still running, go again */
 	}
 
@@ -734,6 +1019,7 @@ int main(int argc, char **argv)
 	free(info.starts);
 	free(info.buffers);
 	free(info.refills);
+	free(info.stats);
 	for (i = 0; i < info.num_threads; i++)
 		free(info.start[i]);
 	free(info.start);
@@ -52,6 +52,9 @@ static const struct option options[] = {
 	  {"auto", no_argument, 0, 'a'},
 	  {"cyclic", no_argument, 0, 'c'},
 	  {"benchmark", no_argument, 0, 'B'},
+	  {"file", required_argument, 0, 'f'},
+	  {"mmap", no_argument, 0, 'm'},
+	  {"convert", no_argument, 0, 'C'},
 	  {0, 0, 0, 0},
 };
 
@@ -66,6 +69,11 @@ static const char *options_descriptions[] = {
 	"Use cyclic buffer mode.",
 	"Benchmark throughput."
 		"\n\t\t\tStatistics will be printed on the standard input.",
+	"Stream the samples of this file, read ahead from a separate thread,"
+		"\n\t\t\tinstead of the standard input.",
+	"Map the input file in memory instead of reading it.",
+	"The input file holds samples in host format, to be converted to"
+		"\n\t\t\tthe hardware format.",
 };
 
 static struct iio_context *ctx;
@@ -201,7 +209,446 @@ static ssize_t read_sample(const struct iio_channel *chn,
 	return (ssize_t) nb;
 }
 
-#define MY_OPTS "t:b:s:T:acB"
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Streaming mode: the samples of the input file are read and converted to the
+ * hardware format ahead of time, so that the pushes never wait for the file.
+ * On high-speed devices they are written straight into the hardware blocks,
+ * the kernel keeping the other blocks queued meanwhile; otherwise a separate
+ * thread fills a ring of buffers, each copied into the iio_buffer just before
+ * being pushed. A memory-mapped input is converted straight from the mapping.
+ */
+#define PLAYBACK_NB_SLOTS 4
+
+struct playback_chn {
+	const struct iio_channel *chn;
+	size_t in_offset, out_offset, length;
+};
+
+struct playback {
+	int fd;
+	char *map;
+	size_t map_len, map_pos;
+	bool convert, direct;
+	size_t left;
+
+	struct playback_chn *chns;
+	unsigned int nb_chns;
+	size_t in_frame, out_step, nb_frames;
+	char *in, *tmp, *tmp2;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *slots[PLAYBACK_NB_SLOTS];
+	size_t slot_len[PLAYBACK_NB_SLOTS];
+	unsigned int head, tail, count;
+	bool eof, stop;
+	int err;
+	uint64_t nb_underruns;
+};
+
+static int playback_open(struct playback *pb, const char *path,
+		bool use_mmap, bool convert, size_t nb_frames)
+{
+	const struct iio_device *dev = iio_buffer_get_device(buffer);
+	uintptr_t start = (uintptr_t) iio_buffer_start(buffer);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	size_t max_length = 0;
+	struct stat st;
+	int err;
+
+	memset(pb, 0, sizeof(*pb));
+	pb->convert = convert;
+	pb->nb_frames = nb_frames;
+	pb->out_step = (size_t) iio_buffer_step(buffer);
+	pb->left = num_samples ? num_samples : SIZE_MAX;
+
+	pb->chns = calloc(nb_channels, sizeof(*pb->chns));
+	if (!pb->chns)
+		return -ENOMEM;
+
+	/* The input holds the samples of the enabled channels, packed in the
+	 * order of iio_buffer_foreach_sample() */
+	for (i = 0; i < nb_channels; i++) {
+		const struct iio_channel *chn = iio_device_get_channel(dev, i);
+		const struct iio_data_format *fmt;
+		struct playback_chn *pc;
+
+		if (!iio_channel_is_enabled(chn))
+			continue;
+
+		fmt = iio_channel_get_data_format(chn);
+		pc = &pb->chns[pb->nb_chns++];
+		pc->chn = chn;
+		pc->length = fmt->length / 8 * fmt->repeat;
+		pc->in_offset = pb->in_frame;
+		pc->out_offset = (uintptr_t) iio_buffer_first(buffer, chn) - start;
+
+		pb->in_frame += pc->length;
+		if (pc->length > max_length)
+			max_length = pc->length;
+	}
+
+	/* Without conversion nor padding, the input is the hardware layout */
+	pb->direct = !convert && pb->in_frame == pb->out_step;
+	for (i = 0; pb->direct && i < pb->nb_chns; i++)
+		pb->direct = pb->chns[i].in_offset == pb->chns[i].out_offset;
+
+	if (convert) {
+		pb->tmp = malloc(nb_frames * max_length);
+		pb->tmp2 = malloc(nb_frames * max_length);
+		if (!pb->tmp || !pb->tmp2) {
+			err = -ENOMEM;
+			goto err_free;
+		}
+	}
+
+	pb->fd = open(path, O_RDONLY);
+	if (pb->fd < 0) {
+		err = -errno;
+		goto err_free;
+	}
+
+	if (use_mmap) {
+		if (fstat(pb->fd, &st) < 0) {
+			err = -errno;
+			goto err_close;
+		}
+
+		pb->map_len = (size_t) st.st_size;
+		pb->map = mmap(NULL, pb->map_len, PROT_READ,
+			       MAP_PRIVATE, pb->fd, 0);
+		if (pb->map == MAP_FAILED) {
+			err = -errno;
+			pb->map = NULL;
+			goto err_close;
+		}
+
+		posix_madvise(pb->map, pb->map_len, POSIX_MADV_SEQUENTIAL);
+	} else {
+		posix_fadvise(pb->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		pb->in = malloc(nb_frames * pb->in_frame);
+		if (!pb->in) {
+			err = -ENOMEM;
+			goto err_close;
+		}
+	}
+
+	return 0;
+
+err_close:
+	close(pb->fd);
+err_free:
+	free(pb->tmp2);
+	free(pb->tmp);
+	free(pb->chns);
+	return err;
+}
+
+static void playback_close(struct playback *pb)
+{
+	if (pb->map)
+		munmap(pb->map, pb->map_len);
+	close(pb->fd);
+	free(pb->in);
+	free(pb->tmp2);
+	free(pb->tmp);
+	free(pb->chns);
+}
+
+static int playback_read(int fd, char *dst, size_t len, size_t *read_len)
+{
+	ssize_t ret;
+
+	for (*read_len = 0; len; ) {
+		ret = read(fd, dst, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			break;
+
+		dst += ret;
+		len -= (size_t) ret;
+		*read_len += (size_t) ret;
+	}
+
+	return 0;
+}
+
+static void playback_convert(struct playback *pb, char *dst,
+		const char *src, size_t nb)
+{
+	const struct playback_chn *pc;
+	unsigned int i;
+	size_t j;
+
+	for (i = 0; i < pb->nb_chns; i++) {
+		pc = &pb->chns[i];
+
+		if (!pb->convert) {
+			for (j = 0; j < nb; j++)
+				memcpy(dst + j * pb->out_step + pc->out_offset,
+				       src + j * pb->in_frame + pc->in_offset,
+				       pc->length);
+			continue;
+		}
+
+		/* Gather the samples of the channel, to convert them all in
+		 * one call, then scatter them in the hardware layout */
+		for (j = 0; j < nb; j++)
+			memcpy(pb->tmp + j * pc->length,
+			       src + j * pb->in_frame + pc->in_offset,
+			       pc->length);
+
+		iio_channel_convert_inverse_block(pc->chn, pb->tmp2, pb->tmp, nb);
+
+		for (j = 0; j < nb; j++)
+			memcpy(dst + j * pb->out_step + pc->out_offset,
+			       pb->tmp2 + j * pc->length, pc->length);
+	}
+}
+
+/* Fill 'dst' with the next samples of the input, in the hardware layout.
+ * Returns the number of bytes written, or 0 at the end of the input. */
+static ssize_t playback_fill(struct playback *pb, char *dst)
+{
+	size_t len, nb = pb->nb_frames;
+	const char *src;
+	int ret;
+
+	if (nb > pb->left)
+		nb = pb->left;
+
+	if (pb->map) {
+		len = (pb->map_len - pb->map_pos) / pb->in_frame;
+		if (nb > len)
+			nb = len;
+
+		src = pb->map + pb->map_pos;
+		pb->map_pos += nb * pb->in_frame;
+
+		if (pb->direct)
+			memcpy(dst, src, nb * pb->in_frame);
+	} else {
+		src = pb->direct ? dst : pb->in;
+
+		ret = playback_read(pb->fd, (char *) src,
+				    nb * pb->in_frame, &len);
+		if (ret < 0)
+			return ret;
+
+		/* A truncated sample at the end of the file is dropped */
+		nb = len / pb->in_frame;
+	}
+
+	if (!pb->direct)
+		playback_convert(pb, dst, src, nb);
+
+	pb->left -= nb;
+	return (ssize_t) (nb * pb->out_step);
+}
+
+static void * playback_thd(void *d)
+{
+	struct playback *pb = d;
+	unsigned int slot;
+	ssize_t ret;
+
+	pthread_mutex_lock(&pb->lock);
+
+	while (!pb->stop) {
+		if (pb->count == PLAYBACK_NB_SLOTS) {
+			pthread_cond_wait(&pb->cond, &pb->lock);
+			continue;
+		}
+
+		slot = pb->head;
+		pthread_mutex_unlock(&pb->lock);
+
+		ret = playback_fill(pb, pb->slots[slot]);
+
+		pthread_mutex_lock(&pb->lock);
+
+		if (ret <= 0) {
+			pb->err = (int) ret;
+			pb->eof = true;
+			pthread_cond_broadcast(&pb->cond);
+			break;
+		}
+
+		pb->slot_len[slot] = (size_t) ret;
+		pb->head = (slot + 1) % PLAYBACK_NB_SLOTS;
+		pb->count++;
+		pthread_cond_broadcast(&pb->cond);
+	}
+
+	pthread_mutex_unlock(&pb->lock);
+
+	return NULL;
+}
+
+static int playback_ring(struct playback *pb, uint64_t *total)
+{
+	size_t len, buf_len = pb->nb_frames * pb->out_step;
+	unsigned int i, slot;
+	bool waited;
+	pthread_t thd;
+	ssize_t ret;
+
+	for (i = 0; i < PLAYBACK_NB_SLOTS; i++) {
+		pb->slots[i] = malloc(buf_len);
+		if (!pb->slots[i]) {
+			ret = -ENOMEM;
+			goto out_free_slots;
+		}
+	}
+
+	pthread_mutex_init(&pb->lock, NULL);
+	pthread_cond_init(&pb->cond, NULL);
+
+	ret = -pthread_create(&thd, NULL, playback_thd, pb);
+	if (ret)
+		goto out_destroy_lock;
+
+	pthread_mutex_lock(&pb->lock);
+
+	while (app_running) {
+		for (waited = false; !pb->count && !pb->eof; waited = true)
+			pthread_cond_wait(&pb->cond, &pb->lock);
+
+		if (!pb->count) {
+			ret = pb->err;
+			break;
+		}
+
+		/* The ring ran dry: the input did not keep up */
+		if (waited && *total)
+			pb->nb_underruns++;
+
+		slot = pb->tail;
+		len = pb->slot_len[slot];
+		pthread_mutex_unlock(&pb->lock);
+
+		memcpy(iio_buffer_start(buffer), pb->slots[slot], len);
+		ret = iio_buffer_push_partial(buffer, len / pb->out_step);
+
+		pthread_mutex_lock(&pb->lock);
+
+		if (ret < 0)
+			break;
+
+		*total += len;
+		pb->tail = (slot + 1) % PLAYBACK_NB_SLOTS;
+		pb->count--;
+		pthread_cond_broadcast(&pb->cond);
+	}
+
+	pb->stop = true;
+	pthread_cond_broadcast(&pb->cond);
+	pthread_mutex_unlock(&pb->lock);
+
+	pthread_join(thd, NULL);
+
+out_destroy_lock:
+	pthread_cond_destroy(&pb->cond);
+	pthread_mutex_destroy(&pb->lock);
+out_free_slots:
+	for (i = 0; i < PLAYBACK_NB_SLOTS; i++)
+		free(pb->slots[i]);
+	return (int) ret;
+}
+
+static int playback_blocks(struct playback *pb, struct iio_block *block,
+		uint64_t *total)
+{
+	ssize_t len;
+	int ret = 0;
+
+	while (app_running) {
+		if (!block) {
+			block = iio_buffer_dequeue_block(buffer);
+			if (!block)
+				return -errno;
+		}
+
+		len = playback_fill(pb, iio_block_start(block));
+		if (len <= 0)
+			return (int) len;
+
+		ret = iio_block_enqueue(block, (size_t) len);
+		if (ret < 0)
+			break;
+
+		*total += (uint64_t) len;
+		block = NULL;
+	}
+
+	return ret;
+}
+
+static int play_file(const char *path, bool use_mmap, bool convert,
+		size_t buffer_size, bool benchmark)
+{
+	struct iio_block *block;
+	struct playback pb;
+	uint64_t before, after, total = 0;
+	char buf[256];
+	int ret;
+
+	ret = playback_open(&pb, path, use_mmap, convert, buffer_size);
+	if (ret) {
+		iio_strerror(-ret, buf, sizeof(buf));
+		fprintf(stderr, "Unable to open %s: %s\n", path, buf);
+		return ret;
+	}
+
+	before = get_time_us();
+
+	/* Only high-speed devices hand out their blocks */
+	block = iio_buffer_dequeue_block(buffer);
+	if (block)
+		ret = playback_blocks(&pb, block, &total);
+	else if (errno == ENOSYS)
+		ret = playback_ring(&pb, &total);
+	else
+		ret = -errno;
+
+	after = get_time_us();
+
+	if (ret < 0 && app_running) {
+		iio_strerror(-ret, buf, sizeof(buf));
+		fprintf(stderr, "Unable to play %s: %s\n", path, buf);
+	}
+
+	if (pb.nb_underruns)
+		fprintf(stderr, "The input did not keep up %" PRIu64 " times\n",
+			pb.nb_underruns);
+
+	if (benchmark && after > before)
+		fprintf(stderr, "Played %" PRIu64 " bytes at %" PRIu64 " KiB/s\n",
+			total, total * (uint64_t) 1000000 /
+			((after - before) * 1024));
+
+	playback_close(&pb);
+
+	return ret;
+}
+
+#endif /* !_WIN32 */
+
+#define MY_OPTS "t:b:s:T:acBf:mC"
 
 int main(int argc, char **argv)
 {
@@ -216,6 +663,8 @@ int main(int argc, char **argv)
 	ssize_t ret;
 	struct option *opts;
 	uint64_t before, after, rate, total;
+	const char *input = NULL;
+	bool use_mmap = false, convert = false;
 
 	argw = dup_argv(MY_NAME, argc, argv);
 
@@ -268,6 +717,24 @@ int main(int argc, char **argv)
 		case 'c':
 			cyclic_buffer = true;
 			break;
+		case 'f':
+			if (!optarg) {
+				fprintf(stderr, "Input file requires argument\n");
+				return EXIT_FAILURE;
+			}
+#ifdef _WIN32
+			fprintf(stderr, "Streaming is not supported on Windows\n");
+			return EXIT_FAILURE;
+#else
+			input = optarg;
+			break;
+#endif
+		case 'm':
+			use_mmap = true;
+			break;
+		case 'C':
+			convert = true;
+			break;
 		case '?':
 			printf("Unknown argument '%c'\n", c);
 			return EXIT_FAILURE;
@@ -290,6 +757,18 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	if (input && cyclic_buffer) {
+		fprintf(stderr, "Cannot stream a file in cyclic mode.\n");
+		iio_context_destroy(ctx);
+		return EXIT_FAILURE;
+	}
+
+	if ((use_mmap || convert) && !input) {
+		fprintf(stderr, "The mmap and convert options require an input file.\n");
+		iio_context_destroy(ctx);
+		return EXIT_FAILURE;
+	}
+
 	setup_sig_handler();
 
 	dev = iio_context_find_device(ctx, argw[optind]);
@@ -394,6 +873,13 @@ int main(int argc, char **argv)
 
 #ifdef _WIN32
 	_setmode(_fileno( stdin ), _O_BINARY);
+#else
+	if (input) {
+		ret = play_file(input, use_mmap, convert, buffer_size, benchmark);
+		if (ret < 0)
+			exit_code = EXIT_FAILURE;
+		goto err_destroy_buffer;
+	}
 #endif
 
 	for (i = 0, total = 0; app_running; ) {
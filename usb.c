@@ -34,11 +34,16 @@ struct iio_usb_ep_couple {
 };
 
 struct iiod_client_pdata {
+	struct iiod_client_conn conn;
+
 	struct iio_usb_ep_couple *ep;
 
 	struct iio_mutex *lock;
 	bool cancelled;
 	struct libusb_transfer *transfer;
+
+	/* Streaming mode, see usb_stream_enable() */
+	struct usb_stream *stream_in, *stream_out;
 };
 
 struct iio_context_pdata {
@@ -64,6 +69,9 @@ struct iio_device_pdata {
 
 	bool opened;
 	struct iiod_client_pdata io_ctx;
+
+	unsigned int nb_transfers;
+	size_t transfer_size;
 };
 
 static const unsigned int libusb_to_errno_codes[] = {
@@ -206,6 +214,454 @@ static int usb_close_pipe(struct iio_context_pdata *pdata, uint16_t pipe_id)
 	return 0;
 }
 
+/*
+ * Streaming mode, see iio_device_set_transfers(): a ring of transfers,
+ * allocated once, is kept submitted on each endpoint of the device, so that
+ * the bus never idles between two of them.
+ *
+ * The IN endpoint is read as a byte stream. A bulk IN transfer only
+ * completes once full, or on a short packet; so that a transfer never waits
+ * for bytes that won't come, the transfers in flight never ask for more
+ * than what the caller expects. When a short transfer made the next ones
+ * ask for too much, the one at the head is cancelled once idle, which
+ * returns the bytes it already received.
+ *
+ * OUT transfers are submitted as soon as filled; the errors are reported by
+ * the write that reuses the transfer, or when the stream is flushed.
+ *
+ * Where the platform supports it, the memory of the transfers is allocated
+ * by the kernel and mapped, so that it is not copied to or from the URBs.
+ */
+#define USB_STREAM_MAX_TRANSFERS 64
+#define USB_STREAM_DEFAULT_SIZE (256 * 1024)
+#define USB_STREAM_POLL_MS 10
+
+struct usb_stream_xfer {
+	struct libusb_transfer *transfer;
+	int completed;
+	bool dev_mem;
+};
+
+struct usb_stream {
+	struct usb_stream_xfer *xfers;
+	unsigned int nb, head, count;
+	size_t size;
+
+	/* IN: bytes asked for by the transfers in flight and not read yet,
+	 * and bytes of the head transfer already read */
+	size_t pending, offset;
+};
+
+static void LIBUSB_CALL usb_stream_cb(struct libusb_transfer *transfer)
+{
+	struct usb_stream_xfer *xfer = transfer->user_data;
+
+	xfer->completed = 1;
+}
+
+static int usb_stream_status(const struct libusb_transfer *transfer)
+{
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return -ETIMEDOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return -EPIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return -ENODEV;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return -EBADF;
+	default:
+		return -EIO;
+	}
+}
+
+/* Waits for the transfer for up to 'nb_polls' periods of
+ * USB_STREAM_POLL_MS, or forever if 0 */
+static int usb_stream_wait(struct iio_context_pdata *pdata,
+		struct usb_stream_xfer *xfer, unsigned int nb_polls)
+{
+	struct timeval tv = { .tv_usec = USB_STREAM_POLL_MS * 1000, };
+	unsigned int i;
+	int ret;
+
+	for (i = 0; !xfer->completed && (!nb_polls || i < nb_polls); i++) {
+		ret = libusb_handle_events_timeout_completed(pdata->ctx,
+				&tv, &xfer->completed);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+			return -(int) libusb_to_errno(ret);
+	}
+
+	return xfer->completed ? 0 : -ETIMEDOUT;
+}
+
+static unsigned int usb_stream_nb_polls(const struct iio_context_pdata *pdata)
+{
+	if (!pdata->timeout_ms)
+		return 0;
+
+	return (pdata->timeout_ms + USB_STREAM_POLL_MS - 1) / USB_STREAM_POLL_MS;
+}
+
+static int usb_stream_submit(struct iiod_client_pdata *io_ctx,
+		struct usb_stream *stream, size_t len)
+{
+	struct usb_stream_xfer *xfer;
+	int ret = -EBADF;
+
+	xfer = &stream->xfers[(stream->head + stream->count) % stream->nb];
+	xfer->completed = 0;
+	xfer->transfer->length = (int) len;
+
+	/* Atomic in regards to usb_cancel(), see usb_sync_transfer() */
+	iio_mutex_lock(io_ctx->lock);
+	if (!io_ctx->cancelled) {
+		ret = libusb_submit_transfer(xfer->transfer);
+		if (ret)
+			ret = -(int) libusb_to_errno(ret);
+		else
+			stream->count++;
+	}
+	iio_mutex_unlock(io_ctx->lock);
+
+	return ret;
+}
+
+static void usb_stream_release_head(struct usb_stream *stream)
+{
+	stream->head = (stream->head + 1) % stream->nb;
+	stream->count--;
+	stream->offset = 0;
+}
+
+static unsigned char * usb_stream_alloc_mem(struct iio_context_pdata *pdata,
+		struct usb_stream_xfer *xfer, size_t size)
+{
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	unsigned char *buf = libusb_dev_mem_alloc(pdata->hdl, size);
+
+	/* Not supported by all the platforms and kernels */
+	xfer->dev_mem = !!buf;
+	if (buf)
+		return buf;
+#endif
+
+	return malloc(size);
+}
+
+static void usb_stream_free_mem(struct iio_context_pdata *pdata,
+		struct usb_stream_xfer *xfer, unsigned char *buf, size_t size)
+{
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	if (xfer->dev_mem) {
+		libusb_dev_mem_free(pdata->hdl, buf, size);
+		return;
+	}
+#endif
+
+	free(buf);
+}
+
+static void usb_stream_free(struct iio_context_pdata *pdata,
+		struct usb_stream *stream)
+{
+	struct usb_stream_xfer *xfer;
+	unsigned int i;
+
+	for (i = 0; i < stream->count; i++) {
+		xfer = &stream->xfers[(stream->head + i) % stream->nb];
+		libusb_cancel_transfer(xfer->transfer);
+	}
+
+	for (i = 0; i < stream->count; i++) {
+		xfer = &stream->xfers[(stream->head + i) % stream->nb];
+		while (usb_stream_wait(pdata, xfer, 0) < 0 && !xfer->completed);
+	}
+
+	for (i = 0; stream->xfers && i < stream->nb; i++) {
+		if (!stream->xfers[i].transfer)
+			break;
+
+		usb_stream_free_mem(pdata, &stream->xfers[i],
+				    stream->xfers[i].transfer->buffer,
+				    stream->size);
+		libusb_free_transfer(stream->xfers[i].transfer);
+	}
+
+	free(stream->xfers);
+	free(stream);
+}
+
+static struct usb_stream * usb_stream_new(struct iio_context_pdata *pdata,
+		unsigned char ep, unsigned int nb, size_t size,
+		unsigned int timeout_ms)
+{
+	struct usb_stream *stream;
+	unsigned char *buf;
+	unsigned int i;
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream)
+		return NULL;
+
+	stream->nb = nb;
+	stream->size = size;
+
+	stream->xfers = calloc(nb, sizeof(*stream->xfers));
+	if (!stream->xfers)
+		goto err_free_stream;
+
+	for (i = 0; i < nb; i++) {
+		struct usb_stream_xfer *xfer = &stream->xfers[i];
+
+		buf = usb_stream_alloc_mem(pdata, xfer, size);
+		if (!buf)
+			goto err_free_stream;
+
+		xfer->transfer = libusb_alloc_transfer(0);
+		if (!xfer->transfer) {
+			usb_stream_free_mem(pdata, xfer, buf, size);
+			goto err_free_stream;
+		}
+
+		libusb_fill_bulk_transfer(xfer->transfer, pdata->hdl, ep,
+				buf, (int) size, usb_stream_cb, xfer,
+				timeout_ms);
+	}
+
+	return stream;
+
+err_free_stream:
+	usb_stream_free(pdata, stream);
+	return NULL;
+}
+
+static ssize_t usb_stream_read(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, char *dst, size_t len,
+		bool line)
+{
+	struct usb_stream *stream = io_ctx->stream_in;
+	struct libusb_transfer *transfer;
+	struct usb_stream_xfer *xfer;
+	size_t avail;
+	char *end;
+	int ret;
+
+	if (!len)
+		return 0;
+
+	while (true) {
+		while (stream->count < stream->nb && stream->pending < len) {
+			size_t size = len - stream->pending;
+
+			if (size > stream->size)
+				size = stream->size;
+
+			ret = usb_stream_submit(io_ctx, stream, size);
+			if (ret < 0)
+				return ret;
+
+			stream->pending += size;
+		}
+
+		xfer = &stream->xfers[stream->head];
+		transfer = xfer->transfer;
+
+		if ((size_t) transfer->length <= len || line) {
+			ret = usb_stream_wait(pdata, xfer,
+					      usb_stream_nb_polls(pdata));
+		} else {
+			/* This transfer may never fill up: get what it
+			 * received so far once the link is idle */
+			ret = usb_stream_wait(pdata, xfer, 1);
+			if (ret == -ETIMEDOUT) {
+				libusb_cancel_transfer(transfer);
+				ret = usb_stream_wait(pdata, xfer, 0);
+			}
+		}
+		if (ret < 0)
+			return ret;
+
+		ret = usb_stream_status(transfer);
+		if (ret == -EBADF && !io_ctx->cancelled)
+			ret = 0;
+		if (ret < 0)
+			return ret;
+
+		avail = (size_t) transfer->actual_length - stream->offset;
+		if (avail)
+			break;
+
+		/* Nothing received, or all of it read: recycle it */
+		stream->pending -= (size_t) transfer->length - stream->offset;
+		usb_stream_release_head(stream);
+	}
+
+	if (avail > len)
+		avail = len;
+
+	if (line) {
+		end = memchr(transfer->buffer + stream->offset, '\n', avail);
+		if (end)
+			avail = (size_t) (end - (char *) transfer->buffer)
+				- stream->offset + 1;
+	}
+
+	memcpy(dst, transfer->buffer + stream->offset, avail);
+	stream->offset += avail;
+	stream->pending -= avail;
+
+	if (stream->offset == (size_t) transfer->actual_length) {
+		stream->pending -= (size_t) (transfer->length
+					     - transfer->actual_length);
+		usb_stream_release_head(stream);
+	}
+
+	return (ssize_t) avail;
+}
+
+/* The IIOD client expects a whole line, which may span several transfers */
+static ssize_t usb_stream_read_line(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, char *dst, size_t len)
+{
+	size_t i = 0;
+	ssize_t ret;
+
+	while (i < len) {
+		ret = usb_stream_read(pdata, io_ctx, dst + i, len - i, true);
+		if (ret < 0)
+			return ret;
+
+		i += (size_t) ret;
+		if (dst[i - 1] == '\n')
+			break;
+	}
+
+	return (ssize_t) i;
+}
+
+static ssize_t usb_stream_write(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, const char *src, size_t len)
+{
+	struct usb_stream *stream = io_ctx->stream_out;
+	struct usb_stream_xfer *xfer;
+	int ret;
+
+	if (!len)
+		return 0;
+
+	/* Reap the completed transfers, or wait for one to be free */
+	while (stream->count) {
+		xfer = &stream->xfers[stream->head];
+
+		if (stream->count == stream->nb) {
+			ret = usb_stream_wait(pdata, xfer, 0);
+			if (ret < 0)
+				return ret;
+		} else if (!xfer->completed) {
+			break;
+		}
+
+		usb_stream_release_head(stream);
+
+		ret = usb_stream_status(xfer->transfer);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (len > stream->size)
+		len = stream->size;
+
+	xfer = &stream->xfers[(stream->head + stream->count) % stream->nb];
+	memcpy(xfer->transfer->buffer, src, len);
+
+	ret = usb_stream_submit(io_ctx, stream, len);
+	if (ret < 0)
+		return ret;
+
+	return (ssize_t) len;
+}
+
+/* Waits for all the OUT transfers to be completed */
+static int usb_stream_flush(struct iio_context_pdata *pdata,
+		struct usb_stream *stream)
+{
+	struct usb_stream_xfer *xfer;
+	int ret, err = 0;
+
+	while (stream->count) {
+		xfer = &stream->xfers[stream->head];
+
+		ret = usb_stream_wait(pdata, xfer, 0);
+		if (ret < 0)
+			return ret;
+
+		usb_stream_release_head(stream);
+
+		ret = usb_stream_status(xfer->transfer);
+		if (ret < 0 && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+/* Called with the lock of the device held */
+static void usb_stream_disable(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx)
+{
+	struct usb_stream *in = io_ctx->stream_in, *out = io_ctx->stream_out;
+
+	iio_mutex_lock(io_ctx->lock);
+	io_ctx->stream_in = NULL;
+	io_ctx->stream_out = NULL;
+	iio_mutex_unlock(io_ctx->lock);
+
+	if (out) {
+		usb_stream_flush(pdata, out);
+		usb_stream_free(pdata, out);
+	}
+
+	if (in)
+		usb_stream_free(pdata, in);
+}
+
+/* Called with the lock of the device held */
+static int usb_stream_enable(struct iio_context_pdata *pdata,
+		struct iiod_client_pdata *io_ctx, unsigned int nb, size_t size)
+{
+	struct usb_stream *in, *out;
+
+	in = usb_stream_new(pdata, io_ctx->ep->addr_in, nb, size, 0);
+	if (!in)
+		return -ENOMEM;
+
+	out = usb_stream_new(pdata, io_ctx->ep->addr_out, nb, size,
+			     pdata->timeout_ms);
+	if (!out) {
+		usb_stream_free(pdata, in);
+		return -ENOMEM;
+	}
+
+	iio_mutex_lock(io_ctx->lock);
+	io_ctx->stream_in = in;
+	io_ctx->stream_out = out;
+	iio_mutex_unlock(io_ctx->lock);
+
+	return 0;
+}
+
+static void usb_stream_cancel(struct usb_stream *stream)
+{
+	unsigned int i;
+
+	for (i = 0; i < stream->count; i++) {
+		libusb_cancel_transfer(
+			stream->xfers[(stream->head + i) % stream->nb].transfer);
+	}
+}
+
 static int usb_reserve_ep_unlocked(const struct iio_device *dev)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
@@ -282,6 +738,14 @@ static int usb_open(const struct iio_device *dev,
 				&pdata->io_ctx, remote_timeout);
 	}
 
+	if (!ret && pdata->nb_transfers) {
+		ret = usb_stream_enable(ctx_pdata, &pdata->io_ctx,
+				pdata->nb_transfers, pdata->transfer_size);
+		if (ret)
+			iiod_client_close_unlocked(ctx_pdata->iiod_client,
+					&pdata->io_ctx, dev);
+	}
+
 	pdata->opened = !ret;
 
 	iio_mutex_unlock(pdata->lock);
@@ -311,6 +775,8 @@ static int usb_close(const struct iio_device *dev)
 			dev);
 	pdata->opened = false;
 
+	usb_stream_disable(ctx_pdata, &pdata->io_ctx);
+
 	iio_mutex_unlock(pdata->lock);
 
 	usb_close_pipe(ctx_pdata, pdata->io_ctx.ep->pipe_id);
@@ -392,6 +858,14 @@ static ssize_t usb_write_chn_attr(const struct iio_channel *chn,
 			src, len, false);
 }
 
+static int usb_set_attr_cache(struct iio_context *ctx,
+		const char *attr, int ttl_ms)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
+
+	return iiod_client_set_attr_cache(pdata->iiod_client, attr, ttl_ms);
+}
+
 static int usb_set_kernel_buffers_count(const struct iio_device *dev,
 		unsigned int nb_blocks)
 {
@@ -401,6 +875,14 @@ static int usb_set_kernel_buffers_count(const struct iio_device *dev,
 			&pdata->io_ctx, dev, nb_blocks);
 }
 
+static int usb_set_low_latency(const struct iio_device *dev, bool enable)
+{
+	struct iio_context_pdata *pdata = iio_context_get_pdata(dev->ctx);
+
+	return iiod_client_set_low_latency(pdata->iiod_client,
+			&pdata->io_ctx, dev, enable);
+}
+
 static int usb_set_timeout(struct iio_context *ctx, unsigned int timeout)
 {
 	struct iio_context_pdata *pdata = iio_context_get_pdata(ctx);
@@ -415,6 +897,21 @@ static int usb_set_timeout(struct iio_context *ctx, unsigned int timeout)
 	return ret;
 }
 
+static int usb_get_timestamp(const struct iio_device *dev,
+		uint64_t *timestamp)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret;
+
+	iio_mutex_lock(pdata->lock);
+	ret = iiod_client_get_timestamp_unlocked(ctx_pdata->iiod_client,
+			&pdata->io_ctx, dev, timestamp);
+	iio_mutex_unlock(pdata->lock);
+
+	return ret;
+}
+
 static int usb_get_trigger(const struct iio_device *dev,
                 const struct iio_device **trigger)
 {
@@ -534,10 +1031,39 @@ static void usb_cancel(const struct iio_device *dev)
 	iio_mutex_lock(ppdata->io_ctx.lock);
 	if (ppdata->io_ctx.transfer && !ppdata->io_ctx.cancelled)
 		libusb_cancel_transfer(ppdata->io_ctx.transfer);
+	if (ppdata->io_ctx.stream_in && !ppdata->io_ctx.cancelled)
+		usb_stream_cancel(ppdata->io_ctx.stream_in);
+	if (ppdata->io_ctx.stream_out && !ppdata->io_ctx.cancelled)
+		usb_stream_cancel(ppdata->io_ctx.stream_out);
 	ppdata->io_ctx.cancelled = true;
 	iio_mutex_unlock(ppdata->io_ctx.lock);
 }
 
+static int usb_set_transfers(const struct iio_device *dev,
+		unsigned int nb_transfers, size_t transfer_size)
+{
+	struct iio_context_pdata *ctx_pdata = iio_context_get_pdata(dev->ctx);
+	struct iio_device_pdata *pdata = dev->pdata;
+	int ret = -EBUSY;
+
+	if (nb_transfers > USB_STREAM_MAX_TRANSFERS ||
+	    transfer_size > 1 * 1024 * 1024)
+		return -EINVAL;
+
+	if (!transfer_size)
+		transfer_size = USB_STREAM_DEFAULT_SIZE;
+
+	iio_mutex_lock(ctx_pdata->ep_lock);
+	if (!pdata->opened) {
+		pdata->nb_transfers = nb_transfers;
+		pdata->transfer_size = transfer_size;
+		ret = 0;
+	}
+	iio_mutex_unlock(ctx_pdata->ep_lock);
+
+	return ret;
+}
+
 static const struct iio_backend_ops usb_ops = {
 	.get_version = usb_get_version,
 	.open = usb_open,
@@ -548,10 +1074,14 @@ static const struct iio_backend_ops usb_ops = {
 	.read_channel_attr = usb_read_chn_attr,
 	.write_device_attr = usb_write_dev_attr,
 	.write_channel_attr = usb_write_chn_attr,
+	.get_timestamp = usb_get_timestamp,
 	.get_trigger = usb_get_trigger,
 	.set_trigger = usb_set_trigger,
 	.set_kernel_buffers_count = usb_set_kernel_buffers_count,
+	.set_low_latency = usb_set_low_latency,
 	.set_timeout = usb_set_timeout,
+	.set_transfers = usb_set_transfers,
+	.set_attr_cache = usb_set_attr_cache,
 	.shutdown = usb_shutdown,
 
 	.cancel = usb_cancel,
@@ -674,6 +1204,9 @@ static ssize_t write_data_sync(struct iio_context_pdata *pdata,
 {
 	int transferred, ret;
 
+	if (ep->stream_out)
+		return usb_stream_write(pdata, ep, data, len);
+
 	ret = usb_sync_transfer(pdata, ep, LIBUSB_ENDPOINT_OUT, (char *) data,
 			len, &transferred);
 	if (ret)
@@ -688,6 +1221,9 @@ static ssize_t read_data_sync(struct iio_context_pdata *pdata,
 {
 	int transferred, ret;
 
+	if (ep->stream_in)
+		return usb_stream_read(pdata, ep, buf, len, false);
+
 	ret = usb_sync_transfer(pdata, ep, LIBUSB_ENDPOINT_IN, buf, len,
 			&transferred);
 	if (ret)
@@ -696,10 +1232,20 @@ static ssize_t read_data_sync(struct iio_context_pdata *pdata,
 		return transferred;
 }
 
+static ssize_t read_line_sync(struct iio_context_pdata *pdata,
+			      struct iiod_client_pdata *ep,
+			      char *buf, size_t len)
+{
+	if (ep->stream_in)
+		return usb_stream_read_line(pdata, ep, buf, len);
+
+	return read_data_sync(pdata, ep, buf, len);
+}
+
 static const struct iiod_client_ops usb_iiod_client_ops = {
 	.write = write_data_sync,
 	.read = read_data_sync,
-	.read_line = read_data_sync,
+	.read_line = read_line_sync,
 };
 
 static int usb_verify_eps(const struct libusb_interface_descriptor *iface)
@@ -20,6 +20,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #if defined(_WIN32) || \
 		(defined(__APPLE__) && defined(__MACH__)) || \
 		(defined(__USE_XOPEN2K8) && \
@@ -330,3 +336,36 @@ ssize_t __iio_printf iio_snprintf(char *buf, size_t len, const char *fmt, ...)
 
 	return (ssize_t)ret;
 }
+
+/* Monotonic time in milliseconds, to measure timeouts and TTLs */
+uint64_t iio_time_ms(void)
+{
+#ifdef _WIN32
+	return (uint64_t) GetTickCount64();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Monotonic time in nanoseconds, to measure short operations */
+uint64_t iio_time_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+
+	return (uint64_t) (count.QuadPart / freq.QuadPart) * 1000000000ull +
+		(uint64_t) (count.QuadPart % freq.QuadPart) * 1000000000ull /
+		(uint64_t) freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+#endif
+}
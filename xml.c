@@ -7,31 +7,66 @@
  */
 
 #include "debug.h"
+#include "iio-config.h"
 #include "iio-private.h"
 
 #include <errno.h>
-#include <libxml/tree.h>
+#include <libxml/parser.h>
+#include <stdio.h>
 #include <string.h>
 
-static int add_attr_to_channel(struct iio_channel *chn, xmlNode *n)
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * The context is built as the XML is parsed, from the SAX events of a push
+ * parser, without building the document tree first; so the XML can be
+ * fed in chunks, as it is read or uncompressed.
+ *
+ * The attributes of an element are handed to the handlers below as a
+ * NULL-terminated array of name/value pairs.
+ */
+
+#define XML_MAX_ATTRS 8
+#define XML_CHUNK_SIZE (16 * 1024)
+
+struct xml_parser {
+	xmlParserCtxtPtr xml;
+	struct iio_context *ctx;
+	struct iio_device *dev;
+	struct iio_channel *chn;
+
+	/* Depth of the current element, the root node being at depth 1 */
+	unsigned int depth;
+	int err;
+
+	/* Storage of the attributes of the current element */
+	const char *atts[2 * XML_MAX_ATTRS + 1];
+	char *strings;
+	size_t strings_size;
+};
+
+static int add_attr_to_channel(struct iio_channel *chn, const char **atts)
 {
-	xmlAttr *attr;
 	char *name = NULL, *filename = NULL;
 	struct iio_channel_attr *attrs;
 	int err = -ENOMEM;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			name = iio_strdup((char *) attr->children->content);
+	for (; *atts; atts += 2) {
+		if (!strcmp(atts[0], "name")) {
+			free(name);
+			name = iio_strdup(atts[1]);
 			if (!name)
 				goto err_free;
-		} else if (!strcmp((char *) attr->name, "filename")) {
-			filename = iio_strdup((char *) attr->children->content);
+		} else if (!strcmp(atts[0], "filename")) {
+			free(filename);
+			filename = iio_strdup(atts[1]);
 			if (!filename)
 				goto err_free;
 		} else {
 			IIO_DEBUG("Unknown field \'%s\' in channel %s\n",
-				  attr->name, chn->id);
+				  atts[0], chn->id);
 		}
 	}
 
@@ -63,17 +98,17 @@ err_free:
 	return err;
 }
 
-static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_type type)
+static int add_attr_to_device(struct iio_device *dev, const char **atts,
+			      enum iio_attr_type type)
 {
-	xmlAttr *attr;
-	char *name = NULL;
+	const char *name = NULL;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			name = (char *) attr->children->content;
+	for (; *atts; atts += 2) {
+		if (!strcmp(atts[0], "name")) {
+			name = atts[1];
 		} else {
 			IIO_DEBUG("Unknown field \'%s\' in device %s\n",
-				  attr->name, dev->id);
+				  atts[0], dev->id);
 		}
 	}
 
@@ -94,14 +129,12 @@ static int add_attr_to_device(struct iio_device *dev, xmlNode *n, enum iio_attr_
 	}
 }
 
-static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
+static int setup_scan_element(struct iio_channel *chn, const char **atts)
 {
-	xmlAttr *attr;
 	int err;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		const char *name = (const char *) attr->name,
-		      *content = (const char *) attr->children->content;
+	for (; *atts; atts += 2) {
+		const char *name = atts[0], *content = atts[1];
 		if (!strcmp(name, "index")) {
 			char *end;
 			long long value;
@@ -159,6 +192,16 @@ static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
 
 			chn->format.with_scale = true;
 			chn->format.scale = value;
+		} else if (!strcmp(name, "offset")) {
+			char *end;
+			float value;
+
+			errno = 0;
+			value = strtof(content, &end);
+			if (end == content || errno == ERANGE)
+				return -EINVAL;
+
+			chn->format.offset = value;
 		} else {
 			IIO_DEBUG("Unknown attribute \'%s\' in <scan-element>\n",
 				  name);
@@ -168,9 +211,10 @@ static int setup_scan_element(struct iio_channel *chn, xmlNode *n)
 	return 0;
 }
 
-static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
+/* The children of the channel are added by xml_start_element() */
+static struct iio_channel * create_channel(struct iio_device *dev,
+					   const char **atts)
 {
-	xmlAttr *attr;
 	struct iio_channel *chn;
 	int err = -ENOMEM;
 
@@ -183,14 +227,15 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 	/* Set the default index value < 0 (== no index) */
 	chn->index = -ENOENT;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		const char *name = (const char *) attr->name,
-		      *content = (const char *) attr->children->content;
+	for (; *atts; atts += 2) {
+		const char *name = atts[0], *content = atts[1];
 		if (!strcmp(name, "name")) {
+			free(chn->name);
 			chn->name = iio_strdup(content);
 			if (!chn->name)
 				goto err_free_channel;
 		} else if (!strcmp(name, "id")) {
+			free(chn->id);
 			chn->id = iio_strdup(content);
 			if (!chn->id)
 				goto err_free_channel;
@@ -211,25 +256,6 @@ static struct iio_channel * create_channel(struct iio_device *dev, xmlNode *n)
 		goto err_free_channel;
 	}
 
-	for (n = n->children; n; n = n->next) {
-		if (!strcmp((char *) n->name, "attribute")) {
-			err = add_attr_to_channel(chn, n);
-			if (err < 0)
-				goto err_free_channel;
-		} else if (!strcmp((char *) n->name, "scan-element")) {
-			chn->is_scan_element = true;
-			err = setup_scan_element(chn, n);
-			if (err < 0)
-				goto err_free_channel;
-		} else if (strcmp((char *) n->name, "text")) {
-			IIO_DEBUG("Unknown children \'%s\' in <channel>\n",
-				  n->name);
-			continue;
-		}
-	}
-
-	iio_channel_init_finalize(chn);
-
 	return chn;
 
 err_free_channel:
@@ -237,9 +263,29 @@ err_free_channel:
 	return ERR_PTR(err);
 }
 
-static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
+static int add_channel_to_device(struct iio_device *dev,
+				 struct iio_channel *chn)
+{
+	struct iio_channel **chns;
+
+	chns = realloc(dev->channels, (1 + dev->nb_channels) *
+			sizeof(struct iio_channel *));
+	if (!chns) {
+		IIO_ERROR("Unable to allocate memory\n");
+		return -ENOMEM;
+	}
+
+	iio_channel_init_finalize(chn);
+
+	chns[dev->nb_channels++] = chn;
+	dev->channels = chns;
+	return 0;
+}
+
+/* The children of the device are added by xml_start_element() */
+static struct iio_device * create_device(struct iio_context *ctx,
+					 const char **atts)
 {
-	xmlAttr *attr;
 	struct iio_device *dev;
 	int err = -ENOMEM;
 
@@ -249,23 +295,25 @@ static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 
 	dev->ctx = ctx;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((char *) attr->name, "name")) {
-			dev->name = iio_strdup(
-					(char *) attr->children->content);
+	for (; *atts; atts += 2) {
+		if (!strcmp(atts[0], "name")) {
+			free(dev->name);
+			dev->name = iio_strdup(atts[1]);
 			if (!dev->name)
 				goto err_free_device;
-		} else if (!strcmp((char *) attr->name, "label")) {
-			dev->label = iio_strdup((char *) attr->children->content);
+		} else if (!strcmp(atts[0], "label")) {
+			free(dev->label);
+			dev->label = iio_strdup(atts[1]);
 			if (!dev->label)
 				goto err_free_device;
-		} else if (!strcmp((char *) attr->name, "id")) {
-			dev->id = iio_strdup((char *) attr->children->content);
+		} else if (!strcmp(atts[0], "id")) {
+			free(dev->id);
+			dev->id = iio_strdup(atts[1]);
 			if (!dev->id)
 				goto err_free_device;
 		} else {
 			IIO_DEBUG("Unknown attribute \'%s\' in <device>\n",
-				  attr->name);
+				  atts[0]);
 		}
 	}
 
@@ -275,61 +323,25 @@ static struct iio_device * create_device(struct iio_context *ctx, xmlNode *n)
 		goto err_free_device;
 	}
 
-	for (n = n->children; n; n = n->next) {
-		if (!strcmp((char *) n->name, "channel")) {
-			struct iio_channel **chns,
-					   *chn = create_channel(dev, n);
-			if (IS_ERR(chn)) {
-				err = PTR_ERR(chn);
-				IIO_ERROR("Unable to create channel: %d\n", err);
-				goto err_free_device;
-			}
+	return dev;
 
-			chns = realloc(dev->channels, (1 + dev->nb_channels) *
-					sizeof(struct iio_channel *));
-			if (!chns) {
-				err = -ENOMEM;
-				IIO_ERROR("Unable to allocate memory\n");
-				free(chn);
-				goto err_free_device;
-			}
+err_free_device:
+	free_device(dev);
 
-			chns[dev->nb_channels++] = chn;
-			dev->channels = chns;
-		} else if (!strcmp((char *) n->name, "attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEVICE);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "debug-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_DEBUG);
-			if (err < 0)
-				goto err_free_device;
-		} else if (!strcmp((char *) n->name, "buffer-attribute")) {
-			err = add_attr_to_device(dev, n, IIO_ATTR_TYPE_BUFFER);
-			if (err < 0)
-				goto err_free_device;
-		} else if (strcmp((char *) n->name, "text")) {
-			IIO_DEBUG("Unknown children \'%s\' in <device>\n",
-				  n->name);
-			continue;
-		}
-	}
+	return ERR_PTR(err);
+}
 
+static int add_device_to_context(struct iio_context *ctx,
+				 struct iio_device *dev)
+{
 	dev->words = (dev->nb_channels + 31) / 32;
 	if (dev->words) {
 		dev->mask = calloc(dev->words, sizeof(*dev->mask));
-		if (!dev->mask) {
-			err = -ENOMEM;
-			goto err_free_device;
-		}
+		if (!dev->mask)
+			return -ENOMEM;
 	}
 
-	return dev;
-
-err_free_device:
-	free_device(dev);
-
-	return ERR_PTR(err);
+	return iio_context_add_device(ctx, dev);
 }
 
 static struct iio_context * xml_clone(const struct iio_context *ctx)
@@ -348,16 +360,15 @@ static const struct iio_backend xml_backend = {
 	.ops = &xml_ops,
 };
 
-static int parse_context_attr(struct iio_context *ctx, xmlNode *n)
+static int parse_context_attr(struct iio_context *ctx, const char **atts)
 {
-	xmlAttr *attr;
 	const char *name = NULL, *value = NULL;
 
-	for (attr = n->properties; attr; attr = attr->next) {
-		if (!strcmp((const char *) attr->name, "name")) {
-			name = (const char *) attr->children->content;
-		} else if (!strcmp((const char *) attr->name, "value")) {
-			value = (const char *) attr->children->content;
+	for (; *atts; atts += 2) {
+		if (!strcmp(atts[0], "name")) {
+			name = atts[1];
+		} else if (!strcmp(atts[0], "value")) {
+			value = atts[1];
 		}
 	}
 
@@ -367,77 +378,29 @@ static int parse_context_attr(struct iio_context *ctx, xmlNode *n)
 		return iio_context_add_attr(ctx, name, value);
 }
 
-static int iio_populate_xml_context_helper(struct iio_context *ctx, xmlNode *root)
-{
-	xmlNode *n;
-	int err;
-
-	for (n = root->children; n; n = n->next) {
-		struct iio_device *dev;
-
-		if (!strcmp((char *) n->name, "context-attribute")) {
-			err = parse_context_attr(ctx, n);
-			if (err)
-				return err;
-
-			continue;
-		} else if (strcmp((char *) n->name, "device")) {
-			if (strcmp((char *) n->name, "text"))
-				IIO_DEBUG("Unknown children \'%s\' in "
-					  "<context>\n", n->name);
-			continue;
-		}
-
-		dev = create_device(ctx, n);
-		if (IS_ERR(dev)) {
-			err = PTR_ERR(dev);
-			IIO_ERROR("Unable to create device: %d\n", err);
-			return err;
-		}
-
-		err = iio_context_add_device(ctx, dev);
-		if (err) {
-			free(dev);
-			return err;
-		}
-	}
-
-	return iio_context_init(ctx);
-}
-
-static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
+static struct iio_context * create_context(const char **atts)
 {
 	const char *description = NULL, *git_tag = NULL, *content;
 	struct iio_context *ctx;
 	long major = 0, minor = 0;
-	xmlNode *root;
-	xmlAttr *attr;
 	char *end;
-	int err;
-
-	root = xmlDocGetRootElement(doc);
-	if (strcmp((char *) root->name, "context")) {
-		IIO_ERROR("Unrecognized XML file\n");
-		errno = EINVAL;
-		return NULL;
-	}
 
-	for (attr = root->properties; attr; attr = attr->next) {
-		content = (const char *) attr->children->content;
+	for (; *atts; atts += 2) {
+		content = atts[1];
 
-		if (!strcmp((char *) attr->name, "description")) {
+		if (!strcmp(atts[0], "description")) {
 			description = content;
-		} else if (!strcmp((char *) attr->name, "version-major")) {
+		} else if (!strcmp(atts[0], "version-major")) {
 			major = strtol(content, &end, 10);
 			if (*end != '\0')
 				IIO_WARNING("invalid format for major version\n");
-		} else if (!strcmp((char *) attr->name, "version-minor")) {
+		} else if (!strcmp(atts[0], "version-minor")) {
 			minor = strtol(content, &end, 10);
 			if (*end != '\0')
 				IIO_WARNING("invalid format for minor version\n");
-		} else if (!strcmp((char *) attr->name, "version-git")) {
+		} else if (!strcmp(atts[0], "version-git")) {
 			git_tag = content;
-		} else if (strcmp((char *) attr->name, "name")) {
+		} else if (strcmp(atts[0], "name")) {
 			IIO_DEBUG("Unknown parameter \'%s\' in <context>\n",
 				  content);
 		}
@@ -445,7 +408,7 @@ static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
 
 	ctx = iio_context_create_from_backend(&xml_backend, description);
 	if (!ctx)
-		return NULL;
+		return ERR_PTR(-errno);
 
 	if (git_tag) {
 		ctx->major = major;
@@ -454,59 +417,439 @@ static struct iio_context * iio_create_xml_context_helper(xmlDoc *doc)
 		ctx->git_tag = iio_strdup(git_tag);
 		if (!ctx->git_tag) {
 			iio_context_destroy(ctx);
-			errno = ENOMEM;
-			return NULL;
+			return ERR_PTR(-ENOMEM);
 		}
 	}
 
-	err = iio_populate_xml_context_helper(ctx, root);
-	if (err) {
-		iio_context_destroy(ctx);
-		errno = -err;
-		return NULL;
+	return ctx;
+}
+
+/* The predefined entities are replaced by the parser, but for '&', which
+ * is handed as a character reference */
+static size_t xml_copy_value(char *dst, const char *src, size_t len)
+{
+	static const char amp[] = "&#38;";
+	size_t i, j;
+
+	for (i = 0, j = 0; i < len; j++) {
+		if (src[i] == '&' && len - i >= sizeof(amp) - 1 &&
+		    !strncmp(&src[i], amp, sizeof(amp) - 1)) {
+			dst[j] = '&';
+			i += sizeof(amp) - 1;
+		} else {
+			dst[j] = src[i++];
+		}
 	}
 
-	return ctx;
+	dst[j] = '\0';
+	return j;
 }
 
-struct iio_context * xml_create_context(const char *xml_file)
+/* Copy the attributes, which the SAX2 interface hands as (localname,
+ * prefix, URI, value start, value end) tuples, as NUL-terminated strings */
+static int xml_load_attributes(struct xml_parser *p, int nb_attributes,
+			       const xmlChar **attributes)
+{
+	size_t len, size = 0, offsets[2 * XML_MAX_ATTRS];
+	unsigned int i, nb;
+	char *strings;
+
+	nb = nb_attributes < XML_MAX_ATTRS ? nb_attributes : XML_MAX_ATTRS;
+
+	for (i = 0; i < nb; i++) {
+		const xmlChar **attr = &attributes[i * 5];
+
+		size += strlen((const char *) attr[0]) + 1;
+		size += (size_t) (attr[4] - attr[3]) + 1;
+	}
+
+	if (size > p->strings_size) {
+		strings = realloc(p->strings, size);
+		if (!strings)
+			return -ENOMEM;
+
+		p->strings = strings;
+		p->strings_size = size;
+	}
+
+	for (i = 0, size = 0; i < nb; i++) {
+		const xmlChar **attr = &attributes[i * 5];
+
+		len = strlen((const char *) attr[0]);
+		memcpy(p->strings + size, attr[0], len + 1);
+		offsets[2 * i] = size;
+		size += len + 1;
+
+		len = xml_copy_value(p->strings + size, (const char *) attr[3],
+				     (size_t) (attr[4] - attr[3]));
+		offsets[2 * i + 1] = size;
+		size += len + 1;
+	}
+
+	for (i = 0; i < 2 * nb; i++)
+		p->atts[i] = p->strings + offsets[i];
+	p->atts[2 * nb] = NULL;
+
+	if ((unsigned int) nb_attributes > nb)
+		IIO_DEBUG("Too many attributes, ignoring the last ones\n");
+
+	return 0;
+}
+
+static int xml_handle_element(struct xml_parser *p, const char *name,
+			      const char **atts)
 {
 	struct iio_context *ctx;
-	xmlDoc *doc;
+	struct iio_channel *chn;
+	struct iio_device *dev;
+
+	switch (p->depth) {
+	case 1:
+		if (strcmp(name, "context")) {
+			IIO_ERROR("Unrecognized XML file\n");
+			return -EINVAL;
+		}
+
+		ctx = create_context(atts);
+		if (IS_ERR(ctx))
+			return PTR_ERR(ctx);
+
+		p->ctx = ctx;
+		return 0;
+	case 2:
+		if (!strcmp(name, "context-attribute"))
+			return parse_context_attr(p->ctx, atts);
+
+		if (strcmp(name, "device")) {
+			IIO_DEBUG("Unknown children \'%s\' in <context>\n",
+				  name);
+			return 0;
+		}
+
+		dev = create_device(p->ctx, atts);
+		if (IS_ERR(dev)) {
+			IIO_ERROR("Unable to create device: %d\n",
+				  PTR_ERR(dev));
+			return PTR_ERR(dev);
+		}
+
+		p->dev = dev;
+		return 0;
+	case 3:
+		if (!p->dev)
+			return 0;
+
+		if (!strcmp(name, "attribute"))
+			return add_attr_to_device(p->dev, atts,
+						  IIO_ATTR_TYPE_DEVICE);
+		if (!strcmp(name, "debug-attribute"))
+			return add_attr_to_device(p->dev, atts,
+						  IIO_ATTR_TYPE_DEBUG);
+		if (!strcmp(name, "buffer-attribute"))
+			return add_attr_to_device(p->dev, atts,
+						  IIO_ATTR_TYPE_BUFFER);
+
+		if (strcmp(name, "channel")) {
+			IIO_DEBUG("Unknown children \'%s\' in <device>\n",
+				  name);
+			return 0;
+		}
+
+		chn = create_channel(p->dev, atts);
+		if (IS_ERR(chn)) {
+			IIO_ERROR("Unable to create channel: %d\n",
+				  PTR_ERR(chn));
+			return PTR_ERR(chn);
+		}
+
+		p->chn = chn;
+		return 0;
+	case 4:
+		if (!p->chn)
+			return 0;
+
+		if (!strcmp(name, "attribute"))
+			return add_attr_to_channel(p->chn, atts);
+
+		if (!strcmp(name, "scan-element")) {
+			p->chn->is_scan_element = true;
+			return setup_scan_element(p->chn, atts);
+		}
+
+		IIO_DEBUG("Unknown children \'%s\' in <channel>\n", name);
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+static void xml_fail(struct xml_parser *p, int err)
+{
+	p->err = err;
+	xmlStopParser(p->xml);
+}
+
+static void xml_start_element(void *d, const xmlChar *localname,
+		const xmlChar *prefix, const xmlChar *URI, int nb_namespaces,
+		const xmlChar **namespaces, int nb_attributes,
+		int nb_defaulted, const xmlChar **attributes)
+{
+	struct xml_parser *p = d;
+	int ret;
+
+	if (p->err)
+		return;
+
+	p->depth++;
+
+	ret = xml_load_attributes(p, nb_attributes, attributes);
+	if (!ret)
+		ret = xml_handle_element(p, (const char *) localname, p->atts);
+	if (ret) {
+		if (p->depth >= 4 && p->chn)
+			IIO_ERROR("Unable to create channel: %d\n", ret);
+		if (p->depth >= 3 && p->dev)
+			IIO_ERROR("Unable to create device: %d\n", ret);
+
+		xml_fail(p, ret);
+	}
+}
+
+static void xml_end_element(void *d, const xmlChar *localname,
+		const xmlChar *prefix, const xmlChar *URI)
+{
+	struct xml_parser *p = d;
+	int ret = 0;
+
+	if (p->err)
+		return;
+
+	p->depth--;
+
+	if (p->depth == 2 && p->chn) {
+		ret = add_channel_to_device(p->dev, p->chn);
+		if (!ret)
+			p->chn = NULL;
+	} else if (p->depth == 1 && p->dev) {
+		ret = add_device_to_context(p->ctx, p->dev);
+		if (!ret)
+			p->dev = NULL;
+	}
+
+	if (ret)
+		xml_fail(p, ret);
+}
+
+#if LIBXML_VERSION >= 21200
+static void xml_error(void *d, const xmlError *error)
+#else
+static void xml_error(void *d, xmlErrorPtr error)
+#endif
+{
+	if (error->level == XML_ERR_WARNING)
+		IIO_WARNING("XML line %d: %s", error->line, error->message);
+	else
+		IIO_ERROR("XML line %d: %s", error->line, error->message);
+}
+
+static int xml_parser_init(struct xml_parser *p, const char *filename)
+{
+	static xmlSAXHandler handler = {
+		.initialized = XML_SAX2_MAGIC,
+		.startElementNs = xml_start_element,
+		.endElementNs = xml_end_element,
+		.serror = xml_error,
+	};
 
 	LIBXML_TEST_VERSION;
 
-	doc = xmlReadFile(xml_file, NULL, XML_PARSE_DTDVALID);
-	if (!doc) {
+	memset(p, 0, sizeof(*p));
+
+	p->xml = xmlCreatePushParserCtxt(&handler, p, NULL, 0, filename);
+	if (!p->xml)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int xml_parser_push(struct xml_parser *p, const char *xml,
+			   size_t len, bool last)
+{
+	int ret;
+
+	if (p->err)
+		return p->err;
+
+	ret = xmlParseChunk(p->xml, xml, (int) len, last);
+	if (p->err)
+		return p->err;
+
+	if (ret || !p->xml->wellFormed) {
 		IIO_ERROR("Unable to parse XML file\n");
-		errno = EINVAL;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Returns the context, or NULL with errno set */
+static struct iio_context * xml_parser_finish(struct xml_parser *p, int err)
+{
+	struct iio_context *ctx = p->ctx;
+
+	if (!err && !ctx) {
+		IIO_ERROR("Unrecognized XML file\n");
+		err = -EINVAL;
+	}
+
+	if (!err)
+		err = iio_context_init(ctx);
+
+	if (p->chn)
+		free_channel(p->chn);
+	if (p->dev)
+		free_device(p->dev);
+
+	xmlFreeParserCtxt(p->xml);
+	free(p->strings);
+
+	if (err) {
+		if (ctx)
+			iio_context_destroy(ctx);
+		errno = -err;
 		return NULL;
 	}
 
-	ctx = iio_create_xml_context_helper(doc);
-	xmlFreeDoc(doc);
 	return ctx;
 }
 
-struct iio_context * xml_create_context_mem(const char *xml, size_t len)
+struct iio_context * xml_create_context(const char *xml_file)
 {
-	struct iio_context *ctx;
-	xmlDoc *doc;
+	struct xml_parser p;
+	char *buf;
+	size_t len;
+	FILE *f;
+	int err;
 
-	LIBXML_TEST_VERSION;
+	f = fopen(xml_file, "r");
+	if (!f) {
+		err = errno;
+		IIO_ERROR("Unable to open XML file\n");
+		errno = err;
+		return NULL;
+	}
 
-	doc = xmlReadMemory(xml, (int) len, NULL, NULL, XML_PARSE_DTDVALID);
-	if (!doc) {
-		IIO_ERROR("Unable to parse XML file\n");
-		errno = EINVAL;
+	buf = malloc(XML_CHUNK_SIZE);
+	if (!buf) {
+		err = -ENOMEM;
+		goto err_close_file;
+	}
+
+	err = xml_parser_init(&p, xml_file);
+	if (err)
+		goto err_free_buf;
+
+	do {
+		len = fread(buf, 1, XML_CHUNK_SIZE, f);
+		if (ferror(f)) {
+			err = -EIO;
+			break;
+		}
+
+		err = xml_parser_push(&p, buf, len, feof(f));
+	} while (!err && !feof(f));
+
+	free(buf);
+	fclose(f);
+
+	return xml_parser_finish(&p, err);
+
+err_free_buf:
+	free(buf);
+err_close_file:
+	fclose(f);
+	errno = -err;
+	return NULL;
+}
+
+struct iio_context * xml_create_context_mem(const char *xml, size_t len)
+{
+	struct xml_parser p;
+	int err;
+
+	err = xml_parser_init(&p, NULL);
+	if (err) {
+		errno = -err;
 		return NULL;
 	}
 
-	ctx = iio_create_xml_context_helper(doc);
-	xmlFreeDoc(doc);
-	return ctx;
+	err = xml_parser_push(&p, xml, len, true);
+
+	return xml_parser_finish(&p, err);
 }
 
+#if WITH_ZSTD
+struct iio_context * xml_create_context_zstd(const void *src, size_t len)
+{
+	ZSTD_inBuffer in = { .src = src, .size = len, };
+	ZSTD_outBuffer out;
+	struct xml_parser p;
+	ZSTD_DStream *zstd;
+	size_t ret = 1;
+	int err;
+
+	zstd = ZSTD_createDStream();
+	if (!zstd) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	out.size = ZSTD_DStreamOutSize();
+	out.dst = malloc(out.size);
+	if (!out.dst) {
+		err = -ENOMEM;
+		goto err_free_dstream;
+	}
+
+	err = xml_parser_init(&p, NULL);
+	if (err)
+		goto err_free_out;
+
+	/* Parse the XML as it is uncompressed, one chunk at a time */
+	while (!err && ret) {
+		out.pos = 0;
+
+		ret = ZSTD_decompressStream(zstd, &out, &in);
+		if (ZSTD_isError(ret)) {
+			IIO_ERROR("Unable to decompress ZSTD data: %s\n",
+				  ZSTD_getErrorName(ret));
+			err = -EIO;
+			break;
+		}
+
+		if (!ret || out.pos)
+			err = xml_parser_push(&p, out.dst, out.pos, !ret);
+
+		/* Truncated frame */
+		if (ret && !out.pos && in.pos == in.size) {
+			IIO_ERROR("Truncated ZSTD data\n");
+			err = -EIO;
+		}
+	}
+
+	free(out.dst);
+	ZSTD_freeDStream(zstd);
+
+	return xml_parser_finish(&p, err);
+
+err_free_out:
+	free(out.dst);
+err_free_dstream:
+	ZSTD_freeDStream(zstd);
+	errno = -err;
+	return NULL;
+}
+#endif
 
 static void cleanup_libxml2_stuff(void)
 {